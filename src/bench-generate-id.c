@@ -0,0 +1,99 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "pcx-generate-id.h"
+#include "pcx-netaddress.h"
+
+/* Compares the time to generate IDs with the buffered ChaCha20
+ * generator against the previous implementation which read from
+ * /dev/urandom for every ID.
+ */
+
+#define N_IDS 200000
+
+static uint64_t
+legacy_generate_id(void)
+{
+        uint64_t id = 0;
+        int fd = open("/dev/urandom", O_RDONLY);
+
+        if (fd != -1) {
+                if (read(fd, &id, sizeof id) != sizeof id)
+                        id = rand();
+                close(fd);
+        }
+
+        return id;
+}
+
+static double
+get_time(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+report(const char *name,
+       double start,
+       double end)
+{
+        printf("%-8s %10.1f ns/id %12.0f ids/s\n",
+               name,
+               (end - start) * 1e9 / N_IDS,
+               N_IDS / (end - start));
+}
+
+int
+main(int argc, char **argv)
+{
+        struct pcx_netaddress address;
+        uint64_t sum = 0;
+
+        pcx_netaddress_from_string(&address, "192.168.1.1", 1234);
+
+        double start = get_time();
+
+        for (int i = 0; i < N_IDS; i++)
+                sum ^= legacy_generate_id();
+
+        double mid = get_time();
+
+        for (int i = 0; i < N_IDS; i++)
+                sum ^= pcx_generate_id(-1, &address);
+
+        double end = get_time();
+
+        report("urandom", start, mid);
+        report("chacha20", mid, end);
+
+        /* Use the result so that the loops can’t be optimised away */
+        return sum == 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
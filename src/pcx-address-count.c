@@ -0,0 +1,206 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "pcx-address-count.h"
+
+#include <assert.h>
+#include <sys/socket.h>
+
+#include "pcx-util.h"
+
+#define MIN_HASH_SIZE 8
+
+struct pcx_address_count_entry {
+        struct pcx_address_count_entry *hash_next;
+
+        short int family;
+        uint64_t key;
+
+        int count;
+};
+
+struct pcx_address_count {
+        int n_entries;
+        int hash_size;
+        struct pcx_address_count_entry **hash_table;
+};
+
+struct pcx_address_count *
+pcx_address_count_new(void)
+{
+        struct pcx_address_count *count = pcx_calloc(sizeof *count);
+
+        count->hash_size = MIN_HASH_SIZE;
+        count->hash_table = pcx_calloc(count->hash_size *
+                                       sizeof *count->hash_table);
+
+        return count;
+}
+
+static bool
+is_counted(const struct pcx_netaddress *address)
+{
+        return address->family == AF_INET || address->family == AF_INET6;
+}
+
+static struct pcx_address_count_entry **
+get_bucket(struct pcx_address_count *count,
+           uint64_t key)
+{
+        return (count->hash_table +
+                (pcx_hash_uint64(key) & (count->hash_size - 1)));
+}
+
+static void
+resize_hash_table(struct pcx_address_count *count,
+                  int new_size)
+{
+        struct pcx_address_count_entry **old_table = count->hash_table;
+        int old_size = count->hash_size;
+
+        count->hash_size = new_size;
+        count->hash_table = pcx_calloc(new_size * sizeof *count->hash_table);
+
+        for (int i = 0; i < old_size; i++) {
+                struct pcx_address_count_entry *entry, *next;
+
+                for (entry = old_table[i]; entry; entry = next) {
+                        struct pcx_address_count_entry **bucket =
+                                get_bucket(count, entry->key);
+
+                        next = entry->hash_next;
+                        entry->hash_next = *bucket;
+                        *bucket = entry;
+                }
+        }
+
+        pcx_free(old_table);
+}
+
+/* Returns a pointer to the link that points to the entry for the
+ * address. The link points to NULL if there isn’t one.
+ */
+static struct pcx_address_count_entry **
+find_entry(struct pcx_address_count *count,
+           const struct pcx_netaddress *address)
+{
+        uint64_t key = pcx_netaddress_get_client_key(address);
+        struct pcx_address_count_entry **prev = get_bucket(count, key);
+
+        while (*prev) {
+                if ((*prev)->key == key && (*prev)->family == address->family)
+                        break;
+
+                prev = &(*prev)->hash_next;
+        }
+
+        return prev;
+}
+
+int
+pcx_address_count_get(struct pcx_address_count *count,
+                      const struct pcx_netaddress *address)
+{
+        if (!is_counted(address))
+                return 0;
+
+        struct pcx_address_count_entry *entry = *find_entry(count, address);
+
+        return entry ? entry->count : 0;
+}
+
+void
+pcx_address_count_increment(struct pcx_address_count *count,
+                            const struct pcx_netaddress *address)
+{
+        if (!is_counted(address))
+                return;
+
+        struct pcx_address_count_entry **prev = find_entry(count, address);
+
+        if (*prev) {
+                (*prev)->count++;
+                return;
+        }
+
+        if (count->n_entries + 1 > count->hash_size * 3 / 4) {
+                resize_hash_table(count, count->hash_size * 2);
+                prev = find_entry(count, address);
+        }
+
+        struct pcx_address_count_entry *entry = pcx_alloc(sizeof *entry);
+
+        entry->family = address->family;
+        entry->key = pcx_netaddress_get_client_key(address);
+        entry->count = 1;
+        entry->hash_next = NULL;
+        *prev = entry;
+
+        count->n_entries++;
+}
+
+void
+pcx_address_count_decrement(struct pcx_address_count *count,
+                            const struct pcx_netaddress *address)
+{
+        if (!is_counted(address))
+                return;
+
+        struct pcx_address_count_entry **prev = find_entry(count, address);
+        struct pcx_address_count_entry *entry = *prev;
+
+        assert(entry && entry->count > 0);
+
+        if (--entry->count > 0)
+                return;
+
+        *prev = entry->hash_next;
+        pcx_free(entry);
+        count->n_entries--;
+
+        /* Halving at a quarter full leaves enough room so that
+         * adding and removing one address can’t keep resizing.
+         */
+        if (count->hash_size > MIN_HASH_SIZE &&
+            count->n_entries < count->hash_size / 4)
+                resize_hash_table(count, count->hash_size / 2);
+}
+
+int
+pcx_address_count_get_n_addresses(struct pcx_address_count *count)
+{
+        return count->n_entries;
+}
+
+void
+pcx_address_count_free(struct pcx_address_count *count)
+{
+        for (int i = 0; i < count->hash_size; i++) {
+                struct pcx_address_count_entry *entry, *next;
+
+                for (entry = count->hash_table[i]; entry; entry = next) {
+                        next = entry->hash_next;
+                        pcx_free(entry);
+                }
+        }
+
+        pcx_free(count->hash_table);
+        pcx_free(count);
+}
@@ -0,0 +1,58 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef PCX_ADDRESS_COUNT_H
+#define PCX_ADDRESS_COUNT_H
+
+#include "pcx-netaddress.h"
+
+/* A count of things that belong to each remote IP address, such as
+ * the number of players that it created. The addresses are grouped
+ * the same way as for pcx_rate_limit. Addresses that aren’t IPv4 or
+ * IPv6 aren’t counted. Entries are removed as soon as their count
+ * drops back to zero so the memory used only depends on the number
+ * of things being counted.
+ */
+
+struct pcx_address_count;
+
+struct pcx_address_count *
+pcx_address_count_new(void);
+
+int
+pcx_address_count_get(struct pcx_address_count *count,
+                      const struct pcx_netaddress *address);
+
+void
+pcx_address_count_increment(struct pcx_address_count *count,
+                            const struct pcx_netaddress *address);
+
+/* The count for the address must be greater than zero */
+void
+pcx_address_count_decrement(struct pcx_address_count *count,
+                            const struct pcx_netaddress *address);
+
+/* Returns the number of addresses with a non-zero count */
+int
+pcx_address_count_get_n_addresses(struct pcx_address_count *count);
+
+void
+pcx_address_count_free(struct pcx_address_count *count);
+
+#endif /* PCX_ADDRESS_COUNT_H */
@@ -0,0 +1,424 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "pcx-admin.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "pcx-util.h"
+#include "pcx-list.h"
+#include "pcx-log.h"
+#include "pcx-main-context.h"
+#include "pcx-socket.h"
+#include "pcx-listen-socket.h"
+
+/* Commands are asked for more output until there is at least this
+ * much waiting to be sent.
+ */
+#define OUTPUT_CHUNK_SIZE 4096
+
+/* Connections that send a longer line than this are closed */
+#define MAX_LINE_LENGTH 1024
+
+struct pcx_admin_command_group {
+        struct pcx_list link;
+        const struct pcx_admin_command *commands;
+        size_t n_commands;
+        void *user_data;
+};
+
+struct pcx_admin {
+        int listen_sock;
+        struct pcx_main_context_source *listen_source;
+
+        /* List of pcx_admin_command_group */
+        struct pcx_list command_groups;
+
+        struct pcx_list connections;
+};
+
+struct pcx_admin_connection {
+        struct pcx_list link;
+        struct pcx_admin *admin;
+        int sock;
+        struct pcx_main_context_source *source;
+
+        struct pcx_buffer in_buf;
+        bool read_closed;
+
+        struct pcx_buffer out_buf;
+        size_t out_pos;
+
+        /* The command that is still writing its response or NULL */
+        const struct pcx_admin_command *command;
+        void *command_user_data;
+        uint64_t cursor;
+        /* The arguments for the command. The command can be called
+         * several times after the line has been removed from in_buf
+         * so they are copied here.
+         */
+        struct pcx_buffer args;
+        struct pcx_buffer state;
+};
+
+static void
+free_connection(struct pcx_admin_connection *conn)
+{
+        pcx_main_context_remove_source(conn->source);
+        pcx_close(conn->sock);
+        pcx_buffer_destroy(&conn->in_buf);
+        pcx_buffer_destroy(&conn->out_buf);
+        pcx_buffer_destroy(&conn->args);
+        pcx_buffer_destroy(&conn->state);
+        pcx_list_remove(&conn->link);
+        pcx_free(conn);
+}
+
+static const struct pcx_admin_command *
+find_command(struct pcx_admin *admin,
+             const char *name,
+             size_t name_length,
+             void **user_data)
+{
+        const struct pcx_admin_command_group *group;
+
+        pcx_list_for_each(group, &admin->command_groups, link) {
+                for (size_t i = 0; i < group->n_commands; i++) {
+                        const char *command_name = group->commands[i].name;
+
+                        if (strlen(command_name) == name_length &&
+                            !memcmp(command_name, name, name_length)) {
+                                *user_data = group->user_data;
+                                return group->commands + i;
+                        }
+                }
+        }
+
+        return NULL;
+}
+
+static void
+write_help(struct pcx_admin *admin,
+           struct pcx_buffer *buf)
+{
+        const struct pcx_admin_command_group *group;
+
+        pcx_buffer_append_string(buf, "help\n");
+
+        pcx_list_for_each(group, &admin->command_groups, link) {
+                for (size_t i = 0; i < group->n_commands; i++) {
+                        pcx_buffer_append_printf(buf,
+                                                 "%s\n",
+                                                 group->commands[i].help);
+                }
+        }
+}
+
+static void
+start_command(struct pcx_admin_connection *conn,
+              const char *line,
+              size_t length)
+{
+        while (length > 0 && strchr(" \t\r", line[length - 1]))
+                length--;
+        while (length > 0 && strchr(" \t", *line)) {
+                line++;
+                length--;
+        }
+
+        /* Empty lines are ignored so that they can be used to check
+         * that the connection is still alive.
+         */
+        if (length == 0) {
+                pcx_buffer_append_c(&conn->out_buf, '\n');
+                return;
+        }
+
+        const char *name_end = memchr(line, ' ', length);
+        size_t name_length = name_end ? name_end - line : length;
+
+        if (name_length == 4 && !memcmp(line, "help", 4)) {
+                write_help(conn->admin, &conn->out_buf);
+                pcx_buffer_append_c(&conn->out_buf, '\n');
+                return;
+        }
+
+        conn->command = find_command(conn->admin,
+                                     line,
+                                     name_length,
+                                     &conn->command_user_data);
+
+        if (conn->command == NULL) {
+                pcx_buffer_append_string(&conn->out_buf,
+                                         "error: unknown command “");
+                pcx_buffer_append(&conn->out_buf, line, name_length);
+                pcx_buffer_append_string(&conn->out_buf, "”\n\n");
+                return;
+        }
+
+        const char *args = line + name_length;
+        size_t args_length = length - name_length;
+
+        while (args_length > 0 && strchr(" \t", *args)) {
+                args++;
+                args_length--;
+        }
+
+        pcx_buffer_set_length(&conn->args, 0);
+        pcx_buffer_append(&conn->args, args, args_length);
+        pcx_buffer_append_c(&conn->args, '\0');
+
+        conn->cursor = 0;
+        pcx_buffer_set_length(&conn->state, 0);
+}
+
+static bool
+take_line(struct pcx_admin_connection *conn)
+{
+        const uint8_t *end = memchr(conn->in_buf.data,
+                                    '\n',
+                                    conn->in_buf.length);
+
+        if (end == NULL)
+                return false;
+
+        size_t line_length = end - conn->in_buf.data;
+
+        start_command(conn, (const char *) conn->in_buf.data, line_length);
+
+        memmove(conn->in_buf.data,
+                end + 1,
+                conn->in_buf.length - line_length - 1);
+        conn->in_buf.length -= line_length + 1;
+
+        return true;
+}
+
+/* Runs the commands until there is enough output to send or there is
+ * nothing left to do. Returns false if the connection was freed.
+ */
+static bool
+fill_output(struct pcx_admin_connection *conn)
+{
+        while (conn->out_buf.length - conn->out_pos < OUTPUT_CHUNK_SIZE) {
+                if (conn->command) {
+                        const char *args = (const char *) conn->args.data;
+
+                        if (!conn->command->cb(args,
+                                               &conn->cursor,
+                                               &conn->state,
+                                               &conn->out_buf,
+                                               conn->command_user_data)) {
+                                conn->command = NULL;
+                                pcx_buffer_append_c(&conn->out_buf, '\n');
+                        }
+                } else if (!take_line(conn)) {
+                        break;
+                }
+        }
+
+        enum pcx_main_context_poll_flags flags = 0;
+
+        if (conn->out_buf.length > conn->out_pos) {
+                flags |= PCX_MAIN_CONTEXT_POLL_OUT;
+        } else if (conn->read_closed) {
+                free_connection(conn);
+                return false;
+        } else {
+                /* Don’t read any more commands until the response
+                 * to the last one has been sent.
+                 */
+                flags |= PCX_MAIN_CONTEXT_POLL_IN;
+        }
+
+        pcx_main_context_modify_poll(conn->source, flags);
+
+        return true;
+}
+
+static void
+write_connection(struct pcx_admin_connection *conn)
+{
+        ssize_t wrote = send(conn->sock,
+                             conn->out_buf.data + conn->out_pos,
+                             conn->out_buf.length - conn->out_pos,
+                             MSG_DONTWAIT | MSG_NOSIGNAL);
+
+        if (wrote == -1) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                        return;
+
+                free_connection(conn);
+                return;
+        }
+
+        conn->out_pos += wrote;
+
+        if (conn->out_pos >= conn->out_buf.length) {
+                pcx_buffer_set_length(&conn->out_buf, 0);
+                conn->out_pos = 0;
+        }
+
+        fill_output(conn);
+}
+
+static void
+read_connection(struct pcx_admin_connection *conn)
+{
+        pcx_buffer_ensure_size(&conn->in_buf, conn->in_buf.length + 1024);
+
+        ssize_t got = read(conn->sock,
+                           conn->in_buf.data + conn->in_buf.length,
+                           conn->in_buf.size - conn->in_buf.length);
+
+        if (got == -1) {
+                if (errno == EAGAIN || errno == EINTR)
+                        return;
+
+                free_connection(conn);
+                return;
+        }
+
+        if (got == 0) {
+                conn->read_closed = true;
+                /* Let a last command without a newline still run */
+                if (conn->in_buf.length > 0)
+                        pcx_buffer_append_c(&conn->in_buf, '\n');
+        } else {
+                conn->in_buf.length += got;
+        }
+
+        if (!fill_output(conn))
+                return;
+
+        if (conn->in_buf.length > MAX_LINE_LENGTH)
+                free_connection(conn);
+}
+
+static void
+connection_cb(struct pcx_main_context_source *source,
+              int fd,
+              enum pcx_main_context_poll_flags flags,
+              void *user_data)
+{
+        struct pcx_admin_connection *conn = user_data;
+
+        if ((flags & PCX_MAIN_CONTEXT_POLL_OUT))
+                write_connection(conn);
+        else
+                read_connection(conn);
+}
+
+static void
+listen_cb(struct pcx_main_context_source *source,
+          int fd,
+          enum pcx_main_context_poll_flags flags,
+          void *user_data)
+{
+        struct pcx_admin *admin = user_data;
+
+        int sock = accept(admin->listen_sock, NULL, NULL);
+
+        if (sock == -1)
+                return;
+
+        if (!pcx_socket_set_nonblock(sock, NULL)) {
+                pcx_close(sock);
+                return;
+        }
+
+        struct pcx_admin_connection *conn = pcx_calloc(sizeof *conn);
+
+        conn->admin = admin;
+        conn->sock = sock;
+        pcx_buffer_init(&conn->in_buf);
+        pcx_buffer_init(&conn->out_buf);
+        pcx_buffer_init(&conn->args);
+        pcx_buffer_init(&conn->state);
+        conn->source = pcx_main_context_add_poll(NULL,
+                                                 sock,
+                                                 PCX_MAIN_CONTEXT_POLL_IN,
+                                                 connection_cb,
+                                                 conn);
+
+        pcx_list_insert(admin->connections.prev, &conn->link);
+}
+
+struct pcx_admin *
+pcx_admin_new(const char *path,
+              struct pcx_error **error)
+{
+        int sock = pcx_listen_socket_create_for_path(path, error);
+
+        if (sock == -1)
+                return NULL;
+
+        struct pcx_admin *admin = pcx_calloc(sizeof *admin);
+
+        admin->listen_sock = sock;
+        pcx_list_init(&admin->command_groups);
+        pcx_list_init(&admin->connections);
+
+        admin->listen_source =
+                pcx_main_context_add_poll(NULL,
+                                          sock,
+                                          PCX_MAIN_CONTEXT_POLL_IN,
+                                          listen_cb,
+                                          admin);
+
+        return admin;
+}
+
+void
+pcx_admin_add_commands(struct pcx_admin *admin,
+                       const struct pcx_admin_command *commands,
+                       size_t n_commands,
+                       void *user_data)
+{
+        struct pcx_admin_command_group *group = pcx_alloc(sizeof *group);
+
+        group->commands = commands;
+        group->n_commands = n_commands;
+        group->user_data = user_data;
+
+        pcx_list_insert(admin->command_groups.prev, &group->link);
+}
+
+void
+pcx_admin_free(struct pcx_admin *admin)
+{
+        struct pcx_admin_connection *conn, *tmp_conn;
+
+        pcx_list_for_each_safe(conn, tmp_conn, &admin->connections, link)
+                free_connection(conn);
+
+        struct pcx_admin_command_group *group, *tmp_group;
+
+        pcx_list_for_each_safe(group, tmp_group, &admin->command_groups, link)
+                pcx_free(group);
+
+        pcx_main_context_remove_source(admin->listen_source);
+        pcx_close(admin->listen_sock);
+
+        pcx_free(admin);
+}
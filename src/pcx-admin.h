@@ -0,0 +1,76 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PCX_ADMIN_H
+#define PCX_ADMIN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "pcx-buffer.h"
+#include "pcx-error.h"
+
+/* A Unix socket that accepts commands one per line. Each command
+ * writes some lines of text and the response is ended with an empty
+ * line.
+ */
+
+struct pcx_admin;
+
+/* Called to write the response to a command. The args are the rest of
+ * the line after the command name with the spaces trimmed. The cursor
+ * starts at zero and the command can use it to remember where it got
+ * to. If the command returns true then it will be called again with
+ * the same cursor once the client has read what was written so far.
+ * That way a long list can be sent in pieces without blocking the
+ * main loop or filling up the memory. The state buffer is empty at
+ * the start of each command and is kept between the calls, for
+ * example to hold a copy of the IDs of a list. It is freed with the
+ * connection so it can’t hold references to anything. None of the
+ * lines can be empty.
+ */
+typedef bool
+(* pcx_admin_command_cb)(const char *args,
+                         uint64_t *cursor,
+                         struct pcx_buffer *state,
+                         struct pcx_buffer *buf,
+                         void *user_data);
+
+struct pcx_admin_command {
+        const char *name;
+        /* Shown by the help command */
+        const char *help;
+        pcx_admin_command_cb cb;
+};
+
+struct pcx_admin *
+pcx_admin_new(const char *path,
+              struct pcx_error **error);
+
+/* The array of commands isn’t copied so it should be static. */
+void
+pcx_admin_add_commands(struct pcx_admin *admin,
+                       const struct pcx_admin_command *commands,
+                       size_t n_commands,
+                       void *user_data);
+
+void
+pcx_admin_free(struct pcx_admin *admin);
+
+#endif /* PCX_ADMIN_H */
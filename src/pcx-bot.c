@@ -39,6 +39,7 @@
 #include "pcx-curl-multi.h"
 #include "pcx-message-queue.h"
 #include "pcx-log.h"
+#include "pcx-stats-log.h"
 
 #define GAME_TIMEOUT (5 * 60 * 1000)
 #define IN_GAME_TIMEOUT (GAME_TIMEOUT * 2)
@@ -58,6 +59,8 @@ struct game {
         struct pcx_bot *bot;
         const struct pcx_game *type;
         char letter_id;
+        /* Monotonic clock when the game started for the stats */
+        uint64_t start_time;
 };
 
 struct pcx_bot {
@@ -86,6 +89,9 @@ struct pcx_bot {
         struct pcx_main_context_source *start_request_source;
         struct pcx_list queued_requests;
         struct json_tokener *request_tokener;
+        /* Monotonic time that the current request was started */
+        uint64_t request_start_time;
+        struct pcx_metrics_histogram request_time;
 
         /* Messages are stored in a separate queue so that we can
          * rate-limit them per chat.
@@ -96,6 +102,8 @@ struct pcx_bot {
         struct pcx_buffer known_ids;
 
         unsigned next_id;
+
+        bool draining;
 };
 
 struct request {
@@ -279,6 +287,10 @@ request_finished_cb(CURLcode code,
                     void *user_data)
 {
         struct pcx_bot *bot = user_data;
+        uint64_t now = pcx_main_context_get_monotonic_clock(NULL);
+
+        pcx_metrics_histogram_observe(&bot->request_time,
+                                      now - bot->request_start_time);
 
         if (code != CURLE_OK) {
                 pcx_log("%s: request failed: %s",
@@ -324,6 +336,8 @@ start_request_cb(struct pcx_main_context_source *source,
 
         set_post_json_data(bot, bot->request_handle, request->args);
 
+        bot->request_start_time = pcx_main_context_get_monotonic_clock(NULL);
+
         pcx_curl_multi_add_handle(bot->pcurl,
                                   bot->request_handle,
                                   request_finished_cb,
@@ -648,6 +662,18 @@ remove_game(struct pcx_bot *bot,
         pcx_free(game);
 }
 
+static void
+log_game_stats(struct game *game,
+               enum pcx_stats_event event)
+{
+        pcx_stats_log_add(event,
+                          PCX_STATS_SOURCE_TELEGRAM,
+                          game->type,
+                          game->bot->bot_config->language,
+                          game->n_players,
+                          game->start_time);
+}
+
 static void
 game_timeout_cb(struct pcx_main_context_source *source,
                 void *user_data)
@@ -681,6 +707,7 @@ game_timeout_cb(struct pcx_main_context_source *source,
                 if (game->game) {
                         pcx_log("game %c timed out after starting",
                                 game->letter_id);
+                        log_game_stats(game, PCX_STATS_EVENT_ABANDON);
                 } else {
                         pcx_log("game %c timed out without starting",
                                 game->letter_id);
@@ -760,6 +787,7 @@ game_over_cb(void *user_data)
 {
         struct game *game = user_data;
         pcx_log("game %c finished successfully", game->letter_id);
+        log_game_stats(game, PCX_STATS_EVENT_END);
         remove_game(game->bot, game);
 }
 
@@ -1248,6 +1276,12 @@ process_create_game(struct pcx_bot *bot,
                 return;
         }
 
+        if (bot->draining) {
+                pcx_log("%s: not starting a new game while draining",
+                        bot->bot_config->botname);
+                return;
+        }
+
         if (!check_id_valid_for_game(bot, game_type, info))
                 return;
 
@@ -1332,6 +1366,9 @@ start_game(struct pcx_bot *bot,
 
         pcx_free(names);
 
+        game->start_time = pcx_main_context_get_monotonic_clock(NULL);
+        log_game_stats(game, PCX_STATS_EVENT_START);
+
         set_game_timeout(game);
 }
 
@@ -1390,6 +1427,8 @@ process_cancel(struct pcx_bot *bot,
                 if (find_player_in_game(game, info->from_id) != -1) {
                         response = PCX_TEXT_STRING_CANCELED;
                         pcx_log("game %c was cancelled", game->letter_id);
+                        if (game->game)
+                                log_game_stats(game, PCX_STATS_EVENT_ABANDON);
                         remove_game(bot, game);
                 } else {
                         response = PCX_TEXT_STRING_CANT_CANCEL;
@@ -2085,6 +2124,23 @@ pcx_bot_get_n_running_games(struct pcx_bot *bot)
         return pcx_list_length(&bot->games);
 }
 
+void
+pcx_bot_set_draining(struct pcx_bot *bot,
+                     bool draining)
+{
+        bot->draining = draining;
+}
+
+void
+pcx_bot_get_stats(struct pcx_bot *bot,
+                  struct pcx_bot_stats *stats)
+{
+        stats->n_queued_requests =
+                pcx_list_length(&bot->queued_requests) +
+                pcx_message_queue_get_length(bot->message_queue);
+        stats->request_time = bot->request_time;
+}
+
 void
 pcx_bot_free(struct pcx_bot *bot)
 {
@@ -19,12 +19,22 @@
 #ifndef PCX_BOT_H
 #define PCX_BOT_H
 
+#include <stdbool.h>
+
 #include "pcx-curl-multi.h"
 #include "pcx-config.h"
 #include "pcx-class-store.h"
+#include "pcx-metrics.h"
 
 struct pcx_bot;
 
+struct pcx_bot_stats {
+        /* Requests and messages waiting to be sent to Telegram */
+        size_t n_queued_requests;
+        /* Time from starting each request until Telegram replied */
+        struct pcx_metrics_histogram request_time;
+};
+
 struct pcx_bot *
 pcx_bot_new(const struct pcx_config *config,
             const struct pcx_config_bot *bot_config,
@@ -34,6 +44,15 @@ pcx_bot_new(const struct pcx_config *config,
 int
 pcx_bot_get_n_running_games(struct pcx_bot *bot);
 
+/* While draining the bot won’t start any new games */
+void
+pcx_bot_set_draining(struct pcx_bot *bot,
+                     bool draining);
+
+void
+pcx_bot_get_stats(struct pcx_bot *bot,
+                  struct pcx_bot_stats *stats);
+
 void
 pcx_bot_free(struct pcx_bot *bot);
 
@@ -0,0 +1,93 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "pcx-chacha20.h"
+
+#include <string.h>
+
+#include "pcx-util.h"
+
+#define ROTL32(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define QUARTER_ROUND(a, b, c, d)                       \
+        do {                                            \
+                a += b; d ^= a; d = ROTL32(d, 16);      \
+                c += d; b ^= c; b = ROTL32(b, 12);      \
+                a += b; d ^= a; d = ROTL32(d, 8);       \
+                c += d; b ^= c; b = ROTL32(b, 7);       \
+        } while (0)
+
+static uint32_t
+load_uint32(const uint8_t *p)
+{
+        uint32_t value;
+        memcpy(&value, p, sizeof value);
+        return PCX_UINT32_FROM_LE(value);
+}
+
+static void
+store_uint32(uint8_t *p, uint32_t value)
+{
+        value = PCX_UINT32_TO_LE(value);
+        memcpy(p, &value, sizeof value);
+}
+
+void
+pcx_chacha20_block(const uint8_t key[PCX_CHACHA20_KEY_SIZE],
+                   uint32_t counter,
+                   const uint8_t nonce[PCX_CHACHA20_NONCE_SIZE],
+                   uint8_t out[PCX_CHACHA20_BLOCK_SIZE])
+{
+        uint32_t state[16];
+
+        /* “expand 32-byte k” */
+        state[0] = UINT32_C(0x61707865);
+        state[1] = UINT32_C(0x3320646e);
+        state[2] = UINT32_C(0x79622d32);
+        state[3] = UINT32_C(0x6b206574);
+
+        for (int i = 0; i < 8; i++)
+                state[4 + i] = load_uint32(key + i * 4);
+
+        state[12] = counter;
+
+        for (int i = 0; i < 3; i++)
+                state[13 + i] = load_uint32(nonce + i * 4);
+
+        uint32_t x[16];
+
+        memcpy(x, state, sizeof x);
+
+        for (int i = 0; i < 10; i++) {
+                /* Column round */
+                QUARTER_ROUND(x[0], x[4], x[8], x[12]);
+                QUARTER_ROUND(x[1], x[5], x[9], x[13]);
+                QUARTER_ROUND(x[2], x[6], x[10], x[14]);
+                QUARTER_ROUND(x[3], x[7], x[11], x[15]);
+                /* Diagonal round */
+                QUARTER_ROUND(x[0], x[5], x[10], x[15]);
+                QUARTER_ROUND(x[1], x[6], x[11], x[12]);
+                QUARTER_ROUND(x[2], x[7], x[8], x[13]);
+                QUARTER_ROUND(x[3], x[4], x[9], x[14]);
+        }
+
+        for (int i = 0; i < 16; i++)
+                store_uint32(out + i * 4, x[i] + state[i]);
+}
@@ -0,0 +1,37 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PCX_CHACHA20_H
+#define PCX_CHACHA20_H
+
+#include <stdint.h>
+
+#define PCX_CHACHA20_KEY_SIZE 32
+#define PCX_CHACHA20_NONCE_SIZE 12
+#define PCX_CHACHA20_BLOCK_SIZE 64
+
+/* Generates one block of the ChaCha20 keystream as described in RFC
+ * 8439.
+ */
+void
+pcx_chacha20_block(const uint8_t key[PCX_CHACHA20_KEY_SIZE],
+                   uint32_t counter,
+                   const uint8_t nonce[PCX_CHACHA20_NONCE_SIZE],
+                   uint8_t out[PCX_CHACHA20_BLOCK_SIZE]);
+
+#endif /* PCX_CHACHA20_H */
@@ -40,6 +40,8 @@
 #define PCX_CHAMELEON_MIN_PLAYERS 4
 #define PCX_CHAMELEON_MAX_PLAYERS 6
 
+#define VOTE_TIMEOUT (1 * 60 * 1000)
+
 struct pcx_chameleon_player {
         char *name;
         struct pcx_buffer guess;
@@ -85,15 +87,11 @@ struct pcx_chameleon {
         /* Bitmask of players that have voted */
         int voted_players;
 
-        /* Number of words in the group the last time we sent sideband
-         * data. This is used so that if the next group has fewer
-         * words then we’ll clear the extra ones.
-         */
-        int last_group_size;
-
         const struct pcx_chameleon_list_word *secret_word;
 
         struct pcx_main_context_source *vote_timeout;
+        /* Monotonic time when vote_timeout was added */
+        uint64_t vote_timeout_start;
         struct pcx_game_button *vote_buttons;
 
         struct pcx_game_button start_round_button;
@@ -105,6 +103,10 @@ struct pcx_chameleon {
 static void
 start_vote_timeout(struct pcx_chameleon *chameleon);
 
+static void
+add_vote_timeout(struct pcx_chameleon *chameleon,
+                 int elapsed_ms);
+
 static void
 escape_string(struct pcx_chameleon *chameleon,
               struct pcx_buffer *buf,
@@ -352,37 +354,36 @@ send_topic_sideband_data(struct pcx_chameleon *chameleon)
 static void
 send_word_list_sideband_data(struct pcx_chameleon *chameleon)
 {
-        int word_count = 0;
+        struct pcx_buffer words = PCX_BUFFER_STATIC_INIT;
 
         const struct pcx_chameleon_list_word *word;
 
         pcx_list_for_each(word, &chameleon->current_group->words, link) {
-                struct pcx_game_sideband_data data = {
-                        .type = PCX_GAME_SIDEBAND_TYPE_STRING,
-                        .string = word->word,
-                };
-
-                chameleon->callbacks.set_sideband_data(word_count + 1,
-                                                       &data,
-                                                       false, /* force */
-                                                       chameleon->user_data);
-                word_count++;
+                const char *text = word->word;
+                pcx_buffer_append(&words, &text, sizeof text);
         }
 
-        /* Clear any extra words from the previous group */
-        for (int i = word_count; i < chameleon->last_group_size; i++) {
-                static const struct pcx_game_sideband_data data = {
-                        .type = PCX_GAME_SIDEBAND_TYPE_STRING,
-                        .string = "",
-                };
-
-                chameleon->callbacks.set_sideband_data(i + 1,
-                                                       &data,
-                                                       false, /* force */
-                                                       chameleon->user_data);
-        }
+        int word_count = words.length / sizeof (const char *);
 
-        chameleon->last_group_size = word_count;
+        /* The whole list is sent as one array so that any extra words
+         * from the previous group are removed.
+         */
+        struct pcx_game_sideband_data data = {
+                .type = PCX_GAME_SIDEBAND_TYPE_ARRAY,
+                .array = {
+                        .start = 0,
+                        .n_elements = word_count,
+                        .elements = (const char * const *) words.data,
+                        .length = word_count,
+                },
+        };
+
+        chameleon->callbacks.set_sideband_data(1, /* data_num */
+                                               &data,
+                                               false, /* force */
+                                               chameleon->user_data);
+
+        pcx_buffer_destroy(&words);
 }
 
 static void
@@ -527,18 +528,33 @@ vote_cb(struct pcx_main_context_source *source,
 }
 
 static void
-start_vote_timeout(struct pcx_chameleon *chameleon)
+add_vote_timeout(struct pcx_chameleon *chameleon,
+                 int elapsed_ms)
 {
-        if (chameleon->vote_timeout)
-                return;
+        int ms = VOTE_TIMEOUT;
+
+        chameleon->vote_timeout_start =
+                pcx_main_context_get_monotonic_clock(NULL) -
+                elapsed_ms * UINT64_C(1000);
+
+        ms = elapsed_ms < ms ? ms - elapsed_ms : 0;
 
         chameleon->vote_timeout =
                 pcx_main_context_add_timeout(NULL,
-                                             1 * 60 * 1000,
+                                             ms,
                                              vote_cb,
                                              chameleon);
 }
 
+static void
+start_vote_timeout(struct pcx_chameleon *chameleon)
+{
+        if (chameleon->vote_timeout)
+                return;
+
+        add_vote_timeout(chameleon, 0 /* elapsed_ms */);
+}
+
 static void
 start_voting(struct pcx_chameleon *chameleon)
 {
@@ -578,6 +594,36 @@ default_rand_func(void *user_data)
         return rand();
 }
 
+static void
+init_players(struct pcx_chameleon *chameleon,
+             const char *const *names)
+{
+        int n_players = chameleon->n_players;
+
+        chameleon->players = pcx_calloc(n_players *
+                                        sizeof (struct pcx_chameleon_player));
+        chameleon->vote_buttons = pcx_alloc(n_players *
+                                            sizeof (struct pcx_game_button));
+
+        chameleon->start_round_button.text =
+                pcx_text_get(chameleon->language,
+                             PCX_TEXT_STRING_START_ROUND_BUTTON);
+        chameleon->start_round_button.data = "start_round";
+
+        for (unsigned i = 0; i < n_players; i++) {
+                chameleon->players[i].name = pcx_strdup(names[i]);
+                pcx_buffer_init(&chameleon->players[i].guess);
+
+                struct pcx_buffer buf = PCX_BUFFER_STATIC_INIT;
+                pcx_buffer_append_printf(&buf, "vote:%i", i);
+
+                chameleon->vote_buttons[i].text =
+                        chameleon->players[i].name;
+                chameleon->vote_buttons[i].data =
+                        (char *) buf.data;
+        }
+}
+
 struct pcx_chameleon *
 pcx_chameleon_new(const struct pcx_config *config,
                   const struct pcx_game_callbacks *callbacks,
@@ -604,31 +650,10 @@ pcx_chameleon_new(const struct pcx_config *config,
 
         chameleon->n_players = n_players;
 
-        chameleon->players = pcx_calloc(n_players *
-                                        sizeof (struct pcx_chameleon_player));
-        chameleon->vote_buttons = pcx_alloc(n_players *
-                                            sizeof (struct pcx_game_button));
-
-        chameleon->start_round_button.text =
-                pcx_text_get(language,
-                             PCX_TEXT_STRING_START_ROUND_BUTTON);
-        chameleon->start_round_button.data = "start_round";
+        init_players(chameleon, names);
 
         chameleon->dealer = get_random(chameleon) % n_players;
 
-        for (unsigned i = 0; i < n_players; i++) {
-                chameleon->players[i].name = pcx_strdup(names[i]);
-                pcx_buffer_init(&chameleon->players[i].guess);
-
-                struct pcx_buffer buf = PCX_BUFFER_STATIC_INIT;
-                pcx_buffer_append_printf(&buf, "vote:%i", i);
-
-                chameleon->vote_buttons[i].text =
-                        chameleon->players[i].name;
-                chameleon->vote_buttons[i].data =
-                        (char *) buf.data;
-        }
-
         chameleon->class_data =
                 pcx_class_store_ref_data(callbacks->get_class_store(user_data),
                                          config,
@@ -1118,6 +1143,253 @@ free_game_cb(void *data)
         pcx_free(chameleon);
 }
 
+static int
+get_word_num(const struct pcx_chameleon_list_group *group,
+             const struct pcx_chameleon_list_word *needle)
+{
+        const struct pcx_chameleon_list_word *word;
+        int word_num = 0;
+
+        pcx_list_for_each(word, &group->words, link) {
+                if (word == needle)
+                        return word_num;
+                word_num++;
+        }
+
+        assert(!"secret word not in list?");
+
+        return -1;
+}
+
+static void
+snapshot_cb(void *data,
+            struct pcx_buffer *buf)
+{
+        struct pcx_chameleon *chameleon = data;
+
+        pcx_snapshot_write_uint32(buf, chameleon->n_groups);
+
+        for (unsigned i = 0; i < chameleon->n_groups; i++)
+                pcx_snapshot_write_int(buf, chameleon->group_order[i]);
+
+        pcx_snapshot_write_int(buf, chameleon->next_group_index);
+
+        /* The topic and the number of words are saved so that the
+         * game won’t be restored if the word list has changed.
+         */
+        const struct pcx_chameleon_list_group *group =
+                chameleon->current_group;
+
+        if (group) {
+                pcx_snapshot_write_string(buf, group->topic);
+                pcx_snapshot_write_int(buf, pcx_list_length(&group->words));
+                pcx_snapshot_write_int(buf,
+                                       get_word_num(group,
+                                                    chameleon->secret_word));
+        }
+
+        pcx_snapshot_write_int(buf, chameleon->phase);
+        pcx_snapshot_write_int(buf, chameleon->n_players_sent_clue);
+        pcx_snapshot_write_int(buf, chameleon->chameleon_player);
+        pcx_snapshot_write_int(buf, chameleon->dealer);
+        pcx_snapshot_write_uint32(buf, chameleon->voted_players);
+
+        for (unsigned i = 0; i < chameleon->n_players; i++) {
+                const struct pcx_chameleon_player *player =
+                        chameleon->players + i;
+
+                pcx_snapshot_write_string(buf,
+                                          player->guess.length > 0 ?
+                                          (const char *) player->guess.data :
+                                          "");
+                pcx_snapshot_write_int(buf, player->vote);
+                pcx_snapshot_write_int(buf, player->score);
+        }
+
+        uint64_t elapsed_ms = 0;
+
+        if (chameleon->vote_timeout) {
+                uint64_t now = pcx_main_context_get_monotonic_clock(NULL);
+                elapsed_ms = (now - chameleon->vote_timeout_start) / 1000;
+        }
+
+        pcx_snapshot_write_int(buf, MIN(elapsed_ms, INT_MAX));
+
+        pcx_snapshot_write_bool(buf, chameleon->game_over_source != NULL);
+}
+
+static void
+restore_group(struct pcx_chameleon *chameleon,
+              struct pcx_snapshot_reader *reader)
+{
+        int group_num = chameleon->group_order[chameleon->next_group_index - 1];
+
+        chameleon->current_group =
+                pcx_chameleon_list_get_group(chameleon->class_data->word_list,
+                                             group_num);
+
+        const char *topic = pcx_snapshot_read_string(reader);
+        int n_words = pcx_snapshot_read_int_range(reader, 1, INT_MAX);
+        int word_num = pcx_snapshot_read_int_range(reader, 0, n_words - 1);
+
+        if (reader->error ||
+            strcmp(topic, chameleon->current_group->topic) ||
+            n_words != pcx_list_length(&chameleon->current_group->words)) {
+                pcx_snapshot_reader_set_error(reader);
+                return;
+        }
+
+        const struct pcx_chameleon_list_word *word;
+
+        pcx_list_for_each(word, &chameleon->current_group->words, link) {
+                if (word_num-- == 0) {
+                        chameleon->secret_word = word;
+                        break;
+                }
+        }
+}
+
+static bool
+is_restored_state_valid(struct pcx_chameleon *chameleon,
+                        bool game_over)
+{
+        if (chameleon->secret_word == NULL)
+                return game_over;
+
+        int n_guesses;
+
+        if (chameleon->phase == PCX_CHAMELEON_PHASE_CLUES) {
+                if (chameleon->n_players_sent_clue >= chameleon->n_players)
+                        return false;
+                n_guesses = chameleon->n_players_sent_clue;
+        } else {
+                n_guesses = chameleon->n_players;
+        }
+
+        /* The clues are shown when the voting starts so they need
+         * to be there.
+         */
+        for (unsigned i = 0; i < n_guesses; i++) {
+                int player_num = (chameleon->dealer + i) % chameleon->n_players;
+
+                if (chameleon->players[player_num].guess.length <= 0)
+                        return false;
+        }
+
+        return true;
+}
+
+static void *
+restore_cb(const struct pcx_config *config,
+           const struct pcx_game_callbacks *callbacks,
+           void *user_data,
+           enum pcx_text_language language,
+           int n_players,
+           const char * const *names,
+           struct pcx_snapshot_reader *reader)
+{
+        if (n_players < PCX_CHAMELEON_MIN_PLAYERS ||
+            n_players > PCX_CHAMELEON_MAX_PLAYERS)
+                return NULL;
+
+        struct pcx_chameleon *chameleon = pcx_calloc(sizeof *chameleon);
+
+        chameleon->language = language;
+        chameleon->callbacks = *callbacks;
+        chameleon->user_data = user_data;
+        chameleon->rand_func = default_rand_func;
+        chameleon->n_players = n_players;
+
+        init_players(chameleon, names);
+
+        chameleon->class_data =
+                pcx_class_store_ref_data(callbacks->get_class_store(user_data),
+                                         config,
+                                         &pcx_chameleon_game,
+                                         language,
+                                         &class_store_callbacks);
+
+        struct pcx_chameleon_list *word_list =
+                chameleon->class_data->word_list;
+        size_t n_groups =
+                word_list ? pcx_chameleon_list_get_n_groups(word_list) : 0;
+
+        if (pcx_snapshot_read_uint32(reader) != n_groups) {
+                pcx_snapshot_reader_set_error(reader);
+                goto error;
+        }
+
+        chameleon->n_groups = n_groups;
+        chameleon->group_order = pcx_alloc(sizeof (int) * n_groups);
+
+        for (unsigned i = 0; i < n_groups; i++) {
+                chameleon->group_order[i] =
+                        pcx_snapshot_read_int_range(reader, 0, n_groups - 1);
+        }
+
+        chameleon->next_group_index =
+                pcx_snapshot_read_int_range(reader, 0, n_groups);
+
+        if (reader->error)
+                goto error;
+
+        if (chameleon->next_group_index > 0)
+                restore_group(chameleon, reader);
+
+        int last_phase = PCX_CHAMELEON_PHASE_WAITING_TO_START_ROUND;
+
+        chameleon->phase = pcx_snapshot_read_int_range(reader, 0, last_phase);
+        chameleon->n_players_sent_clue =
+                pcx_snapshot_read_int_range(reader, 0, n_players);
+        chameleon->chameleon_player =
+                pcx_snapshot_read_int_range(reader, 0, n_players - 1);
+        chameleon->dealer =
+                pcx_snapshot_read_int_range(reader, 0, n_players - 1);
+        chameleon->voted_players = pcx_snapshot_read_uint32(reader);
+
+        if (chameleon->voted_players >= (1 << n_players))
+                pcx_snapshot_reader_set_error(reader);
+
+        for (unsigned i = 0; i < n_players; i++) {
+                struct pcx_chameleon_player *player = chameleon->players + i;
+                const char *guess = pcx_snapshot_read_string(reader);
+
+                if (*guess) {
+                        pcx_buffer_append_string(&player->guess, guess);
+                        pcx_buffer_append_c(&player->guess, '\0');
+                }
+
+                player->vote = pcx_snapshot_read_int_range(reader,
+                                                           0,
+                                                           n_players - 1);
+                player->score = pcx_snapshot_read_int_range(reader,
+                                                            0,
+                                                            INT_MAX);
+        }
+
+        int elapsed_ms = pcx_snapshot_read_int_range(reader, 0, INT_MAX);
+        bool game_over = pcx_snapshot_read_bool(reader);
+
+        if (reader->error || !is_restored_state_valid(chameleon, game_over))
+                goto error;
+
+        if (game_over) {
+                chameleon->game_over_source =
+                        pcx_main_context_add_timeout(NULL,
+                                                     0, /* ms */
+                                                     game_over_cb,
+                                                     chameleon);
+        } else if (chameleon->phase == PCX_CHAMELEON_PHASE_VOTES) {
+                add_vote_timeout(chameleon, elapsed_ms);
+        }
+
+        return chameleon;
+
+error:
+        free_game_cb(chameleon);
+        return NULL;
+}
+
 const struct pcx_game
 pcx_chameleon_game = {
         .name = "chameleon",
@@ -1132,5 +1404,7 @@ pcx_chameleon_game = {
         .get_help_cb = get_help_cb,
         .handle_callback_data_cb = handle_callback_data_cb,
         .handle_message_cb = handle_message_cb,
-        .free_game_cb = free_game_cb
+        .free_game_cb = free_game_cb,
+        .snapshot_cb = snapshot_cb,
+        .restore_cb = restore_cb,
 };
@@ -34,6 +34,12 @@ struct store_entry {
         const void *class;
         enum pcx_text_language language;
 
+        /* Set when the data might be out of date. The instances that
+         * are already using it can carry on but new instances will
+         * create their own copy.
+         */
+        bool stale;
+
         void *data;
 
         const struct pcx_class_store_callbacks *callbacks;
@@ -66,7 +72,8 @@ pcx_class_store_ref_data(struct pcx_class_store *store,
 
         pcx_list_for_each(entry, &store->entries, link) {
                 if (entry->class == class &&
-                    entry->language == language) {
+                    entry->language == language &&
+                    !entry->stale) {
                         entry->ref_count++;
                         return entry->data;
                 }
@@ -77,6 +84,7 @@ pcx_class_store_ref_data(struct pcx_class_store *store,
         entry->ref_count = 1;
         entry->class = class;
         entry->language = language;
+        entry->stale = false;
 
         entry->data = callbacks->create_data(config, language);
         entry->callbacks = callbacks;
@@ -107,6 +115,15 @@ pcx_class_store_unref_data(struct pcx_class_store *store,
         assert(!"Couldn’t find entry for class data");
 }
 
+void
+pcx_class_store_invalidate(struct pcx_class_store *store)
+{
+        struct store_entry *entry;
+
+        pcx_list_for_each(entry, &store->entries, link)
+                entry->stale = true;
+}
+
 void
 pcx_class_store_free(struct pcx_class_store *store)
 {
@@ -63,6 +63,14 @@ void
 pcx_class_store_unref_data(struct pcx_class_store *store,
                            void *data);
 
+/* Makes the next call to pcx_class_store_ref_data create the data
+ * again, for example because the files that it is loaded from have
+ * changed. The data that is already in use stays alive until its
+ * last reference is removed.
+ */
+void
+pcx_class_store_invalidate(struct pcx_class_store *store);
+
 /* All of the references should have already been removed before
  * calling this.
  */
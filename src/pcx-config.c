@@ -27,6 +27,14 @@
 #include "pcx-util.h"
 #include "pcx-key-value.h"
 #include "pcx-buffer.h"
+#include "pcx-generate-id.h"
+
+#define DEFAULT_CONNECTION_RATE 60
+#define DEFAULT_CONNECTION_BURST 32
+#define DEFAULT_HANDSHAKE_RATE 60
+#define DEFAULT_HANDSHAKE_BURST 32
+#define DEFAULT_HANDSHAKE_TIMEOUT 10
+#define DEFAULT_MAX_PENDING_CONNECTIONS 1024
 
 struct pcx_error_domain
 pcx_config_error;
@@ -72,6 +80,7 @@ enum option_type {
         OPTION_TYPE_STRING,
         OPTION_TYPE_INT,
         OPTION_TYPE_LANGUAGE_CODE,
+        OPTION_TYPE_BOOL,
 };
 
 struct option {
@@ -107,6 +116,14 @@ server_options[] = {
         OPTION(certificate, STRING),
         OPTION(private_key, STRING),
         OPTION(private_key_password, STRING),
+        OPTION(connection_rate, INT),
+        OPTION(connection_burst, INT),
+        OPTION(handshake_rate, INT),
+        OPTION(handshake_burst, INT),
+        OPTION(handshake_timeout, INT),
+        OPTION(max_pending_connections, INT),
+        OPTION(web_root, STRING),
+        OPTION(proxy_protocol, BOOL),
 #undef OPTION
 };
 
@@ -123,6 +140,20 @@ general_options[] = {
         OPTION(user, STRING),
         OPTION(group, STRING),
         OPTION(telegram_url, STRING),
+        OPTION(message_retention, INT),
+        OPTION(sideband_interval, INT),
+        OPTION(chat_rate, INT),
+        OPTION(chat_burst, INT),
+        OPTION(auto_start_delay, INT),
+        OPTION(replication_socket, STRING),
+        OPTION(replication_interval, INT),
+        OPTION(shard, INT),
+        OPTION(admin_socket, STRING),
+        OPTION(max_conversations, INT),
+        OPTION(max_players, INT),
+        OPTION(max_conversations_per_ip, INT),
+        OPTION(max_players_per_ip, INT),
+        OPTION(stats_file, STRING),
 #undef OPTION
 };
 
@@ -169,6 +200,20 @@ set_option(struct load_config_data *data,
                 }
                 break;
         }
+        case OPTION_TYPE_BOOL: {
+                bool *ptr = (bool *) ((uint8_t *) config_item +
+                                      option->offset);
+                if (!strcmp(value, "true")) {
+                        *ptr = true;
+                } else if (!strcmp(value, "false")) {
+                        *ptr = false;
+                } else {
+                        load_config_error(data,
+                                          "invalid value for %s",
+                                          option->key);
+                }
+                break;
+        }
         }
 }
 
@@ -213,6 +258,18 @@ load_config_func(enum pcx_key_value_event event,
                         data->server = NULL;
                 } else if (!strcmp(value, "server")) {
                         data->server = pcx_calloc(sizeof *data->server);
+                        data->server->connection_rate =
+                                DEFAULT_CONNECTION_RATE;
+                        data->server->connection_burst =
+                                DEFAULT_CONNECTION_BURST;
+                        data->server->handshake_rate =
+                                DEFAULT_HANDSHAKE_RATE;
+                        data->server->handshake_burst =
+                                DEFAULT_HANDSHAKE_BURST;
+                        data->server->handshake_timeout =
+                                DEFAULT_HANDSHAKE_TIMEOUT;
+                        data->server->max_pending_connections =
+                                DEFAULT_MAX_PENDING_CONNECTIONS;
                         pcx_list_insert(data->config->servers.prev,
                                         &data->server->link);
                         data->bot = NULL;
@@ -312,6 +369,20 @@ validate_server(struct pcx_config_server *server,
                 return false;
         }
 
+        if (server->connection_rate < 0 ||
+            server->connection_burst < 0 ||
+            server->handshake_rate < 0 ||
+            server->handshake_burst < 0 ||
+            server->handshake_timeout < 0 ||
+            server->max_pending_connections < 0) {
+                pcx_set_error(error,
+                              &pcx_config_error,
+                              PCX_CONFIG_ERROR_IO,
+                              "%s: server limits can not be negative",
+                              filename);
+                return false;
+        }
+
         return true;
 }
 
@@ -347,6 +418,73 @@ validate_config(struct pcx_config *config,
                 return false;
         }
 
+        if (config->message_retention < 0) {
+                pcx_set_error(error,
+                              &pcx_config_error,
+                              PCX_CONFIG_ERROR_IO,
+                              "%s: message_retention can not be negative",
+                              filename);
+                return false;
+        }
+
+        if (config->sideband_interval < 0) {
+                pcx_set_error(error,
+                              &pcx_config_error,
+                              PCX_CONFIG_ERROR_IO,
+                              "%s: sideband_interval can not be negative",
+                              filename);
+                return false;
+        }
+
+        if (config->chat_rate < 0 || config->chat_burst < 0) {
+                pcx_set_error(error,
+                              &pcx_config_error,
+                              PCX_CONFIG_ERROR_IO,
+                              "%s: chat limits can not be negative",
+                              filename);
+                return false;
+        }
+
+        if (config->auto_start_delay < 0) {
+                pcx_set_error(error,
+                              &pcx_config_error,
+                              PCX_CONFIG_ERROR_IO,
+                              "%s: auto_start_delay can not be negative",
+                              filename);
+                return false;
+        }
+
+        if (config->max_conversations < 0 ||
+            config->max_players < 0 ||
+            config->max_conversations_per_ip < 0 ||
+            config->max_players_per_ip < 0) {
+                pcx_set_error(error,
+                              &pcx_config_error,
+                              PCX_CONFIG_ERROR_IO,
+                              "%s: game limits can not be negative",
+                              filename);
+                return false;
+        }
+
+        if (config->replication_interval <= 0) {
+                pcx_set_error(error,
+                              &pcx_config_error,
+                              PCX_CONFIG_ERROR_IO,
+                              "%s: replication_interval must be positive",
+                              filename);
+                return false;
+        }
+
+        if (config->shard < -1 || config->shard > PCX_GENERATE_ID_MAX_SHARD) {
+                pcx_set_error(error,
+                              &pcx_config_error,
+                              PCX_CONFIG_ERROR_IO,
+                              "%s: shard must be from 0 to %i",
+                              filename,
+                              PCX_GENERATE_ID_MAX_SHARD);
+                return false;
+        }
+
         if (config->data_dir == NULL) {
                 const char *home = getenv("HOME");
 
@@ -425,6 +563,17 @@ pcx_config_load(const char *filename,
 
         pcx_list_init(&config->bots);
         pcx_list_init(&config->servers);
+        config->message_retention = PCX_CONFIG_DEFAULT_MESSAGE_RETENTION;
+        config->sideband_interval = PCX_CONFIG_DEFAULT_SIDEBAND_INTERVAL;
+        config->chat_rate = PCX_CONFIG_DEFAULT_CHAT_RATE;
+        config->chat_burst = PCX_CONFIG_DEFAULT_CHAT_BURST;
+        config->auto_start_delay = PCX_CONFIG_DEFAULT_AUTO_START_DELAY;
+        config->replication_interval =
+                PCX_CONFIG_DEFAULT_REPLICATION_INTERVAL;
+        config->shard = -1;
+        config->max_conversations_per_ip =
+                PCX_CONFIG_DEFAULT_MAX_CONVERSATIONS_PER_IP;
+        config->max_players_per_ip = PCX_CONFIG_DEFAULT_MAX_PLAYERS_PER_IP;
 
         if (!load_config(filename, config, error))
                 goto error;
@@ -436,17 +585,22 @@ error:
         return NULL;
 }
 
+void
+pcx_config_bot_free(struct pcx_config_bot *bot)
+{
+        pcx_free(bot->apikey);
+        pcx_free(bot->botname);
+        pcx_free(bot->announce_channel);
+        pcx_free(bot);
+}
+
 static void
 free_bots(struct pcx_config *config)
 {
         struct pcx_config_bot *bot, *tmp;
 
-        pcx_list_for_each_safe(bot, tmp, &config->bots, link) {
-                pcx_free(bot->apikey);
-                pcx_free(bot->botname);
-                pcx_free(bot->announce_channel);
-                pcx_free(bot);
-        }
+        pcx_list_for_each_safe(bot, tmp, &config->bots, link)
+                pcx_config_bot_free(bot);
 }
 
 static void
@@ -459,6 +613,7 @@ free_servers(struct pcx_config *config)
                 pcx_free(server->private_key);
                 pcx_free(server->private_key_password);
                 pcx_free(server->address);
+                pcx_free(server->web_root);
                 pcx_free(server);
         }
 
@@ -475,6 +630,9 @@ pcx_config_free(struct pcx_config *config)
         pcx_free(config->user);
         pcx_free(config->group);
         pcx_free(config->telegram_url);
+        pcx_free(config->replication_socket);
+        pcx_free(config->admin_socket);
+        pcx_free(config->stats_file);
 
         pcx_free(config);
 }
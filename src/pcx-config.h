@@ -19,10 +19,38 @@
 #ifndef PCX_CONFIG_H
 #define PCX_CONFIG_H
 
+#include <stdint.h>
+#include <stdbool.h>
+
 #include "pcx-error.h"
 #include "pcx-list.h"
 #include "pcx-text.h"
 
+/* Seconds that conversation messages are kept for after they have
+ * been sent to every connected client.
+ */
+#define PCX_CONFIG_DEFAULT_MESSAGE_RETENTION (10 * 60)
+
+/* Milliseconds between updates of a piece of sideband data */
+#define PCX_CONFIG_DEFAULT_SIDEBAND_INTERVAL 40
+
+/* Chat messages per minute and burst size for each player */
+#define PCX_CONFIG_DEFAULT_CHAT_RATE 60
+#define PCX_CONFIG_DEFAULT_CHAT_BURST 10
+
+/* Seconds before a public game with enough players starts by itself */
+#define PCX_CONFIG_DEFAULT_AUTO_START_DELAY 30
+
+/* Milliseconds between snapshots sent to a hot standby */
+#define PCX_CONFIG_DEFAULT_REPLICATION_INTERVAL 1000
+
+/* Live conversations and players that each IP address can create.
+ * These are generous so that a school or café behind a NAT can still
+ * play.
+ */
+#define PCX_CONFIG_DEFAULT_MAX_CONVERSATIONS_PER_IP 32
+#define PCX_CONFIG_DEFAULT_MAX_PLAYERS_PER_IP 128
+
 extern struct pcx_error_domain
 pcx_config_error;
 
@@ -44,6 +72,34 @@ struct pcx_config_server {
         char *certificate;
         char *private_key;
         char *private_key_password;
+
+        /* Per-IP token buckets. The rates are in tokens per minute.
+         * A rate of zero disables the limit.
+         */
+        int64_t connection_rate;
+        int64_t connection_burst;
+        int64_t handshake_rate;
+        int64_t handshake_burst;
+
+        /* Seconds that a client has to complete the WebSocket
+         * handshake before it is disconnected. Zero for no limit.
+         */
+        int64_t handshake_timeout;
+
+        /* Maximum number of connections across all of the server
+         * sockets that haven’t joined a game yet. Zero for no limit.
+         */
+        int64_t max_pending_connections;
+
+        /* Directory of files to serve to plain HTTP requests or NULL
+         * to reply to all of them with 404.
+         */
+        char *web_root;
+
+        /* Whether each connection starts with a PROXY protocol
+         * header giving the real address of the client.
+         */
+        bool proxy_protocol;
 };
 
 struct pcx_config {
@@ -52,6 +108,50 @@ struct pcx_config {
         char *user;
         char *group;
         char *telegram_url;
+        /* Seconds to keep messages that have been sent to every
+         * connected client so that reconnecting clients can catch up
+         */
+        int64_t message_retention;
+        /* Minimum milliseconds between sending updates of the same
+         * piece of sideband data to the clients
+         */
+        int64_t sideband_interval;
+        /* Per-player token bucket for chat messages. The rate is in
+         * messages per minute. A rate of zero disables the limit.
+         */
+        int64_t chat_rate;
+        int64_t chat_burst;
+        /* Seconds to wait before automatically starting a public
+         * game that has reached the minimum number of players. Zero
+         * disables it.
+         */
+        int64_t auto_start_delay;
+        /* Unix socket that the hot standby connects to. NULL if
+         * replication is disabled.
+         */
+        char *replication_socket;
+        /* Milliseconds between snapshots sent to the standby */
+        int64_t replication_interval;
+        /* Number stored in the top bits of the generated IDs or -1
+         * to use the whole ID for the random number.
+         */
+        int64_t shard;
+        /* Unix socket that accepts admin commands. NULL if it is
+         * disabled.
+         */
+        char *admin_socket;
+        /* Maximum number of live conversations and players on the
+         * server, in total and for each client IP address. Zero for
+         * no limit.
+         */
+        int64_t max_conversations;
+        int64_t max_players;
+        int64_t max_conversations_per_ip;
+        int64_t max_players_per_ip;
+        /* File to append a record to when a game starts or ends.
+         * NULL if it is disabled.
+         */
+        char *stats_file;
         struct pcx_list bots;
         struct pcx_list servers;
 };
@@ -63,4 +163,8 @@ pcx_config_load(const char *filename,
 void
 pcx_config_free(struct pcx_config *config);
 
+/* Frees a bot section that has already been removed from the list */
+void
+pcx_config_bot_free(struct pcx_config_bot *bot);
+
 #endif /* PCX_CONFIG_H */
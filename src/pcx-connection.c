@@ -29,6 +29,8 @@
 #include <inttypes.h>
 #include <assert.h>
 #include <stdarg.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
 
 #include "pcx-util.h"
 #include "pcx-main-context.h"
@@ -41,8 +43,24 @@
 #include "pcx-base64.h"
 #include "pcx-proto.h"
 #include "pcx-ssl-error.h"
+#include "pcx-proxy-protocol.h"
 #include "sha1.h"
 
+/* Maximum number of lobby batches that can be queued. If a client
+ * can’t keep up then the queue is replaced with a new snapshot.
+ */
+#define MAX_LOBBY_BATCHES 8
+
+/* Maximum number of bytes to send with each call to sendfile so that
+ * a big file doesn’t hold up the other connections.
+ */
+#define MAX_SENDFILE_CHUNK (256 * 1024)
+
+struct pcx_connection_lobby_batch {
+        struct pcx_list link;
+        struct pcx_lobby_batch *batch;
+};
+
 struct pcx_connection {
         struct pcx_netaddress remote_address;
         char *remote_address_string;
@@ -58,6 +76,13 @@ struct pcx_connection {
         enum pcx_main_context_poll_flags ssl_write_block;
         size_t ssl_write_block_size;
 
+        /* True until the PROXY protocol header has been received if
+         * the socket expects one. The part received so far is kept
+         * in proxy_header.
+         */
+        bool expecting_proxy_header;
+        struct pcx_buffer proxy_header;
+
         uint8_t read_buf[1024];
         size_t read_buf_pos;
 
@@ -65,6 +90,12 @@ struct pcx_connection {
         size_t write_buf_pos;
 
         struct pcx_player *player;
+        /* The conversation that the connection is receiving messages
+         * from. This is the player’s conversation, or if player is
+         * NULL, a conversation that the client is only watching. The
+         * connection holds a reference on it in the latter case.
+         */
+        struct pcx_conversation *conversation;
         struct pcx_listener conversation_listener;
 
         bool sent_conversation_details;
@@ -103,20 +134,82 @@ struct pcx_connection {
          */
         SHA1_CTX *sha1_ctx;
 
-        /* A pointer to the list node of the last message that was
-         * sent from the conversation. This point to the header node
-         * if no messages have been sent yet.
+        /* Position of the next message to send from the
+         * conversation. This is only registered with the conversation
+         * while has_message_cursor is true.
+         */
+        struct pcx_conversation_cursor message_cursor;
+        bool has_message_cursor;
+
+        /* Number of messages that were released from the
+         * conversation before the client could receive them. If this
+         * is non-zero it needs to be reported before sending any more
+         * messages.
          */
-        struct pcx_list *last_message_sent;
+        int n_dropped_messages;
 
         /* Bitmask of sideband data pieces that need to be send to the
          * client.
          */
         uint64_t dirty_sideband_data;
 
+        /* For each array of sideband data, the value of
+         * sideband_version in the conversation when the last complete
+         * send of the array started. Elements with a later version
+         * need to be sent. This is tracked separately for each array
+         * because the conversation can hold back the modified event
+         * for one array while others are sent.
+         */
+        uint64_t sideband_versions_sent[8 * sizeof (uint64_t)];
+        /* If the write buffer filled up part way through sending an
+         * array, this is the data num of the array and the index to
+         * continue from. Otherwise sideband_array_data_num is -1.
+         * sideband_array_start_version is the conversation’s
+         * sideband_version when the send started.
+         */
+        int sideband_array_data_num;
+        int sideband_array_pos;
+        uint64_t sideband_array_start_version;
+
         /* The number of players that we have sent the name of */
         int named_players;
 
+        /* The lobby that the client is subscribed to or NULL */
+        struct pcx_lobby *lobby;
+        struct pcx_listener lobby_listener;
+        /* Lobby batches waiting to be sent. These are still sent
+         * after unsubscribing so that the client doesn’t get a
+         * partial update.
+         */
+        struct pcx_list lobby_batches;
+        int n_lobby_batches;
+        /* Offset into the first batch of the data already sent */
+        size_t lobby_batch_pos;
+
+        /* Details of a plain HTTP request collected while parsing
+         * the headers. The strings are NULL until the corresponding
+         * part of the request is received.
+         */
+        char *http_method;
+        char *http_path;
+        char *http_if_none_match;
+        bool http_accepts_gzip;
+        bool http_keep_alive;
+
+        /* True once the client has been sent the headers of a reply
+         * to a plain HTTP request. The body is sent from http_body
+         * or http_fd and then either the connection is closed or it
+         * goes back to waiting for another request. Nothing is read
+         * from the client in the meantime.
+         */
+        bool is_http;
+        const uint8_t *http_body;
+        size_t http_body_length;
+        size_t http_body_pos;
+        /* File that the rest of the body is sent from or -1 */
+        int http_fd;
+        uint64_t http_fd_remaining;
+
         SSL *ssl;
 };
 
@@ -133,6 +226,9 @@ ws_header_prefix[] =
 static const char
 ws_header_postfix[] = "\r\n\r\n";
 
+static struct pcx_connection_stats
+connection_stats;
+
 static bool
 emit_event(struct pcx_connection *conn,
            enum pcx_connection_event_type type,
@@ -200,32 +296,58 @@ handle_error(struct pcx_connection *conn)
         set_error_state(conn);
 }
 
+static bool
+has_left(struct pcx_connection *conn)
+{
+        return conn->player && conn->player->has_left;
+}
+
+/* Returns the player number to use to filter the messages. This is
+ * -1 for spectators so that they only see the public messages.
+ */
+static int
+get_player_num(struct pcx_connection *conn)
+{
+        return conn->player ? conn->player->player_num : -1;
+}
+
 static bool
 connection_is_ready_to_write(struct pcx_connection *conn)
 {
         if (conn->write_buf_pos > 0)
                 return true;
 
+        if (conn->is_http) {
+                return (conn->http_body_pos < conn->http_body_length ||
+                        conn->http_fd != -1);
+        }
+
         if (conn->pong_queued)
                 return true;
 
-        if (conn->player) {
+        if (!pcx_list_empty(&conn->lobby_batches))
+                return true;
+
+        if (conn->conversation) {
                 if (!conn->sent_conversation_details)
                         return true;
 
-                if (!conn->player->has_left) {
+                if (!has_left(conn)) {
                         if (conn->named_players <
-                            conn->player->conversation->n_players)
+                            conn->conversation->n_players)
                                 return true;
 
                         if (conn->dirty_sideband_data)
                                 return true;
 
+                        if (conn->n_dropped_messages > 0)
+                                return true;
+
                         /* If the last message we sent isn’t the last
                          * one then we have messages to send.
                          */
-                        if (conn->last_message_sent->next !=
-                            &conn->player->conversation->messages)
+                        if (conn->message_cursor.next_message !=
+                            conn->conversation->next_message)
                                 return true;
                 }
         }
@@ -240,7 +362,7 @@ update_poll_flags(struct pcx_connection *conn)
 
         if (conn->ssl_read_block)
                 flags |= conn->ssl_read_block;
-        else
+        else if (!conn->is_http)
                 flags = PCX_MAIN_CONTEXT_POLL_IN;
 
         if (conn->ssl_write_block)
@@ -270,13 +392,16 @@ write_command(struct pcx_connection *conn,
 
         va_end(ap);
 
+        if (ret != -1)
+                connection_stats.frames_sent[0x2]++;
+
         return ret;
 }
 
 static bool
 write_player_names(struct pcx_connection *conn)
 {
-        struct pcx_conversation *conv = conn->player->conversation;
+        struct pcx_conversation *conv = conn->conversation;
 
         while (conn->named_players < conv->n_players) {
                 const char *name =
@@ -349,15 +474,116 @@ write_sideband_datum(struct pcx_connection *conn,
                                      data->string->text,
 
                                      PCX_PROTO_TYPE_NONE);
+
+        case PCX_GAME_SIDEBAND_TYPE_ARRAY:
+                /* Handled by write_sideband_array */
+                break;
         }
 
         assert(!"unknown sideband data type");
 }
 
+/* Writes as many frames as needed to send the changed elements of
+ * the array. Each frame contains the data num, the length of the
+ * array and then pairs of a uint16_t index and a string value. As
+ * many changes as possible are packed into each frame. Returns false
+ * if the write buffer fills up before everything is sent.
+ */
+static bool
+write_sideband_array(struct pcx_connection *conn,
+                     int data_num,
+                     const struct pcx_conversation_sideband_array *array)
+{
+        /* The payload won’t be bigger than the write buffer so the
+         * header never needs more than four bytes.
+         */
+        _Static_assert(sizeof conn->write_buf <= UINT16_MAX,
+                       "The write buffer is too big for a 16-bit frame");
+        const size_t max_header_length = 4;
+        const size_t array_header_length = 1 + 1 + sizeof (uint16_t);
+
+        if (conn->sideband_array_data_num != data_num) {
+                conn->sideband_array_data_num = data_num;
+                conn->sideband_array_pos = 0;
+                conn->sideband_array_start_version =
+                        conn->conversation->sideband_version;
+        }
+
+        uint64_t version_sent = conn->sideband_versions_sent[data_num];
+
+        int pos = conn->sideband_array_pos;
+
+        do {
+                size_t space = (sizeof conn->write_buf -
+                                conn->write_buf_pos);
+
+                if (space < max_header_length + array_header_length)
+                        return false;
+
+                uint8_t *payload = (conn->write_buf +
+                                    conn->write_buf_pos +
+                                    max_header_length);
+                uint8_t *payload_end = payload + space - max_header_length;
+                uint8_t *p = payload;
+
+                *(p++) = PCX_PROTO_SIDEBAND_ARRAY;
+                *(p++) = data_num;
+                pcx_proto_write_uint16_t(p, array->length);
+                p += sizeof (uint16_t);
+
+                int start_pos = pos;
+
+                for (; pos < array->length; pos++) {
+                        uint64_t version;
+                        const char *value =
+                                pcx_conversation_get_sideband_array_element
+                                (array, pos, &version);
+
+                        if (version <= version_sent)
+                                continue;
+
+                        size_t value_size = strlen(value) + 1;
+
+                        if (p + sizeof (uint16_t) + value_size > payload_end)
+                                break;
+
+                        pcx_proto_write_uint16_t(p, pos);
+                        p += sizeof (uint16_t);
+                        memcpy(p, value, value_size);
+                        p += value_size;
+                }
+
+                /* If nothing fit then wait for the buffer to empty */
+                if (pos < array->length && pos == start_pos)
+                        return false;
+
+                size_t payload_length = p - payload;
+                size_t header_length =
+                        pcx_proto_get_frame_header_length(payload_length);
+                uint8_t *frame = conn->write_buf + conn->write_buf_pos;
+
+                memmove(frame + header_length, payload, payload_length);
+                pcx_proto_write_frame_header(frame, payload_length);
+
+                conn->write_buf_pos += header_length + payload_length;
+                conn->sideband_array_pos = pos;
+        } while (pos < array->length);
+
+        /* Elements that changed after we started might have been
+         * skipped so they are only counted as sent up to the version
+         * at the start.
+         */
+        conn->sideband_versions_sent[data_num] =
+                conn->sideband_array_start_version;
+        conn->sideband_array_data_num = -1;
+
+        return true;
+}
+
 static bool
 write_sideband_data(struct pcx_connection *conn)
 {
-        struct pcx_conversation *conv = conn->player->conversation;
+        struct pcx_conversation *conv = conn->conversation;
 
         while (true) {
                 int first_bit = ffsll(conn->dirty_sideband_data);
@@ -370,14 +596,19 @@ write_sideband_data(struct pcx_connection *conn)
                 struct pcx_conversation_sideband_data *data =
                         pcx_conversation_get_sideband_data(conv, data_num);
 
-                int wrote = write_sideband_datum(conn, data_num, data);
+                if (data->type == PCX_GAME_SIDEBAND_TYPE_ARRAY) {
+                        if (!write_sideband_array(conn, data_num, data->array))
+                                return false;
+                } else {
+                        int wrote = write_sideband_datum(conn, data_num, data);
 
-                if (wrote == -1)
-                        return false;
+                        if (wrote == -1)
+                                return false;
 
-                conn->dirty_sideband_data &= ~(UINT64_C(1) << data_num);
+                        conn->write_buf_pos += wrote;
+                }
 
-                conn->write_buf_pos += wrote;
+                conn->dirty_sideband_data &= ~(UINT64_C(1) << data_num);
         }
 
         return true;
@@ -386,22 +617,41 @@ write_sideband_data(struct pcx_connection *conn)
 static bool
 write_messages(struct pcx_connection *conn)
 {
-        struct pcx_conversation *conv = conn->player->conversation;
+        struct pcx_conversation *conv = conn->conversation;
+        struct pcx_conversation_cursor *cursor = &conn->message_cursor;
+        int player_num = get_player_num(conn);
+
+        if (conn->n_dropped_messages > 0) {
+                int wrote = write_command(conn,
+
+                                          PCX_PROTO_MESSAGES_DROPPED,
+
+                                          PCX_PROTO_TYPE_UINT32,
+                                          (uint32_t) conn->n_dropped_messages,
+
+                                          PCX_PROTO_TYPE_NONE);
+
+                if (wrote == -1)
+                        return false;
 
-        for (; conn->last_message_sent->next != &conv->messages;
-             conn->last_message_sent = conn->last_message_sent->next) {
+                conn->write_buf_pos += wrote;
+                conn->n_dropped_messages = 0;
+        }
+
+        for (; cursor->next_message < conv->next_message;
+             cursor->next_message++) {
                 struct pcx_conversation_message *message =
-                        pcx_container_of(conn->last_message_sent->next,
-                                         struct pcx_conversation_message,
-                                         link);
+                        pcx_conversation_get_message(conv,
+                                                     cursor->next_message);
 
                 if (message->target_player != -1 &&
-                    message->target_player != conn->player->player_num)
+                    message->target_player != player_num)
                         continue;
 
                 size_t length = (message->target_player == -1 &&
-                                 ((UINT32_C(1) << conn->player->player_num) &
-                                  message->button_players) == 0 ?
+                                 (player_num == -1 ||
+                                  ((UINT32_C(1) << player_num) &
+                                   message->button_players) == 0) ?
                                  message->no_buttons_length :
                                  message->length);
 
@@ -426,8 +676,7 @@ write_messages(struct pcx_connection *conn)
                  */
                 if (message->sending_player != -1) {
                         enum pcx_proto_message_type message_type =
-                                message->sending_player ==
-                                conn->player->player_num ?
+                                message->sending_player == player_num ?
                                 PCX_PROTO_MESSAGE_TYPE_CHAT_YOU :
                                 PCX_PROTO_MESSAGE_TYPE_CHAT_OTHER;
                         *p |= message_type << 1;
@@ -436,6 +685,8 @@ write_messages(struct pcx_connection *conn)
                 p += length;
 
                 conn->write_buf_pos = p - conn->write_buf;
+
+                connection_stats.frames_sent[0x2]++;
         }
 
         return true;
@@ -447,28 +698,45 @@ write_conversation_details(struct pcx_connection *conn)
         size_t old_write_buf_pos = conn->write_buf_pos;
         int wrote;
 
-        struct pcx_conversation *conv = conn->player->conversation;
+        struct pcx_conversation *conv = conn->conversation;
 
-        wrote = write_command(conn,
+        /* Spectators don’t have a player */
+        if (conn->player) {
+                wrote = write_command(conn,
 
-                              PCX_PROTO_PLAYER_ID,
+                                      PCX_PROTO_PLAYER_ID,
 
-                              PCX_PROTO_TYPE_UINT64,
-                              conn->player->id,
+                                      PCX_PROTO_TYPE_UINT64,
+                                      conn->player->id,
 
-                              PCX_PROTO_TYPE_NONE);
+                                      PCX_PROTO_TYPE_NONE);
 
-        if (wrote == -1)
-                goto failed;
+                if (wrote == -1)
+                        goto failed;
 
-        conn->write_buf_pos += wrote;
+                conn->write_buf_pos += wrote;
+
+                wrote = write_command(conn,
+
+                                      PCX_PROTO_PLAYER_NUM,
+
+                                      PCX_PROTO_TYPE_UINT8,
+                                      conn->player->player_num,
+
+                                      PCX_PROTO_TYPE_NONE);
+
+                if (wrote == -1)
+                        goto failed;
+
+                conn->write_buf_pos += wrote;
+        }
 
         wrote = write_command(conn,
 
-                              PCX_PROTO_PLAYER_NUM,
+                              PCX_PROTO_GAME_TYPE,
 
-                              PCX_PROTO_TYPE_UINT8,
-                              conn->player->player_num,
+                              PCX_PROTO_TYPE_STRING,
+                              conv->game_type->name,
 
                               PCX_PROTO_TYPE_NONE);
 
@@ -479,10 +747,10 @@ write_conversation_details(struct pcx_connection *conn)
 
         wrote = write_command(conn,
 
-                              PCX_PROTO_GAME_TYPE,
+                              PCX_PROTO_SPECTATE_ID,
 
-                              PCX_PROTO_TYPE_STRING,
-                              conv->game_type->name,
+                              PCX_PROTO_TYPE_UINT64,
+                              conv->spectate_id,
 
                               PCX_PROTO_TYPE_NONE);
 
@@ -491,7 +759,7 @@ write_conversation_details(struct pcx_connection *conn)
 
         conn->write_buf_pos += wrote;
 
-        if (conv->is_private) {
+        if (conv->is_private && conn->player) {
                 wrote = write_command(conn,
 
                                       PCX_PROTO_PRIVATE_GAME_ID,
@@ -531,6 +799,141 @@ write_pong(struct pcx_connection *conn)
         conn->write_buf_pos += conn->pong_data_length;
         conn->pong_queued = false;
 
+        connection_stats.frames_sent[0xa]++;
+
+        return true;
+}
+
+/* Returns the length of the WebSocket frame at the start of data */
+static size_t
+get_frame_length(const uint8_t *data)
+{
+        size_t payload_length = data[1] & 0x7f;
+
+        if (payload_length == 126) {
+                uint16_t value;
+                memcpy(&value, data + 2, sizeof value);
+                payload_length = PCX_UINT16_FROM_BE(value);
+        }
+
+        return pcx_proto_get_frame_header_length(payload_length) +
+                payload_length;
+}
+
+static void
+remove_first_lobby_batch(struct pcx_connection *conn)
+{
+        struct pcx_connection_lobby_batch *lb =
+                pcx_container_of(conn->lobby_batches.next,
+                                 struct pcx_connection_lobby_batch,
+                                 link);
+
+        pcx_lobby_batch_unref(lb->batch);
+        pcx_list_remove(&lb->link);
+        pcx_free(lb);
+        conn->n_lobby_batches--;
+        conn->lobby_batch_pos = 0;
+}
+
+static bool
+write_lobby_batches(struct pcx_connection *conn)
+{
+        while (!pcx_list_empty(&conn->lobby_batches)) {
+                struct pcx_connection_lobby_batch *lb =
+                        pcx_container_of(conn->lobby_batches.next,
+                                         struct pcx_connection_lobby_batch,
+                                         link);
+                const struct pcx_lobby_batch *batch = lb->batch;
+
+                /* Only copy whole frames so that other commands can
+                 * still be added to the write buffer.
+                 */
+                while (conn->lobby_batch_pos < batch->length) {
+                        const uint8_t *frame =
+                                batch->data + conn->lobby_batch_pos;
+                        size_t frame_length = get_frame_length(frame);
+
+                        if (conn->write_buf_pos + frame_length >
+                            sizeof conn->write_buf)
+                                return false;
+
+                        memcpy(conn->write_buf + conn->write_buf_pos,
+                               frame,
+                               frame_length);
+                        conn->write_buf_pos += frame_length;
+                        conn->lobby_batch_pos += frame_length;
+
+                        connection_stats.frames_sent[0x2]++;
+                }
+
+                remove_first_lobby_batch(conn);
+        }
+
+        return true;
+}
+
+static void
+close_http_fd(struct pcx_connection *conn)
+{
+        if (conn->http_fd == -1)
+                return;
+
+        pcx_close(conn->http_fd);
+        conn->http_fd = -1;
+        conn->http_fd_remaining = 0;
+}
+
+/* Reads the next part of the file into the write buffer. This is only
+ * used for SSL connections because the others can use sendfile.
+ */
+static bool
+read_http_file(struct pcx_connection *conn)
+{
+        size_t to_read = MIN(sizeof conn->write_buf - conn->write_buf_pos,
+                             conn->http_fd_remaining);
+
+        if (to_read == 0)
+                return true;
+
+        ssize_t got = read(conn->http_fd,
+                           conn->write_buf + conn->write_buf_pos,
+                           to_read);
+
+        if (got <= 0) {
+                pcx_log("Error reading file to send to %s: %s",
+                        conn->remote_address_string,
+                        got == 0 ? "file was truncated" : strerror(errno));
+                return false;
+        }
+
+        conn->write_buf_pos += got;
+        conn->http_fd_remaining -= got;
+
+        if (conn->http_fd_remaining == 0)
+                close_http_fd(conn);
+
+        return true;
+}
+
+/* Returns false if the connection should be closed */
+static bool
+write_http_body(struct pcx_connection *conn)
+{
+        if (conn->http_fd != -1)
+                return conn->ssl == NULL || read_http_file(conn);
+
+        if (conn->http_body == NULL)
+                return true;
+
+        size_t to_copy = MIN(sizeof conn->write_buf - conn->write_buf_pos,
+                             conn->http_body_length - conn->http_body_pos);
+
+        memcpy(conn->write_buf + conn->write_buf_pos,
+               conn->http_body + conn->http_body_pos,
+               to_copy);
+        conn->write_buf_pos += to_copy;
+        conn->http_body_pos += to_copy;
+
         return true;
 }
 
@@ -540,14 +943,17 @@ fill_write_buf(struct pcx_connection *conn)
         if (conn->pong_queued && !write_pong(conn))
                 return;
 
-        if (conn->player == NULL)
+        if (!write_lobby_batches(conn))
+                return;
+
+        if (conn->conversation == NULL)
                 return;
 
         if (!conn->sent_conversation_details &&
             !write_conversation_details(conn))
                 return;
 
-        if (!conn->player->has_left) {
+        if (!has_left(conn)) {
                 if (!write_player_names(conn))
                         return;
 
@@ -650,7 +1056,8 @@ found_game:
 }
 
 static bool
-handle_join_private_game(struct pcx_connection *conn)
+handle_join_private_game(struct pcx_connection *conn,
+                         enum pcx_connection_event_type event_type)
 {
         struct pcx_connection_join_private_game_event event;
 
@@ -664,15 +1071,32 @@ handle_join_private_game(struct pcx_connection *conn)
                                     &event.game_id,
 
                                     PCX_PROTO_TYPE_NONE)) {
-                pcx_log("Invalid join private game command received from %s",
+                pcx_log("Invalid join game command received from %s",
+                        conn->remote_address_string);
+                set_error_state(conn);
+                return false;
+        }
+
+        return emit_event(conn, event_type, &event.base);
+}
+
+static bool
+handle_lobby_subscribe(struct pcx_connection *conn)
+{
+        struct pcx_connection_event event;
+
+        if (!pcx_proto_read_payload(conn->message_data + 1,
+                                    conn->message_data_length - 1,
+                                    PCX_PROTO_TYPE_NONE)) {
+                pcx_log("Invalid lobby subscribe command received from %s",
                         conn->remote_address_string);
                 set_error_state(conn);
                 return false;
         }
 
         return emit_event(conn,
-                          PCX_CONNECTION_EVENT_JOIN_PRIVATE_GAME,
-                          &event.base);
+                          PCX_CONNECTION_EVENT_LOBBY_SUBSCRIBE,
+                          &event);
 }
 
 static bool
@@ -701,6 +1125,32 @@ handle_reconnect(struct pcx_connection *conn)
                           &event.base);
 }
 
+static bool
+handle_spectate(struct pcx_connection *conn)
+{
+        struct pcx_connection_spectate_event event;
+
+        if (!pcx_proto_read_payload(conn->message_data + 1,
+                                    conn->message_data_length - 1,
+
+                                    PCX_PROTO_TYPE_UINT64,
+                                    &event.spectate_id,
+
+                                    PCX_PROTO_TYPE_UINT16,
+                                    &event.n_messages_received,
+
+                                    PCX_PROTO_TYPE_NONE)) {
+                pcx_log("Invalid spectate command received from %s",
+                        conn->remote_address_string);
+                set_error_state(conn);
+                return false;
+        }
+
+        return emit_event(conn,
+                          PCX_CONNECTION_EVENT_SPECTATE,
+                          &event.base);
+}
+
 static bool
 handle_leave(struct pcx_connection *conn)
 {
@@ -810,15 +1260,25 @@ handle_client_sideband(struct pcx_connection *conn)
 static bool
 process_message(struct pcx_connection *conn)
 {
+        enum pcx_connection_event_type event_type;
+
         switch (conn->message_data[0]) {
         case PCX_PROTO_NEW_PLAYER:
                 return handle_new_player(conn, false /* is_private */);
         case PCX_PROTO_NEW_PRIVATE_PLAYER:
                 return handle_new_player(conn, true /* is_private */);
         case PCX_PROTO_JOIN_PRIVATE_GAME:
-                return handle_join_private_game(conn);
+                event_type = PCX_CONNECTION_EVENT_JOIN_PRIVATE_GAME;
+                return handle_join_private_game(conn, event_type);
+        case PCX_PROTO_JOIN_LOBBY_GAME:
+                event_type = PCX_CONNECTION_EVENT_JOIN_LOBBY_GAME;
+                return handle_join_private_game(conn, event_type);
+        case PCX_PROTO_LOBBY_SUBSCRIBE:
+                return handle_lobby_subscribe(conn);
         case PCX_PROTO_RECONNECT:
                 return handle_reconnect(conn);
+        case PCX_PROTO_SPECTATE:
+                return handle_spectate(conn);
         case PCX_PROTO_LEAVE:
                 return handle_leave(conn);
         case PCX_PROTO_BUTTON:
@@ -968,6 +1428,8 @@ process_frames(struct pcx_connection *conn)
                 data += header_size;
                 length -= header_size;
 
+                connection_stats.frames_received[opcode]++;
+
                 if (has_mask) {
                         memcpy(&mask, data - sizeof mask, sizeof mask);
                         unmask_data(mask, data, payload_length);
@@ -1006,55 +1468,201 @@ ws_request_line_received_cb(const char *method,
                             const char *uri,
                             void *user_data)
 {
+        struct pcx_connection *conn = user_data;
+
+        conn->http_method = pcx_strdup(method);
+        /* The query string isn’t used for anything */
+        conn->http_path = pcx_strndup(uri, strcspn(uri, "?"));
+        conn->http_keep_alive = true;
+
         return true;
 }
 
 static bool
-ws_header_received_cb(const char *field_name,
-                      const char *value,
-                      void *user_data)
+token_case_equal(const char *a,
+                 size_t a_length,
+                 const char *b)
 {
-        struct pcx_connection *conn = user_data;
-
-        if (!pcx_ascii_string_case_equal(field_name, "sec-websocket-key"))
-                return true;
+        size_t b_length = strlen(b);
 
-        if (conn->sha1_ctx != NULL) {
-                pcx_log("Client at %s sent a WebSocket header with multiple "
-                        "Sec-WebSocket-Key headers",
-                        conn->remote_address_string);
-                set_error_state(conn);
+        if (a_length != b_length)
                 return false;
-        }
 
-        conn->sha1_ctx = pcx_alloc(sizeof *conn->sha1_ctx);
-        SHA1Init(conn->sha1_ctx);
-        SHA1Update(conn->sha1_ctx, (const uint8_t *) value, strlen(value));
+        for (size_t i = 0; i < a_length; i++) {
+                if (pcx_ascii_tolower(a[i]) != pcx_ascii_tolower(b[i]))
+                        return false;
+        }
 
         return true;
 }
 
+/* Looks for a token in a comma-separated header value such as the one
+ * for Connection or Accept-Encoding. If it is found then *params is
+ * set to the parameters that follow it, up to the next comma.
+ */
 static bool
-ws_headers_finished(struct pcx_connection *conn)
+find_header_token(const char *value,
+                  const char *token,
+                  const char **params,
+                  size_t *params_length)
 {
-        uint8_t sha1_hash[SHA1_DIGEST_LENGTH];
-        size_t encoded_size;
+        while (*value) {
+                size_t item_length = strcspn(value, ",");
+                size_t name_start = strspn(value, " \t");
+                size_t name_end = (name_start +
+                                   strcspn(value + name_start, " \t;,"));
+
+                if (token_case_equal(value + name_start,
+                                     name_end - name_start,
+                                     token)) {
+                        *params = value + name_end;
+                        *params_length = item_length - name_end;
+                        return true;
+                }
 
-        if (conn->sha1_ctx == NULL) {
-                pcx_log("Client at %s sent a WebSocket header without a "
-                        "Sec-WebSocket-Key header",
-                        conn->remote_address_string);
-                set_error_state(conn);
-                return false;
+                value += item_length;
+                if (*value == ',')
+                        value++;
         }
 
-        SHA1Update(conn->sha1_ctx,
-                   (const uint8_t *) ws_sec_key_guid,
-                   sizeof ws_sec_key_guid - 1);
+        return false;
+}
+
+/* Checks whether the parameters of a token in an Accept-Encoding
+ * header have a quality value of zero, which means the encoding is
+ * not acceptable.
+ */
+static bool
+is_zero_quality(const char *params,
+                size_t length)
+{
+        for (size_t i = 0; i + 1 < length; i++) {
+                if (pcx_ascii_tolower(params[i]) != 'q' ||
+                    params[i + 1] != '=')
+                        continue;
+
+                for (i += 2; i < length; i++) {
+                        if (!strchr("0. \t", params[i]))
+                                return false;
+                }
+
+                return true;
+        }
+
+        return false;
+}
+
+static void
+handle_http_header(struct pcx_connection *conn,
+                   const char *field_name,
+                   const char *value)
+{
+        const char *params;
+        size_t params_length;
+
+        if (pcx_ascii_string_case_equal(field_name, "if-none-match")) {
+                pcx_free(conn->http_if_none_match);
+                conn->http_if_none_match = pcx_strdup(value);
+        } else if (pcx_ascii_string_case_equal(field_name,
+                                               "accept-encoding")) {
+                if (find_header_token(value, "gzip", &params, &params_length)
+                    && !is_zero_quality(params, params_length))
+                        conn->http_accepts_gzip = true;
+        } else if (pcx_ascii_string_case_equal(field_name, "connection")) {
+                if (find_header_token(value,
+                                      "close",
+                                      &params,
+                                      &params_length))
+                        conn->http_keep_alive = false;
+        }
+}
+
+static bool
+ws_header_received_cb(const char *field_name,
+                      const char *value,
+                      void *user_data)
+{
+        struct pcx_connection *conn = user_data;
+
+        if (!pcx_ascii_string_case_equal(field_name, "sec-websocket-key")) {
+                handle_http_header(conn, field_name, value);
+                return true;
+        }
+
+        if (conn->sha1_ctx != NULL) {
+                pcx_log("Client at %s sent a WebSocket header with multiple "
+                        "Sec-WebSocket-Key headers",
+                        conn->remote_address_string);
+                set_error_state(conn);
+                return false;
+        }
+
+        conn->sha1_ctx = pcx_alloc(sizeof *conn->sha1_ctx);
+        SHA1Init(conn->sha1_ctx);
+        SHA1Update(conn->sha1_ctx, (const uint8_t *) value, strlen(value));
+
+        return true;
+}
+
+static void
+free_http_request(struct pcx_connection *conn)
+{
+        pcx_free(conn->http_method);
+        conn->http_method = NULL;
+        pcx_free(conn->http_path);
+        conn->http_path = NULL;
+        pcx_free(conn->http_if_none_match);
+        conn->http_if_none_match = NULL;
+        conn->http_accepts_gzip = false;
+}
+
+static void
+handle_http_request(struct pcx_connection *conn)
+{
+        conn->is_http = true;
+
+        struct pcx_connection_http_request_event event = {
+                .method = conn->http_method,
+                .path = conn->http_path,
+                .if_none_match = conn->http_if_none_match,
+                .accepts_gzip = conn->http_accepts_gzip,
+        };
+
+        emit_event(conn,
+                   PCX_CONNECTION_EVENT_HTTP_REQUEST,
+                   &event.base);
+}
+
+static bool
+ws_headers_finished(struct pcx_connection *conn)
+{
+        uint8_t sha1_hash[SHA1_DIGEST_LENGTH];
+        size_t encoded_size;
+
+        /* A request without a WebSocket key is treated as a plain
+         * HTTP request.
+         */
+        if (conn->sha1_ctx == NULL) {
+                handle_http_request(conn);
+                return false;
+        }
+
+        SHA1Update(conn->sha1_ctx,
+                   (const uint8_t *) ws_sec_key_guid,
+                   sizeof ws_sec_key_guid - 1);
         SHA1Final(sha1_hash, conn->sha1_ctx);
         pcx_free(conn->sha1_ctx);
         conn->sha1_ctx = NULL;
 
+        free_http_request(conn);
+
+        connection_stats.n_handshakes++;
+
+        struct pcx_connection_event event;
+
+        if (!emit_event(conn, PCX_CONNECTION_EVENT_HANDSHAKE, &event))
+                return false;
+
         /* Send the WebSocket protocol response. This is the first
          * thing we'll send to the client so there should always be
          * enough space in the write buffer.
@@ -1164,6 +1772,8 @@ process_incoming_data(struct pcx_connection *conn,
 {
         set_last_update_time(conn);
 
+        connection_stats.bytes_received += got;
+
         if (conn->ws_parser) {
                 handle_ws_data(conn, got);
         } else {
@@ -1210,9 +1820,114 @@ do_ssl_read(struct pcx_connection *conn)
         }
 }
 
+static void
+set_remote_address(struct pcx_connection *conn,
+                   const struct pcx_netaddress *address)
+{
+        char *address_string = pcx_netaddress_to_string(address);
+
+        pcx_log("Connection from %s is for %s",
+                conn->remote_address_string,
+                address_string);
+
+        conn->remote_address = *address;
+        pcx_free(conn->remote_address_string);
+        conn->remote_address_string = address_string;
+}
+
+static void
+finish_proxy_header(struct pcx_connection *conn,
+                    const struct pcx_netaddress *address)
+{
+        conn->expecting_proxy_header = false;
+        pcx_buffer_destroy(&conn->proxy_header);
+        pcx_buffer_init(&conn->proxy_header);
+
+        if (address->family != AF_UNSPEC)
+                set_remote_address(conn, address);
+
+        struct pcx_connection_event event;
+
+        emit_event(conn, PCX_CONNECTION_EVENT_PROXY_HEADER, &event);
+}
+
+static void
+read_proxy_header(struct pcx_connection *conn)
+{
+        struct pcx_buffer *buf = &conn->proxy_header;
+        size_t old_length = buf->length;
+
+        pcx_buffer_ensure_size(buf, PCX_PROXY_PROTOCOL_MAX_HEADER_LENGTH);
+
+        /* The data is only peeked at first so that nothing after the
+         * header is taken out of the socket. That way the SSL object
+         * can read the rest directly.
+         */
+        ssize_t got = recv(conn->sock,
+                           buf->data + old_length,
+                           PCX_PROXY_PROTOCOL_MAX_HEADER_LENGTH - old_length,
+                           MSG_PEEK);
+
+        if (got <= 0) {
+                handle_read_error(conn, got);
+                return;
+        }
+
+        set_last_update_time(conn);
+
+        struct pcx_netaddress address;
+        size_t header_length;
+        struct pcx_error *error = NULL;
+        enum pcx_proxy_protocol_result result =
+                pcx_proxy_protocol_parse(buf->data,
+                                         old_length + got,
+                                         &address,
+                                         &header_length,
+                                         &error);
+        size_t to_consume;
+
+        switch (result) {
+        case PCX_PROXY_PROTOCOL_RESULT_NEED_MORE_DATA:
+                to_consume = got;
+                break;
+        case PCX_PROXY_PROTOCOL_RESULT_FINISHED:
+                to_consume = header_length - old_length;
+                break;
+        case PCX_PROXY_PROTOCOL_RESULT_ERROR:
+        default:
+                pcx_log("Error from %s: %s",
+                        conn->remote_address_string,
+                        error->message);
+                pcx_error_free(error);
+                set_error_state(conn);
+                return;
+        }
+
+        /* Now actually remove the part that belongs to the header */
+        if (read(conn->sock, buf->data + old_length, to_consume) !=
+            to_consume) {
+                pcx_log("Error reading PROXY protocol header from %s",
+                        conn->remote_address_string);
+                set_error_state(conn);
+                return;
+        }
+
+        buf->length = old_length + to_consume;
+
+        connection_stats.bytes_received += to_consume;
+
+        if (result == PCX_PROXY_PROTOCOL_RESULT_FINISHED)
+                finish_proxy_header(conn, &address);
+}
+
 static void
 handle_read(struct pcx_connection *conn)
 {
+        if (conn->expecting_proxy_header) {
+                read_proxy_header(conn);
+                return;
+        }
+
         if (conn->ssl) {
                 do_ssl_read(conn);
                 return;
@@ -1239,6 +1954,51 @@ consume_write_data(struct pcx_connection *conn,
                 conn->write_buf + wrote,
                 conn->write_buf_pos - wrote);
         conn->write_buf_pos -= wrote;
+
+        connection_stats.bytes_sent += wrote;
+}
+
+static bool
+http_response_finished(struct pcx_connection *conn)
+{
+        return (conn->is_http &&
+                conn->write_buf_pos == 0 &&
+                conn->http_body_pos >= conn->http_body_length &&
+                conn->http_fd == -1);
+}
+
+static void
+finish_http_response(struct pcx_connection *conn)
+{
+        if (!conn->http_keep_alive) {
+                set_error_state(conn);
+                return;
+        }
+
+        free_http_request(conn);
+
+        conn->is_http = false;
+        conn->http_body = NULL;
+        conn->http_body_length = 0;
+        conn->http_body_pos = 0;
+
+        conn->ws_parser = pcx_ws_parser_new(&ws_parser_vtable, conn);
+
+        update_poll_flags(conn);
+
+        /* The client might have already sent the next request. Part
+         * of it can be left over in the read buffer from parsing the
+         * last one, or for SSL it can be waiting inside the SSL
+         * object where poll won’t notice it.
+         */
+        size_t pending = conn->read_buf_pos;
+
+        if (pending > 0) {
+                conn->read_buf_pos = 0;
+                handle_ws_data(conn, pending);
+        } else if (conn->ssl && SSL_pending(conn->ssl) > 0) {
+                do_ssl_read(conn);
+        }
 }
 
 static void
@@ -1251,6 +2011,12 @@ do_ssl_write(struct pcx_connection *conn,
         if (wrote > 0) {
                 consume_write_data(conn, wrote);
                 conn->ssl_write_block = 0;
+
+                if (http_response_finished(conn)) {
+                        finish_http_response(conn);
+                        return;
+                }
+
                 update_poll_flags(conn);
         } else {
                 switch (SSL_get_error(conn->ssl, wrote)) {
@@ -1280,12 +2046,64 @@ do_ssl_write(struct pcx_connection *conn,
         }
 }
 
+static void
+send_http_file(struct pcx_connection *conn)
+{
+        ssize_t wrote = sendfile(conn->sock,
+                                 conn->http_fd,
+                                 NULL, /* offset */
+                                 MIN(conn->http_fd_remaining,
+                                     MAX_SENDFILE_CHUNK));
+
+        if (wrote == -1) {
+                enum pcx_file_error e = pcx_file_error_from_errno(errno);
+
+                if (e != PCX_FILE_ERROR_AGAIN &&
+                    e != PCX_FILE_ERROR_INTR) {
+                        pcx_log("Error sending file to %s: %s",
+                                conn->remote_address_string,
+                                strerror(errno));
+                        set_error_state(conn);
+                } else {
+                        update_poll_flags(conn);
+                }
+                return;
+        }
+
+        if (wrote == 0) {
+                pcx_log("Error sending file to %s: file was truncated",
+                        conn->remote_address_string);
+                set_error_state(conn);
+                return;
+        }
+
+        connection_stats.bytes_sent += wrote;
+
+        /* A big download shouldn’t look like an idle connection */
+        set_last_update_time(conn);
+
+        conn->http_fd_remaining -= wrote;
+
+        if (conn->http_fd_remaining == 0)
+                close_http_fd(conn);
+
+        if (http_response_finished(conn))
+                finish_http_response(conn);
+        else
+                update_poll_flags(conn);
+}
+
 static void
 handle_write(struct pcx_connection *conn)
 {
         int wrote;
 
-        fill_write_buf(conn);
+        if (!conn->is_http) {
+                fill_write_buf(conn);
+        } else if (!write_http_body(conn)) {
+                set_error_state(conn);
+                return;
+        }
 
         /* Don’t bother trying to write if the buffer is empty. This
          * is important for SSL_write because it will get confused if
@@ -1295,7 +2113,10 @@ handle_write(struct pcx_connection *conn)
          * fill_write_buf will just skip them.
          */
         if (conn->write_buf_pos == 0) {
-                update_poll_flags(conn);
+                if (conn->http_fd != -1)
+                        send_http_file(conn);
+                else
+                        update_poll_flags(conn);
                 return;
         }
 
@@ -1321,6 +2142,11 @@ handle_write(struct pcx_connection *conn)
         } else {
                 consume_write_data(conn, wrote);
 
+                if (http_response_finished(conn)) {
+                        finish_http_response(conn);
+                        return;
+                }
+
                 update_poll_flags(conn);
         }
 }
@@ -1361,20 +2187,50 @@ connection_poll_cb(struct pcx_main_context_source *source,
         }
 }
 
+static void
+remove_message_cursor(struct pcx_connection *conn)
+{
+        if (!conn->has_message_cursor)
+                return;
+
+        pcx_conversation_remove_cursor(&conn->message_cursor);
+        conn->has_message_cursor = false;
+}
+
+static void
+unsubscribe_lobby(struct pcx_connection *conn)
+{
+        if (conn->lobby == NULL)
+                return;
+
+        pcx_list_remove(&conn->lobby_listener.link);
+        conn->lobby = NULL;
+}
+
 void
 pcx_connection_free(struct pcx_connection *conn)
 {
         remove_sources(conn);
 
+        unsubscribe_lobby(conn);
+
+        while (!pcx_list_empty(&conn->lobby_batches))
+                remove_first_lobby_batch(conn);
+
         if (conn->ssl)
                 SSL_free(conn->ssl);
 
         pcx_free(conn->remote_address_string);
         pcx_close(conn->sock);
 
-        if (conn->player) {
+        if (conn->conversation) {
                 pcx_list_remove(&conn->conversation_listener.link);
-                conn->player->ref_count--;
+                remove_message_cursor(conn);
+
+                if (conn->player)
+                        conn->player->ref_count--;
+                else
+                        pcx_conversation_unref(conn->conversation);
         }
 
         if (conn->ws_parser)
@@ -1383,6 +2239,11 @@ pcx_connection_free(struct pcx_connection *conn)
         if (conn->sha1_ctx)
                 pcx_free(conn->sha1_ctx);
 
+        free_http_request(conn);
+        close_http_fd(conn);
+
+        pcx_buffer_destroy(&conn->proxy_header);
+
         pcx_free(conn);
 }
 
@@ -1420,9 +2281,13 @@ new_for_socket(int sock,
         conn->remote_address = *remote_address;
         conn->remote_address_string = pcx_netaddress_to_string(remote_address);
         conn->ws_parser = pcx_ws_parser_new(&ws_parser_vtable, conn);
+        conn->http_fd = -1;
+        pcx_buffer_init(&conn->proxy_header);
 
         pcx_signal_init(&conn->event_signal);
 
+        pcx_list_init(&conn->lobby_batches);
+
         conn->socket_source =
                 pcx_main_context_add_poll(NULL, /* context */
                                           sock,
@@ -1495,6 +2360,12 @@ pcx_connection_accept(SSL_CTX *ssl_ctx,
         return conn;
 }
 
+void
+pcx_connection_expect_proxy_header(struct pcx_connection *conn)
+{
+        conn->expecting_proxy_header = true;
+}
+
 uint64_t
 pcx_connection_get_last_update_time(struct pcx_connection *conn)
 {
@@ -1513,9 +2384,33 @@ handle_sideband_data_modified(struct pcx_connection *connection,
 
         connection->dirty_sideband_data |= UINT64_C(1) << event->data_num;
 
+        /* If we were part way through sending the array then start
+         * again from the beginning in case an element that was
+         * already skipped has changed.
+         */
+        if (connection->sideband_array_data_num == event->data_num)
+                connection->sideband_array_pos = 0;
+
         update_poll_flags(connection);
 }
 
+static void
+handle_player_removed(struct pcx_connection *connection,
+                      const struct pcx_conversation_event *base_event)
+{
+        const struct pcx_conversation_player_removed_event *event =
+                pcx_container_of(base_event,
+                                 struct pcx_conversation_player_removed_event,
+                                 base);
+
+        /* Once the player has left we won’t send any more messages
+         * so there’s no need to hold on to them.
+         */
+        if (event->player_num == get_player_num(connection) &&
+            has_left(connection))
+                remove_message_cursor(connection);
+}
+
 static bool
 conversation_event_cb(struct pcx_listener *listener,
                       void *data)
@@ -1528,7 +2423,9 @@ conversation_event_cb(struct pcx_listener *listener,
 
         switch (event->type) {
         case PCX_CONVERSATION_EVENT_STARTED:
+                break;
         case PCX_CONVERSATION_EVENT_PLAYER_REMOVED:
+                handle_player_removed(connection, event);
                 break;
         case PCX_CONVERSATION_EVENT_PLAYER_ADDED:
         case PCX_CONVERSATION_EVENT_NEW_MESSAGE:
@@ -1537,54 +2434,159 @@ conversation_event_cb(struct pcx_listener *listener,
         case PCX_CONVERSATION_EVENT_SIDEBAND_DATA_MODIFIED:
                 handle_sideband_data_modified(connection, event);
                 break;
+        case PCX_CONVERSATION_EVENT_DESTROYED:
+                /* The connection holds a reference so this can’t
+                 * happen.
+                 */
+                assert(!"conversation destroyed while in use");
+                break;
         }
 
         return true;
 }
 
+static void
+set_conversation(struct pcx_connection *conn,
+                 struct pcx_conversation *conversation,
+                 int n_messages_received)
+{
+        unsubscribe_lobby(conn);
+
+        conn->conversation = conversation;
+        pcx_signal_add(&conversation->event_signal,
+                       &conn->conversation_listener);
+        conn->conversation_listener.notify = conversation_event_cb;
+
+        conn->sent_conversation_details = false;
+
+        conn->dirty_sideband_data = conversation->available_sideband_data;
+        memset(conn->sideband_versions_sent,
+               0,
+               sizeof conn->sideband_versions_sent);
+        conn->sideband_array_data_num = -1;
+
+        conn->n_dropped_messages =
+                pcx_conversation_seek_cursor(conversation,
+                                             &conn->message_cursor,
+                                             get_player_num(conn),
+                                             n_messages_received);
+
+        if (!has_left(conn)) {
+                pcx_conversation_add_cursor(conversation,
+                                            &conn->message_cursor);
+                conn->has_message_cursor = true;
+        }
+
+        /* This is to update the time on the player */
+        set_last_update_time(conn);
+
+        update_poll_flags(conn);
+}
+
 void
 pcx_connection_set_player(struct pcx_connection *conn,
                           struct pcx_player *player,
                           int n_messages_received)
 {
-        assert(conn->player == NULL);
+        assert(conn->conversation == NULL);
         assert(player != NULL);
 
         player->ref_count++;
 
         conn->player = player;
-        pcx_signal_add(&player->conversation->event_signal,
-                       &conn->conversation_listener);
-        conn->conversation_listener.notify = conversation_event_cb;
 
-        conn->sent_conversation_details = false;
+        set_conversation(conn, player->conversation, n_messages_received);
+}
 
-        conn->last_message_sent = &player->conversation->messages;
+void
+pcx_connection_spectate(struct pcx_connection *conn,
+                        struct pcx_conversation *conversation,
+                        int n_messages_received)
+{
+        assert(conn->conversation == NULL);
 
-        conn->dirty_sideband_data =
-                player->conversation->available_sideband_data;
+        pcx_conversation_ref(conversation);
 
-        while (n_messages_received > 0 &&
-               conn->last_message_sent->next !=
-               &player->conversation->messages) {
-                conn->last_message_sent = conn->last_message_sent->next;
+        set_conversation(conn, conversation, n_messages_received);
+}
 
-                struct pcx_conversation_message *message =
-                        pcx_container_of(conn->last_message_sent,
-                                         struct pcx_conversation_message,
-                                         link);
+static void
+queue_lobby_batch(struct pcx_connection *conn,
+                  struct pcx_lobby_batch *batch)
+{
+        struct pcx_connection_lobby_batch *lb = pcx_alloc(sizeof *lb);
 
-                if (message->target_player == -1 ||
-                    message->target_player == player->player_num)
-                        n_messages_received--;
+        pcx_lobby_batch_ref(batch);
+        lb->batch = batch;
+        pcx_list_insert(conn->lobby_batches.prev, &lb->link);
+        conn->n_lobby_batches++;
+}
+
+static bool
+lobby_batch_cb(struct pcx_listener *listener,
+               void *data)
+{
+        struct pcx_connection *conn =
+                pcx_container_of(listener,
+                                 struct pcx_connection,
+                                 lobby_listener);
+
+        if (conn->n_lobby_batches >= MAX_LOBBY_BATCHES) {
+                /* The client isn’t keeping up so replace everything
+                 * that it hasn’t started receiving with a new
+                 * snapshot. That already includes this batch.
+                 */
+                struct pcx_connection_lobby_batch *lb, *tmp;
+
+                pcx_list_for_each_safe(lb, tmp, &conn->lobby_batches, link) {
+                        if (lb->link.prev == &conn->lobby_batches &&
+                            conn->lobby_batch_pos > 0)
+                                continue;
+
+                        pcx_lobby_batch_unref(lb->batch);
+                        pcx_list_remove(&lb->link);
+                        pcx_free(lb);
+                        conn->n_lobby_batches--;
+                }
+
+                struct pcx_lobby_batch *snapshot =
+                        pcx_lobby_get_snapshot(conn->lobby);
+                queue_lobby_batch(conn, snapshot);
+                pcx_lobby_batch_unref(snapshot);
+        } else {
+                queue_lobby_batch(conn, data);
         }
 
-        /* This is to update the time on the player */
-        set_last_update_time(conn);
+        update_poll_flags(conn);
+
+        return true;
+}
+
+void
+pcx_connection_subscribe_lobby(struct pcx_connection *conn,
+                               struct pcx_lobby *lobby)
+{
+        if (conn->lobby || conn->conversation)
+                return;
+
+        conn->lobby = lobby;
+        conn->lobby_listener.notify = lobby_batch_cb;
+        pcx_signal_add(pcx_lobby_get_batch_signal(lobby),
+                       &conn->lobby_listener);
+
+        struct pcx_lobby_batch *snapshot = pcx_lobby_get_snapshot(lobby);
+        queue_lobby_batch(conn, snapshot);
+        pcx_lobby_batch_unref(snapshot);
 
         update_poll_flags(conn);
 }
 
+struct pcx_conversation *
+pcx_connection_get_conversation(struct pcx_connection *conn)
+{
+        return conn->conversation;
+}
+
 struct pcx_player *
 pcx_connection_get_player(struct pcx_connection *conn)
 {
@@ -1606,3 +2608,131 @@ pcx_connection_send_message(struct pcx_connection *conn,
 
         return true;
 }
+
+enum pcx_connection_state
+pcx_connection_get_state(struct pcx_connection *conn)
+{
+        if (conn->ws_parser)
+                return PCX_CONNECTION_STATE_HANDSHAKE;
+        if (conn->is_http)
+                return PCX_CONNECTION_STATE_HTTP;
+        if (conn->player)
+                return PCX_CONNECTION_STATE_PLAYING;
+        if (conn->conversation)
+                return PCX_CONNECTION_STATE_SPECTATING;
+        if (conn->lobby)
+                return PCX_CONNECTION_STATE_LOBBY;
+
+        return PCX_CONNECTION_STATE_IDLE;
+}
+
+static const char *
+get_http_status_text(int status)
+{
+        switch (status) {
+        case 200: return "OK";
+        case 301: return "Moved Permanently";
+        case 304: return "Not Modified";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        }
+
+        return "Unknown";
+}
+
+static void
+start_http_response(struct pcx_connection *conn,
+                    int status,
+                    const char *headers,
+                    uint64_t length)
+{
+        char content_length[64];
+
+        /* A 304 reply never has a body so the Content-Length would
+         * describe the file that wasn’t sent.
+         */
+        if (status == 304) {
+                content_length[0] = '\0';
+        } else {
+                snprintf(content_length,
+                         sizeof content_length,
+                         "Content-Length: %" PRIu64 "\r\n",
+                         length);
+        }
+
+        int header_length = snprintf((char *) conn->write_buf,
+                                     sizeof conn->write_buf,
+                                     "HTTP/1.1 %i %s\r\n"
+                                     "%s"
+                                     "%s"
+                                     "Connection: %s\r\n"
+                                     "\r\n",
+                                     status,
+                                     get_http_status_text(status),
+                                     headers,
+                                     content_length,
+                                     conn->http_keep_alive ?
+                                     "keep-alive" :
+                                     "close");
+
+        /* The extra headers can only contain the path from the
+         * request line which the WebSocket parser limits to less
+         * than half of the buffer.
+         */
+        assert(header_length < sizeof conn->write_buf);
+
+        conn->write_buf_pos = header_length;
+        conn->is_http = true;
+}
+
+void
+pcx_connection_send_http_response(struct pcx_connection *conn,
+                                  const char *content_type,
+                                  const uint8_t *data,
+                                  size_t length)
+{
+        char headers[128];
+
+        snprintf(headers, sizeof headers,
+                 "Content-Type: %s\r\n",
+                 content_type);
+
+        conn->http_keep_alive = false;
+
+        start_http_response(conn, 200, headers, length);
+
+        conn->http_body = data;
+        conn->http_body_length = length;
+        conn->http_body_pos = 0;
+
+        update_poll_flags(conn);
+}
+
+void
+pcx_connection_send_http_file(struct pcx_connection *conn,
+                              int status,
+                              const char *headers,
+                              int fd,
+                              uint64_t length)
+{
+        start_http_response(conn, status, headers, length);
+
+        if (fd != -1) {
+                if (!strcmp(conn->http_method, "HEAD")) {
+                        pcx_close(fd);
+                } else {
+                        conn->http_fd = fd;
+                        conn->http_fd_remaining = length;
+                        if (length == 0)
+                                close_http_fd(conn);
+                }
+        }
+
+        update_poll_flags(conn);
+}
+
+void
+pcx_connection_get_stats(struct pcx_connection_stats *stats)
+{
+        *stats = connection_stats;
+}
@@ -30,17 +30,68 @@
 #include "pcx-main-context.h"
 #include "pcx-signal.h"
 #include "pcx-player.h"
+#include "pcx-lobby.h"
 
 enum pcx_connection_event_type {
         PCX_CONNECTION_EVENT_ERROR,
 
+        /* Emitted when the WebSocket headers have been received but
+         * before the reply is sent. The listener can return false
+         * after freeing the connection in order to reject it.
+         */
+        PCX_CONNECTION_EVENT_HANDSHAKE,
+
+        /* Emitted when the PROXY protocol header has been received
+         * and the remote address has been updated. The listener can
+         * return false after freeing the connection in order to
+         * reject it.
+         */
+        PCX_CONNECTION_EVENT_PROXY_HEADER,
+
         PCX_CONNECTION_EVENT_NEW_PLAYER,
         PCX_CONNECTION_EVENT_JOIN_PRIVATE_GAME,
         PCX_CONNECTION_EVENT_RECONNECT,
+        PCX_CONNECTION_EVENT_SPECTATE,
+        PCX_CONNECTION_EVENT_LOBBY_SUBSCRIBE,
+        /* Uses struct pcx_connection_join_private_game_event where
+         * the game_id is the ID from the lobby list.
+         */
+        PCX_CONNECTION_EVENT_JOIN_LOBBY_GAME,
         PCX_CONNECTION_EVENT_LEAVE,
         PCX_CONNECTION_EVENT_BUTTON,
         PCX_CONNECTION_EVENT_SEND_MESSAGE,
         PCX_CONNECTION_EVENT_SIDEBAND,
+
+        /* Emitted instead of the handshake when the client makes a
+         * plain HTTP request. The listener should reply with
+         * pcx_connection_send_http_response or
+         * pcx_connection_send_http_file.
+         */
+        PCX_CONNECTION_EVENT_HTTP_REQUEST,
+};
+
+enum pcx_connection_state {
+        /* Still reading the HTTP request */
+        PCX_CONNECTION_STATE_HANDSHAKE,
+        /* Sending a reply to a plain HTTP request */
+        PCX_CONNECTION_STATE_HTTP,
+        /* Finished the WebSocket handshake but not doing anything */
+        PCX_CONNECTION_STATE_IDLE,
+        PCX_CONNECTION_STATE_LOBBY,
+        PCX_CONNECTION_STATE_PLAYING,
+        PCX_CONNECTION_STATE_SPECTATING,
+};
+
+#define PCX_CONNECTION_N_STATES (PCX_CONNECTION_STATE_SPECTATING + 1)
+
+/* Totals for all connections since the program started */
+struct pcx_connection_stats {
+        uint64_t n_handshakes;
+        uint64_t bytes_received;
+        uint64_t bytes_sent;
+        /* Indexed by the WebSocket opcode */
+        uint64_t frames_received[16];
+        uint64_t frames_sent[16];
 };
 
 struct pcx_connection_event {
@@ -68,6 +119,12 @@ struct pcx_connection_reconnect_event {
         uint16_t n_messages_received;
 };
 
+struct pcx_connection_spectate_event {
+        struct pcx_connection_event base;
+        uint64_t spectate_id;
+        uint16_t n_messages_received;
+};
+
 struct pcx_connection_button_event {
         struct pcx_connection_event base;
         const char *button_data;
@@ -84,6 +141,16 @@ struct pcx_connection_sideband_event {
         const char *text;
 };
 
+struct pcx_connection_http_request_event {
+        struct pcx_connection_event base;
+        const char *method;
+        /* The path from the request line without the query string */
+        const char *path;
+        /* NULL if the client didn’t send the header */
+        const char *if_none_match;
+        bool accepts_gzip;
+};
+
 struct pcx_connection;
 
 struct pcx_connection *
@@ -94,6 +161,13 @@ pcx_connection_accept(SSL_CTX *ssl_ctx,
 void
 pcx_connection_free(struct pcx_connection *conn);
 
+/* Makes the connection read a PROXY protocol header before anything
+ * else, including the SSL handshake. This needs to be called
+ * straight after accepting the connection.
+ */
+void
+pcx_connection_expect_proxy_header(struct pcx_connection *conn);
+
 struct pcx_signal *
 pcx_connection_get_event_signal(struct pcx_connection *conn);
 
@@ -111,6 +185,27 @@ pcx_connection_set_player(struct pcx_connection *conn,
                           struct pcx_player *player,
                           int n_messages_received);
 
+/* Attaches the connection to a conversation without a player so that
+ * it only receives the public messages and the sideband data.
+ */
+void
+pcx_connection_spectate(struct pcx_connection *conn,
+                        struct pcx_conversation *conversation,
+                        int n_messages_received);
+
+/* Starts sending a snapshot of the lobby followed by every batch of
+ * updates until the connection is attached to a conversation.
+ */
+void
+pcx_connection_subscribe_lobby(struct pcx_connection *conn,
+                               struct pcx_lobby *lobby);
+
+/* Returns the conversation that the connection is attached to either
+ * as a player or a spectator, or NULL if it isn’t attached yet.
+ */
+struct pcx_conversation *
+pcx_connection_get_conversation(struct pcx_connection *conn);
+
 uint64_t
 pcx_connection_get_last_update_time(struct pcx_connection *conn);
 
@@ -118,4 +213,34 @@ bool
 pcx_connection_send_message(struct pcx_connection *conn,
                             int message);
 
+enum pcx_connection_state
+pcx_connection_get_state(struct pcx_connection *conn);
+
+/* Sends a reply to a plain HTTP request and then closes the
+ * connection. The data isn’t copied so it needs to stay the same
+ * until the connection is freed.
+ */
+void
+pcx_connection_send_http_response(struct pcx_connection *conn,
+                                  const char *content_type,
+                                  const uint8_t *data,
+                                  size_t length);
+
+/* Sends a reply to a plain HTTP request. The headers are added after
+ * the status line as they are and each one should end with "\r\n".
+ * If fd isn’t -1 then the body is the next length bytes read from it
+ * and the connection takes ownership of it. Afterwards the
+ * connection goes back to waiting for another request unless the
+ * client asked for it to be closed.
+ */
+void
+pcx_connection_send_http_file(struct pcx_connection *conn,
+                              int status,
+                              const char *headers,
+                              int fd,
+                              uint64_t length);
+
+void
+pcx_connection_get_stats(struct pcx_connection_stats *stats);
+
 #endif /* PCX_CONNECTION_H */
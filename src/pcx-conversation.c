@@ -22,11 +22,48 @@
 
 #include <assert.h>
 #include <string.h>
+#include <stdalign.h>
+#include <limits.h>
 
 #include "pcx-log.h"
 #include "pcx-util.h"
 #include "pcx-proto.h"
 #include "pcx-html.h"
+#include "pcx-main-context.h"
+#include "pcx-stats-log.h"
+
+#define MESSAGE_CHUNK_SIZE 32
+
+/* Smallest size class for sideband strings including the header.
+ * Each following class is double the size of the previous one.
+ */
+#define MIN_STRING_ALLOCATION 16
+
+/* Chat messages are only merged while the merged text is shorter
+ * than this so that the message still fits in a frame.
+ */
+#define MAX_MERGED_CHAT_LENGTH 512
+
+/* The level is stored as microseconds worth of refilling like in
+ * pcx_rate_limit.
+ */
+struct pcx_conversation_chat_bucket {
+        uint64_t level;
+        uint64_t last_update_time;
+};
+
+static struct pcx_conversation_chat_stats
+chat_stats;
+
+struct pcx_conversation_message_chunk {
+        /* The messages are allocated from this so that releasing the
+         * chunk only needs to free a few slabs.
+         */
+        struct pcx_slab_allocator slab;
+        /* Total size of the messages allocated from the slab */
+        size_t messages_size;
+        struct pcx_conversation_message *messages[MESSAGE_CHUNK_SIZE];
+};
 
 struct pcx_conversation *
 pcx_conversation_new(const struct pcx_config *config,
@@ -37,6 +74,21 @@ pcx_conversation_new(const struct pcx_config *config,
         struct pcx_conversation *conv = pcx_calloc(sizeof *conv);
 
         pcx_buffer_init(&conv->player_names);
+        pcx_buffer_init(&conv->n_released_private_messages);
+        pcx_buffer_init(&conv->chat_buckets);
+        pcx_buffer_init(&conv->pending_chat);
+        pcx_buffer_init(&conv->saved_state);
+
+        pcx_slab_init(&conv->slab);
+
+        size_t string_alignment =
+                alignof(struct pcx_conversation_sideband_string);
+
+        for (unsigned i = 0; i < PCX_CONVERSATION_N_STRING_SIZES; i++) {
+                pcx_slice_allocator_init(conv->sideband_string_allocators + i,
+                                         MIN_STRING_ALLOCATION << i,
+                                         string_alignment);
+        }
 
         conv->ref_count = 1;
         conv->game_type = game_type;
@@ -44,7 +96,32 @@ pcx_conversation_new(const struct pcx_config *config,
         conv->config = config;
         conv->class_store = class_store;
 
-        pcx_list_init(&conv->messages);
+        int64_t retention = (config ?
+                             config->message_retention :
+                             PCX_CONFIG_DEFAULT_MESSAGE_RETENTION);
+        conv->message_retention = retention * UINT64_C(1000000);
+
+        int64_t sideband_interval = (config ?
+                                     config->sideband_interval :
+                                     PCX_CONFIG_DEFAULT_SIDEBAND_INTERVAL);
+        conv->sideband_interval = sideband_interval * UINT64_C(1000);
+
+        int64_t chat_rate = (config ?
+                             config->chat_rate :
+                             PCX_CONFIG_DEFAULT_CHAT_RATE);
+        int64_t chat_burst = (config ?
+                              config->chat_burst :
+                              PCX_CONFIG_DEFAULT_CHAT_BURST);
+
+        if (chat_rate > 0 && chat_burst > 0) {
+                conv->chat_token_time =
+                        MAX((uint64_t) 60 * 1000000 / chat_rate, 1);
+                conv->chat_capacity = conv->chat_token_time * chat_burst;
+        }
+
+        conv->pending_chat_player = -1;
+
+        pcx_list_init(&conv->message_cursors);
         pcx_signal_init(&conv->event_signal);
 
         return conv;
@@ -66,6 +143,11 @@ emit_event_with_data(struct pcx_conversation *conv,
         event->type = type;
         event->conversation = conv;
 
+        /* Every change to the state that needs saving is followed
+         * by an event.
+         */
+        conv->saved_state_valid = false;
+
         pcx_conversation_ref(conv);
 
         bool ret = pcx_signal_emit(&conv->event_signal, event);
@@ -92,11 +174,201 @@ add_string(uint8_t **p, const char *s)
         *p += len;
 }
 
+static struct pcx_conversation_message_chunk **
+get_chunk_slot(struct pcx_conversation *conv,
+               size_t chunk_num)
+{
+        size_t pos = ((conv->first_message_chunk + chunk_num) &
+                      (conv->message_chunks_size - 1));
+
+        return conv->message_chunks + pos;
+}
+
+struct pcx_conversation_message *
+pcx_conversation_get_message(struct pcx_conversation *conv,
+                             uint64_t seq)
+{
+        assert(seq >= conv->first_message && seq < conv->next_message);
+
+        size_t chunk_num = (seq - conv->first_message) / MESSAGE_CHUNK_SIZE;
+        struct pcx_conversation_message_chunk *chunk =
+                *get_chunk_slot(conv, chunk_num);
+
+        return chunk->messages[seq % MESSAGE_CHUNK_SIZE];
+}
+
+static void
+grow_message_chunks(struct pcx_conversation *conv)
+{
+        size_t new_size = MAX(conv->message_chunks_size * 2, 4);
+        struct pcx_conversation_message_chunk **chunks =
+                pcx_alloc(new_size * sizeof *chunks);
+
+        /* Unwrap the ring so that the first chunk is at the start */
+        for (size_t i = 0; i < conv->n_message_chunks; i++)
+                chunks[i] = *get_chunk_slot(conv, i);
+
+        pcx_free(conv->message_chunks);
+
+        conv->message_chunks = chunks;
+        conv->message_chunks_size = new_size;
+        conv->first_message_chunk = 0;
+}
+
+static struct pcx_conversation_message *
+add_message(struct pcx_conversation *conv,
+            size_t payload_length)
+{
+        uint64_t n_stored = conv->next_message - conv->first_message;
+
+        if (n_stored >= conv->n_message_chunks * MESSAGE_CHUNK_SIZE) {
+                if (conv->n_message_chunks >= conv->message_chunks_size)
+                        grow_message_chunks(conv);
+
+                struct pcx_conversation_message_chunk *chunk =
+                        conv->spare_message_chunk;
+
+                if (chunk) {
+                        conv->spare_message_chunk = NULL;
+                } else {
+                        chunk = pcx_alloc(sizeof *chunk);
+                        pcx_slab_init(&chunk->slab);
+                        chunk->messages_size = 0;
+                }
+
+                *get_chunk_slot(conv, conv->n_message_chunks++) = chunk;
+        }
+
+        size_t chunk_num = n_stored / MESSAGE_CHUNK_SIZE;
+        struct pcx_conversation_message_chunk *chunk =
+                *get_chunk_slot(conv, chunk_num);
+
+        size_t message_size = (offsetof(struct pcx_conversation_message,
+                                        data) +
+                               payload_length);
+        struct pcx_conversation_message *message =
+                pcx_slab_allocate(&chunk->slab,
+                                  message_size,
+                                  alignof(struct pcx_conversation_message));
+
+        chunk->messages_size += message_size;
+        conv->messages_size += message_size;
+
+        chunk->messages[conv->next_message++ % MESSAGE_CHUNK_SIZE] = message;
+
+        return message;
+}
+
+static void
+free_message_chunk(struct pcx_conversation_message_chunk *chunk)
+{
+        pcx_slab_destroy(&chunk->slab);
+        pcx_free(chunk);
+}
+
+static void
+count_released_message(struct pcx_conversation *conv,
+                       const struct pcx_conversation_message *message)
+{
+        if (message->target_player == -1) {
+                conv->n_released_public_messages++;
+                return;
+        }
+
+        size_t needed_length = ((message->target_player + 1) *
+                                sizeof (int));
+        struct pcx_buffer *buf = &conv->n_released_private_messages;
+
+        if (buf->length < needed_length) {
+                size_t old_length = buf->length;
+                pcx_buffer_set_length(buf, needed_length);
+                memset(buf->data + old_length,
+                       0,
+                       needed_length - old_length);
+        }
+
+        ((int *) buf->data)[message->target_player]++;
+}
+
+static int
+get_n_released_messages(struct pcx_conversation *conv,
+                        int player_num)
+{
+        int n_messages = conv->n_released_public_messages;
+        const struct pcx_buffer *buf = &conv->n_released_private_messages;
+
+        if (player_num >= 0 && (player_num + 1) * sizeof (int) <= buf->length)
+                n_messages += ((const int *) buf->data)[player_num];
+
+        return n_messages;
+}
+
+static void
+release_first_message_chunk(struct pcx_conversation *conv)
+{
+        struct pcx_conversation_message_chunk **slot =
+                get_chunk_slot(conv, 0);
+        struct pcx_conversation_message_chunk *chunk = *slot;
+
+        for (unsigned i = 0; i < MESSAGE_CHUNK_SIZE; i++)
+                count_released_message(conv, chunk->messages[i]);
+
+        conv->messages_size -= chunk->messages_size;
+
+        if (conv->spare_message_chunk) {
+                free_message_chunk(chunk);
+        } else {
+                pcx_slab_destroy(&chunk->slab);
+                pcx_slab_init(&chunk->slab);
+                chunk->messages_size = 0;
+                conv->spare_message_chunk = chunk;
+        }
+
+        *slot = NULL;
+
+        conv->first_message_chunk = ((conv->first_message_chunk + 1) &
+                                     (conv->message_chunks_size - 1));
+        conv->n_message_chunks--;
+        conv->first_message += MESSAGE_CHUNK_SIZE;
+}
+
+static void
+compact_messages(struct pcx_conversation *conv)
+{
+        uint64_t min_cursor = conv->next_message;
+        struct pcx_conversation_cursor *cursor;
+
+        pcx_list_for_each(cursor, &conv->message_cursors, link) {
+                if (cursor->next_message < min_cursor)
+                        min_cursor = cursor->next_message;
+        }
+
+        uint64_t now = pcx_main_context_get_monotonic_clock(NULL);
+
+        while (conv->first_message + MESSAGE_CHUNK_SIZE <= min_cursor) {
+                struct pcx_conversation_message_chunk *chunk =
+                        *get_chunk_slot(conv, 0);
+                const struct pcx_conversation_message *last_message =
+                        chunk->messages[MESSAGE_CHUNK_SIZE - 1];
+
+                if (last_message->time + conv->message_retention > now)
+                        break;
+
+                release_first_message_chunk(conv);
+        }
+}
+
+static void
+flush_pending_chat(struct pcx_conversation *conv);
+
 static void
 queue_message(struct pcx_conversation *conv,
               const struct pcx_game_message *message,
               int sending_player)
 {
+        /* Keep the messages in order */
+        flush_pending_chat(conv);
+
         size_t payload_length = 1 + strlen(message->text) + 1;
 
         for (unsigned i = 0; i < message->n_buttons; i++) {
@@ -105,7 +377,9 @@ queue_message(struct pcx_conversation *conv,
                         strlen(message->buttons[i].data) + 1;
         }
 
-        uint8_t *buf = pcx_alloc(payload_length);
+        struct pcx_conversation_message *cmessage =
+                add_message(conv, payload_length);
+        uint8_t *buf = cmessage->data;
         uint8_t *p = buf;
 
         *p = message->format == PCX_GAME_MESSAGE_FORMAT_HTML ? 1 : 0;
@@ -126,17 +400,14 @@ queue_message(struct pcx_conversation *conv,
 
         assert(p - buf == payload_length);
 
-        struct pcx_conversation_message *cmessage =
-                pcx_calloc(sizeof *cmessage);
-
+        cmessage->time = pcx_main_context_get_monotonic_clock(NULL);
         cmessage->target_player = message->target;
         cmessage->sending_player = sending_player;
         cmessage->button_players = message->button_players;
-        cmessage->data = buf;
         cmessage->length = payload_length;
         cmessage->no_buttons_length = no_buttons_length;
 
-        pcx_list_insert(conv->messages.prev, &cmessage->link);
+        compact_messages(conv);
 
         emit_event(conv, PCX_CONVERSATION_EVENT_NEW_MESSAGE);
 }
@@ -152,6 +423,24 @@ send_message_cb(const struct pcx_game_message *message,
         queue_message(conv, message, -1 /* sending_player */);
 }
 
+static void
+log_game_end(struct pcx_conversation *conv,
+             enum pcx_stats_event event)
+{
+        if (conv->start_time == 0)
+                return;
+
+        pcx_stats_log_add(event,
+                          PCX_STATS_SOURCE_WEB,
+                          conv->game_type,
+                          conv->language,
+                          conv->n_players,
+                          conv->start_time);
+
+        /* Only the first way that the game ends is counted */
+        conv->start_time = 0;
+}
+
 static void
 game_over_cb(void *user_data)
 {
@@ -159,6 +448,8 @@ game_over_cb(void *user_data)
 
         pcx_log("game finished successfully");
 
+        log_game_end(conv, PCX_STATS_EVENT_END);
+
         assert(conv->game);
 
         conv->game_type->free_game_cb(conv->game);
@@ -183,15 +474,110 @@ pcx_conversation_get_sideband_data(struct pcx_conversation *conv,
                 data_num);
 }
 
+static int
+get_string_size_class(size_t alloc_size)
+{
+        for (int i = 0; i < PCX_CONVERSATION_N_STRING_SIZES; i++) {
+                if (alloc_size <= MIN_STRING_ALLOCATION << i)
+                        return i;
+        }
+
+        return -1;
+}
+
+static struct pcx_conversation_sideband_string *
+allocate_sideband_string(struct pcx_conversation *conv,
+                         size_t needed_size)
+{
+        size_t header_size =
+                offsetof(struct pcx_conversation_sideband_string, text);
+        size_t alloc_size = header_size + needed_size;
+        int size_class = get_string_size_class(alloc_size);
+        struct pcx_conversation_sideband_string *string;
+
+        if (size_class == -1) {
+                string = pcx_alloc(alloc_size);
+        } else {
+                alloc_size = MIN_STRING_ALLOCATION << size_class;
+                string = pcx_slice_alloc(conv->sideband_string_allocators +
+                                         size_class);
+        }
+
+        string->size = alloc_size - header_size;
+
+        return string;
+}
+
+static void
+free_sideband_string(struct pcx_conversation *conv,
+                     struct pcx_conversation_sideband_string *string)
+{
+        size_t alloc_size =
+                offsetof(struct pcx_conversation_sideband_string, text) +
+                string->size;
+        int size_class = get_string_size_class(alloc_size);
+
+        if (size_class == -1) {
+                pcx_free(string);
+        } else {
+                pcx_slice_free(conv->sideband_string_allocators + size_class,
+                               string);
+        }
+}
+
+static struct pcx_conversation_sideband_array_element *
+get_array_elements(const struct pcx_conversation_sideband_array *array)
+{
+        return (struct pcx_conversation_sideband_array_element *)
+                array->elements.data;
+}
+
+const char *
+pcx_conversation_get_sideband_array_element(const struct
+                                            pcx_conversation_sideband_array
+                                            *array,
+                                            int index,
+                                            uint64_t *version)
+{
+        assert(index >= 0 && index < array->length);
+
+        const struct pcx_conversation_sideband_array_element *element =
+                get_array_elements(array) + index;
+
+        *version = element->version;
+
+        return element->string ? element->string->text : "";
+}
+
+static void
+destroy_sideband_array(struct pcx_conversation *conv,
+                       struct pcx_conversation_sideband_array *array)
+{
+        struct pcx_conversation_sideband_array_element *elements =
+                get_array_elements(array);
+
+        for (int i = 0; i < array->length; i++) {
+                if (elements[i].string)
+                        free_sideband_string(conv, elements[i].string);
+        }
+
+        pcx_buffer_destroy(&array->elements);
+        pcx_free(array);
+}
+
 static void
-destroy_sideband_data(struct pcx_conversation_sideband_data *data)
+destroy_sideband_data(struct pcx_conversation *conv,
+                      struct pcx_conversation_sideband_data *data)
 {
         switch (data->type) {
         case PCX_GAME_SIDEBAND_TYPE_BYTE:
         case PCX_GAME_SIDEBAND_TYPE_UINT32:
                 break;
         case PCX_GAME_SIDEBAND_TYPE_STRING:
-                pcx_free(data->string);
+                free_sideband_string(conv, data->string);
+                break;
+        case PCX_GAME_SIDEBAND_TYPE_ARRAY:
+                destroy_sideband_array(conv, data->array);
                 break;
         }
 }
@@ -215,6 +601,7 @@ get_or_create_sideband_data(struct pcx_conversation *conv,
 
         if ((conv->available_sideband_data & (UINT64_C(1) << data_num)) == 0) {
                 conv->available_sideband_data |= UINT64_C(1) << data_num;
+                data->last_event_time = 0;
                 *created = true;
         } else {
                 *created = false;
@@ -237,7 +624,7 @@ set_sideband_byte(struct pcx_conversation *conv,
                         if (data->byte == value)
                                 return false;
                 } else {
-                        destroy_sideband_data(data);
+                        destroy_sideband_data(conv, data);
                 }
         }
 
@@ -261,7 +648,7 @@ set_sideband_uint32(struct pcx_conversation *conv,
                         if (data->uint32 == value)
                                 return false;
                 } else {
-                        destroy_sideband_data(data);
+                        destroy_sideband_data(conv, data);
                 }
         }
 
@@ -291,23 +678,18 @@ set_sideband_string(struct pcx_conversation *conv,
                         return false;
 
                 if (data->string->size < needed_size) {
-                        destroy_sideband_data(data);
+                        destroy_sideband_data(conv, data);
                         need_allocate = true;
                 } else {
                         need_allocate = false;
                 }
         } else {
-                destroy_sideband_data(data);
+                destroy_sideband_data(conv, data);
                 need_allocate = true;
         }
 
         if (need_allocate) {
-                size_t alloc_size =
-                        (offsetof(struct pcx_conversation_sideband_string,
-                                  text) +
-                         needed_size);
-                data->string = pcx_alloc(alloc_size);
-                data->string->size = needed_size;
+                data->string = allocate_sideband_string(conv, needed_size);
                 data->type = PCX_GAME_SIDEBAND_TYPE_STRING;
         }
 
@@ -317,145 +699,457 @@ set_sideband_string(struct pcx_conversation *conv,
 }
 
 static void
-set_sideband_data_cb(int data_num,
-                     const struct pcx_game_sideband_data *value,
-                     bool force,
-                     void *user_data)
+set_array_length(struct pcx_conversation *conv,
+                 struct pcx_conversation_sideband_array *array,
+                 int length)
 {
-        struct pcx_conversation *conv = user_data;
+        struct pcx_conversation_sideband_array_element *elements;
 
-        bool modified;
+        if (length < array->length) {
+                elements = get_array_elements(array);
 
-        switch (value->type) {
-        case PCX_GAME_SIDEBAND_TYPE_BYTE:
-                modified = set_sideband_byte(conv, data_num, value->byte);
-                goto found_type;
-        case PCX_GAME_SIDEBAND_TYPE_UINT32:
-                modified = set_sideband_uint32(conv, data_num, value->uint32);
-                goto found_type;
-        case PCX_GAME_SIDEBAND_TYPE_STRING:
-                modified = set_sideband_string(conv, data_num, value->string);
-                goto found_type;
-        }
+                for (int i = length; i < array->length; i++) {
+                        if (elements[i].string)
+                                free_sideband_string(conv, elements[i].string);
+                }
+        } else if (length > array->length) {
+                size_t needed_size = length * sizeof *elements;
 
-        assert(!"unknown sideband data type");
-        return;
+                if (array->elements.length < needed_size)
+                        pcx_buffer_set_length(&array->elements, needed_size);
 
-found_type:
-        if (!modified && !force)
-                return;
+                elements = get_array_elements(array);
 
-        struct pcx_conversation_sideband_data_modified_event event = {
-                .data_num = data_num,
-        };
+                /* New elements are empty strings but they still need
+                 * to be sent to clients that have seen an older value
+                 * at the same index.
+                 */
+                for (int i = array->length; i < length; i++) {
+                        elements[i].version = ++conv->sideband_version;
+                        elements[i].string = NULL;
+                }
+        }
 
-        emit_event_with_data(conv,
-                             PCX_CONVERSATION_EVENT_SIDEBAND_DATA_MODIFIED,
-                             &event.base);
+        array->length = length;
 }
 
-static const struct pcx_game_callbacks
-game_callbacks = {
-        .send_message = send_message_cb,
-        .game_over = game_over_cb,
-        .get_class_store = get_class_store_cb,
-        .set_sideband_data = set_sideband_data_cb,
-};
-
-static void
-append_current_players_message(struct pcx_conversation *conv,
-                               struct pcx_buffer *buf)
+static size_t
+get_array_element_length(const char *value)
 {
-        pcx_buffer_append_string(buf,
-                                 pcx_text_get(conv->language,
-                                              PCX_TEXT_STRING_CURRENT_PLAYERS));
-        pcx_buffer_append_string(buf, "\n");
+        size_t length = strlen(value);
 
-        const char *final_separator =
-                pcx_text_get(conv->language,
-                             PCX_TEXT_STRING_FINAL_CONJUNCTION);
+        if (length <= PCX_GAME_MAX_SIDEBAND_ARRAY_ELEMENT_LENGTH)
+                return length;
 
-        for (unsigned i = 0; i < conv->n_players; i++) {
-                if (i > 0) {
-                        if (i == conv->n_players - 1)
-                                pcx_buffer_append_string(buf, final_separator);
-                        else
-                                pcx_buffer_append_string(buf, ", ");
-                }
-                const char *name = pcx_conversation_get_player_name(conv, i);
-                pcx_buffer_append_string(buf, name);
-        }
-}
+        length = PCX_GAME_MAX_SIDEBAND_ARRAY_ELEMENT_LENGTH;
 
-static void
-send_welcome_message(struct pcx_conversation *conv,
-                     int new_player_num)
-{
-        struct pcx_buffer buf = PCX_BUFFER_STATIC_INIT;
+        /* Don’t split a UTF-8 sequence */
+        while (length > 0 && (value[length] & 0xc0) == 0x80)
+                length--;
 
-        enum pcx_text_string welcome_note =
-                conv->n_players < conv->game_type->min_players ?
-                PCX_TEXT_STRING_WELCOME_BUTTONS_TOO_FEW :
-                conv->n_players < conv->game_type->max_players ?
-                PCX_TEXT_STRING_WELCOME_BUTTONS :
-                PCX_TEXT_STRING_WELCOME_BUTTONS_FULL;
+        return length;
+}
 
-        const char *name =
-                pcx_conversation_get_player_name(conv, new_player_num);
+static bool
+set_array_element(struct pcx_conversation *conv,
+                  struct pcx_conversation_sideband_array_element *element,
+                  const char *value,
+                  bool force)
+{
+        size_t length = get_array_element_length(value);
 
-        pcx_buffer_append_printf(&buf,
-                                 pcx_text_get(conv->language,
-                                              welcome_note),
-                                 name);
+        if (element->string) {
+                if (!force &&
+                    !strncmp(element->string->text, value, length) &&
+                    element->string->text[length] == '\0')
+                        return false;
 
-        if (conv->n_players < conv->game_type->max_players) {
-                pcx_buffer_append_string(&buf, "\n\n");
-                append_current_players_message(conv, &buf);
+                if (element->string->size <= length) {
+                        free_sideband_string(conv, element->string);
+                        element->string = NULL;
+                }
+        } else if (length == 0 && !force) {
+                return false;
         }
 
-        struct pcx_game_button start_button = {
-                .text = pcx_text_get(conv->language,
-                                     PCX_TEXT_STRING_START_BUTTON),
-                .data = "start",
-        };
-
-        int n_buttons = ((conv->n_players >= conv->game_type->min_players &&
-                          conv->n_players < conv->game_type->max_players) ?
-                         1 :
-                         0);
-
-        struct pcx_game_message message = PCX_GAME_DEFAULT_MESSAGE;
+        if (length == 0) {
+                if (element->string) {
+                        free_sideband_string(conv, element->string);
+                        element->string = NULL;
+                }
+        } else {
+                if (element->string == NULL)
+                        element->string =
+                                allocate_sideband_string(conv, length + 1);
 
-        message.text = (char *) buf.data;
-        message.n_buttons = n_buttons;
-        message.buttons = &start_button;
+                memcpy(element->string->text, value, length);
+                element->string->text[length] = '\0';
+        }
 
-        queue_message(conv, &message, -1 /* sending_player */);
+        element->version = ++conv->sideband_version;
 
-        pcx_buffer_destroy(&buf);
+        return true;
 }
 
-int
-pcx_conversation_add_player(struct pcx_conversation *conv,
-                            const char *name)
+static bool
+set_sideband_array(struct pcx_conversation *conv,
+                   int data_num,
+                   const struct pcx_game_sideband_array *value,
+                   bool force)
 {
-        assert(conv->n_players < conv->game_type->max_players);
-        assert(!conv->started);
+        assert(value->start >= 0 && value->n_elements >= 0);
+        assert(value->start + value->n_elements <=
+               PCX_GAME_MAX_SIDEBAND_ARRAY_LENGTH);
+        assert(value->length <= PCX_GAME_MAX_SIDEBAND_ARRAY_LENGTH);
 
-        int player_num = conv->n_players++;
+        bool created;
+        struct pcx_conversation_sideband_data *data =
+                get_or_create_sideband_data(conv, data_num, &created);
+        bool modified = false;
 
-        char *name_copy = pcx_strdup(name);
+        if (created || data->type != PCX_GAME_SIDEBAND_TYPE_ARRAY) {
+                if (!created)
+                        destroy_sideband_data(conv, data);
 
-        pcx_buffer_append(&conv->player_names, &name_copy, sizeof name_copy);
+                data->type = PCX_GAME_SIDEBAND_TYPE_ARRAY;
+                data->array = pcx_calloc(sizeof *data->array);
+                pcx_buffer_init(&data->array->elements);
+                modified = true;
+        }
 
-        pcx_conversation_ref(conv);
+        struct pcx_conversation_sideband_array *array = data->array;
+        int end = value->start + value->n_elements;
+        int length = value->length == -1 ? MAX(end, array->length) :
+                value->length;
 
-        emit_event(conv, PCX_CONVERSATION_EVENT_PLAYER_ADDED);
+        if (length != array->length) {
+                set_array_length(conv, array, length);
+                modified = true;
+        }
 
-        send_welcome_message(conv, player_num);
+        struct pcx_conversation_sideband_array_element *elements =
+                get_array_elements(array);
 
-        if (conv->n_players >= conv->game_type->max_players)
-                pcx_conversation_start(conv);
+        /* Elements beyond the new length are ignored */
+        for (int i = value->start; i < MIN(end, length); i++) {
+                if (set_array_element(conv,
+                                      elements + i,
+                                      value->elements[i - value->start],
+                                      force))
+                        modified = true;
+        }
+
+        return modified;
+}
+
+static void
+emit_sideband_data_modified(struct pcx_conversation *conv,
+                            int data_num)
+{
+        struct pcx_conversation_sideband_data *data =
+                pcx_conversation_get_sideband_data(conv, data_num);
+
+        data->last_event_time = pcx_main_context_get_monotonic_clock(NULL);
+
+        struct pcx_conversation_sideband_data_modified_event event = {
+                .data_num = data_num,
+        };
+
+        emit_event_with_data(conv,
+                             PCX_CONVERSATION_EVENT_SIDEBAND_DATA_MODIFIED,
+                             &event.base);
+}
+
+static void
+remove_sideband_timeout(struct pcx_conversation *conv)
+{
+        if (conv->sideband_timeout) {
+                pcx_main_context_remove_source(conv->sideband_timeout);
+                conv->sideband_timeout = NULL;
+        }
+}
+
+static void
+sideband_timeout_cb(struct pcx_main_context_source *source,
+                    void *user_data);
+
+static void
+schedule_sideband_timeout(struct pcx_conversation *conv)
+{
+        remove_sideband_timeout(conv);
+
+        if (conv->pending_sideband_data == 0)
+                return;
+
+        uint64_t next_time = UINT64_MAX;
+        uint64_t bits = conv->pending_sideband_data;
+
+        while (bits) {
+                int data_num = ffsll(bits) - 1;
+                bits &= ~(UINT64_C(1) << data_num);
+
+                const struct pcx_conversation_sideband_data *data =
+                        pcx_conversation_get_sideband_data(conv, data_num);
+                uint64_t event_time = (data->last_event_time +
+                                       conv->sideband_interval);
+
+                if (event_time < next_time)
+                        next_time = event_time;
+        }
+
+        uint64_t now = pcx_main_context_get_monotonic_clock(NULL);
+        long ms = next_time > now ? (next_time - now + 999) / 1000 : 0;
+
+        conv->sideband_timeout =
+                pcx_main_context_add_timeout(NULL,
+                                             ms,
+                                             sideband_timeout_cb,
+                                             conv);
+}
+
+/* Emits the modified event for each pending piece of sideband data
+ * whose interval has passed, or for all of them if all is true.
+ */
+static void
+emit_pending_sideband_data(struct pcx_conversation *conv,
+                           bool all)
+{
+        uint64_t now = pcx_main_context_get_monotonic_clock(NULL);
+        uint64_t bits = conv->pending_sideband_data;
+
+        /* A listener might drop the last reference */
+        pcx_conversation_ref(conv);
+
+        while (bits) {
+                int data_num = ffsll(bits) - 1;
+                uint64_t bit = UINT64_C(1) << data_num;
+
+                bits &= ~bit;
+
+                if ((conv->pending_sideband_data & bit) == 0)
+                        continue;
+
+                const struct pcx_conversation_sideband_data *data =
+                        pcx_conversation_get_sideband_data(conv, data_num);
+
+                if (!all &&
+                    data->last_event_time + conv->sideband_interval > now)
+                        continue;
+
+                conv->pending_sideband_data &= ~bit;
+                emit_sideband_data_modified(conv, data_num);
+        }
+
+        schedule_sideband_timeout(conv);
+
+        pcx_conversation_unref(conv);
+}
+
+static void
+sideband_timeout_cb(struct pcx_main_context_source *source,
+                    void *user_data)
+{
+        struct pcx_conversation *conv = user_data;
+
+        conv->sideband_timeout = NULL;
+
+        emit_pending_sideband_data(conv, false /* all */);
+}
+
+static void
+queue_sideband_data_modified(struct pcx_conversation *conv,
+                             int data_num)
+{
+        uint64_t bit = UINT64_C(1) << data_num;
+
+        /* If an event is already pending then the clients will get
+         * the latest value when it is emitted.
+         */
+        if ((conv->pending_sideband_data & bit))
+                return;
+
+        const struct pcx_conversation_sideband_data *data =
+                pcx_conversation_get_sideband_data(conv, data_num);
+        uint64_t now = pcx_main_context_get_monotonic_clock(NULL);
+
+        if (data->last_event_time == 0 ||
+            data->last_event_time + conv->sideband_interval <= now) {
+                emit_sideband_data_modified(conv, data_num);
+                return;
+        }
+
+        conv->pending_sideband_data |= bit;
+        schedule_sideband_timeout(conv);
+}
+
+static bool
+set_sideband_value(struct pcx_conversation *conv,
+                   int data_num,
+                   const struct pcx_game_sideband_data *value,
+                   bool force)
+{
+        switch (value->type) {
+        case PCX_GAME_SIDEBAND_TYPE_BYTE:
+                return set_sideband_byte(conv, data_num, value->byte);
+        case PCX_GAME_SIDEBAND_TYPE_UINT32:
+                return set_sideband_uint32(conv, data_num, value->uint32);
+        case PCX_GAME_SIDEBAND_TYPE_STRING:
+                return set_sideband_string(conv, data_num, value->string);
+        case PCX_GAME_SIDEBAND_TYPE_ARRAY:
+                return set_sideband_array(conv,
+                                          data_num,
+                                          &value->array,
+                                          force);
+        }
+
+        assert(!"unknown sideband data type");
+        return false;
+}
+
+static void
+set_sideband_data_cb(int data_num,
+                     const struct pcx_game_sideband_data *value,
+                     bool force,
+                     void *user_data)
+{
+        struct pcx_conversation *conv = user_data;
+
+        bool modified = set_sideband_value(conv, data_num, value, force);
+
+        if (force) {
+                /* Forced data is used for events so it is sent
+                 * straight away. Any held back changes are sent first
+                 * so that the clients see them in order.
+                 */
+                conv->pending_sideband_data &= ~(UINT64_C(1) << data_num);
+                emit_pending_sideband_data(conv, true /* all */);
+                emit_sideband_data_modified(conv, data_num);
+        } else if (modified) {
+                queue_sideband_data_modified(conv, data_num);
+        }
+}
+
+static const struct pcx_game_callbacks
+game_callbacks = {
+        .send_message = send_message_cb,
+        .game_over = game_over_cb,
+        .get_class_store = get_class_store_cb,
+        .set_sideband_data = set_sideband_data_cb,
+};
+
+static void
+append_current_players_message(struct pcx_conversation *conv,
+                               struct pcx_buffer *buf)
+{
+        pcx_buffer_append_string(buf,
+                                 pcx_text_get(conv->language,
+                                              PCX_TEXT_STRING_CURRENT_PLAYERS));
+        pcx_buffer_append_string(buf, "\n");
+
+        const char *final_separator =
+                pcx_text_get(conv->language,
+                             PCX_TEXT_STRING_FINAL_CONJUNCTION);
+
+        for (unsigned i = 0; i < conv->n_players; i++) {
+                if (i > 0) {
+                        if (i == conv->n_players - 1)
+                                pcx_buffer_append_string(buf, final_separator);
+                        else
+                                pcx_buffer_append_string(buf, ", ");
+                }
+                const char *name = pcx_conversation_get_player_name(conv, i);
+                pcx_buffer_append_string(buf, name);
+        }
+}
+
+static void
+send_welcome_message(struct pcx_conversation *conv,
+                     int new_player_num)
+{
+        struct pcx_buffer buf = PCX_BUFFER_STATIC_INIT;
+
+        enum pcx_text_string welcome_note =
+                conv->n_players < conv->game_type->min_players ?
+                PCX_TEXT_STRING_WELCOME_BUTTONS_TOO_FEW :
+                conv->n_players < conv->game_type->max_players ?
+                PCX_TEXT_STRING_WELCOME_BUTTONS :
+                PCX_TEXT_STRING_WELCOME_BUTTONS_FULL;
+
+        const char *name =
+                pcx_conversation_get_player_name(conv, new_player_num);
+
+        pcx_buffer_append_printf(&buf,
+                                 pcx_text_get(conv->language,
+                                              welcome_note),
+                                 name);
+
+        if (conv->n_players < conv->game_type->max_players) {
+                pcx_buffer_append_string(&buf, "\n\n");
+                append_current_players_message(conv, &buf);
+        }
+
+        struct pcx_game_button start_button = {
+                .text = pcx_text_get(conv->language,
+                                     PCX_TEXT_STRING_START_BUTTON),
+                .data = "start",
+        };
+
+        int n_buttons = ((conv->n_players >= conv->game_type->min_players &&
+                          conv->n_players < conv->game_type->max_players) ?
+                         1 :
+                         0);
+
+        struct pcx_game_message message = PCX_GAME_DEFAULT_MESSAGE;
+
+        message.text = (char *) buf.data;
+        message.n_buttons = n_buttons;
+        message.buttons = &start_button;
+
+        queue_message(conv, &message, -1 /* sending_player */);
+
+        pcx_buffer_destroy(&buf);
+}
+
+static void
+add_player_name(struct pcx_conversation *conv,
+                const char *name)
+{
+        size_t name_size = strlen(name) + 1;
+        char *name_copy = pcx_slab_allocate(&conv->slab, name_size, 1);
+
+        memcpy(name_copy, name, name_size);
+
+        pcx_buffer_append(&conv->player_names, &name_copy, sizeof name_copy);
+
+        struct pcx_conversation_chat_bucket bucket = {
+                .level = conv->chat_capacity,
+                .last_update_time = pcx_main_context_get_monotonic_clock(NULL),
+        };
+
+        pcx_buffer_append(&conv->chat_buckets, &bucket, sizeof bucket);
+
+        conv->n_players++;
+}
+
+int
+pcx_conversation_add_player(struct pcx_conversation *conv,
+                            const char *name)
+{
+        assert(conv->n_players < conv->game_type->max_players);
+        assert(!conv->started);
+
+        int player_num = conv->n_players;
+
+        add_player_name(conv, name);
+
+        pcx_conversation_ref(conv);
+
+        emit_event(conv, PCX_CONVERSATION_EVENT_PLAYER_ADDED);
+
+        send_welcome_message(conv, player_num);
+
+        if (conv->n_players >= conv->game_type->max_players)
+                pcx_conversation_start(conv);
 
         pcx_conversation_unref(conv);
 
@@ -485,6 +1179,11 @@ pcx_conversation_remove_player(struct pcx_conversation *conv,
 
         pcx_buffer_destroy(&buf);
 
+        conv->n_players_left++;
+
+        if (conv->game && conv->n_players_left >= conv->n_players)
+                log_game_end(conv, PCX_STATS_EVENT_ABANDON);
+
         struct pcx_conversation_player_removed_event event = {
                 .player_num = player_num
         };
@@ -496,6 +1195,24 @@ pcx_conversation_remove_player(struct pcx_conversation *conv,
         pcx_conversation_unref(conv);
 }
 
+void
+pcx_conversation_end_game(struct pcx_conversation *conv)
+{
+        /* Make sure it can’t start later either */
+        conv->started = true;
+
+        if (conv->game == NULL)
+                return;
+
+        pcx_log("game ended before finishing");
+
+        log_game_end(conv, PCX_STATS_EVENT_ABANDON);
+
+        conv->game_type->free_game_cb(conv->game);
+
+        conv->game = NULL;
+}
+
 void
 pcx_conversation_start(struct pcx_conversation *conv)
 {
@@ -521,6 +1238,15 @@ pcx_conversation_start(struct pcx_conversation *conv)
                                                 (const char * const *)
                                                 conv->player_names.data);
 
+        conv->start_time = pcx_main_context_get_monotonic_clock(NULL);
+
+        pcx_stats_log_add(PCX_STATS_EVENT_START,
+                          PCX_STATS_SOURCE_WEB,
+                          conv->game_type,
+                          conv->language,
+                          conv->n_players,
+                          conv->start_time);
+
         pcx_conversation_unref(conv);
 }
 
@@ -544,29 +1270,162 @@ pcx_conversation_push_button(struct pcx_conversation *conv,
         }
 }
 
-void
-pcx_conversation_add_chat_message(struct pcx_conversation *conv,
-                                  int player_num,
-                                  const char *text)
+static void
+flush_pending_chat(struct pcx_conversation *conv)
 {
-        assert(player_num >= 0 && player_num < conv->n_players);
+        if (conv->pending_chat_source) {
+                pcx_main_context_remove_source(conv->pending_chat_source);
+                conv->pending_chat_source = NULL;
+        }
 
-        struct pcx_buffer buf = PCX_BUFFER_STATIC_INIT;
+        int player_num = conv->pending_chat_player;
 
-        const char *name = pcx_conversation_get_player_name(conv, player_num);
+        if (player_num == -1)
+                return;
 
-        pcx_buffer_append_string(&buf, "<b>");
-        pcx_html_escape(&buf, name);
-        pcx_buffer_append_string(&buf, "</b>\n\n");
-        pcx_html_escape(&buf, text);
+        /* Reset this first because queue_message calls back into
+         * this function.
+         */
+        conv->pending_chat_player = -1;
 
         struct pcx_game_message message = PCX_GAME_DEFAULT_MESSAGE;
 
-        message.text = (const char *) buf.data;
+        message.text = (const char *) conv->pending_chat.data;
         message.format = PCX_GAME_MESSAGE_FORMAT_HTML;
 
         queue_message(conv, &message, player_num);
 
+        pcx_buffer_set_length(&conv->pending_chat, 0);
+}
+
+static void
+pending_chat_cb(struct pcx_main_context_source *source,
+                void *user_data)
+{
+        struct pcx_conversation *conv = user_data;
+
+        conv->pending_chat_source = NULL;
+
+        pcx_conversation_ref(conv);
+        flush_pending_chat(conv);
+        pcx_conversation_unref(conv);
+}
+
+static void
+queue_pending_chat(struct pcx_conversation *conv)
+{
+        /* The timeout fires once all of the other events in this
+         * main loop iteration have been handled.
+         */
+        if (conv->pending_chat_source == NULL) {
+                conv->pending_chat_source =
+                        pcx_main_context_add_timeout(NULL,
+                                                     0, /* ms */
+                                                     pending_chat_cb,
+                                                     conv);
+        }
+}
+
+static bool
+take_chat_token(struct pcx_conversation *conv,
+                int player_num)
+{
+        if (conv->chat_token_time == 0)
+                return true;
+
+        struct pcx_conversation_chat_bucket *bucket =
+                (struct pcx_conversation_chat_bucket *)
+                conv->chat_buckets.data +
+                player_num;
+        uint64_t now = pcx_main_context_get_monotonic_clock(NULL);
+
+        bucket->level = MIN(bucket->level + (now - bucket->last_update_time),
+                            conv->chat_capacity);
+        bucket->last_update_time = now;
+
+        if (bucket->level < conv->chat_token_time)
+                return false;
+
+        bucket->level -= conv->chat_token_time;
+
+        return true;
+}
+
+size_t
+pcx_conversation_get_message_log_size(struct pcx_conversation *conv)
+{
+        size_t n_chunks = conv->n_message_chunks;
+
+        if (conv->spare_message_chunk)
+                n_chunks++;
+
+        return (conv->messages_size +
+                n_chunks * sizeof (struct pcx_conversation_message_chunk) +
+                conv->message_chunks_size *
+                sizeof (struct pcx_conversation_message_chunk *));
+}
+
+void
+pcx_conversation_get_chat_stats(struct pcx_conversation_chat_stats *stats)
+{
+        *stats = chat_stats;
+}
+
+static void
+queue_chat_message(struct pcx_conversation *conv,
+                   int player_num,
+                   const char *text)
+{
+        struct pcx_buffer escaped = PCX_BUFFER_STATIC_INIT;
+
+        pcx_html_escape(&escaped, text);
+
+        if (conv->pending_chat_player == player_num &&
+            conv->pending_chat.length + 1 + escaped.length <=
+            MAX_MERGED_CHAT_LENGTH) {
+                pcx_buffer_append_c(&conv->pending_chat, '\n');
+                conv->n_merged_chat_messages++;
+                chat_stats.n_merged++;
+        } else {
+                flush_pending_chat(conv);
+
+                const char *name =
+                        pcx_conversation_get_player_name(conv, player_num);
+
+                pcx_buffer_append_string(&conv->pending_chat, "<b>");
+                pcx_html_escape(&conv->pending_chat, name);
+                pcx_buffer_append_string(&conv->pending_chat, "</b>\n\n");
+
+                conv->pending_chat_player = player_num;
+        }
+
+        pcx_buffer_append_string(&conv->pending_chat,
+                                 (const char *) escaped.data);
+
+        pcx_buffer_destroy(&escaped);
+
+        queue_pending_chat(conv);
+}
+
+void
+pcx_conversation_add_chat_message(struct pcx_conversation *conv,
+                                  int player_num,
+                                  const char *text)
+{
+        assert(player_num >= 0 && player_num < conv->n_players);
+
+        /* Only the broadcast is limited. Messages over the limit are
+         * still passed to the game so that a quick player doesn’t
+         * lose moves in games that take the chat as input, such as
+         * Word Party.
+         */
+        if (take_chat_token(conv, player_num)) {
+                queue_chat_message(conv, player_num, text);
+        } else {
+                conv->n_dropped_chat_messages++;
+                chat_stats.n_dropped++;
+        }
+
         if (conv->game != NULL && conv->game_type->handle_message_cb) {
                 pcx_conversation_ref(conv);
 
@@ -576,8 +1435,6 @@ pcx_conversation_add_chat_message(struct pcx_conversation *conv,
 
                 pcx_conversation_unref(conv);
         }
-
-        pcx_buffer_destroy(&buf);
 }
 
 void
@@ -600,6 +1457,441 @@ pcx_conversation_set_sideband(struct pcx_conversation *conv,
         }
 }
 
+int
+pcx_conversation_seek_cursor(struct pcx_conversation *conv,
+                             struct pcx_conversation_cursor *cursor,
+                             int player_num,
+                             int n_messages)
+{
+        int n_released = get_n_released_messages(conv, player_num);
+
+        cursor->next_message = conv->first_message;
+
+        if (n_messages < n_released)
+                return n_released - n_messages;
+
+        n_messages -= n_released;
+
+        while (n_messages > 0 && cursor->next_message < conv->next_message) {
+                const struct pcx_conversation_message *message =
+                        pcx_conversation_get_message(conv,
+                                                     cursor->next_message++);
+
+                if (message->target_player == -1 ||
+                    message->target_player == player_num)
+                        n_messages--;
+        }
+
+        return 0;
+}
+
+void
+pcx_conversation_add_cursor(struct pcx_conversation *conv,
+                            struct pcx_conversation_cursor *cursor)
+{
+        pcx_list_insert(&conv->message_cursors, &cursor->link);
+}
+
+void
+pcx_conversation_remove_cursor(struct pcx_conversation_cursor *cursor)
+{
+        pcx_list_remove(&cursor->link);
+}
+
+bool
+pcx_conversation_can_save(struct pcx_conversation *conv)
+{
+        if (!conv->started)
+                return false;
+
+        /* A game that has already finished only needs its messages */
+        if (conv->game == NULL)
+                return true;
+
+        return (conv->game_type->snapshot_cb != NULL &&
+                conv->game_type->restore_cb != NULL);
+}
+
+static void
+save_messages(struct pcx_conversation *conv,
+              struct pcx_buffer *buf)
+{
+        uint64_t now = pcx_main_context_get_monotonic_clock(NULL);
+
+        pcx_snapshot_write_uint64(buf, conv->first_message);
+        pcx_snapshot_write_uint64(buf,
+                                  conv->next_message - conv->first_message);
+
+        for (uint64_t seq = conv->first_message;
+             seq < conv->next_message;
+             seq++) {
+                const struct pcx_conversation_message *message =
+                        pcx_conversation_get_message(conv, seq);
+
+                /* The monotonic clock starts from a different point
+                 * after a restart so the time is stored as an age.
+                 */
+                pcx_snapshot_write_uint64(buf, now - message->time);
+                pcx_snapshot_write_int(buf, message->target_player);
+                pcx_snapshot_write_uint32(buf, message->button_players);
+                pcx_snapshot_write_int(buf, message->sending_player);
+                pcx_snapshot_write_uint32(buf, message->no_buttons_length);
+                pcx_snapshot_write_data(buf, message->data, message->length);
+        }
+
+        pcx_snapshot_write_int(buf, conv->n_released_public_messages);
+
+        const struct pcx_buffer *released = &conv->n_released_private_messages;
+        int n_released = released->length / sizeof (int);
+
+        pcx_snapshot_write_int(buf, n_released);
+
+        for (int i = 0; i < n_released; i++)
+                pcx_snapshot_write_int(buf, ((const int *) released->data)[i]);
+}
+
+static void
+save_sideband_data(struct pcx_conversation *conv,
+                   struct pcx_buffer *buf)
+{
+        pcx_snapshot_write_uint64(buf, conv->available_sideband_data);
+
+        for (int i = 0; i < 8 * sizeof conv->available_sideband_data; i++) {
+                if ((conv->available_sideband_data & (UINT64_C(1) << i)) == 0)
+                        continue;
+
+                const struct pcx_conversation_sideband_data *data =
+                        pcx_conversation_get_sideband_data(conv, i);
+
+                pcx_snapshot_write_uint8(buf, data->type);
+
+                switch (data->type) {
+                case PCX_GAME_SIDEBAND_TYPE_BYTE:
+                        pcx_snapshot_write_uint8(buf, data->byte);
+                        break;
+                case PCX_GAME_SIDEBAND_TYPE_UINT32:
+                        pcx_snapshot_write_uint32(buf, data->uint32);
+                        break;
+                case PCX_GAME_SIDEBAND_TYPE_STRING:
+                        pcx_snapshot_write_string(buf, data->string->text);
+                        break;
+                case PCX_GAME_SIDEBAND_TYPE_ARRAY: {
+                        const struct pcx_conversation_sideband_array *array =
+                                data->array;
+
+                        pcx_snapshot_write_int(buf, array->length);
+
+                        const struct pcx_conversation_sideband_array_element *
+                                elements = get_array_elements(array);
+
+                        for (int j = 0; j < array->length; j++) {
+                                const struct pcx_conversation_sideband_string *
+                                        string = elements[j].string;
+                                pcx_snapshot_write_string(buf,
+                                                          string ?
+                                                          string->text :
+                                                          "");
+                        }
+                        break;
+                }
+                }
+        }
+}
+
+void
+pcx_conversation_save(struct pcx_conversation *conv,
+                      struct pcx_buffer *buf)
+{
+        assert(pcx_conversation_can_save(conv));
+
+        pcx_snapshot_write_string(buf, conv->game_type->name);
+        pcx_snapshot_write_string(buf,
+                                  pcx_text_get(conv->language,
+                                               PCX_TEXT_STRING_LANGUAGE_CODE));
+        pcx_snapshot_write_bool(buf, conv->is_private);
+        pcx_snapshot_write_uint64(buf, conv->private_game_id);
+        pcx_snapshot_write_uint64(buf, conv->spectate_id);
+
+        pcx_snapshot_write_int(buf, conv->n_players);
+
+        for (int i = 0; i < conv->n_players; i++) {
+                const char *name = pcx_conversation_get_player_name(conv, i);
+                pcx_snapshot_write_string(buf, name);
+        }
+
+        save_messages(conv, buf);
+        save_sideband_data(conv, buf);
+
+        /* The held back chat is saved as it is rather than being
+         * flushed so that saving doesn’t change how it is merged.
+         */
+        pcx_snapshot_write_int(buf, conv->pending_chat_player);
+
+        if (conv->pending_chat_player != -1) {
+                pcx_snapshot_write_string(buf,
+                                          (const char *)
+                                          conv->pending_chat.data);
+        }
+
+        pcx_snapshot_write_bool(buf, conv->game != NULL);
+
+        if (conv->game)
+                conv->game_type->snapshot_cb(conv->game, buf);
+}
+
+void
+pcx_conversation_save_cached(struct pcx_conversation *conv,
+                             struct pcx_buffer *buf,
+                             uint64_t max_age)
+{
+        uint64_t now = pcx_main_context_get_monotonic_clock(NULL);
+
+        if (!conv->saved_state_valid ||
+            now - conv->saved_state_time > max_age) {
+                pcx_buffer_set_length(&conv->saved_state, 0);
+                pcx_conversation_save(conv, &conv->saved_state);
+                conv->saved_state_valid = true;
+                conv->saved_state_time = now;
+        }
+
+        pcx_buffer_append(buf,
+                          conv->saved_state.data,
+                          conv->saved_state.length);
+}
+
+static const struct pcx_game *
+find_game_type(const struct pcx_game * const *game_list,
+               const char *name)
+{
+        for (const struct pcx_game * const *game = game_list;
+             *game;
+             game++) {
+                if (!strcmp((*game)->name, name))
+                        return *game;
+        }
+
+        return NULL;
+}
+
+static void
+restore_messages(struct pcx_conversation *conv,
+                 struct pcx_snapshot_reader *reader)
+{
+        uint64_t now = pcx_main_context_get_monotonic_clock(NULL);
+        uint64_t first_message = pcx_snapshot_read_uint64(reader);
+        uint64_t n_messages = pcx_snapshot_read_uint64(reader);
+
+        /* The message chunks always start on a multiple of the chunk
+         * size.
+         */
+        if (first_message % MESSAGE_CHUNK_SIZE != 0) {
+                pcx_snapshot_reader_set_error(reader);
+                return;
+        }
+
+        conv->first_message = first_message;
+        conv->next_message = first_message;
+
+        for (uint64_t i = 0; i < n_messages && !reader->error; i++) {
+                uint64_t age = pcx_snapshot_read_uint64(reader);
+                int target_player =
+                        pcx_snapshot_read_int_range(reader,
+                                                    -1,
+                                                    conv->n_players - 1);
+                uint32_t button_players = pcx_snapshot_read_uint32(reader);
+                int sending_player =
+                        pcx_snapshot_read_int_range(reader,
+                                                    -1,
+                                                    conv->n_players - 1);
+                uint32_t no_buttons_length = pcx_snapshot_read_uint32(reader);
+                size_t length;
+                const uint8_t *data = pcx_snapshot_read_data(reader, &length);
+
+                if (data == NULL || no_buttons_length > length) {
+                        pcx_snapshot_reader_set_error(reader);
+                        break;
+                }
+
+                struct pcx_conversation_message *message =
+                        add_message(conv, length);
+
+                message->time = age < now ? now - age : 0;
+                message->target_player = target_player;
+                message->button_players = button_players;
+                message->sending_player = sending_player;
+                message->length = length;
+                message->no_buttons_length = no_buttons_length;
+                memcpy(message->data, data, length);
+        }
+
+        conv->n_released_public_messages =
+                pcx_snapshot_read_int_range(reader, 0, INT_MAX);
+
+        int n_released = pcx_snapshot_read_int_range(reader,
+                                                     0,
+                                                     conv->n_players);
+
+        for (int i = 0; i < n_released; i++) {
+                int value = pcx_snapshot_read_int_range(reader, 0, INT_MAX);
+                pcx_buffer_append(&conv->n_released_private_messages,
+                                  &value,
+                                  sizeof value);
+        }
+}
+
+static void
+restore_sideband_array(struct pcx_conversation *conv,
+                       int data_num,
+                       struct pcx_snapshot_reader *reader)
+{
+        int length =
+                pcx_snapshot_read_int_range(reader,
+                                            0,
+                                            PCX_GAME_MAX_SIDEBAND_ARRAY_LENGTH);
+        struct pcx_buffer elements = PCX_BUFFER_STATIC_INIT;
+
+        for (int i = 0; i < length && !reader->error; i++) {
+                const char *element = pcx_snapshot_read_string(reader);
+                pcx_buffer_append(&elements, &element, sizeof element);
+        }
+
+        if (!reader->error) {
+                struct pcx_game_sideband_data value = {
+                        .type = PCX_GAME_SIDEBAND_TYPE_ARRAY,
+                        .array = {
+                                .start = 0,
+                                .n_elements = length,
+                                .elements = (const char * const *)
+                                elements.data,
+                                .length = length,
+                        },
+                };
+
+                set_sideband_value(conv, data_num, &value, false);
+        }
+
+        pcx_buffer_destroy(&elements);
+}
+
+static void
+restore_sideband_data(struct pcx_conversation *conv,
+                      struct pcx_snapshot_reader *reader)
+{
+        uint64_t available = pcx_snapshot_read_uint64(reader);
+
+        for (int i = 0; i < 8 * sizeof available && !reader->error; i++) {
+                if ((available & (UINT64_C(1) << i)) == 0)
+                        continue;
+
+                struct pcx_game_sideband_data value;
+
+                value.type = pcx_snapshot_read_uint8(reader);
+
+                switch (value.type) {
+                case PCX_GAME_SIDEBAND_TYPE_BYTE:
+                        value.byte = pcx_snapshot_read_uint8(reader);
+                        break;
+                case PCX_GAME_SIDEBAND_TYPE_UINT32:
+                        value.uint32 = pcx_snapshot_read_uint32(reader);
+                        break;
+                case PCX_GAME_SIDEBAND_TYPE_STRING:
+                        value.string = pcx_snapshot_read_string(reader);
+                        break;
+                case PCX_GAME_SIDEBAND_TYPE_ARRAY:
+                        restore_sideband_array(conv, i, reader);
+                        continue;
+                default:
+                        pcx_snapshot_reader_set_error(reader);
+                        continue;
+                }
+
+                if (!reader->error)
+                        set_sideband_value(conv, i, &value, false);
+        }
+}
+
+static void
+restore_pending_chat(struct pcx_conversation *conv,
+                     struct pcx_snapshot_reader *reader)
+{
+        int player_num = pcx_snapshot_read_int_range(reader,
+                                                     -1,
+                                                     conv->n_players - 1);
+
+        if (player_num == -1)
+                return;
+
+        const char *text = pcx_snapshot_read_string(reader);
+
+        if (reader->error)
+                return;
+
+        pcx_buffer_append_string(&conv->pending_chat, text);
+        conv->pending_chat_player = player_num;
+
+        queue_pending_chat(conv);
+}
+
+struct pcx_conversation *
+pcx_conversation_restore(const struct pcx_config *config,
+                         struct pcx_class_store *class_store,
+                         const struct pcx_game * const *game_list,
+                         struct pcx_snapshot_reader *reader)
+{
+        const struct pcx_game *game_type =
+                find_game_type(game_list, pcx_snapshot_read_string(reader));
+        enum pcx_text_language language;
+
+        if (game_type == NULL ||
+            !pcx_text_lookup_language(pcx_snapshot_read_string(reader),
+                                      &language))
+                return NULL;
+
+        struct pcx_conversation *conv =
+                pcx_conversation_new(config, class_store, game_type, language);
+
+        conv->started = true;
+        conv->is_private = pcx_snapshot_read_bool(reader);
+        conv->private_game_id = pcx_snapshot_read_uint64(reader);
+        conv->spectate_id = pcx_snapshot_read_uint64(reader);
+
+        int n_players = pcx_snapshot_read_int_range(reader,
+                                                    game_type->min_players,
+                                                    game_type->max_players);
+
+        for (int i = 0; i < n_players && !reader->error; i++)
+                add_player_name(conv, pcx_snapshot_read_string(reader));
+
+        restore_messages(conv, reader);
+        restore_sideband_data(conv, reader);
+        restore_pending_chat(conv, reader);
+
+        if (pcx_snapshot_read_bool(reader) && !reader->error) {
+                if (game_type->restore_cb == NULL) {
+                        pcx_snapshot_reader_set_error(reader);
+                } else {
+                        conv->game =
+                                game_type->restore_cb(config,
+                                                      &game_callbacks,
+                                                      conv,
+                                                      language,
+                                                      conv->n_players,
+                                                      (const char * const *)
+                                                      conv->player_names.data,
+                                                      reader);
+                        if (conv->game == NULL)
+                                pcx_snapshot_reader_set_error(reader);
+                }
+        }
+
+        if (reader->error) {
+                pcx_conversation_unref(conv);
+                return NULL;
+        }
+
+        return conv;
+}
+
 void
 pcx_conversation_ref(struct pcx_conversation *conv)
 {
@@ -607,10 +1899,15 @@ pcx_conversation_ref(struct pcx_conversation *conv)
 }
 
 static void
-free_message(struct pcx_conversation_message *message)
+free_messages(struct pcx_conversation *conv)
 {
-        pcx_free(message->data);
-        pcx_free(message);
+        for (size_t i = 0; i < conv->n_message_chunks; i++)
+                free_message_chunk(*get_chunk_slot(conv, i));
+
+        if (conv->spare_message_chunk)
+                free_message_chunk(conv->spare_message_chunk);
+
+        pcx_free(conv->message_chunks);
 }
 
 static void
@@ -631,12 +1928,18 @@ destroy_all_sideband_data(struct pcx_conversation *conv)
                         conv->sideband_data.data +
                         bit;
 
-                destroy_sideband_data(data);
+                destroy_sideband_data(conv, data);
 
                 bits &= ~(UINT64_C(1) << bit);
         }
 
         pcx_buffer_destroy(&conv->sideband_data);
+
+        struct pcx_slice_allocator *allocators =
+                conv->sideband_string_allocators;
+
+        for (unsigned i = 0; i < PCX_CONVERSATION_N_STRING_SIZES; i++)
+                pcx_slice_allocator_destroy(allocators + i);
 }
 
 void
@@ -645,23 +1948,36 @@ pcx_conversation_unref(struct pcx_conversation *conv)
         if (--conv->ref_count > 0)
                 return;
 
+        /* This can’t use emit_event because that would take a
+         * reference.
+         */
+        struct pcx_conversation_event event = {
+                .type = PCX_CONVERSATION_EVENT_DESTROYED,
+                .conversation = conv,
+        };
+
+        pcx_signal_emit(&conv->event_signal, &event);
+
         if (conv->game)
                 conv->game_type->free_game_cb(conv->game);
 
-        struct pcx_conversation_message *message, *tmp;
+        remove_sideband_timeout(conv);
 
-        pcx_list_for_each_safe(message, tmp, &conv->messages, link) {
-                free_message(message);
-        }
+        if (conv->pending_chat_source)
+                pcx_main_context_remove_source(conv->pending_chat_source);
 
-        char **player_names = (char **) conv->player_names.data;
+        free_messages(conv);
 
-        for (int i = 0; i < conv->n_players; i++)
-                pcx_free(player_names[i]);
+        pcx_buffer_destroy(&conv->n_released_private_messages);
 
         pcx_buffer_destroy(&conv->player_names);
+        pcx_buffer_destroy(&conv->chat_buckets);
+        pcx_buffer_destroy(&conv->pending_chat);
+        pcx_buffer_destroy(&conv->saved_state);
 
         destroy_all_sideband_data(conv);
 
+        pcx_slab_destroy(&conv->slab);
+
         pcx_free(conv);
 }
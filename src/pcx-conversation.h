@@ -26,6 +26,10 @@
 #include "pcx-list.h"
 #include "pcx-config.h"
 #include "pcx-class-store.h"
+#include "pcx-slab.h"
+#include "pcx-buffer.h"
+#include "pcx-slice.h"
+#include "pcx-main-context.h"
 
 enum pcx_conversation_event_type {
         PCX_CONVERSATION_EVENT_STARTED,
@@ -33,6 +37,11 @@ enum pcx_conversation_event_type {
         PCX_CONVERSATION_EVENT_PLAYER_REMOVED,
         PCX_CONVERSATION_EVENT_NEW_MESSAGE,
         PCX_CONVERSATION_EVENT_SIDEBAND_DATA_MODIFIED,
+        /* Emitted when the last reference is dropped just before the
+         * conversation is freed. Only listeners that don’t hold a
+         * reference will see this.
+         */
+        PCX_CONVERSATION_EVENT_DESTROYED,
 };
 
 struct pcx_conversation_event {
@@ -51,7 +60,8 @@ struct pcx_conversation_sideband_data_modified_event {
 };
 
 struct pcx_conversation_message {
-        struct pcx_list link;
+        /* Monotonic clock time when the message was queued */
+        uint64_t time;
 
         /* -1 if the message is a public message for all players */
         int target_player;
@@ -63,34 +73,75 @@ struct pcx_conversation_message {
          */
         int sending_player;
 
+        size_t length;
+
+        /* Length of the message if the buttons aren’t sent */
+        size_t no_buttons_length;
+
         /* The message is encoded as the frame payload minus the
          * WebSocket header and stored here so that it can be easily
          * copied into all of the clients.
          */
-        uint8_t *data;
-        size_t length;
+        uint8_t data[];
+};
 
-        /* Length of the message if the buttons aren’t sent */
-        size_t no_buttons_length;
+/* A position in the message log. Anything that is going to read
+ * messages from the log registers a cursor so that the conversation
+ * knows which messages it can release.
+ */
+struct pcx_conversation_cursor {
+        struct pcx_list link;
+        /* Sequence number of the next message to read */
+        uint64_t next_message;
 };
 
+struct pcx_conversation_message_chunk;
+
 struct pcx_conversation_sideband_string {
         /* Length of the buffer below. This can be longer than the
          * length of the string if the value was overwritten with a
-         * shorter string.
+         * shorter string or if the allocation was rounded up.
          */
         unsigned size;
         /* Over allocated */
         char text[1];
 };
 
+struct pcx_conversation_sideband_array_element {
+        /* Value of sideband_version in the conversation when this
+         * element was last changed
+         */
+        uint64_t version;
+        /* NULL for an empty string */
+        struct pcx_conversation_sideband_string *string;
+};
+
+struct pcx_conversation_sideband_array {
+        int length;
+        /* Array of pcx_conversation_sideband_array_element. This can
+         * be longer than the length.
+         */
+        struct pcx_buffer elements;
+};
+
+/* Sideband strings up to 256 bytes are allocated from one of these
+ * size classes so that they can be reused when the value changes.
+ */
+#define PCX_CONVERSATION_N_STRING_SIZES 5
+
 struct pcx_conversation_sideband_data {
         enum pcx_game_sideband_type type;
 
+        /* Monotonic clock time when the last modified event was
+         * emitted for this data.
+         */
+        uint64_t last_event_time;
+
         union {
                 uint8_t byte;
                 uint32_t uint32;
                 struct pcx_conversation_sideband_string *string;
+                struct pcx_conversation_sideband_array *array;
         };
 };
 
@@ -106,20 +157,75 @@ struct pcx_conversation {
         struct pcx_class_store *class_store;
 
         bool started;
+        /* Monotonic clock when the game started for the stats. This
+         * is zero once the end of the game has been counted or if the
+         * game was restored, in which case the start time isn’t
+         * known.
+         */
+        uint64_t start_time;
+        /* Number of players that have left. Once everyone has left
+         * the game counts as abandoned.
+         */
+        int n_players_left;
 
         bool is_private;
         uint64_t private_game_id;
 
+        /* Randomly generated ID that clients can use to watch the
+         * game without joining it.
+         */
+        uint64_t spectate_id;
+
         const struct pcx_game *game_type;
 
         struct pcx_signal event_signal;
 
         void *game;
 
+        /* Allocations that last as long as the conversation, such as
+         * the player names.
+         */
+        struct pcx_slab_allocator slab;
+
+        struct pcx_slice_allocator
+        sideband_string_allocators[PCX_CONVERSATION_N_STRING_SIZES];
+
         int n_players;
         struct pcx_buffer player_names;
 
-        struct pcx_list messages;
+        /* The message log is stored as a ring buffer of pointers to
+         * fixed-size chunks. Whole chunks are released once every
+         * cursor has moved past them and their messages are older
+         * than the retention time. The size of the ring is always a
+         * power of two.
+         */
+        struct pcx_conversation_message_chunk **message_chunks;
+        size_t message_chunks_size;
+        size_t first_message_chunk;
+        size_t n_message_chunks;
+        /* Kept after releasing a chunk so that a steady stream of
+         * messages doesn’t keep reallocating them.
+         */
+        struct pcx_conversation_message_chunk *spare_message_chunk;
+        /* Total size of the stored messages */
+        size_t messages_size;
+        /* Sequence number of the oldest message that is still stored */
+        uint64_t first_message;
+        /* Sequence number that the next message will get */
+        uint64_t next_message;
+        /* In µs */
+        uint64_t message_retention;
+
+        /* List of pcx_conversation_cursor */
+        struct pcx_list message_cursors;
+
+        /* Number of released public messages, and an array of ints
+         * counting the released private messages for each player.
+         * These are used to work out where a reconnecting client
+         * was.
+         */
+        int n_released_public_messages;
+        struct pcx_buffer n_released_private_messages;
 
         /* Array of pcx_conversation_sideband_data */
         struct pcx_buffer sideband_data;
@@ -129,6 +235,57 @@ struct pcx_conversation {
          * connection.
          */
         uint64_t available_sideband_data;
+
+        /* Incremented every time an element of a sideband array
+         * changes. Connections use this to work out which elements
+         * they still need to send.
+         */
+        uint64_t sideband_version;
+
+        /* Minimum time in µs between modified events for each piece
+         * of sideband data. Changes that happen quicker than this are
+         * coalesced so that the clients only get the latest value.
+         */
+        uint64_t sideband_interval;
+        /* Bitmask of sideband data that has changed but whose
+         * modified event is being held back until the interval has
+         * passed.
+         */
+        uint64_t pending_sideband_data;
+        struct pcx_main_context_source *sideband_timeout;
+
+        /* Array of pcx_conversation_chat_bucket, one for each
+         * player. chat_token_time is zero if chat isn’t limited.
+         */
+        struct pcx_buffer chat_buckets;
+        uint64_t chat_token_time;
+        uint64_t chat_capacity;
+
+        /* Chat messages from the same player that arrive in the same
+         * main loop iteration are merged into this and sent as a
+         * single message. pending_chat_player is -1 if there is
+         * nothing waiting.
+         */
+        struct pcx_buffer pending_chat;
+        int pending_chat_player;
+        struct pcx_main_context_source *pending_chat_source;
+
+        int n_dropped_chat_messages;
+        int n_merged_chat_messages;
+
+        /* Data from the last call to pcx_conversation_save_cached.
+         * It is thrown away whenever the conversation emits an
+         * event.
+         */
+        struct pcx_buffer saved_state;
+        bool saved_state_valid;
+        uint64_t saved_state_time;
+};
+
+/* Totals for all conversations since the program started */
+struct pcx_conversation_chat_stats {
+        uint64_t n_dropped;
+        uint64_t n_merged;
 };
 
 struct pcx_conversation *
@@ -148,11 +305,63 @@ pcx_conversation_remove_player(struct pcx_conversation *conv,
 void
 pcx_conversation_start(struct pcx_conversation *conv);
 
+/* Frees the game if it is still running so that it won’t send any
+ * more messages or react to the buttons. If the game hasn’t started
+ * yet then it never will. The players are left in the conversation.
+ */
+void
+pcx_conversation_end_game(struct pcx_conversation *conv);
+
 void
 pcx_conversation_push_button(struct pcx_conversation *conv,
                              int player_num,
                              const char *button_data);
 
+/* Returns true if the conversation can be saved with
+ * pcx_conversation_save. That is only possible once the game has
+ * started and if the game either supports snapshots or has already
+ * finished.
+ */
+bool
+pcx_conversation_can_save(struct pcx_conversation *conv);
+
+/* Appends the state of the conversation, including the message log,
+ * the sideband data and the game itself, to buf.
+ */
+void
+pcx_conversation_save(struct pcx_conversation *conv,
+                      struct pcx_buffer *buf);
+
+/* The same as pcx_conversation_save except that the data is kept and
+ * reused by the next call if the conversation hasn’t changed since
+ * and the data is at most max_age µs old. The ages of the timers and
+ * messages in the reused data are as of when it was made.
+ */
+void
+pcx_conversation_save_cached(struct pcx_conversation *conv,
+                             struct pcx_buffer *buf,
+                             uint64_t max_age);
+
+/* Recreates a conversation saved with pcx_conversation_save. The
+ * game type is looked up by name in the NULL-terminated game_list.
+ * Returns NULL if the data is invalid or the game is unknown.
+ */
+struct pcx_conversation *
+pcx_conversation_restore(const struct pcx_config *config,
+                         struct pcx_class_store *class_store,
+                         const struct pcx_game * const *game_list,
+                         struct pcx_snapshot_reader *reader);
+
+void
+pcx_conversation_get_chat_stats(struct pcx_conversation_chat_stats *stats);
+
+/* Returns roughly how many bytes the message log is using */
+size_t
+pcx_conversation_get_message_log_size(struct pcx_conversation *conv);
+
+/* Adds a chat message from the given player. It will be dropped if
+ * the player is sending too many messages.
+ */
 void
 pcx_conversation_add_chat_message(struct pcx_conversation *conv,
                                   int player_num,
@@ -172,6 +381,40 @@ struct pcx_conversation_sideband_data *
 pcx_conversation_get_sideband_data(struct pcx_conversation *conv,
                                    int data_num);
 
+/* Returns the message with the given sequence number. It must be
+ * between conv->first_message and conv->next_message.
+ */
+struct pcx_conversation_message *
+pcx_conversation_get_message(struct pcx_conversation *conv,
+                             uint64_t seq);
+
+/* Sets the cursor to the position after the first n_messages
+ * messages that the player can see. If some of those messages have
+ * already been released then the cursor is set to the oldest message
+ * and the return value is the number of messages that the player
+ * will miss. Otherwise it returns zero. The player_num can be -1 to
+ * only count the public messages.
+ */
+int
+pcx_conversation_seek_cursor(struct pcx_conversation *conv,
+                             struct pcx_conversation_cursor *cursor,
+                             int player_num,
+                             int n_messages);
+
+void
+pcx_conversation_add_cursor(struct pcx_conversation *conv,
+                            struct pcx_conversation_cursor *cursor);
+
+void
+pcx_conversation_remove_cursor(struct pcx_conversation_cursor *cursor);
+
+const char *
+pcx_conversation_get_sideband_array_element(const struct
+                                            pcx_conversation_sideband_array
+                                            *array,
+                                            int index,
+                                            uint64_t *version);
+
 void
 pcx_conversation_ref(struct pcx_conversation *conv);
 
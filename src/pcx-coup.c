@@ -26,6 +26,7 @@
 #include <assert.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
 
 #include "pcx-coup-character.h"
 #include "pcx-util.h"
@@ -1038,6 +1039,10 @@ struct challenge_data {
         action_cb cb;
         void *user_data;
         struct pcx_main_context_source *timeout_source;
+        /* Monotonic time when the timeout was added so that the
+         * remaining time can be saved in a snapshot.
+         */
+        uint64_t timeout_start;
         char *message;
         uint32_t accepted_players;
         enum challenge_flag flags;
@@ -1602,6 +1607,26 @@ check_challenge_timeout(struct pcx_main_context_source *source,
         do_idle(coup);
 }
 
+static void
+add_challenge_timeout(struct pcx_coup *coup,
+                      struct challenge_data *data,
+                      int elapsed_ms)
+{
+        data->timeout_start =
+                pcx_main_context_get_monotonic_clock(NULL) -
+                elapsed_ms * UINT64_C(1000);
+
+        int timeout = (elapsed_ms < PCX_COUP_WAIT_TIME ?
+                       PCX_COUP_WAIT_TIME - elapsed_ms :
+                       0);
+
+        data->timeout_source =
+                pcx_main_context_add_timeout(NULL,
+                                             timeout,
+                                             check_challenge_timeout,
+                                             coup);
+}
+
 static enum pcx_text_string
 get_no_target_block_message(struct pcx_coup *coup,
                             struct challenge_data *data)
@@ -1743,13 +1768,8 @@ check_challenge_idle(struct pcx_coup *coup)
                 pcx_buffer_destroy(&blocking_cards);
         }
 
-        if (data->timeout_source == NULL) {
-                data->timeout_source =
-                        pcx_main_context_add_timeout(NULL,
-                                                     PCX_COUP_WAIT_TIME,
-                                                     check_challenge_timeout,
-                                                     coup);
-        }
+        if (data->timeout_source == NULL)
+                add_challenge_timeout(coup, data, 0 /* elapsed_ms */);
 
         uint32_t button_players = get_button_players_for_challenge(coup, data);
 
@@ -2971,6 +2991,687 @@ free_game_cb(void *data)
         free_game(data);
 }
 
+/* The action callbacks that can be stored in the challenge and
+ * reveal data. The snapshot stores the index into this table.
+ */
+static const action_cb
+action_cbs[] = {
+        do_accepted_foreign_aid,
+        do_accepted_embezzle,
+        do_accepted_tax,
+        block_assassinate,
+        do_accepted_assassinate,
+        do_accepted_exchange,
+        do_accepted_inspect,
+        do_accepted_steal,
+        do_block,
+};
+
+static void
+snapshot_action_cb(struct pcx_buffer *buf,
+                   action_cb cb)
+{
+        for (int i = 0; i < PCX_N_ELEMENTS(action_cbs); i++) {
+                if (action_cbs[i] == cb) {
+                        pcx_snapshot_write_int(buf, i);
+                        return;
+                }
+        }
+
+        assert(cb == NULL);
+
+        pcx_snapshot_write_int(buf, -1);
+}
+
+static action_cb
+restore_action_cb(struct pcx_snapshot_reader *reader)
+{
+        int index = pcx_snapshot_read_int_range(reader,
+                                                -1,
+                                                PCX_N_ELEMENTS(action_cbs) - 1);
+
+        return index < 0 ? NULL : action_cbs[index];
+}
+
+/* All of the action user data is either NULL or a pointer to a
+ * player.
+ */
+static void
+snapshot_player_pointer(struct pcx_coup *coup,
+                        struct pcx_buffer *buf,
+                        const struct pcx_coup_player *player)
+{
+        pcx_snapshot_write_int(buf, player ? player - coup->players : -1);
+}
+
+static struct pcx_coup_player *
+restore_player_pointer(struct pcx_coup *coup,
+                       struct pcx_snapshot_reader *reader)
+{
+        int player_num = pcx_snapshot_read_int_range(reader,
+                                                     -1,
+                                                     coup->n_players - 1);
+
+        return player_num < 0 ? NULL : coup->players + player_num;
+}
+
+static enum pcx_coup_character
+restore_character(struct pcx_snapshot_reader *reader)
+{
+        uint8_t character = pcx_snapshot_read_uint8(reader);
+
+        if (character >= PCX_COUP_CHARACTER_COUNT) {
+                pcx_snapshot_reader_set_error(reader);
+                return PCX_COUP_CHARACTER_DUKE;
+        }
+
+        return character;
+}
+
+static uint32_t
+restore_clans(struct pcx_snapshot_reader *reader)
+{
+        uint32_t clans = pcx_snapshot_read_uint32(reader);
+
+        if ((clans & ~((UINT32_C(1) << PCX_COUP_CLAN_COUNT) - 1)))
+                pcx_snapshot_reader_set_error(reader);
+
+        return clans;
+}
+
+static void
+snapshot_lose_card(struct pcx_coup *coup,
+                   const struct pcx_coup_stack_entry *entry,
+                   struct pcx_buffer *buf)
+{
+        pcx_snapshot_write_int(buf, entry->data.i);
+}
+
+static void
+restore_lose_card(struct pcx_coup *coup,
+                  struct pcx_coup_stack_entry *entry,
+                  struct pcx_snapshot_reader *reader)
+{
+        entry->data.i = pcx_snapshot_read_int_range(reader,
+                                                    0,
+                                                    coup->n_players - 1);
+}
+
+static void
+snapshot_challenge(struct pcx_coup *coup,
+                   const struct pcx_coup_stack_entry *entry,
+                   struct pcx_buffer *buf)
+{
+        const struct challenge_data *data = entry->data.p;
+
+        snapshot_action_cb(buf, data->cb);
+        snapshot_player_pointer(coup, buf, data->user_data);
+        pcx_snapshot_write_string(buf, data->message);
+        pcx_snapshot_write_uint32(buf, data->accepted_players);
+        pcx_snapshot_write_uint8(buf, data->flags);
+        pcx_snapshot_write_int(buf, data->player_num);
+        pcx_snapshot_write_uint32(buf, data->challenged_clans);
+        pcx_snapshot_write_uint32(buf, data->blocking_clans);
+        pcx_snapshot_write_int(buf, data->target_player);
+        snapshot_action_cb(buf, data->block_cb);
+
+        pcx_snapshot_write_bool(buf, data->timeout_source != NULL);
+
+        if (data->timeout_source) {
+                uint64_t now = pcx_main_context_get_monotonic_clock(NULL);
+                uint64_t elapsed_ms = (now - data->timeout_start) / 1000;
+
+                pcx_snapshot_write_int(buf, MIN(elapsed_ms, INT_MAX));
+        }
+}
+
+static void
+restore_challenge(struct pcx_coup *coup,
+                  struct pcx_coup_stack_entry *entry,
+                  struct pcx_snapshot_reader *reader)
+{
+        /* The data is attached before reading anything so that the
+         * destroy function can free it if the snapshot is invalid.
+         */
+        struct challenge_data *data = pcx_calloc(sizeof *data);
+
+        entry->data.p = data;
+
+        data->cb = restore_action_cb(reader);
+        data->user_data = restore_player_pointer(coup, reader);
+        data->message = pcx_strdup(pcx_snapshot_read_string(reader));
+        data->accepted_players = pcx_snapshot_read_uint32(reader);
+
+        uint8_t flags = pcx_snapshot_read_uint8(reader);
+
+        if ((flags & ~(CHALLENGE_FLAG_CHALLENGE |
+                       CHALLENGE_FLAG_BLOCK |
+                       CHALLENGE_FLAG_INVERTED)))
+                pcx_snapshot_reader_set_error(reader);
+        else
+                data->flags = flags;
+
+        data->player_num = pcx_snapshot_read_int_range(reader,
+                                                       0,
+                                                       coup->n_players - 1);
+        data->challenged_clans = restore_clans(reader);
+        data->blocking_clans = restore_clans(reader);
+        data->target_player = pcx_snapshot_read_int_range(reader,
+                                                          -1,
+                                                          coup->n_players - 1);
+        data->block_cb = restore_action_cb(reader);
+
+        if (data->cb == NULL)
+                pcx_snapshot_reader_set_error(reader);
+
+        if (pcx_snapshot_read_bool(reader)) {
+                int elapsed_ms = pcx_snapshot_read_int_range(reader,
+                                                             0,
+                                                             INT_MAX);
+
+                if (!reader->error)
+                        add_challenge_timeout(coup, data, elapsed_ms);
+        }
+}
+
+static void
+snapshot_reveal(struct pcx_coup *coup,
+                const struct pcx_coup_stack_entry *entry,
+                struct pcx_buffer *buf)
+{
+        const struct reveal_data *data = entry->data.p;
+
+        snapshot_action_cb(buf, data->cb);
+        snapshot_player_pointer(coup, buf, data->user_data);
+        pcx_snapshot_write_int(buf, data->challenging_player);
+        pcx_snapshot_write_int(buf, data->challenged_player);
+        pcx_snapshot_write_uint32(buf, data->challenged_clans);
+        pcx_snapshot_write_bool(buf, data->inverted);
+}
+
+static void
+restore_reveal(struct pcx_coup *coup,
+               struct pcx_coup_stack_entry *entry,
+               struct pcx_snapshot_reader *reader)
+{
+        struct reveal_data *data = pcx_calloc(sizeof *data);
+
+        entry->data.p = data;
+
+        data->cb = restore_action_cb(reader);
+        data->user_data = restore_player_pointer(coup, reader);
+        data->challenging_player =
+                pcx_snapshot_read_int_range(reader, 0, coup->n_players - 1);
+        data->challenged_player =
+                pcx_snapshot_read_int_range(reader, 0, coup->n_players - 1);
+        data->challenged_clans = restore_clans(reader);
+        data->inverted = pcx_snapshot_read_bool(reader);
+
+        if (data->cb == NULL)
+                pcx_snapshot_reader_set_error(reader);
+}
+
+static void
+snapshot_exchange(struct pcx_coup *coup,
+                  const struct pcx_coup_stack_entry *entry,
+                  struct pcx_buffer *buf)
+{
+        const struct exchange_data *data = entry->data.p;
+
+        pcx_snapshot_write_int(buf, data->n_cards_chosen);
+        pcx_snapshot_write_int(buf, data->n_cards_available);
+
+        for (int i = 0; i < data->n_cards_available; i++)
+                pcx_snapshot_write_uint8(buf, data->available_cards[i]);
+}
+
+static void
+restore_exchange(struct pcx_coup *coup,
+                 struct pcx_coup_stack_entry *entry,
+                 struct pcx_snapshot_reader *reader)
+{
+        struct exchange_data *data = pcx_calloc(sizeof *data);
+
+        entry->data.p = data;
+
+        data->n_cards_chosen =
+                pcx_snapshot_read_int_range(reader,
+                                            0,
+                                            PCX_COUP_CARDS_PER_PLAYER - 1);
+        data->n_cards_available =
+                pcx_snapshot_read_int_range(reader,
+                                            1,
+                                            CARDS_TAKEN_IN_EXCHANGE +
+                                            PCX_COUP_CARDS_PER_PLAYER);
+
+        if (reader->error) {
+                data->n_cards_available = 0;
+                return;
+        }
+
+        for (int i = 0; i < data->n_cards_available; i++)
+                data->available_cards[i] = restore_character(reader);
+}
+
+static void
+snapshot_allow_keep_card(struct pcx_coup *coup,
+                         const struct pcx_coup_stack_entry *entry,
+                         struct pcx_buffer *buf)
+{
+        const struct allow_keep_card_data *data = entry->data.p;
+
+        snapshot_player_pointer(coup, buf, data->target);
+        pcx_snapshot_write_uint8(buf, data->card);
+}
+
+static void
+restore_allow_keep_card(struct pcx_coup *coup,
+                        struct pcx_coup_stack_entry *entry,
+                        struct pcx_snapshot_reader *reader)
+{
+        struct allow_keep_card_data *data = pcx_calloc(sizeof *data);
+
+        entry->data.p = data;
+
+        data->target = restore_player_pointer(coup, reader);
+        data->card = restore_character(reader);
+
+        if (data->target == NULL)
+                pcx_snapshot_reader_set_error(reader);
+}
+
+static void
+snapshot_choose_inspect_card(struct pcx_coup *coup,
+                             const struct pcx_coup_stack_entry *entry,
+                             struct pcx_buffer *buf)
+{
+        snapshot_player_pointer(coup, buf, entry->data.p);
+}
+
+static void
+restore_choose_inspect_card(struct pcx_coup *coup,
+                            struct pcx_coup_stack_entry *entry,
+                            struct pcx_snapshot_reader *reader)
+{
+        entry->data.p = restore_player_pointer(coup, reader);
+
+        if (entry->data.p == NULL)
+                pcx_snapshot_reader_set_error(reader);
+}
+
+struct stack_entry_type {
+        pcx_coup_callback_data_func func;
+        pcx_coup_idle_func idle_func;
+        pcx_coup_stack_destroy_func destroy_func;
+        void (* snapshot_func)(struct pcx_coup *coup,
+                               const struct pcx_coup_stack_entry *entry,
+                               struct pcx_buffer *buf);
+        /* Sets the data of the entry. It should leave the data in a
+         * state that the destroy function can handle even if the
+         * reader has an error.
+         */
+        void (* restore_func)(struct pcx_coup *coup,
+                              struct pcx_coup_stack_entry *entry,
+                              struct pcx_snapshot_reader *reader);
+};
+
+enum stack_entry_type_num {
+        STACK_ENTRY_TYPE_CHOOSE_GAME_TYPE,
+        STACK_ENTRY_TYPE_CHOOSE_ACTION,
+        STACK_ENTRY_TYPE_LOSE_CARD,
+        STACK_ENTRY_TYPE_CHALLENGE,
+        STACK_ENTRY_TYPE_REVEAL,
+        STACK_ENTRY_TYPE_EXCHANGE,
+        STACK_ENTRY_TYPE_ALLOW_KEEP_CARD,
+        STACK_ENTRY_TYPE_CHOOSE_INSPECT_CARD,
+};
+
+static const struct stack_entry_type
+stack_entry_types[] = {
+        [STACK_ENTRY_TYPE_CHOOSE_GAME_TYPE] = {
+                .func = choose_game_type_data,
+        },
+        [STACK_ENTRY_TYPE_CHOOSE_ACTION] = {
+                .func = choose_action,
+                .idle_func = choose_action_idle,
+        },
+        [STACK_ENTRY_TYPE_LOSE_CARD] = {
+                .func = choose_card_to_lose,
+                .idle_func = choose_card_to_lose_idle,
+                .snapshot_func = snapshot_lose_card,
+                .restore_func = restore_lose_card,
+        },
+        [STACK_ENTRY_TYPE_CHALLENGE] = {
+                .func = check_challenge_callback_data,
+                .idle_func = check_challenge_idle,
+                .destroy_func = check_challenge_destroy,
+                .snapshot_func = snapshot_challenge,
+                .restore_func = restore_challenge,
+        },
+        [STACK_ENTRY_TYPE_REVEAL] = {
+                .func = reveal_callback_data,
+                .idle_func = reveal_idle,
+                .destroy_func = reveal_destroy,
+                .snapshot_func = snapshot_reveal,
+                .restore_func = restore_reveal,
+        },
+        [STACK_ENTRY_TYPE_EXCHANGE] = {
+                .func = exchange_callback_data,
+                .idle_func = exchange_idle,
+                .destroy_func = exchange_destroy,
+                .snapshot_func = snapshot_exchange,
+                .restore_func = restore_exchange,
+        },
+        [STACK_ENTRY_TYPE_ALLOW_KEEP_CARD] = {
+                .func = allow_keep_card_callback_data,
+                .destroy_func = allow_keep_card_destroy,
+                .snapshot_func = snapshot_allow_keep_card,
+                .restore_func = restore_allow_keep_card,
+        },
+        [STACK_ENTRY_TYPE_CHOOSE_INSPECT_CARD] = {
+                .func = choose_inspect_card_callback_data,
+                .idle_func = choose_inspect_card_idle,
+                .snapshot_func = snapshot_choose_inspect_card,
+                .restore_func = restore_choose_inspect_card,
+        },
+};
+
+static int
+get_stack_entry_type(const struct pcx_coup_stack_entry *entry)
+{
+        for (int i = 0; i < PCX_N_ELEMENTS(stack_entry_types); i++) {
+                if (stack_entry_types[i].func == entry->func)
+                        return i;
+        }
+
+        pcx_fatal("unknown stack entry in coup snapshot");
+}
+
+static void
+snapshot_cb(void *data,
+            struct pcx_buffer *buf)
+{
+        struct pcx_coup *coup = data;
+
+        for (int i = 0; i < PCX_COUP_CLAN_COUNT; i++)
+                pcx_snapshot_write_uint8(buf, coup->clan_characters[i]);
+
+        pcx_snapshot_write_bool(buf, coup->reformation_extension);
+        pcx_snapshot_write_int(buf, coup->treasury);
+
+        pcx_snapshot_write_int(buf, coup->n_cards);
+
+        for (int i = 0; i < coup->n_cards; i++)
+                pcx_snapshot_write_uint8(buf, coup->deck[i]);
+
+        pcx_snapshot_write_int(buf, coup->current_player);
+
+        for (int i = 0; i < coup->n_players; i++) {
+                const struct pcx_coup_player *player = coup->players + i;
+
+                pcx_snapshot_write_int(buf, player->coins);
+                pcx_snapshot_write_uint8(buf, player->allegiance);
+
+                for (int j = 0; j < PCX_COUP_CARDS_PER_PLAYER; j++) {
+                        const struct pcx_coup_card *card = player->cards + j;
+
+                        pcx_snapshot_write_uint8(buf, card->character);
+                        pcx_snapshot_write_bool(buf, card->dead);
+                }
+        }
+
+        pcx_snapshot_write_int(buf, coup->stack_pos);
+
+        for (int i = 0; i < coup->stack_pos; i++) {
+                const struct pcx_coup_stack_entry *entry = coup->stack + i;
+                int type_num = get_stack_entry_type(entry);
+                const struct stack_entry_type *type =
+                        stack_entry_types + type_num;
+
+                pcx_snapshot_write_uint8(buf, type_num);
+
+                if (type->snapshot_func)
+                        type->snapshot_func(coup, entry, buf);
+        }
+
+        pcx_snapshot_write_bool(buf, coup->game_over_source != NULL);
+}
+
+static void
+restore_stack_entry(struct pcx_coup *coup,
+                    struct pcx_snapshot_reader *reader)
+{
+        uint8_t type_num = pcx_snapshot_read_uint8(reader);
+
+        if (reader->error || type_num >= PCX_N_ELEMENTS(stack_entry_types)) {
+                pcx_snapshot_reader_set_error(reader);
+                return;
+        }
+
+        const struct stack_entry_type *type = stack_entry_types + type_num;
+
+        struct pcx_coup_stack_entry *entry =
+                stack_push(coup, type->func, type->idle_func);
+
+        entry->destroy_func = type->destroy_func;
+
+        if (type->restore_func)
+                type->restore_func(coup, entry, reader);
+}
+
+static bool
+is_restored_stack_valid(struct pcx_coup *coup)
+{
+        /* The bottom of the stack is either choosing the game type
+         * or choosing an action and those can’t appear anywhere else.
+         */
+        int bottom_type = get_stack_entry_type(coup->stack);
+
+        if (bottom_type == STACK_ENTRY_TYPE_CHOOSE_GAME_TYPE) {
+                if (coup->stack_pos != 1)
+                        return false;
+        } else if (bottom_type != STACK_ENTRY_TYPE_CHOOSE_ACTION) {
+                return false;
+        }
+
+        int n_exchanges = 0;
+
+        for (int i = 1; i < coup->stack_pos; i++) {
+                const struct pcx_coup_stack_entry *entry = coup->stack + i;
+                const struct pcx_coup_stack_entry *below = entry - 1;
+                const struct challenge_data *challenge;
+
+                switch ((enum stack_entry_type_num)
+                        get_stack_entry_type(entry)) {
+                case STACK_ENTRY_TYPE_CHOOSE_GAME_TYPE:
+                case STACK_ENTRY_TYPE_CHOOSE_ACTION:
+                        return false;
+                case STACK_ENTRY_TYPE_REVEAL:
+                        /* Revealing a card modifies the challenge below */
+                        if (below->func != check_challenge_callback_data)
+                                return false;
+                        break;
+                case STACK_ENTRY_TYPE_CHALLENGE:
+                        challenge = entry->data.p;
+                        /* Blocking acts on the challenge below */
+                        if (challenge->cb == do_block &&
+                            below->func != check_challenge_callback_data)
+                                return false;
+                        /* The timeout always acts on the top of the stack */
+                        if (challenge->timeout_source &&
+                            i != coup->stack_pos - 1)
+                                return false;
+                        break;
+                case STACK_ENTRY_TYPE_EXCHANGE:
+                        n_exchanges++;
+                        break;
+                case STACK_ENTRY_TYPE_LOSE_CARD:
+                case STACK_ENTRY_TYPE_ALLOW_KEEP_CARD:
+                case STACK_ENTRY_TYPE_CHOOSE_INSPECT_CARD:
+                        break;
+                }
+        }
+
+        return n_exchanges <= 1;
+}
+
+static const struct exchange_data *
+find_exchange_data(struct pcx_coup *coup)
+{
+        for (int i = 0; i < coup->stack_pos; i++) {
+                if (coup->stack[i].func == exchange_callback_data)
+                        return coup->stack[i].data.p;
+        }
+
+        return NULL;
+}
+
+static bool
+are_restored_cards_valid(struct pcx_coup *coup)
+{
+        for (int i = 0; i < PCX_COUP_CLAN_COUNT; i++) {
+                if (pcx_coup_characters[coup->clan_characters[i]].clan != i)
+                        return false;
+        }
+
+        /* The deck isn’t created until the game type is chosen */
+        if (coup->stack[0].func == choose_game_type_data)
+                return coup->n_cards == 0;
+
+        int counts[PCX_COUP_CHARACTER_COUNT] = { 0 };
+
+        for (int i = 0; i < coup->n_cards; i++)
+                counts[coup->deck[i]]++;
+
+        const struct exchange_data *exchange = find_exchange_data(coup);
+
+        for (int i = 0; i < coup->n_players; i++) {
+                int n_cards = PCX_COUP_CARDS_PER_PLAYER;
+
+                /* During an exchange, the current player’s remaining
+                 * slots are only filled in as they choose.
+                 */
+                if (exchange && i == coup->current_player)
+                        n_cards = exchange->n_cards_chosen;
+
+                for (int j = 0; j < n_cards; j++)
+                        counts[coup->players[i].cards[j].character]++;
+        }
+
+        if (exchange) {
+                for (int i = 0; i < exchange->n_cards_available; i++)
+                        counts[exchange->available_cards[i]]++;
+        }
+
+        int cards_per_clan = coup->n_players > 6 ? 4 : 3;
+
+        for (int i = 0; i < PCX_COUP_CLAN_COUNT; i++) {
+                if (counts[coup->clan_characters[i]] != cards_per_clan)
+                        return false;
+
+                counts[coup->clan_characters[i]] = 0;
+        }
+
+        /* There shouldn’t be any cards for characters not in the game */
+        for (int i = 0; i < PCX_COUP_CHARACTER_COUNT; i++) {
+                if (counts[i])
+                        return false;
+        }
+
+        return true;
+}
+
+static void *
+restore_cb(const struct pcx_config *config,
+           const struct pcx_game_callbacks *callbacks,
+           void *user_data,
+           enum pcx_text_language language,
+           int n_players,
+           const char * const *names,
+           struct pcx_snapshot_reader *reader)
+{
+        if (n_players < PCX_COUP_MIN_PLAYERS ||
+            n_players > PCX_COUP_MAX_PLAYERS)
+                return NULL;
+
+        struct pcx_coup *coup = pcx_calloc(sizeof *coup);
+
+        coup->language = language;
+        coup->callbacks = *callbacks;
+        coup->user_data = user_data;
+        coup->rand_func = rand;
+        coup->n_players = n_players;
+
+        for (unsigned i = 0; i < n_players; i++)
+                coup->players[i].name = pcx_strdup(names[i]);
+
+        for (int i = 0; i < PCX_COUP_CLAN_COUNT; i++)
+                coup->clan_characters[i] = restore_character(reader);
+
+        coup->reformation_extension = pcx_snapshot_read_bool(reader);
+        coup->treasury = pcx_snapshot_read_int_range(reader, 0, INT_MAX);
+
+        coup->n_cards = pcx_snapshot_read_int_range(reader,
+                                                    0,
+                                                    PCX_COUP_MAX_DECK_SIZE);
+
+        if (reader->error)
+                coup->n_cards = 0;
+
+        for (int i = 0; i < coup->n_cards; i++)
+                coup->deck[i] = restore_character(reader);
+
+        coup->current_player =
+                pcx_snapshot_read_int_range(reader, 0, n_players - 1);
+
+        for (int i = 0; i < n_players; i++) {
+                struct pcx_coup_player *player = coup->players + i;
+
+                player->coins = pcx_snapshot_read_int_range(reader,
+                                                            0,
+                                                            INT_MAX);
+                uint8_t allegiance = pcx_snapshot_read_uint8(reader);
+
+                if (allegiance > PCX_COUP_ALLEGIANCE_REFORMIST)
+                        pcx_snapshot_reader_set_error(reader);
+                else
+                        player->allegiance = allegiance;
+
+                for (int j = 0; j < PCX_COUP_CARDS_PER_PLAYER; j++) {
+                        struct pcx_coup_card *card = player->cards + j;
+
+                        card->character = restore_character(reader);
+                        card->dead = pcx_snapshot_read_bool(reader);
+                }
+        }
+
+        int stack_size = pcx_snapshot_read_int_range(reader,
+                                                     1,
+                                                     PCX_COUP_STACK_SIZE);
+
+        for (int i = 0; i < stack_size && !reader->error; i++)
+                restore_stack_entry(coup, reader);
+
+        bool game_over = pcx_snapshot_read_bool(reader);
+
+        if (reader->error ||
+            !is_restored_stack_valid(coup) ||
+            !are_restored_cards_valid(coup)) {
+                free_game(coup);
+                return NULL;
+        }
+
+        if (game_over) {
+                coup->game_over_source =
+                        pcx_main_context_add_timeout(NULL,
+                                                     0, /* ms */
+                                                     game_over_cb,
+                                                     coup);
+        }
+
+        return coup;
+}
+
 const struct pcx_game
 pcx_coup_game = {
         .name = "coup",
@@ -2984,5 +3685,7 @@ pcx_coup_game = {
         .create_game_cb = create_game_cb,
         .get_help_cb = get_help_cb,
         .handle_callback_data_cb = handle_callback_data_cb,
-        .free_game_cb = free_game_cb
+        .free_game_cb = free_game_cb,
+        .snapshot_cb = snapshot_cb,
+        .restore_cb = restore_cb,
 };
@@ -1097,6 +1097,147 @@ free_game_cb(void *data)
         pcx_free(fox);
 }
 
+static void
+snapshot_cb(void *data,
+            struct pcx_buffer *buf)
+{
+        struct pcx_fox *fox = data;
+
+        pcx_snapshot_write_int(buf, fox->n_cards_in_hand);
+        pcx_snapshot_write_data(buf, fox->deck, fox->n_cards_in_deck);
+        pcx_snapshot_write_int(buf, fox->dealer);
+        pcx_snapshot_write_int(buf, fox->leader);
+        pcx_snapshot_write_data(buf, fox->played_cards, fox->n_cards_played);
+        pcx_snapshot_write_bool(buf, fox->resolving_card);
+        pcx_snapshot_write_uint8(buf, fox->trump_card);
+
+        for (int i = 0; i < PCX_FOX_N_PLAYERS; i++) {
+                const struct pcx_fox_player *player = fox->players + i;
+
+                pcx_snapshot_write_int(buf, player->score);
+                pcx_snapshot_write_int(buf, player->tricks_this_round);
+
+                for (int suit = 0; suit < PCX_FOX_N_SUITS; suit++)
+                        pcx_snapshot_write_uint16(buf, player->hand[suit]);
+        }
+
+        pcx_snapshot_write_bool(buf, fox->game_over_source != NULL);
+}
+
+static bool
+is_valid_card(pcx_fox_card_t card)
+{
+        return (PCX_FOX_CARD_SUIT(card) < PCX_FOX_N_SUITS &&
+                PCX_FOX_CARD_VALUE(card) >= 1 &&
+                PCX_FOX_CARD_VALUE(card) <= PCX_FOX_N_CARDS_IN_SUIT);
+}
+
+static int
+restore_cards(struct pcx_snapshot_reader *reader,
+              pcx_fox_card_t *cards,
+              int max_cards)
+{
+        size_t n_cards;
+        const uint8_t *data = pcx_snapshot_read_data(reader, &n_cards);
+
+        if (data == NULL || n_cards > max_cards) {
+                pcx_snapshot_reader_set_error(reader);
+                return 0;
+        }
+
+        for (unsigned i = 0; i < n_cards; i++) {
+                if (!is_valid_card(data[i])) {
+                        pcx_snapshot_reader_set_error(reader);
+                        return 0;
+                }
+
+                cards[i] = data[i];
+        }
+
+        return n_cards;
+}
+
+static void *
+restore_cb(const struct pcx_config *config,
+           const struct pcx_game_callbacks *callbacks,
+           void *user_data,
+           enum pcx_text_language language,
+           int n_players,
+           const char * const *names,
+           struct pcx_snapshot_reader *reader)
+{
+        if (n_players != PCX_FOX_N_PLAYERS)
+                return NULL;
+
+        struct pcx_fox *fox = pcx_calloc(sizeof *fox);
+
+        fox->language = language;
+        fox->callbacks = *callbacks;
+        fox->user_data = user_data;
+        fox->rand_func = rand;
+
+        fox->n_cards_in_hand =
+                pcx_snapshot_read_int_range(reader, 0, PCX_FOX_HAND_SIZE);
+        fox->n_cards_in_deck = restore_cards(reader,
+                                             fox->deck,
+                                             PCX_FOX_N_CARDS);
+        fox->dealer = pcx_snapshot_read_int_range(reader,
+                                                  0,
+                                                  PCX_FOX_N_PLAYERS - 1);
+        fox->leader = pcx_snapshot_read_int_range(reader,
+                                                  0,
+                                                  PCX_FOX_N_PLAYERS - 1);
+        fox->n_cards_played = restore_cards(reader,
+                                            fox->played_cards,
+                                            PCX_FOX_N_PLAYERS);
+        fox->resolving_card = pcx_snapshot_read_bool(reader);
+        fox->trump_card = pcx_snapshot_read_uint8(reader);
+
+        if (!is_valid_card(fox->trump_card))
+                pcx_snapshot_reader_set_error(reader);
+
+        /* Bit 0 isn’t used and there is a bit for each value */
+        uint16_t valid_hand_bits =
+                ((1 << (PCX_FOX_N_CARDS_IN_SUIT + 1)) - 1) & ~1;
+
+        for (int i = 0; i < PCX_FOX_N_PLAYERS; i++) {
+                struct pcx_fox_player *player = fox->players + i;
+
+                player->name = pcx_strdup(names[i]);
+                player->score = pcx_snapshot_read_int_range(reader,
+                                                            0,
+                                                            INT_MAX);
+                player->tricks_this_round =
+                        pcx_snapshot_read_int_range(reader,
+                                                    0,
+                                                    PCX_FOX_HAND_SIZE);
+
+                for (int suit = 0; suit < PCX_FOX_N_SUITS; suit++) {
+                        player->hand[suit] = pcx_snapshot_read_uint16(reader);
+
+                        if ((player->hand[suit] & ~valid_hand_bits))
+                                pcx_snapshot_reader_set_error(reader);
+                }
+        }
+
+        bool game_over = pcx_snapshot_read_bool(reader);
+
+        if (reader->error) {
+                free_game_cb(fox);
+                return NULL;
+        }
+
+        if (game_over) {
+                fox->game_over_source =
+                        pcx_main_context_add_timeout(NULL,
+                                                     0, /* ms */
+                                                     game_over_cb,
+                                                     fox);
+        }
+
+        return fox;
+}
+
 const struct pcx_game
 pcx_fox_game = {
         .name = "fox",
@@ -1110,5 +1251,7 @@ pcx_fox_game = {
         .create_game_cb = create_game_cb,
         .get_help_cb = get_help_cb,
         .handle_callback_data_cb = handle_callback_data_cb,
-        .free_game_cb = free_game_cb
+        .free_game_cb = free_game_cb,
+        .snapshot_cb = snapshot_cb,
+        .restore_cb = restore_cb,
 };
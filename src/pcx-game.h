@@ -25,6 +25,7 @@
 #include "pcx-text.h"
 #include "pcx-config.h"
 #include "pcx-class-store.h"
+#include "pcx-snapshot.h"
 
 enum pcx_game_message_format {
         PCX_GAME_MESSAGE_FORMAT_PLAIN,
@@ -61,8 +62,30 @@ enum pcx_game_sideband_type {
         PCX_GAME_SIDEBAND_TYPE_BYTE,
         PCX_GAME_SIDEBAND_TYPE_STRING,
         PCX_GAME_SIDEBAND_TYPE_UINT32,
+        PCX_GAME_SIDEBAND_TYPE_ARRAY,
 };
 
+/* An array of strings stored in a single piece of sideband data.
+ * Setting it only replaces the given range of elements so games can
+ * update part of a list without resending all of it. The server
+ * sends all of the changed elements of an array in one message.
+ */
+struct pcx_game_sideband_array {
+        /* Index of the first element to replace */
+        int start;
+        int n_elements;
+        const char * const *elements;
+        /* The new length of the array. Any elements beyond it are
+         * removed. If it is -1 then the array is only extended if
+         * the new elements don’t fit.
+         */
+        int length;
+};
+
+/* Array elements longer than this are truncated */
+#define PCX_GAME_MAX_SIDEBAND_ARRAY_ELEMENT_LENGTH 255
+#define PCX_GAME_MAX_SIDEBAND_ARRAY_LENGTH UINT16_MAX
+
 struct pcx_game_sideband_data {
         enum pcx_game_sideband_type type;
 
@@ -70,6 +93,7 @@ struct pcx_game_sideband_data {
                 const char *string;
                 uint8_t byte;
                 uint32_t uint32;
+                struct pcx_game_sideband_array array;
         };
 };
 
@@ -136,6 +160,26 @@ struct pcx_game {
                                     int data_num,
                                     const char *text);
         void (* free_game_cb)(void *game);
+
+        /* Optional. Appends the state of a running game to buf so
+         * that it can be recreated with restore_cb after the server
+         * is restarted. Games that don’t set these just end when the
+         * server quits.
+         */
+        void (* snapshot_cb)(void *game,
+                             struct pcx_buffer *buf);
+        /* Recreates a game from the data written by snapshot_cb. The
+         * messages that the game had sent are restored separately so
+         * this shouldn’t send any. It should return NULL if the
+         * reader ends up with an error.
+         */
+        void *(* restore_cb)(const struct pcx_config *config,
+                             const struct pcx_game_callbacks *callbacks,
+                             void *user_data,
+                             enum pcx_text_language language,
+                             int n_players,
+                             const char * const *names,
+                             struct pcx_snapshot_reader *reader);
 };
 
 /* Null terminated list of games */
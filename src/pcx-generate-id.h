@@ -23,7 +23,25 @@
 
 #include "pcx-netaddress.h"
 
+/* When several servers share the same players, the top bits of each
+ * ID can be used to store the number of the server that created it
+ * so that a connection with the ID can be routed back to the right
+ * server.
+ */
+#define PCX_GENERATE_ID_SHARD_BITS 8
+#define PCX_GENERATE_ID_MAX_SHARD ((1 << PCX_GENERATE_ID_SHARD_BITS) - 1)
+
+/* Generates a random ID. If shard is not negative then it is stored
+ * in the top bits of the ID.
+ */
 uint64_t
-pcx_generate_id(const struct pcx_netaddress *remote_address);
+pcx_generate_id(int shard,
+                const struct pcx_netaddress *remote_address);
+
+static inline int
+pcx_generate_id_get_shard(uint64_t id)
+{
+        return id >> (64 - PCX_GENERATE_ID_SHARD_BITS);
+}
 
 #endif /* PCX_GENERATE_ID_H */
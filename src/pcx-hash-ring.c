@@ -0,0 +1,145 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "pcx-hash-ring.h"
+
+#include <string.h>
+#include <stdbool.h>
+
+#include "pcx-util.h"
+#include "pcx-buffer.h"
+
+struct pcx_hash_ring_point {
+        uint64_t hash;
+        int node;
+};
+
+struct pcx_hash_ring {
+        /* Array of struct pcx_hash_ring_point */
+        struct pcx_buffer points;
+        bool sorted;
+};
+
+struct pcx_hash_ring *
+pcx_hash_ring_new(void)
+{
+        struct pcx_hash_ring *ring = pcx_alloc(sizeof *ring);
+
+        pcx_buffer_init(&ring->points);
+        ring->sorted = true;
+
+        return ring;
+}
+
+uint64_t
+pcx_hash_ring_hash_data(const void *data,
+                        size_t length)
+{
+        const uint8_t *p = data;
+        /* FNV-1a */
+        uint64_t hash = UINT64_C(0xcbf29ce484222325);
+
+        for (size_t i = 0; i < length; i++) {
+                hash ^= p[i];
+                hash *= UINT64_C(0x100000001b3);
+        }
+
+        /* FNV doesn’t mix the last bytes very well */
+        return pcx_hash_uint64(hash);
+}
+
+void
+pcx_hash_ring_add_node(struct pcx_hash_ring *ring,
+                       int node,
+                       const char *name)
+{
+        uint64_t name_hash = pcx_hash_ring_hash_data(name, strlen(name));
+
+        for (int i = 0; i < PCX_HASH_RING_POINTS_PER_NODE; i++) {
+                struct pcx_hash_ring_point point = {
+                        .hash = pcx_hash_uint64(name_hash + i),
+                        .node = node,
+                };
+
+                pcx_buffer_append(&ring->points, &point, sizeof point);
+        }
+
+        ring->sorted = false;
+}
+
+static int
+compare_points(const void *pa,
+               const void *pb)
+{
+        const struct pcx_hash_ring_point *a = pa;
+        const struct pcx_hash_ring_point *b = pb;
+
+        if (a->hash < b->hash)
+                return -1;
+        if (a->hash > b->hash)
+                return 1;
+
+        /* Make collisions not depend on the order the nodes were
+         * added in.
+         */
+        return a->node - b->node;
+}
+
+int
+pcx_hash_ring_lookup(struct pcx_hash_ring *ring,
+                     uint64_t hash)
+{
+        struct pcx_hash_ring_point *points =
+                (struct pcx_hash_ring_point *) ring->points.data;
+        size_t n_points = ring->points.length / sizeof *points;
+
+        if (n_points == 0)
+                return -1;
+
+        if (!ring->sorted) {
+                qsort(points, n_points, sizeof *points, compare_points);
+                ring->sorted = true;
+        }
+
+        /* Find the first point that is at or after the hash */
+        size_t min = 0, max = n_points;
+
+        while (min < max) {
+                size_t mid = (min + max) / 2;
+
+                if (points[mid].hash < hash)
+                        min = mid + 1;
+                else
+                        max = mid;
+        }
+
+        /* Wrap around to the start of the ring */
+        if (min >= n_points)
+                min = 0;
+
+        return points[min].node;
+}
+
+void
+pcx_hash_ring_free(struct pcx_hash_ring *ring)
+{
+        pcx_buffer_destroy(&ring->points);
+        pcx_free(ring);
+}
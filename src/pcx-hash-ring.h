@@ -0,0 +1,62 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PCX_HASH_RING_H
+#define PCX_HASH_RING_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Consistent hashing. Each node is put at several points around a
+ * ring of 64-bit hashes and a key belongs to the first node after its
+ * hash. Adding a node only moves the keys that now belong to the new
+ * node.
+ */
+
+/* Number of points on the ring for each node */
+#define PCX_HASH_RING_POINTS_PER_NODE 64
+
+struct pcx_hash_ring;
+
+struct pcx_hash_ring *
+pcx_hash_ring_new(void);
+
+/* Adds a node with the given number. The name decides where its
+ * points are on the ring so it should be something that stays the
+ * same when the nodes are reordered, such as the address.
+ */
+void
+pcx_hash_ring_add_node(struct pcx_hash_ring *ring,
+                       int node,
+                       const char *name);
+
+/* Returns the node for a key that has already been hashed or -1 if
+ * the ring is empty.
+ */
+int
+pcx_hash_ring_lookup(struct pcx_hash_ring *ring,
+                     uint64_t hash);
+
+uint64_t
+pcx_hash_ring_hash_data(const void *data,
+                        size_t length);
+
+void
+pcx_hash_ring_free(struct pcx_hash_ring *ring);
+
+#endif /* PCX_HASH_RING_H */
@@ -22,6 +22,8 @@
 
 #include <errno.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/un.h>
 
 #include "pcx-file-error.h"
 #include "pcx-socket.h"
@@ -110,3 +112,59 @@ pcx_listen_socket_create_for_port(int port,
 
         return pcx_listen_socket_create_for_netaddress(&netaddress, error);
 }
+
+int
+pcx_listen_socket_create_for_path(const char *path,
+                                  struct pcx_error **error)
+{
+        struct sockaddr_un addr = { .sun_family = AF_UNIX };
+        size_t path_length = strlen(path);
+
+        if (path_length >= sizeof addr.sun_path) {
+                pcx_file_error_set(error,
+                                   ENAMETOOLONG,
+                                   "Socket path is too long: %s",
+                                   path);
+                return -1;
+        }
+
+        memcpy(addr.sun_path, path, path_length + 1);
+
+        int sock = socket(PF_UNIX, SOCK_STREAM, 0);
+
+        if (sock == -1) {
+                pcx_file_error_set(error,
+                                   errno,
+                                   "Failed to create socket: %s",
+                                   strerror(errno));
+                return -1;
+        }
+
+        if (!pcx_socket_set_nonblock(sock, error))
+                goto error;
+
+        unlink(path);
+
+        if (bind(sock, (struct sockaddr *) &addr, sizeof addr) == -1) {
+                pcx_file_error_set(error,
+                                   errno,
+                                   "Failed to bind socket %s: %s",
+                                   path,
+                                   strerror(errno));
+                goto error;
+        }
+
+        if (listen(sock, 10) == -1) {
+                pcx_file_error_set(error,
+                                   errno,
+                                   "Failed to make socket listen: %s",
+                                   strerror(errno));
+                goto error;
+        }
+
+        return sock;
+
+error:
+        pcx_close(sock);
+        return -1;
+}
@@ -32,4 +32,12 @@ int
 pcx_listen_socket_create_for_port(int port,
                                   struct pcx_error **error);
 
+/* Creates a Unix domain socket. Any existing file at the path is
+ * removed first so that a socket left behind by a process that
+ * crashed doesn’t get in the way.
+ */
+int
+pcx_listen_socket_create_for_path(const char *path,
+                                  struct pcx_error **error);
+
 #endif /* PCX_LISTEN_SOCKET_H */
@@ -0,0 +1,379 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "pcx-lobby.h"
+
+#include <assert.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#include "pcx-util.h"
+#include "pcx-buffer.h"
+#include "pcx-list.h"
+#include "pcx-main-context.h"
+#include "pcx-proto.h"
+
+/* Enough space for any single lobby command including the frame
+ * header.
+ */
+#define MAX_COMMAND_SIZE 256
+
+struct pcx_lobby_game {
+        struct pcx_list link;
+
+        uint64_t id;
+        const struct pcx_game *game_type;
+        enum pcx_text_language language;
+        int n_players;
+        uint64_t creation_time;
+
+        /* True if the subscribers have been told about the game */
+        bool sent;
+        /* True if the game has changed since the last batch */
+        bool dirty;
+        /* True if the game only still exists to tell the subscribers
+         * that it has been removed.
+         */
+        bool removed;
+};
+
+struct pcx_lobby {
+        /* Games in the order they were added */
+        struct pcx_list games;
+
+        struct pcx_signal batch_signal;
+
+        uint64_t last_batch_time;
+        struct pcx_main_context_source *batch_timeout;
+
+        /* Cached snapshot. This is cleared whenever the list changes
+         * and is only reused within PCX_LOBBY_INTERVAL so that the
+         * ages stay roughly right.
+         */
+        struct pcx_lobby_batch *snapshot;
+        uint64_t snapshot_time;
+
+        struct pcx_buffer buffer;
+};
+
+struct pcx_lobby *
+pcx_lobby_new(void)
+{
+        struct pcx_lobby *lobby = pcx_calloc(sizeof *lobby);
+
+        pcx_list_init(&lobby->games);
+        pcx_signal_init(&lobby->batch_signal);
+        pcx_buffer_init(&lobby->buffer);
+
+        return lobby;
+}
+
+static void
+add_command(struct pcx_lobby *lobby,
+            uint8_t command,
+            ...)
+{
+        struct pcx_buffer *buffer = &lobby->buffer;
+        va_list ap;
+
+        pcx_buffer_ensure_size(buffer, buffer->length + MAX_COMMAND_SIZE);
+
+        va_start(ap, command);
+
+        int wrote = pcx_proto_write_command_v(buffer->data + buffer->length,
+                                              buffer->size - buffer->length,
+                                              command,
+                                              ap);
+
+        va_end(ap);
+
+        assert(wrote != -1);
+
+        buffer->length += wrote;
+}
+
+static void
+add_game_command(struct pcx_lobby *lobby,
+                 const struct pcx_lobby_game *game,
+                 uint64_t now)
+{
+        add_command(lobby,
+                    PCX_PROTO_LOBBY_GAME,
+
+                    PCX_PROTO_TYPE_UINT64,
+                    game->id,
+
+                    PCX_PROTO_TYPE_STRING,
+                    game->game_type->name,
+
+                    PCX_PROTO_TYPE_STRING,
+                    pcx_text_get(game->language,
+                                 PCX_TEXT_STRING_LANGUAGE_CODE),
+
+                    PCX_PROTO_TYPE_UINT8,
+                    (uint8_t) game->n_players,
+
+                    PCX_PROTO_TYPE_UINT32,
+                    (uint32_t) ((now - game->creation_time) / 1000000),
+
+                    PCX_PROTO_TYPE_NONE);
+}
+
+static struct pcx_lobby_batch *
+take_batch(struct pcx_lobby *lobby)
+{
+        struct pcx_lobby_batch *batch =
+                pcx_alloc(offsetof(struct pcx_lobby_batch, data) +
+                          lobby->buffer.length);
+
+        batch->ref_count = 1;
+        batch->length = lobby->buffer.length;
+        memcpy(batch->data, lobby->buffer.data, lobby->buffer.length);
+
+        lobby->buffer.length = 0;
+
+        return batch;
+}
+
+static bool
+has_subscribers(struct pcx_lobby *lobby)
+{
+        return !pcx_list_empty(&lobby->batch_signal.listener_list);
+}
+
+static void
+free_game(struct pcx_lobby_game *game)
+{
+        pcx_list_remove(&game->link);
+        pcx_free(game);
+}
+
+static void
+invalidate_snapshot(struct pcx_lobby *lobby)
+{
+        if (lobby->snapshot) {
+                pcx_lobby_batch_unref(lobby->snapshot);
+                lobby->snapshot = NULL;
+        }
+}
+
+static void
+batch_timeout_cb(struct pcx_main_context_source *source,
+                 void *user_data)
+{
+        struct pcx_lobby *lobby = user_data;
+        uint64_t now = pcx_main_context_get_monotonic_clock(NULL);
+        bool encode = has_subscribers(lobby);
+        struct pcx_lobby_game *game, *tmp;
+
+        lobby->batch_timeout = NULL;
+        lobby->last_batch_time = now;
+
+        /* The games that are marked as sent will change so the
+         * snapshot needs to be made again.
+         */
+        invalidate_snapshot(lobby);
+
+        pcx_list_for_each_safe(game, tmp, &lobby->games, link) {
+                if (game->removed) {
+                        if (encode && game->sent) {
+                                add_command(lobby,
+                                            PCX_PROTO_LOBBY_GAME_REMOVED,
+
+                                            PCX_PROTO_TYPE_UINT64,
+                                            game->id,
+
+                                            PCX_PROTO_TYPE_NONE);
+                        }
+
+                        free_game(game);
+                } else if (game->dirty) {
+                        if (encode)
+                                add_game_command(lobby, game, now);
+
+                        game->dirty = false;
+                        game->sent = true;
+                }
+        }
+
+        if (lobby->buffer.length == 0)
+                return;
+
+        struct pcx_lobby_batch *batch = take_batch(lobby);
+
+        pcx_signal_emit(&lobby->batch_signal, batch);
+
+        pcx_lobby_batch_unref(batch);
+}
+
+static void
+queue_batch(struct pcx_lobby *lobby)
+{
+        invalidate_snapshot(lobby);
+
+        if (lobby->batch_timeout)
+                return;
+
+        uint64_t now = pcx_main_context_get_monotonic_clock(NULL);
+        uint64_t next_time = lobby->last_batch_time + PCX_LOBBY_INTERVAL;
+        long ms = next_time > now ? (next_time - now + 999) / 1000 : 0;
+
+        lobby->batch_timeout = pcx_main_context_add_timeout(NULL,
+                                                            ms,
+                                                            batch_timeout_cb,
+                                                            lobby);
+}
+
+struct pcx_lobby_game *
+pcx_lobby_add_game(struct pcx_lobby *lobby,
+                   uint64_t id,
+                   const struct pcx_game *game_type,
+                   enum pcx_text_language language,
+                   int n_players)
+{
+        struct pcx_lobby_game *game = pcx_calloc(sizeof *game);
+
+        game->id = id;
+        game->game_type = game_type;
+        game->language = language;
+        game->n_players = n_players;
+        game->creation_time = pcx_main_context_get_monotonic_clock(NULL);
+        game->dirty = true;
+
+        pcx_list_insert(lobby->games.prev, &game->link);
+
+        queue_batch(lobby);
+
+        return game;
+}
+
+void
+pcx_lobby_set_n_players(struct pcx_lobby *lobby,
+                        struct pcx_lobby_game *game,
+                        int n_players)
+{
+        assert(!game->removed);
+
+        if (game->n_players == n_players)
+                return;
+
+        game->n_players = n_players;
+        game->dirty = true;
+
+        queue_batch(lobby);
+}
+
+void
+pcx_lobby_remove_game(struct pcx_lobby *lobby,
+                      struct pcx_lobby_game *game)
+{
+        assert(!game->removed);
+
+        /* If the subscribers never heard about the game then it can
+         * just disappear.
+         */
+        if (!game->sent) {
+                free_game(game);
+                invalidate_snapshot(lobby);
+                return;
+        }
+
+        game->removed = true;
+
+        queue_batch(lobby);
+}
+
+struct pcx_signal *
+pcx_lobby_get_batch_signal(struct pcx_lobby *lobby)
+{
+        return &lobby->batch_signal;
+}
+
+struct pcx_lobby_batch *
+pcx_lobby_get_snapshot(struct pcx_lobby *lobby)
+{
+        uint64_t now = pcx_main_context_get_monotonic_clock(NULL);
+
+        if (lobby->snapshot &&
+            lobby->snapshot_time + PCX_LOBBY_INTERVAL > now) {
+                pcx_lobby_batch_ref(lobby->snapshot);
+                return lobby->snapshot;
+        }
+
+        invalidate_snapshot(lobby);
+
+        /* The snapshot describes the current state rather than the
+         * state as of the last batch. This works because all of the
+         * commands just set or remove a game so applying the next
+         * batch on top of it doesn’t do any harm. Games that haven’t
+         * been in a batch yet are left out because if they are
+         * removed before the next batch then nobody will be told.
+         * They will be added by the next batch instead.
+         */
+        add_command(lobby, PCX_PROTO_LOBBY_RESET, PCX_PROTO_TYPE_NONE);
+
+        struct pcx_lobby_game *game;
+
+        pcx_list_for_each(game, &lobby->games, link) {
+                if (game->sent && !game->removed)
+                        add_game_command(lobby, game, now);
+        }
+
+        lobby->snapshot = take_batch(lobby);
+        lobby->snapshot_time = now;
+
+        pcx_lobby_batch_ref(lobby->snapshot);
+
+        return lobby->snapshot;
+}
+
+void
+pcx_lobby_batch_ref(struct pcx_lobby_batch *batch)
+{
+        batch->ref_count++;
+}
+
+void
+pcx_lobby_batch_unref(struct pcx_lobby_batch *batch)
+{
+        if (--batch->ref_count <= 0)
+                pcx_free(batch);
+}
+
+void
+pcx_lobby_free(struct pcx_lobby *lobby)
+{
+        assert(!has_subscribers(lobby));
+
+        struct pcx_lobby_game *game, *tmp;
+
+        pcx_list_for_each_safe(game, tmp, &lobby->games, link)
+                free_game(game);
+
+        if (lobby->batch_timeout)
+                pcx_main_context_remove_source(lobby->batch_timeout);
+
+        invalidate_snapshot(lobby);
+
+        pcx_buffer_destroy(&lobby->buffer);
+
+        pcx_free(lobby);
+}
@@ -0,0 +1,92 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PCX_LOBBY_H
+#define PCX_LOBBY_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "pcx-game.h"
+#include "pcx-text.h"
+#include "pcx-signal.h"
+
+/* The list of public games that are waiting for players. Changes to
+ * the list are collected and encoded as a batch of protocol commands
+ * at most once every PCX_LOBBY_INTERVAL. The same batch is then
+ * shared between all of the subscribers so that the cost of an update
+ * doesn’t depend on how many clients are watching.
+ */
+
+/* Minimum time in microseconds between two batches */
+#define PCX_LOBBY_INTERVAL ((uint64_t) 1000000)
+
+struct pcx_lobby;
+struct pcx_lobby_game;
+
+/* A run of complete WebSocket frames to send to each subscriber */
+struct pcx_lobby_batch {
+        int ref_count;
+        size_t length;
+        uint8_t data[];
+};
+
+struct pcx_lobby *
+pcx_lobby_new(void);
+
+struct pcx_lobby_game *
+pcx_lobby_add_game(struct pcx_lobby *lobby,
+                   uint64_t id,
+                   const struct pcx_game *game_type,
+                   enum pcx_text_language language,
+                   int n_players);
+
+void
+pcx_lobby_set_n_players(struct pcx_lobby *lobby,
+                        struct pcx_lobby_game *game,
+                        int n_players);
+
+void
+pcx_lobby_remove_game(struct pcx_lobby *lobby,
+                      struct pcx_lobby_game *game);
+
+/* Emitted with a pointer to a struct pcx_lobby_batch whenever a
+ * batch of changes is ready. Listeners that want to keep the batch
+ * need to take a reference on it. Nothing is encoded while there are
+ * no listeners.
+ */
+struct pcx_signal *
+pcx_lobby_get_batch_signal(struct pcx_lobby *lobby);
+
+/* Returns a new reference to a batch that clears the client’s list
+ * and then describes every game in the lobby. Applying the following
+ * batches from the signal on top of it brings the client up to date.
+ */
+struct pcx_lobby_batch *
+pcx_lobby_get_snapshot(struct pcx_lobby *lobby);
+
+void
+pcx_lobby_batch_ref(struct pcx_lobby_batch *batch);
+
+void
+pcx_lobby_batch_unref(struct pcx_lobby_batch *batch);
+
+void
+pcx_lobby_free(struct pcx_lobby *lobby);
+
+#endif /* PCX_LOBBY_H */
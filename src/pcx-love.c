@@ -26,6 +26,7 @@
 #include <assert.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
 
 #include "pcx-util.h"
 #include "pcx-main-context.h"
@@ -1413,6 +1414,156 @@ free_game_cb(void *data)
         pcx_free(love);
 }
 
+/* Cards are stored as their index in the characters array or -1 for
+ * NULL.
+ */
+static void
+save_card(struct pcx_buffer *buf,
+          const struct pcx_love_character *card)
+{
+        int index = -1;
+
+        if (card)
+                index = card->value - characters[0]->value;
+
+        pcx_snapshot_write_int(buf, index);
+}
+
+static const struct pcx_love_character *
+restore_card(struct pcx_snapshot_reader *reader)
+{
+        int index = pcx_snapshot_read_int_range(reader,
+                                                -1,
+                                                PCX_N_ELEMENTS(characters) -
+                                                1);
+
+        return index == -1 ? NULL : characters[index];
+}
+
+static void
+snapshot_cb(void *data,
+            struct pcx_buffer *buf)
+{
+        struct pcx_love *love = data;
+
+        pcx_snapshot_write_int(buf, love->current_player);
+
+        for (int i = 0; i < love->n_players; i++) {
+                const struct pcx_love_player *player = love->players + i;
+
+                save_card(buf, player->card);
+
+                pcx_snapshot_write_int(buf, player->n_discarded_cards);
+
+                for (unsigned j = 0; j < player->n_discarded_cards; j++)
+                        save_card(buf, player->discarded_cards[j]);
+
+                pcx_snapshot_write_int(buf, player->hearts);
+                pcx_snapshot_write_bool(buf, player->is_alive);
+                pcx_snapshot_write_bool(buf, player->is_protected);
+        }
+
+        pcx_snapshot_write_int(buf, love->n_cards);
+
+        for (unsigned i = 0; i < love->n_cards; i++)
+                save_card(buf, love->deck[i]);
+
+        save_card(buf, love->pending_card);
+        save_card(buf, love->set_aside_card);
+
+        for (unsigned i = 0; i < PCX_LOVE_N_VISIBLE_CARDS; i++)
+                save_card(buf, love->visible_cards[i]);
+
+        pcx_snapshot_write_bool(buf, love->game_over_source != NULL);
+}
+
+static void *
+restore_cb(const struct pcx_config *config,
+           const struct pcx_game_callbacks *callbacks,
+           void *user_data,
+           enum pcx_text_language language,
+           int n_players,
+           const char * const *names,
+           struct pcx_snapshot_reader *reader)
+{
+        if (n_players < 1 || n_players > PCX_LOVE_MAX_PLAYERS)
+                return NULL;
+
+        struct pcx_love *love = pcx_calloc(sizeof *love);
+
+        love->language = language;
+        love->callbacks = *callbacks;
+        love->user_data = user_data;
+        love->n_players = n_players;
+
+        love->current_player =
+                pcx_snapshot_read_int_range(reader, 0, n_players - 1);
+
+        for (int i = 0; i < n_players; i++) {
+                struct pcx_love_player *player = love->players + i;
+
+                player->name = pcx_strdup(names[i]);
+                player->card = restore_card(reader);
+                int max_discarded_cards =
+                        PCX_N_ELEMENTS(player->discarded_cards);
+
+                player->n_discarded_cards =
+                        pcx_snapshot_read_int_range(reader,
+                                                    0,
+                                                    max_discarded_cards);
+
+                for (unsigned j = 0; j < player->n_discarded_cards; j++) {
+                        player->discarded_cards[j] = restore_card(reader);
+
+                        if (player->discarded_cards[j] == NULL)
+                                pcx_snapshot_reader_set_error(reader);
+                }
+
+                player->hearts = pcx_snapshot_read_int_range(reader,
+                                                             0,
+                                                             INT_MAX);
+                player->is_alive = pcx_snapshot_read_bool(reader);
+                player->is_protected = pcx_snapshot_read_bool(reader);
+
+                if (player->is_alive && player->card == NULL)
+                        pcx_snapshot_reader_set_error(reader);
+        }
+
+        love->n_cards = pcx_snapshot_read_int_range(reader,
+                                                    0,
+                                                    PCX_LOVE_N_CARDS);
+
+        for (unsigned i = 0; i < love->n_cards; i++) {
+                love->deck[i] = restore_card(reader);
+
+                if (love->deck[i] == NULL)
+                        pcx_snapshot_reader_set_error(reader);
+        }
+
+        love->pending_card = restore_card(reader);
+        love->set_aside_card = restore_card(reader);
+
+        for (unsigned i = 0; i < PCX_LOVE_N_VISIBLE_CARDS; i++)
+                love->visible_cards[i] = restore_card(reader);
+
+        bool game_over = pcx_snapshot_read_bool(reader);
+
+        if (reader->error) {
+                free_game_cb(love);
+                return NULL;
+        }
+
+        if (game_over) {
+                love->game_over_source =
+                        pcx_main_context_add_timeout(NULL,
+                                                     0, /* ms */
+                                                     game_over_cb,
+                                                     love);
+        }
+
+        return love;
+}
+
 const struct pcx_game
 pcx_love_game = {
         .name = "loveletter",
@@ -1426,5 +1577,7 @@ pcx_love_game = {
         .create_game_cb = create_game_cb,
         .get_help_cb = get_help_cb,
         .handle_callback_data_cb = handle_callback_data_cb,
-        .free_game_cb = free_game_cb
+        .free_game_cb = free_game_cb,
+        .snapshot_cb = snapshot_cb,
+        .restore_cb = restore_cb,
 };
@@ -64,6 +64,8 @@ struct pcx_main_context {
         int64_t wall_time;
 
         struct pcx_slice_allocator source_allocator;
+
+        struct pcx_main_context_stats stats;
 };
 
 struct pcx_main_context_source {
@@ -199,6 +201,8 @@ pcx_main_context_new(void)
 
         mc->signal_read = 0;
 
+        memset(&mc->stats, 0, sizeof mc->stats);
+
         if (pipe(mc->async_pipe) == -1) {
                 pcx_warning("Failed to create pipe: %s",
                             strerror(errno));
@@ -410,7 +414,7 @@ get_source_for_fd(struct pcx_main_context *mc,
                         return source;
         }
 
-        pcx_fatal("Poll result found for unknown fd");
+        return NULL;
 }
 
 static void
@@ -426,6 +430,17 @@ handle_poll_result(struct pcx_main_context *mc,
 
         source = get_source_for_fd(mc, pollfd->fd);
 
+        if (source == NULL) {
+                /* A callback for an earlier fd can remove the source
+                 * for a later one, for example when the router closes
+                 * both sides of a connection at once.
+                 */
+                if (mc->poll_array_dirty)
+                        return;
+
+                pcx_fatal("Poll result found for unknown fd");
+        }
+
         callback = source->callback;
         flags = 0;
 
@@ -497,15 +512,20 @@ pcx_main_context_poll(struct pcx_main_context *mc)
 
         ensure_poll_array(mc);
 
+        int timeout = get_timeout(mc);
+        uint64_t wait_start = pcx_main_context_get_monotonic_clock(mc);
+
         n_events = poll((struct pollfd *) mc->poll_array.data,
                         mc->poll_array.length / sizeof (struct pollfd),
-                        get_timeout(mc));
+                        timeout);
 
         /* Once we've polled we can assume that some time has passed so our
            cached values of the clocks are no longer valid */
         mc->monotonic_time_valid = false;
         mc->wall_time_valid = false;
 
+        uint64_t dispatch_start = pcx_main_context_get_monotonic_clock(mc);
+
         if (n_events == -1) {
                 if (errno != EINTR)
                         pcx_warning("poll failed: %s", strerror(errno));
@@ -518,6 +538,24 @@ pcx_main_context_poll(struct pcx_main_context *mc)
 
                 check_timer_sources(mc);
         }
+
+        mc->monotonic_time_valid = false;
+        uint64_t dispatch_end = pcx_main_context_get_monotonic_clock(mc);
+
+        mc->stats.n_iterations++;
+        mc->stats.wait_time += dispatch_start - wait_start;
+        pcx_metrics_histogram_observe(&mc->stats.dispatch_time,
+                                      dispatch_end - dispatch_start);
+}
+
+void
+pcx_main_context_get_stats(struct pcx_main_context *mc,
+                           struct pcx_main_context_stats *stats)
+{
+        if (mc == NULL)
+                mc = pcx_main_context_get_default();
+
+        *stats = mc->stats;
 }
 
 uint64_t
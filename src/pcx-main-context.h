@@ -27,6 +27,7 @@
 #include <stdint.h>
 
 #include "pcx-util.h"
+#include "pcx-metrics.h"
 
 enum pcx_main_context_poll_flags {
         PCX_MAIN_CONTEXT_POLL_IN = 1 << 0,
@@ -37,6 +38,15 @@ enum pcx_main_context_poll_flags {
 struct pcx_main_context;
 struct pcx_main_context_source;
 
+struct pcx_main_context_stats {
+        /* Number of times poll has returned */
+        uint64_t n_iterations;
+        /* Total microseconds spent waiting in poll */
+        uint64_t wait_time;
+        /* Time spent running the callbacks after each poll */
+        struct pcx_metrics_histogram dispatch_time;
+};
+
 typedef void
 (* pcx_main_context_poll_callback) (struct pcx_main_context_source *source,
                                     int fd,
@@ -93,6 +103,10 @@ pcx_main_context_get_monotonic_clock(struct pcx_main_context *mc);
 int64_t
 pcx_main_context_get_wall_clock(struct pcx_main_context *mc);
 
+void
+pcx_main_context_get_stats(struct pcx_main_context *mc,
+                           struct pcx_main_context_stats *stats);
+
 void
 pcx_main_context_free(struct pcx_main_context *mc);
 
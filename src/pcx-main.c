@@ -27,9 +27,11 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <inttypes.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/file.h>
+#include <sys/wait.h>
 #include <fcntl.h>
 #include <grp.h>
 #include <pwd.h>
@@ -42,12 +44,32 @@
 #include "pcx-curl-multi.h"
 #include "pcx-log.h"
 #include "pcx-class-store.h"
+#include "pcx-buffer.h"
+#include "pcx-upgrade.h"
+#include "pcx-snapshot.h"
+#include "pcx-replication.h"
+#include "pcx-metrics.h"
+#include "pcx-admin.h"
+#include "pcx-stats-log.h"
+
+struct pcx_main_bot {
+        struct pcx_list link;
+        struct pcx_bot *bot;
+        /* This is owned by the running config */
+        struct pcx_config_bot *config;
+        /* Set when the bot has been removed from the config. It
+         * carries on without starting any new games until its
+         * running games have finished.
+         */
+        bool removed;
+};
 
 struct pcx_main {
         struct pcx_curl_multi *pcurl;
 
-        size_t n_bots;
-        struct pcx_bot **bots;
+        struct pcx_list bots;
+        /* Timeout to check whether the removed bots can be freed */
+        struct pcx_main_context_source *removed_bots_source;
 
         struct pcx_server *server;
 
@@ -56,16 +78,72 @@ struct pcx_main {
         struct pcx_class_store *class_store;
 
         const char *config_filename;
+        /* The file that the config was loaded from so that it can be
+         * loaded again.
+         */
+        char *config_path;
         const char *log_filename;
         const char *run_as_user;
         const char *run_as_group;
         bool daemonize;
+        bool standby;
         bool curl_inited;
         bool quit;
         int lock_fd;
+
+        /* Used to start the new process for a live upgrade */
+        char **argv;
+        char *start_dir;
+
+        /* Set once the new process has taken over so that the games
+         * aren’t saved to the file as well.
+         */
+        bool handed_over;
+
+        /* Socket to the old process if this process was started by a
+         * live upgrade, otherwise -1.
+         */
+        int upgrade_sock;
+        /* The state and the listen sockets from the old process */
+        struct pcx_buffer upgrade_data;
+        struct pcx_buffer upgrade_fds;
+        const uint8_t *upgrade_sockets;
+        size_t upgrade_sockets_length;
+        const uint8_t *upgrade_state;
+        size_t upgrade_state_length;
+
+        /* Sends the games to a hot standby */
+        struct pcx_replication_primary *replication;
+
+        /* Set when this process is a standby and the primary has gone
+         * away. The last state received from it is kept in
+         * standby_state.
+         */
+        bool take_over;
+        struct pcx_buffer standby_state;
+
+        struct pcx_admin *admin;
+
+        /* Set once the program has been asked to quit as soon as no
+         * games would be lost. No new games are started in the
+         * meantime and the timeout checks every so often whether the
+         * games have finished.
+         */
+        bool draining;
+        struct pcx_main_context_source *drain_source;
+        /* Set when a live upgrade was requested while some games
+         * couldn’t be handed over to the new process. The games are
+         * drained and the upgrade starts once they have finished.
+         */
+        bool upgrade_pending;
+        /* Set when the drain was requested explicitly rather than
+         * only to wait for an upgrade, so the program should quit
+         * even if the upgrade fails.
+         */
+        bool quit_when_drained;
 };
 
-static const char options[] = "-ht:l:c:du:g:";
+static const char options[] = "-ht:l:c:du:g:S";
 
 static void
 quit_cb(struct pcx_main_context_source *source,
@@ -77,6 +155,111 @@ quit_cb(struct pcx_main_context_source *source,
         data->quit = true;
 }
 
+/* Returns true if quitting would lose any games */
+static bool
+is_busy(struct pcx_main *data)
+{
+        struct pcx_main_bot *mbot;
+
+        pcx_list_for_each(mbot, &data->bots, link) {
+                if (pcx_bot_get_n_running_games(mbot->bot) > 0)
+                        return true;
+        }
+
+        /* Games that can be saved will carry on after the restart so
+         * they don’t need to stop it.
+         */
+        return (data->server &&
+                pcx_server_get_n_unsaveable_players(data->server) > 0);
+}
+
+static void
+queue_drain_check(struct pcx_main *data);
+
+static void
+set_draining(struct pcx_main *data,
+             bool draining)
+{
+        data->draining = draining;
+
+        struct pcx_main_bot *mbot;
+
+        pcx_list_for_each(mbot, &data->bots, link)
+                pcx_bot_set_draining(mbot->bot, draining);
+
+        if (data->server)
+                pcx_server_set_draining(data->server, draining);
+}
+
+static bool
+start_upgrade(struct pcx_main *data);
+
+static void
+check_drain(struct pcx_main *data)
+{
+        if (is_busy(data)) {
+                queue_drain_check(data);
+                return;
+        }
+
+        if (data->upgrade_pending) {
+                data->upgrade_pending = false;
+
+                if (start_upgrade(data))
+                        return;
+
+                if (!data->quit_when_drained) {
+                        pcx_log("Carrying on without upgrading");
+                        set_draining(data, false);
+                        return;
+                }
+        }
+
+        pcx_log("No games running, quitting");
+        data->quit = true;
+}
+
+static void
+drain_cb(struct pcx_main_context_source *source,
+         void *user_data)
+{
+        struct pcx_main *data = user_data;
+
+        data->drain_source = NULL;
+
+        check_drain(data);
+}
+
+static void
+queue_drain_check(struct pcx_main *data)
+{
+        if (data->drain_source)
+                return;
+
+        data->drain_source = pcx_main_context_add_timeout(NULL,
+                                                          1000, /* ms */
+                                                          drain_cb,
+                                                          data);
+}
+
+static void
+start_drain(struct pcx_main *data)
+{
+        if (!data->draining) {
+                pcx_log("Draining, no new games will be started");
+                set_draining(data, true);
+        }
+
+        check_drain(data);
+}
+
+static void
+request_drain(struct pcx_main *data)
+{
+        data->quit_when_drained = true;
+        start_drain(data);
+}
+
 static void
 info_cb(struct pcx_main_context_source *source,
         int signal_num,
@@ -84,20 +267,17 @@ info_cb(struct pcx_main_context_source *source,
 {
         struct pcx_main *data = user_data;
         int total_games = 0;
-        struct pcx_config_bot *bot;
-        int bot_num = 0;
-        bool is_busy = false;
-
-        pcx_list_for_each(bot, &data->config->bots, link) {
-                int n_games = pcx_bot_get_n_running_games(data->bots[bot_num]);
-                pcx_log("@%s: %i", bot->botname, n_games);
+        struct pcx_main_bot *mbot;
+
+        pcx_list_for_each(mbot, &data->bots, link) {
+                int n_games = pcx_bot_get_n_running_games(mbot->bot);
+                pcx_log("@%s: %i%s",
+                        mbot->config->botname,
+                        n_games,
+                        mbot->removed ? " (removed)" : "");
                 total_games += n_games;
-                bot_num++;
         }
 
-        if (total_games > 0)
-                is_busy = true;
-
         pcx_log("Total games: %i", total_games);
 
         if (data->server) {
@@ -105,48 +285,750 @@ info_cb(struct pcx_main_context_source *source,
 
                 total_server_players +=
                         pcx_server_get_n_players(data->server);
-                if (total_server_players > 0)
-                        is_busy = true;
 
-                pcx_log("Total server players: %i", total_server_players);
+                int unsaveable_players =
+                        pcx_server_get_n_unsaveable_players(data->server);
+
+                pcx_log("Total server players: %i (%i can’t be saved)",
+                        total_server_players,
+                        unsaveable_players);
+
+                pcx_log("Total server conversations: %i",
+                        pcx_server_get_n_conversations(data->server));
+
+                pcx_log("Clients refused because the server is full: %i",
+                        pcx_server_get_n_refused_players(data->server));
+
+                struct pcx_matchmaker_time_to_game ttg;
+
+                pcx_server_get_time_to_game(data->server, &ttg);
+
+                pcx_log("Time to game over the last %i players: "
+                        "p50 %.1fs, p90 %.1fs, p99 %.1fs",
+                        ttg.n_samples,
+                        ttg.p50 / 1e6,
+                        ttg.p90 / 1e6,
+                        ttg.p99 / 1e6);
         }
 
-        if (signal_num == SIGUSR2) {
-                if (is_busy) {
-                        pcx_log("Not quitting due to running games");
-                } else {
-                        pcx_log("No games running, quitting");
-                        data->quit = true;
-                }
+        if (signal_num == SIGUSR2)
+                request_drain(data);
+}
+
+static bool
+admin_drain_cb(const char *args,
+               uint64_t *cursor,
+               struct pcx_buffer *state,
+               struct pcx_buffer *buf,
+               void *user_data)
+{
+        struct pcx_main *data = user_data;
+
+        request_drain(data);
+
+        if (data->quit) {
+                pcx_buffer_append_string(buf, "no games running, quitting\n");
+        } else {
+                pcx_buffer_append_string(buf,
+                                         "draining, will quit when the "
+                                         "games have finished\n");
         }
+
+        return false;
 }
 
 static void
-init_main_bots(struct pcx_main *data)
+add_main_bot(struct pcx_main *data,
+             struct pcx_config_bot *bot_config)
+{
+        /* Curl is only initialised once there is a bot */
+        if (data->pcurl == NULL) {
+                curl_global_init(CURL_GLOBAL_ALL);
+                data->curl_inited = true;
+
+                data->pcurl = pcx_curl_multi_new();
+        }
+
+        struct pcx_main_bot *mbot = pcx_alloc(sizeof *mbot);
+
+        mbot->config = bot_config;
+        mbot->removed = false;
+        mbot->bot = pcx_bot_new(data->config,
+                                bot_config,
+                                data->class_store,
+                                data->pcurl);
+
+        if (data->draining)
+                pcx_bot_set_draining(mbot->bot, true);
+
+        pcx_list_insert(data->bots.prev, &mbot->link);
+}
+
+static void
+free_main_bot(struct pcx_main_bot *mbot)
+{
+        pcx_bot_free(mbot->bot);
+        pcx_list_remove(&mbot->link);
+        pcx_free(mbot);
+}
+
+static void
+reload_option(struct pcx_buffer *buf,
+              const char *name,
+              int64_t *value,
+              int64_t new_value)
 {
-        if (pcx_list_empty(&data->config->bots))
+        if (*value == new_value)
                 return;
 
-        curl_global_init(CURL_GLOBAL_ALL);
-        data->curl_inited = true;
+        pcx_buffer_append_printf(buf,
+                                 "%s: %" PRIi64 " → %" PRIi64 "\n",
+                                 name,
+                                 *value,
+                                 new_value);
+
+        *value = new_value;
+}
+
+static void
+check_restart_option(struct pcx_buffer *buf,
+                     const char *name,
+                     const char *value,
+                     const char *new_value)
+{
+        if (value == new_value ||
+            (value && new_value && !strcmp(value, new_value)))
+                return;
+
+        pcx_buffer_append_printf(buf,
+                                 "%s: can’t be changed without a restart\n",
+                                 name);
+}
+
+static void
+check_restart_int_option(struct pcx_buffer *buf,
+                         const char *name,
+                         int64_t value,
+                         int64_t new_value)
+{
+        if (value == new_value)
+                return;
+
+        pcx_buffer_append_printf(buf,
+                                 "%s: can’t be changed without a restart\n",
+                                 name);
+}
+
+static void
+reload_general_options(struct pcx_main *data,
+                       const struct pcx_config *config,
+                       struct pcx_buffer *buf)
+{
+        /* These are read whenever they are needed so they are copied
+         * into the running config.
+         */
+        reload_option(buf,
+                      "message_retention",
+                      &data->config->message_retention,
+                      config->message_retention);
+        reload_option(buf,
+                      "sideband_interval",
+                      &data->config->sideband_interval,
+                      config->sideband_interval);
+        reload_option(buf,
+                      "chat_rate",
+                      &data->config->chat_rate,
+                      config->chat_rate);
+        reload_option(buf,
+                      "chat_burst",
+                      &data->config->chat_burst,
+                      config->chat_burst);
+        reload_option(buf,
+                      "auto_start_delay",
+                      &data->config->auto_start_delay,
+                      config->auto_start_delay);
+        reload_option(buf,
+                      "max_conversations",
+                      &data->config->max_conversations,
+                      config->max_conversations);
+        reload_option(buf,
+                      "max_players",
+                      &data->config->max_players,
+                      config->max_players);
+        reload_option(buf,
+                      "max_conversations_per_ip",
+                      &data->config->max_conversations_per_ip,
+                      config->max_conversations_per_ip);
+        reload_option(buf,
+                      "max_players_per_ip",
+                      &data->config->max_players_per_ip,
+                      config->max_players_per_ip);
+
+        /* These are only used at startup */
+        check_restart_option(buf,
+                             "data_dir",
+                             data->config->data_dir,
+                             config->data_dir);
+        check_restart_option(buf,
+                             "log_file",
+                             data->config->log_file,
+                             config->log_file);
+        check_restart_option(buf,
+                             "user",
+                             data->config->user,
+                             config->user);
+        check_restart_option(buf,
+                             "group",
+                             data->config->group,
+                             config->group);
+        check_restart_option(buf,
+                             "telegram_url",
+                             data->config->telegram_url,
+                             config->telegram_url);
+        check_restart_option(buf,
+                             "replication_socket",
+                             data->config->replication_socket,
+                             config->replication_socket);
+        check_restart_option(buf,
+                             "admin_socket",
+                             data->config->admin_socket,
+                             config->admin_socket);
+        check_restart_option(buf,
+                             "stats_file",
+                             data->config->stats_file,
+                             config->stats_file);
+
+        check_restart_int_option(buf,
+                                 "replication_interval",
+                                 data->config->replication_interval,
+                                 config->replication_interval);
+        /* Changing the shard would let the new IDs clash with the
+         * ones that are already given out.
+         */
+        check_restart_int_option(buf,
+                                 "shard",
+                                 data->config->shard,
+                                 config->shard);
+}
+
+static void
+check_removed_bots(struct pcx_main *data);
+
+static void
+removed_bots_cb(struct pcx_main_context_source *source,
+                void *user_data)
+{
+        struct pcx_main *data = user_data;
+
+        data->removed_bots_source = NULL;
+
+        check_removed_bots(data);
+}
+
+static void
+check_removed_bots(struct pcx_main *data)
+{
+        struct pcx_main_bot *mbot, *tmp;
+        bool waiting = false;
 
-        data->pcurl = pcx_curl_multi_new();
+        pcx_list_for_each_safe(mbot, tmp, &data->bots, link) {
+                if (!mbot->removed)
+                        continue;
 
+                if (pcx_bot_get_n_running_games(mbot->bot) > 0) {
+                        waiting = true;
+                        continue;
+                }
+
+                pcx_log("Stopping @%s", mbot->config->botname);
+
+                pcx_list_remove(&mbot->config->link);
+                pcx_config_bot_free(mbot->config);
+                free_main_bot(mbot);
+        }
+
+        if (waiting && data->removed_bots_source == NULL) {
+                data->removed_bots_source =
+                        pcx_main_context_add_timeout(NULL,
+                                                     1000, /* ms */
+                                                     removed_bots_cb,
+                                                     data);
+        }
+}
+
+static struct pcx_config_bot *
+find_bot_config(struct pcx_list *bots,
+                const char *apikey)
+{
         struct pcx_config_bot *bot;
 
-        pcx_list_for_each(bot, &data->config->bots, link) {
-                data->n_bots++;
+        pcx_list_for_each(bot, bots, link) {
+                if (!strcmp(bot->apikey, apikey))
+                        return bot;
+        }
+
+        return NULL;
+}
+
+static bool
+bot_configs_equal(const struct pcx_config_bot *a,
+                  const struct pcx_config_bot *b)
+{
+        if (a->language != b->language || strcmp(a->botname, b->botname))
+                return false;
+
+        if (a->announce_channel == NULL || b->announce_channel == NULL)
+                return a->announce_channel == b->announce_channel;
+
+        return !strcmp(a->announce_channel, b->announce_channel);
+}
+
+static void
+reload_bots(struct pcx_main *data,
+            struct pcx_config *config,
+            struct pcx_buffer *buf)
+{
+        struct pcx_main_bot *mbot;
+
+        /* The bots are matched by their API key because only one of
+         * them can get the updates for it at a time.
+         */
+        pcx_list_for_each(mbot, &data->bots, link) {
+                struct pcx_config_bot *bot_config =
+                        find_bot_config(&config->bots, mbot->config->apikey);
+
+                if (bot_config == NULL) {
+                        if (!mbot->removed) {
+                                pcx_buffer_append_printf(buf,
+                                                         "removed @%s\n",
+                                                         mbot->config->
+                                                         botname);
+                                mbot->removed = true;
+                                pcx_bot_set_draining(mbot->bot, true);
+                        }
+                        continue;
+                }
+
+                if (mbot->removed) {
+                        pcx_buffer_append_printf(buf,
+                                                 "kept @%s\n",
+                                                 mbot->config->botname);
+                        mbot->removed = false;
+                        pcx_bot_set_draining(mbot->bot, data->draining);
+                }
+
+                if (!bot_configs_equal(mbot->config, bot_config)) {
+                        pcx_buffer_append_printf(buf,
+                                                 "@%s: the settings can’t "
+                                                 "be changed while the bot "
+                                                 "is running\n",
+                                                 mbot->config->botname);
+                }
+
+                /* Only the new bots are left in the list afterwards */
+                pcx_list_remove(&bot_config->link);
+                pcx_config_bot_free(bot_config);
+        }
+
+        struct pcx_config_bot *bot_config, *tmp;
+
+        pcx_list_for_each_safe(bot_config, tmp, &config->bots, link) {
+                pcx_list_remove(&bot_config->link);
+                pcx_list_insert(data->config->bots.prev, &bot_config->link);
+                add_main_bot(data, bot_config);
+                pcx_buffer_append_printf(buf,
+                                         "added @%s\n",
+                                         bot_config->botname);
+        }
+
+        check_removed_bots(data);
+}
+
+static void
+swap_lists(struct pcx_list *a,
+           struct pcx_list *b)
+{
+        struct pcx_list tmp;
+
+        pcx_list_init(&tmp);
+        pcx_list_insert_list(&tmp, a);
+        pcx_list_init(a);
+        pcx_list_insert_list(a, b);
+        pcx_list_init(b);
+        pcx_list_insert_list(b, &tmp);
+}
+
+static bool
+reload_servers(struct pcx_main *data,
+               struct pcx_config *config,
+               struct pcx_buffer *buf,
+               struct pcx_error **error)
+{
+        if (data->server == NULL) {
+                if (!pcx_list_empty(&config->servers)) {
+                        pcx_buffer_append_string(buf,
+                                                 "adding the first server "
+                                                 "needs a restart\n");
+                }
+                return true;
+        }
+
+        if (!pcx_server_set_configs(data->server, &config->servers, error))
+                return false;
+
+        /* The server is now using the new sections so they are moved
+         * into the running config and the old ones will be freed
+         * along with the new config.
+         */
+        swap_lists(&data->config->servers, &config->servers);
+
+        return true;
+}
+
+/* Reads the config file again and applies the differences to the
+ * running program without affecting the games. A line describing
+ * each change is added to buf. If the new config can’t be used then
+ * nothing is changed.
+ */
+static void
+reload_config(struct pcx_main *data,
+              struct pcx_buffer *buf)
+{
+        struct pcx_error *error = NULL;
+        struct pcx_config *config =
+                pcx_config_load(data->config_path, &error);
+
+        if (config == NULL)
+                goto error;
+
+        /* This is done first because it is the only part that can
+         * fail once the config has been loaded.
+         */
+        if (!reload_servers(data, config, buf, &error)) {
+                pcx_config_free(config);
+                goto error;
+        }
+
+        reload_general_options(data, config, buf);
+        reload_bots(data, config, buf);
+
+        /* The games will load their data files again the next time
+         * they are created in case they have changed.
+         */
+        pcx_class_store_invalidate(data->class_store);
+
+        pcx_config_free(config);
+
+        pcx_buffer_append_string(buf, "reloaded\n");
+
+        return;
+
+error:
+        pcx_buffer_append_printf(buf, "error: %s\n", error->message);
+        pcx_error_free(error);
+}
+
+static void
+log_reload_report(const char *report)
+{
+        while (*report) {
+                const char *end = strchr(report, '\n');
+
+                pcx_log("Reload: %.*s", (int) (end - report), report);
+
+                report = end + 1;
+        }
+}
+
+static void
+reload_cb(struct pcx_main_context_source *source,
+          int signal_num,
+          void *user_data)
+{
+        struct pcx_main *data = user_data;
+        struct pcx_buffer buf = PCX_BUFFER_STATIC_INIT;
+
+        pcx_log("Reloading the config because of SIGHUP");
+
+        reload_config(data, &buf);
+
+        /* Make sure the report is terminated even if it is empty */
+        pcx_buffer_append_c(&buf, '\0');
+        log_reload_report((const char *) buf.data);
+
+        pcx_buffer_destroy(&buf);
+}
+
+static bool
+admin_reload_cb(const char *args,
+                uint64_t *cursor,
+                struct pcx_buffer *state,
+                struct pcx_buffer *buf,
+                void *user_data)
+{
+        struct pcx_main *data = user_data;
+        size_t start = buf->length;
+
+        pcx_log("Reloading the config from the admin socket");
+
+        reload_config(data, buf);
+
+        pcx_buffer_append_c(buf, '\0');
+        log_reload_report((const char *) buf->data + start);
+        buf->length--;
+
+        return false;
+}
+
+static const struct pcx_admin_command
+admin_commands[] = {
+        {
+                .name = "drain",
+                .help = "drain – stop starting games and quit when the "
+                "running ones have finished",
+                .cb = admin_drain_cb,
+        },
+        {
+                .name = "reload",
+                .help = "reload – read the config again and apply the "
+                "changes, the same as SIGHUP",
+                .cb = admin_reload_cb,
+        },
+};
+
+static void
+start_admin(struct pcx_main *data)
+{
+        if (data->config->admin_socket == NULL)
+                return;
+
+        struct pcx_error *error = NULL;
+
+        data->admin = pcx_admin_new(data->config->admin_socket, &error);
+
+        if (data->admin == NULL) {
+                pcx_log("Error starting the admin socket: %s",
+                        error->message);
+                pcx_error_free(error);
+                return;
+        }
+
+        pcx_admin_add_commands(data->admin,
+                               admin_commands,
+                               PCX_N_ELEMENTS(admin_commands),
+                               data);
+
+        if (data->server)
+                pcx_server_add_admin_commands(data->server, data->admin);
+}
+
+static bool
+hand_over(struct pcx_main *data,
+          struct pcx_error **error)
+{
+        pid_t pid;
+        int sock = pcx_upgrade_start(data->argv[0],
+                                     data->argv,
+                                     data->start_dir,
+                                     &pid,
+                                     error);
+
+        if (sock == -1)
+                return false;
+
+        struct pcx_buffer sockets = PCX_BUFFER_STATIC_INIT;
+        struct pcx_buffer state = PCX_BUFFER_STATIC_INIT;
+        struct pcx_buffer fds = PCX_BUFFER_STATIC_INIT;
+        struct pcx_buffer buf = PCX_BUFFER_STATIC_INIT;
+
+        /* The lock is shared with the new process so that nothing
+         * else can start in between.
+         */
+        pcx_buffer_append(&fds, &data->lock_fd, sizeof data->lock_fd);
+
+        if (data->server) {
+                pcx_server_save_listen_sockets(data->server, &sockets, &fds);
+                pcx_server_save_state(data->server,
+                                      &state,
+                                      0 /* max_cache_age */);
+        }
+
+        pcx_snapshot_write_data(&buf, sockets.data, sockets.length);
+        pcx_snapshot_write_data(&buf, state.data, state.length);
+
+        bool ret = (pcx_upgrade_send(sock,
+                                     &buf,
+                                     (const int *) fds.data,
+                                     fds.length / sizeof (int),
+                                     error) &&
+                    pcx_upgrade_wait_for_ack(sock, error));
+
+        pcx_buffer_destroy(&buf);
+        pcx_buffer_destroy(&fds);
+        pcx_buffer_destroy(&state);
+        pcx_buffer_destroy(&sockets);
+
+        pcx_close(sock);
+
+        if (ret) {
+                /* Reap the child if it already forked to daemonize */
+                waitpid(pid, NULL, WNOHANG);
+        } else {
+                /* Make sure the new process doesn’t carry on with a
+                 * copy of the games.
+                 */
+                kill(pid, SIGKILL);
+                waitpid(pid, NULL, 0);
+        }
+
+        return ret;
+}
+
+static bool
+start_upgrade(struct pcx_main *data)
+{
+        struct pcx_error *error = NULL;
+
+        pcx_log("Starting live upgrade");
+
+        if (!hand_over(data, &error)) {
+                pcx_log("Live upgrade failed: %s", error->message);
+                pcx_error_free(error);
+                return false;
         }
 
-        data->bots = pcx_alloc((sizeof *data->bots) * MAX(data->n_bots, 1));
+        pcx_log("The new process has taken over, quitting");
+
+        data->handed_over = true;
+        data->quit = true;
+
+        return true;
+}
+
+static void
+upgrade_cb(struct pcx_main_context_source *source,
+           int signal_num,
+           void *user_data)
+{
+        struct pcx_main *data = user_data;
+
+        if (data->upgrade_pending) {
+                pcx_log("Live upgrade already waiting for games to finish");
+                return;
+        }
+
+        /* Only the server games can be handed over so the upgrade
+         * has to wait for the Telegram games and any server games
+         * that can’t be saved.
+         */
+        if (is_busy(data)) {
+                pcx_log("Some games can’t be handed over, the live "
+                        "upgrade will start when they have finished");
+                data->upgrade_pending = true;
+                start_drain(data);
+                return;
+        }
+
+        start_upgrade(data);
+}
+
+static bool
+receive_upgrade(struct pcx_main *data)
+{
+        struct pcx_error *error = NULL;
+
+        if (!pcx_upgrade_receive(data->upgrade_sock,
+                                 &data->upgrade_data,
+                                 &data->upgrade_fds,
+                                 &error)) {
+                fprintf(stderr, "%s\n", error->message);
+                pcx_error_free(error);
+                return false;
+        }
+
+        if (data->upgrade_fds.length < sizeof (int)) {
+                fprintf(stderr, "The old process didn’t send the lock\n");
+                return false;
+        }
+
+        /* The first fd is always the lock file */
+        const int *fds = (const int *) data->upgrade_fds.data;
+
+        data->lock_fd = fds[0];
+
+        struct pcx_snapshot_reader reader;
+
+        pcx_snapshot_reader_init(&reader,
+                                 data->upgrade_data.data,
+                                 data->upgrade_data.length);
+
+        data->upgrade_sockets =
+                pcx_snapshot_read_data(&reader, &data->upgrade_sockets_length);
+        data->upgrade_state =
+                pcx_snapshot_read_data(&reader, &data->upgrade_state_length);
+
+        if (reader.error) {
+                fprintf(stderr, "Invalid upgrade data\n");
+                return false;
+        }
+
+        return true;
+}
+
+static void
+init_main_bots(struct pcx_main *data)
+{
+        struct pcx_config_bot *bot;
+
+        pcx_list_for_each(bot, &data->config->bots, link)
+                add_main_bot(data, bot);
+}
+
+static void
+metrics_cb(struct pcx_buffer *buf,
+           void *user_data)
+{
+        struct pcx_main *data = user_data;
+        struct pcx_main_bot *mbot;
+        struct pcx_bot_stats stats;
+        char labels[128];
+
+        if (pcx_list_empty(&data->bots))
+                return;
 
-        unsigned i = 0;
+        pcx_metrics_write_header(buf,
+                                 "pucxobot_bot_queued_requests",
+                                 "gauge",
+                                 "Requests waiting to be sent to Telegram");
+
+        pcx_list_for_each(mbot, &data->bots, link) {
+                pcx_bot_get_stats(mbot->bot, &stats);
+                snprintf(labels,
+                         sizeof labels,
+                         "bot=\"%s\"",
+                         mbot->config->botname);
+                pcx_metrics_write_value(buf,
+                                        "pucxobot_bot_queued_requests",
+                                        labels,
+                                        stats.n_queued_requests);
+        }
 
-        pcx_list_for_each(bot, &data->config->bots, link) {
-                data->bots[i++] = pcx_bot_new(data->config,
-                                              bot,
-                                              data->class_store,
-                                              data->pcurl);
+        pcx_metrics_write_header(buf,
+                                 "pucxobot_telegram_request_seconds",
+                                 "histogram",
+                                 "Time for Telegram to answer a request");
+
+        pcx_list_for_each(mbot, &data->bots, link) {
+                pcx_bot_get_stats(mbot->bot, &stats);
+                snprintf(labels,
+                         sizeof labels,
+                         "bot=\"%s\"",
+                         mbot->config->botname);
+                pcx_metrics_write_histogram(buf,
+                                            "pucxobot_telegram_request_"
+                                            "seconds",
+                                            labels,
+                                            &stats.request_time);
         }
 }
 
@@ -158,6 +1040,29 @@ init_main_server(struct pcx_main *data)
 
         data->server = pcx_server_new(data->config, data->class_store);
 
+        pcx_server_set_metrics_cb(data->server, metrics_cb, data);
+
+        if (data->upgrade_sock != -1) {
+                struct pcx_error *error = NULL;
+                const int *fds = (const int *) data->upgrade_fds.data;
+                int n_fds = data->upgrade_fds.length / sizeof (int);
+
+                /* The server takes ownership of the listen sockets */
+                data->upgrade_fds.length = sizeof (int);
+
+                if (!pcx_server_add_inherited_sockets(data->server,
+                                                      data->upgrade_sockets,
+                                                      data->
+                                                      upgrade_sockets_length,
+                                                      fds + 1,
+                                                      n_fds - 1,
+                                                      &error)) {
+                        fprintf(stderr, "%s\n", error->message);
+                        pcx_error_free(error);
+                        return false;
+                }
+        }
+
         struct pcx_config_server *server_conf;
 
         pcx_list_for_each(server_conf, &data->config->servers, link) {
@@ -172,15 +1077,188 @@ init_main_server(struct pcx_main *data)
                 }
         }
 
+        pcx_server_close_inherited_sockets(data->server);
+
         return true;
 }
 
+static char *
+get_state_file(struct pcx_main *data)
+{
+        return pcx_strconcat(data->config->data_dir,
+                             "/saved-games.bin",
+                             NULL);
+}
+
+static void
+save_state(struct pcx_main *data)
+{
+        if (data->server == NULL)
+                return;
+
+        struct pcx_buffer buf = PCX_BUFFER_STATIC_INIT;
+
+        pcx_server_save_state(data->server, &buf, 0 /* max_cache_age */);
+
+        char *fn = get_state_file(data);
+        char *tmp_fn = pcx_strconcat(fn, ".tmp", NULL);
+        FILE *f = fopen(tmp_fn, "wb");
+
+        if (f == NULL) {
+                pcx_log("Error saving the games: %s", strerror(errno));
+        } else {
+                bool ok = fwrite(buf.data, 1, buf.length, f) == buf.length;
+
+                if (fclose(f) != 0)
+                        ok = false;
+
+                if (!ok || rename(tmp_fn, fn) == -1) {
+                        pcx_log("Error saving the games: %s",
+                                strerror(errno));
+                        unlink(tmp_fn);
+                }
+        }
+
+        pcx_free(tmp_fn);
+        pcx_free(fn);
+        pcx_buffer_destroy(&buf);
+}
+
+static void
+restore_state(struct pcx_main *data,
+              const uint8_t *state,
+              size_t length)
+{
+        struct pcx_error *error = NULL;
+
+        if (!pcx_server_restore_state(data->server,
+                                      state,
+                                      length,
+                                      &error)) {
+                pcx_log("Error loading the saved games: %s",
+                        error->message);
+                pcx_error_free(error);
+        }
+}
+
+static void
+load_state(struct pcx_main *data)
+{
+        if (data->server == NULL)
+                return;
+
+        if (data->standby_state.length > 0) {
+                restore_state(data,
+                              data->standby_state.data,
+                              data->standby_state.length);
+                return;
+        }
+
+        if (data->upgrade_sock != -1) {
+                /* An empty state means the old process had no server */
+                if (data->upgrade_state_length > 0) {
+                        restore_state(data,
+                                      data->upgrade_state,
+                                      data->upgrade_state_length);
+                }
+                return;
+        }
+
+        char *fn = get_state_file(data);
+        FILE *f = fopen(fn, "rb");
+
+        if (f) {
+                struct pcx_buffer buf = PCX_BUFFER_STATIC_INIT;
+                size_t got;
+
+                do {
+                        pcx_buffer_ensure_size(&buf, buf.length + 4096);
+                        got = fread(buf.data + buf.length,
+                                    1,
+                                    buf.size - buf.length,
+                                    f);
+                        buf.length += got;
+                } while (got > 0);
+
+                fclose(f);
+
+                /* Remove the file straight away so that a state that
+                 * makes the program crash can’t be loaded twice.
+                 */
+                unlink(fn);
+
+                restore_state(data, buf.data, buf.length);
+
+                pcx_buffer_destroy(&buf);
+        }
+
+        pcx_free(fn);
+}
+
+static void
+replication_state_cb(struct pcx_buffer *buf,
+                     void *user_data)
+{
+        struct pcx_main *data = user_data;
+
+        /* Only the games that have changed are saved again */
+        pcx_server_save_state(data->server,
+                              buf,
+                              PCX_REPLICATION_REFRESH_TIME);
+}
+
+static void
+state_changed_cb(void *user_data)
+{
+        struct pcx_main *data = user_data;
+
+        pcx_replication_primary_state_changed(data->replication);
+}
+
+static void
+start_replication(struct pcx_main *data)
+{
+        if (data->config->replication_socket == NULL || data->server == NULL)
+                return;
+
+        struct pcx_error *error = NULL;
+
+        data->replication =
+                pcx_replication_primary_new(data->config->replication_socket,
+                                            data->config->replication_interval,
+                                            replication_state_cb,
+                                            data,
+                                            &error);
+
+        if (data->replication == NULL) {
+                pcx_log("Error starting replication: %s", error->message);
+                pcx_error_free(error);
+                return;
+        }
+
+        pcx_server_set_state_changed_cb(data->server, state_changed_cb, data);
+}
+
 static void
 destroy_main(struct pcx_main *data)
 {
-        for (unsigned i = 0; i < data->n_bots; i++)
-                pcx_bot_free(data->bots[i]);
-        pcx_free(data->bots);
+        if (data->admin)
+                pcx_admin_free(data->admin);
+        if (data->drain_source)
+                pcx_main_context_remove_source(data->drain_source);
+
+        if (data->replication) {
+                pcx_server_set_state_changed_cb(data->server, NULL, NULL);
+                pcx_replication_primary_free(data->replication);
+        }
+        pcx_buffer_destroy(&data->standby_state);
+
+        struct pcx_main_bot *mbot, *tmp;
+
+        pcx_list_for_each_safe(mbot, tmp, &data->bots, link)
+                free_main_bot(mbot);
+        if (data->removed_bots_source)
+                pcx_main_context_remove_source(data->removed_bots_source);
 
         if (data->server)
                 pcx_server_free(data->server);
@@ -197,6 +1275,14 @@ destroy_main(struct pcx_main *data)
 
         if (data->lock_fd != -1)
                 close(data->lock_fd);
+
+        if (data->upgrade_sock != -1)
+                pcx_close(data->upgrade_sock);
+        pcx_buffer_destroy(&data->upgrade_fds);
+        pcx_buffer_destroy(&data->upgrade_data);
+
+        pcx_free(data->start_dir);
+        pcx_free(data->config_path);
 }
 
 static bool
@@ -225,7 +1311,9 @@ usage(void)
                " -d                   Fork and detach from terminal\n"
                "                      (Daemonize)\n"
                " -u <user>            Drop privileges to user\n"
-               " -g <group>           Drop privileges to group\n");
+               " -g <group>           Drop privileges to group\n"
+               " -S                   Run as a hot standby and take over\n"
+               "                      when the primary process stops\n");
 }
 
 static bool
@@ -274,6 +1362,10 @@ process_arguments(struct pcx_main *data,
                 case 'g':
                         data->run_as_group = optarg;
                         break;
+
+                case 'S':
+                        data->standby = true;
+                        break;
                 }
         }
 
@@ -286,7 +1378,18 @@ load_config(struct pcx_main *data)
         struct pcx_error *error = NULL;
 
         if (data->config_filename) {
-                data->config = pcx_config_load(data->config_filename, &error);
+                /* Daemonizing changes the directory so make the path
+                 * absolute in order to find the file again later.
+                 */
+                if (data->config_filename[0] != '/' && data->start_dir) {
+                        data->config_path =
+                                pcx_strconcat(data->start_dir,
+                                              "/",
+                                              data->config_filename,
+                                              NULL);
+                } else {
+                        data->config_path = pcx_strdup(data->config_filename);
+                }
         } else {
                 const char *home = getenv("HOME");
 
@@ -296,13 +1399,13 @@ load_config(struct pcx_main *data)
                         return false;
                 }
 
-                char *filename = pcx_strconcat(home,
-                                               "/.pucxobot/conf.txt",
-                                               NULL);
-                data->config = pcx_config_load(filename, &error);
-                pcx_free(filename);
+                data->config_path = pcx_strconcat(home,
+                                                  "/.pucxobot/conf.txt",
+                                                  NULL);
         }
 
+        data->config = pcx_config_load(data->config_path, &error);
+
         if (data->config == NULL) {
                 fprintf(stderr, "%s\n", error->message);
                 pcx_error_free(error);
@@ -336,9 +1439,32 @@ start_log(struct pcx_main *data)
         return true;
 }
 
+static bool
+start_stats(struct pcx_main *data)
+{
+        if (data->config->stats_file == NULL)
+                return true;
+
+        struct pcx_error *error = NULL;
+
+        if (!pcx_stats_log_open(data->config->stats_file, &error)) {
+                fprintf(stderr, "%s\n", error->message);
+                pcx_error_free(error);
+                return false;
+        }
+
+        return true;
+}
+
 static bool
 check_not_already_running(struct pcx_main *data)
 {
+        /* The old process has handed over its lock or the standby
+         * has already taken it.
+         */
+        if (data->lock_fd != -1)
+                return true;
+
         char *filename = pcx_strconcat(data->config->data_dir,
                                        "/pucxobot-lock",
                                        NULL);
@@ -358,20 +1484,76 @@ check_not_already_running(struct pcx_main *data)
 
         if (ret == -1) {
                 if (errno == EWOULDBLOCK) {
-                        fprintf(stderr,
-                                "pucxobot is already running\n");
+                        if (!data->standby) {
+                                fprintf(stderr,
+                                        "pucxobot is already running\n");
+                        }
                 } else {
                         fprintf(stderr,
                                 "error getting file lock: %s\n",
                                 strerror(errno));
                 }
 
+                close(data->lock_fd);
+                data->lock_fd = -1;
+
                 return false;
         }
 
         return true;
 }
 
+static void
+standby_lost_cb(void *user_data)
+{
+        struct pcx_main *data = user_data;
+
+        /* The primary holds the lock for as long as it is running so
+         * if we can get it then the primary has gone. Otherwise it is
+         * probably just restarting or upgrading.
+         */
+        if (check_not_already_running(data)) {
+                pcx_log("The primary has stopped, taking over");
+                data->take_over = true;
+        }
+}
+
+static bool
+run_standby(struct pcx_main *data)
+{
+        struct pcx_replication_standby *standby =
+                pcx_replication_standby_new(data->config->replication_socket,
+                                            standby_lost_cb,
+                                            data);
+        struct pcx_main_context_source *int_source =
+                pcx_main_context_add_signal_source(NULL,
+                                                   SIGINT,
+                                                   quit_cb,
+                                                   data);
+        struct pcx_main_context_source *term_source =
+                pcx_main_context_add_signal_source(NULL,
+                                                   SIGTERM,
+                                                   quit_cb,
+                                                   data);
+
+        pcx_log("Waiting as a standby");
+
+        while (!data->quit && !data->take_over)
+                pcx_main_context_poll(NULL);
+
+        pcx_main_context_remove_source(term_source);
+        pcx_main_context_remove_source(int_source);
+
+        const struct pcx_buffer *state =
+                pcx_replication_standby_get_state(standby);
+
+        pcx_buffer_append(&data->standby_state, state->data, state->length);
+
+        pcx_replication_standby_free(standby);
+
+        return data->take_over;
+}
+
 static bool
 set_user(const char *user_name)
 {
@@ -477,18 +1659,25 @@ main(int argc, char **argv)
 {
         struct pcx_main data = {
                 .pcurl = NULL,
-                .n_bots = 0,
-                .bots = NULL,
                 .server = NULL,
                 .config = NULL,
                 .curl_inited = false,
                 .quit = false,
                 .config_filename = NULL,
                 .lock_fd = -1,
+                .argv = argv,
+                .start_dir = getcwd(NULL, 0),
+                .handed_over = false,
+                .upgrade_sock = pcx_upgrade_get_socket(),
+                .upgrade_data = PCX_BUFFER_STATIC_INIT,
+                .upgrade_fds = PCX_BUFFER_STATIC_INIT,
+                .standby_state = PCX_BUFFER_STATIC_INIT,
         };
 
         int ret = EXIT_SUCCESS;
 
+        pcx_list_init(&data.bots);
+
         pcx_main_context_get_default();
 
         if (!process_arguments(&data, argc, argv)) {
@@ -501,6 +1690,37 @@ main(int argc, char **argv)
                 goto done;
         }
 
+        if (data.upgrade_sock != -1 && !receive_upgrade(&data)) {
+                ret = EXIT_FAILURE;
+                goto done;
+        }
+
+        /* A process started by a live upgrade carries on from the old
+         * one even if it was started as a standby.
+         */
+        if (data.upgrade_sock != -1)
+                data.standby = false;
+
+        if (data.standby && data.config->replication_socket == NULL) {
+                fprintf(stderr,
+                        "A standby needs replication_socket in the config\n");
+                ret = EXIT_FAILURE;
+                goto done;
+        }
+
+        if (data.standby) {
+                if (data.daemonize)
+                        daemonize();
+
+                if (!start_log(&data)) {
+                        ret = EXIT_FAILURE;
+                        goto done;
+                }
+
+                if (!run_standby(&data))
+                        goto done;
+        }
+
         if (!check_not_already_running(&data)) {
                 ret = EXIT_FAILURE;
                 goto done;
@@ -518,10 +1738,17 @@ main(int argc, char **argv)
                 goto done;
         }
 
-        if (data.daemonize)
-                daemonize();
+        if (!data.standby) {
+                if (data.daemonize)
+                        daemonize();
 
-        if (!start_log(&data)) {
+                if (!start_log(&data)) {
+                        ret = EXIT_FAILURE;
+                        goto done;
+                }
+        }
+
+        if (!start_stats(&data)) {
                 ret = EXIT_FAILURE;
                 goto done;
         }
@@ -532,6 +1759,8 @@ main(int argc, char **argv)
 
         init_main_bots(&data);
 
+        load_state(&data);
+
         struct pcx_main_context_source *int_source =
                 pcx_main_context_add_signal_source(NULL,
                                                    SIGINT,
@@ -552,18 +1781,61 @@ main(int argc, char **argv)
                                                    SIGUSR2,
                                                    info_cb,
                                                    &data);
+        struct pcx_main_context_source *quit_source =
+                pcx_main_context_add_signal_source(NULL,
+                                                   SIGQUIT,
+                                                   upgrade_cb,
+                                                   &data);
+        struct pcx_main_context_source *hup_source =
+                pcx_main_context_add_signal_source(NULL,
+                                                   SIGHUP,
+                                                   reload_cb,
+                                                   &data);
 
-        do
+        if (data.upgrade_sock != -1) {
+                struct pcx_error *error = NULL;
+
+                if (pcx_upgrade_send_ack(data.upgrade_sock, &error)) {
+                        pcx_log("Took over from the old process");
+                } else {
+                        /* The old process has probably given up on us
+                         * and is carrying on with the games.
+                         */
+                        pcx_log("%s", error->message);
+                        pcx_error_free(error);
+                        data.handed_over = true;
+                        data.quit = true;
+                        ret = EXIT_FAILURE;
+                }
+
+                pcx_close(data.upgrade_sock);
+                data.upgrade_sock = -1;
+        }
+
+        /* These are started after the old process has let go so that
+         * a failed upgrade doesn’t take the sockets away from it.
+         */
+        if (!data.quit) {
+                start_admin(&data);
+                start_replication(&data);
+        }
+
+        while (!data.quit)
                 pcx_main_context_poll(NULL);
-        while (!data.quit);
 
+        pcx_main_context_remove_source(hup_source);
+        pcx_main_context_remove_source(quit_source);
         pcx_main_context_remove_source(usr2_source);
         pcx_main_context_remove_source(usr1_source);
         pcx_main_context_remove_source(term_source);
         pcx_main_context_remove_source(int_source);
 
+        if (!data.handed_over)
+                save_state(&data);
+
 done:
         destroy_main(&data);
+        pcx_stats_log_close();
         pcx_log_close();
 
         pcx_main_context_free(pcx_main_context_get_default());
@@ -0,0 +1,288 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "pcx-matchmaker.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pcx-util.h"
+#include "pcx-buffer.h"
+#include "pcx-list.h"
+#include "pcx-main-context.h"
+
+/* Number of recent players used to calculate the time to game */
+#define N_SAMPLES 1024
+
+/* Rough guess of how long it takes for each missing player to turn
+ * up. This is only used to prefer the lobbies that need fewer players.
+ */
+#define MISSING_PLAYER_WAIT ((uint64_t) 120 * 1000000)
+
+/* If auto-start is disabled and nobody has pressed the start button
+ * after this long then the lobby is considered stuck and new players
+ * are sent elsewhere.
+ */
+#define STALL_TIME ((uint64_t) 60 * 1000000)
+
+struct pcx_matchmaker {
+        uint64_t auto_start_delay;
+
+        struct pcx_list lobbies;
+
+        /* Ring buffer of the most recent times to game */
+        uint64_t samples[N_SAMPLES];
+        int n_samples;
+        int next_sample;
+};
+
+struct pcx_matchmaker_lobby {
+        struct pcx_list link;
+        struct pcx_matchmaker *matchmaker;
+        struct pcx_conversation *conversation;
+
+        uint64_t creation_time;
+        /* Time the lobby reached the minimum number of players or
+         * zero if it hasn’t yet.
+         */
+        uint64_t ready_time;
+
+        struct pcx_main_context_source *auto_start_source;
+
+        /* Array of uint64_t with the time that each player joined */
+        struct pcx_buffer join_times;
+};
+
+struct pcx_matchmaker *
+pcx_matchmaker_new(const struct pcx_config *config)
+{
+        struct pcx_matchmaker *matchmaker = pcx_calloc(sizeof *matchmaker);
+
+        int64_t auto_start_delay = (config ?
+                                    config->auto_start_delay :
+                                    PCX_CONFIG_DEFAULT_AUTO_START_DELAY);
+        matchmaker->auto_start_delay = auto_start_delay * UINT64_C(1000000);
+
+        pcx_list_init(&matchmaker->lobbies);
+
+        return matchmaker;
+}
+
+struct pcx_matchmaker_lobby *
+pcx_matchmaker_add_lobby(struct pcx_matchmaker *matchmaker,
+                         struct pcx_conversation *conversation)
+{
+        struct pcx_matchmaker_lobby *lobby = pcx_calloc(sizeof *lobby);
+
+        lobby->matchmaker = matchmaker;
+        lobby->conversation = conversation;
+        lobby->creation_time = pcx_main_context_get_monotonic_clock(NULL);
+        pcx_buffer_init(&lobby->join_times);
+
+        pcx_list_insert(matchmaker->lobbies.prev, &lobby->link);
+
+        return lobby;
+}
+
+static void
+auto_start_cb(struct pcx_main_context_source *source,
+              void *user_data)
+{
+        struct pcx_matchmaker_lobby *lobby = user_data;
+
+        lobby->auto_start_source = NULL;
+
+        /* This will probably cause the lobby to be removed */
+        pcx_conversation_start(lobby->conversation);
+}
+
+void
+pcx_matchmaker_player_added(struct pcx_matchmaker_lobby *lobby)
+{
+        struct pcx_matchmaker *matchmaker = lobby->matchmaker;
+        const struct pcx_conversation *conv = lobby->conversation;
+        uint64_t now = pcx_main_context_get_monotonic_clock(NULL);
+
+        pcx_buffer_append(&lobby->join_times, &now, sizeof now);
+
+        assert(lobby->join_times.length / sizeof now == conv->n_players);
+
+        if (lobby->ready_time != 0 ||
+            conv->n_players < conv->game_type->min_players)
+                return;
+
+        lobby->ready_time = now;
+
+        if (matchmaker->auto_start_delay > 0) {
+                lobby->auto_start_source =
+                        pcx_main_context_add_timeout(NULL,
+                                                     matchmaker->
+                                                     auto_start_delay / 1000,
+                                                     auto_start_cb,
+                                                     lobby);
+        }
+}
+
+void
+pcx_matchmaker_lobby_started(struct pcx_matchmaker_lobby *lobby)
+{
+        struct pcx_matchmaker *matchmaker = lobby->matchmaker;
+        uint64_t now = pcx_main_context_get_monotonic_clock(NULL);
+        const uint64_t *join_times = (const uint64_t *) lobby->join_times.data;
+        size_t n_players = lobby->join_times.length / sizeof (uint64_t);
+
+        for (size_t i = 0; i < n_players; i++) {
+                matchmaker->samples[matchmaker->next_sample] =
+                        now - join_times[i];
+                matchmaker->next_sample =
+                        (matchmaker->next_sample + 1) % N_SAMPLES;
+                if (matchmaker->n_samples < N_SAMPLES)
+                        matchmaker->n_samples++;
+        }
+}
+
+void
+pcx_matchmaker_remove_lobby(struct pcx_matchmaker_lobby *lobby)
+{
+        if (lobby->auto_start_source)
+                pcx_main_context_remove_source(lobby->auto_start_source);
+
+        pcx_buffer_destroy(&lobby->join_times);
+        pcx_list_remove(&lobby->link);
+        pcx_free(lobby);
+}
+
+/* Returns the estimated number of microseconds until the lobby
+ * starts if one more player joins it, or UINT64_MAX if no more
+ * players should be sent to it.
+ */
+static uint64_t
+get_expected_wait(const struct pcx_matchmaker_lobby *lobby,
+                  uint64_t now)
+{
+        const struct pcx_conversation *conv = lobby->conversation;
+        const struct pcx_game *game_type = conv->game_type;
+        int n_players = conv->n_players + 1;
+
+        /* The new player would fill the game so it starts straight
+         * away.
+         */
+        if (n_players >= game_type->max_players)
+                return 0;
+
+        if (n_players < game_type->min_players) {
+                return ((game_type->min_players - n_players) *
+                        MISSING_PLAYER_WAIT);
+        }
+
+        uint64_t ready_time = lobby->ready_time ? lobby->ready_time : now;
+        uint64_t auto_start_delay = lobby->matchmaker->auto_start_delay;
+
+        if (auto_start_delay > 0) {
+                uint64_t start_time = ready_time + auto_start_delay;
+                return start_time > now ? start_time - now : 0;
+        }
+
+        /* Otherwise it depends on someone pressing the start button */
+        if (now - ready_time >= STALL_TIME)
+                return UINT64_MAX;
+
+        return STALL_TIME - (now - ready_time);
+}
+
+bool
+pcx_matchmaker_is_better(const struct pcx_matchmaker_lobby *a,
+                         const struct pcx_matchmaker_lobby *b)
+{
+        uint64_t now = pcx_main_context_get_monotonic_clock(NULL);
+        uint64_t a_wait = get_expected_wait(a, now);
+
+        if (a_wait == UINT64_MAX)
+                return false;
+
+        if (b == NULL)
+                return true;
+
+        uint64_t b_wait = get_expected_wait(b, now);
+
+        if (a_wait != b_wait)
+                return a_wait < b_wait;
+
+        /* Give the players that have been waiting longest a chance
+         * to play first.
+         */
+        return a->creation_time < b->creation_time;
+}
+
+static int
+compare_samples(const void *pa,
+                const void *pb)
+{
+        uint64_t a = *(const uint64_t *) pa;
+        uint64_t b = *(const uint64_t *) pb;
+
+        return a < b ? -1 : a > b ? 1 : 0;
+}
+
+static uint64_t
+get_percentile(const uint64_t *sorted_samples,
+               int n_samples,
+               int percentile)
+{
+        int index = (n_samples * percentile + 99) / 100 - 1;
+
+        return sorted_samples[MAX(index, 0)];
+}
+
+void
+pcx_matchmaker_get_time_to_game(struct pcx_matchmaker *matchmaker,
+                                struct pcx_matchmaker_time_to_game *stats)
+{
+        int n_samples = matchmaker->n_samples;
+
+        memset(stats, 0, sizeof *stats);
+        stats->n_samples = n_samples;
+
+        if (n_samples <= 0)
+                return;
+
+        uint64_t *sorted = pcx_memdup(matchmaker->samples,
+                                      n_samples * sizeof (uint64_t));
+
+        qsort(sorted, n_samples, sizeof (uint64_t), compare_samples);
+
+        stats->p50 = get_percentile(sorted, n_samples, 50);
+        stats->p90 = get_percentile(sorted, n_samples, 90);
+        stats->p99 = get_percentile(sorted, n_samples, 99);
+
+        pcx_free(sorted);
+}
+
+void
+pcx_matchmaker_free(struct pcx_matchmaker *matchmaker)
+{
+        /* The lobbies belong to the server’s pending conversations
+         * and should have been removed before freeing.
+         */
+        assert(pcx_list_empty(&matchmaker->lobbies));
+
+        pcx_free(matchmaker);
+}
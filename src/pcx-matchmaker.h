@@ -0,0 +1,83 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PCX_MATCHMAKER_H
+#define PCX_MATCHMAKER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "pcx-config.h"
+#include "pcx-conversation.h"
+
+/* Decides which of the public pending conversations a new player
+ * should be sent to. There can be several of these lobbies for each
+ * game type and language and the player is sent to the one that is
+ * expected to start the soonest. Lobbies that have enough players are
+ * started automatically after the configured delay. The matchmaker
+ * also keeps track of how long players wait for their game to start.
+ */
+
+struct pcx_matchmaker;
+struct pcx_matchmaker_lobby;
+
+/* Percentiles of the time between joining and the game starting
+ * for the most recent players.
+ */
+struct pcx_matchmaker_time_to_game {
+        int n_samples;
+        /* Microseconds */
+        uint64_t p50, p90, p99;
+};
+
+struct pcx_matchmaker *
+pcx_matchmaker_new(const struct pcx_config *config);
+
+/* Starts tracking a public conversation that hasn’t started yet. The
+ * lobby must be removed before the conversation is destroyed.
+ */
+struct pcx_matchmaker_lobby *
+pcx_matchmaker_add_lobby(struct pcx_matchmaker *matchmaker,
+                         struct pcx_conversation *conversation);
+
+void
+pcx_matchmaker_player_added(struct pcx_matchmaker_lobby *lobby);
+
+/* Records the time to game for each of the players */
+void
+pcx_matchmaker_lobby_started(struct pcx_matchmaker_lobby *lobby);
+
+void
+pcx_matchmaker_remove_lobby(struct pcx_matchmaker_lobby *lobby);
+
+/* Returns true if a new player should be sent to lobby a rather than
+ * to lobby b. b can be NULL, in which case this returns whether the
+ * lobby should get new players at all.
+ */
+bool
+pcx_matchmaker_is_better(const struct pcx_matchmaker_lobby *a,
+                         const struct pcx_matchmaker_lobby *b);
+
+void
+pcx_matchmaker_get_time_to_game(struct pcx_matchmaker *matchmaker,
+                                struct pcx_matchmaker_time_to_game *stats);
+
+void
+pcx_matchmaker_free(struct pcx_matchmaker *matchmaker);
+
+#endif /* PCX_MATCHMAKER_H */
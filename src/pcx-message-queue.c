@@ -56,6 +56,8 @@ struct pcx_message_queue_chat {
 
 struct pcx_message_queue {
         struct pcx_list chats;
+        /* Number of messages waiting in all of the chat queues */
+        size_t n_queued_messages;
 };
 
 static void
@@ -158,6 +160,8 @@ pcx_message_queue_add(struct pcx_message_queue *mq,
 
         message->args = json_object_get(args);
         pcx_list_insert(chat->queue.prev, &message->link);
+
+        mq->n_queued_messages++;
 }
 
 static struct json_object *
@@ -215,8 +219,10 @@ pcx_message_queue_get(struct pcx_message_queue *mq,
 
                 update_recent_messages(chat, now);
 
-                if (chat->recent_sent_messages_length < LIMIT_AMOUNT)
+                if (chat->recent_sent_messages_length < LIMIT_AMOUNT) {
+                        mq->n_queued_messages--;
                         return unqueue_message(chat, now);
+                }
 
                 struct pcx_message_queue_message *message =
                         pcx_container_of(chat->recent_sent_messages.next,
@@ -240,6 +246,12 @@ pcx_message_queue_get(struct pcx_message_queue *mq,
         return NULL;
 }
 
+size_t
+pcx_message_queue_get_length(struct pcx_message_queue *mq)
+{
+        return mq->n_queued_messages;
+}
+
 void
 pcx_message_queue_free(struct pcx_message_queue *mq)
 {
@@ -22,6 +22,7 @@
 #include <json_object.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stddef.h>
 
 struct pcx_message_queue;
 
@@ -46,6 +47,10 @@ pcx_message_queue_get(struct pcx_message_queue *mq,
                       bool *has_delayed_message,
                       uint64_t *send_delay);
 
+/* Returns the number of messages that haven’t been sent yet */
+size_t
+pcx_message_queue_get_length(struct pcx_message_queue *mq);
+
 void
 pcx_message_queue_free(struct pcx_message_queue *mq);
 
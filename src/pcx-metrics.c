@@ -0,0 +1,104 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "pcx-metrics.h"
+
+#include <inttypes.h>
+
+void
+pcx_metrics_write_header(struct pcx_buffer *buf,
+                         const char *name,
+                         const char *type,
+                         const char *help)
+{
+        pcx_buffer_append_printf(buf,
+                                 "# HELP %s %s\n"
+                                 "# TYPE %s %s\n",
+                                 name, help,
+                                 name, type);
+}
+
+void
+pcx_metrics_write_value(struct pcx_buffer *buf,
+                        const char *name,
+                        const char *labels,
+                        uint64_t value)
+{
+        if (labels) {
+                pcx_buffer_append_printf(buf,
+                                         "%s{%s} %" PRIu64 "\n",
+                                         name,
+                                         labels,
+                                         value);
+        } else {
+                pcx_buffer_append_printf(buf,
+                                         "%s %" PRIu64 "\n",
+                                         name,
+                                         value);
+        }
+}
+
+void
+pcx_metrics_write_histogram(struct pcx_buffer *buf,
+                            const char *name,
+                            const char *labels,
+                            const struct pcx_metrics_histogram *histogram)
+{
+        const char *separator = labels ? "," : "";
+
+        if (labels == NULL)
+                labels = "";
+
+        uint64_t total = 0;
+
+        for (int i = 0; i < PCX_METRICS_N_BUCKETS; i++) {
+                total += histogram->buckets[i];
+                pcx_buffer_append_printf(buf,
+                                         "%s_bucket{%s%sle=\"%g\"} "
+                                         "%" PRIu64 "\n",
+                                         name,
+                                         labels,
+                                         separator,
+                                         pcx_metrics_get_bucket_bound(i) /
+                                         1e6,
+                                         total);
+        }
+
+        pcx_buffer_append_printf(buf,
+                                 "%s_bucket{%s%sle=\"+Inf\"} %" PRIu64 "\n",
+                                 name,
+                                 labels,
+                                 separator,
+                                 histogram->count);
+
+        if (*labels) {
+                pcx_buffer_append_printf(buf,
+                                         "%s_sum{%s} %f\n"
+                                         "%s_count{%s} %" PRIu64 "\n",
+                                         name, labels, histogram->sum / 1e6,
+                                         name, labels, histogram->count);
+        } else {
+                pcx_buffer_append_printf(buf,
+                                         "%s_sum %f\n"
+                                         "%s_count %" PRIu64 "\n",
+                                         name, histogram->sum / 1e6,
+                                         name, histogram->count);
+        }
+}
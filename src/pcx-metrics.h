@@ -0,0 +1,92 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PCX_METRICS_H
+#define PCX_METRICS_H
+
+#include <stdint.h>
+
+#include "pcx-buffer.h"
+
+/* Helpers to write metrics in the Prometheus text format. None of
+ * these allocate anything except to grow the buffer so the same
+ * buffer can be reused for every request.
+ */
+
+#define PCX_METRICS_N_BUCKETS 10
+
+/* Times in microseconds. The buckets don’t include the values that
+ * fall into a smaller bucket and the values that are bigger than the
+ * last bucket are only in the count.
+ */
+struct pcx_metrics_histogram {
+        uint64_t buckets[PCX_METRICS_N_BUCKETS];
+        uint64_t count;
+        uint64_t sum;
+};
+
+/* The upper bounds go 100µs, 500µs, 1ms, 5ms and so on up to 5s */
+static inline uint64_t
+pcx_metrics_get_bucket_bound(int bucket)
+{
+        uint64_t bound = 100;
+
+        for (int i = 0; i < bucket / 2; i++)
+                bound *= 10;
+
+        return (bucket & 1) ? bound * 5 : bound;
+}
+
+static inline void
+pcx_metrics_histogram_observe(struct pcx_metrics_histogram *histogram,
+                              uint64_t value)
+{
+        for (int i = 0; i < PCX_METRICS_N_BUCKETS; i++) {
+                if (value <= pcx_metrics_get_bucket_bound(i)) {
+                        histogram->buckets[i]++;
+                        break;
+                }
+        }
+
+        histogram->count++;
+        histogram->sum += value;
+}
+
+void
+pcx_metrics_write_header(struct pcx_buffer *buf,
+                         const char *name,
+                         const char *type,
+                         const char *help);
+
+/* The labels are written between the braces as they are, for example
+ * ‘state="lobby"’. They can be NULL if there aren’t any.
+ */
+void
+pcx_metrics_write_value(struct pcx_buffer *buf,
+                        const char *name,
+                        const char *labels,
+                        uint64_t value);
+
+/* Writes the histogram with the times converted to seconds */
+void
+pcx_metrics_write_histogram(struct pcx_buffer *buf,
+                            const char *name,
+                            const char *labels,
+                            const struct pcx_metrics_histogram *histogram);
+
+#endif /* PCX_METRICS_H */
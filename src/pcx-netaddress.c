@@ -23,6 +23,7 @@
 #include <string.h>
 #include <inttypes.h>
 #include <arpa/inet.h>
+#include <sys/socket.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <errno.h>
@@ -97,6 +98,14 @@ pcx_netaddress_from_native(struct pcx_netaddress *address,
                                                 &native->sockaddr_in6);
                 break;
 
+        case AF_UNIX:
+                /* The clients of a Unix socket don’t have a useful
+                 * address so they all look the same.
+                 */
+                memset(address, 0, sizeof *address);
+                address->family = AF_UNIX;
+                break;
+
         default:
                 memset(address, 0, sizeof *address);
                 break;
@@ -119,6 +128,11 @@ pcx_netaddress_to_string(const struct pcx_netaddress *address)
         };
         int len;
 
+        if (address->family == AF_UNIX) {
+                strcpy(buf, "unix");
+                return buf;
+        }
+
         if (address->family == AF_INET6) {
                 if (memcmp(&address->ipv6,
                            ipv4_mapped_address_prefix,
@@ -230,3 +244,16 @@ out:
 
         return ret;
 }
+
+uint64_t
+pcx_netaddress_get_client_key(const struct pcx_netaddress *address)
+{
+        if (address->family == AF_INET6) {
+                /* Only use the /64 prefix */
+                uint64_t prefix;
+                memcpy(&prefix, &address->ipv6, sizeof prefix);
+                return prefix;
+        } else {
+                return address->ipv4.s_addr;
+        }
+}
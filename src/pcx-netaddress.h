@@ -58,4 +58,13 @@ pcx_netaddress_from_string(struct pcx_netaddress *address,
                            const char *str,
                            int default_port);
 
+/* Returns a number to identify the client that the address belongs
+ * to. The port is ignored and IPv6 addresses are grouped by their /64
+ * prefix because a single client can usually pick any address within
+ * that. Two addresses are from the same client if they have the same
+ * family and key.
+ */
+uint64_t
+pcx_netaddress_get_client_key(const struct pcx_netaddress *address);
+
 #endif /* PCX_NETADDRESS_H */
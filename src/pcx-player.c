@@ -19,6 +19,9 @@
 #include "config.h"
 
 #include "pcx-player.h"
+
+#include <sys/socket.h>
+
 #include "pcx-main-context.h"
 
 struct pcx_player *
@@ -32,6 +35,7 @@ pcx_player_new(uint64_t id,
         player->ref_count = 0;
         player->last_update_time = pcx_main_context_get_monotonic_clock(NULL);
         player->has_left = false;
+        player->address.family = AF_UNSPEC;
 
         pcx_conversation_ref(conversation);
         player->conversation = conversation;
@@ -41,6 +45,28 @@ pcx_player_new(uint64_t id,
         return player;
 }
 
+struct pcx_player *
+pcx_player_new_restored(uint64_t id,
+                        struct pcx_conversation *conversation,
+                        int player_num,
+                        bool has_left)
+{
+        struct pcx_player *player = pcx_alloc(sizeof *player);
+
+        player->id = id;
+        player->ref_count = 0;
+        player->last_update_time = pcx_main_context_get_monotonic_clock(NULL);
+        player->has_left = has_left;
+        player->address.family = AF_UNSPEC;
+
+        pcx_conversation_ref(conversation);
+        player->conversation = conversation;
+
+        player->player_num = player_num;
+
+        return player;
+}
+
 void
 pcx_player_free(struct pcx_player *player)
 {
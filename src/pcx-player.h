@@ -23,6 +23,7 @@
 
 #include "pcx-list.h"
 #include "pcx-conversation.h"
+#include "pcx-netaddress.h"
 
 struct pcx_player {
         /* This is the randomly generated globally unique ID for the
@@ -54,6 +55,12 @@ struct pcx_player {
         struct pcx_player *hash_next;
 
         bool has_left;
+
+        /* Address of the client that created the player. The family
+         * is AF_UNSPEC if it isn’t known, for example because the
+         * player was restored from a snapshot.
+         */
+        struct pcx_netaddress address;
 };
 
 struct pcx_player *
@@ -61,6 +68,16 @@ pcx_player_new(uint64_t id,
                struct pcx_conversation *conversation,
                const char *name);
 
+/* Creates a player for a conversation that was restored from a
+ * snapshot. The player is already part of the conversation so it
+ * isn’t added again.
+ */
+struct pcx_player *
+pcx_player_new_restored(uint64_t id,
+                        struct pcx_conversation *conversation,
+                        int player_num,
+                        bool has_left);
+
 void
 pcx_player_free(struct pcx_player *player);
 
@@ -21,6 +21,8 @@
 #include "pcx-playerbase.h"
 
 #include <assert.h>
+#include <limits.h>
+#include <stdlib.h>
 
 #include "pcx-util.h"
 #include "pcx-main-context.h"
@@ -30,50 +32,174 @@
  */
 #define PCX_PLAYERBASE_MAX_PLAYER_AGE ((uint64_t) 2 * 60 * 1000000)
 
+/* Number of buckets from the old hash table to move to the new one
+ * on each operation while the table is being resized.
+ */
+#define REHASH_STEP 4
+
+#define MIN_HASH_SIZE 8
+
+struct pcx_playerbase_hash_table {
+        int size;
+        struct pcx_player **buckets;
+};
+
 struct pcx_playerbase {
         struct pcx_list players;
 
         int n_players;
-        int hash_size;
-        struct pcx_player **hash_table;
+
+        struct pcx_playerbase_hash_table hash_table;
+
+        /* When the hash table is resized the players are moved from
+         * the old table a few buckets at a time so that there isn’t
+         * a latency spike. Any bucket in the old table before
+         * rehash_pos has already been moved. The buckets are NULL
+         * when there is no resize in progress.
+         */
+        struct pcx_playerbase_hash_table old_hash_table;
+        int rehash_pos;
 
         struct pcx_main_context_source *gc_source;
+
+        pcx_playerbase_player_removed_cb player_removed_cb;
+        void *player_removed_cb_user_data;
 };
 
 static void
 queue_gc_source(struct pcx_playerbase *playerbase);
 
-static int
-get_hash_pos(struct pcx_playerbase *playerbase,
-             uint64_t id)
+static struct pcx_player **
+get_bucket(const struct pcx_playerbase_hash_table *table,
+           uint64_t id)
 {
-        return id % playerbase->hash_size;
+        return table->buckets + (pcx_hash_uint64(id) & (table->size - 1));
 }
 
 static void
-remove_player(struct pcx_playerbase *playerbase,
-              struct pcx_player *player)
+add_player_to_table(struct pcx_playerbase_hash_table *table,
+                    struct pcx_player *player)
 {
-        pcx_list_remove(&player->link);
+        struct pcx_player **bucket = get_bucket(table, player->id);
 
-        int pos = get_hash_pos(playerbase, player->id);
-        struct pcx_player **prev = playerbase->hash_table + pos;
-        while (true) {
-                assert(*prev);
+        player->hash_next = *bucket;
+        *bucket = player;
+}
 
-                if (*prev == player)
-                        break;
+static void
+rehash_step(struct pcx_playerbase *playerbase,
+            int n_buckets)
+{
+        struct pcx_playerbase_hash_table *old_table =
+                &playerbase->old_hash_table;
+
+        if (old_table->buckets == NULL)
+                return;
+
+        for (; n_buckets > 0 && playerbase->rehash_pos < old_table->size;
+             n_buckets--, playerbase->rehash_pos++) {
+                struct pcx_player *player, *next;
+
+                for (player = old_table->buckets[playerbase->rehash_pos];
+                     player;
+                     player = next) {
+                        next = player->hash_next;
+                        add_player_to_table(&playerbase->hash_table, player);
+                }
+
+                old_table->buckets[playerbase->rehash_pos] = NULL;
+        }
+
+        if (playerbase->rehash_pos >= old_table->size) {
+                pcx_free(old_table->buckets);
+                old_table->buckets = NULL;
+                old_table->size = 0;
+        }
+}
+
+static void
+finish_rehash(struct pcx_playerbase *playerbase)
+{
+        rehash_step(playerbase, INT_MAX);
+}
+
+static void
+start_resize(struct pcx_playerbase *playerbase,
+             int new_size)
+{
+        /* The resize thresholds are far enough apart that the
+         * previous resize should have finished by now, but make sure
+         * so that there are only ever two tables.
+         */
+        finish_rehash(playerbase);
+
+        playerbase->old_hash_table = playerbase->hash_table;
+        playerbase->rehash_pos = 0;
+
+        playerbase->hash_table.size = new_size;
+        playerbase->hash_table.buckets =
+                pcx_calloc(new_size * sizeof *playerbase->hash_table.buckets);
+}
+
+static void
+maybe_shrink_hash_table(struct pcx_playerbase *playerbase)
+{
+        int new_size = playerbase->hash_table.size;
+
+        while (new_size > MIN_HASH_SIZE && playerbase->n_players < new_size / 4)
+                new_size /= 2;
+
+        if (new_size != playerbase->hash_table.size)
+                start_resize(playerbase, new_size);
+}
+
+static bool
+unlink_from_table(struct pcx_playerbase_hash_table *table,
+                  struct pcx_player *player)
+{
+        struct pcx_player **prev = get_bucket(table, player->id);
+
+        while (*prev) {
+                if (*prev == player) {
+                        *prev = player->hash_next;
+                        return true;
+                }
 
                 prev = &(*prev)->hash_next;
         }
 
-        *prev = player->hash_next;
+        return false;
+}
+
+static void
+remove_player(struct pcx_playerbase *playerbase,
+              struct pcx_player *player)
+{
+        rehash_step(playerbase, REHASH_STEP);
+
+        pcx_list_remove(&player->link);
+
+        /* If the player isn’t in the new table then it must be in a
+         * bucket of the old table that hasn’t been moved yet.
+         */
+        if (!unlink_from_table(&playerbase->hash_table, player)) {
+                bool found = (playerbase->old_hash_table.buckets &&
+                              unlink_from_table(&playerbase->old_hash_table,
+                                                player));
+                assert(found);
+        }
 
         if (!player->has_left) {
                 pcx_conversation_remove_player(player->conversation,
                                                player->player_num);
         }
 
+        if (playerbase->player_removed_cb) {
+                playerbase->player_removed_cb(player,
+                                              playerbase->
+                                              player_removed_cb_user_data);
+        }
+
         pcx_player_free(player);
 
         playerbase->n_players--;
@@ -97,6 +223,11 @@ gc_cb(struct pcx_main_context_source *source,
                 }
         }
 
+        /* Release the memory from the table if a lot of players have
+         * left.
+         */
+        maybe_shrink_hash_table(playerbase);
+
         if (playerbase->n_players > 0)
                 queue_gc_source(playerbase);
 }
@@ -123,20 +254,19 @@ pcx_playerbase_new(void)
 
         pcx_list_init(&playerbase->players);
 
-        playerbase->hash_size = 8;
-        playerbase->hash_table = pcx_calloc(playerbase->hash_size *
-                                            sizeof *playerbase->hash_table);
+        playerbase->hash_table.size = MIN_HASH_SIZE;
+        playerbase->hash_table.buckets =
+                pcx_calloc(playerbase->hash_table.size *
+                           sizeof *playerbase->hash_table.buckets);
 
         return playerbase;
 }
 
-struct pcx_player *
-pcx_playerbase_get_player_by_id(struct pcx_playerbase *playerbase,
-                                uint64_t id)
+static struct pcx_player *
+find_in_table(const struct pcx_playerbase_hash_table *table,
+              uint64_t id)
 {
-        int pos = get_hash_pos(playerbase, id);
-
-        for (struct pcx_player *player = playerbase->hash_table[pos];
+        for (struct pcx_player *player = *get_bucket(table, id);
              player;
              player = player->hash_next) {
                 if (player->id == id)
@@ -146,31 +276,39 @@ pcx_playerbase_get_player_by_id(struct pcx_playerbase *playerbase,
         return NULL;
 }
 
-static void
-add_player_to_hash(struct pcx_playerbase *playerbase,
-                   struct pcx_player *player)
+struct pcx_player *
+pcx_playerbase_get_player_by_id(struct pcx_playerbase *playerbase,
+                                uint64_t id)
 {
-        int pos = get_hash_pos(playerbase, player->id);
+        rehash_step(playerbase, REHASH_STEP);
+
+        struct pcx_player *player = find_in_table(&playerbase->hash_table, id);
+
+        if (player == NULL && playerbase->old_hash_table.buckets)
+                player = find_in_table(&playerbase->old_hash_table, id);
 
-        player->hash_next = playerbase->hash_table[pos];
-        playerbase->hash_table[pos] = player;
+        return player;
 }
 
 static void
-grow_hash_table(struct pcx_playerbase *playerbase)
+prepare_add_player(struct pcx_playerbase *playerbase)
 {
-        pcx_free(playerbase->hash_table);
+        rehash_step(playerbase, REHASH_STEP);
 
-        playerbase->hash_size *= 2;
+        if ((playerbase->n_players + 1) > playerbase->hash_table.size * 3 / 4)
+                start_resize(playerbase, playerbase->hash_table.size * 2);
+}
 
-        playerbase->hash_table = pcx_calloc(playerbase->hash_size *
-                                            sizeof *playerbase->hash_table);
+static void
+insert_player(struct pcx_playerbase *playerbase,
+              struct pcx_player *player)
+{
+        pcx_list_insert(playerbase->players.prev, &player->link);
+        add_player_to_table(&playerbase->hash_table, player);
 
-        struct pcx_player *player;
+        playerbase->n_players++;
 
-        pcx_list_for_each(player, &playerbase->players, link) {
-                add_player_to_hash(playerbase, player);
-        }
+        queue_gc_source(playerbase);
 }
 
 struct pcx_player *
@@ -179,27 +317,255 @@ pcx_playerbase_add_player(struct pcx_playerbase *playerbase,
                           const char *name,
                           uint64_t id)
 {
-        if ((playerbase->n_players + 1) > playerbase->hash_size * 3 / 4)
-                grow_hash_table(playerbase);
+        prepare_add_player(playerbase);
 
         struct pcx_player *player = pcx_player_new(id, conversation, name);
 
-        pcx_list_insert(playerbase->players.prev, &player->link);
-        add_player_to_hash(playerbase, player);
-
-        playerbase->n_players++;
-
-        queue_gc_source(playerbase);
+        insert_player(playerbase, player);
 
         return player;
 }
 
+void
+pcx_playerbase_set_player_removed_cb(struct pcx_playerbase *playerbase,
+                                     pcx_playerbase_player_removed_cb cb,
+                                     void *user_data)
+{
+        playerbase->player_removed_cb = cb;
+        playerbase->player_removed_cb_user_data = user_data;
+}
+
 int
 pcx_playerbase_get_n_players(struct pcx_playerbase *playerbase)
 {
         return playerbase->n_players;
 }
 
+void
+pcx_playerbase_foreach_player(struct pcx_playerbase *playerbase,
+                              pcx_playerbase_foreach_cb cb,
+                              void *user_data)
+{
+        struct pcx_player *player;
+
+        pcx_list_for_each(player, &playerbase->players, link) {
+                if (!cb(player, user_data))
+                        break;
+        }
+}
+
+int
+pcx_playerbase_get_n_unsaveable_players(struct pcx_playerbase *playerbase)
+{
+        struct pcx_player *player;
+        int n_players = 0;
+
+        pcx_list_for_each(player, &playerbase->players, link) {
+                if (!pcx_conversation_can_save(player->conversation))
+                        n_players++;
+        }
+
+        return n_players;
+}
+
+static int
+compare_player_conversation(const void *a,
+                            const void *b)
+{
+        uintptr_t conv_a =
+                (uintptr_t) (*(struct pcx_player * const *) a)->conversation;
+        uintptr_t conv_b =
+                (uintptr_t) (*(struct pcx_player * const *) b)->conversation;
+
+        return conv_a < conv_b ? -1 : conv_a > conv_b ? 1 : 0;
+}
+
+static int
+get_conversation_end(struct pcx_player * const *players,
+                     int n_players,
+                     int start)
+{
+        int end = start + 1;
+
+        while (end < n_players &&
+               players[end]->conversation == players[start]->conversation)
+                end++;
+
+        return end;
+}
+
+void
+pcx_playerbase_save(struct pcx_playerbase *playerbase,
+                    struct pcx_buffer *buf,
+                    uint64_t max_cache_age)
+{
+        struct pcx_player **players =
+                pcx_alloc(MAX(playerbase->n_players, 1) * sizeof *players);
+        int n_players = 0;
+        struct pcx_player *player;
+
+        pcx_list_for_each(player, &playerbase->players, link) {
+                if (pcx_conversation_can_save(player->conversation))
+                        players[n_players++] = player;
+        }
+
+        /* Group the players by conversation */
+        qsort(players, n_players, sizeof *players, compare_player_conversation);
+
+        int n_conversations = 0;
+
+        for (int start = 0;
+             start < n_players;
+             start = get_conversation_end(players, n_players, start))
+                n_conversations++;
+
+        pcx_snapshot_write_int(buf, n_conversations);
+
+        /* Each conversation is stored with its length so that one
+         * that can’t be restored can be skipped.
+         */
+        struct pcx_buffer conv_buf = PCX_BUFFER_STATIC_INIT;
+
+        for (int start = 0, end; start < n_players; start = end) {
+                end = get_conversation_end(players, n_players, start);
+
+                struct pcx_conversation *conv = players[start]->conversation;
+
+                pcx_buffer_set_length(&conv_buf, 0);
+
+                if (max_cache_age > 0) {
+                        pcx_conversation_save_cached(conv,
+                                                     &conv_buf,
+                                                     max_cache_age);
+                } else {
+                        pcx_conversation_save(conv, &conv_buf);
+                }
+
+                pcx_snapshot_write_int(&conv_buf, end - start);
+
+                for (int i = start; i < end; i++) {
+                        pcx_snapshot_write_uint64(&conv_buf, players[i]->id);
+                        pcx_snapshot_write_int(&conv_buf,
+                                               players[i]->player_num);
+                        pcx_snapshot_write_bool(&conv_buf,
+                                                players[i]->has_left);
+                }
+
+                pcx_snapshot_write_data(buf, conv_buf.data, conv_buf.length);
+        }
+
+        pcx_buffer_destroy(&conv_buf);
+        pcx_free(players);
+}
+
+struct restored_player {
+        uint64_t id;
+        int player_num;
+        bool has_left;
+};
+
+static bool
+restore_conversation(struct pcx_playerbase *playerbase,
+                     const struct pcx_config *config,
+                     struct pcx_class_store *class_store,
+                     const struct pcx_game * const *game_list,
+                     struct pcx_snapshot_reader *reader,
+                     pcx_playerbase_restore_cb restore_cb,
+                     void *user_data)
+{
+        struct pcx_conversation *conv =
+                pcx_conversation_restore(config,
+                                         class_store,
+                                         game_list,
+                                         reader);
+
+        if (conv == NULL)
+                return false;
+
+        int n_players = pcx_snapshot_read_int_range(reader,
+                                                    0,
+                                                    conv->n_players);
+        struct restored_player *players =
+                pcx_alloc(MAX(n_players, 1) * sizeof *players);
+
+        /* Read all of the players before adding any of them so that
+         * invalid data doesn’t leave half of them behind.
+         */
+        for (int i = 0; i < n_players; i++) {
+                players[i].id = pcx_snapshot_read_uint64(reader);
+                players[i].player_num =
+                        pcx_snapshot_read_int_range(reader,
+                                                    0,
+                                                    conv->n_players - 1);
+                players[i].has_left = pcx_snapshot_read_bool(reader);
+        }
+
+        bool ret = !reader->error && n_players > 0;
+
+        if (ret) {
+                for (int i = 0; i < n_players; i++) {
+                        if (pcx_playerbase_get_player_by_id(playerbase,
+                                                            players[i].id))
+                                continue;
+
+                        prepare_add_player(playerbase);
+
+                        struct pcx_player *player =
+                                pcx_player_new_restored(players[i].id,
+                                                        conv,
+                                                        players[i].player_num,
+                                                        players[i].has_left);
+
+                        insert_player(playerbase, player);
+                }
+
+                restore_cb(conv, user_data);
+        }
+
+        pcx_free(players);
+
+        /* The players now hold the references */
+        pcx_conversation_unref(conv);
+
+        return ret;
+}
+
+int
+pcx_playerbase_restore(struct pcx_playerbase *playerbase,
+                       const struct pcx_config *config,
+                       struct pcx_class_store *class_store,
+                       const struct pcx_game * const *game_list,
+                       struct pcx_snapshot_reader *reader,
+                       pcx_playerbase_restore_cb restore_cb,
+                       void *user_data)
+{
+        int n_conversations = pcx_snapshot_read_int_range(reader, 0, INT_MAX);
+        int n_restored = 0;
+
+        for (int i = 0; i < n_conversations; i++) {
+                size_t length;
+                const uint8_t *data = pcx_snapshot_read_data(reader, &length);
+
+                if (data == NULL)
+                        break;
+
+                struct pcx_snapshot_reader conv_reader;
+
+                pcx_snapshot_reader_init(&conv_reader, data, length);
+
+                if (restore_conversation(playerbase,
+                                         config,
+                                         class_store,
+                                         game_list,
+                                         &conv_reader,
+                                         restore_cb,
+                                         user_data))
+                        n_restored++;
+        }
+
+        return n_restored;
+}
+
 void
 pcx_playerbase_free(struct pcx_playerbase *playerbase)
 {
@@ -209,7 +575,8 @@ pcx_playerbase_free(struct pcx_playerbase *playerbase)
                 pcx_player_free(player);
         }
 
-        pcx_free(playerbase->hash_table);
+        pcx_free(playerbase->hash_table.buckets);
+        pcx_free(playerbase->old_hash_table.buckets);
 
         if (playerbase->gc_source)
                 pcx_main_context_remove_source(playerbase->gc_source);
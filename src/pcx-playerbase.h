@@ -37,9 +37,71 @@ pcx_playerbase_add_player(struct pcx_playerbase *playerbase,
                           const char *name,
                           uint64_t id);
 
+/* Called just before a player is garbage collected. It isn’t called
+ * for the players that are still there when the playerbase is freed.
+ */
+typedef void
+(* pcx_playerbase_player_removed_cb)(struct pcx_player *player,
+                                     void *user_data);
+
+void
+pcx_playerbase_set_player_removed_cb(struct pcx_playerbase *playerbase,
+                                     pcx_playerbase_player_removed_cb cb,
+                                     void *user_data);
+
 int
 pcx_playerbase_get_n_players(struct pcx_playerbase *playerbase);
 
+typedef bool
+(* pcx_playerbase_foreach_cb)(struct pcx_player *player,
+                              void *user_data);
+
+/* Calls the callback for each player in the order they were added
+ * until it returns false. The callback must not add or remove any
+ * players.
+ */
+void
+pcx_playerbase_foreach_player(struct pcx_playerbase *playerbase,
+                              pcx_playerbase_foreach_cb cb,
+                              void *user_data);
+
+/* Returns the number of players that would lose their game if the
+ * server was restarted.
+ */
+int
+pcx_playerbase_get_n_unsaveable_players(struct pcx_playerbase *playerbase);
+
+/* Appends every conversation that can be saved to buf along with
+ * the IDs of its players so that the clients can reconnect to them
+ * after a restart. If max_cache_age isn’t zero then the conversations
+ * are saved with pcx_conversation_save_cached using it as the
+ * maximum age.
+ */
+void
+pcx_playerbase_save(struct pcx_playerbase *playerbase,
+                    struct pcx_buffer *buf,
+                    uint64_t max_cache_age);
+
+/* Called for each conversation that is restored. The players hold
+ * the only references on the conversation.
+ */
+typedef void
+(* pcx_playerbase_restore_cb)(struct pcx_conversation *conv,
+                              void *user_data);
+
+/* Recreates the conversations and players saved with
+ * pcx_playerbase_save. Conversations that can’t be restored are
+ * skipped. Returns the number of conversations restored.
+ */
+int
+pcx_playerbase_restore(struct pcx_playerbase *playerbase,
+                       const struct pcx_config *config,
+                       struct pcx_class_store *class_store,
+                       const struct pcx_game * const *game_list,
+                       struct pcx_snapshot_reader *reader,
+                       pcx_playerbase_restore_cb restore_cb,
+                       void *user_data);
+
 void
 pcx_playerbase_free(struct pcx_playerbase *playerbase);
 
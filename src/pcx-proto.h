@@ -51,6 +51,9 @@
 #define PCX_PROTO_LEAVE 0x84
 #define PCX_PROTO_SEND_MESSAGE 0x85
 #define PCX_PROTO_CLIENT_SIDEBAND 0x88
+#define PCX_PROTO_SPECTATE 0x89
+#define PCX_PROTO_LOBBY_SUBSCRIBE 0x8a
+#define PCX_PROTO_JOIN_LOBBY_GAME 0x8b
 
 #define PCX_PROTO_PLAYER_ID 0x00
 #define PCX_PROTO_PLAYER_NUM 0x07
@@ -60,6 +63,13 @@
 #define PCX_PROTO_PRIVATE_GAME_NOT_FOUND 0x04
 #define PCX_PROTO_PLAYER_NAME 0x05
 #define PCX_PROTO_SIDEBAND 0x06
+#define PCX_PROTO_MESSAGES_DROPPED 0x08
+#define PCX_PROTO_SIDEBAND_ARRAY 0x09
+#define PCX_PROTO_SPECTATE_ID 0x0a
+#define PCX_PROTO_LOBBY_RESET 0x0b
+#define PCX_PROTO_LOBBY_GAME 0x0c
+#define PCX_PROTO_LOBBY_GAME_REMOVED 0x0d
+#define PCX_PROTO_SERVER_FULL 0x0e
 
 enum pcx_proto_type {
         PCX_PROTO_TYPE_UINT8,
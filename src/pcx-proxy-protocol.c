@@ -0,0 +1,369 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "pcx-proxy-protocol.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <arpa/inet.h>
+
+#include "pcx-util.h"
+
+/* Including the CRLF */
+#define V1_MAX_LENGTH 107
+#define V1_MAX_FIELDS 6
+
+/* The signature and the fixed fields before the addresses */
+#define V2_HEADER_LENGTH 16
+
+#define V2_COMMAND_LOCAL 0
+#define V2_COMMAND_PROXY 1
+
+#define V2_FAMILY_UNSPEC 0
+#define V2_FAMILY_INET 1
+#define V2_FAMILY_INET6 2
+
+#define V2_PROTOCOL_UNSPEC 0
+#define V2_PROTOCOL_STREAM 1
+
+struct pcx_error_domain
+pcx_proxy_protocol_error;
+
+static const char
+v1_prefix[] = "PROXY ";
+
+static const uint8_t
+v2_signature[] = {
+        0x0d, 0x0a, 0x0d, 0x0a, 0x00, 0x0d, 0x0a, 0x51, 0x55, 0x49, 0x54, 0x0a
+};
+
+static bool
+has_prefix(const uint8_t *data,
+           size_t length,
+           const void *prefix,
+           size_t prefix_length)
+{
+        return !memcmp(data, prefix, MIN(length, prefix_length));
+}
+
+static void
+set_invalid_error(struct pcx_error **error,
+                  const char *message)
+{
+        pcx_set_error(error,
+                      &pcx_proxy_protocol_error,
+                      PCX_PROXY_PROTOCOL_ERROR_INVALID,
+                      "%s",
+                      message);
+}
+
+static bool
+parse_port(const char *str,
+           uint16_t *port)
+{
+        if (*str < '0' || *str > '9')
+                return false;
+
+        char *tail;
+        unsigned long value = strtoul(str, &tail, 10);
+
+        if (*tail || value > UINT16_MAX)
+                return false;
+
+        *port = value;
+
+        return true;
+}
+
+static int
+split_fields(char *line,
+             char **fields)
+{
+        int n_fields = 0;
+
+        while (n_fields < V1_MAX_FIELDS) {
+                fields[n_fields++] = line;
+
+                char *space = strchr(line, ' ');
+
+                if (space == NULL)
+                        return n_fields;
+
+                *space = '\0';
+                line = space + 1;
+        }
+
+        /* Too many fields */
+        return -1;
+}
+
+static bool
+parse_v1_address(char **fields,
+                 int n_fields,
+                 struct pcx_netaddress *address)
+{
+        if (!strcmp(fields[0], "UNKNOWN"))
+                return true;
+
+        if (n_fields != 5)
+                return false;
+
+        if (!strcmp(fields[0], "TCP4")) {
+                address->family = AF_INET;
+                if (inet_pton(AF_INET, fields[1], &address->ipv4) != 1)
+                        return false;
+        } else if (!strcmp(fields[0], "TCP6")) {
+                address->family = AF_INET6;
+                if (inet_pton(AF_INET6, fields[1], &address->ipv6) != 1)
+                        return false;
+        } else {
+                return false;
+        }
+
+        uint16_t destination_port;
+
+        return (parse_port(fields[3], &address->port) &&
+                parse_port(fields[4], &destination_port));
+}
+
+static enum pcx_proxy_protocol_result
+parse_v1(const uint8_t *data,
+         size_t length,
+         struct pcx_netaddress *address,
+         size_t *header_length,
+         struct pcx_error **error)
+{
+        if (!has_prefix(data, length, v1_prefix, sizeof v1_prefix - 1)) {
+                set_invalid_error(error, "Invalid PROXY protocol header");
+                return PCX_PROXY_PROTOCOL_RESULT_ERROR;
+        }
+
+        const uint8_t *end = memchr(data, '\n', MIN(length, V1_MAX_LENGTH));
+
+        if (end == NULL) {
+                if (length < V1_MAX_LENGTH)
+                        return PCX_PROXY_PROTOCOL_RESULT_NEED_MORE_DATA;
+
+                set_invalid_error(error, "PROXY protocol header is too long");
+                return PCX_PROXY_PROTOCOL_RESULT_ERROR;
+        }
+
+        size_t line_length = end - data;
+
+        if (line_length < sizeof v1_prefix || end[-1] != '\r') {
+                set_invalid_error(error, "Invalid PROXY protocol header");
+                return PCX_PROXY_PROTOCOL_RESULT_ERROR;
+        }
+
+        char line[V1_MAX_LENGTH];
+        char *fields[V1_MAX_FIELDS];
+
+        /* Skip the prefix and the CR */
+        line_length -= sizeof v1_prefix;
+        memcpy(line, data + sizeof v1_prefix - 1, line_length);
+        line[line_length] = '\0';
+
+        int n_fields = split_fields(line, fields);
+
+        if (n_fields == -1 ||
+            !parse_v1_address(fields, n_fields, address)) {
+                set_invalid_error(error, "Invalid PROXY protocol header");
+                return PCX_PROXY_PROTOCOL_RESULT_ERROR;
+        }
+
+        *header_length = end + 1 - data;
+
+        return PCX_PROXY_PROTOCOL_RESULT_FINISHED;
+}
+
+static void
+parse_v2_address(int family,
+                 const uint8_t *addresses,
+                 size_t length,
+                 struct pcx_netaddress *address)
+{
+        switch (family) {
+        case V2_FAMILY_INET:
+                /* Source and destination address and then the ports */
+                if (length < 4 * 2 + 2 * 2)
+                        return;
+                address->family = AF_INET;
+                memcpy(&address->ipv4, addresses, 4);
+                addresses += 4 * 2;
+                break;
+
+        case V2_FAMILY_INET6:
+                if (length < 16 * 2 + 2 * 2)
+                        return;
+                address->family = AF_INET6;
+                memcpy(&address->ipv6, addresses, 16);
+                addresses += 16 * 2;
+                break;
+
+        default:
+                /* Unix sockets etc don’t have a useful address */
+                return;
+        }
+
+        address->port = (addresses[0] << 8) | addresses[1];
+}
+
+static enum pcx_proxy_protocol_result
+parse_v2(const uint8_t *data,
+         size_t length,
+         struct pcx_netaddress *address,
+         size_t *header_length,
+         struct pcx_error **error)
+{
+        if (!has_prefix(data, length, v2_signature, sizeof v2_signature)) {
+                set_invalid_error(error, "Invalid PROXY protocol header");
+                return PCX_PROXY_PROTOCOL_RESULT_ERROR;
+        }
+
+        if (length < V2_HEADER_LENGTH)
+                return PCX_PROXY_PROTOCOL_RESULT_NEED_MORE_DATA;
+
+        int version = data[12] >> 4;
+        int command = data[12] & 0xf;
+        int family = data[13] >> 4;
+        size_t addresses_length = (data[14] << 8) | data[15];
+        size_t total_length = V2_HEADER_LENGTH + addresses_length;
+
+        if (version != 2) {
+                set_invalid_error(error,
+                                  "Unsupported PROXY protocol version");
+                return PCX_PROXY_PROTOCOL_RESULT_ERROR;
+        }
+
+        if (command != V2_COMMAND_LOCAL && command != V2_COMMAND_PROXY) {
+                set_invalid_error(error,
+                                  "Unknown command in PROXY protocol header");
+                return PCX_PROXY_PROTOCOL_RESULT_ERROR;
+        }
+
+        if (total_length > PCX_PROXY_PROTOCOL_MAX_HEADER_LENGTH) {
+                set_invalid_error(error, "PROXY protocol header is too long");
+                return PCX_PROXY_PROTOCOL_RESULT_ERROR;
+        }
+
+        if (length < total_length)
+                return PCX_PROXY_PROTOCOL_RESULT_NEED_MORE_DATA;
+
+        /* A local connection is from the proxy itself so the real
+         * address of the socket should be used.
+         */
+        if (command == V2_COMMAND_PROXY) {
+                parse_v2_address(family,
+                                 data + V2_HEADER_LENGTH,
+                                 addresses_length,
+                                 address);
+        }
+
+        *header_length = total_length;
+
+        return PCX_PROXY_PROTOCOL_RESULT_FINISHED;
+}
+
+enum pcx_proxy_protocol_result
+pcx_proxy_protocol_parse(const uint8_t *data,
+                         size_t length,
+                         struct pcx_netaddress *address,
+                         size_t *header_length,
+                         struct pcx_error **error)
+{
+        memset(address, 0, sizeof *address);
+        address->family = AF_UNSPEC;
+
+        if (length == 0)
+                return PCX_PROXY_PROTOCOL_RESULT_NEED_MORE_DATA;
+
+        if (data[0] == v1_prefix[0])
+                return parse_v1(data, length, address, header_length, error);
+        else
+                return parse_v2(data, length, address, header_length, error);
+}
+
+static void
+write_v2_port(struct pcx_buffer *buf,
+              uint16_t port)
+{
+        uint8_t bytes[] = { port >> 8, port & 0xff };
+
+        pcx_buffer_append(buf, bytes, sizeof bytes);
+}
+
+void
+pcx_proxy_protocol_write_v2(struct pcx_buffer *buf,
+                            const struct pcx_netaddress *source,
+                            const struct pcx_netaddress *destination)
+{
+        int command = V2_COMMAND_PROXY;
+        const void *source_address = NULL, *destination_address = NULL;
+        int family, address_size;
+
+        if (source->family != destination->family)
+                family = V2_FAMILY_UNSPEC;
+        else if (source->family == AF_INET)
+                family = V2_FAMILY_INET;
+        else if (source->family == AF_INET6)
+                family = V2_FAMILY_INET6;
+        else
+                family = V2_FAMILY_UNSPEC;
+
+        switch (family) {
+        case V2_FAMILY_INET:
+                source_address = &source->ipv4;
+                destination_address = &destination->ipv4;
+                address_size = sizeof source->ipv4;
+                break;
+        case V2_FAMILY_INET6:
+                source_address = &source->ipv6;
+                destination_address = &destination->ipv6;
+                address_size = sizeof source->ipv6;
+                break;
+        default:
+                command = V2_COMMAND_LOCAL;
+                address_size = 0;
+                break;
+        }
+
+        size_t addresses_length = address_size == 0 ? 0 : address_size * 2 + 4;
+        uint8_t fixed[] = {
+                (2 << 4) | command,
+                (family << 4) |
+                (family == V2_FAMILY_UNSPEC ?
+                 V2_PROTOCOL_UNSPEC :
+                 V2_PROTOCOL_STREAM),
+                addresses_length >> 8,
+                addresses_length & 0xff,
+        };
+
+        pcx_buffer_append(buf, v2_signature, sizeof v2_signature);
+        pcx_buffer_append(buf, fixed, sizeof fixed);
+
+        if (address_size == 0)
+                return;
+
+        /* Both addresses are already in network byte order */
+        pcx_buffer_append(buf, source_address, address_size);
+        pcx_buffer_append(buf, destination_address, address_size);
+        write_v2_port(buf, source->port);
+        write_v2_port(buf, destination->port);
+}
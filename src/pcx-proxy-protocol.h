@@ -0,0 +1,80 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PCX_PROXY_PROTOCOL_H
+#define PCX_PROXY_PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "pcx-error.h"
+#include "pcx-netaddress.h"
+#include "pcx-buffer.h"
+
+/* Parser for the header that HAProxy and other load balancers send at
+ * the start of a connection to say where the client is really
+ * connecting from. Both the text version 1 and the binary version 2
+ * are supported. The router writes version 2 headers for the servers
+ * behind it.
+ */
+
+/* Longer headers are rejected. Version 1 headers can’t be longer than
+ * 107 bytes but version 2 headers can have extra fields that aren’t
+ * used here.
+ */
+#define PCX_PROXY_PROTOCOL_MAX_HEADER_LENGTH 1024
+
+extern struct pcx_error_domain
+pcx_proxy_protocol_error;
+
+enum pcx_proxy_protocol_error {
+        PCX_PROXY_PROTOCOL_ERROR_INVALID,
+};
+
+enum pcx_proxy_protocol_result {
+        PCX_PROXY_PROTOCOL_RESULT_NEED_MORE_DATA,
+        PCX_PROXY_PROTOCOL_RESULT_FINISHED,
+        PCX_PROXY_PROTOCOL_RESULT_ERROR
+};
+
+/* Parses the header at the start of the data. If the result is
+ * FINISHED then *header_length is set to the length of the header and
+ * address is set to the source address. If the header doesn’t have an
+ * address, for example because it is a health check from the proxy
+ * itself, then the family is set to AF_UNSPEC. If more data is needed
+ * then all of the given data is part of the header so the caller can
+ * consume it without reading past the end.
+ */
+enum pcx_proxy_protocol_result
+pcx_proxy_protocol_parse(const uint8_t *data,
+                         size_t length,
+                         struct pcx_netaddress *address,
+                         size_t *header_length,
+                         struct pcx_error **error);
+
+/* Appends a version 2 header for a TCP connection from source to
+ * destination. If either address is unknown or they aren’t the same
+ * family then a LOCAL header is written instead so that the receiver
+ * uses the address of the socket.
+ */
+void
+pcx_proxy_protocol_write_v2(struct pcx_buffer *buf,
+                            const struct pcx_netaddress *source,
+                            const struct pcx_netaddress *destination);
+
+#endif /* PCX_PROXY_PROTOCOL_H */
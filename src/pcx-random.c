@@ -0,0 +1,236 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "pcx-random.h"
+
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#ifdef HAVE_GETRANDOM
+#include <sys/random.h>
+#endif
+
+#include "pcx-chacha20.h"
+#include "pcx-util.h"
+
+/* Number of ChaCha20 blocks to generate whenever the buffer runs out */
+#define N_BUFFER_BLOCKS 16
+
+/* Number of bytes to generate before mixing in a new seed from the
+ * kernel.
+ */
+#define RESEED_INTERVAL (1024 * 1024)
+
+struct pcx_random_state {
+        bool seeded;
+        uint8_t key[PCX_CHACHA20_KEY_SIZE];
+        uint8_t buffer[N_BUFFER_BLOCKS * PCX_CHACHA20_BLOCK_SIZE];
+        /* Number of bytes at the start of the buffer that have
+         * already been used. They are zeroed as soon as they are
+         * consumed.
+         */
+        size_t buffer_pos;
+        size_t bytes_since_seed;
+};
+
+static _Thread_local struct pcx_random_state
+random_state = {
+        .seeded = false,
+};
+
+static pthread_once_t
+atfork_once = PTHREAD_ONCE_INIT;
+
+static void
+atfork_child_cb(void)
+{
+        /* The child would otherwise continue the same stream as the
+         * parent. Only the thread that called fork exists in the
+         * child so this is the only state that needs resetting.
+         */
+        random_state.seeded = false;
+}
+
+static void
+register_atfork(void)
+{
+        pthread_atfork(NULL, NULL, atfork_child_cb);
+}
+
+static size_t
+read_kernel_random(uint8_t *buf,
+                   size_t size)
+{
+        size_t got = 0;
+
+#ifdef HAVE_GETRANDOM
+        while (got < size) {
+                ssize_t ret = getrandom(buf + got, size - got, 0);
+
+                if (ret == -1) {
+                        if (errno == EINTR)
+                                continue;
+                        break;
+                }
+
+                got += ret;
+        }
+
+        if (got >= size)
+                return got;
+#endif
+
+        int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+
+        if (fd == -1)
+                return got;
+
+        while (got < size) {
+                ssize_t ret = read(fd, buf + got, size - got);
+
+                if (ret == -1) {
+                        if (errno == EINTR)
+                                continue;
+                        break;
+                }
+
+                if (ret == 0)
+                        break;
+
+                got += ret;
+        }
+
+        pcx_close(fd);
+
+        return got;
+}
+
+static void
+seed(struct pcx_random_state *state)
+{
+        uint8_t seed_data[PCX_CHACHA20_KEY_SIZE];
+
+        size_t got = read_kernel_random(seed_data, sizeof seed_data);
+
+        if (got < sizeof seed_data) {
+                /* This shouldn’t happen on any reasonable system but
+                 * rather than failing, mix in what we can. The stream
+                 * is still unpredictable to anyone who can’t guess
+                 * the time and the previous state.
+                 */
+                pcx_warning("Failed to get random data from the kernel");
+
+                struct timespec ts;
+                clock_gettime(CLOCK_REALTIME, &ts);
+
+                uint32_t extra[] = {
+                        ts.tv_sec, ts.tv_nsec, getpid(), rand(), rand(),
+                };
+
+                for (size_t i = got; i < sizeof seed_data; i++) {
+                        seed_data[i] = ((const uint8_t *) extra)
+                                [(i - got) % sizeof extra];
+                }
+        }
+
+        /* XOR the seed in so that a bad seed can’t make the state
+         * any worse than it was.
+         */
+        for (size_t i = 0; i < sizeof seed_data; i++)
+                state->key[i] ^= seed_data[i];
+
+        memset(seed_data, 0, sizeof seed_data);
+
+        /* Throw away anything generated from the old key */
+        memset(state->buffer, 0, sizeof state->buffer);
+        state->buffer_pos = sizeof state->buffer;
+
+        state->bytes_since_seed = 0;
+        state->seeded = true;
+}
+
+static void
+refill(struct pcx_random_state *state)
+{
+        static const uint8_t nonce[PCX_CHACHA20_NONCE_SIZE] = { 0 };
+
+        if (!state->seeded || state->bytes_since_seed >= RESEED_INTERVAL) {
+                pthread_once(&atfork_once, register_atfork);
+                seed(state);
+        }
+
+        for (unsigned i = 0; i < N_BUFFER_BLOCKS; i++) {
+                pcx_chacha20_block(state->key,
+                                   i,
+                                   nonce,
+                                   state->buffer +
+                                   i * PCX_CHACHA20_BLOCK_SIZE);
+        }
+
+        /* Use the start of the keystream as the next key and erase
+         * it so that the previous output can’t be reconstructed.
+         */
+        memcpy(state->key, state->buffer, sizeof state->key);
+        memset(state->buffer, 0, sizeof state->key);
+        state->buffer_pos = sizeof state->key;
+}
+
+void
+pcx_random_fill(void *buf,
+                size_t size)
+{
+        struct pcx_random_state *state = &random_state;
+        uint8_t *p = buf;
+
+        if (!state->seeded)
+                refill(state);
+
+        while (size > 0) {
+                if (state->buffer_pos >= sizeof state->buffer)
+                        refill(state);
+
+                size_t to_copy = MIN(size,
+                                     sizeof state->buffer -
+                                     state->buffer_pos);
+
+                memcpy(p, state->buffer + state->buffer_pos, to_copy);
+                memset(state->buffer + state->buffer_pos, 0, to_copy);
+
+                state->buffer_pos += to_copy;
+                state->bytes_since_seed += to_copy;
+                p += to_copy;
+                size -= to_copy;
+        }
+}
+
+uint64_t
+pcx_random_uint64(void)
+{
+        uint64_t value;
+
+        pcx_random_fill(&value, sizeof value);
+
+        return value;
+}
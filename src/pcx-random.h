@@ -0,0 +1,41 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PCX_RANDOM_H
+#define PCX_RANDOM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Cryptographically secure random numbers. Each thread has its own
+ * ChaCha20 keystream that is seeded from the kernel and then
+ * generated several blocks at a time so that most calls don’t need
+ * any system calls. The key is replaced with part of the keystream on
+ * each refill so that earlier output can’t be recovered from the
+ * state. The stream is reseeded periodically and in the child after a
+ * fork.
+ */
+
+void
+pcx_random_fill(void *buf,
+                size_t size);
+
+uint64_t
+pcx_random_uint64(void);
+
+#endif /* PCX_RANDOM_H */
@@ -0,0 +1,226 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "pcx-rate-limit.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "pcx-util.h"
+#include "pcx-main-context.h"
+
+/* The bucket level is stored as the number of microseconds worth of
+ * refilling that it contains. That way it can be updated using only
+ * integer arithmetic. Taking a token removes token_time from the
+ * level.
+ */
+
+struct pcx_rate_limit_bucket {
+        struct pcx_rate_limit_bucket *hash_next;
+
+        short int family;
+        uint64_t key;
+
+        uint64_t level;
+        uint64_t last_update_time;
+};
+
+struct pcx_rate_limit {
+        uint64_t token_time;
+        uint64_t capacity;
+
+        int n_buckets;
+        int hash_size;
+        struct pcx_rate_limit_bucket **hash_table;
+};
+
+struct pcx_rate_limit *
+pcx_rate_limit_new(int64_t rate,
+                   int64_t burst)
+{
+        assert(rate > 0 && burst > 0);
+
+        struct pcx_rate_limit *limit = pcx_calloc(sizeof *limit);
+
+        limit->token_time = MAX((uint64_t) 60 * 1000000 / rate, 1);
+        limit->capacity = limit->token_time * burst;
+
+        limit->hash_size = 8;
+        limit->hash_table = pcx_calloc(limit->hash_size *
+                                       sizeof *limit->hash_table);
+
+        return limit;
+}
+
+static int
+get_hash_pos(struct pcx_rate_limit *limit,
+             uint64_t key)
+{
+        return pcx_hash_uint64(key) & (limit->hash_size - 1);
+}
+
+static void
+add_bucket_to_hash(struct pcx_rate_limit *limit,
+                   struct pcx_rate_limit_bucket *bucket)
+{
+        int pos = get_hash_pos(limit, bucket->key);
+
+        bucket->hash_next = limit->hash_table[pos];
+        limit->hash_table[pos] = bucket;
+}
+
+static void
+resize_hash_table(struct pcx_rate_limit *limit,
+                  int new_size)
+{
+        struct pcx_rate_limit_bucket **old_table = limit->hash_table;
+        int old_size = limit->hash_size;
+
+        limit->hash_size = new_size;
+        limit->hash_table = pcx_calloc(new_size * sizeof *limit->hash_table);
+
+        for (int i = 0; i < old_size; i++) {
+                struct pcx_rate_limit_bucket *bucket, *next;
+
+                for (bucket = old_table[i]; bucket; bucket = next) {
+                        next = bucket->hash_next;
+                        add_bucket_to_hash(limit, bucket);
+                }
+        }
+
+        pcx_free(old_table);
+}
+
+static struct pcx_rate_limit_bucket *
+get_bucket(struct pcx_rate_limit *limit,
+           const struct pcx_netaddress *address,
+           uint64_t now)
+{
+        uint64_t key = pcx_netaddress_get_client_key(address);
+        int pos = get_hash_pos(limit, key);
+
+        for (struct pcx_rate_limit_bucket *bucket = limit->hash_table[pos];
+             bucket;
+             bucket = bucket->hash_next) {
+                if (bucket->key == key && bucket->family == address->family)
+                        return bucket;
+        }
+
+        if (limit->n_buckets + 1 > limit->hash_size * 3 / 4)
+                resize_hash_table(limit, limit->hash_size * 2);
+
+        struct pcx_rate_limit_bucket *bucket = pcx_alloc(sizeof *bucket);
+
+        bucket->family = address->family;
+        bucket->key = key;
+        bucket->level = limit->capacity;
+        bucket->last_update_time = now;
+
+        add_bucket_to_hash(limit, bucket);
+
+        limit->n_buckets++;
+
+        return bucket;
+}
+
+static uint64_t
+get_current_level(struct pcx_rate_limit *limit,
+                  const struct pcx_rate_limit_bucket *bucket,
+                  uint64_t now)
+{
+        uint64_t elapsed = now - bucket->last_update_time;
+
+        if (elapsed >= limit->capacity - bucket->level)
+                return limit->capacity;
+
+        return bucket->level + elapsed;
+}
+
+bool
+pcx_rate_limit_take(struct pcx_rate_limit *limit,
+                    const struct pcx_netaddress *address)
+{
+        uint64_t now = pcx_main_context_get_monotonic_clock(NULL);
+        struct pcx_rate_limit_bucket *bucket =
+                get_bucket(limit, address, now);
+
+        bucket->level = get_current_level(limit, bucket, now);
+        bucket->last_update_time = now;
+
+        if (bucket->level < limit->token_time)
+                return false;
+
+        bucket->level -= limit->token_time;
+
+        return true;
+}
+
+void
+pcx_rate_limit_gc(struct pcx_rate_limit *limit)
+{
+        uint64_t now = pcx_main_context_get_monotonic_clock(NULL);
+
+        for (int i = 0; i < limit->hash_size; i++) {
+                struct pcx_rate_limit_bucket **prev = limit->hash_table + i;
+
+                while (*prev) {
+                        struct pcx_rate_limit_bucket *bucket = *prev;
+
+                        if (get_current_level(limit, bucket, now) >=
+                            limit->capacity) {
+                                *prev = bucket->hash_next;
+                                pcx_free(bucket);
+                                limit->n_buckets--;
+                        } else {
+                                prev = &bucket->hash_next;
+                        }
+                }
+        }
+
+        int new_size = limit->hash_size;
+
+        while (new_size > 8 && limit->n_buckets < new_size / 4)
+                new_size /= 2;
+
+        if (new_size != limit->hash_size)
+                resize_hash_table(limit, new_size);
+}
+
+int
+pcx_rate_limit_get_n_buckets(struct pcx_rate_limit *limit)
+{
+        return limit->n_buckets;
+}
+
+void
+pcx_rate_limit_free(struct pcx_rate_limit *limit)
+{
+        for (int i = 0; i < limit->hash_size; i++) {
+                struct pcx_rate_limit_bucket *bucket, *next;
+
+                for (bucket = limit->hash_table[i]; bucket; bucket = next) {
+                        next = bucket->hash_next;
+                        pcx_free(bucket);
+                }
+        }
+
+        pcx_free(limit->hash_table);
+        pcx_free(limit);
+}
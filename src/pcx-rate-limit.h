@@ -0,0 +1,59 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PCX_RATE_LIMIT_H
+#define PCX_RATE_LIMIT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "pcx-netaddress.h"
+
+/* A set of token buckets keyed on the remote IP address. Each address
+ * gets a bucket that can hold up to “burst” tokens and refills at
+ * “rate” tokens per minute. The port of the address is ignored and
+ * IPv6 addresses are grouped by their /64 prefix because a single
+ * client can usually pick any address within that.
+ */
+
+struct pcx_rate_limit;
+
+struct pcx_rate_limit *
+pcx_rate_limit_new(int64_t rate,
+                   int64_t burst);
+
+/* Tries to take a token from the bucket for the given address.
+ * Returns false if the bucket is empty.
+ */
+bool
+pcx_rate_limit_take(struct pcx_rate_limit *limit,
+                    const struct pcx_netaddress *address);
+
+/* Removes the buckets that have refilled completely so that they
+ * don’t use memory forever.
+ */
+void
+pcx_rate_limit_gc(struct pcx_rate_limit *limit);
+
+int
+pcx_rate_limit_get_n_buckets(struct pcx_rate_limit *limit);
+
+void
+pcx_rate_limit_free(struct pcx_rate_limit *limit);
+
+#endif /* PCX_RATE_LIMIT_H */
@@ -0,0 +1,570 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "pcx-replication.h"
+
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "pcx-util.h"
+#include "pcx-list.h"
+#include "pcx-log.h"
+#include "pcx-main-context.h"
+#include "pcx-socket.h"
+#include "pcx-listen-socket.h"
+
+/* Milliseconds to wait before trying to connect to the primary again */
+#define RECONNECT_DELAY 1000
+
+/* Longest time in milliseconds to wait before trying again when the
+ * state is too big to send.
+ */
+#define MAX_OVERSIZE_DELAY (5 * 60 * 1000)
+
+struct pcx_replication_primary {
+        int listen_sock;
+        struct pcx_main_context_source *listen_source;
+        struct pcx_main_context_source *timeout_source;
+        long interval;
+
+        pcx_replication_state_cb state_cb;
+        void *user_data;
+
+        struct pcx_list connections;
+
+        /* The last state that was built. It is only built again when
+         * it has changed or when it is getting old. The serial
+         * increases every time it is built so that each connection
+         * can tell whether it has already been sent.
+         */
+        struct pcx_buffer state_buf;
+        uint64_t state_serial;
+        uint64_t state_time;
+        bool state_dirty;
+
+        /* Set while the state is too big to send. The state isn’t
+         * built again until this timeout has passed, and the timeout
+         * is doubled each time it happens again.
+         */
+        bool state_too_big;
+        long oversize_delay;
+};
+
+struct pcx_replication_connection {
+        struct pcx_list link;
+        struct pcx_replication_primary *primary;
+        int sock;
+        struct pcx_main_context_source *source;
+
+        /* The snapshot that is being sent. This is empty if the
+         * connection is waiting for the next one.
+         */
+        struct pcx_buffer out_buf;
+        size_t out_pos;
+
+        /* The serial of the last state that was queued */
+        uint64_t state_serial;
+};
+
+struct pcx_replication_standby {
+        char *path;
+        int sock;
+        struct pcx_main_context_source *sock_source;
+        struct pcx_main_context_source *connect_source;
+
+        pcx_replication_lost_cb lost_cb;
+        void *user_data;
+
+        struct pcx_buffer in_buf;
+        struct pcx_buffer state;
+};
+
+static void
+free_connection(struct pcx_replication_connection *conn)
+{
+        pcx_main_context_remove_source(conn->source);
+        pcx_close(conn->sock);
+        pcx_buffer_destroy(&conn->out_buf);
+        pcx_list_remove(&conn->link);
+        pcx_free(conn);
+}
+
+static void
+write_connection(struct pcx_replication_connection *conn)
+{
+        ssize_t wrote = send(conn->sock,
+                             conn->out_buf.data + conn->out_pos,
+                             conn->out_buf.length - conn->out_pos,
+                             MSG_DONTWAIT | MSG_NOSIGNAL);
+
+        if (wrote == -1) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                        return;
+
+                pcx_log("Error sending to standby: %s", strerror(errno));
+                free_connection(conn);
+                return;
+        }
+
+        conn->out_pos += wrote;
+
+        if (conn->out_pos >= conn->out_buf.length) {
+                conn->out_buf.length = 0;
+                conn->out_pos = 0;
+                pcx_main_context_modify_poll(conn->source,
+                                             PCX_MAIN_CONTEXT_POLL_IN);
+        }
+}
+
+static void
+connection_cb(struct pcx_main_context_source *source,
+              int fd,
+              enum pcx_main_context_poll_flags flags,
+              void *user_data)
+{
+        struct pcx_replication_connection *conn = user_data;
+
+        if ((flags & PCX_MAIN_CONTEXT_POLL_OUT)) {
+                write_connection(conn);
+                return;
+        }
+
+        /* The standby never sends anything so this can only be EOF
+         * or an error.
+         */
+        uint8_t buf[128];
+        ssize_t got = read(conn->sock, buf, sizeof buf);
+
+        if (got == -1 && (errno == EAGAIN || errno == EINTR))
+                return;
+
+        pcx_log("Standby disconnected");
+        free_connection(conn);
+}
+
+static void
+queue_timeout(struct pcx_replication_primary *primary);
+
+static bool
+has_idle_connection(struct pcx_replication_primary *primary)
+{
+        struct pcx_replication_connection *conn;
+
+        pcx_list_for_each(conn, &primary->connections, link) {
+                /* Standbys that haven’t finished reading the last
+                 * snapshot yet are skipped.
+                 */
+                if (conn->out_buf.length == 0)
+                        return true;
+        }
+
+        return false;
+}
+
+static void
+update_state(struct pcx_replication_primary *primary)
+{
+        uint64_t now = pcx_main_context_get_monotonic_clock(NULL);
+
+        if (!primary->state_dirty &&
+            primary->state_serial > 0 &&
+            now - primary->state_time < PCX_REPLICATION_REFRESH_TIME)
+                return;
+
+        if (!has_idle_connection(primary))
+                return;
+
+        primary->state_buf.length = 0;
+        primary->state_cb(&primary->state_buf, primary->user_data);
+        primary->state_serial++;
+        primary->state_time = now;
+        primary->state_dirty = false;
+
+        if (primary->state_buf.length > PCX_REPLICATION_MAX_STATE_SIZE) {
+                if (primary->state_too_big) {
+                        primary->oversize_delay =
+                                MIN(primary->oversize_delay * 2,
+                                    MAX_OVERSIZE_DELAY);
+                } else {
+                        pcx_log("The state is too big to send to the "
+                                "standby (%zu bytes)",
+                                primary->state_buf.length);
+                        primary->state_too_big = true;
+                        primary->oversize_delay =
+                                MIN(primary->interval * 2,
+                                    MAX_OVERSIZE_DELAY);
+                }
+        } else if (primary->state_too_big) {
+                pcx_log("The state is small enough to send to the "
+                        "standby again");
+                primary->state_too_big = false;
+        }
+}
+
+static void
+timeout_cb(struct pcx_main_context_source *source,
+           void *user_data)
+{
+        struct pcx_replication_primary *primary = user_data;
+        struct pcx_replication_connection *conn;
+
+        primary->timeout_source = NULL;
+
+        update_state(primary);
+
+        pcx_list_for_each(conn, &primary->connections, link) {
+                if (primary->state_too_big)
+                        break;
+
+                if (conn->out_buf.length > 0 ||
+                    conn->state_serial == primary->state_serial)
+                        continue;
+
+                conn->state_serial = primary->state_serial;
+
+                uint32_t length = PCX_UINT32_TO_LE(primary->state_buf.length);
+
+                pcx_buffer_append(&conn->out_buf, &length, sizeof length);
+                pcx_buffer_append(&conn->out_buf,
+                                  primary->state_buf.data,
+                                  primary->state_buf.length);
+
+                pcx_main_context_modify_poll(conn->source,
+                                             PCX_MAIN_CONTEXT_POLL_IN |
+                                             PCX_MAIN_CONTEXT_POLL_OUT);
+        }
+
+        queue_timeout(primary);
+}
+
+static void
+queue_timeout(struct pcx_replication_primary *primary)
+{
+        if (primary->timeout_source || pcx_list_empty(&primary->connections))
+                return;
+
+        primary->timeout_source =
+                pcx_main_context_add_timeout(NULL,
+                                             primary->state_too_big ?
+                                             primary->oversize_delay :
+                                             primary->interval,
+                                             timeout_cb,
+                                             primary);
+}
+
+static void
+listen_cb(struct pcx_main_context_source *source,
+          int fd,
+          enum pcx_main_context_poll_flags flags,
+          void *user_data)
+{
+        struct pcx_replication_primary *primary = user_data;
+
+        int sock = accept(primary->listen_sock, NULL, NULL);
+
+        if (sock == -1)
+                return;
+
+        if (!pcx_socket_set_nonblock(sock, NULL)) {
+                pcx_close(sock);
+                return;
+        }
+
+        struct pcx_replication_connection *conn = pcx_calloc(sizeof *conn);
+
+        conn->primary = primary;
+        conn->sock = sock;
+        pcx_buffer_init(&conn->out_buf);
+        conn->source = pcx_main_context_add_poll(NULL,
+                                                 sock,
+                                                 PCX_MAIN_CONTEXT_POLL_IN,
+                                                 connection_cb,
+                                                 conn);
+
+        pcx_list_insert(primary->connections.prev, &conn->link);
+
+        pcx_log("Standby connected");
+
+        queue_timeout(primary);
+}
+
+struct pcx_replication_primary *
+pcx_replication_primary_new(const char *path,
+                            long interval,
+                            pcx_replication_state_cb state_cb,
+                            void *user_data,
+                            struct pcx_error **error)
+{
+        int sock = pcx_listen_socket_create_for_path(path, error);
+
+        if (sock == -1)
+                return NULL;
+
+        struct pcx_replication_primary *primary = pcx_calloc(sizeof *primary);
+
+        primary->listen_sock = sock;
+        primary->interval = interval;
+        primary->state_cb = state_cb;
+        primary->user_data = user_data;
+        pcx_list_init(&primary->connections);
+        pcx_buffer_init(&primary->state_buf);
+        primary->state_dirty = true;
+
+        primary->listen_source =
+                pcx_main_context_add_poll(NULL,
+                                          sock,
+                                          PCX_MAIN_CONTEXT_POLL_IN,
+                                          listen_cb,
+                                          primary);
+
+        return primary;
+}
+
+void
+pcx_replication_primary_state_changed(struct pcx_replication_primary *primary)
+{
+        primary->state_dirty = true;
+}
+
+void
+pcx_replication_primary_free(struct pcx_replication_primary *primary)
+{
+        struct pcx_replication_connection *conn, *tmp;
+
+        pcx_list_for_each_safe(conn, tmp, &primary->connections, link)
+                free_connection(conn);
+
+        if (primary->timeout_source)
+                pcx_main_context_remove_source(primary->timeout_source);
+
+        pcx_main_context_remove_source(primary->listen_source);
+        pcx_close(primary->listen_sock);
+
+        pcx_buffer_destroy(&primary->state_buf);
+
+        pcx_free(primary);
+}
+
+static void
+queue_connect(struct pcx_replication_standby *standby,
+              long delay);
+
+static void
+lose_connection(struct pcx_replication_standby *standby)
+{
+        if (standby->sock_source) {
+                pcx_main_context_remove_source(standby->sock_source);
+                standby->sock_source = NULL;
+        }
+
+        if (standby->sock != -1) {
+                pcx_close(standby->sock);
+                standby->sock = -1;
+        }
+
+        /* Forget any partial snapshot */
+        standby->in_buf.length = 0;
+
+        queue_connect(standby, RECONNECT_DELAY);
+
+        standby->lost_cb(standby->user_data);
+}
+
+static bool
+process_input(struct pcx_replication_standby *standby)
+{
+        size_t pos = 0;
+
+        while (standby->in_buf.length - pos >= sizeof (uint32_t)) {
+                uint32_t length;
+
+                memcpy(&length, standby->in_buf.data + pos, sizeof length);
+                length = PCX_UINT32_FROM_LE(length);
+
+                if (length > PCX_REPLICATION_MAX_STATE_SIZE) {
+                        pcx_log("Snapshot from the primary is too big");
+                        return false;
+                }
+
+                if (standby->in_buf.length - pos - sizeof length < length)
+                        break;
+
+                pos += sizeof length;
+
+                standby->state.length = 0;
+                pcx_buffer_append(&standby->state,
+                                  standby->in_buf.data + pos,
+                                  length);
+
+                pos += length;
+        }
+
+        memmove(standby->in_buf.data,
+                standby->in_buf.data + pos,
+                standby->in_buf.length - pos);
+        standby->in_buf.length -= pos;
+
+        return true;
+}
+
+static void
+standby_sock_cb(struct pcx_main_context_source *source,
+                int fd,
+                enum pcx_main_context_poll_flags flags,
+                void *user_data)
+{
+        struct pcx_replication_standby *standby = user_data;
+
+        pcx_buffer_ensure_size(&standby->in_buf,
+                               standby->in_buf.length + 4096);
+
+        ssize_t got = read(standby->sock,
+                           standby->in_buf.data + standby->in_buf.length,
+                           standby->in_buf.size - standby->in_buf.length);
+
+        if (got == -1) {
+                if (errno == EAGAIN || errno == EINTR)
+                        return;
+
+                pcx_log("Error reading from the primary: %s",
+                        strerror(errno));
+                lose_connection(standby);
+                return;
+        }
+
+        if (got == 0) {
+                pcx_log("The primary closed the connection");
+                lose_connection(standby);
+                return;
+        }
+
+        standby->in_buf.length += got;
+
+        if (!process_input(standby))
+                lose_connection(standby);
+}
+
+static bool
+try_connect(struct pcx_replication_standby *standby)
+{
+        struct sockaddr_un addr = { .sun_family = AF_UNIX };
+        size_t path_length = strlen(standby->path);
+
+        if (path_length >= sizeof addr.sun_path)
+                return false;
+
+        memcpy(addr.sun_path, standby->path, path_length + 1);
+
+        int sock = socket(PF_UNIX, SOCK_STREAM, 0);
+
+        if (sock == -1)
+                return false;
+
+        if (connect(sock, (struct sockaddr *) &addr, sizeof addr) == -1 ||
+            !pcx_socket_set_nonblock(sock, NULL)) {
+                pcx_close(sock);
+                return false;
+        }
+
+        standby->sock = sock;
+        standby->sock_source =
+                pcx_main_context_add_poll(NULL,
+                                          sock,
+                                          PCX_MAIN_CONTEXT_POLL_IN,
+                                          standby_sock_cb,
+                                          standby);
+
+        pcx_log("Connected to the primary");
+
+        return true;
+}
+
+static void
+connect_cb(struct pcx_main_context_source *source,
+           void *user_data)
+{
+        struct pcx_replication_standby *standby = user_data;
+
+        standby->connect_source = NULL;
+
+        if (!try_connect(standby))
+                lose_connection(standby);
+}
+
+static void
+queue_connect(struct pcx_replication_standby *standby,
+              long delay)
+{
+        if (standby->connect_source)
+                return;
+
+        standby->connect_source = pcx_main_context_add_timeout(NULL,
+                                                               delay,
+                                                               connect_cb,
+                                                               standby);
+}
+
+struct pcx_replication_standby *
+pcx_replication_standby_new(const char *path,
+                            pcx_replication_lost_cb lost_cb,
+                            void *user_data)
+{
+        struct pcx_replication_standby *standby = pcx_calloc(sizeof *standby);
+
+        standby->path = pcx_strdup(path);
+        standby->sock = -1;
+        standby->lost_cb = lost_cb;
+        standby->user_data = user_data;
+        pcx_buffer_init(&standby->in_buf);
+        pcx_buffer_init(&standby->state);
+
+        /* Connect from the main loop so that the callback isn’t
+         * called before this function returns.
+         */
+        queue_connect(standby, 0);
+
+        return standby;
+}
+
+const struct pcx_buffer *
+pcx_replication_standby_get_state(struct pcx_replication_standby *standby)
+{
+        return &standby->state;
+}
+
+void
+pcx_replication_standby_free(struct pcx_replication_standby *standby)
+{
+        if (standby->connect_source)
+                pcx_main_context_remove_source(standby->connect_source);
+        if (standby->sock_source)
+                pcx_main_context_remove_source(standby->sock_source);
+        if (standby->sock != -1)
+                pcx_close(standby->sock);
+
+        pcx_buffer_destroy(&standby->in_buf);
+        pcx_buffer_destroy(&standby->state);
+        pcx_free(standby->path);
+        pcx_free(standby);
+}
@@ -0,0 +1,98 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PCX_REPLICATION_H
+#define PCX_REPLICATION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "pcx-error.h"
+#include "pcx-buffer.h"
+
+/* Hot standby. The primary process listens on a Unix socket and
+ * every interval it sends a snapshot of the running games to each
+ * standby process that is connected to it. The snapshots are only
+ * built when a standby is ready for the next one so a slow standby
+ * just gets fewer of them and never holds up the primary. A snapshot
+ * is only built again when the state has changed, apart from an
+ * occasional refresh so that the timers don’t get too old.
+ *
+ * Each snapshot is sent as a 32-bit little-endian length followed by
+ * the data.
+ */
+
+/* Microseconds after which the state is sent again even if nothing
+ * has changed so that the timers in the games that the standby would
+ * restore don’t get too far behind.
+ */
+#define PCX_REPLICATION_REFRESH_TIME ((uint64_t) 30 * 1000000)
+
+/* Snapshots bigger than this are treated as a protocol error. The
+ * primary doesn’t send them and tries again later instead.
+ */
+#define PCX_REPLICATION_MAX_STATE_SIZE (64 * 1024 * 1024)
+
+struct pcx_replication_primary;
+struct pcx_replication_standby;
+
+typedef void
+(* pcx_replication_state_cb)(struct pcx_buffer *buf,
+                             void *user_data);
+
+typedef void
+(* pcx_replication_lost_cb)(void *user_data);
+
+/* The callback is called to append the state to the buffer every
+ * interval milliseconds while there is a standby waiting for it and
+ * the state has changed since the last time.
+ */
+struct pcx_replication_primary *
+pcx_replication_primary_new(const char *path,
+                            long interval,
+                            pcx_replication_state_cb state_cb,
+                            void *user_data,
+                            struct pcx_error **error);
+
+/* Tells the primary that the state needs to be built again */
+void
+pcx_replication_primary_state_changed(struct pcx_replication_primary *primary);
+
+void
+pcx_replication_primary_free(struct pcx_replication_primary *primary);
+
+/* The lost callback is called whenever the standby isn’t connected to
+ * a primary, either because connecting failed or because the
+ * connection was closed. It will try again a second later. The
+ * callback must not free the standby.
+ */
+struct pcx_replication_standby *
+pcx_replication_standby_new(const char *path,
+                            pcx_replication_lost_cb lost_cb,
+                            void *user_data);
+
+/* Returns the last complete snapshot that was received. This is empty
+ * if nothing has been received yet.
+ */
+const struct pcx_buffer *
+pcx_replication_standby_get_state(struct pcx_replication_standby *standby);
+
+void
+pcx_replication_standby_free(struct pcx_replication_standby *standby);
+
+#endif /* PCX_REPLICATION_H */
@@ -0,0 +1,257 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include "pcx-router.h"
+#include "pcx-main-context.h"
+#include "pcx-listen-socket.h"
+#include "pcx-netaddress.h"
+#include "pcx-generate-id.h"
+#include "pcx-log.h"
+#include "pcx-util.h"
+
+#define DEFAULT_PORT 3648
+
+struct pcx_router_main {
+        struct pcx_router *router;
+        const char *listen_address;
+        const char *log_filename;
+        bool quit;
+};
+
+static const char options[] = "-ha:b:l:";
+
+static void
+quit_cb(struct pcx_main_context_source *source,
+        int signal_num,
+        void *user_data)
+{
+        struct pcx_router_main *data = user_data;
+
+        data->quit = true;
+}
+
+static void
+usage(void)
+{
+        printf("Pucxobot router - sends connections to several servers\n"
+               "usage: pucxobot-router [options]...\n"
+               " -h                   Show this help message\n"
+               " -a <address>         Address or port to listen on.\n"
+               "                      Defaults to port 3648.\n"
+               " -b <shard>=<addr>    Add a server to send connections to.\n"
+               "                      The shard is the shard number in\n"
+               "                      the server’s config and must be\n"
+               "                      different for each server. Can be\n"
+               "                      given more than once.\n"
+               " -l <file>            Specify a log file. Defaults to "
+               "stdout.\n");
+}
+
+static bool
+add_backend(struct pcx_router_main *data,
+            const char *arg)
+{
+        const char *equals = strchr(arg, '=');
+
+        if (equals == NULL) {
+                fprintf(stderr, "missing shard in \"%s\"\n", arg);
+                return false;
+        }
+
+        char *tail;
+
+        errno = 0;
+        long shard = strtol(arg, &tail, 10);
+
+        if (errno ||
+            tail == arg ||
+            tail != equals ||
+            shard < 0 ||
+            shard > PCX_GENERATE_ID_MAX_SHARD) {
+                fprintf(stderr, "invalid shard in \"%s\"\n", arg);
+                return false;
+        }
+
+        struct pcx_error *error = NULL;
+
+        if (!pcx_router_add_backend(data->router,
+                                    equals + 1,
+                                    shard,
+                                    &error)) {
+                fprintf(stderr, "%s\n", error->message);
+                pcx_error_free(error);
+                return false;
+        }
+
+        return true;
+}
+
+static bool
+process_arguments(struct pcx_router_main *data,
+                  int argc, char **argv)
+{
+        bool have_backend = false;
+        int opt;
+
+        opterr = false;
+
+        while ((opt = getopt(argc, argv, options)) != -1) {
+                switch (opt) {
+                case ':':
+                case '?':
+                        fprintf(stderr,
+                                "invalid option '%c'\n",
+                                optopt);
+                        return false;
+
+                case '\1':
+                        fprintf(stderr,
+                                "unexpected argument \"%s\"\n",
+                                optarg);
+                        return false;
+
+                case 'h':
+                        usage();
+                        return false;
+
+                case 'a':
+                        data->listen_address = optarg;
+                        break;
+
+                case 'b':
+                        if (!add_backend(data, optarg))
+                                return false;
+                        have_backend = true;
+                        break;
+
+                case 'l':
+                        data->log_filename = optarg;
+                        break;
+                }
+        }
+
+        if (!have_backend) {
+                fprintf(stderr, "at least one server must be given with -b\n");
+                return false;
+        }
+
+        return true;
+}
+
+static int
+create_listen_socket(const char *address,
+                     struct pcx_error **error)
+{
+        if (address == NULL)
+                return pcx_listen_socket_create_for_port(DEFAULT_PORT, error);
+
+        unsigned long port;
+        char *tail;
+
+        errno = 0;
+        port = strtoul(address, &tail, 0);
+        if (errno == 0 && port <= UINT16_MAX && *tail == '\0')
+                return pcx_listen_socket_create_for_port(port, error);
+
+        struct pcx_netaddress netaddress;
+
+        if (!pcx_netaddress_from_string(&netaddress, address, DEFAULT_PORT)) {
+                pcx_set_error(error,
+                              &pcx_router_error,
+                              PCX_ROUTER_ERROR_INVALID_ADDRESS,
+                              "The listen address %s is invalid",
+                              address);
+                return -1;
+        }
+
+        return pcx_listen_socket_create_for_netaddress(&netaddress, error);
+}
+
+int
+main(int argc, char **argv)
+{
+        struct pcx_router_main data = {
+                .router = pcx_router_new(),
+        };
+        struct pcx_error *error = NULL;
+        int ret = EXIT_SUCCESS;
+
+        if (!process_arguments(&data, argc, argv)) {
+                ret = EXIT_FAILURE;
+                goto done;
+        }
+
+        int sock = create_listen_socket(data.listen_address, &error);
+
+        if (sock == -1) {
+                fprintf(stderr, "%s\n", error->message);
+                pcx_error_free(error);
+                ret = EXIT_FAILURE;
+                goto done;
+        }
+
+        pcx_router_add_listen_socket(data.router, sock);
+
+        if (data.log_filename &&
+            !pcx_log_set_file(data.log_filename, &error)) {
+                fprintf(stderr, "%s\n", error->message);
+                pcx_error_free(error);
+                ret = EXIT_FAILURE;
+                goto done;
+        }
+
+        pcx_log_start();
+
+        signal(SIGPIPE, SIG_IGN);
+
+        struct pcx_main_context_source *int_source =
+                pcx_main_context_add_signal_source(NULL,
+                                                   SIGINT,
+                                                   quit_cb,
+                                                   &data);
+        struct pcx_main_context_source *term_source =
+                pcx_main_context_add_signal_source(NULL,
+                                                   SIGTERM,
+                                                   quit_cb,
+                                                   &data);
+
+        while (!data.quit)
+                pcx_main_context_poll(NULL);
+
+        pcx_main_context_remove_source(term_source);
+        pcx_main_context_remove_source(int_source);
+
+        pcx_log_close();
+
+done:
+        pcx_router_free(data.router);
+
+        pcx_main_context_free(pcx_main_context_get_default());
+
+        return ret;
+}
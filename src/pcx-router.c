@@ -0,0 +1,1123 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "pcx-router.h"
+
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "pcx-util.h"
+#include "pcx-main-context.h"
+#include "pcx-buffer.h"
+#include "pcx-list.h"
+#include "pcx-log.h"
+#include "pcx-socket.h"
+#include "pcx-netaddress.h"
+#include "pcx-ws-parser.h"
+#include "pcx-base64.h"
+#include "pcx-proto.h"
+#include "pcx-proxy-protocol.h"
+#include "pcx-hash-ring.h"
+#include "pcx-generate-id.h"
+#include "sha1.h"
+
+#define DEFAULT_BACKEND_PORT 3648
+
+/* Stop reading from one side when this much data is waiting to be
+ * written to the other side.
+ */
+#define MAX_BUFFERED_DATA (64 * 1024)
+
+/* Time in milliseconds that a client has to get from connecting to
+ * having its data forwarded to a backend.
+ */
+#define SETUP_TIMEOUT (10 * 1000)
+
+/* Maximum size of the HTTP reply from a backend */
+#define MAX_BACKEND_REPLY_SIZE 1024
+
+struct pcx_error_domain
+pcx_router_error;
+
+enum pcx_router_client_state {
+        /* Waiting for the WebSocket request from the client */
+        PCX_ROUTER_CLIENT_STATE_HANDSHAKE,
+        /* Waiting for the first frame from the client */
+        PCX_ROUTER_CLIENT_STATE_FIRST_MESSAGE,
+        /* Waiting for the connection to the backend */
+        PCX_ROUTER_CLIENT_STATE_CONNECTING,
+        /* Waiting for the WebSocket reply from the backend */
+        PCX_ROUTER_CLIENT_STATE_BACKEND_HANDSHAKE,
+        /* Copying data in both directions */
+        PCX_ROUTER_CLIENT_STATE_FORWARDING,
+};
+
+struct pcx_router_backend {
+        struct pcx_netaddress address;
+        char *address_string;
+        int shard;
+};
+
+struct pcx_router_socket {
+        struct pcx_list link;
+        struct pcx_router *router;
+        int sock;
+        struct pcx_main_context_source *source;
+};
+
+struct pcx_router_client {
+        struct pcx_list link;
+        struct pcx_router *router;
+
+        enum pcx_router_client_state state;
+
+        struct pcx_netaddress remote_address;
+        char *remote_address_string;
+        /* The address that the client connected to */
+        struct pcx_netaddress local_address;
+
+        int client_sock;
+        struct pcx_main_context_source *client_source;
+        bool client_eof;
+
+        int backend_sock;
+        struct pcx_main_context_source *backend_source;
+        bool backend_eof;
+        int backend_num;
+
+        struct pcx_main_context_source *timeout_source;
+
+        struct pcx_ws_parser *ws_parser;
+        SHA1_CTX *sha1_ctx;
+
+        /* Data from the client waiting to be written to the backend */
+        struct pcx_buffer to_backend;
+        /* Data from the backend waiting to be written to the client */
+        struct pcx_buffer to_client;
+        /* The HTTP reply from the backend */
+        struct pcx_buffer backend_reply;
+};
+
+struct pcx_router {
+        struct pcx_list sockets;
+        struct pcx_list clients;
+
+        /* Array of struct pcx_router_backend */
+        struct pcx_buffer backends;
+        struct pcx_hash_ring *ring;
+};
+
+static const char
+ws_sec_key_guid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+static const char
+ws_header_prefix[] =
+        "HTTP/1.1 101 Switching Protocols\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Accept: ";
+
+static const char
+ws_header_postfix[] = "\r\n\r\n";
+
+/* The request that the router sends to the backend on behalf of the
+ * client. The client has already been given its own accept key so the
+ * key here doesn’t matter.
+ */
+static const char
+backend_request[] =
+        "GET / HTTP/1.1\r\n"
+        "Host: pucxobot\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "\r\n";
+
+static const char
+backend_reply_prefix[] = "HTTP/1.1 101 ";
+
+static struct pcx_router_backend *
+get_backends(struct pcx_router *router,
+             size_t *n_backends)
+{
+        *n_backends = router->backends.length /
+                sizeof (struct pcx_router_backend);
+
+        return (struct pcx_router_backend *) router->backends.data;
+}
+
+static void
+free_client(struct pcx_router_client *client)
+{
+        if (client->client_source)
+                pcx_main_context_remove_source(client->client_source);
+        pcx_close(client->client_sock);
+
+        if (client->backend_source)
+                pcx_main_context_remove_source(client->backend_source);
+        if (client->backend_sock != -1)
+                pcx_close(client->backend_sock);
+
+        if (client->timeout_source)
+                pcx_main_context_remove_source(client->timeout_source);
+
+        if (client->ws_parser)
+                pcx_ws_parser_free(client->ws_parser);
+        pcx_free(client->sha1_ctx);
+
+        pcx_buffer_destroy(&client->to_backend);
+        pcx_buffer_destroy(&client->to_client);
+        pcx_buffer_destroy(&client->backend_reply);
+
+        pcx_free(client->remote_address_string);
+
+        pcx_list_remove(&client->link);
+
+        pcx_free(client);
+}
+
+static void
+update_poll_flags(struct pcx_router_client *client)
+{
+        enum pcx_main_context_poll_flags flags = 0;
+
+        if (!client->client_eof &&
+            client->to_backend.length < MAX_BUFFERED_DATA)
+                flags |= PCX_MAIN_CONTEXT_POLL_IN;
+        if (client->to_client.length > 0)
+                flags |= PCX_MAIN_CONTEXT_POLL_OUT;
+
+        pcx_main_context_modify_poll(client->client_source, flags);
+
+        if (client->backend_source == NULL)
+                return;
+
+        flags = 0;
+
+        if (client->state == PCX_ROUTER_CLIENT_STATE_CONNECTING) {
+                flags |= PCX_MAIN_CONTEXT_POLL_OUT;
+        } else {
+                if (!client->backend_eof &&
+                    client->to_client.length < MAX_BUFFERED_DATA)
+                        flags |= PCX_MAIN_CONTEXT_POLL_IN;
+                if (client->to_backend.length > 0)
+                        flags |= PCX_MAIN_CONTEXT_POLL_OUT;
+        }
+
+        pcx_main_context_modify_poll(client->backend_source, flags);
+}
+
+/* Frees the client if there is nothing more to do with it */
+static void
+check_finished(struct pcx_router_client *client)
+{
+        if (client->state != PCX_ROUTER_CLIENT_STATE_FORWARDING) {
+                if (client->client_eof || client->backend_eof) {
+                        pcx_log("Connection closed for %s before it was "
+                                "forwarded",
+                                client->remote_address_string);
+                        free_client(client);
+                        return;
+                }
+        } else if ((client->client_eof && client->to_backend.length == 0) ||
+                   (client->backend_eof && client->to_client.length == 0)) {
+                free_client(client);
+                return;
+        }
+
+        update_poll_flags(client);
+}
+
+static bool
+write_buffer(struct pcx_router_client *client,
+             int sock,
+             struct pcx_buffer *buffer)
+{
+        ssize_t wrote = send(sock,
+                             buffer->data,
+                             buffer->length,
+                             MSG_DONTWAIT | MSG_NOSIGNAL);
+
+        if (wrote == -1) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                        return true;
+
+                pcx_log("Error writing to socket for %s: %s",
+                        client->remote_address_string,
+                        strerror(errno));
+                return false;
+        }
+
+        memmove(buffer->data, buffer->data + wrote, buffer->length - wrote);
+        buffer->length -= wrote;
+
+        return true;
+}
+
+/* Reads some data from the socket into the buffer. Returns the number
+ * of bytes added or -1 if there was an error. If the socket is closed
+ * then *eof is set to true.
+ */
+static ssize_t
+read_into_buffer(struct pcx_router_client *client,
+                 int sock,
+                 struct pcx_buffer *buffer,
+                 bool *eof)
+{
+        pcx_buffer_ensure_size(buffer, buffer->length + 4096);
+
+        ssize_t got = read(sock,
+                           buffer->data + buffer->length,
+                           buffer->size - buffer->length);
+
+        if (got == -1) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                        return 0;
+
+                pcx_log("Error reading from socket for %s: %s",
+                        client->remote_address_string,
+                        strerror(errno));
+                return -1;
+        }
+
+        if (got == 0)
+                *eof = true;
+
+        buffer->length += got;
+
+        return got;
+}
+
+static void
+timeout_cb(struct pcx_main_context_source *source,
+           void *user_data)
+{
+        struct pcx_router_client *client = user_data;
+
+        client->timeout_source = NULL;
+
+        pcx_log("Timed out setting up the connection for %s",
+                client->remote_address_string);
+
+        free_client(client);
+}
+
+static int
+route_id(struct pcx_router *router,
+         uint64_t id)
+{
+        size_t n_backends;
+        const struct pcx_router_backend *backends =
+                get_backends(router, &n_backends);
+        int shard = pcx_generate_id_get_shard(id);
+
+        for (size_t i = 0; i < n_backends; i++) {
+                if (backends[i].shard == shard)
+                        return i;
+        }
+
+        /* None of the servers could have made the ID */
+        return -1;
+}
+
+static uint64_t
+hash_remote_address(const struct pcx_netaddress *address)
+{
+        if (address->family == AF_INET6) {
+                return pcx_hash_ring_hash_data(&address->ipv6,
+                                               sizeof address->ipv6);
+        } else {
+                return pcx_hash_ring_hash_data(&address->ipv4,
+                                               sizeof address->ipv4);
+        }
+}
+
+/* Players waiting for the same type of game need to end up on the
+ * same server to meet each other.
+ */
+static uint64_t
+hash_game(const char *game_name,
+          const char *language_code)
+{
+        struct pcx_buffer key = PCX_BUFFER_STATIC_INIT;
+
+        /* Include the terminator to separate the two strings */
+        pcx_buffer_append(&key, game_name, strlen(game_name) + 1);
+        pcx_buffer_append_string(&key, language_code);
+
+        uint64_t hash = pcx_hash_ring_hash_data(key.data, key.length);
+
+        pcx_buffer_destroy(&key);
+
+        return hash;
+}
+
+/* Returns the number of the backend to use for the first message from
+ * a client or -1 if the message isn’t valid.
+ */
+static int
+choose_backend(struct pcx_router_client *client,
+               const uint8_t *payload,
+               size_t length)
+{
+        struct pcx_router *router = client->router;
+        const char *name, *game_name, *language_code;
+        uint16_t n_messages_received;
+        uint64_t id;
+
+        if (length < 1)
+                return -1;
+
+        switch (payload[0]) {
+        case PCX_PROTO_NEW_PLAYER:
+                if (!pcx_proto_read_payload(payload + 1,
+                                            length - 1,
+
+                                            PCX_PROTO_TYPE_STRING,
+                                            &name,
+
+                                            PCX_PROTO_TYPE_STRING,
+                                            &game_name,
+
+                                            PCX_PROTO_TYPE_STRING,
+                                            &language_code,
+
+                                            PCX_PROTO_TYPE_NONE))
+                        return -1;
+
+                return pcx_hash_ring_lookup(router->ring,
+                                            hash_game(game_name,
+                                                      language_code));
+
+        case PCX_PROTO_NEW_PRIVATE_PLAYER:
+        case PCX_PROTO_LOBBY_SUBSCRIBE:
+                /* These can go anywhere */
+                return pcx_hash_ring_lookup(router->ring,
+                                            hash_remote_address
+                                            (&client->remote_address));
+
+        case PCX_PROTO_JOIN_PRIVATE_GAME:
+        case PCX_PROTO_JOIN_LOBBY_GAME:
+                if (!pcx_proto_read_payload(payload + 1,
+                                            length - 1,
+
+                                            PCX_PROTO_TYPE_STRING,
+                                            &name,
+
+                                            PCX_PROTO_TYPE_UINT64,
+                                            &id,
+
+                                            PCX_PROTO_TYPE_NONE))
+                        return -1;
+
+                return route_id(router, id);
+
+        case PCX_PROTO_RECONNECT:
+        case PCX_PROTO_SPECTATE:
+                if (!pcx_proto_read_payload(payload + 1,
+                                            length - 1,
+
+                                            PCX_PROTO_TYPE_UINT64,
+                                            &id,
+
+                                            PCX_PROTO_TYPE_UINT16,
+                                            &n_messages_received,
+
+                                            PCX_PROTO_TYPE_NONE))
+                        return -1;
+
+                return route_id(router, id);
+        }
+
+        return -1;
+}
+
+static void
+backend_sock_cb(struct pcx_main_context_source *source,
+                int fd,
+                enum pcx_main_context_poll_flags flags,
+                void *user_data);
+
+static bool
+connect_to_backend(struct pcx_router_client *client)
+{
+        size_t n_backends;
+        const struct pcx_router_backend *backend =
+                get_backends(client->router, &n_backends) +
+                client->backend_num;
+        struct pcx_netaddress_native native_address;
+
+        pcx_netaddress_to_native(&backend->address, &native_address);
+
+        int sock = socket(native_address.sockaddr.sa_family == AF_INET6 ?
+                          PF_INET6 : PF_INET,
+                          SOCK_STREAM,
+                          0);
+
+        if (sock == -1) {
+                pcx_log("Error creating socket for %s: %s",
+                        client->remote_address_string,
+                        strerror(errno));
+                return false;
+        }
+
+        struct pcx_error *error = NULL;
+
+        if (!pcx_socket_set_nonblock(sock, &error)) {
+                pcx_log("Error setting socket for %s non-blocking: %s",
+                        client->remote_address_string,
+                        error->message);
+                pcx_error_free(error);
+                pcx_close(sock);
+                return false;
+        }
+
+        if (connect(sock,
+                    &native_address.sockaddr,
+                    native_address.length) == -1 &&
+            errno != EINPROGRESS) {
+                pcx_log("Error connecting to %s for %s: %s",
+                        backend->address_string,
+                        client->remote_address_string,
+                        strerror(errno));
+                pcx_close(sock);
+                return false;
+        }
+
+        client->backend_sock = sock;
+        client->backend_source =
+                pcx_main_context_add_poll(NULL,
+                                          sock,
+                                          PCX_MAIN_CONTEXT_POLL_OUT,
+                                          backend_sock_cb,
+                                          client);
+        client->state = PCX_ROUTER_CLIENT_STATE_CONNECTING;
+
+        /* Put a PROXY protocol header and our own request in front of
+         * the frames from the client so that the backend sees the
+         * client’s real address.
+         */
+        struct pcx_buffer prefix = PCX_BUFFER_STATIC_INIT;
+
+        pcx_proxy_protocol_write_v2(&prefix,
+                                    &client->remote_address,
+                                    &client->local_address);
+        pcx_buffer_append(&prefix,
+                          backend_request,
+                          sizeof backend_request - 1);
+
+        size_t data_length = client->to_backend.length;
+        pcx_buffer_set_length(&client->to_backend,
+                              data_length + prefix.length);
+        memmove(client->to_backend.data + prefix.length,
+                client->to_backend.data,
+                data_length);
+        memcpy(client->to_backend.data, prefix.data, prefix.length);
+
+        pcx_buffer_destroy(&prefix);
+
+        return true;
+}
+
+/* Looks at the first frame from the client once it has arrived to
+ * decide which backend to use. Returns false if the client should be
+ * closed.
+ */
+static bool
+process_first_message(struct pcx_router_client *client)
+{
+        const uint8_t *data = client->to_backend.data;
+        size_t length = client->to_backend.length;
+
+        if (length < 2)
+                return true;
+
+        /* The first frame must be a complete binary frame from the
+         * client so it should have the FIN bit, the binary opcode and
+         * the mask bit.
+         */
+        if (data[0] != 0x82 || (data[1] & 0x80) == 0) {
+                pcx_log("Client %s sent an invalid first frame",
+                        client->remote_address_string);
+                return false;
+        }
+
+        size_t payload_length = data[1] & 0x7f;
+        size_t header_length = 2;
+
+        if (payload_length == 126) {
+                if (length < 4)
+                        return true;
+                payload_length = (data[2] << 8) | data[3];
+                header_length = 4;
+        } else if (payload_length == 127) {
+                /* This would be too big anyway */
+                payload_length = SIZE_MAX;
+        }
+
+        if (payload_length > PCX_PROTO_MAX_PAYLOAD_SIZE) {
+                pcx_log("Client %s sent a first frame that is too long",
+                        client->remote_address_string);
+                return false;
+        }
+
+        /* Mask */
+        header_length += 4;
+
+        if (length < header_length + payload_length)
+                return true;
+
+        uint8_t payload[PCX_PROTO_MAX_PAYLOAD_SIZE];
+        const uint8_t *mask = data + header_length - 4;
+
+        for (size_t i = 0; i < payload_length; i++)
+                payload[i] = data[header_length + i] ^ mask[i % 4];
+
+        int backend_num = choose_backend(client, payload, payload_length);
+
+        if (backend_num == -1) {
+                pcx_log("Client %s sent a first message that can’t be "
+                        "routed",
+                        client->remote_address_string);
+                return false;
+        }
+
+        client->backend_num = backend_num;
+
+        return connect_to_backend(client);
+}
+
+static bool
+ws_request_line_received_cb(const char *method,
+                            const char *uri,
+                            void *user_data)
+{
+        return true;
+}
+
+static bool
+ws_header_received_cb(const char *field_name,
+                      const char *value,
+                      void *user_data)
+{
+        struct pcx_router_client *client = user_data;
+
+        if (!pcx_ascii_string_case_equal(field_name, "sec-websocket-key"))
+                return true;
+
+        if (client->sha1_ctx != NULL) {
+                pcx_log("Client at %s sent a WebSocket header with multiple "
+                        "Sec-WebSocket-Key headers",
+                        client->remote_address_string);
+                return false;
+        }
+
+        client->sha1_ctx = pcx_alloc(sizeof *client->sha1_ctx);
+        SHA1Init(client->sha1_ctx);
+        SHA1Update(client->sha1_ctx, (const uint8_t *) value, strlen(value));
+
+        return true;
+}
+
+static const struct pcx_ws_parser_vtable
+ws_parser_vtable = {
+        .request_line_received = ws_request_line_received_cb,
+        .header_received = ws_header_received_cb
+};
+
+static bool
+ws_headers_finished(struct pcx_router_client *client)
+{
+        uint8_t sha1_hash[SHA1_DIGEST_LENGTH];
+
+        if (client->sha1_ctx == NULL) {
+                pcx_log("Client at %s sent a WebSocket header without a "
+                        "Sec-WebSocket-Key header",
+                        client->remote_address_string);
+                return false;
+        }
+
+        SHA1Update(client->sha1_ctx,
+                   (const uint8_t *) ws_sec_key_guid,
+                   sizeof ws_sec_key_guid - 1);
+        SHA1Final(sha1_hash, client->sha1_ctx);
+        pcx_free(client->sha1_ctx);
+        client->sha1_ctx = NULL;
+
+        struct pcx_buffer *buf = &client->to_client;
+
+        pcx_buffer_append(buf,
+                          ws_header_prefix,
+                          sizeof ws_header_prefix - 1);
+        pcx_buffer_ensure_size(buf,
+                               buf->length +
+                               PCX_BASE64_ENCODED_SIZE(SHA1_DIGEST_LENGTH));
+        buf->length += pcx_base64_encode(sha1_hash,
+                                         sizeof sha1_hash,
+                                         (char *) buf->data + buf->length);
+        pcx_buffer_append(buf,
+                          ws_header_postfix,
+                          sizeof ws_header_postfix - 1);
+
+        return true;
+}
+
+static bool
+handle_ws_data(struct pcx_router_client *client,
+               const uint8_t *data,
+               size_t length)
+{
+        struct pcx_error *error = NULL;
+        enum pcx_ws_parser_result result;
+        size_t consumed;
+
+        result = pcx_ws_parser_parse_data(client->ws_parser,
+                                          data,
+                                          length,
+                                          &consumed,
+                                          &error);
+
+        switch (result) {
+        case PCX_WS_PARSER_RESULT_NEED_MORE_DATA:
+                return true;
+        case PCX_WS_PARSER_RESULT_FINISHED:
+                pcx_ws_parser_free(client->ws_parser);
+                client->ws_parser = NULL;
+
+                if (!ws_headers_finished(client))
+                        return false;
+
+                client->state = PCX_ROUTER_CLIENT_STATE_FIRST_MESSAGE;
+
+                /* Anything after the request is the start of the
+                 * frames.
+                 */
+                pcx_buffer_append(&client->to_backend,
+                                  data + consumed,
+                                  length - consumed);
+
+                return process_first_message(client);
+        case PCX_WS_PARSER_RESULT_ERROR:
+                if (error->domain != &pcx_ws_parser_error ||
+                    error->code != PCX_WS_PARSER_ERROR_CANCELLED) {
+                        pcx_log("WebSocket protocol error from %s: %s",
+                                client->remote_address_string,
+                                error->message);
+                }
+                pcx_error_free(error);
+                return false;
+        }
+
+        return false;
+}
+
+static bool
+read_from_client(struct pcx_router_client *client)
+{
+        if (client->state == PCX_ROUTER_CLIENT_STATE_HANDSHAKE) {
+                uint8_t buf[1024];
+                ssize_t got = read(client->client_sock, buf, sizeof buf);
+
+                if (got == -1) {
+                        if (errno == EAGAIN ||
+                            errno == EWOULDBLOCK ||
+                            errno == EINTR)
+                                return true;
+
+                        pcx_log("Error reading from socket for %s: %s",
+                                client->remote_address_string,
+                                strerror(errno));
+                        return false;
+                }
+
+                if (got == 0) {
+                        client->client_eof = true;
+                        return true;
+                }
+
+                return handle_ws_data(client, buf, got);
+        }
+
+        ssize_t got = read_into_buffer(client,
+                                       client->client_sock,
+                                       &client->to_backend,
+                                       &client->client_eof);
+
+        if (got == -1)
+                return false;
+
+        if (got > 0 && client->state == PCX_ROUTER_CLIENT_STATE_FIRST_MESSAGE)
+                return process_first_message(client);
+
+        return true;
+}
+
+static void
+client_sock_cb(struct pcx_main_context_source *source,
+               int fd,
+               enum pcx_main_context_poll_flags flags,
+               void *user_data)
+{
+        struct pcx_router_client *client = user_data;
+
+        if ((flags & PCX_MAIN_CONTEXT_POLL_OUT) &&
+            !write_buffer(client, client->client_sock, &client->to_client))
+                goto error;
+
+        if ((flags & (PCX_MAIN_CONTEXT_POLL_IN |
+                      PCX_MAIN_CONTEXT_POLL_ERROR)) &&
+            !read_from_client(client))
+                goto error;
+
+        check_finished(client);
+
+        return;
+
+error:
+        free_client(client);
+}
+
+static bool
+handle_backend_reply(struct pcx_router_client *client)
+{
+        struct pcx_buffer *reply = &client->backend_reply;
+        size_t header_length = 0;
+
+        for (size_t i = sizeof ws_header_postfix - 1;
+             i <= reply->length;
+             i++) {
+                if (!memcmp(reply->data + i - (sizeof ws_header_postfix - 1),
+                            ws_header_postfix,
+                            sizeof ws_header_postfix - 1)) {
+                        header_length = i;
+                        break;
+                }
+        }
+
+        if (header_length == 0) {
+                if (reply->length > MAX_BACKEND_REPLY_SIZE) {
+                        pcx_log("The backend sent a reply that is too long "
+                                "for %s",
+                                client->remote_address_string);
+                        return false;
+                }
+
+                return true;
+        }
+
+        if (reply->length < sizeof backend_reply_prefix - 1 ||
+            memcmp(reply->data,
+                   backend_reply_prefix,
+                   sizeof backend_reply_prefix - 1)) {
+                pcx_log("The backend didn’t accept the WebSocket connection "
+                        "for %s",
+                        client->remote_address_string);
+                return false;
+        }
+
+        /* Throw away the reply because the client has already had
+         * one. Anything after it is frames for the client.
+         */
+        pcx_buffer_append(&client->to_client,
+                          reply->data + header_length,
+                          reply->length - header_length);
+        pcx_buffer_set_length(reply, 0);
+
+        client->state = PCX_ROUTER_CLIENT_STATE_FORWARDING;
+
+        pcx_main_context_remove_source(client->timeout_source);
+        client->timeout_source = NULL;
+
+        return true;
+}
+
+static bool
+read_from_backend(struct pcx_router_client *client)
+{
+        if (client->state == PCX_ROUTER_CLIENT_STATE_BACKEND_HANDSHAKE) {
+                if (read_into_buffer(client,
+                                     client->backend_sock,
+                                     &client->backend_reply,
+                                     &client->backend_eof) == -1)
+                        return false;
+
+                return handle_backend_reply(client);
+        }
+
+        return read_into_buffer(client,
+                                client->backend_sock,
+                                &client->to_client,
+                                &client->backend_eof) != -1;
+}
+
+static bool
+finish_connect(struct pcx_router_client *client)
+{
+        int value;
+        socklen_t value_len = sizeof value;
+
+        if (getsockopt(client->backend_sock,
+                       SOL_SOCKET,
+                       SO_ERROR,
+                       &value,
+                       &value_len) == -1)
+                value = errno;
+
+        if (value != 0) {
+                size_t n_backends;
+                const struct pcx_router_backend *backend =
+                        get_backends(client->router, &n_backends) +
+                        client->backend_num;
+
+                pcx_log("Error connecting to %s for %s: %s",
+                        backend->address_string,
+                        client->remote_address_string,
+                        strerror(value));
+                return false;
+        }
+
+        client->state = PCX_ROUTER_CLIENT_STATE_BACKEND_HANDSHAKE;
+
+        return true;
+}
+
+static void
+backend_sock_cb(struct pcx_main_context_source *source,
+                int fd,
+                enum pcx_main_context_poll_flags flags,
+                void *user_data)
+{
+        struct pcx_router_client *client = user_data;
+
+        if (client->state == PCX_ROUTER_CLIENT_STATE_CONNECTING) {
+                if (!finish_connect(client))
+                        goto error;
+                flags |= PCX_MAIN_CONTEXT_POLL_OUT;
+        }
+
+        if ((flags & PCX_MAIN_CONTEXT_POLL_OUT) &&
+            !write_buffer(client, client->backend_sock, &client->to_backend))
+                goto error;
+
+        if ((flags & (PCX_MAIN_CONTEXT_POLL_IN |
+                      PCX_MAIN_CONTEXT_POLL_ERROR)) &&
+            !read_from_backend(client))
+                goto error;
+
+        check_finished(client);
+
+        return;
+
+error:
+        free_client(client);
+}
+
+static void
+accept_client(struct pcx_router_socket *rsocket)
+{
+        struct pcx_netaddress_native native_address;
+
+        native_address.length = sizeof native_address.sockaddr_in6;
+
+        int sock = accept(rsocket->sock,
+                          &native_address.sockaddr,
+                          &native_address.length);
+
+        if (sock == -1) {
+                pcx_log("Error accepting connection: %s", strerror(errno));
+                return;
+        }
+
+        struct pcx_error *error = NULL;
+
+        if (!pcx_socket_set_nonblock(sock, &error)) {
+                pcx_log("Error setting socket non-blocking: %s",
+                        error->message);
+                pcx_error_free(error);
+                pcx_close(sock);
+                return;
+        }
+
+        struct pcx_router_client *client = pcx_calloc(sizeof *client);
+
+        client->router = rsocket->router;
+        client->state = PCX_ROUTER_CLIENT_STATE_HANDSHAKE;
+        client->client_sock = sock;
+        client->backend_sock = -1;
+
+        pcx_netaddress_from_native(&client->remote_address, &native_address);
+        client->remote_address_string =
+                pcx_netaddress_to_string(&client->remote_address);
+
+        native_address.length = sizeof native_address.sockaddr_in6;
+
+        if (getsockname(sock,
+                        &native_address.sockaddr,
+                        &native_address.length) == -1) {
+                /* The header will be LOCAL instead */
+                client->local_address.family = AF_UNSPEC;
+        } else {
+                pcx_netaddress_from_native(&client->local_address,
+                                           &native_address);
+        }
+
+        pcx_buffer_init(&client->to_backend);
+        pcx_buffer_init(&client->to_client);
+        pcx_buffer_init(&client->backend_reply);
+
+        client->ws_parser = pcx_ws_parser_new(&ws_parser_vtable, client);
+
+        client->client_source =
+                pcx_main_context_add_poll(NULL,
+                                          sock,
+                                          PCX_MAIN_CONTEXT_POLL_IN,
+                                          client_sock_cb,
+                                          client);
+        client->timeout_source =
+                pcx_main_context_add_timeout(NULL,
+                                             SETUP_TIMEOUT,
+                                             timeout_cb,
+                                             client);
+
+        pcx_list_insert(&rsocket->router->clients, &client->link);
+}
+
+static void
+listen_sock_cb(struct pcx_main_context_source *source,
+               int fd,
+               enum pcx_main_context_poll_flags flags,
+               void *user_data)
+{
+        accept_client(user_data);
+}
+
+struct pcx_router *
+pcx_router_new(void)
+{
+        struct pcx_router *router = pcx_calloc(sizeof *router);
+
+        pcx_list_init(&router->sockets);
+        pcx_list_init(&router->clients);
+        pcx_buffer_init(&router->backends);
+        router->ring = pcx_hash_ring_new();
+
+        return router;
+}
+
+bool
+pcx_router_add_backend(struct pcx_router *router,
+                       const char *address,
+                       int shard,
+                       struct pcx_error **error)
+{
+        size_t n_backends;
+        const struct pcx_router_backend *backends =
+                get_backends(router, &n_backends);
+
+        for (size_t i = 0; i < n_backends; i++) {
+                if (backends[i].shard == shard) {
+                        pcx_set_error(error,
+                                      &pcx_router_error,
+                                      PCX_ROUTER_ERROR_DUPLICATE_SHARD,
+                                      "The shard %i is used by more than "
+                                      "one backend",
+                                      shard);
+                        return false;
+                }
+        }
+
+        struct pcx_router_backend backend = {
+                .shard = shard,
+        };
+
+        if (!pcx_netaddress_from_string(&backend.address,
+                                        address,
+                                        DEFAULT_BACKEND_PORT)) {
+                pcx_set_error(error,
+                              &pcx_router_error,
+                              PCX_ROUTER_ERROR_INVALID_ADDRESS,
+                              "The backend address %s is invalid",
+                              address);
+                return false;
+        }
+
+        backend.address_string = pcx_netaddress_to_string(&backend.address);
+
+        /* The backend is named by its address on the ring so that
+         * the order they are given in doesn’t matter.
+         */
+        pcx_hash_ring_add_node(router->ring,
+                               n_backends,
+                               backend.address_string);
+
+        pcx_buffer_append(&router->backends, &backend, sizeof backend);
+
+        return true;
+}
+
+void
+pcx_router_add_listen_socket(struct pcx_router *router,
+                             int sock)
+{
+        struct pcx_router_socket *rsocket = pcx_calloc(sizeof *rsocket);
+
+        rsocket->router = router;
+        rsocket->sock = sock;
+        rsocket->source = pcx_main_context_add_poll(NULL,
+                                                    sock,
+                                                    PCX_MAIN_CONTEXT_POLL_IN,
+                                                    listen_sock_cb,
+                                                    rsocket);
+
+        pcx_list_insert(&router->sockets, &rsocket->link);
+}
+
+void
+pcx_router_free(struct pcx_router *router)
+{
+        struct pcx_router_client *client, *tmp_client;
+
+        pcx_list_for_each_safe(client, tmp_client, &router->clients, link)
+                free_client(client);
+
+        struct pcx_router_socket *rsocket, *tmp_socket;
+
+        pcx_list_for_each_safe(rsocket, tmp_socket, &router->sockets, link) {
+                pcx_main_context_remove_source(rsocket->source);
+                pcx_close(rsocket->sock);
+                pcx_free(rsocket);
+        }
+
+        size_t n_backends;
+        struct pcx_router_backend *backends =
+                get_backends(router, &n_backends);
+
+        for (size_t i = 0; i < n_backends; i++)
+                pcx_free(backends[i].address_string);
+
+        pcx_buffer_destroy(&router->backends);
+        pcx_hash_ring_free(router->ring);
+
+        pcx_free(router);
+}
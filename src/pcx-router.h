@@ -0,0 +1,71 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PCX_ROUTER_H
+#define PCX_ROUTER_H
+
+#include <stdbool.h>
+
+#include "pcx-error.h"
+
+/* Sits in front of several servers and sends each WebSocket
+ * connection to one of them. The router does the WebSocket handshake
+ * with the client itself and waits for the first message. It then
+ * picks a server based on that message, sends it a PROXY protocol
+ * header with the client’s address, does its own handshake with the
+ * server and after that just copies the bytes in both directions.
+ *
+ * Messages with an ID go to the server with the shard number in the
+ * ID. IDs from unknown shards can’t belong to any of the servers so
+ * the connection is closed. Everything else is shared between the
+ * servers with consistent hashing. New players are hashed by the game
+ * type and language so that they meet the other players waiting for
+ * the same game.
+ */
+
+struct pcx_router;
+
+extern struct pcx_error_domain
+pcx_router_error;
+
+enum pcx_router_error {
+        PCX_ROUTER_ERROR_INVALID_ADDRESS,
+        PCX_ROUTER_ERROR_DUPLICATE_SHARD,
+};
+
+struct pcx_router *
+pcx_router_new(void);
+
+/* Each backend needs a different shard number which must match the
+ * shard in the server’s config.
+ */
+bool
+pcx_router_add_backend(struct pcx_router *router,
+                       const char *address,
+                       int shard,
+                       struct pcx_error **error);
+
+/* Takes ownership of the listen socket */
+void
+pcx_router_add_listen_socket(struct pcx_router *router,
+                             int sock);
+
+void
+pcx_router_free(struct pcx_router *router);
+
+#endif /* PCX_ROUTER_H */
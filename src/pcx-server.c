@@ -27,6 +27,7 @@
 #include <inttypes.h>
 #include <stdbool.h>
 #include <fcntl.h>
+#include <sys/socket.h>
 #include <openssl/ssl.h>
 
 #include "pcx-util.h"
@@ -47,6 +48,21 @@
 #include "pcx-generate-id.h"
 #include "pcx-ssl-error.h"
 #include "pcx-listen-socket.h"
+#include "pcx-rate-limit.h"
+#include "pcx-lobby.h"
+#include "pcx-matchmaker.h"
+#include "pcx-snapshot.h"
+#include "pcx-metrics.h"
+#include "pcx-admin.h"
+#include "pcx-static-root.h"
+#include "pcx-address-count.h"
+
+/* Start of the file written by pcx_server_save_state. The version
+ * needs to be bumped whenever the format of the conversations or any
+ * of the games changes.
+ */
+#define PCX_SERVER_STATE_MAGIC "PCXSTATE"
+#define PCX_SERVER_STATE_VERSION 3
 
 #define DEFAULT_PORT 3648
 #define DEFAULT_SSL_PORT (DEFAULT_PORT + 1)
@@ -56,9 +72,39 @@
  */
 #define MAX_CLIENT_AGE ((uint64_t) 2 * 60 * 1000000)
 
+/* Number of microseconds of inactivity before a client that has
+ * joined a game can be disconnected to make room for a new client
+ * when we run out of file descriptors. The web client sends a keep
+ * alive message every minute so this should only catch dead
+ * connections.
+ */
+#define MIN_SHED_CLIENT_AGE ((uint64_t) 90 * 1000000)
+
+static const char
+busy_response[] =
+        "HTTP/1.1 503 Service Unavailable\r\n"
+        "Retry-After: 5\r\n"
+        "Content-Length: 0\r\n"
+        "Connection: close\r\n"
+        "\r\n";
+
 struct pcx_error_domain
 pcx_server_error;
 
+/* Chained hash table of conversations. The entries are embedded in
+ * the structs that track the conversations.
+ */
+struct pcx_server_conversation_hash_entry {
+        uint64_t hash;
+        struct pcx_server_conversation_hash_entry *next;
+};
+
+struct pcx_server_conversation_hash {
+        int n_entries;
+        int size;
+        struct pcx_server_conversation_hash_entry **table;
+};
+
 struct pcx_server {
         const struct pcx_config *config;
         struct pcx_class_store *class_store;
@@ -66,12 +112,80 @@ struct pcx_server {
         struct pcx_list sockets;
         struct pcx_list clients;
 
+        /* Number of clients that haven’t joined a game yet */
+        int n_pending_clients;
+
         struct pcx_playerbase *playerbase;
 
         /* If there is a game that hasn’t started yet then it will be
          * stored here so that people can join it.
          */
         struct pcx_list pending_conversations;
+
+        /* Indices of the pending conversations. The public ones are
+         * keyed by the game type and language and the private ones
+         * are keyed by the private game ID.
+         */
+        struct pcx_server_conversation_hash public_conversations;
+        struct pcx_server_conversation_hash private_conversations;
+
+        /* Every conversation keyed by its spectate ID */
+        struct pcx_server_conversation_hash spectatable_conversations;
+
+        /* Live conversations and players keyed by the address of the
+         * client that created them
+         */
+        struct pcx_address_count *conversation_counts;
+        struct pcx_address_count *player_counts;
+
+        /* Number of clients that were refused a game because of the
+         * limits on the conversations and players
+         */
+        int n_refused_players;
+
+        /* List of the public pending conversations for the clients */
+        struct pcx_lobby *lobby;
+
+        struct pcx_matchmaker *matchmaker;
+
+        /* An fd that is kept open only so that it can be closed when
+         * we run out of file descriptors in order to have room to
+         * accept a connection and reply to it. This is -1 if it
+         * couldn’t be opened.
+         */
+        int reserve_fd;
+
+        /* Listen sockets handed over from the old process during a
+         * live upgrade that haven’t been claimed by a config yet.
+         */
+        struct pcx_list inherited_sockets;
+
+        /* Reused for every request for the metrics. It is only
+         * rendered again once none of the clients are still sending
+         * the previous version.
+         */
+        struct pcx_buffer metrics_buffer;
+        int n_metrics_clients;
+
+        /* Reused to build the headers for the static files */
+        struct pcx_buffer http_headers;
+
+        pcx_server_metrics_cb metrics_cb;
+        void *metrics_cb_user_data;
+
+        pcx_server_state_changed_cb state_changed_cb;
+        void *state_changed_cb_user_data;
+
+        /* Set when the program is waiting for the games to finish so
+         * that it can quit. New games are refused.
+         */
+        bool draining;
+};
+
+struct pcx_server_inherited_socket {
+        struct pcx_list link;
+        char *key;
+        int fd;
 };
 
 struct pcx_server_client {
@@ -79,12 +193,53 @@ struct pcx_server_client {
         struct pcx_connection *connection;
         struct pcx_listener event_listener;
         struct pcx_server *server;
+
+        /* The socket that accepted the client. This will be set to
+         * NULL if the socket is freed before the client.
+         */
+        struct pcx_server_socket *ssocket;
+
+        /* True until the client is attached to a player */
+        bool is_pending;
+
+        /* True if the client is being sent the metrics buffer */
+        bool is_metrics;
+
+        /* Timeout that disconnects the client if it doesn’t finish
+         * the WebSocket handshake in time.
+         */
+        struct pcx_main_context_source *handshake_timeout_source;
 };
 
 struct pcx_server_pending_conversation {
         struct pcx_list link;
         struct pcx_conversation *conversation;
         struct pcx_listener listener;
+        struct pcx_server *server;
+
+        struct pcx_server_conversation_hash_entry hash_entry;
+
+        /* The entries in the lobby and the matchmaker. These are
+         * NULL for private conversations.
+         */
+        struct pcx_lobby_game *lobby_game;
+        struct pcx_matchmaker_lobby *matchmaker_lobby;
+};
+
+/* This doesn’t hold a reference on the conversation. Instead it is
+ * removed when the conversation is destroyed.
+ */
+struct pcx_server_spectatable_conversation {
+        struct pcx_conversation *conversation;
+        struct pcx_listener listener;
+        struct pcx_server *server;
+
+        struct pcx_server_conversation_hash_entry hash_entry;
+
+        /* Address of the client that created the conversation. The
+         * family is AF_UNSPEC for restored conversations.
+         */
+        struct pcx_netaddress creator_address;
 };
 
 struct pcx_server_socket {
@@ -93,20 +248,81 @@ struct pcx_server_socket {
         struct pcx_main_context_source *listen_source;
         SSL_CTX *ssl_ctx;
         struct pcx_server *server;
+        const struct pcx_config_server *config;
+
+        /* Per-IP token buckets. These are NULL if the limit is
+         * disabled.
+         */
+        struct pcx_rate_limit *connection_limit;
+        struct pcx_rate_limit *handshake_limit;
+
+        /* Files to serve to plain HTTP requests or NULL */
+        struct pcx_static_root *static_root;
 };
 
 static void
 queue_gc_source(struct pcx_server *server);
 
+static void
+open_reserve_fd(struct pcx_server *server)
+{
+        if (server->reserve_fd != -1)
+                return;
+
+        server->reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+}
+
+static void
+close_reserve_fd(struct pcx_server *server)
+{
+        if (server->reserve_fd == -1)
+                return;
+
+        pcx_close(server->reserve_fd);
+        server->reserve_fd = -1;
+}
+
+static void
+remove_handshake_timeout(struct pcx_server_client *client)
+{
+        if (client->handshake_timeout_source == NULL)
+                return;
+
+        pcx_main_context_remove_source(client->handshake_timeout_source);
+        client->handshake_timeout_source = NULL;
+}
+
+static void
+set_client_joined(struct pcx_server *server,
+                  struct pcx_server_client *client)
+{
+        if (!client->is_pending)
+                return;
+
+        client->is_pending = false;
+        server->n_pending_clients--;
+}
+
 static void
 remove_client(struct pcx_server *server,
               struct pcx_server_client *client)
 {
+        remove_handshake_timeout(client);
+        set_client_joined(server, client);
+
+        if (client->is_metrics)
+                server->n_metrics_clients--;
+
         pcx_connection_free(client->connection);
 
         pcx_list_remove(&client->link);
         pcx_free(client);
 
+        /* Now that there is a free fd we can try to get the reserve
+         * back if we had to give it up.
+         */
+        open_reserve_fd(server);
+
         /* If we remove a connection then any previous disabled accept
          * might start working again.
          */
@@ -122,6 +338,19 @@ remove_client(struct pcx_server *server,
         }
 }
 
+static void
+gc_rate_limits(struct pcx_server *server)
+{
+        struct pcx_server_socket *ssocket;
+
+        pcx_list_for_each(ssocket, &server->sockets, link) {
+                if (ssocket->connection_limit)
+                        pcx_rate_limit_gc(ssocket->connection_limit);
+                if (ssocket->handshake_limit)
+                        pcx_rate_limit_gc(ssocket->handshake_limit);
+        }
+}
+
 static void
 gc_cb(struct pcx_main_context_source *source,
       void *user_data)
@@ -133,6 +362,8 @@ gc_cb(struct pcx_main_context_source *source,
 
         server->gc_source = NULL;
 
+        gc_rate_limits(server);
+
         pcx_list_for_each_safe(client, tmp, &server->clients, link) {
                 struct pcx_connection *conn = client->connection;
                 uint64_t update_time =
@@ -166,9 +397,121 @@ queue_gc_source(struct pcx_server *server)
                                              server);
 }
 
+static void
+conversation_hash_init(struct pcx_server_conversation_hash *hash)
+{
+        hash->n_entries = 0;
+        hash->size = 8;
+        hash->table = pcx_calloc(hash->size * sizeof *hash->table);
+}
+
+static void
+conversation_hash_insert_entry(struct pcx_server_conversation_hash *hash,
+                               struct pcx_server_conversation_hash_entry *entry)
+{
+        int pos = entry->hash & (hash->size - 1);
+
+        entry->next = hash->table[pos];
+        hash->table[pos] = entry;
+}
+
+static void
+conversation_hash_resize(struct pcx_server_conversation_hash *hash,
+                         int new_size)
+{
+        struct pcx_server_conversation_hash_entry **old_table = hash->table;
+        int old_size = hash->size;
+
+        hash->size = new_size;
+        hash->table = pcx_calloc(new_size * sizeof *hash->table);
+
+        for (int i = 0; i < old_size; i++) {
+                struct pcx_server_conversation_hash_entry *entry, *next;
+
+                for (entry = old_table[i]; entry; entry = next) {
+                        next = entry->next;
+                        conversation_hash_insert_entry(hash, entry);
+                }
+        }
+
+        pcx_free(old_table);
+}
+
+static void
+conversation_hash_add(struct pcx_server_conversation_hash *hash,
+                      struct pcx_server_conversation_hash_entry *entry)
+{
+        if (hash->n_entries + 1 > hash->size * 3 / 4)
+                conversation_hash_resize(hash, hash->size * 2);
+
+        conversation_hash_insert_entry(hash, entry);
+
+        hash->n_entries++;
+}
+
+static void
+conversation_hash_remove(struct pcx_server_conversation_hash *hash,
+                         struct pcx_server_conversation_hash_entry *entry)
+{
+        struct pcx_server_conversation_hash_entry **prev =
+                hash->table + (entry->hash & (hash->size - 1));
+
+        while (true) {
+                assert(*prev);
+
+                if (*prev == entry)
+                        break;
+
+                prev = &(*prev)->next;
+        }
+
+        *prev = entry->next;
+
+        hash->n_entries--;
+
+        if (hash->size > 8 && hash->n_entries < hash->size / 4)
+                conversation_hash_resize(hash, hash->size / 2);
+}
+
+static struct pcx_server_conversation_hash_entry *
+conversation_hash_get_chain(struct pcx_server_conversation_hash *hash,
+                            uint64_t hash_value)
+{
+        return hash->table[hash_value & (hash->size - 1)];
+}
+
+static uint64_t
+get_public_hash(const struct pcx_game *game_type,
+                enum pcx_text_language language)
+{
+        return pcx_hash_uint64((uint64_t) (uintptr_t) game_type ^
+                               ((uint64_t) language << 56));
+}
+
+static uint64_t
+get_private_hash(uint64_t private_game_id)
+{
+        return pcx_hash_uint64(private_game_id);
+}
+
+static struct pcx_server_conversation_hash *
+get_conversation_hash(struct pcx_server *server,
+                      struct pcx_server_pending_conversation *pc)
+{
+        return (pc->conversation->is_private ?
+                &server->private_conversations :
+                &server->public_conversations);
+}
+
 static void
 remove_pending_conversation(struct pcx_server_pending_conversation *pc)
 {
+        conversation_hash_remove(get_conversation_hash(pc->server, pc),
+                                 &pc->hash_entry);
+        if (pc->lobby_game)
+                pcx_lobby_remove_game(pc->server->lobby, pc->lobby_game);
+        if (pc->matchmaker_lobby)
+                pcx_matchmaker_remove_lobby(pc->matchmaker_lobby);
         pcx_list_remove(&pc->listener.link);
         pcx_conversation_unref(pc->conversation);
         pcx_list_remove(&pc->link);
@@ -187,6 +530,8 @@ pending_conversation_event_cb(struct pcx_listener *listener,
 
         switch (event->type) {
         case PCX_CONVERSATION_EVENT_STARTED:
+                if (pc->matchmaker_lobby)
+                        pcx_matchmaker_lobby_started(pc->matchmaker_lobby);
                 remove_pending_conversation(pc);
                 break;
         case PCX_CONVERSATION_EVENT_PLAYER_ADDED:
@@ -195,6 +540,13 @@ pending_conversation_event_cb(struct pcx_listener *listener,
                  * from the pending conversation so we don’t need to
                  * handle it here.
                  */
+                if (pc->lobby_game) {
+                        pcx_lobby_set_n_players(pc->server->lobby,
+                                                pc->lobby_game,
+                                                pc->conversation->n_players);
+                }
+                if (pc->matchmaker_lobby)
+                        pcx_matchmaker_player_added(pc->matchmaker_lobby);
                 break;
         case PCX_CONVERSATION_EVENT_PLAYER_REMOVED:
                 /* If a player has been removed then the game will
@@ -205,16 +557,114 @@ pending_conversation_event_cb(struct pcx_listener *listener,
                 break;
         case PCX_CONVERSATION_EVENT_NEW_MESSAGE:
         case PCX_CONVERSATION_EVENT_SIDEBAND_DATA_MODIFIED:
+        case PCX_CONVERSATION_EVENT_DESTROYED:
                 break;
         }
 
         return true;
 }
 
+static void
+state_changed(struct pcx_server *server)
+{
+        if (server->state_changed_cb)
+                server->state_changed_cb(server->state_changed_cb_user_data);
+}
+
+static bool
+spectatable_conversation_event_cb(struct pcx_listener *listener,
+                                  void *data)
+{
+        struct pcx_server_spectatable_conversation *sc =
+               pcx_container_of(listener,
+                                struct pcx_server_spectatable_conversation,
+                                listener);
+        const struct pcx_conversation_event *event = data;
+
+        /* Every conversation on the server is spectatable so this
+         * sees all of the changes to the games.
+         */
+        state_changed(sc->server);
+
+        if (event->type != PCX_CONVERSATION_EVENT_DESTROYED)
+                return true;
+
+        conversation_hash_remove(&sc->server->spectatable_conversations,
+                                 &sc->hash_entry);
+        pcx_address_count_decrement(sc->server->conversation_counts,
+                                    &sc->creator_address);
+        pcx_list_remove(&sc->listener.link);
+        pcx_free(sc);
+
+        return true;
+}
+
+static struct pcx_conversation *
+find_spectatable_conversation(struct pcx_server *server,
+                              uint64_t id)
+{
+        struct pcx_server_conversation_hash_entry *entry =
+                conversation_hash_get_chain(&server->spectatable_conversations,
+                                            pcx_hash_uint64(id));
+
+        for (; entry; entry = entry->next) {
+                struct pcx_server_spectatable_conversation *sc =
+                        pcx_container_of(entry,
+                                         struct
+                                         pcx_server_spectatable_conversation,
+                                         hash_entry);
+
+                if (sc->conversation->spectate_id == id)
+                        return sc->conversation;
+        }
+
+        return NULL;
+}
+
+static void
+register_spectatable_conversation(struct pcx_server *server,
+                                  struct pcx_conversation *conv,
+                                  const struct pcx_netaddress *creator_address)
+{
+        struct pcx_server_spectatable_conversation *sc = pcx_alloc(sizeof *sc);
+
+        sc->server = server;
+        sc->conversation = conv;
+        sc->creator_address = *creator_address;
+        pcx_address_count_increment(server->conversation_counts,
+                                    creator_address);
+        sc->listener.notify = spectatable_conversation_event_cb;
+        pcx_signal_add(&conv->event_signal, &sc->listener);
+
+        sc->hash_entry.hash = pcx_hash_uint64(conv->spectate_id);
+        conversation_hash_add(&server->spectatable_conversations,
+                              &sc->hash_entry);
+}
+
+static void
+add_spectatable_conversation(struct pcx_server *server,
+                             struct pcx_conversation *conv,
+                             const struct pcx_netaddress *remote_address)
+{
+        uint64_t id;
+
+        do {
+                id = pcx_generate_id(server->config->shard,
+                                     remote_address);
+        } while (find_spectatable_conversation(server, id));
+
+        conv->spectate_id = id;
+
+        register_spectatable_conversation(server, conv, remote_address);
+}
+
 static struct pcx_server_pending_conversation *
 add_pending_conversation(struct pcx_server *server,
                          const struct pcx_game *game_type,
-                         enum pcx_text_language language)
+                         enum pcx_text_language language,
+                         bool is_private,
+                         uint64_t private_game_id,
+                         const struct pcx_netaddress *remote_address)
 {
         struct pcx_conversation *conv =
                 pcx_conversation_new(server->config,
@@ -223,32 +673,85 @@ add_pending_conversation(struct pcx_server *server,
                                      language);
         struct pcx_server_pending_conversation *pc = pcx_alloc(sizeof *pc);
 
+        conv->is_private = is_private;
+        conv->private_game_id = private_game_id;
+
+        pc->server = server;
         pc->conversation = conv;
         pc->listener.notify = pending_conversation_event_cb;
         pcx_signal_add(&conv->event_signal,
                        &pc->listener);
         pcx_list_insert(&server->pending_conversations, &pc->link);
 
+        add_spectatable_conversation(server, conv, remote_address);
+
+        if (is_private) {
+                pc->hash_entry.hash = get_private_hash(private_game_id);
+                conversation_hash_add(&server->private_conversations,
+                                      &pc->hash_entry);
+                pc->lobby_game = NULL;
+                pc->matchmaker_lobby = NULL;
+        } else {
+                pc->hash_entry.hash = get_public_hash(game_type, language);
+                conversation_hash_add(&server->public_conversations,
+                                      &pc->hash_entry);
+                pc->lobby_game = pcx_lobby_add_game(server->lobby,
+                                                    conv->spectate_id,
+                                                    game_type,
+                                                    language,
+                                                    conv->n_players);
+                pc->matchmaker_lobby =
+                        pcx_matchmaker_add_lobby(server->matchmaker, conv);
+        }
+
         return pc;
 }
 
 static struct pcx_conversation *
-get_pending_conversation(struct pcx_server *server,
-                         const struct pcx_game *game_type,
-                         enum pcx_text_language language)
+find_pending_conversation(struct pcx_server *server,
+                          const struct pcx_game *game_type,
+                          enum pcx_text_language language)
 {
-        struct pcx_server_pending_conversation *pc;
+        uint64_t hash = get_public_hash(game_type, language);
+        struct pcx_server_conversation_hash_entry *entry;
+        struct pcx_server_pending_conversation *pc, *best = NULL;
+
+        for (entry = conversation_hash_get_chain(&server->public_conversations,
+                                                 hash);
+             entry;
+             entry = entry->next) {
+                pc = pcx_container_of(entry,
+                                      struct pcx_server_pending_conversation,
+                                      hash_entry);
+
+                if (pc->conversation->game_type != game_type ||
+                    pc->conversation->language != language)
+                        continue;
 
-        pcx_list_for_each(pc, &server->pending_conversations, link) {
-                if (!pc->conversation->is_private &&
-                    pc->conversation->game_type == game_type &&
-                    pc->conversation->language == language)
-                        goto found_conversation;
+                if (pcx_matchmaker_is_better(pc->matchmaker_lobby,
+                                             best ?
+                                             best->matchmaker_lobby :
+                                             NULL))
+                        best = pc;
         }
 
-        pc = add_pending_conversation(server, game_type, language);
+        return best ? best->conversation : NULL;
+}
+
+static struct pcx_conversation *
+add_public_conversation(struct pcx_server *server,
+                        const struct pcx_game *game_type,
+                        enum pcx_text_language language,
+                        const struct pcx_netaddress *remote_address)
+{
+        struct pcx_server_pending_conversation *pc =
+                add_pending_conversation(server,
+                                         game_type,
+                                         language,
+                                         false, /* is_private */
+                                         0, /* private_game_id */
+                                         remote_address);
 
-found_conversation:
         return pc->conversation;
 }
 
@@ -256,11 +759,51 @@ static struct pcx_server_pending_conversation *
 find_private_conversation(struct pcx_server *server,
                           uint64_t id)
 {
-        struct pcx_server_pending_conversation *pc;
+        uint64_t hash = get_private_hash(id);
+        struct pcx_server_conversation_hash_entry *entry;
+
+        for (entry = conversation_hash_get_chain(&server->private_conversations,
+                                                 hash);
+             entry;
+             entry = entry->next) {
+                struct pcx_server_pending_conversation *pc =
+                        pcx_container_of(entry,
+                                         struct pcx_server_pending_conversation,
+                                         hash_entry);
+
+                if (pc->conversation->private_game_id == id)
+                        return pc;
+        }
+
+        return NULL;
+}
+
+/* Finds a public pending conversation using the ID that it has in
+ * the lobby list.
+ */
+static struct pcx_server_pending_conversation *
+find_lobby_conversation(struct pcx_server *server,
+                        uint64_t id)
+{
+        struct pcx_conversation *conv =
+                find_spectatable_conversation(server, id);
+
+        if (conv == NULL || conv->is_private)
+                return NULL;
+
+        uint64_t hash = get_public_hash(conv->game_type, conv->language);
+        struct pcx_server_conversation_hash_entry *entry;
+
+        for (entry = conversation_hash_get_chain(&server->public_conversations,
+                                                 hash);
+             entry;
+             entry = entry->next) {
+                struct pcx_server_pending_conversation *pc =
+                        pcx_container_of(entry,
+                                         struct pcx_server_pending_conversation,
+                                         hash_entry);
 
-        pcx_list_for_each(pc, &server->pending_conversations, link) {
-                if (pc->conversation->is_private &&
-                    pc->conversation->private_game_id == id)
+                if (pc->conversation == conv)
                         return pc;
         }
 
@@ -273,18 +816,20 @@ add_private_conversation(struct pcx_server *server,
                          enum pcx_text_language language,
                          const struct pcx_netaddress *remote_address)
 {
-        struct pcx_server_pending_conversation *pc =
-                add_pending_conversation(server, game_type, language);
-
-        pc->conversation->is_private = true;
-
         uint64_t id;
 
         do {
-                id = pcx_generate_id(remote_address);
+                id = pcx_generate_id(server->config->shard,
+                                     remote_address);
         } while (find_private_conversation(server, id));
 
-        pc->conversation->private_game_id = id;
+        struct pcx_server_pending_conversation *pc =
+                add_pending_conversation(server,
+                                         game_type,
+                                         language,
+                                         true, /* is_private */
+                                         id,
+                                         remote_address);
 
         return pc->conversation;
 }
@@ -327,7 +872,8 @@ watch_conversation(struct pcx_server *server,
         uint64_t id;
 
         do {
-                id = pcx_generate_id(remote_address);
+                id = pcx_generate_id(server->config->shard,
+                                     remote_address);
         } while (pcx_playerbase_get_player_by_id(server->playerbase, id));
 
         struct pcx_player *player =
@@ -336,61 +882,188 @@ watch_conversation(struct pcx_server *server,
                                           name,
                                           id);
 
+        player->address = *remote_address;
+        pcx_address_count_increment(server->player_counts, remote_address);
+
         pcx_connection_set_player(client->connection,
                                   player,
                                   0 /* n_messages_received */);
+
+        set_client_joined(server, client);
+}
+
+static void
+player_removed_cb(struct pcx_player *player,
+                  void *user_data)
+{
+        struct pcx_server *server = user_data;
+
+        pcx_address_count_decrement(server->player_counts, &player->address);
+
+        state_changed(server);
 }
 
+/* The limits only need a few counters so that they can be checked
+ * on every new player without slowing anything down.
+ */
 static bool
-handle_new_player(struct pcx_server *server,
-                  struct pcx_server_client *client,
-                  const struct pcx_connection_new_player_event *event)
+check_player_limits(struct pcx_server *server,
+                    struct pcx_server_client *client)
 {
-        const char *remote_address_string =
-                pcx_connection_get_remote_address_string(client->connection);
-        struct pcx_player *player =
-                pcx_connection_get_player(client->connection);
+        const struct pcx_config *config = server->config;
+        const struct pcx_netaddress *remote_address =
+                pcx_connection_get_remote_address(client->connection);
 
-        if (player != NULL) {
-                pcx_log("Client %s sent multiple hello messages",
-                       remote_address_string);
-                remove_client(server, client);
+        if (config->max_players > 0 &&
+            pcx_playerbase_get_n_players(server->playerbase) >=
+            config->max_players) {
+                pcx_log("Refusing a game to %s because there are too many "
+                        "players",
+                        pcx_connection_get_remote_address_string(client->
+                                                                 connection));
                 return false;
         }
 
-        if (pcx_text_get(event->language,
-                         PCX_TEXT_STRING_START_BUTTON) == NULL ||
-            pcx_text_get(event->language,
-                         event->game_type->start_command) == NULL) {
-                pcx_log("Client %s tried to start a game in a language "
-                        "that it hasn’t been translated to",
-                        remote_address_string);
-                remove_client(server, client);
+        if (config->max_players_per_ip > 0 &&
+            pcx_address_count_get(server->player_counts, remote_address) >=
+            config->max_players_per_ip) {
+                pcx_log("Refusing a game to %s which has too many players",
+                        pcx_connection_get_remote_address_string(client->
+                                                                 connection));
                 return false;
         }
 
-        char *normalised_name = normalise_string(event->name);
+        return true;
+}
 
-        if (normalised_name == NULL) {
-                pcx_log("Client %s sent an invalid name",
-                       remote_address_string);
-                remove_client(server, client);
+static bool
+check_conversation_limits(struct pcx_server *server,
+                          struct pcx_server_client *client)
+{
+        const struct pcx_config *config = server->config;
+        const struct pcx_netaddress *remote_address =
+                pcx_connection_get_remote_address(client->connection);
+
+        if (config->max_conversations > 0 &&
+            server->spectatable_conversations.n_entries >=
+            config->max_conversations) {
+                pcx_log("Refusing a game to %s because there are too many "
+                        "conversations",
+                        pcx_connection_get_remote_address_string(client->
+                                                                 connection));
                 return false;
         }
 
-        struct pcx_conversation *conversation;
-
-        if (event->is_private) {
+        if (config->max_conversations_per_ip > 0 &&
+            pcx_address_count_get(server->conversation_counts,
+                                  remote_address) >=
+            config->max_conversations_per_ip) {
+                pcx_log("Refusing a game to %s which has too many "
+                        "conversations",
+                        pcx_connection_get_remote_address_string(client->
+                                                                 connection));
+                return false;
+        }
+
+        return true;
+}
+
+static bool
+send_server_full(struct pcx_server *server,
+                 struct pcx_server_client *client)
+{
+        server->n_refused_players++;
+
+        int msg = PCX_PROTO_SERVER_FULL;
+        if (!pcx_connection_send_message(client->connection, msg)) {
+                pcx_log("Couldn’t send server full message to %s",
+                        pcx_connection_get_remote_address_string(client->
+                                                                 connection));
+                remove_client(server, client);
+                return false;
+        }
+
+        return true;
+}
+
+static bool
+handle_new_player(struct pcx_server *server,
+                  struct pcx_server_client *client,
+                  const struct pcx_connection_new_player_event *event)
+{
+        const char *remote_address_string =
+                pcx_connection_get_remote_address_string(client->connection);
+
+        if (pcx_connection_get_conversation(client->connection)) {
+                pcx_log("Client %s sent multiple hello messages",
+                       remote_address_string);
+                remove_client(server, client);
+                return false;
+        }
+
+        if (server->draining) {
+                pcx_log("Refusing a new game from %s while draining",
+                        remote_address_string);
+                remove_client(server, client);
+                return false;
+        }
+
+        if (pcx_text_get(event->language,
+                         PCX_TEXT_STRING_START_BUTTON) == NULL ||
+            pcx_text_get(event->language,
+                         event->game_type->start_command) == NULL) {
+                pcx_log("Client %s tried to start a game in a language "
+                        "that it hasn’t been translated to",
+                        remote_address_string);
+                remove_client(server, client);
+                return false;
+        }
+
+        if (!check_player_limits(server, client))
+                return send_server_full(server, client);
+
+        struct pcx_conversation *conversation = NULL;
+
+        if (!event->is_private) {
+                conversation = find_pending_conversation(server,
+                                                         event->game_type,
+                                                         event->language);
+        }
+
+        /* Joining a public game that is already waiting doesn’t need
+         * a new conversation so it is allowed even if the conversation
+         * limit has been reached.
+         */
+        if (conversation == NULL &&
+            !check_conversation_limits(server, client))
+                return send_server_full(server, client);
+
+        char *normalised_name = normalise_string(event->name);
+
+        if (normalised_name == NULL) {
+                pcx_log("Client %s sent an invalid name",
+                       remote_address_string);
+                remove_client(server, client);
+                return false;
+        }
+
+        if (conversation == NULL) {
                 const struct pcx_netaddress *remote_address =
                         pcx_connection_get_remote_address(client->connection);
-                conversation = add_private_conversation(server,
+
+                if (event->is_private) {
+                        conversation =
+                                add_private_conversation(server,
+                                                         event->game_type,
+                                                         event->language,
+                                                         remote_address);
+                } else {
+                        conversation =
+                                add_public_conversation(server,
                                                         event->game_type,
                                                         event->language,
                                                         remote_address);
-        } else {
-                conversation = get_pending_conversation(server,
-                                                        event->game_type,
-                                                        event->language);
+                }
         }
 
         watch_conversation(server, client, normalised_name, conversation);
@@ -400,28 +1073,57 @@ handle_new_player(struct pcx_server *server,
         return true;
 }
 
+/* Logs when a client asks for an ID that was made by another server
+ * so that it is clear that the router in front sent it to the wrong
+ * place.
+ */
+static void
+check_shard(struct pcx_server *server,
+            struct pcx_server_client *client,
+            uint64_t id)
+{
+        int shard = server->config->shard;
+
+        if (shard < 0 || pcx_generate_id_get_shard(id) == shard)
+                return;
+
+        pcx_log("Client %s sent an ID from shard %i but this is shard %i",
+                pcx_connection_get_remote_address_string(client->connection),
+                pcx_generate_id_get_shard(id),
+                shard);
+}
+
 static bool
 handle_join_private_game(struct pcx_server *server,
                          struct pcx_server_client *client,
-                         const struct pcx_connection_join_private_game_event *e)
+                         const struct pcx_connection_join_private_game_event *e,
+                         bool from_lobby)
 {
         const char *remote_address_string =
                 pcx_connection_get_remote_address_string(client->connection);
 
-        struct pcx_player *player =
-                pcx_connection_get_player(client->connection);
-
-        if (player != NULL) {
+        if (pcx_connection_get_conversation(client->connection)) {
                 pcx_log("Client %s sent multiple hello messages",
                         remote_address_string);
                 remove_client(server, client);
                 return false;
         }
 
+        if (server->draining) {
+                pcx_log("Refusing to add %s to a game while draining",
+                        remote_address_string);
+                remove_client(server, client);
+                return false;
+        }
+
         struct pcx_server_pending_conversation *pc =
+                from_lobby ?
+                find_lobby_conversation(server, e->game_id) :
                 find_private_conversation(server, e->game_id);
 
         if (pc == NULL) {
+                check_shard(server, client, e->game_id);
+
                 int msg = PCX_PROTO_PRIVATE_GAME_NOT_FOUND;
                 if (!pcx_connection_send_message(client->connection, msg)) {
                         pcx_log("Couldn’t send game not found message to %s",
@@ -432,6 +1134,9 @@ handle_join_private_game(struct pcx_server *server,
                 return true;
         }
 
+        if (!check_player_limits(server, client))
+                return send_server_full(server, client);
+
         char *normalised_name = normalise_string(e->name);
 
         if (normalised_name == NULL) {
@@ -448,6 +1153,29 @@ handle_join_private_game(struct pcx_server *server,
         return true;
 }
 
+static bool
+handle_lobby_subscribe(struct pcx_server *server,
+                       struct pcx_server_client *client)
+{
+        if (pcx_connection_get_conversation(client->connection)) {
+                pcx_log("Client %s subscribed to the lobby after joining "
+                        "a game",
+                        pcx_connection_get_remote_address_string(client->
+                                                                 connection));
+                remove_client(server, client);
+                return false;
+        }
+
+        pcx_connection_subscribe_lobby(client->connection, server->lobby);
+
+        /* Browsing the lobby is a legitimate use so the client no
+         * longer counts as pending.
+         */
+        set_client_joined(server, client);
+
+        return true;
+}
+
 static bool
 handle_reconnect(struct pcx_server *server,
                  struct pcx_server_client *client,
@@ -455,20 +1183,20 @@ handle_reconnect(struct pcx_server *server,
 {
         const char *remote_address_string =
                 pcx_connection_get_remote_address_string(client->connection);
-        struct pcx_player *player =
-                pcx_connection_get_player(client->connection);
 
-        if (player != NULL) {
+        if (pcx_connection_get_conversation(client->connection)) {
                 pcx_log("Client %s sent multiple hello messages",
                        remote_address_string);
                 remove_client(server, client);
                 return false;
         }
 
-        player = pcx_playerbase_get_player_by_id(server->playerbase,
-                                                 event->player_id);
+        struct pcx_player *player =
+                pcx_playerbase_get_player_by_id(server->playerbase,
+                                                event->player_id);
 
         if (player == NULL) {
+                check_shard(server, client, event->player_id);
                 pcx_log("Client %s tried to reconnect to a non-existent player",
                        remote_address_string);
                 remove_client(server, client);
@@ -479,6 +1207,48 @@ handle_reconnect(struct pcx_server *server,
                                   player,
                                   event->n_messages_received);
 
+        set_client_joined(server, client);
+
+        return true;
+}
+
+static bool
+handle_spectate(struct pcx_server *server,
+                struct pcx_server_client *client,
+                const struct pcx_connection_spectate_event *event)
+{
+        const char *remote_address_string =
+                pcx_connection_get_remote_address_string(client->connection);
+
+        if (pcx_connection_get_conversation(client->connection)) {
+                pcx_log("Client %s sent multiple hello messages",
+                        remote_address_string);
+                remove_client(server, client);
+                return false;
+        }
+
+        struct pcx_conversation *conversation =
+                find_spectatable_conversation(server, event->spectate_id);
+
+        if (conversation == NULL) {
+                check_shard(server, client, event->spectate_id);
+
+                int msg = PCX_PROTO_PRIVATE_GAME_NOT_FOUND;
+                if (!pcx_connection_send_message(client->connection, msg)) {
+                        pcx_log("Couldn’t send game not found message to %s",
+                                remote_address_string);
+                        remove_client(server, client);
+                        return false;
+                }
+                return true;
+        }
+
+        pcx_connection_spectate(client->connection,
+                                conversation,
+                                event->n_messages_received);
+
+        set_client_joined(server, client);
+
         return true;
 }
 
@@ -612,147 +1382,1199 @@ handle_sideband(struct pcx_server *server,
 }
 
 static bool
-connection_event_cb(struct pcx_listener *listener,
-                    void *data)
+check_connection_rate_limit(struct pcx_server_socket *ssocket,
+                            struct pcx_connection *conn)
 {
-        struct pcx_connection_event *event = data;
-        struct pcx_server_client *client =
-                pcx_container_of(listener,
-                                 struct pcx_server_client,
-                                 event_listener);
-        struct pcx_server *server = client->server;
-
-        switch (event->type) {
-        case PCX_CONNECTION_EVENT_ERROR:
-                remove_client(server, client);
+        if (ssocket->connection_limit &&
+            !pcx_rate_limit_take(ssocket->connection_limit,
+                                 pcx_connection_get_remote_address(conn))) {
+                pcx_log("Rejecting connection from %s which exceeded the "
+                        "connection rate limit",
+                        pcx_connection_get_remote_address_string(conn));
                 return false;
-
-        case PCX_CONNECTION_EVENT_NEW_PLAYER: {
-                struct pcx_connection_new_player_event *de = (void *) event;
-                return handle_new_player(server, client, de);
         }
 
-        case PCX_CONNECTION_EVENT_JOIN_PRIVATE_GAME: {
-                struct pcx_connection_join_private_game_event *de =
-                        (void *) event;
-                return handle_join_private_game(server, client, de);
-        }
+        return true;
+}
 
-        case PCX_CONNECTION_EVENT_RECONNECT: {
-                struct pcx_connection_reconnect_event *de = (void *) event;
-                return handle_reconnect(server, client, de);
+static bool
+handle_proxy_header(struct pcx_server *server,
+                    struct pcx_server_client *client)
+{
+        if (client->ssocket &&
+            !check_connection_rate_limit(client->ssocket,
+                                         client->connection)) {
+                remove_client(server, client);
+                return false;
         }
 
-        case PCX_CONNECTION_EVENT_LEAVE:
-                return handle_leave(server, client);
+        return true;
+}
 
-        case PCX_CONNECTION_EVENT_BUTTON: {
-                struct pcx_connection_button_event *de = (void *) event;
-                return handle_button(server, client, de);
-        }
+static bool
+handle_handshake(struct pcx_server *server,
+                 struct pcx_server_client *client)
+{
+        remove_handshake_timeout(client);
 
-        case PCX_CONNECTION_EVENT_SEND_MESSAGE: {
-                struct pcx_connection_send_message_event *de = (void *) event;
-                return handle_send_message(server, client, de);
-        }
+        struct pcx_server_socket *ssocket = client->ssocket;
 
-        case PCX_CONNECTION_EVENT_SIDEBAND: {
-                struct pcx_connection_sideband_event *de = (void *) event;
-                return handle_sideband(server, client, de);
-        }
+        if (ssocket && ssocket->handshake_limit) {
+                const struct pcx_netaddress *remote_address =
+                        pcx_connection_get_remote_address(client->connection);
 
+                if (!pcx_rate_limit_take(ssocket->handshake_limit,
+                                         remote_address)) {
+                        pcx_log("Client %s exceeded the handshake rate limit",
+                                pcx_connection_get_remote_address_string
+                                (client->connection));
+                        remove_client(server, client);
+                        return false;
+                }
         }
 
         return true;
 }
 
-static int
-create_socket_for_address(const char *address,
-                          int default_port,
-                          struct pcx_error **error)
-{
-        unsigned long port;
-        char *tail;
+static const char * const
+connection_state_names[] = {
+        [PCX_CONNECTION_STATE_HANDSHAKE] = "handshake",
+        [PCX_CONNECTION_STATE_HTTP] = "http",
+        [PCX_CONNECTION_STATE_IDLE] = "idle",
+        [PCX_CONNECTION_STATE_LOBBY] = "lobby",
+        [PCX_CONNECTION_STATE_PLAYING] = "playing",
+        [PCX_CONNECTION_STATE_SPECTATING] = "spectating",
+};
 
-        errno = 0;
-        port = strtoul(address, &tail, 0);
-        if (errno == 0 && port <= UINT16_MAX && *tail == '\0')
-                return pcx_listen_socket_create_for_port(port, error);
+_Static_assert(PCX_N_ELEMENTS(connection_state_names) ==
+               PCX_CONNECTION_N_STATES,
+               "There should be a name for every connection state");
+
+static const struct {
+        int opcode;
+        const char *name;
+} opcode_names[] = {
+        { 0x0, "continuation" },
+        { 0x1, "text" },
+        { 0x2, "binary" },
+        { 0x8, "close" },
+        { 0x9, "ping" },
+        { 0xa, "pong" },
+};
 
-        struct pcx_netaddress netaddress;
+static void
+write_connection_metrics(struct pcx_server *server,
+                         struct pcx_buffer *buf)
+{
+        int counts[PCX_CONNECTION_N_STATES] = { 0 };
+        struct pcx_server_client *client;
+        char labels[64];
+
+        pcx_list_for_each(client, &server->clients, link) {
+                enum pcx_connection_state state =
+                        pcx_connection_get_state(client->connection);
+                counts[state]++;
+        }
 
-        if (!pcx_netaddress_from_string(&netaddress,
-                                        address,
-                                        default_port)) {
-                pcx_set_error(error,
-                              &pcx_server_error,
-                              PCX_SERVER_ERROR_INVALID_ADDRESS,
-                              "The listen address %s is invalid",
-                              address);
-                return -1;
+        pcx_metrics_write_header(buf,
+                                 "pucxobot_connections",
+                                 "gauge",
+                                 "Open connections by state");
+
+        for (int i = 0; i < PCX_CONNECTION_N_STATES; i++) {
+                snprintf(labels,
+                         sizeof labels,
+                         "state=\"%s\"",
+                         connection_state_names[i]);
+                pcx_metrics_write_value(buf,
+                                        "pucxobot_connections",
+                                        labels,
+                                        counts[i]);
         }
 
-        return pcx_listen_socket_create_for_netaddress(&netaddress, error);
+        struct pcx_connection_stats stats;
+
+        pcx_connection_get_stats(&stats);
+
+        pcx_metrics_write_header(buf,
+                                 "pucxobot_handshakes_total",
+                                 "counter",
+                                 "WebSocket handshakes completed");
+        pcx_metrics_write_value(buf,
+                                "pucxobot_handshakes_total",
+                                NULL,
+                                stats.n_handshakes);
+
+        pcx_metrics_write_header(buf,
+                                 "pucxobot_received_bytes_total",
+                                 "counter",
+                                 "Bytes received from the clients");
+        pcx_metrics_write_value(buf,
+                                "pucxobot_received_bytes_total",
+                                NULL,
+                                stats.bytes_received);
+
+        pcx_metrics_write_header(buf,
+                                 "pucxobot_sent_bytes_total",
+                                 "counter",
+                                 "Bytes sent to the clients");
+        pcx_metrics_write_value(buf,
+                                "pucxobot_sent_bytes_total",
+                                NULL,
+                                stats.bytes_sent);
+
+        pcx_metrics_write_header(buf,
+                                 "pucxobot_frames_total",
+                                 "counter",
+                                 "WebSocket frames by direction and "
+                                 "opcode");
+
+        for (int i = 0; i < PCX_N_ELEMENTS(opcode_names); i++) {
+                int opcode = opcode_names[i].opcode;
+
+                snprintf(labels,
+                         sizeof labels,
+                         "direction=\"received\",opcode=\"%s\"",
+                         opcode_names[i].name);
+                pcx_metrics_write_value(buf,
+                                        "pucxobot_frames_total",
+                                        labels,
+                                        stats.frames_received[opcode]);
+
+                snprintf(labels,
+                         sizeof labels,
+                         "direction=\"sent\",opcode=\"%s\"",
+                         opcode_names[i].name);
+                pcx_metrics_write_value(buf,
+                                        "pucxobot_frames_total",
+                                        labels,
+                                        stats.frames_sent[opcode]);
+        }
 }
 
-static struct pcx_server_client *
-add_client(struct pcx_server *server,
-           struct pcx_connection *conn)
+static void
+add_conversation_value(const struct pcx_server_conversation_hash_entry *entry,
+                       const struct pcx_game *game_type,
+                       bool message_log_size,
+                       uint64_t *values)
 {
-        struct pcx_server_client *client = pcx_calloc(sizeof *client);
-
-        client->server = server;
-        client->connection = conn;
+        const struct pcx_server_spectatable_conversation *sc =
+                pcx_container_of(entry,
+                                 struct pcx_server_spectatable_conversation,
+                                 hash_entry);
+        struct pcx_conversation *conv = sc->conversation;
 
-        struct pcx_signal *
-                command_signal = pcx_connection_get_event_signal(conn);
-        pcx_signal_add(command_signal, &client->event_listener);
-        client->event_listener.notify = connection_event_cb;
-
-        pcx_list_insert(&server->clients, &client->link);
-
-        queue_gc_source(server);
+        if (conv->game_type != game_type)
+                return;
 
-        return client;
+        if (message_log_size)
+                values[conv->language] +=
+                        pcx_conversation_get_message_log_size(conv);
+        else
+                values[conv->language]++;
 }
 
 static void
-free_server_socket(struct pcx_server_socket *ssocket)
+get_conversation_values(struct pcx_server *server,
+                        const struct pcx_game *game_type,
+                        bool message_log_size,
+                        uint64_t *values)
 {
-        if (ssocket->ssl_ctx)
-                SSL_CTX_free(ssocket->ssl_ctx);
-        if (ssocket->listen_source)
-                pcx_main_context_remove_source(ssocket->listen_source);
-        if (ssocket->listen_sock != -1)
-                pcx_close(ssocket->listen_sock);
-
-        pcx_list_remove(&ssocket->link);
-
-        pcx_free(ssocket);
+        const struct pcx_server_conversation_hash *hash =
+                &server->spectatable_conversations;
+        const struct pcx_server_conversation_hash_entry *entry;
+
+        for (int i = 0; i < hash->size; i++) {
+                for (entry = hash->table[i]; entry; entry = entry->next) {
+                        add_conversation_value(entry,
+                                               game_type,
+                                               message_log_size,
+                                               values);
+                }
+        }
 }
 
 static void
-listen_sock_cb(struct pcx_main_context_source *source,
-               int fd,
-               enum pcx_main_context_poll_flags flags,
-               void *user_data)
+write_conversation_metric(struct pcx_server *server,
+                          struct pcx_buffer *buf,
+                          const char *name,
+                          bool message_log_size)
 {
-        struct pcx_server_socket *ssocket = user_data;
-        struct pcx_server *server = ssocket->server;
-        struct pcx_connection *conn;
-        struct pcx_error *error = NULL;
+        char labels[64];
+
+        for (int game = 0; pcx_game_list[game]; game++) {
+                const struct pcx_game *game_type = pcx_game_list[game];
+                uint64_t values[PCX_TEXT_N_LANGUAGES] = { 0 };
+
+                get_conversation_values(server,
+                                        game_type,
+                                        message_log_size,
+                                        values);
+
+                for (int lang = 0; lang < PCX_TEXT_N_LANGUAGES; lang++) {
+                        const char *code =
+                                pcx_text_get(lang,
+                                             PCX_TEXT_STRING_LANGUAGE_CODE);
+
+                        snprintf(labels,
+                                 sizeof labels,
+                                 "game=\"%s\",language=\"%s\"",
+                                 game_type->name,
+                                 code);
+                        pcx_metrics_write_value(buf,
+                                                name,
+                                                labels,
+                                                values[lang]);
+                }
+        }
+}
 
-        conn = pcx_connection_accept(ssocket->ssl_ctx, fd, &error);
+static void
+write_metrics(struct pcx_server *server,
+              struct pcx_buffer *buf)
+{
+        write_connection_metrics(server, buf);
+
+        pcx_metrics_write_header(buf,
+                                 "pucxobot_players",
+                                 "gauge",
+                                 "Players in a game");
+        pcx_metrics_write_value(buf,
+                                "pucxobot_players",
+                                NULL,
+                                pcx_playerbase_get_n_players
+                                (server->playerbase));
+
+        pcx_metrics_write_header(buf,
+                                 "pucxobot_conversations",
+                                 "gauge",
+                                 "Games by game type and language");
+        write_conversation_metric(server,
+                                  buf,
+                                  "pucxobot_conversations",
+                                  false /* message_log_size */);
+
+        pcx_metrics_write_header(buf,
+                                 "pucxobot_message_log_bytes",
+                                 "gauge",
+                                 "Memory used by the message logs of the "
+                                 "games");
+        write_conversation_metric(server,
+                                  buf,
+                                  "pucxobot_message_log_bytes",
+                                  true /* message_log_size */);
+
+        struct pcx_main_context_stats mc_stats;
+
+        pcx_main_context_get_stats(NULL, &mc_stats);
+
+        pcx_metrics_write_header(buf,
+                                 "pucxobot_event_loop_iterations_total",
+                                 "counter",
+                                 "Number of times the event loop woke up");
+        pcx_metrics_write_value(buf,
+                                "pucxobot_event_loop_iterations_total",
+                                NULL,
+                                mc_stats.n_iterations);
+
+        pcx_metrics_write_header(buf,
+                                 "pucxobot_event_loop_wait_seconds_total",
+                                 "counter",
+                                 "Time the event loop spent waiting");
+        pcx_buffer_append_printf(buf,
+                                 "pucxobot_event_loop_wait_seconds_total "
+                                 "%f\n",
+                                 mc_stats.wait_time / 1e6);
+
+        pcx_metrics_write_header(buf,
+                                 "pucxobot_event_loop_dispatch_seconds",
+                                 "histogram",
+                                 "Time spent handling the events after "
+                                 "each wake up");
+        pcx_metrics_write_histogram(buf,
+                                    "pucxobot_event_loop_dispatch_seconds",
+                                    NULL,
+                                    &mc_stats.dispatch_time);
+
+        if (server->metrics_cb)
+                server->metrics_cb(buf, server->metrics_cb_user_data);
+}
 
-        if (conn == NULL) {
-                if (error->domain == &pcx_file_error &&
+static bool
+handle_metrics_request(struct pcx_server *server,
+                       struct pcx_server_client *client)
+{
+        /* The connections don’t copy the buffer so it can only be
+         * changed when nothing is sending it.
+         */
+        if (server->n_metrics_clients == 0) {
+                pcx_buffer_set_length(&server->metrics_buffer, 0);
+                write_metrics(server, &server->metrics_buffer);
+        }
+
+        client->is_metrics = true;
+        server->n_metrics_clients++;
+
+        pcx_connection_send_http_response(client->connection,
+                                          "text/plain; version=0.0.4",
+                                          server->metrics_buffer.data,
+                                          server->metrics_buffer.length);
+
+        return true;
+}
+
+static bool
+handle_http_request(struct pcx_server *server,
+                    struct pcx_server_client *client,
+                    struct pcx_connection_http_request_event *event)
+{
+        /* Plain HTTP clients never do the WebSocket handshake and
+         * with keep-alive they can stay connected for more requests.
+         * They are still removed by the garbage collection when they
+         * are idle. They won’t join a game so they shouldn’t count
+         * towards the pending connections either.
+         */
+        remove_handshake_timeout(client);
+        set_client_joined(server, client);
+
+        struct pcx_static_root *static_root =
+                client->ssocket ? client->ssocket->static_root : NULL;
+
+        /* A socket that serves the website is reachable from the
+         * internet so it doesn’t give out the metrics.
+         */
+        if (static_root == NULL &&
+            !strcmp(event->method, "GET") &&
+            !strcmp(event->path, "/metrics"))
+                return handle_metrics_request(server, client);
+
+        struct pcx_buffer *headers = &server->http_headers;
+        struct pcx_static_root_reply reply = {
+                .status = 404,
+                .fd = -1,
+        };
+
+        pcx_buffer_set_length(headers, 0);
+        pcx_buffer_append_string(headers, "");
+
+        if (static_root) {
+                pcx_static_root_handle_request(static_root,
+                                               event,
+                                               headers,
+                                               &reply);
+        }
+
+        pcx_connection_send_http_file(client->connection,
+                                      reply.status,
+                                      (const char *) headers->data,
+                                      reply.fd,
+                                      reply.length);
+
+        return true;
+}
+
+/* Maximum number of lines that the admin commands write each time
+ * they are called.
+ */
+#define ADMIN_LINES_PER_CALL 64
+
+static const char *
+get_conversation_state_name(const struct pcx_conversation *conv)
+{
+        if (!conv->started)
+                return "waiting";
+        if (conv->game)
+                return "playing";
+        return "finished";
+}
+
+static void
+write_admin_conversation(struct pcx_buffer *buf,
+                         struct pcx_conversation *conv)
+{
+        pcx_buffer_append_printf(buf,
+                                 "%016" PRIx64 " game=%s language=%s "
+                                 "state=%s private=%s players=%i "
+                                 "messages=%" PRIu64 " log_bytes=%zu\n",
+                                 conv->spectate_id,
+                                 conv->game_type->name,
+                                 pcx_text_get(conv->language,
+                                              PCX_TEXT_STRING_LANGUAGE_CODE),
+                                 get_conversation_state_name(conv),
+                                 conv->is_private ? "yes" : "no",
+                                 conv->n_players,
+                                 conv->next_message - conv->first_message,
+                                 pcx_conversation_get_message_log_size(conv));
+}
+
+/* The lists are sent in pieces. The first call copies the IDs of the
+ * items into the state and after that the cursor is the number of IDs
+ * that have been handled. Each ID is looked up again when its line is
+ * written so that anything that has been freed in the meantime is
+ * skipped. That way each call only costs as much as the lines it
+ * writes.
+ */
+
+typedef void
+(* admin_list_item_cb)(struct pcx_server *server,
+                       uint64_t id,
+                       struct pcx_buffer *buf);
+
+static bool
+write_admin_list(struct pcx_server *server,
+                 uint64_t *cursor,
+                 const struct pcx_buffer *state,
+                 struct pcx_buffer *buf,
+                 admin_list_item_cb item_cb)
+{
+        const uint64_t *ids = (const uint64_t *) state->data;
+        size_t n_ids = state->length / sizeof *ids;
+        size_t end = MIN(n_ids, *cursor + ADMIN_LINES_PER_CALL);
+
+        for (size_t i = *cursor; i < end; i++)
+                item_cb(server, ids[i], buf);
+
+        *cursor = end;
+
+        return end < n_ids;
+}
+
+static void
+write_admin_conversation_item(struct pcx_server *server,
+                              uint64_t id,
+                              struct pcx_buffer *buf)
+{
+        struct pcx_conversation *conv =
+                find_spectatable_conversation(server, id);
+
+        if (conv)
+                write_admin_conversation(buf, conv);
+}
+
+static void
+copy_conversation_id(struct pcx_buffer *state,
+                     const struct pcx_server_conversation_hash_entry *entry)
+{
+        const struct pcx_server_spectatable_conversation *sc =
+                pcx_container_of(entry,
+                                 struct pcx_server_spectatable_conversation,
+                                 hash_entry);
+        uint64_t id = sc->conversation->spectate_id;
+
+        pcx_buffer_append(state, &id, sizeof id);
+}
+
+static bool
+admin_conversations_cb(const char *args,
+                       uint64_t *cursor,
+                       struct pcx_buffer *state,
+                       struct pcx_buffer *buf,
+                       void *user_data)
+{
+        struct pcx_server *server = user_data;
+
+        if (*cursor == 0) {
+                const struct pcx_server_conversation_hash *hash =
+                        &server->spectatable_conversations;
+                const struct pcx_server_conversation_hash_entry *entry;
+
+                for (int i = 0; i < hash->size; i++) {
+                        for (entry = hash->table[i]; entry; entry = entry->next)
+                                copy_conversation_id(state, entry);
+                }
+        }
+
+        return write_admin_list(server,
+                                cursor,
+                                state,
+                                buf,
+                                write_admin_conversation_item);
+}
+
+static void
+write_admin_connection(struct pcx_buffer *buf,
+                       struct pcx_server_client *client)
+{
+        struct pcx_connection *conn = client->connection;
+        enum pcx_connection_state state = pcx_connection_get_state(conn);
+        struct pcx_conversation *conv = pcx_connection_get_conversation(conn);
+        struct pcx_player *player = pcx_connection_get_player(conn);
+        const char *address = pcx_connection_get_remote_address_string(conn);
+
+        pcx_buffer_append_printf(buf,
+                                 "%s state=%s",
+                                 address,
+                                 connection_state_names[state]);
+
+        if (conv) {
+                pcx_buffer_append_printf(buf,
+                                         " game=%016" PRIx64,
+                                         conv->spectate_id);
+        }
+
+        if (player) {
+                pcx_buffer_append_printf(buf,
+                                         " player=%016" PRIx64,
+                                         player->id);
+        }
+
+        pcx_buffer_append_c(buf, '\n');
+}
+
+/* The connections don’t have an ID to look them up by so instead
+ * their lines are all written into the state on the first call and
+ * the cursor is the offset of the next line to send.
+ */
+static bool
+admin_connections_cb(const char *args,
+                     uint64_t *cursor,
+                     struct pcx_buffer *state,
+                     struct pcx_buffer *buf,
+                     void *user_data)
+{
+        struct pcx_server *server = user_data;
+
+        if (*cursor == 0) {
+                struct pcx_server_client *client;
+
+                pcx_list_for_each(client, &server->clients, link)
+                        write_admin_connection(state, client);
+        }
+
+        const uint8_t *start = state->data + *cursor;
+        const uint8_t *end = state->data + state->length;
+        const uint8_t *p = start;
+
+        for (int i = 0; i < ADMIN_LINES_PER_CALL && p < end; i++)
+                p = (const uint8_t *) memchr(p, '\n', end - p) + 1;
+
+        pcx_buffer_append(buf, start, p - start);
+
+        *cursor += p - start;
+
+        return p < end;
+}
+
+static void
+write_admin_player(struct pcx_server *server,
+                   uint64_t id,
+                   struct pcx_buffer *buf)
+{
+        struct pcx_player *player =
+                pcx_playerbase_get_player_by_id(server->playerbase, id);
+
+        if (player == NULL)
+                return;
+
+        struct pcx_conversation *conv = player->conversation;
+        uint64_t now = pcx_main_context_get_monotonic_clock(NULL);
+
+        pcx_buffer_append_printf(buf,
+                                 "%016" PRIx64 " game=%016" PRIx64 " "
+                                 "player_num=%i connections=%i left=%s "
+                                 "idle=%" PRIu64 " name=%s\n",
+                                 player->id,
+                                 conv->spectate_id,
+                                 player->player_num,
+                                 player->ref_count,
+                                 player->has_left ? "yes" : "no",
+                                 (now - player->last_update_time) / 1000000,
+                                 pcx_conversation_get_player_name
+                                 (conv, player->player_num));
+}
+
+static bool
+copy_player_id_cb(struct pcx_player *player,
+                  void *user_data)
+{
+        struct pcx_buffer *state = user_data;
+
+        pcx_buffer_append(state, &player->id, sizeof player->id);
+
+        return true;
+}
+
+static bool
+admin_players_cb(const char *args,
+                 uint64_t *cursor,
+                 struct pcx_buffer *state,
+                 struct pcx_buffer *buf,
+                 void *user_data)
+{
+        struct pcx_server *server = user_data;
+
+        if (*cursor == 0) {
+                pcx_playerbase_foreach_player(server->playerbase,
+                                              copy_player_id_cb,
+                                              state);
+        }
+
+        return write_admin_list(server,
+                                cursor,
+                                state,
+                                buf,
+                                write_admin_player);
+}
+
+static struct pcx_conversation *
+get_admin_conversation(struct pcx_server *server,
+                       const char *args,
+                       struct pcx_buffer *buf)
+{
+        char *tail;
+
+        errno = 0;
+        uint64_t id = strtoull(args, &tail, 16);
+
+        if (errno || *args == '\0' || *tail != '\0') {
+                pcx_buffer_append_string(buf,
+                                         "error: expected a game ID\n");
+                return NULL;
+        }
+
+        struct pcx_conversation *conv =
+                find_spectatable_conversation(server, id);
+
+        if (conv == NULL)
+                pcx_buffer_append_string(buf, "error: game not found\n");
+
+        return conv;
+}
+
+static bool
+admin_conversation_cb(const char *args,
+                      uint64_t *cursor,
+                      struct pcx_buffer *state,
+                      struct pcx_buffer *buf,
+                      void *user_data)
+{
+        struct pcx_server *server = user_data;
+        struct pcx_conversation *conv =
+                get_admin_conversation(server, args, buf);
+
+        if (conv == NULL)
+                return false;
+
+        write_admin_conversation(buf, conv);
+
+        pcx_buffer_append_printf(buf,
+                                 "first_message=%" PRIu64 "\n"
+                                 "next_message=%" PRIu64 "\n"
+                                 "message_bytes=%zu\n"
+                                 "chunks=%zu\n"
+                                 "chunk_ring_size=%zu\n"
+                                 "cursors=%i\n"
+                                 "message_retention=%" PRIu64 "\n"
+                                 "references=%i\n",
+                                 conv->first_message,
+                                 conv->next_message,
+                                 conv->messages_size,
+                                 conv->n_message_chunks,
+                                 conv->message_chunks_size,
+                                 pcx_list_length(&conv->message_cursors),
+                                 conv->message_retention / 1000000,
+                                 conv->ref_count);
+
+        for (int i = 0; i < conv->n_players; i++) {
+                pcx_buffer_append_printf(buf,
+                                         "player%i=%s\n",
+                                         i,
+                                         pcx_conversation_get_player_name(conv,
+                                                                          i));
+        }
+
+        return false;
+}
+
+struct admin_end_closure {
+        struct pcx_conversation *conversation;
+        struct pcx_buffer players;
+};
+
+static bool
+find_players_to_end_cb(struct pcx_player *player,
+                       void *user_data)
+{
+        struct admin_end_closure *closure = user_data;
+
+        if (player->conversation == closure->conversation &&
+            !player->has_left) {
+                pcx_buffer_append(&closure->players,
+                                  &player,
+                                  sizeof player);
+        }
+
+        return true;
+}
+
+static bool
+admin_end_cb(const char *args,
+             uint64_t *cursor,
+             struct pcx_buffer *state,
+             struct pcx_buffer *buf,
+             void *user_data)
+{
+        struct pcx_server *server = user_data;
+        struct pcx_conversation *conv =
+                get_admin_conversation(server, args, buf);
+
+        if (conv == NULL)
+                return false;
+
+        struct admin_end_closure closure = {
+                .conversation = conv,
+                .players = PCX_BUFFER_STATIC_INIT,
+        };
+
+        pcx_playerbase_foreach_player(server->playerbase,
+                                      find_players_to_end_cb,
+                                      &closure);
+
+        pcx_conversation_ref(conv);
+
+        pcx_conversation_end_game(conv);
+
+        /* Remove the players in the same way as if they had left
+         * themselves so that the clients are told about it.
+         */
+        struct pcx_player **players = (struct pcx_player **)
+                closure.players.data;
+        size_t n_players = closure.players.length / sizeof *players;
+
+        for (size_t i = 0; i < n_players; i++) {
+                players[i]->has_left = true;
+                pcx_conversation_remove_player(conv, players[i]->player_num);
+        }
+
+        pcx_log("Game %016" PRIx64 " ended from the admin socket",
+                conv->spectate_id);
+
+        pcx_buffer_append_printf(buf,
+                                 "ended game %016" PRIx64 " and removed %zu "
+                                 "players\n",
+                                 conv->spectate_id,
+                                 n_players);
+
+        pcx_conversation_unref(conv);
+
+        pcx_buffer_destroy(&closure.players);
+
+        return false;
+}
+
+static const struct pcx_admin_command
+admin_commands[] = {
+        {
+                .name = "conversations",
+                .help = "conversations – list every game",
+                .cb = admin_conversations_cb,
+        },
+        {
+                .name = "connections",
+                .help = "connections – list the WebSocket connections",
+                .cb = admin_connections_cb,
+        },
+        {
+                .name = "players",
+                .help = "players – list the players of the games",
+                .cb = admin_players_cb,
+        },
+        {
+                .name = "conversation",
+                .help = "conversation <id> – show the details of a game",
+                .cb = admin_conversation_cb,
+        },
+        {
+                .name = "end",
+                .help = "end <id> – stop a game and remove its players",
+                .cb = admin_end_cb,
+        },
+};
+
+static bool
+connection_event_cb(struct pcx_listener *listener,
+                    void *data)
+{
+        struct pcx_connection_event *event = data;
+        struct pcx_server_client *client =
+                pcx_container_of(listener,
+                                 struct pcx_server_client,
+                                 event_listener);
+        struct pcx_server *server = client->server;
+
+        switch (event->type) {
+        case PCX_CONNECTION_EVENT_ERROR:
+                remove_client(server, client);
+                return false;
+
+        case PCX_CONNECTION_EVENT_PROXY_HEADER:
+                return handle_proxy_header(server, client);
+
+        case PCX_CONNECTION_EVENT_HANDSHAKE:
+                return handle_handshake(server, client);
+
+        case PCX_CONNECTION_EVENT_NEW_PLAYER: {
+                struct pcx_connection_new_player_event *de = (void *) event;
+                return handle_new_player(server, client, de);
+        }
+
+        case PCX_CONNECTION_EVENT_JOIN_PRIVATE_GAME: {
+                struct pcx_connection_join_private_game_event *de =
+                        (void *) event;
+                return handle_join_private_game(server,
+                                                client,
+                                                de,
+                                                false /* from_lobby */);
+        }
+
+        case PCX_CONNECTION_EVENT_JOIN_LOBBY_GAME: {
+                struct pcx_connection_join_private_game_event *de =
+                        (void *) event;
+                return handle_join_private_game(server,
+                                                client,
+                                                de,
+                                                true /* from_lobby */);
+        }
+
+        case PCX_CONNECTION_EVENT_LOBBY_SUBSCRIBE:
+                return handle_lobby_subscribe(server, client);
+
+        case PCX_CONNECTION_EVENT_RECONNECT: {
+                struct pcx_connection_reconnect_event *de = (void *) event;
+                return handle_reconnect(server, client, de);
+        }
+
+        case PCX_CONNECTION_EVENT_SPECTATE: {
+                struct pcx_connection_spectate_event *de = (void *) event;
+                return handle_spectate(server, client, de);
+        }
+
+        case PCX_CONNECTION_EVENT_LEAVE:
+                return handle_leave(server, client);
+
+        case PCX_CONNECTION_EVENT_BUTTON: {
+                struct pcx_connection_button_event *de = (void *) event;
+                return handle_button(server, client, de);
+        }
+
+        case PCX_CONNECTION_EVENT_SEND_MESSAGE: {
+                struct pcx_connection_send_message_event *de = (void *) event;
+                return handle_send_message(server, client, de);
+        }
+
+        case PCX_CONNECTION_EVENT_SIDEBAND: {
+                struct pcx_connection_sideband_event *de = (void *) event;
+                return handle_sideband(server, client, de);
+        }
+
+        case PCX_CONNECTION_EVENT_HTTP_REQUEST: {
+                struct pcx_connection_http_request_event *de = (void *) event;
+                return handle_http_request(server, client, de);
+        }
+
+        }
+
+        return true;
+}
+
+static int
+create_socket_for_address(const char *address,
+                          int default_port,
+                          struct pcx_error **error)
+{
+        unsigned long port;
+        char *tail;
+
+        if (!strncmp(address, "unix:", 5))
+                return pcx_listen_socket_create_for_path(address + 5, error);
+
+        errno = 0;
+        port = strtoul(address, &tail, 0);
+        if (errno == 0 && port <= UINT16_MAX && *tail == '\0')
+                return pcx_listen_socket_create_for_port(port, error);
+
+        struct pcx_netaddress netaddress;
+
+        if (!pcx_netaddress_from_string(&netaddress,
+                                        address,
+                                        default_port)) {
+                pcx_set_error(error,
+                              &pcx_server_error,
+                              PCX_SERVER_ERROR_INVALID_ADDRESS,
+                              "The listen address %s is invalid",
+                              address);
+                return -1;
+        }
+
+        return pcx_listen_socket_create_for_netaddress(&netaddress, error);
+}
+
+/* Key used to match up a config with a listen socket from the old
+ * process during a live upgrade.
+ */
+static void
+get_socket_key(const struct pcx_config_server *server_config,
+               struct pcx_buffer *buf)
+{
+        int default_port = (server_config->certificate ?
+                            DEFAULT_SSL_PORT :
+                            DEFAULT_PORT);
+
+        pcx_buffer_append_printf(buf,
+                                 "%s/%i",
+                                 server_config->address ?
+                                 server_config->address :
+                                 "",
+                                 default_port);
+}
+
+static int
+take_inherited_socket(struct pcx_server *server,
+                      const struct pcx_config_server *server_config)
+{
+        struct pcx_buffer key = PCX_BUFFER_STATIC_INIT;
+        struct pcx_server_inherited_socket *isocket;
+        int fd = -1;
+
+        get_socket_key(server_config, &key);
+
+        pcx_list_for_each(isocket, &server->inherited_sockets, link) {
+                if (!strcmp(isocket->key, (const char *) key.data)) {
+                        fd = isocket->fd;
+                        pcx_list_remove(&isocket->link);
+                        pcx_free(isocket->key);
+                        pcx_free(isocket);
+                        break;
+                }
+        }
+
+        pcx_buffer_destroy(&key);
+
+        return fd;
+}
+
+static void
+handshake_timeout_cb(struct pcx_main_context_source *source,
+                     void *user_data)
+{
+        struct pcx_server_client *client = user_data;
+
+        client->handshake_timeout_source = NULL;
+
+        pcx_log("Removing connection from %s which didn’t finish the "
+                "handshake in time",
+                pcx_connection_get_remote_address_string(client->connection));
+
+        remove_client(client->server, client);
+}
+
+static struct pcx_server_client *
+add_client(struct pcx_server_socket *ssocket,
+           struct pcx_connection *conn)
+{
+        struct pcx_server *server = ssocket->server;
+        struct pcx_server_client *client = pcx_calloc(sizeof *client);
+
+        client->server = server;
+        client->ssocket = ssocket;
+        client->connection = conn;
+
+        client->is_pending = true;
+        server->n_pending_clients++;
+
+        if (ssocket->config->handshake_timeout > 0) {
+                client->handshake_timeout_source =
+                        pcx_main_context_add_timeout(NULL,
+                                                     ssocket->config->
+                                                     handshake_timeout *
+                                                     1000,
+                                                     handshake_timeout_cb,
+                                                     client);
+        }
+
+        struct pcx_signal *
+                command_signal = pcx_connection_get_event_signal(conn);
+        pcx_signal_add(command_signal, &client->event_listener);
+        client->event_listener.notify = connection_event_cb;
+
+        pcx_list_insert(&server->clients, &client->link);
+
+        queue_gc_source(server);
+
+        return client;
+}
+
+static void
+free_server_socket(struct pcx_server_socket *ssocket)
+{
+        struct pcx_server_client *client;
+
+        pcx_list_for_each(client, &ssocket->server->clients, link) {
+                if (client->ssocket == ssocket)
+                        client->ssocket = NULL;
+        }
+
+        if (ssocket->connection_limit)
+                pcx_rate_limit_free(ssocket->connection_limit);
+        if (ssocket->handshake_limit)
+                pcx_rate_limit_free(ssocket->handshake_limit);
+
+        if (ssocket->static_root)
+                pcx_static_root_free(ssocket->static_root);
+
+        if (ssocket->ssl_ctx)
+                SSL_CTX_free(ssocket->ssl_ctx);
+        if (ssocket->listen_source)
+                pcx_main_context_remove_source(ssocket->listen_source);
+        if (ssocket->listen_sock != -1)
+                pcx_close(ssocket->listen_sock);
+
+        pcx_list_remove(&ssocket->link);
+
+        pcx_free(ssocket);
+}
+
+static bool
+check_accept_limits(struct pcx_server_socket *ssocket,
+                    struct pcx_connection *conn)
+{
+        struct pcx_server *server = ssocket->server;
+        const struct pcx_config_server *config = ssocket->config;
+
+        if (config->max_pending_connections > 0 &&
+            server->n_pending_clients >= config->max_pending_connections) {
+                pcx_log("Rejecting connection from %s because there are "
+                        "too many pending connections",
+                        pcx_connection_get_remote_address_string(conn));
+                return false;
+        }
+
+        /* With the PROXY protocol the address is only the proxy’s
+         * until the header is received so the rate limit is checked
+         * then instead.
+         */
+        if (!config->proxy_protocol &&
+            !check_connection_rate_limit(ssocket, conn))
+                return false;
+
+        return true;
+}
+
+static struct pcx_server_client *
+find_client_to_shed(struct pcx_server *server)
+{
+        uint64_t now = pcx_main_context_get_monotonic_clock(NULL);
+        struct pcx_server_client *best_client = NULL;
+        bool best_is_pending = false;
+        uint64_t best_update_time = UINT64_MAX;
+        struct pcx_server_client *client;
+
+        /* Prefer the oldest client that hasn’t joined a game.
+         * Otherwise pick the one that has been idle the longest as
+         * long as it looks like it is dead.
+         */
+        pcx_list_for_each(client, &server->clients, link) {
+                uint64_t update_time =
+                        pcx_connection_get_last_update_time(client->
+                                                            connection);
+
+                if (client->is_pending) {
+                        if (!best_is_pending ||
+                            update_time < best_update_time) {
+                                best_client = client;
+                                best_is_pending = true;
+                                best_update_time = update_time;
+                        }
+                } else if (!best_is_pending &&
+                           now - update_time >= MIN_SHED_CLIENT_AGE &&
+                           update_time < best_update_time) {
+                        best_client = client;
+                        best_update_time = update_time;
+                }
+        }
+
+        return best_client;
+}
+
+static void
+reject_busy_connection(struct pcx_server_socket *ssocket)
+{
+        int sock = accept(ssocket->listen_sock, NULL, NULL);
+
+        if (sock == -1)
+                return;
+
+        /* We can’t easily reply over TLS without doing the handshake
+         * so in that case the client just sees the connection close.
+         */
+        if (ssocket->ssl_ctx == NULL) {
+                /* This is just a best effort so it doesn’t matter if
+                 * it fails.
+                 */
+                ssize_t wrote = send(sock,
+                                     busy_response,
+                                     sizeof busy_response - 1,
+                                     MSG_DONTWAIT | MSG_NOSIGNAL);
+                (void) wrote;
+        }
+
+        pcx_close(sock);
+}
+
+static void
+handle_out_of_fds(struct pcx_server_socket *ssocket)
+{
+        struct pcx_server *server = ssocket->server;
+
+        if (server->reserve_fd == -1) {
+                pcx_log("Accept failed due to too many open fds. "
+                        "Waiting for a client to disconnect.");
+                /* Run out of file descriptors and there’s no reserve
+                 * to fall back on. Stop listening until someone
+                 * disconnects.
+                 */
+                pcx_main_context_modify_poll(ssocket->listen_source, 0);
+                return;
+        }
+
+        struct pcx_server_client *client = find_client_to_shed(server);
+
+        if (client) {
+                pcx_log("Too many open fds. Disconnecting %s to make room "
+                        "for a new client.",
+                        pcx_connection_get_remote_address_string
+                        (client->connection));
+                /* This will free an fd so the next poll will be able
+                 * to accept the new connection normally.
+                 */
+                remove_client(server, client);
+                return;
+        }
+
+        pcx_log("Too many open fds and no idle clients. Rejecting a new "
+                "connection.");
+
+        close_reserve_fd(server);
+        reject_busy_connection(ssocket);
+        open_reserve_fd(server);
+}
+
+static void
+listen_sock_cb(struct pcx_main_context_source *source,
+               int fd,
+               enum pcx_main_context_poll_flags flags,
+               void *user_data)
+{
+        struct pcx_server_socket *ssocket = user_data;
+        struct pcx_connection *conn;
+        struct pcx_error *error = NULL;
+
+        conn = pcx_connection_accept(ssocket->ssl_ctx, fd, &error);
+
+        if (conn == NULL) {
+                if (error->domain == &pcx_file_error &&
                     error->code == PCX_FILE_ERROR_MFILE) {
-                        pcx_log("Accept failed due to too many open fds. "
-                                "Waiting for a client to disconnect.");
-                        /* Run out of file descriptors. Stop listening
-                         * until someone disconnects.
-                         */
-                        pcx_main_context_modify_poll(source, 0);
+                        handle_out_of_fds(ssocket);
                 } else if (error->domain != &pcx_file_error ||
                            (error->code != PCX_FILE_ERROR_AGAIN &&
                             error->code != PCX_FILE_ERROR_INTR)) {
@@ -763,10 +2585,18 @@ listen_sock_cb(struct pcx_main_context_source *source,
                 return;
         }
 
+        if (ssocket->config->proxy_protocol)
+                pcx_connection_expect_proxy_header(conn);
+
+        if (!check_accept_limits(ssocket, conn)) {
+                pcx_connection_free(conn);
+                return;
+        }
+
         pcx_log("Accepted connection from %s",
                 pcx_connection_get_remote_address_string(conn));
 
-        add_client(server, conn);
+        add_client(ssocket, conn);
 }
 
 int
@@ -775,6 +2605,227 @@ pcx_server_get_n_players(struct pcx_server *server)
         return pcx_playerbase_get_n_players(server->playerbase);
 }
 
+int
+pcx_server_get_n_unsaveable_players(struct pcx_server *server)
+{
+        return pcx_playerbase_get_n_unsaveable_players(server->playerbase);
+}
+
+int
+pcx_server_get_n_conversations(struct pcx_server *server)
+{
+        return server->spectatable_conversations.n_entries;
+}
+
+int
+pcx_server_get_n_refused_players(struct pcx_server *server)
+{
+        return server->n_refused_players;
+}
+
+void
+pcx_server_get_time_to_game(struct pcx_server *server,
+                            struct pcx_matchmaker_time_to_game *stats)
+{
+        pcx_matchmaker_get_time_to_game(server->matchmaker, stats);
+}
+
+void
+pcx_server_add_admin_commands(struct pcx_server *server,
+                              struct pcx_admin *admin)
+{
+        pcx_admin_add_commands(admin,
+                               admin_commands,
+                               PCX_N_ELEMENTS(admin_commands),
+                               server);
+}
+
+void
+pcx_server_set_draining(struct pcx_server *server,
+                        bool draining)
+{
+        server->draining = draining;
+}
+
+void
+pcx_server_set_metrics_cb(struct pcx_server *server,
+                          pcx_server_metrics_cb cb,
+                          void *user_data)
+{
+        server->metrics_cb = cb;
+        server->metrics_cb_user_data = user_data;
+}
+
+void
+pcx_server_set_state_changed_cb(struct pcx_server *server,
+                                pcx_server_state_changed_cb cb,
+                                void *user_data)
+{
+        server->state_changed_cb = cb;
+        server->state_changed_cb_user_data = user_data;
+}
+
+void
+pcx_server_save_state(struct pcx_server *server,
+                      struct pcx_buffer *buf,
+                      uint64_t max_cache_age)
+{
+        pcx_buffer_append(buf,
+                          PCX_SERVER_STATE_MAGIC,
+                          sizeof PCX_SERVER_STATE_MAGIC - 1);
+        pcx_snapshot_write_uint32(buf, PCX_SERVER_STATE_VERSION);
+
+        pcx_playerbase_save(server->playerbase, buf, max_cache_age);
+}
+
+void
+pcx_server_save_listen_sockets(struct pcx_server *server,
+                               struct pcx_buffer *buf,
+                               struct pcx_buffer *fds)
+{
+        struct pcx_server_socket *ssocket;
+        struct pcx_buffer key = PCX_BUFFER_STATIC_INIT;
+
+        pcx_snapshot_write_int(buf, pcx_list_length(&server->sockets));
+
+        pcx_list_for_each(ssocket, &server->sockets, link) {
+                pcx_buffer_set_length(&key, 0);
+                get_socket_key(ssocket->config, &key);
+                pcx_snapshot_write_string(buf, (const char *) key.data);
+                pcx_buffer_append(fds,
+                                  &ssocket->listen_sock,
+                                  sizeof ssocket->listen_sock);
+        }
+
+        pcx_buffer_destroy(&key);
+}
+
+bool
+pcx_server_add_inherited_sockets(struct pcx_server *server,
+                                 const uint8_t *data,
+                                 size_t length,
+                                 const int *fds,
+                                 int n_fds,
+                                 struct pcx_error **error)
+{
+        struct pcx_snapshot_reader reader;
+
+        pcx_snapshot_reader_init(&reader, data, length);
+
+        int n_sockets = pcx_snapshot_read_int_range(&reader, 0, n_fds);
+
+        for (int i = 0; i < n_sockets; i++) {
+                const char *key = pcx_snapshot_read_string(&reader);
+
+                if (reader.error)
+                        break;
+
+                struct pcx_server_inherited_socket *isocket =
+                        pcx_alloc(sizeof *isocket);
+
+                isocket->key = pcx_strdup(key);
+                isocket->fd = fds[i];
+                pcx_list_insert(server->inherited_sockets.prev,
+                                &isocket->link);
+        }
+
+        if (reader.error || n_sockets != n_fds) {
+                pcx_set_error(error,
+                              &pcx_server_error,
+                              PCX_SERVER_ERROR_INVALID_STATE,
+                              "The list of listen sockets is invalid");
+                return false;
+        }
+
+        return true;
+}
+
+void
+pcx_server_close_inherited_sockets(struct pcx_server *server)
+{
+        struct pcx_server_inherited_socket *isocket, *tmp;
+
+        pcx_list_for_each_safe(isocket,
+                               tmp,
+                               &server->inherited_sockets,
+                               link) {
+                pcx_close(isocket->fd);
+                pcx_free(isocket->key);
+                pcx_free(isocket);
+        }
+
+        pcx_list_init(&server->inherited_sockets);
+}
+
+static void
+restored_conversation_cb(struct pcx_conversation *conv,
+                         void *user_data)
+{
+        struct pcx_server *server = user_data;
+
+        /* Keep the old spectate link working unless something else
+         * has already taken the ID.
+         */
+        struct pcx_netaddress no_address = { .family = AF_UNSPEC };
+
+        if (find_spectatable_conversation(server, conv->spectate_id))
+                add_spectatable_conversation(server, conv, &no_address);
+        else
+                register_spectatable_conversation(server, conv, &no_address);
+}
+
+bool
+pcx_server_restore_state(struct pcx_server *server,
+                         const uint8_t *data,
+                         size_t length,
+                         struct pcx_error **error)
+{
+        size_t magic_length = sizeof PCX_SERVER_STATE_MAGIC - 1;
+
+        if (length < magic_length ||
+            memcmp(data, PCX_SERVER_STATE_MAGIC, magic_length)) {
+                pcx_set_error(error,
+                              &pcx_server_error,
+                              PCX_SERVER_ERROR_INVALID_STATE,
+                              "The saved state has an unknown format");
+                return false;
+        }
+
+        struct pcx_snapshot_reader reader;
+
+        pcx_snapshot_reader_init(&reader,
+                                 data + magic_length,
+                                 length - magic_length);
+
+        if (pcx_snapshot_read_uint32(&reader) != PCX_SERVER_STATE_VERSION) {
+                pcx_set_error(error,
+                              &pcx_server_error,
+                              PCX_SERVER_ERROR_INVALID_STATE,
+                              "The saved state is from a different version");
+                return false;
+        }
+
+        int n_restored = pcx_playerbase_restore(server->playerbase,
+                                                server->config,
+                                                server->class_store,
+                                                pcx_game_list,
+                                                &reader,
+                                                restored_conversation_cb,
+                                                server);
+
+        pcx_log("Restored %i games from the saved state", n_restored);
+
+        if (reader.error) {
+                pcx_set_error(error,
+                              &pcx_server_error,
+                              PCX_SERVER_ERROR_INVALID_STATE,
+                              "The saved state is corrupt");
+                return false;
+        }
+
+        return true;
+}
+
 static int
 ssl_password_cb(char *buf, int size, int rwflag, void *user_data)
 {
@@ -825,47 +2876,273 @@ error:
         return false;
 }
 
-bool
-pcx_server_add_config(struct pcx_server *server,
-                      const struct pcx_config_server *server_config,
-                      struct pcx_error **error)
+static int
+open_listen_socket(struct pcx_server *server,
+                   const struct pcx_config_server *server_config,
+                   struct pcx_error **error)
 {
         int default_port = (server_config->certificate ?
                             DEFAULT_SSL_PORT :
                             DEFAULT_PORT);
 
-        int sock;
+        int sock = take_inherited_socket(server, server_config);
 
-        if (server_config->address) {
-                sock = create_socket_for_address(server_config->address,
+        if (sock != -1) {
+                /* Reuse the socket from the old process */
+                return sock;
+        } else if (server_config->address) {
+                return create_socket_for_address(server_config->address,
                                                  default_port,
                                                  error);
         } else {
-                sock = pcx_listen_socket_create_for_port(default_port, error);
+                return pcx_listen_socket_create_for_port(default_port, error);
         }
+}
 
-        if (sock == -1)
-                return false;
-
+/* Creates a socket and adds it to the list without starting to
+ * listen on it yet. If it fails then the listen socket isn’t closed.
+ */
+static struct pcx_server_socket *
+create_server_socket(struct pcx_server *server,
+                     struct pcx_list *list,
+                     const struct pcx_config_server *server_config,
+                     int sock,
+                     struct pcx_error **error)
+{
         struct pcx_server_socket *ssocket = pcx_calloc(sizeof *ssocket);
 
-        pcx_list_insert(&server->sockets, &ssocket->link);
+        pcx_list_insert(list, &ssocket->link);
         ssocket->server = server;
+        ssocket->config = server_config;
         ssocket->listen_sock = sock;
+
+        if (server_config->connection_rate > 0 &&
+            server_config->connection_burst > 0) {
+                ssocket->connection_limit =
+                        pcx_rate_limit_new(server_config->connection_rate,
+                                           server_config->connection_burst);
+        }
+
+        if (server_config->handshake_rate > 0 &&
+            server_config->handshake_burst > 0) {
+                ssocket->handshake_limit =
+                        pcx_rate_limit_new(server_config->handshake_rate,
+                                           server_config->handshake_burst);
+        }
+
+        if (server_config->certificate &&
+            !init_ssl(ssocket, server_config, error))
+                goto error;
+
+        if (server_config->web_root) {
+                ssocket->static_root =
+                        pcx_static_root_new(server_config->web_root, error);
+
+                if (ssocket->static_root == NULL)
+                        goto error;
+        }
+
+        return ssocket;
+
+error:
+        ssocket->listen_sock = -1;
+        free_server_socket(ssocket);
+        return NULL;
+}
+
+static void
+start_listening(struct pcx_server_socket *ssocket)
+{
         ssocket->listen_source =
                 pcx_main_context_add_poll(NULL,
-                                          sock,
+                                          ssocket->listen_sock,
                                           PCX_MAIN_CONTEXT_POLL_IN,
                                           listen_sock_cb,
                                           ssocket);
+}
 
-        if (server_config->certificate &&
-            !init_ssl(ssocket, server_config, error)) {
-                free_server_socket(ssocket);
+bool
+pcx_server_add_config(struct pcx_server *server,
+                      const struct pcx_config_server *server_config,
+                      struct pcx_error **error)
+{
+        int sock = open_listen_socket(server, server_config, error);
+
+        if (sock == -1)
+                return false;
+
+        struct pcx_server_socket *ssocket =
+                create_server_socket(server,
+                                     &server->sockets,
+                                     server_config,
+                                     sock,
+                                     error);
+
+        if (ssocket == NULL) {
+                pcx_close(sock);
                 return false;
         }
 
-        return server;
+        start_listening(ssocket);
+
+        return true;
+}
+
+static struct pcx_server_socket *
+find_socket_with_fd(struct pcx_list *sockets,
+                    int fd)
+{
+        struct pcx_server_socket *ssocket;
+
+        pcx_list_for_each(ssocket, sockets, link) {
+                if (ssocket->listen_sock == fd)
+                        return ssocket;
+        }
+
+        return NULL;
+}
+
+/* Finds a running socket for the same address that isn’t already
+ * being reused by one of the new sockets.
+ */
+static struct pcx_server_socket *
+find_reusable_socket(struct pcx_server *server,
+                     struct pcx_list *new_sockets,
+                     const struct pcx_config_server *server_config)
+{
+        struct pcx_buffer key = PCX_BUFFER_STATIC_INIT;
+        struct pcx_buffer other_key = PCX_BUFFER_STATIC_INIT;
+        struct pcx_server_socket *ssocket, *found = NULL;
+
+        get_socket_key(server_config, &key);
+
+        pcx_list_for_each(ssocket, &server->sockets, link) {
+                pcx_buffer_set_length(&other_key, 0);
+                get_socket_key(ssocket->config, &other_key);
+
+                if (!strcmp((const char *) key.data,
+                            (const char *) other_key.data) &&
+                    find_socket_with_fd(new_sockets,
+                                        ssocket->listen_sock) == NULL) {
+                        found = ssocket;
+                        break;
+                }
+        }
+
+        pcx_buffer_destroy(&other_key);
+        pcx_buffer_destroy(&key);
+
+        return found;
+}
+
+/* Frees the new sockets without closing the listen sockets that
+ * still belong to the running ones.
+ */
+static void
+free_new_sockets(struct pcx_server *server,
+                 struct pcx_list *new_sockets)
+{
+        struct pcx_server_socket *ssocket, *tmp;
+
+        pcx_list_for_each_safe(ssocket, tmp, new_sockets, link) {
+                if (find_socket_with_fd(&server->sockets,
+                                        ssocket->listen_sock))
+                        ssocket->listen_sock = -1;
+                free_server_socket(ssocket);
+        }
+}
+
+static void
+replace_server_socket(struct pcx_server_socket *old_socket,
+                      struct pcx_server_socket *new_socket)
+{
+        struct pcx_server_client *client;
+
+        pcx_list_for_each(client, &old_socket->server->clients, link) {
+                if (client->ssocket == old_socket)
+                        client->ssocket = new_socket;
+        }
+
+        /* The new socket has taken over the listen socket */
+        old_socket->listen_sock = -1;
+        free_server_socket(old_socket);
+}
+
+bool
+pcx_server_set_configs(struct pcx_server *server,
+                       const struct pcx_list *server_configs,
+                       struct pcx_error **error)
+{
+        struct pcx_list new_sockets;
+        const struct pcx_config_server *server_config;
+
+        pcx_list_init(&new_sockets);
+
+        /* Everything that could fail is done before touching the
+         * running sockets so that a mistake in the config doesn’t
+         * stop the server.
+         */
+        pcx_list_for_each(server_config, server_configs, link) {
+                struct pcx_server_socket *old_socket =
+                        find_reusable_socket(server,
+                                             &new_sockets,
+                                             server_config);
+                int sock;
+
+                if (old_socket) {
+                        sock = old_socket->listen_sock;
+                } else {
+                        sock = open_listen_socket(server,
+                                                  server_config,
+                                                  error);
+                        if (sock == -1)
+                                goto error;
+                }
+
+                /* This also loads the certificate again so that it
+                 * can be replaced without a restart. The connections
+                 * that already use the old one keep a reference on
+                 * it.
+                 */
+                if (create_server_socket(server,
+                                         new_sockets.prev,
+                                         server_config,
+                                         sock,
+                                         error) == NULL) {
+                        if (old_socket == NULL)
+                                pcx_close(sock);
+                        goto error;
+                }
+        }
+
+        struct pcx_server_socket *ssocket, *tmp;
+
+        pcx_list_for_each_safe(ssocket, tmp, &server->sockets, link) {
+                struct pcx_server_socket *new_socket =
+                        find_socket_with_fd(&new_sockets,
+                                            ssocket->listen_sock);
+
+                if (new_socket) {
+                        replace_server_socket(ssocket, new_socket);
+                } else {
+                        pcx_log("Closing the listen socket for %s",
+                                ssocket->config->address ?
+                                ssocket->config->address :
+                                "the default port");
+                        free_server_socket(ssocket);
+                }
+        }
+
+        pcx_list_for_each(ssocket, &new_sockets, link)
+                start_listening(ssocket);
+
+        pcx_list_insert_list(server->sockets.prev, &new_sockets);
+
+        return true;
+
+error:
+        free_new_sockets(server, &new_sockets);
+        return false;
 }
 
 struct pcx_server *
@@ -876,13 +3153,32 @@ pcx_server_new(const struct pcx_config *config,
 
         pcx_list_init(&server->clients);
         pcx_list_init(&server->sockets);
+        pcx_list_init(&server->inherited_sockets);
 
         server->playerbase = pcx_playerbase_new();
+        pcx_playerbase_set_player_removed_cb(server->playerbase,
+                                             player_removed_cb,
+                                             server);
+
+        server->conversation_counts = pcx_address_count_new();
+        server->player_counts = pcx_address_count_new();
+
+        server->reserve_fd = -1;
+        open_reserve_fd(server);
 
         server->config = config;
         server->class_store = class_store;
 
         pcx_list_init(&server->pending_conversations);
+        conversation_hash_init(&server->public_conversations);
+        conversation_hash_init(&server->private_conversations);
+        conversation_hash_init(&server->spectatable_conversations);
+
+        server->lobby = pcx_lobby_new();
+        server->matchmaker = pcx_matchmaker_new(config);
+
+        pcx_buffer_init(&server->metrics_buffer);
+        pcx_buffer_init(&server->http_headers);
 
         return server;
 }
@@ -920,14 +3216,35 @@ pcx_server_free(struct pcx_server *server)
 {
         free_clients(server);
         free_sockets(server);
+        pcx_server_close_inherited_sockets(server);
 
         remove_pending_conversations(server);
 
+        pcx_matchmaker_free(server->matchmaker);
+
+        pcx_free(server->public_conversations.table);
+        pcx_free(server->private_conversations.table);
+
         pcx_playerbase_free(server->playerbase);
 
+        /* Freeing the players should have destroyed all of the
+         * conversations.
+         */
+        assert(server->spectatable_conversations.n_entries == 0);
+        pcx_free(server->spectatable_conversations.table);
+
+        pcx_address_count_free(server->conversation_counts);
+        pcx_address_count_free(server->player_counts);
+
+        pcx_lobby_free(server->lobby);
+
+        close_reserve_fd(server);
+
         if (server->gc_source)
                 pcx_main_context_remove_source(server->gc_source);
 
+        pcx_buffer_destroy(&server->metrics_buffer);
+        pcx_buffer_destroy(&server->http_headers);
 
         pcx_free(server);
 }
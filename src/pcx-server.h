@@ -20,16 +20,37 @@
 #define PCX_SERVER_H
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
 #include "pcx-config.h"
 #include "pcx-class-store.h"
+#include "pcx-matchmaker.h"
+#include "pcx-buffer.h"
+#include "pcx-error.h"
+#include "pcx-admin.h"
 
 struct pcx_server;
 
+/* Called at the end of rendering the metrics so that parts of the
+ * program that the server doesn’t know about can add their own.
+ */
+typedef void
+(* pcx_server_metrics_cb)(struct pcx_buffer *buf,
+                          void *user_data);
+
+/* Called whenever something happens that might change the state
+ * saved by pcx_server_save_state.
+ */
+typedef void
+(* pcx_server_state_changed_cb)(void *user_data);
+
 extern struct pcx_error_domain
 pcx_server_error;
 
 enum pcx_server_error {
-        PCX_SERVER_ERROR_INVALID_ADDRESS
+        PCX_SERVER_ERROR_INVALID_ADDRESS,
+        PCX_SERVER_ERROR_INVALID_STATE,
 };
 
 struct pcx_server *
@@ -41,9 +62,103 @@ pcx_server_add_config(struct pcx_server *server,
                       const struct pcx_config_server *server_config,
                       struct pcx_error **error);
 
+/* Makes the listen sockets match a new list of pcx_config_server
+ * structs. Sockets for an address that is in both lists are kept open
+ * along with their connections, but everything else about them is
+ * set up again from the new config. Sockets that aren’t in the new
+ * list are closed. If anything fails then the running sockets are
+ * left as they were. The configs need to stay alive for as long as
+ * the server uses them.
+ */
+bool
+pcx_server_set_configs(struct pcx_server *server,
+                       const struct pcx_list *server_configs,
+                       struct pcx_error **error);
+
 int
 pcx_server_get_n_players(struct pcx_server *server);
 
+int
+pcx_server_get_n_unsaveable_players(struct pcx_server *server);
+
+/* Returns the number of conversations that haven’t been destroyed
+ * yet, including the ones that have started.
+ */
+int
+pcx_server_get_n_conversations(struct pcx_server *server);
+
+/* Returns the number of times a client was sent SERVER_FULL */
+int
+pcx_server_get_n_refused_players(struct pcx_server *server);
+
+void
+pcx_server_get_time_to_game(struct pcx_server *server,
+                            struct pcx_matchmaker_time_to_game *stats);
+
+/* Adds the commands to list and stop the games */
+void
+pcx_server_add_admin_commands(struct pcx_server *server,
+                              struct pcx_admin *admin);
+
+/* While draining, clients can’t start or join new games */
+void
+pcx_server_set_draining(struct pcx_server *server,
+                        bool draining);
+
+void
+pcx_server_set_metrics_cb(struct pcx_server *server,
+                          pcx_server_metrics_cb cb,
+                          void *user_data);
+
+void
+pcx_server_set_state_changed_cb(struct pcx_server *server,
+                                pcx_server_state_changed_cb cb,
+                                void *user_data);
+
+/* Saves the games that are running so that they can be picked up
+ * again with pcx_server_restore_state after a restart. Games that
+ * haven’t started yet and games that don’t support snapshots aren’t
+ * saved. If max_cache_age isn’t zero then games that haven’t changed
+ * since the last save reuse the saved data if it is at most that
+ * many µs old.
+ */
+void
+pcx_server_save_state(struct pcx_server *server,
+                      struct pcx_buffer *buf,
+                      uint64_t max_cache_age);
+
+bool
+pcx_server_restore_state(struct pcx_server *server,
+                         const uint8_t *data,
+                         size_t length,
+                         struct pcx_error **error);
+
+/* Appends a description of each listen socket to buf and its fd to
+ * the fds buffer so that they can be handed over to a new process
+ * during a live upgrade.
+ */
+void
+pcx_server_save_listen_sockets(struct pcx_server *server,
+                               struct pcx_buffer *buf,
+                               struct pcx_buffer *fds);
+
+/* Takes ownership of the fds from pcx_server_save_listen_sockets in
+ * the new process. This needs to be called before adding the configs
+ * so that any config that matches one of the sockets will use it
+ * instead of binding a new one.
+ */
+bool
+pcx_server_add_inherited_sockets(struct pcx_server *server,
+                                 const uint8_t *data,
+                                 size_t length,
+                                 const int *fds,
+                                 int n_fds,
+                                 struct pcx_error **error);
+
+/* Closes the inherited sockets that no config used */
+void
+pcx_server_close_inherited_sockets(struct pcx_server *server);
+
 void
 pcx_server_free(struct pcx_server *server);
 
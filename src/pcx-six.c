@@ -26,6 +26,7 @@
 #include <assert.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
 
 #include "pcx-util.h"
 #include "pcx-main-context.h"
@@ -817,6 +818,167 @@ free_game_cb(void *data)
         pcx_free(six);
 }
 
+static void
+snapshot_cb(void *data,
+            struct pcx_buffer *buf)
+{
+        struct pcx_six *six = data;
+
+        pcx_snapshot_write_int(buf, six->n_cards);
+        pcx_snapshot_write_uint32(buf, six->card_chosen_mask);
+
+        for (int i = 0; i < six->n_players; i++) {
+                const struct pcx_six_player *player = six->players + i;
+
+                pcx_snapshot_write_int(buf, player->score);
+                pcx_snapshot_write_int(buf, player->score_this_round);
+                pcx_snapshot_write_int(buf, player->chosen_card);
+                pcx_snapshot_write_data(buf, player->hand, six->n_cards);
+
+                /* The reveal order can’t be worked out again because
+                 * the cards have been removed from the hands.
+                 */
+                const struct pcx_six_player *reveal = six->reveal_order[i];
+
+                pcx_snapshot_write_int(buf,
+                                       reveal ? reveal - six->players : -1);
+        }
+
+        for (int i = 0; i < PCX_SIX_N_ROWS; i++) {
+                const struct pcx_six_row *row = six->rows + i;
+
+                pcx_snapshot_write_data(buf, row->cards, row->n_cards);
+        }
+
+        pcx_snapshot_write_int(buf, six->next_placement);
+        pcx_snapshot_write_int(buf, six->player_choosing_row);
+        pcx_snapshot_write_bool(buf, six->placement_timer_source != NULL);
+        pcx_snapshot_write_bool(buf, six->game_over_source != NULL);
+}
+
+static void
+restore_cards(struct pcx_snapshot_reader *reader,
+              pcx_six_card_t *cards,
+              int min_cards,
+              int max_cards,
+              int *n_cards_out)
+{
+        size_t n_cards;
+        const uint8_t *data = pcx_snapshot_read_data(reader, &n_cards);
+
+        if (data == NULL || n_cards < min_cards || n_cards > max_cards) {
+                pcx_snapshot_reader_set_error(reader);
+                return;
+        }
+
+        for (unsigned i = 0; i < n_cards; i++) {
+                if (data[i] >= PCX_SIX_N_CARDS) {
+                        pcx_snapshot_reader_set_error(reader);
+                        return;
+                }
+
+                cards[i] = data[i];
+        }
+
+        *n_cards_out = n_cards;
+}
+
+static void *
+restore_cb(const struct pcx_config *config,
+           const struct pcx_game_callbacks *callbacks,
+           void *user_data,
+           enum pcx_text_language language,
+           int n_players,
+           const char * const *names,
+           struct pcx_snapshot_reader *reader)
+{
+        if (n_players < 1 || n_players > PCX_SIX_MAX_PLAYERS)
+                return NULL;
+
+        struct pcx_six *six = pcx_calloc(sizeof *six);
+
+        six->language = language;
+        six->callbacks = *callbacks;
+        six->user_data = user_data;
+        six->n_players = n_players;
+
+        six->n_cards = pcx_snapshot_read_int_range(reader,
+                                                   0,
+                                                   PCX_SIX_HAND_SIZE);
+        six->card_chosen_mask = pcx_snapshot_read_uint32(reader);
+
+        if (six->card_chosen_mask >= UINT32_C(1) << n_players)
+                pcx_snapshot_reader_set_error(reader);
+
+        for (int i = 0; i < n_players; i++) {
+                struct pcx_six_player *player = six->players + i;
+                int n_cards = 0;
+
+                player->name = pcx_strdup(names[i]);
+                player->score = pcx_snapshot_read_int_range(reader,
+                                                            0,
+                                                            INT_MAX);
+                player->score_this_round =
+                        pcx_snapshot_read_int_range(reader, 0, INT_MAX);
+                player->chosen_card =
+                        pcx_snapshot_read_int_range(reader,
+                                                    0,
+                                                    PCX_SIX_HAND_SIZE - 1);
+                restore_cards(reader,
+                              player->hand,
+                              six->n_cards,
+                              six->n_cards,
+                              &n_cards);
+
+                int reveal = pcx_snapshot_read_int_range(reader,
+                                                         -1,
+                                                         n_players - 1);
+
+                six->reveal_order[i] = reveal == -1 ? NULL :
+                        six->players + reveal;
+        }
+
+        for (int i = 0; i < PCX_SIX_N_ROWS; i++) {
+                struct pcx_six_row *row = six->rows + i;
+
+                restore_cards(reader,
+                              row->cards,
+                              1,
+                              PCX_SIX_ROW_SIZE,
+                              &row->n_cards);
+        }
+
+        six->next_placement = pcx_snapshot_read_int_range(reader,
+                                                          0,
+                                                          n_players);
+        six->player_choosing_row =
+                pcx_snapshot_read_int_range(reader, -1, n_players - 1);
+
+        bool placing = pcx_snapshot_read_bool(reader);
+        bool game_over = pcx_snapshot_read_bool(reader);
+
+        /* The placement code only uses the reveal order while the
+         * cards are being placed.
+         */
+        if ((placing || six->player_choosing_row != -1) &&
+            six->next_placement < n_players &&
+            six->reveal_order[six->next_placement] == NULL)
+                pcx_snapshot_reader_set_error(reader);
+
+        if (reader->error) {
+                free_game_cb(six);
+                return NULL;
+        }
+
+        if (placing)
+                start_placement_timer(six);
+
+        if (game_over)
+                end_game(six);
+
+        return six;
+}
+
 const struct pcx_game
 pcx_six_game = {
         .name = "six",
@@ -830,5 +992,7 @@ pcx_six_game = {
         .create_game_cb = create_game_cb,
         .get_help_cb = get_help_cb,
         .handle_callback_data_cb = handle_callback_data_cb,
-        .free_game_cb = free_game_cb
+        .free_game_cb = free_game_cb,
+        .snapshot_cb = snapshot_cb,
+        .restore_cb = restore_cb,
 };
@@ -48,6 +48,30 @@ pcx_slab_align(size_t base, int alignment)
         return (base + alignment - 1) & ~(alignment - 1);
 }
 
+static void *
+allocate_large(struct pcx_slab_allocator *allocator,
+               size_t size,
+               int alignment)
+{
+        size_t offset = pcx_slab_align(sizeof(struct pcx_slab), alignment);
+        struct pcx_slab *slab = pcx_alloc(offset + size);
+
+        /* Put the large block after the current slab so that the
+         * remaining space in it can still be used. If there isn’t a
+         * current slab then slab_used will already force a new one
+         * on the next allocation.
+         */
+        if (allocator->slabs) {
+                slab->next = allocator->slabs->next;
+                allocator->slabs->next = slab;
+        } else {
+                slab->next = NULL;
+                allocator->slabs = slab;
+        }
+
+        return (uint8_t *) slab + offset;
+}
+
 void *
 pcx_slab_allocate(struct pcx_slab_allocator *allocator,
                   size_t size, int alignment)
@@ -55,6 +79,13 @@ pcx_slab_allocate(struct pcx_slab_allocator *allocator,
         struct pcx_slab *slab;
         size_t offset;
 
+        /* Allocations that wouldn’t fit in an empty slab get a block
+         * of their own.
+         */
+        if (size + pcx_slab_align(sizeof(struct pcx_slab), alignment) >
+            PCX_SLAB_SIZE)
+                return allocate_large(allocator, size, alignment);
+
         offset = pcx_slab_align(allocator->slab_used, alignment);
 
         if (size + offset > PCX_SLAB_SIZE) {
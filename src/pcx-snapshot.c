@@ -0,0 +1,225 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "pcx-snapshot.h"
+
+#include <string.h>
+
+#include "pcx-util.h"
+
+void
+pcx_snapshot_write_uint8(struct pcx_buffer *buf,
+                         uint8_t value)
+{
+        pcx_buffer_append_c(buf, value);
+}
+
+void
+pcx_snapshot_write_uint16(struct pcx_buffer *buf,
+                          uint16_t value)
+{
+        value = PCX_UINT16_TO_LE(value);
+        pcx_buffer_append(buf, &value, sizeof value);
+}
+
+void
+pcx_snapshot_write_uint32(struct pcx_buffer *buf,
+                          uint32_t value)
+{
+        value = PCX_UINT32_TO_LE(value);
+        pcx_buffer_append(buf, &value, sizeof value);
+}
+
+void
+pcx_snapshot_write_uint64(struct pcx_buffer *buf,
+                          uint64_t value)
+{
+        value = PCX_UINT64_TO_LE(value);
+        pcx_buffer_append(buf, &value, sizeof value);
+}
+
+void
+pcx_snapshot_write_bool(struct pcx_buffer *buf,
+                        bool value)
+{
+        pcx_snapshot_write_uint8(buf, value ? 1 : 0);
+}
+
+void
+pcx_snapshot_write_int(struct pcx_buffer *buf,
+                       int value)
+{
+        pcx_snapshot_write_uint32(buf, (uint32_t) (int32_t) value);
+}
+
+void
+pcx_snapshot_write_string(struct pcx_buffer *buf,
+                          const char *value)
+{
+        pcx_snapshot_write_data(buf, value, strlen(value) + 1);
+}
+
+void
+pcx_snapshot_write_data(struct pcx_buffer *buf,
+                        const void *data,
+                        size_t length)
+{
+        pcx_snapshot_write_uint32(buf, length);
+        pcx_buffer_append(buf, data, length);
+}
+
+void
+pcx_snapshot_reader_init(struct pcx_snapshot_reader *reader,
+                         const void *data,
+                         size_t length)
+{
+        reader->data = data;
+        reader->length = length;
+        reader->pos = 0;
+        reader->error = false;
+}
+
+void
+pcx_snapshot_reader_set_error(struct pcx_snapshot_reader *reader)
+{
+        reader->error = true;
+        /* Make all of the following reads fail too */
+        reader->pos = reader->length;
+}
+
+static const uint8_t *
+take_bytes(struct pcx_snapshot_reader *reader,
+           size_t length)
+{
+        if (reader->error || reader->length - reader->pos < length) {
+                pcx_snapshot_reader_set_error(reader);
+                return NULL;
+        }
+
+        const uint8_t *p = reader->data + reader->pos;
+
+        reader->pos += length;
+
+        return p;
+}
+
+uint8_t
+pcx_snapshot_read_uint8(struct pcx_snapshot_reader *reader)
+{
+        const uint8_t *p = take_bytes(reader, sizeof (uint8_t));
+
+        return p ? *p : 0;
+}
+
+uint16_t
+pcx_snapshot_read_uint16(struct pcx_snapshot_reader *reader)
+{
+        uint16_t value;
+        const uint8_t *p = take_bytes(reader, sizeof value);
+
+        if (p == NULL)
+                return 0;
+
+        memcpy(&value, p, sizeof value);
+
+        return PCX_UINT16_FROM_LE(value);
+}
+
+uint32_t
+pcx_snapshot_read_uint32(struct pcx_snapshot_reader *reader)
+{
+        uint32_t value;
+        const uint8_t *p = take_bytes(reader, sizeof value);
+
+        if (p == NULL)
+                return 0;
+
+        memcpy(&value, p, sizeof value);
+
+        return PCX_UINT32_FROM_LE(value);
+}
+
+uint64_t
+pcx_snapshot_read_uint64(struct pcx_snapshot_reader *reader)
+{
+        uint64_t value;
+        const uint8_t *p = take_bytes(reader, sizeof value);
+
+        if (p == NULL)
+                return 0;
+
+        memcpy(&value, p, sizeof value);
+
+        return PCX_UINT64_FROM_LE(value);
+}
+
+bool
+pcx_snapshot_read_bool(struct pcx_snapshot_reader *reader)
+{
+        uint8_t value = pcx_snapshot_read_uint8(reader);
+
+        if (value > 1) {
+                pcx_snapshot_reader_set_error(reader);
+                return false;
+        }
+
+        return value;
+}
+
+int
+pcx_snapshot_read_int_range(struct pcx_snapshot_reader *reader,
+                            int min,
+                            int max)
+{
+        int value = (int32_t) pcx_snapshot_read_uint32(reader);
+
+        if (value < min || value > max) {
+                pcx_snapshot_reader_set_error(reader);
+                return min;
+        }
+
+        return value;
+}
+
+const uint8_t *
+pcx_snapshot_read_data(struct pcx_snapshot_reader *reader,
+                       size_t *length_out)
+{
+        uint32_t length = pcx_snapshot_read_uint32(reader);
+        const uint8_t *p = take_bytes(reader, length);
+
+        *length_out = p ? length : 0;
+
+        return p;
+}
+
+const char *
+pcx_snapshot_read_string(struct pcx_snapshot_reader *reader)
+{
+        size_t length;
+        const uint8_t *p = pcx_snapshot_read_data(reader, &length);
+
+        if (p == NULL || length < 1 || memchr(p, 0, length) != p + length - 1) {
+                pcx_snapshot_reader_set_error(reader);
+                return "";
+        }
+
+        return (const char *) p;
+}
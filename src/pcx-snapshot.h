@@ -0,0 +1,127 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PCX_SNAPSHOT_H
+#define PCX_SNAPSHOT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "pcx-buffer.h"
+
+/* Helpers to save the state of the running games in a compact binary
+ * format so that they can survive a restart of the server. All of
+ * the numbers are little-endian and there is no padding. Strings are
+ * stored with a 32-bit length that includes the terminating zero.
+ *
+ * The reader never reads past the end of the data. Instead it sets
+ * the error flag and returns zeroes and empty strings so that the
+ * callers only need to check the flag once they have read
+ * everything.
+ */
+
+struct pcx_snapshot_reader {
+        const uint8_t *data;
+        size_t length;
+        size_t pos;
+        bool error;
+};
+
+void
+pcx_snapshot_write_uint8(struct pcx_buffer *buf,
+                         uint8_t value);
+
+void
+pcx_snapshot_write_uint16(struct pcx_buffer *buf,
+                          uint16_t value);
+
+void
+pcx_snapshot_write_uint32(struct pcx_buffer *buf,
+                          uint32_t value);
+
+void
+pcx_snapshot_write_uint64(struct pcx_buffer *buf,
+                          uint64_t value);
+
+void
+pcx_snapshot_write_bool(struct pcx_buffer *buf,
+                        bool value);
+
+/* Stored as a signed 32-bit number */
+void
+pcx_snapshot_write_int(struct pcx_buffer *buf,
+                       int value);
+
+void
+pcx_snapshot_write_string(struct pcx_buffer *buf,
+                          const char *value);
+
+void
+pcx_snapshot_write_data(struct pcx_buffer *buf,
+                        const void *data,
+                        size_t length);
+
+void
+pcx_snapshot_reader_init(struct pcx_snapshot_reader *reader,
+                         const void *data,
+                         size_t length);
+
+uint8_t
+pcx_snapshot_read_uint8(struct pcx_snapshot_reader *reader);
+
+uint16_t
+pcx_snapshot_read_uint16(struct pcx_snapshot_reader *reader);
+
+uint32_t
+pcx_snapshot_read_uint32(struct pcx_snapshot_reader *reader);
+
+uint64_t
+pcx_snapshot_read_uint64(struct pcx_snapshot_reader *reader);
+
+bool
+pcx_snapshot_read_bool(struct pcx_snapshot_reader *reader);
+
+/* Reads an integer and checks that it is in the range [min, max].
+ * The error flag is set if it isn’t.
+ */
+int
+pcx_snapshot_read_int_range(struct pcx_snapshot_reader *reader,
+                            int min,
+                            int max);
+
+/* Returns a pointer into the reader’s data. The string is checked to
+ * be terminated and to not contain any other zeroes.
+ */
+const char *
+pcx_snapshot_read_string(struct pcx_snapshot_reader *reader);
+
+/* Returns a pointer into the reader’s data. This is NULL if there is
+ * an error.
+ */
+const uint8_t *
+pcx_snapshot_read_data(struct pcx_snapshot_reader *reader,
+                       size_t *length);
+
+/* Marks the data as invalid. This can be used by the callers when
+ * the values they read don’t make sense.
+ */
+void
+pcx_snapshot_reader_set_error(struct pcx_snapshot_reader *reader);
+
+#endif /* PCX_SNAPSHOT_H */
@@ -26,6 +26,7 @@
 #include <assert.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
 
 #include "pcx-util.h"
 #include "pcx-main-context.h"
@@ -898,6 +899,185 @@ free_game_cb(void *data)
         pcx_free(snitch);
 }
 
+static void
+snapshot_roles(struct pcx_buffer *buf,
+               const enum pcx_snitch_role *roles,
+               size_t n_roles)
+{
+        pcx_snapshot_write_uint32(buf, n_roles);
+
+        for (unsigned i = 0; i < n_roles; i++)
+                pcx_snapshot_write_uint8(buf, roles[i]);
+}
+
+static void
+snapshot_cb(void *data,
+            struct pcx_buffer *buf)
+{
+        struct pcx_snitch *snitch = data;
+
+        pcx_snapshot_write_int(buf, snitch->round_num);
+        pcx_snapshot_write_int(buf, snitch->first_player);
+        snapshot_roles(buf, snitch->deck, snitch->n_cards);
+        snapshot_roles(buf,
+                       snitch->discarded_cards,
+                       snitch->n_discarded_cards);
+        pcx_snapshot_write_int(buf, snitch->heist_size);
+
+        for (unsigned i = 0; i < PCX_SNITCH_N_BASE_ROLES; i++)
+                pcx_snapshot_write_int(buf, snitch->heist[i]);
+
+        for (unsigned i = 0; i < snitch->n_players; i++) {
+                const struct pcx_snitch_player *player = snitch->players + i;
+
+                pcx_snapshot_write_int(buf, player->coins);
+                pcx_snapshot_write_int(buf, player->chosen_role);
+
+                for (unsigned role = 0; role < PCX_SNITCH_N_ROLES; role++)
+                        pcx_snapshot_write_int(buf, player->cards[role]);
+        }
+}
+
+static size_t
+restore_roles(struct pcx_snapshot_reader *reader,
+              enum pcx_snitch_role *roles)
+{
+        uint32_t n_roles = pcx_snapshot_read_uint32(reader);
+
+        if (n_roles > PCX_SNITCH_N_BASE_CARDS) {
+                pcx_snapshot_reader_set_error(reader);
+                return 0;
+        }
+
+        for (unsigned i = 0; i < n_roles; i++) {
+                uint8_t role = pcx_snapshot_read_uint8(reader);
+
+                if (role >= PCX_SNITCH_N_BASE_ROLES)
+                        pcx_snapshot_reader_set_error(reader);
+
+                roles[i] = role;
+        }
+
+        return n_roles;
+}
+
+static bool
+is_restored_state_valid(struct pcx_snitch *snitch)
+{
+        bool heist_active = (snitch->heist_size != -1 &&
+                             snitch->round_num < PCX_SNITCH_N_ROUNDS);
+        int n_cards = snitch->n_cards + snitch->n_discarded_cards;
+        int n_heist_cards = 0;
+
+        for (unsigned i = 0; i < PCX_SNITCH_N_BASE_ROLES; i++)
+                n_heist_cards += snitch->heist[i];
+
+        if (heist_active) {
+                if (n_heist_cards != snitch->heist_size)
+                        return false;
+                n_cards += n_heist_cards;
+        }
+
+        for (unsigned i = 0; i < snitch->n_players; i++) {
+                const struct pcx_snitch_player *player = snitch->players + i;
+
+                for (unsigned role = 0;
+                     role < PCX_SNITCH_N_BASE_ROLES;
+                     role++)
+                        n_cards += player->cards[role];
+
+                if (heist_active &&
+                    player->chosen_role != -1 &&
+                    player->cards[player->chosen_role] <= 0)
+                        return false;
+        }
+
+        /* Every base card should be somewhere */
+        return n_cards == PCX_SNITCH_N_BASE_CARDS;
+}
+
+static void *
+restore_cb(const struct pcx_config *config,
+           const struct pcx_game_callbacks *callbacks,
+           void *user_data,
+           enum pcx_text_language language,
+           int n_players,
+           const char * const *names,
+           struct pcx_snapshot_reader *reader)
+{
+        if (n_players < PCX_SNITCH_MIN_PLAYERS ||
+            n_players > PCX_SNITCH_MAX_PLAYERS)
+                return NULL;
+
+        struct pcx_snitch *snitch = pcx_calloc(sizeof *snitch);
+
+        snitch->language = language;
+        snitch->callbacks = *callbacks;
+        snitch->user_data = user_data;
+        snitch->n_players = n_players;
+
+        snitch->round_num =
+                pcx_snapshot_read_int_range(reader, 0, PCX_SNITCH_N_ROUNDS);
+        snitch->first_player =
+                pcx_snapshot_read_int_range(reader, 0, n_players - 1);
+        snitch->n_cards = restore_roles(reader, snitch->deck);
+        snitch->n_discarded_cards =
+                restore_roles(reader, snitch->discarded_cards);
+        snitch->heist_size = pcx_snapshot_read_int_range(reader,
+                                                         -1,
+                                                         n_players);
+
+        if (snitch->heist_size >= 0 &&
+            snitch->heist_size < PCX_SNITCH_MIN_HEIST_SIZE)
+                pcx_snapshot_reader_set_error(reader);
+
+        for (unsigned i = 0; i < PCX_SNITCH_N_BASE_ROLES; i++) {
+                snitch->heist[i] =
+                        pcx_snapshot_read_int_range(reader, 0, n_players);
+        }
+
+        int max_cards = PCX_SNITCH_N_BASE_CARDS;
+
+        for (unsigned i = 0; i < n_players; i++) {
+                struct pcx_snitch_player *player = snitch->players + i;
+
+                player->name = pcx_strdup(names[i]);
+                /* Failed heists can make this negative */
+                player->coins = pcx_snapshot_read_int_range(reader,
+                                                            INT_MIN,
+                                                            INT_MAX);
+                player->chosen_role =
+                        pcx_snapshot_read_int_range(reader,
+                                                    -1,
+                                                    PCX_SNITCH_N_ROLES - 1);
+
+                for (unsigned role = 0; role < PCX_SNITCH_N_ROLES; role++) {
+                        player->cards[role] =
+                                pcx_snapshot_read_int_range(reader,
+                                                            0,
+                                                            max_cards);
+                }
+        }
+
+        if (!reader->error && !is_restored_state_valid(snitch))
+                pcx_snapshot_reader_set_error(reader);
+
+        if (reader->error) {
+                free_game_cb(snitch);
+                return NULL;
+        }
+
+        if (snitch->round_num >= PCX_SNITCH_N_ROUNDS) {
+                snitch->game_over_source =
+                        pcx_main_context_add_timeout(NULL,
+                                                     0, /* ms */
+                                                     game_over_cb,
+                                                     snitch);
+        }
+
+        return snitch;
+}
+
 const struct pcx_game
 pcx_snitch_game = {
         .name = "snitch",
@@ -911,5 +1091,7 @@ pcx_snitch_game = {
         .create_game_cb = create_game_cb,
         .get_help_cb = get_help_cb,
         .handle_callback_data_cb = handle_callback_data_cb,
-        .free_game_cb = free_game_cb
+        .free_game_cb = free_game_cb,
+        .snapshot_cb = snapshot_cb,
+        .restore_cb = restore_cb,
 };
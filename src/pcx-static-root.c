@@ -0,0 +1,446 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "pcx-static-root.h"
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#ifdef HAVE_OPENAT2
+#include <linux/openat2.h>
+#endif
+
+#include "pcx-util.h"
+#include "pcx-file-error.h"
+
+struct pcx_static_root {
+        int dir_fd;
+};
+
+static const struct {
+        const char *extension;
+        const char *type;
+} content_types[] = {
+        { "html", "text/html; charset=utf-8" },
+        { "js", "text/javascript; charset=utf-8" },
+        { "css", "text/css; charset=utf-8" },
+        { "txt", "text/plain; charset=utf-8" },
+        { "json", "application/json" },
+        { "svg", "image/svg+xml" },
+        { "png", "image/png" },
+        { "jpg", "image/jpeg" },
+        { "ico", "image/x-icon" },
+        { "mp3", "audio/mpeg" },
+};
+
+/* Files that have a part of at least this many hex digits between
+ * two dots in their name, like “pucxobot.0123abcd.js”, are assumed to
+ * never change so the clients can cache them forever.
+ */
+#define MIN_HASH_LENGTH 8
+
+static const char
+hashed_cache_control[] = "public, max-age=31536000, immutable";
+
+/* Everything else has to be checked with the ETag every time */
+static const char
+default_cache_control[] = "no-cache";
+
+struct pcx_static_root *
+pcx_static_root_new(const char *path,
+                    struct pcx_error **error)
+{
+        int dir_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+        if (dir_fd == -1) {
+                pcx_file_error_set(error,
+                                   errno,
+                                   "%s: %s",
+                                   path,
+                                   strerror(errno));
+                return NULL;
+        }
+
+        struct pcx_static_root *root = pcx_alloc(sizeof *root);
+
+        root->dir_fd = dir_fd;
+
+        return root;
+}
+
+static const char *
+get_content_type(const char *filename)
+{
+        const char *slash = strrchr(filename, '/');
+
+        if (slash)
+                filename = slash + 1;
+
+        const char *dot = strrchr(filename, '.');
+
+        if (dot) {
+                for (unsigned i = 0; i < PCX_N_ELEMENTS(content_types); i++) {
+                        if (pcx_ascii_string_case_equal(dot + 1,
+                                                        content_types[i].
+                                                        extension))
+                                return content_types[i].type;
+                }
+        }
+
+        return "application/octet-stream";
+}
+
+static bool
+is_hashed_name(const char *path)
+{
+        const char *part = strchr(strrchr(path, '/'), '.');
+
+        while (part) {
+                const char *end = strchr(part + 1, '.');
+
+                if (end == NULL)
+                        break;
+
+                size_t length = end - part - 1;
+
+                if (length >= MIN_HASH_LENGTH &&
+                    strspn(part + 1, "0123456789abcdefABCDEF") == length)
+                        return true;
+
+                part = end;
+        }
+
+        return false;
+}
+
+static bool
+is_safe_path(const char *path)
+{
+        if (path[0] != '/')
+                return false;
+
+        /* Nothing is decoded so the file names can’t contain a
+         * percent sign anyway.
+         */
+        if (strchr(path, '%'))
+                return false;
+
+        /* Refuse “..”, “.”, hidden files such as .htaccess and empty
+         * parts. A path like “//etc/passwd” would otherwise still be
+         * absolute after removing the first slash.
+         */
+        for (const char *p = path; (p = strchr(p, '/')); p++) {
+                if (p[1] == '.' || p[1] == '/')
+                        return false;
+        }
+
+        return true;
+}
+
+static bool
+etag_matches(const char *header,
+             const char *etag)
+{
+        size_t etag_length = strlen(etag);
+
+        while (*header) {
+                size_t item_length = strcspn(header, ",");
+                size_t start = strspn(header, " \t");
+                size_t end = item_length;
+
+                while (end > start && strchr(" \t", header[end - 1]))
+                        end--;
+
+                const char *item = header + start;
+                size_t length = end - start;
+
+                if (length == 1 && *item == '*')
+                        return true;
+
+                /* The weak comparison is fine for a GET */
+                if (length >= 2 && !memcmp(item, "W/", 2)) {
+                        item += 2;
+                        length -= 2;
+                }
+
+                if (length == etag_length && !memcmp(item, etag, length))
+                        return true;
+
+                header += item_length;
+                if (*header == ',')
+                        header++;
+        }
+
+        return false;
+}
+
+/* Opens each directory in the path in turn without following
+ * symlinks. This is used when the kernel doesn’t have openat2.
+ */
+static int
+open_walking(int dir_fd,
+             const char *path,
+             int flags)
+{
+        int fd = dir_fd;
+        const char *slash;
+
+        while ((slash = strchr(path, '/'))) {
+                char *part = pcx_strndup(path, slash - path);
+                int next_fd = openat(fd,
+                                     part,
+                                     O_RDONLY | O_DIRECTORY | O_NOFOLLOW |
+                                     O_CLOEXEC);
+
+                pcx_free(part);
+
+                if (fd != dir_fd)
+                        pcx_close(fd);
+
+                if (next_fd == -1)
+                        return -1;
+
+                fd = next_fd;
+                path = slash + 1;
+        }
+
+        int ret = openat(fd, path, flags | O_NOFOLLOW);
+
+        if (fd != dir_fd)
+                pcx_close(fd);
+
+        return ret;
+}
+
+/* Opens a file relative to the root without letting the path or a
+ * symlink lead outside of it.
+ */
+static int
+open_beneath(struct pcx_static_root *root,
+             const char *filename,
+             int flags)
+{
+#if defined(HAVE_OPENAT2) && defined(SYS_openat2)
+        struct open_how how = {
+                .flags = flags | O_CLOEXEC,
+                .resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS,
+        };
+
+        int fd = syscall(SYS_openat2, root->dir_fd, filename, &how, sizeof how);
+
+        if (fd != -1 || errno != ENOSYS)
+                return fd;
+#endif
+
+        return open_walking(root->dir_fd, filename, flags | O_CLOEXEC);
+}
+
+static bool
+stat_beneath(struct pcx_static_root *root,
+             const char *filename,
+             struct stat *statbuf)
+{
+        int fd = open_beneath(root, filename, O_RDONLY | O_NONBLOCK);
+
+        if (fd == -1)
+                return false;
+
+        bool ret = fstat(fd, statbuf) == 0;
+
+        pcx_close(fd);
+
+        return ret;
+}
+
+static int
+open_regular_file(struct pcx_static_root *root,
+                  const char *filename,
+                  struct stat *statbuf)
+{
+        /* O_NONBLOCK so that opening a FIFO can’t block */
+        int fd = open_beneath(root, filename, O_RDONLY | O_NONBLOCK);
+
+        if (fd == -1)
+                return -1;
+
+        if (fstat(fd, statbuf) == -1 || !S_ISREG(statbuf->st_mode)) {
+                pcx_close(fd);
+                return -1;
+        }
+
+        return fd;
+}
+
+static bool
+has_gzip_variant(struct pcx_static_root *root,
+                 const char *gz_filename,
+                 const struct stat *statbuf)
+{
+        struct stat gz_statbuf;
+
+        /* Ignore the compressed file if it looks older than the
+         * original because it was probably left over from an
+         * earlier install.
+         */
+        return (stat_beneath(root, gz_filename, &gz_statbuf) &&
+                S_ISREG(gz_statbuf.st_mode) &&
+                gz_statbuf.st_mtime >= statbuf->st_mtime);
+}
+
+static void
+handle_file(struct pcx_static_root *root,
+            const struct pcx_connection_http_request_event *request,
+            struct pcx_buffer *filename,
+            struct pcx_buffer *headers,
+            struct pcx_static_root_reply *reply)
+{
+        struct stat statbuf;
+        int fd = open_regular_file(root,
+                                   (const char *) filename->data,
+                                   &statbuf);
+
+        if (fd == -1)
+                return;
+
+        const char *content_type =
+                get_content_type((const char *) filename->data);
+
+        pcx_buffer_append_string(filename, ".gz");
+
+        bool has_gzip = has_gzip_variant(root,
+                                         (const char *) filename->data,
+                                         &statbuf);
+        bool use_gzip = false;
+
+        if (has_gzip && request->accepts_gzip) {
+                struct stat gz_statbuf;
+                int gz_fd = open_regular_file(root,
+                                              (const char *) filename->data,
+                                              &gz_statbuf);
+
+                if (gz_fd != -1) {
+                        pcx_close(fd);
+                        fd = gz_fd;
+                        statbuf = gz_statbuf;
+                        use_gzip = true;
+                }
+        }
+
+        char etag[64];
+
+        snprintf(etag, sizeof etag,
+                 "\"%" PRIx64 "-%" PRIx64 "\"",
+                 (uint64_t) statbuf.st_size,
+                 (uint64_t) statbuf.st_mtime);
+
+        const char *cache_control = (is_hashed_name(request->path) ?
+                                     hashed_cache_control :
+                                     default_cache_control);
+
+        pcx_buffer_append_printf(headers,
+                                 "ETag: %s\r\n"
+                                 "Cache-Control: %s\r\n",
+                                 etag,
+                                 cache_control);
+
+        if (has_gzip)
+                pcx_buffer_append_string(headers, "Vary: Accept-Encoding\r\n");
+
+        if (request->if_none_match &&
+            etag_matches(request->if_none_match, etag)) {
+                pcx_close(fd);
+                reply->status = 304;
+                return;
+        }
+
+        pcx_buffer_append_printf(headers,
+                                 "Content-Type: %s\r\n",
+                                 content_type);
+
+        if (use_gzip)
+                pcx_buffer_append_string(headers, "Content-Encoding: gzip\r\n");
+
+        reply->status = 200;
+        reply->fd = fd;
+        reply->length = statbuf.st_size;
+}
+
+void
+pcx_static_root_handle_request(struct pcx_static_root *root,
+                               const struct
+                               pcx_connection_http_request_event *request,
+                               struct pcx_buffer *headers,
+                               struct pcx_static_root_reply *reply)
+{
+        reply->status = 404;
+        reply->fd = -1;
+        reply->length = 0;
+
+        if (strcmp(request->method, "GET") &&
+            strcmp(request->method, "HEAD")) {
+                reply->status = 405;
+                pcx_buffer_append_string(headers, "Allow: GET, HEAD\r\n");
+                return;
+        }
+
+        if (!is_safe_path(request->path))
+                return;
+
+        const char *relative_path = request->path + 1;
+        size_t path_length = strlen(relative_path);
+        struct pcx_buffer filename = PCX_BUFFER_STATIC_INIT;
+
+        pcx_buffer_append_string(&filename, relative_path);
+
+        if (path_length == 0 || relative_path[path_length - 1] == '/') {
+                pcx_buffer_append_string(&filename, "index.html");
+        } else {
+                struct stat statbuf;
+
+                if (stat_beneath(root, relative_path, &statbuf) &&
+                    S_ISDIR(statbuf.st_mode)) {
+                        /* Redirect so that relative links in the
+                         * index work.
+                         */
+                        reply->status = 301;
+                        pcx_buffer_append_printf(headers,
+                                                 "Location: %s/\r\n",
+                                                 request->path);
+                        goto done;
+                }
+        }
+
+        handle_file(root, request, &filename, headers, reply);
+
+done:
+        pcx_buffer_destroy(&filename);
+}
+
+void
+pcx_static_root_free(struct pcx_static_root *root)
+{
+        pcx_close(root->dir_fd);
+        pcx_free(root);
+}
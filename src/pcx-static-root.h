@@ -0,0 +1,60 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PCX_STATIC_ROOT_H
+#define PCX_STATIC_ROOT_H
+
+#include <stdint.h>
+
+#include "pcx-error.h"
+#include "pcx-buffer.h"
+#include "pcx-connection.h"
+
+/* A directory of files to serve to plain HTTP requests. If there is
+ * a file with the same name plus “.gz” next to a file then it is
+ * sent instead to clients that accept gzip.
+ */
+
+struct pcx_static_root;
+
+struct pcx_static_root_reply {
+        int status;
+        /* File to send as the body or -1 */
+        int fd;
+        uint64_t length;
+};
+
+struct pcx_static_root *
+pcx_static_root_new(const char *path,
+                    struct pcx_error **error);
+
+/* Works out the reply to the request. The extra headers for the reply
+ * are appended to the buffer. If reply->fd isn’t -1 then the caller
+ * takes ownership of it.
+ */
+void
+pcx_static_root_handle_request(struct pcx_static_root *root,
+                               const struct
+                               pcx_connection_http_request_event *request,
+                               struct pcx_buffer *headers,
+                               struct pcx_static_root_reply *reply);
+
+void
+pcx_static_root_free(struct pcx_static_root *root);
+
+#endif /* PCX_STATIC_ROOT_H */
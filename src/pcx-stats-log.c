@@ -0,0 +1,281 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "pcx-stats-log.h"
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "pcx-util.h"
+#include "pcx-buffer.h"
+#include "pcx-log.h"
+#include "pcx-file-error.h"
+#include "pcx-main-context.h"
+
+/* The buffer is written once it is this big or once the first
+ * record in it has waited for FLUSH_DELAY.
+ */
+#define FLUSH_SIZE (PCX_STATS_RECORD_SIZE * 128)
+/* ms */
+#define FLUSH_DELAY (10 * 1000)
+
+static int pcx_stats_log_fd = -1;
+static struct pcx_buffer pcx_stats_log_buffer = PCX_BUFFER_STATIC_INIT;
+static struct pcx_main_context_source *pcx_stats_log_flush_source = NULL;
+/* Set after a failed write so that the error is only logged once */
+static bool pcx_stats_log_had_error = false;
+
+struct pcx_error_domain
+pcx_stats_log_error;
+
+static bool
+write_all(int fd,
+          const uint8_t *data,
+          size_t length)
+{
+        while (length > 0) {
+                ssize_t wrote = write(fd, data, length);
+
+                if (wrote == -1) {
+                        if (errno == EINTR)
+                                continue;
+                        return false;
+                }
+
+                data += wrote;
+                length -= wrote;
+        }
+
+        return true;
+}
+
+/* Cuts off any part of a record at the end of the file so that the
+ * new records stay aligned.
+ */
+static bool
+truncate_partial_record(int fd,
+                        off_t size)
+{
+        size_t partial = (size - PCX_STATS_MAGIC_SIZE) % PCX_STATS_RECORD_SIZE;
+
+        return partial == 0 || ftruncate(fd, size - partial) != -1;
+}
+
+static void
+flush_buffer(void)
+{
+        if (pcx_stats_log_flush_source) {
+                pcx_main_context_remove_source(pcx_stats_log_flush_source);
+                pcx_stats_log_flush_source = NULL;
+        }
+
+        if (pcx_stats_log_buffer.length == 0)
+                return;
+
+        /* The records are lost if this fails but the games carry on */
+        if (write_all(pcx_stats_log_fd,
+                      pcx_stats_log_buffer.data,
+                      pcx_stats_log_buffer.length)) {
+                pcx_stats_log_had_error = false;
+        } else {
+                int write_errno = errno;
+
+                /* The write may have stopped in the middle of a
+                 * record. It is cut off so that the records written
+                 * later don’t end up out of alignment.
+                 */
+                struct stat statbuf;
+
+                if (fstat(pcx_stats_log_fd, &statbuf) == 0)
+                        truncate_partial_record(pcx_stats_log_fd,
+                                                statbuf.st_size);
+
+                if (!pcx_stats_log_had_error) {
+                        pcx_log("Error writing the stats file: %s",
+                                strerror(write_errno));
+                        pcx_stats_log_had_error = true;
+                }
+        }
+
+        pcx_buffer_set_length(&pcx_stats_log_buffer, 0);
+}
+
+static void
+flush_cb(struct pcx_main_context_source *source,
+         void *user_data)
+{
+        pcx_stats_log_flush_source = NULL;
+
+        flush_buffer();
+}
+
+/* Checks the start of an existing file and makes sure that the new
+ * records will start on a record boundary.
+ */
+static bool
+prepare_file(int fd,
+             const char *filename,
+             struct pcx_error **error)
+{
+        struct stat statbuf;
+
+        if (fstat(fd, &statbuf) == -1) {
+                pcx_file_error_set(error,
+                                   errno,
+                                   "%s: %s",
+                                   filename,
+                                   strerror(errno));
+                return false;
+        }
+
+        if (statbuf.st_size == 0) {
+                if (!write_all(fd,
+                               (const uint8_t *) PCX_STATS_MAGIC,
+                               PCX_STATS_MAGIC_SIZE)) {
+                        pcx_file_error_set(error,
+                                           errno,
+                                           "%s: %s",
+                                           filename,
+                                           strerror(errno));
+                        return false;
+                }
+
+                return true;
+        }
+
+        char magic[PCX_STATS_MAGIC_SIZE];
+
+        if (pread(fd, magic, sizeof magic, 0) != sizeof magic ||
+            memcmp(magic, PCX_STATS_MAGIC, sizeof magic)) {
+                pcx_set_error(error,
+                              &pcx_stats_log_error,
+                              PCX_STATS_LOG_ERROR_INVALID,
+                              "%s: not a stats file",
+                              filename);
+                return false;
+        }
+
+        /* A crash in the middle of a write can leave part of a
+         * record at the end.
+         */
+        if (!truncate_partial_record(fd, statbuf.st_size)) {
+                pcx_file_error_set(error,
+                                   errno,
+                                   "%s: %s",
+                                   filename,
+                                   strerror(errno));
+                return false;
+        }
+
+        return true;
+}
+
+bool
+pcx_stats_log_open(const char *filename,
+                   struct pcx_error **error)
+{
+        int fd = open(filename,
+                      O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC,
+                      0666);
+
+        if (fd == -1) {
+                pcx_file_error_set(error,
+                                   errno,
+                                   "%s: %s",
+                                   filename,
+                                   strerror(errno));
+                return false;
+        }
+
+        if (!prepare_file(fd, filename, error)) {
+                pcx_close(fd);
+                return false;
+        }
+
+        pcx_stats_log_close();
+
+        pcx_stats_log_fd = fd;
+
+        return true;
+}
+
+void
+pcx_stats_log_add(enum pcx_stats_event event,
+                  enum pcx_stats_source source,
+                  const struct pcx_game *game_type,
+                  enum pcx_text_language language,
+                  int n_players,
+                  uint64_t start_time)
+{
+        if (pcx_stats_log_fd == -1)
+                return;
+
+        struct pcx_stats_record record = {
+                .time = pcx_main_context_get_wall_clock(NULL),
+                .event = event,
+                .source = source,
+                .n_players = n_players,
+        };
+
+        if (event != PCX_STATS_EVENT_START) {
+                uint64_t now = pcx_main_context_get_monotonic_clock(NULL);
+                record.duration = MIN((now - start_time) / 1000000,
+                                      UINT32_MAX);
+        }
+
+        strncpy(record.language,
+                pcx_text_get(language, PCX_TEXT_STRING_LANGUAGE_CODE),
+                PCX_STATS_LANGUAGE_SIZE);
+        strncpy(record.game, game_type->name, PCX_STATS_GAME_SIZE);
+
+        size_t pos = pcx_stats_log_buffer.length;
+
+        pcx_buffer_set_length(&pcx_stats_log_buffer,
+                              pos + PCX_STATS_RECORD_SIZE);
+        pcx_stats_encode(&record, pcx_stats_log_buffer.data + pos);
+
+        if (pcx_stats_log_buffer.length >= FLUSH_SIZE) {
+                flush_buffer();
+        } else if (pcx_stats_log_flush_source == NULL) {
+                pcx_stats_log_flush_source =
+                        pcx_main_context_add_timeout(NULL,
+                                                     FLUSH_DELAY,
+                                                     flush_cb,
+                                                     NULL);
+        }
+}
+
+void
+pcx_stats_log_close(void)
+{
+        if (pcx_stats_log_fd == -1)
+                return;
+
+        flush_buffer();
+
+        pcx_close(pcx_stats_log_fd);
+        pcx_stats_log_fd = -1;
+
+        pcx_buffer_destroy(&pcx_stats_log_buffer);
+        pcx_buffer_init(&pcx_stats_log_buffer);
+}
@@ -0,0 +1,62 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PCX_STATS_LOG_H
+#define PCX_STATS_LOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "pcx-error.h"
+#include "pcx-stats.h"
+#include "pcx-game.h"
+#include "pcx-text.h"
+
+/* Appends the game events to the file described in pcx-stats.h. The
+ * records are collected in memory and written in one go after a short
+ * delay so that a busy server doesn’t do a write for every game. Until
+ * a file is opened the events are ignored.
+ */
+
+extern struct pcx_error_domain
+pcx_stats_log_error;
+
+enum pcx_stats_log_error {
+        PCX_STATS_LOG_ERROR_INVALID,
+};
+
+bool
+pcx_stats_log_open(const char *filename,
+                   struct pcx_error **error);
+
+/* start_time is the monotonic clock in µs when the game started. It
+ * is used to work out the duration except for START events.
+ */
+void
+pcx_stats_log_add(enum pcx_stats_event event,
+                  enum pcx_stats_source source,
+                  const struct pcx_game *game_type,
+                  enum pcx_text_language language,
+                  int n_players,
+                  uint64_t start_time);
+
+/* Writes anything that is still waiting and closes the file */
+void
+pcx_stats_log_close(void);
+
+#endif /* PCX_STATS_LOG_H */
@@ -0,0 +1,489 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "pcx-stats.h"
+#include "pcx-buffer.h"
+#include "pcx-util.h"
+
+struct group {
+        bool used;
+
+        /* The key. The parts that the results aren’t split by are
+         * left as zeroes.
+         */
+        char game[PCX_STATS_GAME_SIZE + 1];
+        char language[PCX_STATS_LANGUAGE_SIZE + 1];
+        int source;
+
+        uint64_t counts[PCX_STATS_N_EVENTS];
+        /* Sum of the number of players in the started games */
+        uint64_t total_players;
+        /* Sum of the durations of the finished games in seconds */
+        uint64_t total_duration;
+};
+
+struct pcx_stats_main {
+        /* Open-addressed hash table of groups. The size is always a
+         * power of two and it is never more than half full.
+         */
+        struct group *groups;
+        size_t n_groups;
+        size_t size;
+
+        struct pcx_buffer filenames;
+
+        int64_t since;
+        bool split_language;
+        bool split_source;
+};
+
+#define INITIAL_SIZE 64
+
+static const char options[] = "-hd:ls";
+
+static const char * const
+source_names[] = {
+        [PCX_STATS_SOURCE_WEB] = "web",
+        [PCX_STATS_SOURCE_TELEGRAM] = "telegram",
+};
+
+static void
+usage(void)
+{
+        printf("Pucxobot stats - counts the games in a stats file\n"
+               "usage: pucxobot-stats [options]... <file>...\n"
+               " -h                   Show this help message\n"
+               " -d <days>            Only count the events from the\n"
+               "                      last <days> days\n"
+               " -l                   Split the results by language\n"
+               " -s                   Split the results by whether the\n"
+               "                      game was on the website or Telegram\n");
+}
+
+static bool
+process_arguments(struct pcx_stats_main *data,
+                  int argc, char **argv)
+{
+        int opt;
+
+        opterr = false;
+
+        while ((opt = getopt(argc, argv, options)) != -1) {
+                switch (opt) {
+                case ':':
+                case '?':
+                        fprintf(stderr,
+                                "invalid option '%c'\n",
+                                optopt);
+                        return false;
+
+                case '\1':
+                        pcx_buffer_append(&data->filenames,
+                                          &optarg,
+                                          sizeof optarg);
+                        break;
+
+                case 'h':
+                        usage();
+                        return false;
+
+                case 'd': {
+                        char *tail;
+
+                        errno = 0;
+                        long days = strtol(optarg, &tail, 10);
+
+                        if (errno || *tail || days < 0) {
+                                fprintf(stderr,
+                                        "invalid number of days \"%s\"\n",
+                                        optarg);
+                                return false;
+                        }
+
+                        data->since = time(NULL) - days * 24 * 60 * 60;
+                        break;
+                }
+
+                case 'l':
+                        data->split_language = true;
+                        break;
+
+                case 's':
+                        data->split_source = true;
+                        break;
+                }
+        }
+
+        if (data->filenames.length == 0) {
+                fprintf(stderr, "no stats file given\n");
+                return false;
+        }
+
+        return true;
+}
+
+static size_t
+hash_group_key(const struct group *key)
+{
+        /* FNV-1a */
+        uint32_t hash = 2166136261u;
+        const uint8_t *p = (const uint8_t *) key->game;
+
+        for (unsigned i = 0; i < sizeof key->game; i++)
+                hash = (hash ^ p[i]) * 16777619u;
+
+        p = (const uint8_t *) key->language;
+
+        for (unsigned i = 0; i < sizeof key->language; i++)
+                hash = (hash ^ p[i]) * 16777619u;
+
+        return (hash ^ key->source) * 16777619u;
+}
+
+static bool
+group_keys_equal(const struct group *a,
+                 const struct group *b)
+{
+        return (a->source == b->source &&
+                !memcmp(a->game, b->game, sizeof a->game) &&
+                !memcmp(a->language, b->language, sizeof a->language));
+}
+
+static struct group *
+find_slot(struct group *groups,
+          size_t size,
+          const struct group *key)
+{
+        size_t pos = hash_group_key(key) & (size - 1);
+
+        while (groups[pos].used && !group_keys_equal(groups + pos, key))
+                pos = (pos + 1) & (size - 1);
+
+        return groups + pos;
+}
+
+static void
+grow_groups(struct pcx_stats_main *data)
+{
+        size_t new_size = data->size ? data->size * 2 : INITIAL_SIZE;
+        struct group *new_groups = pcx_calloc(new_size * sizeof *new_groups);
+
+        for (size_t i = 0; i < data->size; i++) {
+                if (data->groups[i].used) {
+                        *find_slot(new_groups, new_size, data->groups + i) =
+                                data->groups[i];
+                }
+        }
+
+        pcx_free(data->groups);
+        data->groups = new_groups;
+        data->size = new_size;
+}
+
+static struct group *
+get_group(struct pcx_stats_main *data,
+          const struct group *key)
+{
+        if ((data->n_groups + 1) * 2 > data->size)
+                grow_groups(data);
+
+        struct group *group = find_slot(data->groups, data->size, key);
+
+        if (!group->used) {
+                *group = *key;
+                group->used = true;
+                data->n_groups++;
+        }
+
+        return group;
+}
+
+static void
+add_record(struct pcx_stats_main *data,
+           const struct pcx_stats_record *record)
+{
+        struct group key = { .source = -1 };
+
+        memcpy(key.game, record->game, sizeof key.game);
+
+        if (data->split_language)
+                memcpy(key.language, record->language, sizeof key.language);
+        if (data->split_source)
+                key.source = record->source;
+
+        struct group *group = get_group(data, &key);
+
+        group->counts[record->event]++;
+
+        switch (record->event) {
+        case PCX_STATS_EVENT_START:
+                group->total_players += record->n_players;
+                break;
+        case PCX_STATS_EVENT_END:
+                group->total_duration += record->duration;
+                break;
+        case PCX_STATS_EVENT_ABANDON:
+                break;
+        }
+}
+
+static void
+add_records(struct pcx_stats_main *data,
+            const uint8_t *records,
+            size_t n_records)
+{
+        for (size_t i = 0; i < n_records; i++) {
+                struct pcx_stats_record record;
+
+                if (!pcx_stats_decode(records + i * PCX_STATS_RECORD_SIZE,
+                                      &record))
+                        continue;
+
+                /* A crash can leave zeroes in place of a record */
+                if (record.game[0] == '\0')
+                        continue;
+
+                if (record.time < data->since)
+                        continue;
+
+                add_record(data, &record);
+        }
+}
+
+static bool
+read_file(struct pcx_stats_main *data,
+          const char *filename)
+{
+        int fd = open(filename, O_RDONLY | O_CLOEXEC);
+
+        if (fd == -1) {
+                fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+                return false;
+        }
+
+        bool ret = true;
+        struct stat statbuf;
+
+        if (fstat(fd, &statbuf) == -1) {
+                fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+                ret = false;
+                goto done;
+        }
+
+        if (statbuf.st_size < PCX_STATS_MAGIC_SIZE) {
+                fprintf(stderr, "%s: not a stats file\n", filename);
+                ret = false;
+                goto done;
+        }
+
+        const uint8_t *contents = mmap(NULL, /* addr */
+                                       statbuf.st_size,
+                                       PROT_READ,
+                                       MAP_PRIVATE,
+                                       fd,
+                                       0 /* offset */);
+
+        if (contents == MAP_FAILED) {
+                fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+                ret = false;
+                goto done;
+        }
+
+        if (memcmp(contents, PCX_STATS_MAGIC, PCX_STATS_MAGIC_SIZE)) {
+                fprintf(stderr, "%s: not a stats file\n", filename);
+                ret = false;
+        } else {
+                madvise((void *) contents, statbuf.st_size, MADV_SEQUENTIAL);
+
+                /* The server might be in the middle of appending a
+                 * record so a partial one at the end is ignored.
+                 */
+                add_records(data,
+                            contents + PCX_STATS_MAGIC_SIZE,
+                            (statbuf.st_size - PCX_STATS_MAGIC_SIZE) /
+                            PCX_STATS_RECORD_SIZE);
+        }
+
+        munmap((void *) contents, statbuf.st_size);
+
+done:
+        pcx_close(fd);
+
+        return ret;
+}
+
+static int
+compare_groups(const void *pa,
+               const void *pb)
+{
+        const struct group *a = pa;
+        const struct group *b = pb;
+
+        int ret = strcmp(a->game, b->game);
+
+        if (ret == 0)
+                ret = strcmp(a->language, b->language);
+        if (ret == 0)
+                ret = a->source - b->source;
+
+        return ret;
+}
+
+static void
+print_group(const struct pcx_stats_main *data,
+            const struct group *group)
+{
+        printf("%-12s", group->game);
+
+        if (data->split_language)
+                printf(" %-8s", group->language);
+
+        if (data->split_source) {
+                printf(" %-8s",
+                       group->source == -1 ?
+                       "" :
+                       source_names[group->source]);
+        }
+
+        uint64_t n_started = group->counts[PCX_STATS_EVENT_START];
+        uint64_t n_finished = group->counts[PCX_STATS_EVENT_END];
+        uint64_t n_abandoned = group->counts[PCX_STATS_EVENT_ABANDON];
+
+        printf(" %9" PRIu64 " %9" PRIu64 " %9" PRIu64,
+               n_started,
+               n_finished,
+               n_abandoned);
+
+        if (n_finished + n_abandoned > 0) {
+                printf(" %8.1f%%",
+                       n_abandoned * 100.0 / (n_finished + n_abandoned));
+        } else {
+                printf(" %9s", "-");
+        }
+
+        if (n_started > 0)
+                printf(" %8.1f", group->total_players / (double) n_started);
+        else
+                printf(" %8s", "-");
+
+        if (n_finished > 0) {
+                printf(" %8.1f",
+                       group->total_duration / 60.0 / n_finished);
+        } else {
+                printf(" %8s", "-");
+        }
+
+        fputc('\n', stdout);
+}
+
+static void
+print_results(struct pcx_stats_main *data)
+{
+        struct group *sorted = pcx_alloc(MAX(data->n_groups, 1) *
+                                         sizeof *sorted);
+        struct group total = { .source = -1 };
+        size_t n_sorted = 0;
+
+        strcpy(total.game, "total");
+
+        for (size_t i = 0; i < data->size; i++) {
+                const struct group *group = data->groups + i;
+
+                if (!group->used)
+                        continue;
+
+                sorted[n_sorted++] = *group;
+
+                for (unsigned j = 0; j < PCX_STATS_N_EVENTS; j++)
+                        total.counts[j] += group->counts[j];
+
+                total.total_players += group->total_players;
+                total.total_duration += group->total_duration;
+        }
+
+        qsort(sorted, n_sorted, sizeof *sorted, compare_groups);
+
+        printf("%-12s", "game");
+        if (data->split_language)
+                printf(" %-8s", "language");
+        if (data->split_source)
+                printf(" %-8s", "source");
+        printf(" %9s %9s %9s %9s %8s %8s\n",
+               "started",
+               "finished",
+               "abandoned",
+               "abandon",
+               "players",
+               "minutes");
+
+        for (size_t i = 0; i < n_sorted; i++)
+                print_group(data, sorted + i);
+
+        print_group(data, &total);
+
+        pcx_free(sorted);
+}
+
+int
+main(int argc, char **argv)
+{
+        struct pcx_stats_main data = {
+                .filenames = PCX_BUFFER_STATIC_INIT,
+                .since = INT64_MIN,
+        };
+        int ret = EXIT_SUCCESS;
+
+        if (!process_arguments(&data, argc, argv)) {
+                ret = EXIT_FAILURE;
+                goto done;
+        }
+
+        const char * const *filenames =
+                (const char * const *) data.filenames.data;
+        size_t n_filenames = data.filenames.length / sizeof *filenames;
+
+        for (size_t i = 0; i < n_filenames; i++) {
+                if (!read_file(&data, filenames[i])) {
+                        ret = EXIT_FAILURE;
+                        goto done;
+                }
+        }
+
+        print_results(&data);
+
+done:
+        pcx_free(data.groups);
+        pcx_buffer_destroy(&data.filenames);
+
+        return ret;
+}
@@ -0,0 +1,98 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "pcx-stats.h"
+
+#include <string.h>
+
+#include "pcx-util.h"
+
+static void
+encode_string(uint8_t *data,
+              const char *value,
+              size_t size)
+{
+        size_t length = strlen(value);
+
+        if (length > size)
+                length = size;
+
+        memcpy(data, value, length);
+        memset(data + length, 0, size - length);
+}
+
+void
+pcx_stats_encode(const struct pcx_stats_record *record,
+                 uint8_t *data)
+{
+        uint64_t time = PCX_UINT64_TO_LE(record->time);
+        uint32_t duration = PCX_UINT32_TO_LE(record->duration);
+
+        memcpy(data, &time, sizeof time);
+        memcpy(data + 8, &duration, sizeof duration);
+
+        data[12] = record->event;
+        data[13] = record->source;
+        data[14] = MIN(record->n_players, UINT8_MAX);
+        data[15] = 0;
+
+        encode_string(data + 16, record->language, PCX_STATS_LANGUAGE_SIZE);
+        encode_string(data + 16 + PCX_STATS_LANGUAGE_SIZE,
+                      record->game,
+                      PCX_STATS_GAME_SIZE);
+}
+
+static void
+decode_string(char *value,
+              const uint8_t *data,
+              size_t size)
+{
+        memcpy(value, data, size);
+        value[size] = '\0';
+}
+
+bool
+pcx_stats_decode(const uint8_t *data,
+                 struct pcx_stats_record *record)
+{
+        if (data[12] >= PCX_STATS_N_EVENTS || data[13] >= PCX_STATS_N_SOURCES)
+                return false;
+
+        uint64_t time;
+        uint32_t duration;
+
+        memcpy(&time, data, sizeof time);
+        memcpy(&duration, data + 8, sizeof duration);
+
+        record->time = PCX_UINT64_FROM_LE(time);
+        record->duration = PCX_UINT32_FROM_LE(duration);
+        record->event = data[12];
+        record->source = data[13];
+        record->n_players = data[14];
+
+        decode_string(record->language,
+                      data + 16,
+                      PCX_STATS_LANGUAGE_SIZE);
+        decode_string(record->game,
+                      data + 16 + PCX_STATS_LANGUAGE_SIZE,
+                      PCX_STATS_GAME_SIZE);
+
+        return true;
+}
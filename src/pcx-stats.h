@@ -0,0 +1,95 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PCX_STATS_H
+#define PCX_STATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* The format of the file that gets a record every time a game starts
+ * or ends. The file starts with PCX_STATS_MAGIC and then has records
+ * of PCX_STATS_RECORD_SIZE bytes with no padding between them so
+ * that it can be read by mapping it into memory. All of the numbers
+ * are little-endian. Each record is:
+ *
+ *   0  uint64   time of the event in seconds since the Unix epoch
+ *   8  uint32   seconds since the game started, zero for START
+ *  12  uint8    event type
+ *  13  uint8    where the game was played
+ *  14  uint8    number of players
+ *  15  uint8    reserved, always zero
+ *  16  char[8]  language code padded with zeroes
+ *  24  char[16] game name padded with zeroes
+ *
+ * The names are stored as strings rather than numbers so that the
+ * file stays valid when games or languages are added.
+ */
+
+#define PCX_STATS_MAGIC "PCXSTAT1"
+#define PCX_STATS_MAGIC_SIZE (sizeof PCX_STATS_MAGIC - 1)
+
+#define PCX_STATS_LANGUAGE_SIZE 8
+#define PCX_STATS_GAME_SIZE 16
+#define PCX_STATS_RECORD_SIZE (16 +                             \
+                               PCX_STATS_LANGUAGE_SIZE +        \
+                               PCX_STATS_GAME_SIZE)
+
+enum pcx_stats_event {
+        PCX_STATS_EVENT_START,
+        /* The game finished normally */
+        PCX_STATS_EVENT_END,
+        /* The game stopped before finishing, for example because
+         * the players left or it timed out.
+         */
+        PCX_STATS_EVENT_ABANDON,
+};
+
+#define PCX_STATS_N_EVENTS (PCX_STATS_EVENT_ABANDON + 1)
+
+enum pcx_stats_source {
+        PCX_STATS_SOURCE_WEB,
+        PCX_STATS_SOURCE_TELEGRAM,
+};
+
+#define PCX_STATS_N_SOURCES (PCX_STATS_SOURCE_TELEGRAM + 1)
+
+struct pcx_stats_record {
+        int64_t time;
+        uint32_t duration;
+        enum pcx_stats_event event;
+        enum pcx_stats_source source;
+        int n_players;
+        char language[PCX_STATS_LANGUAGE_SIZE + 1];
+        char game[PCX_STATS_GAME_SIZE + 1];
+};
+
+/* Names that are too long are truncated */
+void
+pcx_stats_encode(const struct pcx_stats_record *record,
+                 uint8_t *data);
+
+/* Returns false if the event type or source is unknown, in which
+ * case the record was probably written by a later version.
+ */
+bool
+pcx_stats_decode(const uint8_t *data,
+                 struct pcx_stats_record *record);
+
+#endif /* PCX_STATS_H */
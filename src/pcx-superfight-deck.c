@@ -24,6 +24,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <assert.h>
 
 #include "pcx-util.h"
 #include "pcx-buffer.h"
@@ -90,6 +91,19 @@ shuffle_deck(struct pcx_superfight_deck *deck)
         }
 }
 
+static struct pcx_superfight_deck *
+create_deck(struct load_data *data)
+{
+        struct pcx_superfight_deck *deck = pcx_alloc(sizeof *deck);
+
+        deck->slices = data->slices;
+        deck->cards = (char **) data->cards.data;
+        deck->n_cards = data->cards.length / sizeof (char *);
+        deck->card_pos = 0;
+
+        return deck;
+}
+
 static bool
 is_space_char(char ch)
 {
@@ -194,18 +208,96 @@ pcx_superfight_deck_load(const struct pcx_config *config,
                 add_card(&data, &name, 1);
         }
 
-        struct pcx_superfight_deck *deck = pcx_alloc(sizeof *deck);
-
-        deck->slices = data.slices;
-        deck->cards = (char **) data.cards.data;
-        deck->n_cards = data.cards.length / sizeof (char *);
-        deck->card_pos = 0;
+        struct pcx_superfight_deck *deck = create_deck(&data);
 
         shuffle_deck(deck);
 
         return deck;
 }
 
+void
+pcx_superfight_deck_snapshot(struct pcx_superfight_deck *deck,
+                             struct pcx_buffer *buf)
+{
+        pcx_snapshot_write_uint32(buf, deck->n_cards);
+        pcx_snapshot_write_int(buf, deck->card_pos);
+
+        for (unsigned i = 0; i < deck->n_cards; i++)
+                pcx_snapshot_write_string(buf, deck->cards[i]);
+}
+
+struct pcx_superfight_deck *
+pcx_superfight_deck_restore(struct pcx_snapshot_reader *reader)
+{
+        uint32_t n_cards = pcx_snapshot_read_uint32(reader);
+
+        /* Each card needs at least the string length */
+        if (n_cards < MIN_CARDS ||
+            n_cards > (reader->length - reader->pos) / sizeof (uint32_t)) {
+                pcx_snapshot_reader_set_error(reader);
+                return NULL;
+        }
+
+        int card_pos = pcx_snapshot_read_int_range(reader, 0, n_cards);
+
+        struct load_data data = {
+                .slices = NULL,
+                .cards = PCX_BUFFER_STATIC_INIT,
+                .slice_used = SLICE_SIZE,
+        };
+
+        for (unsigned i = 0; i < n_cards; i++) {
+                const char *name = pcx_snapshot_read_string(reader);
+                add_card(&data, name, strlen(name));
+        }
+
+        struct pcx_superfight_deck *deck = create_deck(&data);
+
+        if (reader->error) {
+                pcx_superfight_deck_free(deck);
+                return NULL;
+        }
+
+        deck->card_pos = card_pos;
+
+        return deck;
+}
+
+int
+pcx_superfight_deck_get_card_num(struct pcx_superfight_deck *deck,
+                                 const char *card)
+{
+        if (card == NULL)
+                return -1;
+
+        for (unsigned i = 0; i < deck->n_cards; i++) {
+                if (deck->cards[i] == card)
+                        return i;
+        }
+
+        assert(!"card is not in the deck");
+
+        return -1;
+}
+
+const char *
+pcx_superfight_deck_get_card(struct pcx_superfight_deck *deck,
+                             int card_num)
+{
+        assert(card_num >= -1 && card_num < deck->n_cards);
+
+        if (card_num == -1)
+                return NULL;
+
+        return deck->cards[card_num];
+}
+
+int
+pcx_superfight_deck_get_n_cards(struct pcx_superfight_deck *deck)
+{
+        return deck->n_cards;
+}
+
 const char *
 pcx_superfight_deck_draw_card(struct pcx_superfight_deck *deck)
 {
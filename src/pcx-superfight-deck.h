@@ -21,6 +21,7 @@
 
 #include "pcx-text.h"
 #include "pcx-config.h"
+#include "pcx-snapshot.h"
 
 struct pcx_superfight_deck;
 
@@ -32,6 +33,35 @@ pcx_superfight_deck_load(const struct pcx_config *config,
 const char *
 pcx_superfight_deck_draw_card(struct pcx_superfight_deck *deck);
 
+/* Saves the names of the cards in their current order so that the
+ * deck doesn’t depend on the data files when it is restored.
+ */
+void
+pcx_superfight_deck_snapshot(struct pcx_superfight_deck *deck,
+                             struct pcx_buffer *buf);
+
+/* Returns NULL and sets the error flag on the reader if the data
+ * is invalid.
+ */
+struct pcx_superfight_deck *
+pcx_superfight_deck_restore(struct pcx_snapshot_reader *reader);
+
+/* Returns the position in the deck of a card that was returned by
+ * pcx_superfight_deck_draw_card or -1 if the card is NULL. The card
+ * can be retrieved again with pcx_superfight_deck_get_card.
+ */
+int
+pcx_superfight_deck_get_card_num(struct pcx_superfight_deck *deck,
+                                 const char *card);
+
+/* Returns NULL if the number is -1 */
+const char *
+pcx_superfight_deck_get_card(struct pcx_superfight_deck *deck,
+                             int card_num);
+
+int
+pcx_superfight_deck_get_n_cards(struct pcx_superfight_deck *deck);
+
 void
 pcx_superfight_deck_free(struct pcx_superfight_deck *deck);
 
@@ -26,6 +26,7 @@
 #include <assert.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
 
 #include "pcx-util.h"
 #include "pcx-buffer.h"
@@ -71,6 +72,8 @@ struct pcx_superfight {
         void *user_data;
         struct pcx_main_context_source *game_over_source;
         struct pcx_main_context_source *vote_timeout;
+        /* Monotonic time when vote_timeout was added */
+        uint64_t vote_timeout_start;
         enum pcx_text_language language;
 
         struct pcx_superfight_fighter fighters[2];
@@ -302,18 +305,31 @@ vote_timeout_cb(struct pcx_main_context_source *source,
 }
 
 static void
-set_vote_timeout(struct pcx_superfight *superfight)
+start_vote_timeout(struct pcx_superfight *superfight,
+                   int elapsed_ms)
 {
         long ms = BASE_VOTE_TIMEOUT << superfight->vote_message_num;
 
         remove_vote_timeout(superfight);
 
+        superfight->vote_timeout_start =
+                pcx_main_context_get_monotonic_clock(NULL) -
+                elapsed_ms * UINT64_C(1000);
+
+        ms = elapsed_ms < ms ? ms - elapsed_ms : 0;
+
         superfight->vote_timeout = pcx_main_context_add_timeout(NULL,
                                                                 ms,
                                                                 vote_timeout_cb,
                                                                 superfight);
 }
 
+static void
+set_vote_timeout(struct pcx_superfight *superfight)
+{
+        start_vote_timeout(superfight, 0 /* elapsed_ms */);
+}
+
 static void
 append_card_choice(struct pcx_superfight *superfight,
                    struct pcx_buffer *buf,
@@ -906,6 +922,270 @@ free_game_cb(void *data)
         free_game(data);
 }
 
+static int
+get_choice_num(const char * const *cards,
+               const char *card)
+{
+        if (card == NULL)
+                return -1;
+
+        for (unsigned i = 0; i < N_CARD_CHOICE; i++) {
+                if (cards[i] == card)
+                        return i;
+        }
+
+        assert(!"chosen card is not one of the choices");
+
+        return -1;
+}
+
+static void
+snapshot_cards(struct pcx_buffer *buf,
+               struct pcx_superfight_deck *deck,
+               const char * const *cards,
+               size_t n_cards)
+{
+        for (unsigned i = 0; i < n_cards; i++) {
+                int card_num = pcx_superfight_deck_get_card_num(deck, cards[i]);
+                pcx_snapshot_write_int(buf, card_num);
+        }
+}
+
+static void
+snapshot_cb(void *data,
+            struct pcx_buffer *buf)
+{
+        struct pcx_superfight *superfight = data;
+
+        pcx_superfight_deck_snapshot(superfight->roles, buf);
+        pcx_superfight_deck_snapshot(superfight->attributes, buf);
+
+        pcx_snapshot_write_int(buf, superfight->current_player);
+        pcx_snapshot_write_int(buf, superfight->vote_message_num);
+
+        /* Save how long the vote timeout has been running so that
+         * the time that has already passed isn’t added again.
+         */
+        uint64_t elapsed_ms = 0;
+
+        if (superfight->vote_timeout) {
+                uint64_t now = pcx_main_context_get_monotonic_clock(NULL);
+                elapsed_ms = (now - superfight->vote_timeout_start) / 1000;
+        }
+
+        pcx_snapshot_write_int(buf, MIN(elapsed_ms, INT_MAX));
+
+        for (unsigned i = 0; i < superfight->n_players; i++) {
+                const struct pcx_superfight_player *player =
+                        superfight->players + i;
+
+                pcx_snapshot_write_int(buf, player->vote);
+                pcx_snapshot_write_int(buf, player->score);
+        }
+
+        for (unsigned i = 0; i < PCX_N_ELEMENTS(superfight->fighters); i++) {
+                const struct pcx_superfight_fighter *fighter =
+                        superfight->fighters + i;
+
+                snapshot_cards(buf,
+                               superfight->roles,
+                               fighter->roles,
+                               N_CARD_CHOICE);
+                snapshot_cards(buf,
+                               superfight->attributes,
+                               fighter->attributes,
+                               N_CARD_CHOICE);
+                snapshot_cards(buf,
+                               superfight->attributes,
+                               &fighter->forced_attribute,
+                               1);
+
+                int role_num = get_choice_num(fighter->roles,
+                                              fighter->chosen_role);
+                int attribute_num = get_choice_num(fighter->attributes,
+                                                   fighter->chosen_attribute);
+
+                pcx_snapshot_write_int(buf, role_num);
+                pcx_snapshot_write_int(buf, attribute_num);
+                pcx_snapshot_write_int(buf, fighter->player_num);
+                pcx_snapshot_write_bool(buf, fighter->complete);
+        }
+}
+
+static void
+restore_cards(struct pcx_snapshot_reader *reader,
+              struct pcx_superfight_deck *deck,
+              const char **cards,
+              size_t n_cards)
+{
+        int n_deck_cards = pcx_superfight_deck_get_n_cards(deck);
+
+        for (unsigned i = 0; i < n_cards; i++) {
+                int card_num = pcx_snapshot_read_int_range(reader,
+                                                           -1,
+                                                           n_deck_cards - 1);
+                cards[i] = pcx_superfight_deck_get_card(deck, card_num);
+        }
+}
+
+static const char *
+restore_choice(struct pcx_snapshot_reader *reader,
+               const char * const *cards)
+{
+        int choice_num = pcx_snapshot_read_int_range(reader,
+                                                     -1,
+                                                     N_CARD_CHOICE - 1);
+
+        if (choice_num == -1)
+                return NULL;
+
+        if (cards[choice_num] == NULL)
+                pcx_snapshot_reader_set_error(reader);
+
+        return cards[choice_num];
+}
+
+static bool
+restore_fighter(struct pcx_superfight *superfight,
+                struct pcx_snapshot_reader *reader,
+                struct pcx_superfight_fighter *fighter)
+{
+        restore_cards(reader,
+                      superfight->roles,
+                      fighter->roles,
+                      N_CARD_CHOICE);
+        restore_cards(reader,
+                      superfight->attributes,
+                      fighter->attributes,
+                      N_CARD_CHOICE);
+        restore_cards(reader,
+                      superfight->attributes,
+                      &fighter->forced_attribute,
+                      1);
+
+        if (reader->error)
+                return false;
+
+        fighter->chosen_role = restore_choice(reader, fighter->roles);
+        fighter->chosen_attribute = restore_choice(reader,
+                                                   fighter->attributes);
+        fighter->player_num =
+                pcx_snapshot_read_int_range(reader,
+                                            0,
+                                            superfight->n_players - 1);
+        fighter->complete = pcx_snapshot_read_bool(reader);
+
+        if (reader->error)
+                return false;
+
+        if (fighter->chosen_attribute && fighter->chosen_role == NULL)
+                return false;
+
+        if (fighter->complete &&
+            (fighter->chosen_attribute == NULL ||
+             fighter->forced_attribute == NULL))
+                return false;
+
+        return true;
+}
+
+static void *
+restore_cb(const struct pcx_config *config,
+           const struct pcx_game_callbacks *callbacks,
+           void *user_data,
+           enum pcx_text_language language,
+           int n_players,
+           const char * const *names,
+           struct pcx_snapshot_reader *reader)
+{
+        if (n_players < PCX_SUPERFIGHT_MIN_PLAYERS ||
+            n_players > PCX_SUPERFIGHT_MAX_PLAYERS)
+                return NULL;
+
+        struct pcx_superfight_deck *roles =
+                pcx_superfight_deck_restore(reader);
+
+        if (roles == NULL)
+                return NULL;
+
+        struct pcx_superfight_deck *attributes =
+                pcx_superfight_deck_restore(reader);
+
+        if (attributes == NULL) {
+                pcx_superfight_deck_free(roles);
+                return NULL;
+        }
+
+        struct pcx_superfight *superfight = pcx_calloc(sizeof *superfight);
+
+        superfight->language = language;
+        superfight->callbacks = *callbacks;
+        superfight->user_data = user_data;
+        superfight->roles = roles;
+        superfight->attributes = attributes;
+
+        superfight->n_players = n_players;
+        superfight->players = pcx_calloc(n_players *
+                                         sizeof (struct pcx_superfight_player));
+
+        for (unsigned i = 0; i < n_players; i++)
+                superfight->players[i].name = pcx_strdup(names[i]);
+
+        superfight->current_player =
+                pcx_snapshot_read_int_range(reader, 0, n_players - 1);
+        /* The timeout is doubled each time so this can’t get very
+         * big before it would overflow.
+         */
+        superfight->vote_message_num =
+                pcx_snapshot_read_int_range(reader, 0, 32);
+        int elapsed_ms = pcx_snapshot_read_int_range(reader, 0, INT_MAX);
+
+        bool game_over = false;
+        int max_vote = PCX_N_ELEMENTS(superfight->fighters) - 1;
+
+        for (unsigned i = 0; i < n_players; i++) {
+                struct pcx_superfight_player *player = superfight->players + i;
+
+                player->vote = pcx_snapshot_read_int_range(reader,
+                                                           -1,
+                                                           max_vote);
+                player->score = pcx_snapshot_read_int_range(reader,
+                                                            0,
+                                                            POINTS_TO_WIN);
+
+                if (player->score >= POINTS_TO_WIN)
+                        game_over = true;
+        }
+
+        for (unsigned i = 0; i < PCX_N_ELEMENTS(superfight->fighters); i++) {
+                if (!restore_fighter(superfight,
+                                     reader,
+                                     superfight->fighters + i))
+                        pcx_snapshot_reader_set_error(reader);
+        }
+
+        if (superfight->fighters[0].player_num ==
+            superfight->fighters[1].player_num)
+                pcx_snapshot_reader_set_error(reader);
+
+        if (reader->error) {
+                free_game(superfight);
+                return NULL;
+        }
+
+        if (game_over) {
+                superfight->game_over_source =
+                        pcx_main_context_add_timeout(NULL,
+                                                     0, /* ms */
+                                                     game_over_cb,
+                                                     superfight);
+        } else if (all_roles_chosen(superfight)) {
+                start_vote_timeout(superfight, elapsed_ms);
+        }
+
+        return superfight;
+}
+
 const struct pcx_game
 pcx_superfight_game = {
         .name = "superfight",
@@ -919,5 +1199,7 @@ pcx_superfight_game = {
         .create_game_cb = create_game_cb,
         .get_help_cb = get_help_cb,
         .handle_callback_data_cb = handle_callback_data_cb,
-        .free_game_cb = free_game_cb
+        .free_game_cb = free_game_cb,
+        .snapshot_cb = snapshot_cb,
+        .restore_cb = restore_cb,
 };
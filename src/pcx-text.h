@@ -32,6 +32,8 @@ enum pcx_text_language {
         PCX_TEXT_LANGUAGE_CHINESE_TRADITIONAL,
 };
 
+#define PCX_TEXT_N_LANGUAGES (PCX_TEXT_LANGUAGE_CHINESE_TRADITIONAL + 1)
+
 enum pcx_text_string {
         PCX_TEXT_STRING_LANGUAGE_CODE,
         PCX_TEXT_STRING_NAME_COUP,
@@ -100,6 +100,79 @@ pcx_trie_add_word(struct pcx_trie *trie,
         }
 }
 
+struct foreach_stack_entry {
+        const struct pcx_trie_node *node;
+        /* Length of the word before this node’s letter is added */
+        size_t word_length;
+};
+
+static void
+push_foreach_node(struct pcx_buffer *stack,
+                  const struct pcx_trie_node *node,
+                  size_t word_length)
+{
+        struct foreach_stack_entry entry = {
+                .node = node,
+                .word_length = word_length,
+        };
+
+        pcx_buffer_append(stack, &entry, sizeof entry);
+}
+
+void
+pcx_trie_foreach_word(struct pcx_trie *trie,
+                      pcx_trie_word_cb cb,
+                      void *user_data)
+{
+        struct pcx_buffer stack = PCX_BUFFER_STATIC_INIT;
+        struct pcx_buffer word = PCX_BUFFER_STATIC_INIT;
+
+        if (trie->root)
+                push_foreach_node(&stack, trie->root, 0);
+
+        /* The children are visited before the siblings so that the
+         * words are reported in the order that the branches were
+         * first added.
+         */
+        while (stack.length > 0) {
+                stack.length -= sizeof (struct foreach_stack_entry);
+
+                const struct foreach_stack_entry *entry =
+                        (const struct foreach_stack_entry *)
+                        (stack.data + stack.length);
+                const struct pcx_trie_node *node = entry->node;
+
+                word.length = entry->word_length;
+
+                if (node->next_sibling) {
+                        push_foreach_node(&stack,
+                                          node->next_sibling,
+                                          word.length);
+                }
+
+                if (node->ch == '\0') {
+                        pcx_buffer_append_c(&word, '\0');
+                        cb((const char *) word.data, user_data);
+                        continue;
+                }
+
+                pcx_buffer_ensure_size(&word,
+                                       word.length + PCX_UTF8_MAX_CHAR_LENGTH);
+                word.length += pcx_utf8_encode(node->ch,
+                                               (char *) word.data +
+                                               word.length);
+
+                if (node->first_child) {
+                        push_foreach_node(&stack,
+                                          node->first_child,
+                                          word.length);
+                }
+        }
+
+        pcx_buffer_destroy(&word);
+        pcx_buffer_destroy(&stack);
+}
+
 void
 pcx_trie_free(struct pcx_trie *trie)
 {
@@ -35,6 +35,18 @@ enum pcx_trie_add_result
 pcx_trie_add_word(struct pcx_trie *trie,
                   const char *word);
 
+typedef void
+(* pcx_trie_word_cb)(const char *word,
+                     void *user_data);
+
+/* Calls the callback for each word in the trie. Adding the words to
+ * a new trie in the same order will recreate the same trie.
+ */
+void
+pcx_trie_foreach_word(struct pcx_trie *trie,
+                      pcx_trie_word_cb cb,
+                      void *user_data);
+
 void
 pcx_trie_free(struct pcx_trie *trie);
 
@@ -0,0 +1,441 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "pcx-upgrade.h"
+
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "pcx-util.h"
+#include "pcx-file-error.h"
+
+/* The fd that the upgrade socket is moved to in the new process */
+#define UPGRADE_FD 3
+
+#define UPGRADE_MAGIC UINT32_C(0x50435855)
+
+#define UPGRADE_ACK 'A'
+
+/* Time in seconds to wait for the new process at each step */
+#define UPGRADE_TIMEOUT 30
+
+struct pcx_error_domain
+pcx_upgrade_error;
+
+/* Sent in the same message as the fds */
+struct upgrade_header {
+        uint32_t magic;
+        uint32_t n_fds;
+        uint64_t length;
+};
+
+static void
+close_other_fds(void)
+{
+        long max_fd = sysconf(_SC_OPEN_MAX);
+
+        if (max_fd < 0)
+                max_fd = 1024;
+
+        for (int fd = UPGRADE_FD + 1; fd < max_fd; fd++)
+                close(fd);
+}
+
+int
+pcx_upgrade_start(const char *program,
+                  char * const *argv,
+                  const char *working_dir,
+                  pid_t *pid_out,
+                  struct pcx_error **error)
+{
+        int sv[2];
+
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == -1) {
+                pcx_file_error_set(error,
+                                   errno,
+                                   "Error creating upgrade socket: %s",
+                                   strerror(errno));
+                return -1;
+        }
+
+        pid_t pid = fork();
+
+        if (pid == -1) {
+                pcx_file_error_set(error,
+                                   errno,
+                                   "fork failed: %s",
+                                   strerror(errno));
+                pcx_close(sv[0]);
+                pcx_close(sv[1]);
+                return -1;
+        }
+
+        if (pid == 0) {
+                /* dup2 clears the close-on-exec flag */
+                if (dup2(sv[1], UPGRADE_FD) == -1)
+                        _exit(EXIT_FAILURE);
+
+                close_other_fds();
+
+                /* The program and config paths might be relative to
+                 * the directory that the old process was started
+                 * from.
+                 */
+                if (working_dir && chdir(working_dir) == -1)
+                        _exit(EXIT_FAILURE);
+
+                setenv(PCX_UPGRADE_FD_VARIABLE, "3", 1 /* overwrite */);
+
+                execvp(program, argv);
+
+                _exit(EXIT_FAILURE);
+        }
+
+        pcx_close(sv[1]);
+
+        /* Don’t block forever if the new process gets stuck */
+        struct timeval timeout = { .tv_sec = UPGRADE_TIMEOUT };
+
+        setsockopt(sv[0], SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof timeout);
+
+        *pid_out = pid;
+
+        return sv[0];
+}
+
+static bool
+send_all(int sock,
+         const uint8_t *data,
+         size_t length,
+         struct pcx_error **error)
+{
+        while (length > 0) {
+                ssize_t wrote = send(sock, data, length, MSG_NOSIGNAL);
+
+                if (wrote == -1) {
+                        if (errno == EINTR)
+                                continue;
+
+                        pcx_file_error_set(error,
+                                           errno,
+                                           "Error sending upgrade state: %s",
+                                           strerror(errno));
+                        return false;
+                }
+
+                data += wrote;
+                length -= wrote;
+        }
+
+        return true;
+}
+
+bool
+pcx_upgrade_send(int sock,
+                 const struct pcx_buffer *data,
+                 const int *fds,
+                 int n_fds,
+                 struct pcx_error **error)
+{
+        if (n_fds < 1 || n_fds > PCX_UPGRADE_MAX_FDS) {
+                pcx_set_error(error,
+                              &pcx_upgrade_error,
+                              PCX_UPGRADE_ERROR_PROTOCOL,
+                              "Invalid number of fds to hand over");
+                return false;
+        }
+
+        struct upgrade_header header = {
+                .magic = PCX_UINT32_TO_LE(UPGRADE_MAGIC),
+                .n_fds = PCX_UINT32_TO_LE(n_fds),
+                .length = PCX_UINT64_TO_LE(data->length),
+        };
+        struct iovec iov = {
+                .iov_base = &header,
+                .iov_len = sizeof header,
+        };
+        union {
+                struct cmsghdr align;
+                uint8_t buf[CMSG_SPACE(sizeof (int) * PCX_UPGRADE_MAX_FDS)];
+        } control;
+        struct msghdr msg = {
+                .msg_iov = &iov,
+                .msg_iovlen = 1,
+                .msg_control = control.buf,
+                .msg_controllen = CMSG_SPACE(sizeof (int) * n_fds),
+        };
+
+        memset(&control, 0, sizeof control);
+
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof (int) * n_fds);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof (int) * n_fds);
+
+        ssize_t wrote;
+
+        do
+                wrote = sendmsg(sock, &msg, MSG_NOSIGNAL);
+        while (wrote == -1 && errno == EINTR);
+
+        if (wrote == -1) {
+                pcx_file_error_set(error,
+                                   errno,
+                                   "Error sending upgrade fds: %s",
+                                   strerror(errno));
+                return false;
+        }
+
+        /* The fds are attached to the first byte so the rest of
+         * the header can follow normally if it was split.
+         */
+        return (send_all(sock,
+                         (const uint8_t *) &header + wrote,
+                         sizeof header - wrote,
+                         error) &&
+                send_all(sock, data->data, data->length, error));
+}
+
+bool
+pcx_upgrade_wait_for_ack(int sock,
+                         struct pcx_error **error)
+{
+        struct pollfd pfd = { .fd = sock, .events = POLLIN };
+        int ret;
+
+        do
+                ret = poll(&pfd, 1, UPGRADE_TIMEOUT * 1000);
+        while (ret == -1 && errno == EINTR);
+
+        if (ret == -1) {
+                pcx_file_error_set(error,
+                                   errno,
+                                   "Error waiting for the new process: %s",
+                                   strerror(errno));
+                return false;
+        }
+
+        if (ret == 0) {
+                pcx_set_error(error,
+                              &pcx_upgrade_error,
+                              PCX_UPGRADE_ERROR_TIMEOUT,
+                              "Timed out waiting for the new process");
+                return false;
+        }
+
+        uint8_t ack;
+        ssize_t got;
+
+        do
+                got = read(sock, &ack, 1);
+        while (got == -1 && errno == EINTR);
+
+        if (got != 1 || ack != UPGRADE_ACK) {
+                pcx_set_error(error,
+                              &pcx_upgrade_error,
+                              PCX_UPGRADE_ERROR_PROTOCOL,
+                              "The new process failed to start");
+                return false;
+        }
+
+        return true;
+}
+
+int
+pcx_upgrade_get_socket(void)
+{
+        const char *value = getenv(PCX_UPGRADE_FD_VARIABLE);
+
+        if (value == NULL)
+                return -1;
+
+        char *tail;
+
+        errno = 0;
+        long fd = strtol(value, &tail, 10);
+
+        /* Don’t pass it on to anything else that we start */
+        unsetenv(PCX_UPGRADE_FD_VARIABLE);
+
+        if (errno || *tail || tail == value || fd < 0 || fd > INT32_MAX)
+                return -1;
+
+        return fd;
+}
+
+static bool
+read_all(int sock,
+         uint8_t *data,
+         size_t length,
+         struct pcx_error **error)
+{
+        while (length > 0) {
+                ssize_t got = read(sock, data, length);
+
+                if (got == -1) {
+                        if (errno == EINTR)
+                                continue;
+
+                        pcx_file_error_set(error,
+                                           errno,
+                                           "Error reading upgrade state: %s",
+                                           strerror(errno));
+                        return false;
+                }
+
+                if (got == 0) {
+                        pcx_set_error(error,
+                                      &pcx_upgrade_error,
+                                      PCX_UPGRADE_ERROR_PROTOCOL,
+                                      "The old process closed the upgrade "
+                                      "socket");
+                        return false;
+                }
+
+                data += got;
+                length -= got;
+        }
+
+        return true;
+}
+
+static void
+take_fds(struct msghdr *msg,
+         struct pcx_buffer *fds)
+{
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg);
+             cmsg;
+             cmsg = CMSG_NXTHDR(msg, cmsg)) {
+                if (cmsg->cmsg_level != SOL_SOCKET ||
+                    cmsg->cmsg_type != SCM_RIGHTS)
+                        continue;
+
+                size_t data_length = cmsg->cmsg_len - CMSG_LEN(0);
+
+                pcx_buffer_append(fds, CMSG_DATA(cmsg), data_length);
+        }
+}
+
+static void
+close_fds(struct pcx_buffer *fds)
+{
+        const int *fd_array = (const int *) fds->data;
+        size_t n_fds = fds->length / sizeof (int);
+
+        for (unsigned i = 0; i < n_fds; i++)
+                pcx_close(fd_array[i]);
+
+        fds->length = 0;
+}
+
+bool
+pcx_upgrade_receive(int sock,
+                    struct pcx_buffer *data,
+                    struct pcx_buffer *fds,
+                    struct pcx_error **error)
+{
+        struct upgrade_header header;
+        struct iovec iov = {
+                .iov_base = &header,
+                .iov_len = sizeof header,
+        };
+        union {
+                struct cmsghdr align;
+                uint8_t buf[CMSG_SPACE(sizeof (int) * PCX_UPGRADE_MAX_FDS)];
+        } control;
+        struct msghdr msg = {
+                .msg_iov = &iov,
+                .msg_iovlen = 1,
+                .msg_control = control.buf,
+                .msg_controllen = sizeof control.buf,
+        };
+        ssize_t got;
+
+        do
+                got = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+        while (got == -1 && errno == EINTR);
+
+        if (got == -1) {
+                pcx_file_error_set(error,
+                                   errno,
+                                   "Error receiving upgrade fds: %s",
+                                   strerror(errno));
+                return false;
+        }
+
+        take_fds(&msg, fds);
+
+        if (got == 0 ||
+            (msg.msg_flags & MSG_CTRUNC) ||
+            !read_all(sock,
+                      (uint8_t *) &header + got,
+                      sizeof header - got,
+                      error))
+                goto error;
+
+        size_t n_fds = fds->length / sizeof (int);
+
+        if (PCX_UINT32_FROM_LE(header.magic) != UPGRADE_MAGIC ||
+            PCX_UINT32_FROM_LE(header.n_fds) != n_fds) {
+                pcx_set_error(error,
+                              &pcx_upgrade_error,
+                              PCX_UPGRADE_ERROR_PROTOCOL,
+                              "Invalid upgrade header");
+                goto error;
+        }
+
+        uint64_t length = PCX_UINT64_FROM_LE(header.length);
+
+        pcx_buffer_set_length(data, length);
+
+        if (!read_all(sock, data->data, length, error))
+                goto error;
+
+        return true;
+
+error:
+        if (error && *error == NULL) {
+                pcx_set_error(error,
+                              &pcx_upgrade_error,
+                              PCX_UPGRADE_ERROR_PROTOCOL,
+                              "Invalid upgrade message");
+        }
+
+        close_fds(fds);
+
+        return false;
+}
+
+bool
+pcx_upgrade_send_ack(int sock,
+                     struct pcx_error **error)
+{
+        static const uint8_t ack = UPGRADE_ACK;
+
+        return send_all(sock, &ack, sizeof ack, error);
+}
@@ -0,0 +1,94 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PCX_UPGRADE_H
+#define PCX_UPGRADE_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "pcx-error.h"
+#include "pcx-buffer.h"
+
+/* Live upgrades. The running process starts a new copy of the program
+ * with one end of a Unix socket. It then sends a blob of state and a
+ * set of file descriptors over the socket and waits for the new
+ * process to say that it has taken over before quitting.
+ */
+
+/* Environment variable that tells the new process which fd is the
+ * upgrade socket.
+ */
+#define PCX_UPGRADE_FD_VARIABLE "PUCXOBOT_UPGRADE_FD"
+
+/* Maximum number of fds that can be handed over */
+#define PCX_UPGRADE_MAX_FDS 64
+
+extern struct pcx_error_domain
+pcx_upgrade_error;
+
+enum pcx_upgrade_error {
+        PCX_UPGRADE_ERROR_PROTOCOL,
+        PCX_UPGRADE_ERROR_TIMEOUT,
+};
+
+/* Forks and runs the program with the given arguments from the
+ * working directory, which can be NULL to leave it as it is. All of
+ * the fds except the standard streams are closed in the new process
+ * so that it only gets what is sent explicitly. Returns the socket to
+ * send the state on or -1 on error.
+ */
+int
+pcx_upgrade_start(const char *program,
+                  char * const *argv,
+                  const char *working_dir,
+                  pid_t *pid_out,
+                  struct pcx_error **error);
+
+bool
+pcx_upgrade_send(int sock,
+                 const struct pcx_buffer *data,
+                 const int *fds,
+                 int n_fds,
+                 struct pcx_error **error);
+
+bool
+pcx_upgrade_wait_for_ack(int sock,
+                         struct pcx_error **error);
+
+/* Returns the upgrade socket if the process was started by
+ * pcx_upgrade_start or -1 otherwise.
+ */
+int
+pcx_upgrade_get_socket(void);
+
+/* Receives the state into data and appends the fds to the fds buffer
+ * as an array of ints. The new process owns the fds.
+ */
+bool
+pcx_upgrade_receive(int sock,
+                    struct pcx_buffer *data,
+                    struct pcx_buffer *fds,
+                    struct pcx_error **error);
+
+/* Tells the old process that it can quit */
+bool
+pcx_upgrade_send_ack(int sock,
+                     struct pcx_error **error);
+
+#endif /* PCX_UPGRADE_H */
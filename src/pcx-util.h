@@ -21,6 +21,7 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifdef __GNUC__
 #define PCX_NO_RETURN __attribute__((noreturn))
@@ -142,6 +143,22 @@ pcx_ascii_isdigit(char ch)
         return ch >= '0' && ch <= '9';
 }
 
+/* Mixes the bits of a 64-bit integer so that it can be used as a
+ * hash table key even if the values aren’t evenly distributed. This
+ * is the finalizer from MurmurHash3.
+ */
+static inline uint64_t
+pcx_hash_uint64(uint64_t value)
+{
+        value ^= value >> 33;
+        value *= UINT64_C(0xff51afd7ed558ccd);
+        value ^= value >> 33;
+        value *= UINT64_C(0xc4ceb9fe1a85ec53);
+        value ^= value >> 33;
+
+        return value;
+}
+
 /* Returns true if the given strings are the same, ignoring case. The
  * case is compared ignoring the locale and operates on ASCII only.
  */
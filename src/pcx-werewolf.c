@@ -26,6 +26,7 @@
 #include <assert.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
 
 #include "pcx-util.h"
 #include "pcx-buffer.h"
@@ -45,6 +46,14 @@
 #define PCX_WEREWOLF_N_SEE_CENTER_CHOICES \
         (PCX_WEREWOLF_N_EXTRA_CARDS * (PCX_WEREWOLF_N_EXTRA_CARDS - 1) / 2)
 
+#define PCX_WEREWOLF_DISCUSSION_TIME (60 * 1000)
+#define PCX_WEREWOLF_VOTE_REMINDER_TIME (3 * 60 * 1000)
+
+enum pcx_werewolf_timeout_type {
+        PCX_WEREWOLF_TIMEOUT_NEXT_PHASE,
+        PCX_WEREWOLF_TIMEOUT_START_VOTING,
+};
+
 struct pcx_werewolf_player {
         char *name;
 
@@ -72,6 +81,13 @@ struct pcx_werewolf {
         int deck_mode;
 
         struct pcx_main_context_source *timeout_source;
+        enum pcx_werewolf_timeout_type timeout_type;
+        /* Length of the current timeout in milliseconds and the
+         * monotonic time when it was started so that it can be saved
+         * in a snapshot.
+         */
+        int timeout_duration;
+        uint64_t timeout_start;
         int current_phase;
 
         enum pcx_werewolf_role extra_cards[PCX_WEREWOLF_N_EXTRA_CARDS];
@@ -268,6 +284,10 @@ static void
 next_phase_cb(struct pcx_main_context_source *source,
               void *user_data);
 
+static void
+start_voting_cb(struct pcx_main_context_source *source,
+                void *user_data);
+
 static void
 append_role(struct pcx_werewolf *werewolf,
             enum pcx_werewolf_role role);
@@ -281,18 +301,43 @@ append_text_string(struct pcx_werewolf *werewolf,
 }
 
 static void
-queue_next_phase(struct pcx_werewolf *werewolf,
-                 int n_seconds)
+start_timeout(struct pcx_werewolf *werewolf,
+              enum pcx_werewolf_timeout_type type,
+              int duration_ms,
+              int elapsed_ms)
 {
         assert(werewolf->timeout_source == NULL);
 
+        werewolf->timeout_type = type;
+        werewolf->timeout_duration = duration_ms;
+        werewolf->timeout_start =
+                pcx_main_context_get_monotonic_clock(NULL) -
+                elapsed_ms * UINT64_C(1000);
+
+        int remaining = (elapsed_ms < duration_ms ?
+                         duration_ms - elapsed_ms :
+                         0);
+
         werewolf->timeout_source =
                 pcx_main_context_add_timeout(NULL,
-                                             n_seconds * 1000,
-                                             next_phase_cb,
+                                             remaining,
+                                             type ==
+                                             PCX_WEREWOLF_TIMEOUT_NEXT_PHASE ?
+                                             next_phase_cb :
+                                             start_voting_cb,
                                              werewolf);
 }
 
+static void
+queue_next_phase(struct pcx_werewolf *werewolf,
+                 int n_seconds)
+{
+        start_timeout(werewolf,
+                      PCX_WEREWOLF_TIMEOUT_NEXT_PHASE,
+                      n_seconds * 1000,
+                      0 /* elapsed_ms */);
+}
+
 static int
 find_player_for_wakeup_role(struct pcx_werewolf *werewolf,
                             enum pcx_werewolf_role role)
@@ -908,11 +953,10 @@ start_voting_cb(struct pcx_main_context_source *source,
 
         pcx_free(buttons);
 
-        werewolf->timeout_source =
-                pcx_main_context_add_timeout(NULL,
-                                             3 * 60 * 1000,
-                                             start_voting_cb,
-                                             werewolf);
+        start_timeout(werewolf,
+                      PCX_WEREWOLF_TIMEOUT_START_VOTING,
+                      PCX_WEREWOLF_VOTE_REMINDER_TIME,
+                      0 /* elapsed_ms */);
 }
 
 static void
@@ -1106,11 +1150,10 @@ start_next_phase(struct pcx_werewolf *werewolf)
                                     PCX_TEXT_STRING_EVERYONE_WAKES_UP);
         werewolf->callbacks.send_message(&message, werewolf->user_data);
 
-        werewolf->timeout_source =
-                pcx_main_context_add_timeout(NULL,
-                                             60 * 1000,
-                                             start_voting_cb,
-                                             werewolf);
+        start_timeout(werewolf,
+                      PCX_WEREWOLF_TIMEOUT_START_VOTING,
+                      PCX_WEREWOLF_DISCUSSION_TIME,
+                      0 /* elapsed_ms */);
 }
 
 static void
@@ -2144,6 +2187,229 @@ free_game_cb(void *user_data)
         pcx_free(werewolf);
 }
 
+static void
+snapshot_cb(void *data,
+            struct pcx_buffer *buf)
+{
+        struct pcx_werewolf *werewolf = data;
+
+        pcx_snapshot_write_int(buf, werewolf->deck_mode);
+        pcx_snapshot_write_int(buf, werewolf->current_phase);
+
+        for (int i = 0; i < werewolf->n_players; i++) {
+                const struct pcx_werewolf_player *player =
+                        werewolf->players + i;
+
+                pcx_snapshot_write_uint8(buf, player->card);
+                pcx_snapshot_write_uint8(buf, player->wakeup_role);
+                pcx_snapshot_write_int(buf, player->vote);
+        }
+
+        for (int i = 0; i < PCX_WEREWOLF_N_EXTRA_CARDS; i++)
+                pcx_snapshot_write_uint8(buf, werewolf->extra_cards[i]);
+
+        pcx_snapshot_write_uint32(buf, werewolf->available_roles);
+        pcx_snapshot_write_int(buf, werewolf->first_choice);
+        pcx_snapshot_write_uint32(buf, werewolf->voted_mask);
+
+        pcx_snapshot_write_bool(buf, werewolf->timeout_source != NULL);
+
+        if (werewolf->timeout_source) {
+                uint64_t now = pcx_main_context_get_monotonic_clock(NULL);
+                uint64_t elapsed_ms = (now - werewolf->timeout_start) / 1000;
+
+                pcx_snapshot_write_uint8(buf, werewolf->timeout_type);
+                pcx_snapshot_write_int(buf, werewolf->timeout_duration);
+                pcx_snapshot_write_int(buf, MIN(elapsed_ms, INT_MAX));
+        }
+
+        pcx_snapshot_write_bool(buf, werewolf->game_over_source != NULL);
+}
+
+static enum pcx_werewolf_role
+restore_role(struct pcx_snapshot_reader *reader)
+{
+        uint8_t role = pcx_snapshot_read_uint8(reader);
+
+        if (role >= PCX_N_ELEMENTS(roles)) {
+                pcx_snapshot_reader_set_error(reader);
+                return PCX_WEREWOLF_ROLE_VILLAGER;
+        }
+
+        return role;
+}
+
+static bool
+phase_waits_for_player(struct pcx_werewolf *werewolf)
+{
+        /* Returns whether the phase callback for the current phase
+         * would have sent a question to a player instead of queuing
+         * the next phase.
+         */
+        switch ((enum pcx_werewolf_role) werewolf->current_phase) {
+        case PCX_WEREWOLF_ROLE_WEREWOLF:
+                return count_wakeup_wolves(werewolf) == 1;
+        case PCX_WEREWOLF_ROLE_SEER:
+        case PCX_WEREWOLF_ROLE_ROBBER:
+        case PCX_WEREWOLF_ROLE_TROUBLEMAKER:
+        case PCX_WEREWOLF_ROLE_DRUNK:
+                return find_player_for_wakeup_role(werewolf,
+                                                   werewolf->current_phase) !=
+                        -1;
+        default:
+                return false;
+        }
+}
+
+static bool
+is_timeout_valid(struct pcx_werewolf *werewolf,
+                 bool has_timeout)
+{
+        /* The game asserts that there is no timeout when it queues
+         * the next phase so make sure that the restored timeout is
+         * the one the current phase would have.
+         */
+        if (werewolf->current_phase == PCX_WEREWOLF_PICK_MODE_PHASE)
+                return !has_timeout;
+
+        if (!has_timeout)
+                return (werewolf->current_phase >= 0 &&
+                        werewolf->current_phase < PCX_N_ELEMENTS(roles) &&
+                        phase_waits_for_player(werewolf));
+
+        if (werewolf->current_phase == PCX_N_ELEMENTS(roles)) {
+                return (werewolf->timeout_type ==
+                        PCX_WEREWOLF_TIMEOUT_START_VOTING);
+        }
+
+        if (werewolf->timeout_type != PCX_WEREWOLF_TIMEOUT_NEXT_PHASE)
+                return false;
+
+        return (werewolf->current_phase == PCX_WEREWOLF_PICK_WAITING_PHASE ||
+                !phase_waits_for_player(werewolf));
+}
+
+static bool
+is_restored_state_valid(struct pcx_werewolf *werewolf,
+                        bool has_timeout,
+                        bool game_over)
+{
+        uint32_t all_roles = (UINT32_C(1) << PCX_N_ELEMENTS(roles)) - 1;
+
+        if ((werewolf->available_roles & ~all_roles))
+                return false;
+
+        uint32_t all_players = (UINT32_C(1) << werewolf->n_players) - 1;
+
+        if ((werewolf->voted_mask & ~all_players))
+                return false;
+
+        if (werewolf->current_phase >= 0 &&
+            werewolf->current_phase < PCX_N_ELEMENTS(roles) &&
+            roles[werewolf->current_phase].phase_cb == NULL)
+                return false;
+
+        if (game_over &&
+            (werewolf->current_phase != PCX_N_ELEMENTS(roles) ||
+             werewolf->voted_mask != all_players))
+                return false;
+
+        return is_timeout_valid(werewolf, has_timeout);
+}
+
+static void *
+restore_cb(const struct pcx_config *config,
+           const struct pcx_game_callbacks *callbacks,
+           void *user_data,
+           enum pcx_text_language language,
+           int n_players,
+           const char * const *names,
+           struct pcx_snapshot_reader *reader)
+{
+        if (n_players < PCX_WEREWOLF_MIN_PLAYERS ||
+            n_players > PCX_WEREWOLF_MAX_PLAYERS)
+                return NULL;
+
+        struct pcx_werewolf *werewolf = pcx_calloc(sizeof *werewolf);
+
+        werewolf->language = language;
+        werewolf->callbacks = *callbacks;
+        werewolf->user_data = user_data;
+        pcx_buffer_init(&werewolf->buffer);
+
+        werewolf->n_players = n_players;
+
+        for (unsigned i = 0; i < n_players; i++)
+                werewolf->players[i].name = pcx_strdup(names[i]);
+
+        werewolf->deck_mode =
+                pcx_snapshot_read_int_range(reader,
+                                            0,
+                                            PCX_N_ELEMENTS(deck_modes));
+        werewolf->current_phase =
+                pcx_snapshot_read_int_range(reader,
+                                            PCX_WEREWOLF_PICK_MODE_PHASE,
+                                            PCX_N_ELEMENTS(roles));
+
+        for (int i = 0; i < n_players; i++) {
+                struct pcx_werewolf_player *player = werewolf->players + i;
+
+                player->card = restore_role(reader);
+                player->wakeup_role = restore_role(reader);
+                player->vote =
+                        pcx_snapshot_read_int_range(reader, 0, n_players - 1);
+        }
+
+        for (int i = 0; i < PCX_WEREWOLF_N_EXTRA_CARDS; i++)
+                werewolf->extra_cards[i] = restore_role(reader);
+
+        werewolf->available_roles = pcx_snapshot_read_uint32(reader);
+        werewolf->first_choice =
+                pcx_snapshot_read_int_range(reader, -1, n_players - 1);
+        werewolf->voted_mask = pcx_snapshot_read_uint32(reader);
+
+        bool has_timeout = pcx_snapshot_read_bool(reader);
+        int timeout_duration = 0, elapsed_ms = 0;
+
+        if (has_timeout) {
+                uint8_t type = pcx_snapshot_read_uint8(reader);
+
+                if (type > PCX_WEREWOLF_TIMEOUT_START_VOTING)
+                        pcx_snapshot_reader_set_error(reader);
+                else
+                        werewolf->timeout_type = type;
+
+                timeout_duration =
+                        pcx_snapshot_read_int_range(reader, 0, INT_MAX);
+                elapsed_ms = pcx_snapshot_read_int_range(reader, 0, INT_MAX);
+        }
+
+        bool game_over = pcx_snapshot_read_bool(reader);
+
+        if (reader->error ||
+            !is_restored_state_valid(werewolf, has_timeout, game_over)) {
+                free_game_cb(werewolf);
+                return NULL;
+        }
+
+        if (has_timeout) {
+                start_timeout(werewolf,
+                              werewolf->timeout_type,
+                              timeout_duration,
+                              elapsed_ms);
+        }
+
+        if (game_over) {
+                werewolf->game_over_source =
+                        pcx_main_context_add_timeout(NULL,
+                                                     0, /* ms */
+                                                     game_over_cb,
+                                                     werewolf);
+        }
+
+        return werewolf;
+}
+
 const struct pcx_game
 pcx_werewolf_game = {
         .name = "werewolf",
@@ -2157,5 +2423,7 @@ pcx_werewolf_game = {
         .create_game_cb = create_game_cb,
         .get_help_cb = get_help_cb,
         .handle_callback_data_cb = handle_callback_data_cb,
-        .free_game_cb = free_game_cb
+        .free_game_cb = free_game_cb,
+        .snapshot_cb = snapshot_cb,
+        .restore_cb = restore_cb,
 };
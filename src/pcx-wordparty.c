@@ -26,6 +26,8 @@
 #include <assert.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
+#include <inttypes.h>
 
 #include "pcx-util.h"
 #include "pcx-main-context.h"
@@ -55,6 +57,18 @@
 #define PCX_WORDPARTY_MIN_WORD_TIMEOUT (5 * 1000)
 #define PCX_WORDPARTY_MAX_WORD_TIMEOUT (60 * 1000)
 
+/* The data numbers of the sideband data. The per-player state is
+ * sent as arrays with an element for each player.
+ */
+enum pcx_wordparty_sideband {
+        PCX_WORDPARTY_SIDEBAND_CURRENT_PLAYER,
+        PCX_WORDPARTY_SIDEBAND_SYLLABLE,
+        PCX_WORDPARTY_SIDEBAND_LAST_RESULT,
+        PCX_WORDPARTY_SIDEBAND_LIVES,
+        PCX_WORDPARTY_SIDEBAND_TYPED_WORDS,
+        PCX_WORDPARTY_SIDEBAND_LETTERS_USED,
+};
+
 /* Word results used for the sideband data */
 enum pcx_wordparty_result {
         PCX_WORDPARTY_RESULT_ACCEPTED,
@@ -121,6 +135,8 @@ struct pcx_wordparty {
         int n_used_words;
 
         struct pcx_main_context_source *word_timeout;
+        /* Monotonic time when word_timeout was added */
+        uint64_t word_timeout_start;
 
         char current_syllable[PCX_SYLLABARY_MAX_SYLLABLE_LENGTH + 1];
         int current_difficulty;
@@ -197,6 +213,36 @@ count_players(struct pcx_wordparty *wordparty)
         return count;
 }
 
+static void
+update_syllable_upper(struct pcx_wordparty *wordparty)
+{
+        const char *src = wordparty->current_syllable;
+        char *dst = wordparty->current_syllable_upper;
+
+        while (true) {
+                int ch = pcx_utf8_get_char(src);
+
+                dst += pcx_utf8_encode(pcx_hat_to_upper(ch), dst);
+
+                if (ch == 0)
+                        break;
+
+                src = pcx_utf8_next(src);
+        }
+}
+
+static void
+set_sideband_data(struct pcx_wordparty *wordparty,
+                  enum pcx_wordparty_sideband data_num,
+                  const struct pcx_game_sideband_data *data,
+                  bool force)
+{
+        wordparty->callbacks.set_sideband_data(data_num,
+                                               data,
+                                               force,
+                                               wordparty->user_data);
+}
+
 static void
 pick_syllable(struct pcx_wordparty *wordparty)
 {
@@ -212,31 +258,39 @@ pick_syllable(struct pcx_wordparty *wordparty)
                 wordparty->current_difficulty = 0;
         }
 
-        char *upper = wordparty->current_syllable_upper;
+        update_syllable_upper(wordparty);
 
-        const char *src = wordparty->current_syllable;
-        char *dst = upper;
-
-        while (true) {
-                int ch = pcx_utf8_get_char(src);
-
-                dst += pcx_utf8_encode(pcx_hat_to_upper(ch), dst);
-
-                if (ch == 0)
-                        break;
+        struct pcx_game_sideband_data data = {
+                .type = PCX_GAME_SIDEBAND_TYPE_STRING,
+                .string = wordparty->current_syllable_upper,
+        };
 
-                src = pcx_utf8_next(src);
-        }
+        set_sideband_data(wordparty,
+                          PCX_WORDPARTY_SIDEBAND_SYLLABLE,
+                          &data,
+                          false /* force */);
+}
 
+static void
+set_player_sideband_data(struct pcx_wordparty *wordparty,
+                         enum pcx_wordparty_sideband data_num,
+                         int player_num,
+                         const char *value)
+{
         struct pcx_game_sideband_data data = {
-                .type = PCX_GAME_SIDEBAND_TYPE_STRING,
-                .string = upper,
+                .type = PCX_GAME_SIDEBAND_TYPE_ARRAY,
+                .array = {
+                        .start = player_num,
+                        .n_elements = 1,
+                        .elements = &value,
+                        .length = wordparty->n_players,
+                },
         };
 
-        wordparty->callbacks.set_sideband_data(wordparty->n_players + 1,
-                                               &data,
-                                               false, /* force */
-                                               wordparty->user_data);
+        set_sideband_data(wordparty,
+                          data_num,
+                          &data,
+                          false /* force */);
 }
 
 static void
@@ -246,15 +300,14 @@ set_lives(struct pcx_wordparty *wordparty,
 {
         wordparty->players[player_num].lives = lives;
 
-        struct pcx_game_sideband_data data = {
-                .type = PCX_GAME_SIDEBAND_TYPE_BYTE,
-                .byte = lives,
-        };
+        char value[16];
 
-        wordparty->callbacks.set_sideband_data(player_num + 1, /* data_num */
-                                               &data,
-                                               false, /* force */
-                                               wordparty->user_data);
+        snprintf(value, sizeof value, "%i", lives);
+
+        set_player_sideband_data(wordparty,
+                                 PCX_WORDPARTY_SIDEBAND_LIVES,
+                                 player_num,
+                                 value);
 }
 
 static void
@@ -268,10 +321,10 @@ set_current_player(struct pcx_wordparty *wordparty,
                 .byte = player_num,
         };
 
-        wordparty->callbacks.set_sideband_data(0, /* data_num */
-                                               &data,
-                                               false, /* force */
-                                               wordparty->user_data);
+        set_sideband_data(wordparty,
+                          PCX_WORDPARTY_SIDEBAND_CURRENT_PLAYER,
+                          &data,
+                          false /* force */);
 }
 
 static void
@@ -290,10 +343,10 @@ set_word_result(struct pcx_wordparty *wordparty,
          * invalid word we still want to resend the result even though
          * it’s the same as the last one.
          */
-        wordparty->callbacks.set_sideband_data(wordparty->n_players + 2,
-                                               &data,
-                                               true, /* force */
-                                               wordparty->user_data);
+        set_sideband_data(wordparty,
+                          PCX_WORDPARTY_SIDEBAND_LAST_RESULT,
+                          &data,
+                          true /* force */);
 }
 
 static void
@@ -301,17 +354,10 @@ set_typed_word(struct pcx_wordparty *wordparty,
                int player_num,
                const char *word)
 {
-        struct pcx_game_sideband_data data = {
-                .type = PCX_GAME_SIDEBAND_TYPE_STRING,
-                .string = word,
-        };
-
-        wordparty->callbacks.set_sideband_data(wordparty->n_players +
-                                               3 +
-                                               player_num,
-                                               &data,
-                                               false, /* force */
-                                               wordparty->user_data);
+        set_player_sideband_data(wordparty,
+                                 PCX_WORDPARTY_SIDEBAND_TYPED_WORDS,
+                                 player_num,
+                                 word);
 }
 
 static void
@@ -321,17 +367,14 @@ set_letters_used(struct pcx_wordparty *wordparty,
 {
         wordparty->players[player_num].letters_used = letters_used;
 
-        struct pcx_game_sideband_data data = {
-                .type = PCX_GAME_SIDEBAND_TYPE_UINT32,
-                .uint32 = letters_used,
-        };
+        char value[16];
 
-        wordparty->callbacks.set_sideband_data(wordparty->n_players * 2 +
-                                               3 +
-                                               player_num,
-                                               &data,
-                                               false, /* force */
-                                               wordparty->user_data);
+        snprintf(value, sizeof value, "%" PRIu32, letters_used);
+
+        set_player_sideband_data(wordparty,
+                                 PCX_WORDPARTY_SIDEBAND_LETTERS_USED,
+                                 player_num,
+                                 value);
 }
 
 static void
@@ -481,25 +524,9 @@ maybe_add_letters_hint(struct pcx_wordparty *wordparty,
 }
 
 static void
-start_turn(struct pcx_wordparty *wordparty)
+start_word_timeout(struct pcx_wordparty *wordparty,
+                   int elapsed_ms)
 {
-        int next_player = wordparty->current_player;
-
-        while (true) {
-                next_player = (next_player + 1) % wordparty->n_players;
-
-                if (wordparty->players[next_player].lives > 0 ||
-                    next_player == wordparty->current_player)
-                        break;
-        }
-
-        set_current_player(wordparty, next_player);
-
-        if (count_players(wordparty) <= (wordparty->n_players > 1 ? 1 : 0)) {
-                end_game(wordparty);
-                return;
-        }
-
         /* Make the timeouts gradually get shorter as the game progresses */
         int difficulty = (wordparty->current_difficulty -
                           wordparty->n_used_words / wordparty->n_players);
@@ -513,11 +540,40 @@ start_turn(struct pcx_wordparty *wordparty)
                                        PCX_WORDPARTY_MIN_WORD_TIMEOUT) /
                          PCX_SYLLABARY_MAX_DIFFICULTY));
 
+        wordparty->word_timeout_start =
+                pcx_main_context_get_monotonic_clock(NULL) -
+                elapsed_ms * UINT64_C(1000);
+
+        timeout = elapsed_ms < timeout ? timeout - elapsed_ms : 0;
+
         wordparty->word_timeout =
                 pcx_main_context_add_timeout(NULL,
                                              timeout,
                                              word_timeout_cb,
                                              wordparty);
+}
+
+static void
+start_turn(struct pcx_wordparty *wordparty)
+{
+        int next_player = wordparty->current_player;
+
+        while (true) {
+                next_player = (next_player + 1) % wordparty->n_players;
+
+                if (wordparty->players[next_player].lives > 0 ||
+                    next_player == wordparty->current_player)
+                        break;
+        }
+
+        set_current_player(wordparty, next_player);
+
+        if (count_players(wordparty) <= (wordparty->n_players > 1 ? 1 : 0)) {
+                end_game(wordparty);
+                return;
+        }
+
+        start_word_timeout(wordparty, 0 /* elapsed_ms */);
 
         struct pcx_buffer buf = PCX_BUFFER_STATIC_INIT;
 
@@ -682,6 +738,39 @@ create_alphabet(struct pcx_wordparty *wordparty)
               compare_letter_by_unicode);
 }
 
+/* Sets up the parts of the game that are the same for a new game
+ * and a restored one without sending any sideband data.
+ */
+static void
+init_game(struct pcx_wordparty *wordparty,
+          const struct pcx_config *config,
+          const char * const *names)
+{
+        int n_players = wordparty->n_players;
+
+        wordparty->players = pcx_calloc(n_players *
+                                        sizeof (struct pcx_wordparty_player));
+
+        for (unsigned i = 0; i < n_players; i++)
+                wordparty->players[i].name = pcx_strdup(names[i]);
+
+        pcx_buffer_init(&wordparty->word_buf);
+
+        wordparty->used_words = pcx_trie_new();
+
+        struct pcx_class_store *class_store =
+                wordparty->callbacks.get_class_store(wordparty->user_data);
+
+        wordparty->class_data =
+                pcx_class_store_ref_data(class_store,
+                                         config,
+                                         &pcx_wordparty_game,
+                                         wordparty->language,
+                                         &class_store_callbacks);
+
+        create_alphabet(wordparty);
+}
+
 static void *
 create_game_cb(const struct pcx_config *config,
                const struct pcx_game_callbacks *callbacks,
@@ -700,29 +789,13 @@ create_game_cb(const struct pcx_config *config,
 
         wordparty->n_players = n_players;
 
-        wordparty->players = pcx_calloc(n_players *
-                                        sizeof (struct pcx_wordparty_player));
+        init_game(wordparty, config, names);
 
-        for (unsigned i = 0; i < n_players; i++) {
-                wordparty->players[i].name = pcx_strdup(names[i]);
+        for (unsigned i = 0; i < n_players; i++)
                 set_lives(wordparty, i, PCX_WORDPARTY_LIVES);
-        }
-
-        pcx_buffer_init(&wordparty->word_buf);
-
-        wordparty->used_words = pcx_trie_new();
-
-        wordparty->class_data =
-                pcx_class_store_ref_data(callbacks->get_class_store(user_data),
-                                         config,
-                                         &pcx_wordparty_game,
-                                         language,
-                                         &class_store_callbacks);
 
         set_current_player(wordparty, rand() % n_players);
 
-        create_alphabet(wordparty);
-
         pick_syllable(wordparty);
         start_turn(wordparty);
 
@@ -988,6 +1061,178 @@ free_game_cb(void *data)
         pcx_free(wordparty);
 }
 
+static void
+snapshot_word_cb(const char *word,
+                 void *user_data)
+{
+        struct pcx_buffer *buf = user_data;
+        pcx_snapshot_write_string(buf, word);
+}
+
+static void
+snapshot_cb(void *data,
+            struct pcx_buffer *buf)
+{
+        struct pcx_wordparty *wordparty = data;
+
+        for (unsigned i = 0; i < wordparty->n_players; i++) {
+                const struct pcx_wordparty_player *player =
+                        wordparty->players + i;
+
+                pcx_snapshot_write_int(buf, player->lives);
+                pcx_snapshot_write_uint32(buf, player->letters_used);
+        }
+
+        pcx_snapshot_write_int(buf, wordparty->current_player);
+        pcx_snapshot_write_int(buf, wordparty->fail_count);
+        pcx_snapshot_write_int(buf, wordparty->max_fail_count);
+        pcx_snapshot_write_int(buf, wordparty->n_used_words);
+        pcx_snapshot_write_string(buf, wordparty->current_syllable);
+        pcx_snapshot_write_int(buf, wordparty->current_difficulty);
+
+        /* The words are written with a count in front so they are
+         * collected in a separate buffer first.
+         */
+        struct pcx_buffer words = PCX_BUFFER_STATIC_INIT;
+
+        pcx_trie_foreach_word(wordparty->used_words,
+                              snapshot_word_cb,
+                              &words);
+
+        pcx_snapshot_write_data(buf, words.data, words.length);
+
+        pcx_buffer_destroy(&words);
+
+        uint64_t elapsed_ms = 0;
+
+        if (wordparty->word_timeout) {
+                uint64_t now = pcx_main_context_get_monotonic_clock(NULL);
+                elapsed_ms = (now - wordparty->word_timeout_start) / 1000;
+        }
+
+        pcx_snapshot_write_int(buf, MIN(elapsed_ms, INT_MAX));
+
+        pcx_snapshot_write_bool(buf, wordparty->game_over_source != NULL);
+}
+
+static void
+restore_used_words(struct pcx_wordparty *wordparty,
+                   struct pcx_snapshot_reader *reader)
+{
+        size_t length;
+        const uint8_t *data = pcx_snapshot_read_data(reader, &length);
+
+        if (data == NULL)
+                return;
+
+        struct pcx_snapshot_reader words_reader;
+
+        pcx_snapshot_reader_init(&words_reader, data, length);
+
+        while (words_reader.pos < words_reader.length) {
+                const char *word = pcx_snapshot_read_string(&words_reader);
+
+                if (*word == '\0') {
+                        pcx_snapshot_reader_set_error(&words_reader);
+                        break;
+                }
+
+                pcx_trie_add_word(wordparty->used_words, word);
+        }
+
+        if (words_reader.error)
+                pcx_snapshot_reader_set_error(reader);
+}
+
+static void
+restore_syllable(struct pcx_wordparty *wordparty,
+                 struct pcx_snapshot_reader *reader)
+{
+        const char *syllable = pcx_snapshot_read_string(reader);
+
+        if (*syllable == '\0' ||
+            strlen(syllable) > PCX_SYLLABARY_MAX_SYLLABLE_LENGTH ||
+            !pcx_utf8_is_valid_string(syllable)) {
+                pcx_snapshot_reader_set_error(reader);
+                return;
+        }
+
+        strcpy(wordparty->current_syllable, syllable);
+
+        update_syllable_upper(wordparty);
+}
+
+static void *
+restore_cb(const struct pcx_config *config,
+           const struct pcx_game_callbacks *callbacks,
+           void *user_data,
+           enum pcx_text_language language,
+           int n_players,
+           const char * const *names,
+           struct pcx_snapshot_reader *reader)
+{
+        if (n_players < PCX_WORDPARTY_MIN_PLAYERS ||
+            n_players > PCX_WORDPARTY_MAX_PLAYERS)
+                return NULL;
+
+        struct pcx_wordparty *wordparty = pcx_calloc(sizeof *wordparty);
+
+        wordparty->language = language;
+        wordparty->callbacks = *callbacks;
+        wordparty->user_data = user_data;
+        wordparty->n_players = n_players;
+
+        init_game(wordparty, config, names);
+
+        for (unsigned i = 0; i < n_players; i++) {
+                struct pcx_wordparty_player *player = wordparty->players + i;
+
+                player->lives =
+                        pcx_snapshot_read_int_range(reader,
+                                                    0,
+                                                    PCX_WORDPARTY_MAX_LIVES);
+                player->letters_used = pcx_snapshot_read_uint32(reader);
+        }
+
+        wordparty->current_player =
+                pcx_snapshot_read_int_range(reader, 0, n_players - 1);
+        wordparty->fail_count =
+                pcx_snapshot_read_int_range(reader, 0, n_players);
+        wordparty->max_fail_count =
+                pcx_snapshot_read_int_range(reader, 0, n_players);
+        wordparty->n_used_words =
+                pcx_snapshot_read_int_range(reader, 0, INT_MAX);
+
+        restore_syllable(wordparty, reader);
+
+        wordparty->current_difficulty =
+                pcx_snapshot_read_int_range(reader,
+                                            0,
+                                            PCX_SYLLABARY_MAX_DIFFICULTY);
+
+        restore_used_words(wordparty, reader);
+
+        int elapsed_ms = pcx_snapshot_read_int_range(reader, 0, INT_MAX);
+        bool game_over = pcx_snapshot_read_bool(reader);
+
+        if (reader->error) {
+                free_game_cb(wordparty);
+                return NULL;
+        }
+
+        if (game_over) {
+                wordparty->game_over_source =
+                        pcx_main_context_add_timeout(NULL,
+                                                     0, /* ms */
+                                                     game_over_cb,
+                                                     wordparty);
+        } else {
+                start_word_timeout(wordparty, elapsed_ms);
+        }
+
+        return wordparty;
+}
+
 const struct pcx_game
 pcx_wordparty_game = {
         .name = "wordparty",
@@ -1003,5 +1248,7 @@ pcx_wordparty_game = {
         .handle_callback_data_cb = handle_callback_data_cb,
         .handle_message_cb = handle_message_cb,
         .handle_sideband_cb = handle_sideband_cb,
-        .free_game_cb = free_game_cb
+        .free_game_cb = free_game_cb,
+        .snapshot_cb = snapshot_cb,
+        .restore_cb = restore_cb,
 };
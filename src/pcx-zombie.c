@@ -26,6 +26,7 @@
 #include <assert.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
 
 #include "pcx-util.h"
 #include "pcx-buffer.h"
@@ -806,6 +807,132 @@ free_game_cb(void *data)
         free_game(data);
 }
 
+static void
+save_die_set(struct pcx_buffer *buf,
+             const struct pcx_zombie_die_set *set)
+{
+        for (unsigned i = 0; i < PCX_ZOMBIE_N_DICE; i++)
+                pcx_snapshot_write_int(buf, set->dice_count[i]);
+}
+
+static void
+snapshot_cb(void *data,
+            struct pcx_buffer *buf)
+{
+        struct pcx_zombie *zombie = data;
+
+        for (int i = 0; i < zombie->n_players; i++)
+                pcx_snapshot_write_int(buf, zombie->players[i].score);
+
+        pcx_snapshot_write_int(buf, zombie->current_player);
+        pcx_snapshot_write_int(buf, zombie->last_player);
+
+        pcx_snapshot_write_bool(buf, zombie->drama_source != NULL);
+        pcx_snapshot_write_bool(buf, zombie->game_over_source != NULL);
+
+        pcx_snapshot_write_int(buf, zombie->n_dice_thrown);
+
+        for (int i = 0; i < zombie->n_dice_thrown; i++) {
+                pcx_snapshot_write_uint8(buf, zombie->dice_thrown[i].die);
+                pcx_snapshot_write_uint8(buf, zombie->dice_thrown[i].face);
+        }
+
+        save_die_set(buf, &zombie->box);
+        save_die_set(buf, &zombie->brains_thrown);
+        save_die_set(buf, &zombie->feet_thrown);
+
+        pcx_snapshot_write_int(buf, zombie->n_brains);
+        pcx_snapshot_write_int(buf, zombie->n_shotguns);
+}
+
+static void
+restore_die_set(struct pcx_snapshot_reader *reader,
+                struct pcx_zombie_die_set *set)
+{
+        for (unsigned i = 0; i < PCX_ZOMBIE_N_DICE; i++) {
+                set->dice_count[i] =
+                        pcx_snapshot_read_int_range(reader,
+                                                    0,
+                                                    die_info[i].start_amount);
+        }
+}
+
+static void *
+restore_cb(const struct pcx_config *config,
+           const struct pcx_game_callbacks *callbacks,
+           void *user_data,
+           enum pcx_text_language language,
+           int n_players,
+           const char * const *names,
+           struct pcx_snapshot_reader *reader)
+{
+        struct pcx_zombie *zombie = pcx_calloc(sizeof *zombie);
+
+        zombie->language = language;
+        zombie->callbacks = *callbacks;
+        zombie->user_data = user_data;
+        zombie->rand_func = rand;
+        zombie->n_players = n_players;
+
+        for (int i = 0; i < n_players; i++) {
+                zombie->players[i].name = pcx_strdup(names[i]);
+                zombie->players[i].score =
+                        pcx_snapshot_read_int_range(reader, 0, INT_MAX);
+        }
+
+        zombie->current_player =
+                pcx_snapshot_read_int_range(reader, 0, n_players - 1);
+        zombie->last_player =
+                pcx_snapshot_read_int_range(reader, -1, n_players - 1);
+
+        bool in_drama = pcx_snapshot_read_bool(reader);
+        bool game_over = pcx_snapshot_read_bool(reader);
+
+        zombie->n_dice_thrown =
+                pcx_snapshot_read_int_range(reader,
+                                            0,
+                                            PCX_ZOMBIE_DICE_PER_THROW);
+
+        for (int i = 0; i < zombie->n_dice_thrown; i++) {
+                struct pcx_zombie_die_and_face *daf = zombie->dice_thrown + i;
+
+                daf->die = pcx_snapshot_read_uint8(reader);
+                daf->face = pcx_snapshot_read_uint8(reader);
+
+                if (daf->die >= PCX_ZOMBIE_N_DICE ||
+                    daf->face >= PCX_ZOMBIE_N_FACES)
+                        pcx_snapshot_reader_set_error(reader);
+        }
+
+        restore_die_set(reader, &zombie->box);
+        restore_die_set(reader, &zombie->brains_thrown);
+        restore_die_set(reader, &zombie->feet_thrown);
+
+        zombie->n_brains = pcx_snapshot_read_int_range(reader, 0, INT_MAX);
+        zombie->n_shotguns = pcx_snapshot_read_int_range(reader, 0, INT_MAX);
+
+        if (reader->error) {
+                free_game(zombie);
+                return NULL;
+        }
+
+        /* The dice that were being thrown are revealed again after
+         * the full delay.
+         */
+        if (in_drama)
+                start_drama_timeout(zombie);
+
+        if (game_over) {
+                zombie->game_over_source =
+                        pcx_main_context_add_timeout(NULL,
+                                                     0, /* ms */
+                                                     game_over_cb,
+                                                     zombie);
+        }
+
+        return zombie;
+}
+
 const struct pcx_game
 pcx_zombie_game = {
         .name = "zombie",
@@ -819,5 +946,7 @@ pcx_zombie_game = {
         .create_game_cb = create_game_cb,
         .get_help_cb = get_help_cb,
         .handle_callback_data_cb = handle_callback_data_cb,
-        .free_game_cb = free_game_cb
+        .free_game_cb = free_game_cb,
+        .snapshot_cb = snapshot_cb,
+        .restore_cb = restore_cb,
 };
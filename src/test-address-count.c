@@ -0,0 +1,144 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+
+#include "pcx-address-count.h"
+
+static void
+get_address(struct pcx_netaddress *address,
+            const char *str)
+{
+        bool ret = pcx_netaddress_from_string(address, str, 1234);
+        assert(ret);
+}
+
+static void
+test_count(void)
+{
+        struct pcx_address_count *count = pcx_address_count_new();
+        struct pcx_netaddress a, b;
+
+        get_address(&a, "192.168.1.1");
+        get_address(&b, "192.168.1.2");
+
+        assert(pcx_address_count_get(count, &a) == 0);
+
+        for (int i = 0; i < 3; i++)
+                pcx_address_count_increment(count, &a);
+
+        assert(pcx_address_count_get(count, &a) == 3);
+        assert(pcx_address_count_get(count, &b) == 0);
+
+        /* A different port is the same client */
+        a.port++;
+        pcx_address_count_increment(count, &a);
+        assert(pcx_address_count_get(count, &a) == 4);
+
+        pcx_address_count_increment(count, &b);
+        assert(pcx_address_count_get(count, &b) == 1);
+        assert(pcx_address_count_get_n_addresses(count) == 2);
+
+        pcx_address_count_decrement(count, &b);
+        assert(pcx_address_count_get(count, &b) == 0);
+        assert(pcx_address_count_get_n_addresses(count) == 1);
+
+        pcx_address_count_decrement(count, &a);
+        assert(pcx_address_count_get(count, &a) == 3);
+
+        pcx_address_count_free(count);
+}
+
+static void
+test_ipv6_prefix(void)
+{
+        struct pcx_address_count *count = pcx_address_count_new();
+        struct pcx_netaddress a, b, c;
+
+        get_address(&a, "[2001:db8:1:2::1]");
+        get_address(&b, "[2001:db8:1:2::ffff]");
+        get_address(&c, "[2001:db8:1:3::1]");
+
+        pcx_address_count_increment(count, &a);
+        /* Same /64 */
+        assert(pcx_address_count_get(count, &b) == 1);
+        assert(pcx_address_count_get(count, &c) == 0);
+
+        pcx_address_count_free(count);
+}
+
+static void
+test_not_counted(void)
+{
+        struct pcx_address_count *count = pcx_address_count_new();
+        struct pcx_netaddress address = { .family = AF_UNSPEC };
+
+        pcx_address_count_increment(count, &address);
+        assert(pcx_address_count_get(count, &address) == 0);
+        assert(pcx_address_count_get_n_addresses(count) == 0);
+        pcx_address_count_decrement(count, &address);
+
+        pcx_address_count_free(count);
+}
+
+static void
+test_resize(void)
+{
+        struct pcx_address_count *count = pcx_address_count_new();
+
+        for (int i = 0; i < 1000; i++) {
+                struct pcx_netaddress address = {
+                        .family = AF_INET,
+                        .ipv4 = { .s_addr = i },
+                };
+                for (int j = 0; j <= i % 3; j++)
+                        pcx_address_count_increment(count, &address);
+        }
+
+        assert(pcx_address_count_get_n_addresses(count) == 1000);
+
+        for (int i = 0; i < 1000; i++) {
+                struct pcx_netaddress address = {
+                        .family = AF_INET,
+                        .ipv4 = { .s_addr = i },
+                };
+                assert(pcx_address_count_get(count, &address) == i % 3 + 1);
+                for (int j = 0; j <= i % 3; j++)
+                        pcx_address_count_decrement(count, &address);
+                assert(pcx_address_count_get(count, &address) == 0);
+        }
+
+        assert(pcx_address_count_get_n_addresses(count) == 0);
+
+        pcx_address_count_free(count);
+}
+
+int
+main(int argc, char **argv)
+{
+        test_count();
+        test_ipv6_prefix();
+        test_not_counted();
+        test_resize();
+
+        return EXIT_SUCCESS;
+}
@@ -34,6 +34,7 @@
 #include "pcx-list.h"
 #include "pcx-main-context.h"
 #include "pcx-log.h"
+#include "pcx-snapshot.h"
 #include "test-message.h"
 #include "test-time-hack.h"
 
@@ -274,13 +275,22 @@ queue_private_message(struct test_data *data,
 
 static PCX_NULL_TERMINATED void
 queue_sideband_word_list(struct test_data *data,
+                         const char *topic,
                          ...)
 {
         va_list ap;
 
-        va_start(ap, data);
+        struct test_message *message =
+                test_message_queue(&data->message_data,
+                                   TEST_MESSAGE_TYPE_SIDEBAND_STRING);
+
+        message->destination = 0;
+        message->message = pcx_strdup(topic);
 
-        int data_num = 0;
+        struct pcx_buffer buf = PCX_BUFFER_STATIC_INIT;
+        bool first = true;
+
+        va_start(ap, topic);
 
         while (true) {
                 const char *word = va_arg(ap, const char *);
@@ -288,17 +298,24 @@ queue_sideband_word_list(struct test_data *data,
                 if (word == NULL)
                         break;
 
-                struct test_message *message =
-                        test_message_queue(&data->message_data,
-                                           TEST_MESSAGE_TYPE_SIDEBAND_STRING);
+                if (!first)
+                        pcx_buffer_append_c(&buf, '\n');
 
-                message->destination = data_num;
-                message->message = pcx_strdup(word);
-
-                data_num++;
+                pcx_buffer_append_string(&buf, word);
+                first = false;
         }
 
         va_end(ap);
+
+        pcx_buffer_append_c(&buf, '\0');
+
+        message = test_message_queue(&data->message_data,
+                                     TEST_MESSAGE_TYPE_SIDEBAND_ARRAY);
+
+        message->destination = 1;
+        message->message = pcx_strdup((const char *) buf.data);
+
+        pcx_buffer_destroy(&buf);
 }
 
 static struct test_message *
@@ -1681,8 +1698,6 @@ test_shorter_word_list(void)
         queue_sideband_word_list(data,
                                  "One letter",
                                  "A",
-                                 "",
-                                 "",
                                  NULL);
 
         queue_private_message(data,
@@ -1841,6 +1856,123 @@ out:
         return ret;
 }
 
+static bool
+test_snapshot(void)
+{
+        struct test_data *data = start_basic_game();
+
+        if (data == NULL)
+                return false;
+
+        bool ret = true;
+        struct pcx_buffer buf = PCX_BUFFER_STATIC_INIT;
+
+        if (!send_clues(data,
+                        "lemon",
+                        "blood",
+                        "tomato",
+                        "china",
+                        NULL)) {
+                ret = false;
+                goto out;
+        }
+
+        /* Let some of the time for the vote message pass before the
+         * snapshot.
+         */
+        test_time_hack_add_time(30);
+
+        pcx_chameleon_game.snapshot_cb(data->chameleon, &buf);
+
+        struct pcx_snapshot_reader reader;
+
+        pcx_snapshot_reader_init(&reader, buf.data, buf.length - 1);
+
+        struct pcx_chameleon *restored =
+                pcx_chameleon_game.restore_cb(data->config,
+                                              &test_message_callbacks,
+                                              &data->message_data,
+                                              PCX_TEXT_LANGUAGE_ESPERANTO,
+                                              4, /* n_players */
+                                              test_message_player_names,
+                                              &reader);
+
+        if (restored) {
+                fprintf(stderr, "Truncated snapshot was restored\n");
+                pcx_chameleon_game.free_game_cb(restored);
+                ret = false;
+                goto out;
+        }
+
+        pcx_snapshot_reader_init(&reader, buf.data, buf.length);
+
+        restored = pcx_chameleon_game.restore_cb(data->config,
+                                                 &test_message_callbacks,
+                                                 &data->message_data,
+                                                 PCX_TEXT_LANGUAGE_ESPERANTO,
+                                                 4, /* n_players */
+                                                 test_message_player_names,
+                                                 &reader);
+
+        if (restored == NULL) {
+                fprintf(stderr, "Restoring the snapshot failed\n");
+                ret = false;
+                goto out;
+        }
+
+        pcx_chameleon_game.free_game_cb(data->chameleon);
+        data->chameleon = restored;
+
+        struct pcx_buffer second_buf = PCX_BUFFER_STATIC_INIT;
+
+        pcx_chameleon_game.snapshot_cb(data->chameleon, &second_buf);
+
+        if (second_buf.length != buf.length ||
+            memcmp(second_buf.data, buf.data, buf.length)) {
+                fprintf(stderr, "Restored snapshot doesn’t match\n");
+                ret = false;
+        }
+
+        pcx_buffer_destroy(&second_buf);
+
+        if (!ret)
+                goto out;
+
+        /* The vote message should only need the rest of the time */
+        test_time_hack_add_time(29);
+
+        if (!check_idle(data)) {
+                ret = false;
+                goto out;
+        }
+
+        test_time_hack_add_time(2);
+
+        struct test_message *message =
+                queue_global_message(data,
+                                     "Se vi jam finis la debaton, vi "
+                                     "povas voĉdoni por la ludanto "
+                                     "kiun vi suspektas esti la "
+                                     "kameleono.");
+
+        test_message_enable_check_buttons(message);
+        test_message_add_button(message, "vote:0", "Alice");
+        test_message_add_button(message, "vote:1", "Bob");
+        test_message_add_button(message, "vote:2", "Charles");
+        test_message_add_button(message, "vote:3", "David");
+
+        if (!test_message_run_queue(&data->message_data)) {
+                ret = false;
+                goto out;
+        }
+
+out:
+        pcx_buffer_destroy(&buf);
+        free_test_data(data);
+
+        return ret;
+}
+
 int
 main(int argc, char **argv)
 {
@@ -1887,6 +2019,9 @@ main(int argc, char **argv)
         if (!test_invalid_start_round())
                 ret = EXIT_FAILURE;
 
+        if (!test_snapshot())
+                ret = EXIT_FAILURE;
+
         pcx_log_close();
 
         pcx_main_context_free(pcx_main_context_get_default());
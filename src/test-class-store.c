@@ -0,0 +1,143 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "pcx-class-store.h"
+#include "pcx-util.h"
+
+static int n_datas = 0;
+
+static void *
+create_data(const struct pcx_config *config,
+            enum pcx_text_language language)
+{
+        int *data = pcx_alloc(sizeof *data);
+
+        *data = n_datas++;
+
+        return data;
+}
+
+static void
+free_data(void *data)
+{
+        n_datas--;
+        pcx_free(data);
+}
+
+static const struct pcx_class_store_callbacks
+callbacks = {
+        .create_data = create_data,
+        .free_data = free_data,
+};
+
+static const int class_a, class_b;
+
+static void
+test_sharing(void)
+{
+        struct pcx_class_store *store = pcx_class_store_new();
+
+        void *a1 = pcx_class_store_ref_data(store,
+                                            NULL,
+                                            &class_a,
+                                            PCX_TEXT_LANGUAGE_ESPERANTO,
+                                            &callbacks);
+        void *a2 = pcx_class_store_ref_data(store,
+                                            NULL,
+                                            &class_a,
+                                            PCX_TEXT_LANGUAGE_ESPERANTO,
+                                            &callbacks);
+        void *a_en = pcx_class_store_ref_data(store,
+                                              NULL,
+                                              &class_a,
+                                              PCX_TEXT_LANGUAGE_ENGLISH,
+                                              &callbacks);
+        void *b = pcx_class_store_ref_data(store,
+                                           NULL,
+                                           &class_b,
+                                           PCX_TEXT_LANGUAGE_ESPERANTO,
+                                           &callbacks);
+
+        assert(a1 == a2);
+        assert(a1 != a_en);
+        assert(a1 != b);
+        assert(n_datas == 3);
+
+        pcx_class_store_unref_data(store, a1);
+        assert(n_datas == 3);
+        pcx_class_store_unref_data(store, a2);
+        assert(n_datas == 2);
+        pcx_class_store_unref_data(store, a_en);
+        pcx_class_store_unref_data(store, b);
+        assert(n_datas == 0);
+
+        pcx_class_store_free(store);
+}
+
+static void
+test_invalidate(void)
+{
+        struct pcx_class_store *store = pcx_class_store_new();
+
+        void *old = pcx_class_store_ref_data(store,
+                                             NULL,
+                                             &class_a,
+                                             PCX_TEXT_LANGUAGE_ESPERANTO,
+                                             &callbacks);
+
+        pcx_class_store_invalidate(store);
+
+        /* The old data is still alive but new users get a new copy */
+        void *new1 = pcx_class_store_ref_data(store,
+                                              NULL,
+                                              &class_a,
+                                              PCX_TEXT_LANGUAGE_ESPERANTO,
+                                              &callbacks);
+        void *new2 = pcx_class_store_ref_data(store,
+                                              NULL,
+                                              &class_a,
+                                              PCX_TEXT_LANGUAGE_ESPERANTO,
+                                              &callbacks);
+
+        assert(new1 != old);
+        assert(new1 == new2);
+        assert(n_datas == 2);
+
+        pcx_class_store_unref_data(store, old);
+        assert(n_datas == 1);
+
+        pcx_class_store_unref_data(store, new1);
+        pcx_class_store_unref_data(store, new2);
+        assert(n_datas == 0);
+
+        pcx_class_store_free(store);
+}
+
+int
+main(int argc, char **argv)
+{
+        test_sharing();
+        test_invalidate();
+
+        return EXIT_SUCCESS;
+}
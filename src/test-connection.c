@@ -0,0 +1,370 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "pcx-connection.h"
+#include "pcx-conversation.h"
+#include "pcx-main-context.h"
+#include "pcx-proto.h"
+#include "pcx-util.h"
+#include "test-time-hack.h"
+
+#define ARRAY_DATA_NUM 0
+#define STRING_DATA_NUM 1
+#define ARRAY_LENGTH 3
+
+struct test_client {
+        int fd;
+        uint8_t read_buf[8192];
+        size_t read_pos;
+        bool had_handshake;
+        char elements[ARRAY_LENGTH][32];
+};
+
+static const struct pcx_game_callbacks *
+game_callbacks;
+static void *
+game_user_data;
+
+static void *
+create_game_cb(const struct pcx_config *config,
+               const struct pcx_game_callbacks *callbacks,
+               void *user_data,
+               enum pcx_text_language language,
+               int n_players,
+               const char * const *names)
+{
+        game_callbacks = callbacks;
+        game_user_data = user_data;
+
+        return pcx_alloc(1);
+}
+
+static void
+free_game_cb(void *game)
+{
+        pcx_free(game);
+}
+
+static const struct pcx_game
+test_game = {
+        .name = "test",
+        .min_players = 2,
+        .max_players = 4,
+        .create_game_cb = create_game_cb,
+        .free_game_cb = free_game_cb,
+};
+
+static void
+clear_timeout_cb(struct pcx_main_context_source *source,
+                 void *user_data)
+{
+        struct pcx_main_context_source **timeout_ptr = user_data;
+
+        *timeout_ptr = NULL;
+}
+
+static void
+handle_sideband_array(struct test_client *client,
+                      const uint8_t *payload,
+                      size_t length)
+{
+        assert(length >= 4);
+
+        if (payload[1] != ARRAY_DATA_NUM)
+                return;
+
+        assert(payload[2] == ARRAY_LENGTH && payload[3] == 0);
+
+        const uint8_t *p = payload + 4, *end = payload + length;
+
+        while (p < end) {
+                assert(p + 2 < end);
+
+                int index = p[0] | (p[1] << 8);
+                const char *value = (const char *) p + 2;
+                size_t value_size = strlen(value) + 1;
+
+                assert(index < ARRAY_LENGTH);
+                assert(value_size <= sizeof client->elements[index]);
+
+                memcpy(client->elements[index], value, value_size);
+
+                p += 2 + value_size;
+        }
+}
+
+static void
+process_frames(struct test_client *client)
+{
+        size_t pos = 0;
+
+        if (!client->had_handshake) {
+                while (true) {
+                        if (pos + 4 > client->read_pos)
+                                return;
+                        if (!memcmp(client->read_buf + pos, "\r\n\r\n", 4))
+                                break;
+                        pos++;
+                }
+
+                client->had_handshake = true;
+                pos += 4;
+        }
+
+        while (pos + 2 <= client->read_pos) {
+                size_t length = client->read_buf[pos + 1];
+                size_t data_start = pos + 2;
+
+                if (length == 126) {
+                        if (data_start + 2 > client->read_pos)
+                                break;
+
+                        length = ((client->read_buf[data_start] << 8) |
+                                  client->read_buf[data_start + 1]);
+                        data_start += 2;
+                }
+
+                if (data_start + length > client->read_pos)
+                        break;
+
+                if (length >= 1 &&
+                    client->read_buf[data_start] == PCX_PROTO_SIDEBAND_ARRAY) {
+                        handle_sideband_array(client,
+                                              client->read_buf + data_start,
+                                              length);
+                }
+
+                pos = data_start + length;
+        }
+
+        memmove(client->read_buf,
+                client->read_buf + pos,
+                client->read_pos - pos);
+        client->read_pos -= pos;
+}
+
+static void
+client_read_cb(struct pcx_main_context_source *source,
+               int fd,
+               enum pcx_main_context_poll_flags flags,
+               void *user_data)
+{
+        struct test_client *client = user_data;
+
+        ssize_t got = read(client->fd,
+                           client->read_buf + client->read_pos,
+                           sizeof client->read_buf - client->read_pos);
+
+        assert(got > 0);
+
+        client->read_pos += got;
+
+        process_frames(client);
+}
+
+static void
+sync_with_connection(void)
+{
+        /* Poll until a short timeout is hit so that everything that
+         * can be written has been read.
+         */
+        int poll_count = 0;
+
+        while (true) {
+                struct pcx_main_context_source *timeout =
+                        pcx_main_context_add_timeout(NULL,
+                                                     poll_count < 2 ? 0 : 16,
+                                                     clear_timeout_cb,
+                                                     &timeout);
+
+                pcx_main_context_poll(NULL);
+
+                if (timeout)
+                        pcx_main_context_remove_source(timeout);
+                else if (poll_count >= 2)
+                        break;
+
+                poll_count++;
+        }
+}
+
+static struct pcx_connection *
+connect_client(struct test_client *client)
+{
+        int listen_sock = socket(PF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr = {
+                .sin_family = AF_INET,
+                .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        };
+        socklen_t addr_len = sizeof addr;
+
+        assert(listen_sock != -1);
+        assert(bind(listen_sock, (struct sockaddr *) &addr, addr_len) == 0);
+        assert(listen(listen_sock, 1) == 0);
+        assert(getsockname(listen_sock,
+                           (struct sockaddr *) &addr,
+                           &addr_len) == 0);
+
+        client->fd = socket(PF_INET, SOCK_STREAM, 0);
+        assert(client->fd != -1);
+        assert(connect(client->fd, (struct sockaddr *) &addr, addr_len) == 0);
+
+        struct pcx_error *error = NULL;
+        struct pcx_connection *conn =
+                pcx_connection_accept(NULL, listen_sock, &error);
+
+        assert(conn);
+
+        pcx_close(listen_sock);
+
+        static const char ws_request[] =
+                "GET / HTTP/1.1\r\n"
+                "Upgrade: websocket\r\n"
+                "Connection: Upgrade\r\n"
+                "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                "\r\n";
+
+        assert(write(client->fd, ws_request, sizeof ws_request - 1) ==
+               sizeof ws_request - 1);
+
+        return conn;
+}
+
+static void
+set_array_element(int index,
+                  const char *value)
+{
+        struct pcx_game_sideband_data data = {
+                .type = PCX_GAME_SIDEBAND_TYPE_ARRAY,
+                .array = {
+                        .start = index,
+                        .n_elements = 1,
+                        .elements = &value,
+                        .length = ARRAY_LENGTH,
+                },
+        };
+
+        game_callbacks->set_sideband_data(ARRAY_DATA_NUM,
+                                          &data,
+                                          false, /* force */
+                                          game_user_data);
+}
+
+static void
+set_string(const char *value)
+{
+        struct pcx_game_sideband_data data = {
+                .type = PCX_GAME_SIDEBAND_TYPE_STRING,
+                .string = value,
+        };
+
+        game_callbacks->set_sideband_data(STRING_DATA_NUM,
+                                          &data,
+                                          false, /* force */
+                                          game_user_data);
+}
+
+static void
+test_held_back_array(void)
+{
+        struct pcx_config config = {
+                .message_retention = 60,
+                .sideband_interval = 1000,
+        };
+        struct pcx_conversation *conv =
+                pcx_conversation_new(&config,
+                                     NULL, /* class_store */
+                                     &test_game,
+                                     PCX_TEXT_LANGUAGE_ENGLISH);
+
+        pcx_conversation_add_player(conv, "alice");
+        pcx_conversation_add_player(conv, "bob");
+        pcx_conversation_start(conv);
+
+        struct test_client client = { .read_pos = 0 };
+        struct pcx_connection *conn = connect_client(&client);
+        struct pcx_main_context_source *read_source =
+                pcx_main_context_add_poll(NULL,
+                                          client.fd,
+                                          PCX_MAIN_CONTEXT_POLL_IN,
+                                          client_read_cb,
+                                          &client);
+
+        sync_with_connection();
+        assert(client.had_handshake);
+
+        pcx_connection_spectate(conn, conv, 0);
+
+        set_array_element(0, "zero");
+        set_array_element(1, "one");
+        set_array_element(2, "two");
+        sync_with_connection();
+
+        assert(!strcmp(client.elements[0], "zero"));
+        assert(!strcmp(client.elements[1], "one"));
+        assert(!strcmp(client.elements[2], "two"));
+
+        /* This change is held back because the array was only just
+         * sent.
+         */
+        set_array_element(1, "uno");
+        /* This is sent straight away because the string hasn’t been
+         * sent before.
+         */
+        set_string("string");
+        sync_with_connection();
+
+        assert(!strcmp(client.elements[1], "one"));
+
+        /* Once the interval passes the held back change should be
+         * sent.
+         */
+        test_time_hack_add_time(2);
+        sync_with_connection();
+
+        assert(!strcmp(client.elements[0], "zero"));
+        assert(!strcmp(client.elements[1], "uno"));
+        assert(!strcmp(client.elements[2], "two"));
+
+        pcx_main_context_remove_source(read_source);
+        pcx_connection_free(conn);
+        pcx_close(client.fd);
+        pcx_conversation_unref(conv);
+}
+
+int
+main(int argc, char **argv)
+{
+        test_held_back_array();
+
+        pcx_main_context_free(pcx_main_context_get_default());
+
+        return EXIT_SUCCESS;
+}
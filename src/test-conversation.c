@@ -0,0 +1,874 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "pcx-conversation.h"
+#include "pcx-main-context.h"
+#include "test-time-hack.h"
+
+#define RETENTION 60
+
+#define TEST_GAME_STATE 0x12345678
+
+static const struct pcx_game_callbacks *
+game_callbacks;
+static void *
+game_user_data;
+
+static void *
+create_game_cb(const struct pcx_config *config,
+               const struct pcx_game_callbacks *callbacks,
+               void *user_data,
+               enum pcx_text_language language,
+               int n_players,
+               const char * const *names)
+{
+        game_callbacks = callbacks;
+        game_user_data = user_data;
+
+        return pcx_alloc(1);
+}
+
+static void
+free_game_cb(void *game)
+{
+        pcx_free(game);
+}
+
+static void
+snapshot_cb(void *game,
+            struct pcx_buffer *buf)
+{
+        pcx_snapshot_write_uint32(buf, TEST_GAME_STATE);
+}
+
+static void *
+restore_cb(const struct pcx_config *config,
+           const struct pcx_game_callbacks *callbacks,
+           void *user_data,
+           enum pcx_text_language language,
+           int n_players,
+           const char * const *names,
+           struct pcx_snapshot_reader *reader)
+{
+        if (pcx_snapshot_read_uint32(reader) != TEST_GAME_STATE)
+                return NULL;
+
+        game_callbacks = callbacks;
+        game_user_data = user_data;
+
+        return pcx_alloc(1);
+}
+
+static const struct pcx_game
+test_game = {
+        .name = "test",
+        .min_players = 2,
+        .max_players = 4,
+        .create_game_cb = create_game_cb,
+        .free_game_cb = free_game_cb,
+        .snapshot_cb = snapshot_cb,
+        .restore_cb = restore_cb,
+};
+
+static const struct pcx_game * const
+test_game_list[] = {
+        &test_game,
+        NULL,
+};
+
+static void
+send_messages(int n_messages,
+              int target)
+{
+        struct pcx_game_message message = PCX_GAME_DEFAULT_MESSAGE;
+
+        message.text = "test";
+        message.target = target;
+
+        for (int i = 0; i < n_messages; i++)
+                game_callbacks->send_message(&message, game_user_data);
+}
+
+static struct pcx_conversation *
+create_conversation(const struct pcx_config *config)
+{
+        struct pcx_conversation *conv =
+                pcx_conversation_new(config,
+                                     NULL, /* class_store */
+                                     &test_game,
+                                     PCX_TEXT_LANGUAGE_ENGLISH);
+
+        pcx_conversation_add_player(conv, "alice");
+        pcx_conversation_add_player(conv, "bob");
+        pcx_conversation_start(conv);
+
+        assert(conv->game);
+
+        return conv;
+}
+
+static void
+test_cursor_keeps_messages(const struct pcx_config *config)
+{
+        struct pcx_conversation *conv = create_conversation(config);
+        struct pcx_conversation_cursor cursor;
+
+        assert(pcx_conversation_seek_cursor(conv, &cursor, 0, 0) == 0);
+        pcx_conversation_add_cursor(conv, &cursor);
+
+        send_messages(200, -1);
+        test_time_hack_add_time(RETENTION * 2);
+        send_messages(1, -1);
+
+        /* Nothing can be released while the cursor is at the start */
+        assert(conv->first_message == 0);
+
+        for (uint64_t i = 2; i < conv->next_message; i++) {
+                const struct pcx_conversation_message *message =
+                        pcx_conversation_get_message(conv, i);
+                assert(message->length == 6);
+                assert(!memcmp(message->data + 1, "test", 5));
+        }
+
+        cursor.next_message = conv->next_message;
+        send_messages(1, -1);
+
+        /* Everything except the chunk that is still being filled can
+         * now be released.
+         */
+        assert(conv->first_message > 0);
+        assert(conv->next_message - conv->first_message <= 32);
+
+        pcx_conversation_remove_cursor(&cursor);
+        pcx_conversation_unref(conv);
+}
+
+static void
+test_retention(const struct pcx_config *config)
+{
+        struct pcx_conversation *conv = create_conversation(config);
+
+        send_messages(100, -1);
+
+        /* With no cursors the messages are still kept until they are
+         * older than the retention time.
+         */
+        assert(conv->first_message == 0);
+
+        test_time_hack_add_time(RETENTION / 2);
+        send_messages(100, -1);
+        assert(conv->first_message == 0);
+
+        test_time_hack_add_time(RETENTION / 2 + 1);
+        send_messages(1, -1);
+
+        /* Only the first batch is old enough */
+        assert(conv->first_message > 0);
+        assert(conv->first_message <= 102);
+
+        pcx_conversation_unref(conv);
+}
+
+static void
+test_resync(const struct pcx_config *config)
+{
+        struct pcx_conversation *conv = create_conversation(config);
+        struct pcx_conversation_cursor cursor;
+
+        /* The log starts with the public welcome messages */
+        int n_public = conv->next_message + 70;
+
+        send_messages(70, -1);
+        send_messages(30, 1);
+
+        test_time_hack_add_time(RETENTION + 1);
+        send_messages(1, -1);
+
+        uint64_t first_message = conv->first_message;
+        assert(first_message > 0);
+
+        /* Work out how many of the released messages each player
+         * could see.
+         */
+        int n_released[2] = { 0, 0 };
+
+        for (uint64_t i = 0; i < first_message; i++) {
+                int target = i < n_public ? -1 : 1;
+
+                for (int player = 0; player < 2; player++) {
+                        if (target == -1 || target == player)
+                                n_released[player]++;
+                }
+        }
+
+        for (int player = 0; player < 2; player++) {
+                /* A client that has seen nothing missed everything
+                 * that was released.
+                 */
+                assert(pcx_conversation_seek_cursor(conv,
+                                                    &cursor,
+                                                    player,
+                                                    0) ==
+                       n_released[player]);
+                assert(cursor.next_message == first_message);
+
+                /* A client that had seen everything up to the
+                 * released messages carries on from the first stored
+                 * message.
+                 */
+                assert(pcx_conversation_seek_cursor(conv,
+                                                    &cursor,
+                                                    player,
+                                                    n_released[player]) ==
+                       0);
+                assert(cursor.next_message == first_message);
+        }
+
+        /* Player 0 can’t see the private messages so it skips over
+         * them to the end.
+         */
+        assert(pcx_conversation_seek_cursor(conv,
+                                            &cursor,
+                                            0,
+                                            n_public + 1) == 0);
+        assert(cursor.next_message == conv->next_message);
+
+        assert(pcx_conversation_seek_cursor(conv,
+                                            &cursor,
+                                            1,
+                                            n_public + 31) == 0);
+        assert(cursor.next_message == conv->next_message);
+
+        pcx_conversation_unref(conv);
+}
+
+static void
+test_large_message(const struct pcx_config *config)
+{
+        struct pcx_conversation *conv = create_conversation(config);
+        struct pcx_game_message message = PCX_GAME_DEFAULT_MESSAGE;
+        const size_t text_length = PCX_SLAB_SIZE * 3;
+        char *text = pcx_alloc(text_length + 1);
+
+        memset(text, 'a', text_length);
+        text[text_length] = '\0';
+
+        message.text = text;
+
+        send_messages(1, -1);
+        game_callbacks->send_message(&message, game_user_data);
+        send_messages(1, -1);
+
+        const struct pcx_conversation_message *cmessage =
+                pcx_conversation_get_message(conv, conv->next_message - 2);
+
+        assert(cmessage->length == text_length + 2);
+        assert(!memcmp(cmessage->data + 1, text, text_length + 1));
+
+        cmessage = pcx_conversation_get_message(conv, conv->next_message - 1);
+        assert(!memcmp(cmessage->data + 1, "test", 5));
+
+        pcx_free(text);
+
+        pcx_conversation_unref(conv);
+}
+
+static void
+set_sideband_string(int data_num,
+                    const char *value)
+{
+        struct pcx_game_sideband_data data = {
+                .type = PCX_GAME_SIDEBAND_TYPE_STRING,
+                .string = value,
+        };
+
+        game_callbacks->set_sideband_data(data_num,
+                                          &data,
+                                          false, /* force */
+                                          game_user_data);
+}
+
+static void
+test_sideband_strings(const struct pcx_config *config)
+{
+        struct pcx_conversation *conv = create_conversation(config);
+        char value[1024];
+
+        /* Grow and shrink the strings across all of the size classes
+         * and past the largest one.
+         */
+        for (int length = 0; length < sizeof value; length += 7) {
+                for (int data_num = 0; data_num < 3; data_num++) {
+                        int this_length = (length * (data_num + 1)) %
+                                sizeof value;
+
+                        memset(value, 'a' + data_num, this_length);
+                        value[this_length] = '\0';
+
+                        set_sideband_string(data_num, value);
+
+                        struct pcx_conversation_sideband_data *data =
+                                pcx_conversation_get_sideband_data(conv,
+                                                                   data_num);
+
+                        assert(data->type == PCX_GAME_SIDEBAND_TYPE_STRING);
+                        assert(data->string->size > this_length);
+                        assert(!strcmp(data->string->text, value));
+                }
+        }
+
+        pcx_conversation_unref(conv);
+}
+
+static void
+set_sideband_array(int data_num,
+                   int start,
+                   int n_elements,
+                   const char * const *elements,
+                   int length)
+{
+        struct pcx_game_sideband_data data = {
+                .type = PCX_GAME_SIDEBAND_TYPE_ARRAY,
+                .array = {
+                        .start = start,
+                        .n_elements = n_elements,
+                        .elements = elements,
+                        .length = length,
+                },
+        };
+
+        game_callbacks->set_sideband_data(data_num,
+                                          &data,
+                                          false, /* force */
+                                          game_user_data);
+}
+
+static void
+check_array(struct pcx_conversation *conv,
+            int data_num,
+            int length,
+            const char * const *expected)
+{
+        struct pcx_conversation_sideband_data *data =
+                pcx_conversation_get_sideband_data(conv, data_num);
+
+        assert(data->type == PCX_GAME_SIDEBAND_TYPE_ARRAY);
+        assert(data->array->length == length);
+
+        for (int i = 0; i < length; i++) {
+                uint64_t version;
+                const char *value =
+                        pcx_conversation_get_sideband_array_element(data->array,
+                                                                    i,
+                                                                    &version);
+                assert(!strcmp(value, expected[i]));
+        }
+}
+
+static uint64_t
+get_element_version(struct pcx_conversation *conv,
+                    int data_num,
+                    int index)
+{
+        struct pcx_conversation_sideband_data *data =
+                pcx_conversation_get_sideband_data(conv, data_num);
+        uint64_t version;
+
+        pcx_conversation_get_sideband_array_element(data->array,
+                                                    index,
+                                                    &version);
+
+        return version;
+}
+
+static void
+test_sideband_array(const struct pcx_config *config)
+{
+        struct pcx_conversation *conv = create_conversation(config);
+
+        static const char * const words[] = {
+                "zero", "one", "two", "three",
+        };
+
+        set_sideband_array(3, 0, 4, words, -1);
+        check_array(conv, 3, 4, words);
+
+        /* Setting the same values doesn’t change the versions */
+        uint64_t version = conv->sideband_version;
+        set_sideband_array(3, 1, 2, words + 1, -1);
+        assert(conv->sideband_version == version);
+
+        /* Replacing one element only changes that element */
+        static const char * const replacement[] = { "deux" };
+        set_sideband_array(3, 2, 1, replacement, -1);
+        assert(conv->sideband_version == version + 1);
+        assert(get_element_version(conv, 3, 2) == version + 1);
+        assert(get_element_version(conv, 3, 1) <= version);
+
+        static const char * const expected[] = {
+                "zero", "one", "deux", "three",
+        };
+        check_array(conv, 3, 4, expected);
+
+        /* Writing past the end extends the array with empty
+         * elements
+         */
+        set_sideband_array(3, 6, 1, words, -1);
+
+        static const char * const extended[] = {
+                "zero", "one", "deux", "three", "", "", "zero",
+        };
+        check_array(conv, 3, 7, extended);
+
+        /* The length truncates the array */
+        set_sideband_array(3, 0, 0, NULL, 2);
+        check_array(conv, 3, 2, expected);
+
+        /* Elements beyond the length are ignored */
+        set_sideband_array(3, 1, 3, words + 1, 2);
+        check_array(conv, 3, 2, words);
+
+        /* Long elements are truncated without splitting a UTF-8
+         * sequence
+         */
+        char long_value[PCX_GAME_MAX_SIDEBAND_ARRAY_ELEMENT_LENGTH + 10];
+        const char *long_values[] = { long_value };
+
+        memset(long_value, 'a', sizeof long_value - 1);
+        long_value[sizeof long_value - 1] = '\0';
+        /* Put a two-byte character across the limit */
+        memcpy(long_value + PCX_GAME_MAX_SIDEBAND_ARRAY_ELEMENT_LENGTH - 1,
+               "ĉ",
+               2);
+
+        set_sideband_array(4, 0, 1, long_values, 1);
+
+        struct pcx_conversation_sideband_data *data =
+                pcx_conversation_get_sideband_data(conv, 4);
+        const char *value =
+                pcx_conversation_get_sideband_array_element(data->array,
+                                                            0,
+                                                            &version);
+        assert(strlen(value) == PCX_GAME_MAX_SIDEBAND_ARRAY_ELEMENT_LENGTH - 1);
+        assert(!memcmp(value, long_value, strlen(value)));
+
+        /* Changing the type replaces the array */
+        set_sideband_string(3, "string");
+        data = pcx_conversation_get_sideband_data(conv, 3);
+        assert(data->type == PCX_GAME_SIDEBAND_TYPE_STRING);
+
+        pcx_conversation_unref(conv);
+}
+
+struct sideband_event_listener {
+        struct pcx_listener listener;
+        int events[16];
+        int n_events;
+};
+
+static bool
+sideband_event_cb(struct pcx_listener *listener,
+                  void *user_data)
+{
+        struct sideband_event_listener *sl =
+                pcx_container_of(listener,
+                                 struct sideband_event_listener,
+                                 listener);
+        const struct pcx_conversation_event *event = user_data;
+
+        if (event->type != PCX_CONVERSATION_EVENT_SIDEBAND_DATA_MODIFIED)
+                return true;
+
+        const struct pcx_conversation_sideband_data_modified_event *me =
+                pcx_container_of(event,
+                                 struct
+                                 pcx_conversation_sideband_data_modified_event,
+                                 base);
+
+        assert(sl->n_events < PCX_N_ELEMENTS(sl->events));
+        sl->events[sl->n_events++] = me->data_num;
+
+        return true;
+}
+
+static void
+check_sideband_events(struct sideband_event_listener *sl,
+                      int n_events,
+                      ...)
+{
+        va_list ap;
+
+        assert(sl->n_events == n_events);
+
+        va_start(ap, n_events);
+
+        for (int i = 0; i < n_events; i++)
+                assert(sl->events[i] == va_arg(ap, int));
+
+        va_end(ap);
+
+        sl->n_events = 0;
+}
+
+static void
+test_sideband_coalescing(const struct pcx_config *config)
+{
+        struct pcx_config coalescing_config = *config;
+
+        coalescing_config.sideband_interval = 1000;
+
+        struct pcx_conversation *conv =
+                create_conversation(&coalescing_config);
+        struct sideband_event_listener sl = {
+                .listener = { .notify = sideband_event_cb },
+        };
+
+        pcx_signal_add(&conv->event_signal, &sl.listener);
+
+        /* The first change is sent straight away */
+        set_sideband_string(1, "a");
+        check_sideband_events(&sl, 1, 1);
+
+        /* Further changes within the interval are held back */
+        set_sideband_string(1, "ab");
+        set_sideband_string(1, "abc");
+        check_sideband_events(&sl, 0);
+
+        /* Other data has its own interval */
+        set_sideband_string(2, "x");
+        check_sideband_events(&sl, 1, 2);
+
+        /* Forcing data sends the pending data first to keep the order */
+        struct pcx_game_sideband_data byte_data = {
+                .type = PCX_GAME_SIDEBAND_TYPE_BYTE,
+                .byte = 7,
+        };
+        game_callbacks->set_sideband_data(3,
+                                          &byte_data,
+                                          true, /* force */
+                                          game_user_data);
+        check_sideband_events(&sl, 2, 1, 3);
+
+        /* Forcing the same value again still sends it */
+        game_callbacks->set_sideband_data(3,
+                                          &byte_data,
+                                          true, /* force */
+                                          game_user_data);
+        check_sideband_events(&sl, 1, 3);
+
+        /* The held back change is sent by the timeout */
+        set_sideband_string(1, "abcd");
+        check_sideband_events(&sl, 0);
+        assert(conv->sideband_timeout);
+
+        test_time_hack_add_time(1);
+        pcx_main_context_poll(NULL);
+
+        check_sideband_events(&sl, 1, 1);
+        assert(conv->sideband_timeout == NULL);
+
+        struct pcx_conversation_sideband_data *data =
+                pcx_conversation_get_sideband_data(conv, 1);
+        assert(!strcmp(data->string->text, "abcd"));
+
+        /* Leave a change pending to check that the timeout is
+         * removed with the conversation
+         */
+        set_sideband_string(1, "abcde");
+        check_sideband_events(&sl, 0);
+        assert(conv->sideband_timeout);
+
+        pcx_list_remove(&sl.listener.link);
+
+        pcx_conversation_unref(conv);
+}
+
+static void
+check_chat_message(struct pcx_conversation *conv,
+                   uint64_t message_num,
+                   int sending_player,
+                   const char *text)
+{
+        const struct pcx_conversation_message *message =
+                pcx_conversation_get_message(conv, message_num);
+
+        assert(message->sending_player == sending_player);
+        assert(message->length == strlen(text) + 2);
+        assert(!strcmp((const char *) message->data + 1, text));
+}
+
+static void
+test_chat(const struct pcx_config *config)
+{
+        struct pcx_config chat_config = *config;
+
+        chat_config.chat_rate = 60;
+        chat_config.chat_burst = 3;
+
+        struct pcx_conversation *conv = create_conversation(&chat_config);
+        uint64_t next_message = conv->next_message;
+
+        /* Messages in the same main loop iteration are merged */
+        pcx_conversation_add_chat_message(conv, 0, "one");
+        pcx_conversation_add_chat_message(conv, 0, "<two>");
+        assert(conv->next_message == next_message);
+
+        pcx_main_context_poll(NULL);
+
+        assert(conv->next_message == next_message + 1);
+        check_chat_message(conv, next_message++, 0,
+                           "<b>alice</b>\n\none\n&lt;two&gt;");
+        assert(conv->n_merged_chat_messages == 1);
+
+        /* The bucket is now empty so the next message is dropped */
+        pcx_conversation_add_chat_message(conv, 0, "three");
+        pcx_conversation_add_chat_message(conv, 0, "four");
+        assert(conv->n_dropped_chat_messages == 1);
+
+        /* A message from another player sends the pending one first */
+        pcx_conversation_add_chat_message(conv, 1, "five");
+        assert(conv->next_message == next_message + 1);
+        check_chat_message(conv, next_message++, 0,
+                           "<b>alice</b>\n\nthree");
+
+        /* So does a message from the game */
+        send_messages(1, -1);
+        assert(conv->next_message == next_message + 2);
+        check_chat_message(conv, next_message, 1, "<b>bob</b>\n\nfive");
+        next_message += 2;
+
+        /* The bucket refills over time */
+        test_time_hack_add_time(1);
+        pcx_conversation_add_chat_message(conv, 0, "six");
+        assert(conv->n_dropped_chat_messages == 1);
+
+        /* The merged length counts the text after escaping it */
+        char amps[101];
+
+        memset(amps, '&', sizeof amps - 1);
+        amps[sizeof amps - 1] = '\0';
+
+        test_time_hack_add_time(1);
+        pcx_conversation_add_chat_message(conv, 0, amps);
+        assert(conv->next_message == next_message + 1);
+        check_chat_message(conv, next_message++, 0,
+                           "<b>alice</b>\n\nsix");
+
+        struct pcx_conversation_chat_stats stats;
+        pcx_conversation_get_chat_stats(&stats);
+        assert(stats.n_dropped == 1);
+        assert(stats.n_merged == 1);
+
+        /* Leave the chat message pending to check that it gets
+         * cleaned up
+         */
+        pcx_conversation_unref(conv);
+}
+
+static void
+check_restored_sideband(struct pcx_conversation *conv)
+{
+        assert(conv->available_sideband_data == 0x0b);
+
+        struct pcx_conversation_sideband_data *data =
+                pcx_conversation_get_sideband_data(conv, 0);
+        assert(data->type == PCX_GAME_SIDEBAND_TYPE_STRING);
+        assert(!strcmp(data->string->text, "word"));
+
+        data = pcx_conversation_get_sideband_data(conv, 1);
+        assert(data->type == PCX_GAME_SIDEBAND_TYPE_UINT32);
+        assert(data->uint32 == 0xdeadbeef);
+
+        static const char * const words[] = { "one", "", "three" };
+
+        check_array(conv, 3, 3, words);
+}
+
+static void
+test_save_cached(const struct pcx_config *config)
+{
+        struct pcx_conversation *conv = create_conversation(config);
+        struct pcx_buffer a = PCX_BUFFER_STATIC_INIT;
+        struct pcx_buffer b = PCX_BUFFER_STATIC_INIT;
+
+        send_messages(3, -1);
+
+        pcx_conversation_save_cached(conv, &a, 10);
+        pcx_conversation_save(conv, &b);
+        assert(a.length == b.length && !memcmp(a.data, b.data, a.length));
+
+        /* Nothing has changed so the data is reused even though the
+         * ages would be different now.
+         */
+        uint64_t save_time = conv->saved_state_time;
+
+        test_time_hack_add_time(1);
+        pcx_buffer_set_length(&a, 0);
+        pcx_conversation_save_cached(conv, &a, UINT64_MAX);
+        assert(conv->saved_state_time == save_time);
+        assert(a.length == b.length && !memcmp(a.data, b.data, a.length));
+
+        /* Unless it is too old */
+        pcx_buffer_set_length(&a, 0);
+        pcx_conversation_save_cached(conv, &a, 10);
+        assert(conv->saved_state_time > save_time);
+
+        /* A new message is an event so the data is made again */
+        save_time = conv->saved_state_time;
+        send_messages(1, -1);
+        assert(!conv->saved_state_valid);
+        pcx_buffer_set_length(&a, 0);
+        pcx_conversation_save_cached(conv, &a, UINT64_MAX);
+        assert(conv->saved_state_valid);
+        pcx_buffer_set_length(&b, 0);
+        pcx_conversation_save(conv, &b);
+        assert(a.length == b.length && !memcmp(a.data, b.data, a.length));
+
+        pcx_buffer_destroy(&a);
+        pcx_buffer_destroy(&b);
+        pcx_conversation_unref(conv);
+}
+
+static void
+test_snapshot(const struct pcx_config *config)
+{
+        struct pcx_conversation *conv = create_conversation(config);
+
+        send_messages(100, -1);
+        send_messages(10, 1);
+        test_time_hack_add_time(RETENTION * 2);
+        send_messages(1, 0);
+
+        set_sideband_string(0, "word");
+
+        struct pcx_game_sideband_data data = {
+                .type = PCX_GAME_SIDEBAND_TYPE_UINT32,
+                .uint32 = 0xdeadbeef,
+        };
+        game_callbacks->set_sideband_data(1,
+                                          &data,
+                                          false, /* force */
+                                          game_user_data);
+
+        static const char * const words[] = { "one", "", "three" };
+        set_sideband_array(3, 0, 3, words, -1);
+
+        /* Chat that is still waiting to be sent should be saved
+         * without sending it.
+         */
+        pcx_conversation_add_chat_message(conv, 1, "hi");
+
+        assert(pcx_conversation_can_save(conv));
+
+        struct pcx_buffer buf = PCX_BUFFER_STATIC_INIT;
+
+        pcx_conversation_save(conv, &buf);
+
+        assert(conv->first_message > 0);
+        assert(conv->pending_chat_player == 1);
+
+        struct pcx_snapshot_reader reader;
+
+        pcx_snapshot_reader_init(&reader, buf.data, buf.length);
+
+        struct pcx_conversation *restored =
+                pcx_conversation_restore(config,
+                                         NULL, /* class_store */
+                                         test_game_list,
+                                         &reader);
+
+        assert(restored);
+        assert(reader.pos == buf.length);
+        assert(restored->started);
+        assert(restored->game);
+        assert(restored->n_players == 2);
+        assert(!strcmp(pcx_conversation_get_player_name(restored, 1), "bob"));
+        assert(restored->first_message == conv->first_message);
+        assert(restored->next_message == conv->next_message);
+
+        for (uint64_t i = conv->first_message; i < conv->next_message; i++) {
+                const struct pcx_conversation_message *a =
+                        pcx_conversation_get_message(conv, i);
+                const struct pcx_conversation_message *b =
+                        pcx_conversation_get_message(restored, i);
+
+                assert(a->target_player == b->target_player);
+                assert(a->sending_player == b->sending_player);
+                assert(a->length == b->length);
+                assert(!memcmp(a->data, b->data, a->length));
+        }
+
+        /* A reconnecting player should pick up at the same place */
+        for (int player = 0; player < 2; player++) {
+                struct pcx_conversation_cursor a, b;
+
+                assert(pcx_conversation_seek_cursor(conv, &a, player, 50) ==
+                       pcx_conversation_seek_cursor(restored, &b, player, 50));
+                assert(a.next_message == b.next_message);
+        }
+
+        check_restored_sideband(restored);
+
+        assert(restored->pending_chat_player == 1);
+        assert(!strcmp((const char *) restored->pending_chat.data,
+                       (const char *) conv->pending_chat.data));
+
+        pcx_conversation_unref(restored);
+
+        /* Truncated data should never be accepted */
+        for (size_t length = 0; length < buf.length; length++) {
+                pcx_snapshot_reader_init(&reader, buf.data, length);
+                assert(pcx_conversation_restore(config,
+                                                NULL, /* class_store */
+                                                test_game_list,
+                                                &reader) == NULL);
+        }
+
+        pcx_buffer_destroy(&buf);
+        pcx_conversation_unref(conv);
+}
+
+int
+main(int argc, char **argv)
+{
+        struct pcx_config config = {
+                .message_retention = RETENTION,
+        };
+
+        test_cursor_keeps_messages(&config);
+        test_retention(&config);
+        test_resync(&config);
+        test_large_message(&config);
+        test_sideband_strings(&config);
+        test_sideband_array(&config);
+        test_sideband_coalescing(&config);
+        test_chat(&config);
+        test_save_cached(&config);
+        test_snapshot(&config);
+
+        pcx_main_context_free(pcx_main_context_get_default());
+
+        return EXIT_SUCCESS;
+}
@@ -306,6 +306,9 @@ handle_message_type(struct test_data *data,
         case TEST_MESSAGE_TYPE_SIDEBAND_STRING:
                 assert(!"sideband string arg used");
                 return;
+        case TEST_MESSAGE_TYPE_SIDEBAND_ARRAY:
+                assert(!"sideband array arg used");
+                return;
         case TEST_MESSAGE_TYPE_GAME_OVER:
                 return;
         }
@@ -3207,6 +3210,125 @@ done:
         return ret;
 }
 
+static bool
+restore_snapshot(struct test_data *data)
+{
+        struct pcx_buffer buf = PCX_BUFFER_STATIC_INIT;
+
+        pcx_coup_game.snapshot_cb(data->coup, &buf);
+
+        struct pcx_snapshot_reader reader;
+
+        pcx_snapshot_reader_init(&reader, buf.data, buf.length);
+
+        struct pcx_coup *restored =
+                pcx_coup_game.restore_cb(NULL, /* config */
+                                         &test_message_callbacks,
+                                         &data->message_data,
+                                         PCX_TEXT_LANGUAGE_ESPERANTO,
+                                         data->n_players,
+                                         test_message_player_names,
+                                         &reader);
+
+        bool ret = true;
+
+        if (restored == NULL) {
+                fprintf(stderr, "Restoring the snapshot failed\n");
+                ret = false;
+        } else {
+                struct pcx_buffer second_buf = PCX_BUFFER_STATIC_INIT;
+
+                pcx_coup_game.snapshot_cb(restored, &second_buf);
+
+                if (second_buf.length != buf.length ||
+                    memcmp(second_buf.data, buf.data, buf.length)) {
+                        fprintf(stderr,
+                                "Restored snapshot doesn’t match\n");
+                        ret = false;
+                }
+
+                pcx_buffer_destroy(&second_buf);
+
+                pcx_coup_game.free_game_cb(data->coup);
+                data->coup = restored;
+        }
+
+        /* Truncated data shouldn’t be accepted */
+        if (ret) {
+                pcx_snapshot_reader_init(&reader, buf.data, buf.length - 1);
+
+                struct pcx_coup *truncated =
+                        pcx_coup_game.restore_cb(NULL, /* config */
+                                                 &test_message_callbacks,
+                                                 &data->message_data,
+                                                 PCX_TEXT_LANGUAGE_ESPERANTO,
+                                                 data->n_players,
+                                                 test_message_player_names,
+                                                 &reader);
+
+                if (truncated) {
+                        fprintf(stderr,
+                                "Truncated snapshot was restored\n");
+                        pcx_coup_game.free_game_cb(truncated);
+                        ret = false;
+                }
+        }
+
+        pcx_buffer_destroy(&buf);
+
+        return ret;
+}
+
+static bool
+test_snapshot(void)
+{
+        struct test_data *data = set_up_tax();
+
+        if (data == NULL)
+                return false;
+
+        bool ret;
+
+        ret = challenge_tax(data);
+        if (!ret)
+                goto done;
+
+        /* Restore while Bob is choosing which card to reveal */
+        ret = restore_snapshot(data);
+        if (!ret)
+                goto done;
+
+        data->status.players[1].cards[1].dead = true;
+        data->status.current_player = 0;
+
+        ret = send_callback_data(data,
+                                 1,
+                                 "reveal:1",
+                                 TEST_MESSAGE_TYPE_GLOBAL,
+                                 "Alice defiis kaj Bob ne havis la dukon kaj "
+                                 "Bob perdas karton",
+                                 ARG_TYPE_SHOW_CARDS,
+                                 1,
+                                 ARG_TYPE_STATUS,
+                                 -1);
+        if (!ret)
+                goto done;
+
+        /* Restore at the start of a turn */
+        ret = restore_snapshot(data);
+        if (!ret)
+                goto done;
+
+        ret = take_income(data);
+        if (!ret)
+                goto done;
+
+done:
+        free_test_data(data);
+
+        return ret;
+}
+
 int
 main(int argc, char **argv)
 {
@@ -3222,7 +3344,8 @@ main(int argc, char **argv)
             !test_exchange_inspector() ||
             !test_inspect() ||
             !test_reformation() ||
-            !test_max_players())
+            !test_max_players() ||
+            !test_snapshot())
                 ret = EXIT_FAILURE;
 
         pcx_main_context_free(pcx_main_context_get_default());
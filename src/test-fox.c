@@ -28,6 +28,8 @@
 #include "pcx-fox.h"
 #include "pcx-list.h"
 #include "pcx-main-context.h"
+#include "pcx-snapshot.h"
+#include "pcx-buffer.h"
 #include "test-message.h"
 
 #define FIRST_ARG_TYPE 1000
@@ -270,6 +272,9 @@ handle_message_type(struct test_data *data,
         case TEST_MESSAGE_TYPE_SIDEBAND_STRING:
                 assert(!"sideband string arg used");
                 return;
+        case TEST_MESSAGE_TYPE_SIDEBAND_ARRAY:
+                assert(!"sideband array arg used");
+                return;
         case TEST_MESSAGE_TYPE_GAME_OVER:
                 return;
         }
@@ -1901,6 +1906,104 @@ out:
         return ret;
 }
 
+static bool
+test_snapshot(void)
+{
+        struct test_data *data = create_test_data();
+
+        bool ret = true;
+
+        ret = make_alice_lead(data);
+
+        if (!ret)
+                goto out;
+
+        struct pcx_buffer buf = PCX_BUFFER_STATIC_INIT;
+
+        pcx_fox_game.snapshot_cb(data->fox, &buf);
+
+        struct pcx_snapshot_reader reader;
+
+        pcx_snapshot_reader_init(&reader, buf.data, buf.length);
+
+        struct pcx_fox *restored =
+                pcx_fox_game.restore_cb(NULL, /* config */
+                                        &test_message_callbacks,
+                                        &data->message_data,
+                                        PCX_TEXT_LANGUAGE_ESPERANTO,
+                                        2, /* n_players */
+                                        test_message_player_names,
+                                        &reader);
+
+        if (restored == NULL) {
+                fprintf(stderr, "Restoring the snapshot failed\n");
+                ret = false;
+        } else {
+                struct pcx_buffer second_buf = PCX_BUFFER_STATIC_INIT;
+
+                pcx_fox_game.snapshot_cb(restored, &second_buf);
+
+                if (second_buf.length != buf.length ||
+                    memcmp(second_buf.data, buf.data, buf.length)) {
+                        fprintf(stderr,
+                                "Restored snapshot doesn’t match\n");
+                        ret = false;
+                }
+
+                pcx_buffer_destroy(&second_buf);
+
+                pcx_fox_game.free_game_cb(data->fox);
+                data->fox = restored;
+        }
+
+        /* Truncated data shouldn’t be accepted */
+        if (ret) {
+                pcx_snapshot_reader_init(&reader, buf.data, buf.length - 1);
+
+                struct pcx_fox *truncated =
+                        pcx_fox_game.restore_cb(NULL, /* config */
+                                                &test_message_callbacks,
+                                                &data->message_data,
+                                                PCX_TEXT_LANGUAGE_ESPERANTO,
+                                                2, /* n_players */
+                                                test_message_player_names,
+                                                &reader);
+
+                if (truncated) {
+                        fprintf(stderr,
+                                "Truncated snapshot was restored\n");
+                        pcx_fox_game.free_game_cb(truncated);
+                        ret = false;
+                }
+        }
+
+        pcx_buffer_destroy(&buf);
+
+        if (!ret)
+                goto out;
+
+        /* The restored game should carry on from where it left off */
+        remove_card_from_hand(data->players + 0, 2, 2);
+
+        ret = send_callback_data(data,
+                                 0,
+                                 "play:34", /* 2 moons */
+                                 TEST_MESSAGE_TYPE_GLOBAL,
+                                 "Alice ludis: 🌜2",
+                                 TEST_MESSAGE_TYPE_GLOBAL,
+                                 "Nun Bob elektas kiun karton ludi.",
+                                 ARG_TYPE_UNLIMITED_FOLLOW_CHOICE,
+                                 1,
+                                 -1);
+        if (!ret)
+                goto out;
+
+out:
+        free_test_data(data);
+
+        return ret;
+}
+
 int
 main(int argc, char **argv)
 {
@@ -1914,7 +2017,8 @@ main(int argc, char **argv)
             !test_become_trump_lead_suit() ||
             !test_two_become_trumps() ||
             !test_force_best_card() ||
-            !test_full_game())
+            !test_full_game() ||
+            !test_snapshot())
                 ret = EXIT_FAILURE;
 
         pcx_main_context_free(pcx_main_context_get_default());
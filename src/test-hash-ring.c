@@ -0,0 +1,144 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "pcx-hash-ring.h"
+#include "pcx-util.h"
+
+#define N_KEYS 10000
+
+static const char * const
+node_names[] = {
+        "127.0.0.1:3650",
+        "127.0.0.1:3651",
+        "127.0.0.1:3652",
+        "127.0.0.1:3653",
+        "127.0.0.1:3654",
+};
+
+static uint64_t
+get_key(int i)
+{
+        return pcx_hash_uint64(i);
+}
+
+static void
+test_empty(void)
+{
+        struct pcx_hash_ring *ring = pcx_hash_ring_new();
+
+        assert(pcx_hash_ring_lookup(ring, 12) == -1);
+
+        pcx_hash_ring_free(ring);
+}
+
+static void
+test_distribution(void)
+{
+        struct pcx_hash_ring *ring = pcx_hash_ring_new();
+        int counts[4] = { 0 };
+
+        for (int i = 0; i < PCX_N_ELEMENTS(counts); i++)
+                pcx_hash_ring_add_node(ring, i, node_names[i]);
+
+        for (int i = 0; i < N_KEYS; i++) {
+                int node = pcx_hash_ring_lookup(ring, get_key(i));
+                assert(node >= 0 && node < PCX_N_ELEMENTS(counts));
+                counts[node]++;
+        }
+
+        /* Each node should get roughly a quarter of the keys */
+        for (int i = 0; i < PCX_N_ELEMENTS(counts); i++) {
+                assert(counts[i] > N_KEYS / 8);
+                assert(counts[i] < N_KEYS / 2);
+        }
+
+        pcx_hash_ring_free(ring);
+}
+
+static void
+test_order(void)
+{
+        struct pcx_hash_ring *a = pcx_hash_ring_new();
+        struct pcx_hash_ring *b = pcx_hash_ring_new();
+
+        /* The same nodes added in a different order should give the
+         * same results.
+         */
+        for (int i = 0; i < 4; i++) {
+                pcx_hash_ring_add_node(a, i, node_names[i]);
+                pcx_hash_ring_add_node(b, 3 - i, node_names[3 - i]);
+        }
+
+        for (int i = 0; i < N_KEYS; i++) {
+                assert(pcx_hash_ring_lookup(a, get_key(i)) ==
+                       pcx_hash_ring_lookup(b, get_key(i)));
+        }
+
+        pcx_hash_ring_free(b);
+        pcx_hash_ring_free(a);
+}
+
+static void
+test_add_node(void)
+{
+        struct pcx_hash_ring *ring = pcx_hash_ring_new();
+        int before[N_KEYS];
+        int n_moved = 0;
+
+        for (int i = 0; i < 4; i++)
+                pcx_hash_ring_add_node(ring, i, node_names[i]);
+
+        for (int i = 0; i < N_KEYS; i++)
+                before[i] = pcx_hash_ring_lookup(ring, get_key(i));
+
+        pcx_hash_ring_add_node(ring, 4, node_names[4]);
+
+        for (int i = 0; i < N_KEYS; i++) {
+                int node = pcx_hash_ring_lookup(ring, get_key(i));
+
+                /* Keys either stay where they were or move to the
+                 * new node.
+                 */
+                if (node != before[i]) {
+                        assert(node == 4);
+                        n_moved++;
+                }
+        }
+
+        /* About a fifth of the keys should move */
+        assert(n_moved > N_KEYS / 10);
+        assert(n_moved < N_KEYS * 2 / 5);
+
+        pcx_hash_ring_free(ring);
+}
+
+int
+main(int argc, char **argv)
+{
+        test_empty();
+        test_distribution();
+        test_order();
+        test_add_node();
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,349 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "pcx-lobby.h"
+#include "pcx-main-context.h"
+#include "pcx-buffer.h"
+#include "pcx-proto.h"
+#include "test-time-hack.h"
+
+struct batch_listener {
+        struct pcx_listener listener;
+        int n_batches;
+        struct pcx_buffer commands;
+};
+
+static const struct pcx_game
+test_game = {
+        .name = "test",
+};
+
+/* Appends a short description of each command in the batch */
+static void
+describe_batch(struct pcx_buffer *buf,
+               const struct pcx_lobby_batch *batch)
+{
+        size_t pos = 0;
+
+        while (pos < batch->length) {
+                /* All of the lobby commands are short */
+                assert(batch->data[pos] == 0x82);
+                size_t length = batch->data[pos + 1];
+                assert(length < 126);
+                const uint8_t *payload = batch->data + pos + 2;
+                uint64_t id;
+                const char *name, *language;
+                uint8_t n_players;
+                uint32_t age;
+
+                switch (payload[0]) {
+                case PCX_PROTO_LOBBY_RESET:
+                        assert(length == 1);
+                        pcx_buffer_append_string(buf, "x ");
+                        break;
+
+                case PCX_PROTO_LOBBY_GAME: {
+                        bool ret = pcx_proto_read_payload(payload + 1,
+                                                          length - 1,
+
+                                                          PCX_PROTO_TYPE_UINT64,
+                                                          &id,
+
+                                                          PCX_PROTO_TYPE_STRING,
+                                                          &name,
+
+                                                          PCX_PROTO_TYPE_STRING,
+                                                          &language,
+
+                                                          PCX_PROTO_TYPE_UINT8,
+                                                          &n_players,
+
+                                                          PCX_PROTO_TYPE_UINT32,
+                                                          &age,
+
+                                                          PCX_PROTO_TYPE_NONE);
+                        assert(ret);
+                        assert(!strcmp(name, "test"));
+                        assert(!strcmp(language, "en"));
+                        pcx_buffer_append_printf(buf,
+                                                 "g%" PRIu64 ",%i,%" PRIu32 " ",
+                                                 id,
+                                                 n_players,
+                                                 age);
+                        break;
+                }
+
+                case PCX_PROTO_LOBBY_GAME_REMOVED: {
+                        bool ret = pcx_proto_read_payload(payload + 1,
+                                                          length - 1,
+
+                                                          PCX_PROTO_TYPE_UINT64,
+                                                          &id,
+
+                                                          PCX_PROTO_TYPE_NONE);
+                        assert(ret);
+                        pcx_buffer_append_printf(buf, "r%" PRIu64 " ", id);
+                        break;
+                }
+
+                default:
+                        assert(!"unexpected lobby command");
+                }
+
+                pos += length + 2;
+        }
+
+        assert(pos == batch->length);
+}
+
+static bool
+batch_cb(struct pcx_listener *listener,
+         void *data)
+{
+        struct batch_listener *bl =
+                pcx_container_of(listener, struct batch_listener, listener);
+
+        bl->n_batches++;
+        describe_batch(&bl->commands, data);
+
+        return true;
+}
+
+static void
+add_listener(struct pcx_lobby *lobby,
+             struct batch_listener *bl)
+{
+        bl->n_batches = 0;
+        pcx_buffer_init(&bl->commands);
+        bl->listener.notify = batch_cb;
+        pcx_signal_add(pcx_lobby_get_batch_signal(lobby), &bl->listener);
+}
+
+static void
+check_commands(struct batch_listener *bl,
+               const char *expected)
+{
+        pcx_buffer_append_c(&bl->commands, '\0');
+        assert(!strcmp((const char *) bl->commands.data, expected));
+        bl->commands.length = 0;
+}
+
+static void
+remove_listener(struct batch_listener *bl)
+{
+        pcx_list_remove(&bl->listener.link);
+        pcx_buffer_destroy(&bl->commands);
+}
+
+static void
+test_batching(void)
+{
+        struct pcx_lobby *lobby = pcx_lobby_new();
+        struct batch_listener bl;
+
+        add_listener(lobby, &bl);
+
+        struct pcx_lobby_game *a =
+                pcx_lobby_add_game(lobby,
+                                   1,
+                                   &test_game,
+                                   PCX_TEXT_LANGUAGE_ENGLISH,
+                                   1);
+
+        /* The first batch can be sent straight away */
+        pcx_main_context_poll(NULL);
+        assert(bl.n_batches == 1);
+        check_commands(&bl, "g1,1,0 ");
+
+        /* Several changes within the interval make a single batch */
+        pcx_lobby_set_n_players(lobby, a, 2);
+        pcx_lobby_set_n_players(lobby, a, 3);
+
+        struct pcx_lobby_game *b =
+                pcx_lobby_add_game(lobby,
+                                   2,
+                                   &test_game,
+                                   PCX_TEXT_LANGUAGE_ENGLISH,
+                                   1);
+        struct pcx_lobby_game *c =
+                pcx_lobby_add_game(lobby,
+                                   3,
+                                   &test_game,
+                                   PCX_TEXT_LANGUAGE_ENGLISH,
+                                   1);
+
+        /* The subscribers never hear about a game that is removed
+         * before the batch is sent.
+         */
+        pcx_lobby_remove_game(lobby, c);
+
+        test_time_hack_add_time(1);
+        pcx_main_context_poll(NULL);
+        assert(bl.n_batches == 2);
+        check_commands(&bl, "g1,3,1 g2,1,1 ");
+
+        pcx_lobby_remove_game(lobby, a);
+
+        /* The snapshot describes the current state */
+        struct pcx_lobby_batch *snapshot = pcx_lobby_get_snapshot(lobby);
+        describe_batch(&bl.commands, snapshot);
+        check_commands(&bl, "x g2,1,1 ");
+        pcx_lobby_batch_unref(snapshot);
+
+        test_time_hack_add_time(1);
+        pcx_main_context_poll(NULL);
+        assert(bl.n_batches == 3);
+        check_commands(&bl, "r1 ");
+
+        pcx_lobby_remove_game(lobby, b);
+
+        remove_listener(&bl);
+
+        pcx_lobby_free(lobby);
+}
+
+static void
+test_no_subscribers(void)
+{
+        struct pcx_lobby *lobby = pcx_lobby_new();
+
+        struct pcx_lobby_game *a =
+                pcx_lobby_add_game(lobby,
+                                   1,
+                                   &test_game,
+                                   PCX_TEXT_LANGUAGE_ENGLISH,
+                                   1);
+        pcx_lobby_add_game(lobby,
+                           2,
+                           &test_game,
+                           PCX_TEXT_LANGUAGE_ENGLISH,
+                           2);
+
+        test_time_hack_add_time(1);
+        pcx_main_context_poll(NULL);
+
+        struct batch_listener bl;
+
+        add_listener(lobby, &bl);
+
+        struct pcx_lobby_batch *snapshot = pcx_lobby_get_snapshot(lobby);
+        describe_batch(&bl.commands, snapshot);
+        check_commands(&bl, "x g1,1,1 g2,2,1 ");
+
+        /* The snapshot is shared until something changes */
+        struct pcx_lobby_batch *other = pcx_lobby_get_snapshot(lobby);
+        assert(other == snapshot);
+        pcx_lobby_batch_unref(other);
+
+        pcx_lobby_remove_game(lobby, a);
+
+        other = pcx_lobby_get_snapshot(lobby);
+        assert(other != snapshot);
+        pcx_lobby_batch_unref(other);
+        pcx_lobby_batch_unref(snapshot);
+
+        test_time_hack_add_time(1);
+        pcx_main_context_poll(NULL);
+        assert(bl.n_batches == 1);
+        check_commands(&bl, "r1 ");
+
+        remove_listener(&bl);
+
+        /* Freeing the lobby frees the remaining game */
+        pcx_lobby_free(lobby);
+}
+
+static void
+test_unsent_games(void)
+{
+        struct pcx_lobby *lobby = pcx_lobby_new();
+        struct batch_listener bl;
+
+        add_listener(lobby, &bl);
+
+        struct pcx_lobby_game *a =
+                pcx_lobby_add_game(lobby,
+                                   1,
+                                   &test_game,
+                                   PCX_TEXT_LANGUAGE_ENGLISH,
+                                   1);
+
+        /* A game that hasn’t been in a batch yet isn’t in the
+         * snapshot because nobody would be told if it was removed
+         * before the batch.
+         */
+        struct pcx_lobby_batch *snapshot = pcx_lobby_get_snapshot(lobby);
+        describe_batch(&bl.commands, snapshot);
+        check_commands(&bl, "x ");
+        pcx_lobby_batch_unref(snapshot);
+
+        pcx_lobby_remove_game(lobby, a);
+
+        struct pcx_lobby_game *b =
+                pcx_lobby_add_game(lobby,
+                                   2,
+                                   &test_game,
+                                   PCX_TEXT_LANGUAGE_ENGLISH,
+                                   1);
+
+        snapshot = pcx_lobby_get_snapshot(lobby);
+        describe_batch(&bl.commands, snapshot);
+        check_commands(&bl, "x ");
+
+        pcx_main_context_poll(NULL);
+        assert(bl.n_batches == 1);
+        check_commands(&bl, "g2,1,0 ");
+
+        /* The game is in the snapshot once it has been sent */
+        struct pcx_lobby_batch *other = pcx_lobby_get_snapshot(lobby);
+        assert(other != snapshot);
+        describe_batch(&bl.commands, other);
+        check_commands(&bl, "x g2,1,0 ");
+        pcx_lobby_batch_unref(other);
+        pcx_lobby_batch_unref(snapshot);
+
+        pcx_lobby_remove_game(lobby, b);
+
+        test_time_hack_add_time(1);
+        pcx_main_context_poll(NULL);
+        assert(bl.n_batches == 2);
+        check_commands(&bl, "r2 ");
+
+        remove_listener(&bl);
+
+        pcx_lobby_free(lobby);
+}
+
+int
+main(int argc, char **argv)
+{
+        test_batching();
+        test_no_subscribers();
+        test_unsent_games();
+
+        pcx_main_context_free(pcx_main_context_get_default());
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,234 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "pcx-matchmaker.h"
+#include "pcx-main-context.h"
+#include "test-time-hack.h"
+
+#define AUTO_START_DELAY 30
+
+static void *
+create_game_cb(const struct pcx_config *config,
+               const struct pcx_game_callbacks *callbacks,
+               void *user_data,
+               enum pcx_text_language language,
+               int n_players,
+               const char * const *names)
+{
+        return pcx_alloc(1);
+}
+
+static void
+free_game_cb(void *game)
+{
+        pcx_free(game);
+}
+
+static const struct pcx_game
+test_game = {
+        .name = "test",
+        .min_players = 2,
+        .max_players = 4,
+        .create_game_cb = create_game_cb,
+        .free_game_cb = free_game_cb,
+};
+
+struct test_lobby {
+        struct pcx_conversation *conversation;
+        struct pcx_matchmaker_lobby *lobby;
+        struct pcx_listener listener;
+};
+
+static bool
+conversation_event_cb(struct pcx_listener *listener,
+                      void *data)
+{
+        struct test_lobby *tl =
+                pcx_container_of(listener, struct test_lobby, listener);
+        const struct pcx_conversation_event *event = data;
+
+        /* This does the same as the server */
+        switch (event->type) {
+        case PCX_CONVERSATION_EVENT_STARTED:
+                pcx_matchmaker_lobby_started(tl->lobby);
+                pcx_matchmaker_remove_lobby(tl->lobby);
+                tl->lobby = NULL;
+                break;
+        case PCX_CONVERSATION_EVENT_PLAYER_ADDED:
+                pcx_matchmaker_player_added(tl->lobby);
+                break;
+        default:
+                break;
+        }
+
+        return true;
+}
+
+static void
+create_lobby(struct test_lobby *tl,
+             struct pcx_matchmaker *matchmaker,
+             int n_players)
+{
+        tl->conversation = pcx_conversation_new(NULL, /* config */
+                                                NULL, /* class_store */
+                                                &test_game,
+                                                PCX_TEXT_LANGUAGE_ENGLISH);
+        tl->lobby = pcx_matchmaker_add_lobby(matchmaker, tl->conversation);
+        tl->listener.notify = conversation_event_cb;
+        pcx_signal_add(&tl->conversation->event_signal, &tl->listener);
+
+        for (int i = 0; i < n_players; i++)
+                pcx_conversation_add_player(tl->conversation, "player");
+}
+
+static void
+free_lobby(struct test_lobby *tl)
+{
+        if (tl->lobby)
+                pcx_matchmaker_remove_lobby(tl->lobby);
+
+        pcx_list_remove(&tl->listener.link);
+
+        pcx_conversation_unref(tl->conversation);
+}
+
+static void
+test_routing(const struct pcx_config *config)
+{
+        struct pcx_matchmaker *matchmaker = pcx_matchmaker_new(config);
+        struct test_lobby empty, one, three;
+
+        create_lobby(&empty, matchmaker, 0);
+        create_lobby(&one, matchmaker, 1);
+
+        /* The lobby with one player only needs one more */
+        assert(pcx_matchmaker_is_better(one.lobby, empty.lobby));
+        assert(!pcx_matchmaker_is_better(empty.lobby, one.lobby));
+        assert(pcx_matchmaker_is_better(empty.lobby, NULL));
+
+        /* A player that fills a lobby starts it straight away */
+        create_lobby(&three, matchmaker, 3);
+        assert(pcx_matchmaker_is_better(three.lobby, one.lobby));
+
+        /* Lobbies that are expected to start at the same time go in
+         * order of age.
+         */
+        struct test_lobby other_one;
+        test_time_hack_add_time(1);
+        create_lobby(&other_one, matchmaker, 1);
+        assert(pcx_matchmaker_is_better(one.lobby, other_one.lobby));
+        assert(!pcx_matchmaker_is_better(other_one.lobby, one.lobby));
+
+        /* A lobby that has been ready for a while starts sooner than
+         * one that only becomes ready with the new player.
+         */
+        pcx_conversation_add_player(other_one.conversation, "player");
+        test_time_hack_add_time(AUTO_START_DELAY / 2);
+        assert(pcx_matchmaker_is_better(other_one.lobby, one.lobby));
+
+        free_lobby(&other_one);
+        free_lobby(&three);
+        free_lobby(&one);
+        free_lobby(&empty);
+
+        pcx_matchmaker_free(matchmaker);
+}
+
+static void
+test_auto_start(const struct pcx_config *config)
+{
+        struct pcx_matchmaker *matchmaker = pcx_matchmaker_new(config);
+        struct test_lobby tl;
+
+        create_lobby(&tl, matchmaker, 1);
+
+        test_time_hack_add_time(10);
+
+        pcx_conversation_add_player(tl.conversation, "player");
+        assert(!tl.conversation->started);
+
+        test_time_hack_add_time(AUTO_START_DELAY);
+        pcx_main_context_poll(NULL);
+
+        assert(tl.conversation->started);
+        assert(tl.lobby == NULL);
+
+        struct pcx_matchmaker_time_to_game stats;
+
+        pcx_matchmaker_get_time_to_game(matchmaker, &stats);
+
+        assert(stats.n_samples == 2);
+        assert(stats.p50 / 1000000 == AUTO_START_DELAY);
+        assert(stats.p90 / 1000000 == AUTO_START_DELAY + 10);
+        assert(stats.p99 == stats.p90);
+
+        free_lobby(&tl);
+
+        pcx_matchmaker_free(matchmaker);
+}
+
+static void
+test_stall(void)
+{
+        struct pcx_config config = {
+                .auto_start_delay = 0,
+        };
+        struct pcx_matchmaker *matchmaker = pcx_matchmaker_new(&config);
+        struct test_lobby ready, empty;
+
+        create_lobby(&ready, matchmaker, 2);
+        create_lobby(&empty, matchmaker, 0);
+
+        assert(pcx_matchmaker_is_better(ready.lobby, empty.lobby));
+
+        /* Nobody presses start so the lobby is eventually given up
+         * on and new players go to the other one.
+         */
+        test_time_hack_add_time(120);
+        assert(!pcx_matchmaker_is_better(ready.lobby, empty.lobby));
+        assert(!pcx_matchmaker_is_better(ready.lobby, NULL));
+        assert(pcx_matchmaker_is_better(empty.lobby, ready.lobby));
+
+        assert(!ready.conversation->started);
+
+        free_lobby(&empty);
+        free_lobby(&ready);
+
+        pcx_matchmaker_free(matchmaker);
+}
+
+int
+main(int argc, char **argv)
+{
+        struct pcx_config config = {
+                .auto_start_delay = AUTO_START_DELAY,
+        };
+
+        test_routing(&config);
+        test_auto_start(&config);
+        test_stall();
+
+        pcx_main_context_free(pcx_main_context_get_default());
+
+        return EXIT_SUCCESS;
+}
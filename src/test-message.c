@@ -26,6 +26,7 @@
 
 #include "pcx-main-context.h"
 #include "pcx-game.h"
+#include "pcx-buffer.h"
 
 const char *const
 test_message_player_names[] = {
@@ -236,26 +237,17 @@ handle_public_message(struct test_message_data *data,
 }
 
 static void
-set_sideband_data_cb(int data_num,
-                     const struct pcx_game_sideband_data *value,
-                     bool force,
-                     void *user_data)
+check_sideband_data(struct test_message_data *data,
+                    int data_num,
+                    enum test_message_type type,
+                    const char *value,
+                    bool force)
 {
-        struct test_message_data *data = user_data;
-
-        if (value->type != PCX_GAME_SIDEBAND_TYPE_STRING) {
-                fprintf(stderr,
-                        "Received side band data in a format that the "
-                        "test harness doesn’t support.\n");
-                data->had_error = true;
-                return;
-        }
-
         if (pcx_list_empty(&data->queue)) {
                 fprintf(stderr,
-                        "Unexpected sideband string sent: %i: %s\n",
+                        "Unexpected sideband data sent: %i: %s\n",
                         data_num,
-                        value->string);
+                        value);
                 data->had_error = true;
                 return;
         }
@@ -265,19 +257,19 @@ set_sideband_data_cb(int data_num,
                                  struct test_message,
                                  link);
 
-        if (message->type != TEST_MESSAGE_TYPE_SIDEBAND_STRING) {
+        if (message->type != type) {
                 fprintf(stderr,
-                        "Sideband string received when a different "
+                        "Sideband data received when a different "
                         "type was expected: %i: %s\n",
                         data_num,
-                        value->string);
+                        value);
                 data->had_error = true;
                 return;
         }
 
         if (data_num != message->destination) {
                 fprintf(stderr,
-                        "Received sideband string data_num %i but %i "
+                        "Received sideband data data_num %i but %i "
                         "was expected\n",
                         data_num,
                         message->destination);
@@ -285,12 +277,12 @@ set_sideband_data_cb(int data_num,
                 return;
         }
 
-        if (strcmp(value->string, message->message)) {
+        if (strcmp(value, message->message)) {
                 fprintf(stderr,
-                        "Sideband string does not match expected string.\n"
+                        "Sideband data does not match expected value.\n"
                         "Received: %s\n"
                         "Expected: %s\n",
-                        value->string,
+                        value,
                         message->message);
                 data->had_error = true;
                 return;
@@ -298,10 +290,10 @@ set_sideband_data_cb(int data_num,
 
         if (force) {
                 fprintf(stderr,
-                        "Received sideband string with the force argument set "
+                        "Received sideband data with the force argument set "
                         "but the test harness does not support this: %i: %s\n",
                         data_num,
-                        value->string);
+                        value);
                 data->had_error = true;
                 return;
         }
@@ -310,6 +302,60 @@ set_sideband_data_cb(int data_num,
         free_message(message);
 }
 
+static void
+set_sideband_data_cb(int data_num,
+                     const struct pcx_game_sideband_data *value,
+                     bool force,
+                     void *user_data)
+{
+        struct test_message_data *data = user_data;
+        struct pcx_buffer buf = PCX_BUFFER_STATIC_INIT;
+        const struct pcx_game_sideband_array *array = &value->array;
+
+        switch (value->type) {
+        case PCX_GAME_SIDEBAND_TYPE_STRING:
+                check_sideband_data(data,
+                                    data_num,
+                                    TEST_MESSAGE_TYPE_SIDEBAND_STRING,
+                                    value->string,
+                                    force);
+                return;
+
+        case PCX_GAME_SIDEBAND_TYPE_ARRAY:
+                if (array->start != 0 || array->length != array->n_elements)
+                        break;
+
+                /* The elements are compared as a single string
+                 * separated by newlines
+                 */
+                for (int i = 0; i < array->n_elements; i++) {
+                        if (i > 0)
+                                pcx_buffer_append_c(&buf, '\n');
+                        pcx_buffer_append_string(&buf, array->elements[i]);
+                }
+
+                pcx_buffer_append_c(&buf, '\0');
+
+                check_sideband_data(data,
+                                    data_num,
+                                    TEST_MESSAGE_TYPE_SIDEBAND_ARRAY,
+                                    (const char *) buf.data,
+                                    force);
+
+                pcx_buffer_destroy(&buf);
+                return;
+
+        case PCX_GAME_SIDEBAND_TYPE_BYTE:
+        case PCX_GAME_SIDEBAND_TYPE_UINT32:
+                break;
+        }
+
+        fprintf(stderr,
+                "Received side band data in a format that the "
+                "test harness doesn’t support.\n");
+        data->had_error = true;
+}
+
 static void
 send_message_cb(const struct pcx_game_message *message,
                 void *user_data)
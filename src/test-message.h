@@ -29,6 +29,8 @@ enum test_message_type {
         TEST_MESSAGE_TYPE_PRIVATE,
         TEST_MESSAGE_TYPE_GLOBAL,
         TEST_MESSAGE_TYPE_SIDEBAND_STRING,
+        /* The message is the elements separated by newlines */
+        TEST_MESSAGE_TYPE_SIDEBAND_ARRAY,
         TEST_MESSAGE_TYPE_GAME_OVER,
 };
 
@@ -0,0 +1,210 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "pcx-playerbase.h"
+#include "pcx-conversation.h"
+#include "pcx-main-context.h"
+#include "test-time-hack.h"
+
+#define N_PLAYERS 5000
+#define PLAYERS_PER_GAME 4
+
+static void *
+create_game_cb(const struct pcx_config *config,
+               const struct pcx_game_callbacks *callbacks,
+               void *user_data,
+               enum pcx_text_language language,
+               int n_players,
+               const char * const *names)
+{
+        return pcx_alloc(1);
+}
+
+static void
+free_game_cb(void *game)
+{
+        pcx_free(game);
+}
+
+static const struct pcx_game
+test_game = {
+        .name = "test",
+        .min_players = 1,
+        .max_players = PLAYERS_PER_GAME,
+        .create_game_cb = create_game_cb,
+        .free_game_cb = free_game_cb,
+};
+
+static uint64_t
+get_player_id(int num)
+{
+        /* Use IDs that only differ in the high bits to check that the
+         * hash function mixes them.
+         */
+        return (uint64_t) num << 40;
+}
+
+static void
+add_players(struct pcx_playerbase *playerbase)
+{
+        struct pcx_conversation *conv = NULL;
+
+        for (int i = 0; i < N_PLAYERS; i++) {
+                if (i % PLAYERS_PER_GAME == 0) {
+                        if (conv)
+                                pcx_conversation_unref(conv);
+
+                        conv = pcx_conversation_new(NULL, /* config */
+                                                    NULL, /* class_store */
+                                                    &test_game,
+                                                    PCX_TEXT_LANGUAGE_ENGLISH);
+                }
+
+                uint64_t id = get_player_id(i);
+
+                assert(pcx_playerbase_get_player_by_id(playerbase, id) ==
+                       NULL);
+
+                struct pcx_player *player =
+                        pcx_playerbase_add_player(playerbase,
+                                                  conv,
+                                                  "test",
+                                                  id);
+
+                assert(player->id == id);
+                assert(pcx_playerbase_get_n_players(playerbase) == i + 1);
+
+                /* All of the previous players should still be
+                 * reachable while the table is being resized.
+                 */
+                if (i % 97 == 0) {
+                        for (int j = 0; j <= i; j++) {
+                                uint64_t other_id = get_player_id(j);
+                                struct pcx_player *other =
+                                        pcx_playerbase_get_player_by_id
+                                        (playerbase, other_id);
+                                assert(other && other->id == other_id);
+                        }
+                }
+        }
+
+        pcx_conversation_unref(conv);
+}
+
+static void
+check_players(struct pcx_playerbase *playerbase)
+{
+        for (int i = 0; i < N_PLAYERS; i++) {
+                uint64_t id = get_player_id(i);
+                struct pcx_player *player =
+                        pcx_playerbase_get_player_by_id(playerbase, id);
+                assert(player && player->id == id);
+        }
+
+        assert(pcx_playerbase_get_player_by_id(playerbase, 1) == NULL);
+}
+
+static void
+clear_timeout_cb(struct pcx_main_context_source *source,
+                 void *user_data)
+{
+        struct pcx_main_context_source **timeout_ptr = user_data;
+
+        *timeout_ptr = NULL;
+}
+
+static void
+run_gc(void)
+{
+        test_time_hack_add_time(3 * 60);
+
+        struct pcx_main_context_source *timeout =
+                pcx_main_context_add_timeout(NULL,
+                                             0,
+                                             clear_timeout_cb,
+                                             &timeout);
+
+        while (timeout)
+                pcx_main_context_poll(NULL);
+}
+
+static void
+test_grow_and_shrink(void)
+{
+        struct pcx_playerbase *playerbase = pcx_playerbase_new();
+
+        add_players(playerbase);
+        check_players(playerbase);
+
+        /* Keep half of the players alive */
+        for (int i = 0; i < N_PLAYERS; i += 2) {
+                struct pcx_player *player =
+                        pcx_playerbase_get_player_by_id(playerbase,
+                                                        get_player_id(i));
+                player->ref_count++;
+        }
+
+        run_gc();
+
+        assert(pcx_playerbase_get_n_players(playerbase) == N_PLAYERS / 2);
+
+        for (int i = 0; i < N_PLAYERS; i++) {
+                struct pcx_player *player =
+                        pcx_playerbase_get_player_by_id(playerbase,
+                                                        get_player_id(i));
+
+                if (i % 2 == 0) {
+                        assert(player);
+                        player->ref_count--;
+                } else {
+                        assert(player == NULL);
+                }
+        }
+
+        /* Now everyone goes away and the table should shrink */
+        run_gc();
+
+        assert(pcx_playerbase_get_n_players(playerbase) == 0);
+
+        for (int i = 0; i < N_PLAYERS; i++) {
+                assert(pcx_playerbase_get_player_by_id(playerbase,
+                                                       get_player_id(i)) ==
+                       NULL);
+        }
+
+        /* The table should still work after shrinking */
+        add_players(playerbase);
+        check_players(playerbase);
+
+        pcx_playerbase_free(playerbase);
+}
+
+int
+main(int argc, char **argv)
+{
+        test_grow_and_shrink();
+
+        pcx_main_context_free(pcx_main_context_get_default());
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,290 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "pcx-proxy-protocol.h"
+#include "pcx-util.h"
+
+static enum pcx_proxy_protocol_result
+parse(const void *data,
+      size_t length,
+      struct pcx_netaddress *address,
+      size_t *header_length)
+{
+        struct pcx_error *error = NULL;
+        enum pcx_proxy_protocol_result result =
+                pcx_proxy_protocol_parse(data,
+                                         length,
+                                         address,
+                                         header_length,
+                                         &error);
+
+        if (result == PCX_PROXY_PROTOCOL_RESULT_ERROR) {
+                assert(error);
+                pcx_error_free(error);
+        } else {
+                assert(error == NULL);
+        }
+
+        return result;
+}
+
+static void
+check_address(const struct pcx_netaddress *address,
+              const char *expected)
+{
+        char *str = pcx_netaddress_to_string(address);
+        assert(!strcmp(str, expected));
+        pcx_free(str);
+}
+
+static void
+test_v1(void)
+{
+        static const char header[] =
+                "PROXY TCP4 192.168.1.2 10.0.0.1 56324 443\r\nGET / HTTP/1.1";
+        size_t header_end = strstr(header, "GET") - header;
+        struct pcx_netaddress address;
+        size_t header_length;
+
+        /* Every prefix of the header needs more data */
+        for (size_t i = 0; i < header_end; i++) {
+                assert(parse(header, i, &address, &header_length) ==
+                       PCX_PROXY_PROTOCOL_RESULT_NEED_MORE_DATA);
+        }
+
+        assert(parse(header, sizeof header - 1, &address, &header_length) ==
+               PCX_PROXY_PROTOCOL_RESULT_FINISHED);
+        assert(header_length == header_end);
+        assert(address.family == AF_INET);
+        check_address(&address, "192.168.1.2:56324");
+
+        static const char ipv6_header[] =
+                "PROXY TCP6 2001:db8::1 2001:db8::2 1234 443\r\n";
+
+        assert(parse(ipv6_header,
+                     sizeof ipv6_header - 1,
+                     &address,
+                     &header_length) ==
+               PCX_PROXY_PROTOCOL_RESULT_FINISHED);
+        assert(address.family == AF_INET6);
+        check_address(&address, "[2001:db8::1]:1234");
+
+        static const char unknown_header[] = "PROXY UNKNOWN\r\n";
+
+        assert(parse(unknown_header,
+                     sizeof unknown_header - 1,
+                     &address,
+                     &header_length) ==
+               PCX_PROXY_PROTOCOL_RESULT_FINISHED);
+        assert(header_length == sizeof unknown_header - 1);
+        assert(address.family == AF_UNSPEC);
+
+        static const char *const bad_headers[] = {
+                "GET / HTTP/1.1\r\n",
+                "PROXY TCP4 192.168.1.2 10.0.0.1 56324 443\n",
+                "PROXY TCP4 192.168.1.2 10.0.0.1 56324\r\n",
+                "PROXY TCP4 192.168.1.2 10.0.0.1 56324 443 7\r\n",
+                "PROXY TCP4 2001:db8::1 10.0.0.1 56324 443\r\n",
+                "PROXY TCP4 192.168.1.2 10.0.0.1 65536 443\r\n",
+                "PROXY TCP4 192.168.1.2 10.0.0.1 -1 443\r\n",
+                "PROXY UDP4 192.168.1.2 10.0.0.1 56324 443\r\n",
+        };
+
+        for (unsigned i = 0; i < PCX_N_ELEMENTS(bad_headers); i++) {
+                assert(parse(bad_headers[i],
+                             strlen(bad_headers[i]),
+                             &address,
+                             &header_length) ==
+                       PCX_PROXY_PROTOCOL_RESULT_ERROR);
+        }
+
+        /* A header without a newline is rejected once it is too long
+         * to be valid.
+         */
+        char long_header[200];
+
+        memset(long_header, 'a', sizeof long_header);
+        memcpy(long_header, "PROXY ", 6);
+
+        assert(parse(long_header, 100, &address, &header_length) ==
+               PCX_PROXY_PROTOCOL_RESULT_NEED_MORE_DATA);
+        assert(parse(long_header,
+                     sizeof long_header,
+                     &address,
+                     &header_length) ==
+               PCX_PROXY_PROTOCOL_RESULT_ERROR);
+}
+
+static const uint8_t
+v2_ipv4_header[] = {
+        0x0d, 0x0a, 0x0d, 0x0a, 0x00, 0x0d, 0x0a, 0x51, 0x55, 0x49, 0x54, 0x0a,
+        /* Version 2, PROXY command */
+        0x21,
+        /* TCP over IPv4 */
+        0x11,
+        /* Length of the addresses plus a 4-byte TLV */
+        0x00, 12 + 4,
+        /* Source address */
+        192, 168, 1, 2,
+        /* Destination address */
+        10, 0, 0, 1,
+        /* Source port */
+        0xdc, 0x04,
+        /* Destination port */
+        0x01, 0xbb,
+        /* A TLV that should be ignored */
+        0x04, 0x00, 0x01, 0x00,
+        /* The data after the header */
+        'G', 'E', 'T',
+};
+
+static void
+test_v2(void)
+{
+        struct pcx_netaddress address;
+        size_t header_length;
+
+        for (size_t i = 0; i < sizeof v2_ipv4_header - 3; i++) {
+                assert(parse(v2_ipv4_header, i, &address, &header_length) ==
+                       PCX_PROXY_PROTOCOL_RESULT_NEED_MORE_DATA);
+        }
+
+        assert(parse(v2_ipv4_header,
+                     sizeof v2_ipv4_header,
+                     &address,
+                     &header_length) ==
+               PCX_PROXY_PROTOCOL_RESULT_FINISHED);
+        assert(header_length == sizeof v2_ipv4_header - 3);
+        check_address(&address, "192.168.1.2:56324");
+
+        uint8_t header[sizeof v2_ipv4_header];
+
+        /* The LOCAL command uses the address of the socket */
+        memcpy(header, v2_ipv4_header, sizeof header);
+        header[12] = 0x20;
+        assert(parse(header, sizeof header, &address, &header_length) ==
+               PCX_PROXY_PROTOCOL_RESULT_FINISHED);
+        assert(address.family == AF_UNSPEC);
+
+        /* Unknown version */
+        memcpy(header, v2_ipv4_header, sizeof header);
+        header[12] = 0x31;
+        assert(parse(header, sizeof header, &address, &header_length) ==
+               PCX_PROXY_PROTOCOL_RESULT_ERROR);
+
+        /* Bad signature */
+        memcpy(header, v2_ipv4_header, sizeof header);
+        header[3] = 'x';
+        assert(parse(header, sizeof header, &address, &header_length) ==
+               PCX_PROXY_PROTOCOL_RESULT_ERROR);
+
+        /* Too long */
+        memcpy(header, v2_ipv4_header, sizeof header);
+        header[14] = 0xff;
+        assert(parse(header, sizeof header, &address, &header_length) ==
+               PCX_PROXY_PROTOCOL_RESULT_ERROR);
+
+        /* Addresses too short for the family */
+        memcpy(header, v2_ipv4_header, sizeof header);
+        header[15] = 4;
+        assert(parse(header, sizeof header, &address, &header_length) ==
+               PCX_PROXY_PROTOCOL_RESULT_FINISHED);
+        assert(address.family == AF_UNSPEC);
+}
+
+static void
+make_address(struct pcx_netaddress *address,
+             const char *str)
+{
+        bool ret = pcx_netaddress_from_string(address, str, 0);
+        assert(ret);
+}
+
+static void
+check_round_trip(const char *source_str,
+                 const char *destination_str,
+                 const char *expected)
+{
+        struct pcx_netaddress source, destination, address;
+        struct pcx_buffer buf = PCX_BUFFER_STATIC_INIT;
+        size_t header_length;
+
+        make_address(&source, source_str);
+        make_address(&destination, destination_str);
+
+        pcx_proxy_protocol_write_v2(&buf, &source, &destination);
+
+        assert(parse(buf.data, buf.length, &address, &header_length) ==
+               PCX_PROXY_PROTOCOL_RESULT_FINISHED);
+        assert(header_length == buf.length);
+
+        if (expected)
+                check_address(&address, expected);
+        else
+                assert(address.family == AF_UNSPEC);
+
+        pcx_buffer_destroy(&buf);
+}
+
+static void
+test_write_v2(void)
+{
+        struct pcx_netaddress source, destination;
+        struct pcx_buffer buf = PCX_BUFFER_STATIC_INIT;
+
+        make_address(&source, "192.168.1.2:56324");
+        make_address(&destination, "10.0.0.1:443");
+
+        pcx_proxy_protocol_write_v2(&buf, &source, &destination);
+
+        /* The same as the example header without the TLV */
+        assert(buf.length == 16 + 12);
+        assert(!memcmp(buf.data, v2_ipv4_header, 15));
+        assert(buf.data[15] == 12);
+        assert(!memcmp(buf.data + 16, v2_ipv4_header + 16, 12));
+
+        pcx_buffer_destroy(&buf);
+
+        check_round_trip("192.168.1.2:56324",
+                         "10.0.0.1:443",
+                         "192.168.1.2:56324");
+        check_round_trip("[2001:db8::1]:1234",
+                         "[2001:db8::2]:443",
+                         "[2001:db8::1]:1234");
+        /* Mixed families can’t be described so the header is LOCAL */
+        check_round_trip("192.168.1.2:56324",
+                         "[2001:db8::2]:443",
+                         NULL);
+}
+
+int
+main(int argc, char **argv)
+{
+        test_v1();
+        test_v2();
+        test_write_v2();
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,163 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "pcx-chacha20.h"
+#include "pcx-random.h"
+
+static void
+test_chacha20(void)
+{
+        /* Test vector from RFC 8439 section 2.3.2 */
+        uint8_t key[PCX_CHACHA20_KEY_SIZE];
+        static const uint8_t nonce[PCX_CHACHA20_NONCE_SIZE] = {
+                0x00, 0x00, 0x00, 0x09, 0x00, 0x00, 0x00, 0x4a,
+                0x00, 0x00, 0x00, 0x00,
+        };
+        static const uint8_t expected[PCX_CHACHA20_BLOCK_SIZE] = {
+                0x10, 0xf1, 0xe7, 0xe4, 0xd1, 0x3b, 0x59, 0x15,
+                0x50, 0x0f, 0xdd, 0x1f, 0xa3, 0x20, 0x71, 0xc4,
+                0xc7, 0xd1, 0xf4, 0xc7, 0x33, 0xc0, 0x68, 0x03,
+                0x04, 0x22, 0xaa, 0x9a, 0xc3, 0xd4, 0x6c, 0x4e,
+                0xd2, 0x82, 0x64, 0x46, 0x07, 0x9f, 0xaa, 0x09,
+                0x14, 0xc2, 0xd7, 0x05, 0xd9, 0x8b, 0x02, 0xa2,
+                0xb5, 0x12, 0x9c, 0xd1, 0xde, 0x16, 0x4e, 0xb9,
+                0xcb, 0xd0, 0x83, 0xe8, 0xa2, 0x50, 0x3c, 0x4e,
+        };
+        uint8_t block[PCX_CHACHA20_BLOCK_SIZE];
+
+        for (int i = 0; i < sizeof key; i++)
+                key[i] = i;
+
+        pcx_chacha20_block(key, 1, nonce, block);
+
+        assert(!memcmp(block, expected, sizeof block));
+}
+
+static void
+test_chacha20_zero(void)
+{
+        /* Test vector from RFC 8439 appendix A.1 */
+        static const uint8_t key[PCX_CHACHA20_KEY_SIZE] = { 0 };
+        static const uint8_t nonce[PCX_CHACHA20_NONCE_SIZE] = { 0 };
+        static const uint8_t expected[PCX_CHACHA20_BLOCK_SIZE] = {
+                0x76, 0xb8, 0xe0, 0xad, 0xa0, 0xf1, 0x3d, 0x90,
+                0x40, 0x5d, 0x6a, 0xe5, 0x53, 0x86, 0xbd, 0x28,
+                0xbd, 0xd2, 0x19, 0xb8, 0xa0, 0x8d, 0xed, 0x1a,
+                0xa8, 0x36, 0xef, 0xcc, 0x8b, 0x77, 0x0d, 0xc7,
+                0xda, 0x41, 0x59, 0x7c, 0x51, 0x57, 0x48, 0x8d,
+                0x77, 0x24, 0xe0, 0x3f, 0xb8, 0xd8, 0x4a, 0x37,
+                0x6a, 0x43, 0xb8, 0xf4, 0x15, 0x18, 0xa1, 0x1c,
+                0xc3, 0x87, 0xb6, 0x69, 0xb2, 0xee, 0x65, 0x86,
+        };
+        uint8_t block[PCX_CHACHA20_BLOCK_SIZE];
+
+        pcx_chacha20_block(key, 0, nonce, block);
+
+        assert(!memcmp(block, expected, sizeof block));
+}
+
+static void
+test_distribution(void)
+{
+        /* Fetch the data in odd sizes so that the reads straddle the
+         * internal buffer boundaries.
+         */
+        static const size_t sizes[] = { 1, 7, 8, 13, 64, 1000, 3 };
+        const size_t total = 1024 * 1024;
+        uint8_t *buf = malloc(total);
+        size_t pos = 0;
+
+        for (int i = 0; pos < total; i++) {
+                size_t size = sizes[i % (sizeof sizes / sizeof sizes[0])];
+
+                if (size > total - pos)
+                        size = total - pos;
+
+                pcx_random_fill(buf + pos, size);
+                pos += size;
+        }
+
+        unsigned counts[256] = { 0 };
+
+        for (size_t i = 0; i < total; i++)
+                counts[buf[i]]++;
+
+        /* Expected count is 4096 with a standard deviation of about
+         * 64 so this shouldn’t fail by chance.
+         */
+        for (int i = 0; i < 256; i++)
+                assert(counts[i] > 3600 && counts[i] < 4600);
+
+        free(buf);
+}
+
+static void
+test_fork(void)
+{
+        uint64_t values[2];
+        int pipe_fds[2];
+
+        /* Make sure the state is seeded before forking */
+        pcx_random_uint64();
+
+        int ret = pipe(pipe_fds);
+        assert(ret == 0);
+
+        pid_t pid = fork();
+        assert(pid != -1);
+
+        if (pid == 0) {
+                uint64_t value = pcx_random_uint64();
+                ret = write(pipe_fds[1], &value, sizeof value);
+                _exit(ret == sizeof value ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+
+        values[0] = pcx_random_uint64();
+
+        ret = read(pipe_fds[0], values + 1, sizeof values[1]);
+        assert(ret == sizeof values[1]);
+
+        int status;
+        waitpid(pid, &status, 0);
+        assert(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+
+        /* The child must not continue the parent’s stream */
+        assert(values[0] != values[1]);
+}
+
+int
+main(int argc, char **argv)
+{
+        test_chacha20();
+        test_chacha20_zero();
+        test_distribution();
+        test_fork();
+
+        return EXIT_SUCCESS;
+}
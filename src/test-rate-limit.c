@@ -0,0 +1,131 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "pcx-rate-limit.h"
+#include "pcx-main-context.h"
+#include "test-time-hack.h"
+
+static void
+get_address(struct pcx_netaddress *address,
+            const char *str)
+{
+        bool ret = pcx_netaddress_from_string(address, str, 1234);
+        assert(ret);
+}
+
+static void
+test_burst(void)
+{
+        struct pcx_rate_limit *limit = pcx_rate_limit_new(60, 4);
+        struct pcx_netaddress a, b;
+
+        get_address(&a, "192.168.1.1");
+        get_address(&b, "192.168.1.2");
+
+        for (int i = 0; i < 4; i++)
+                assert(pcx_rate_limit_take(limit, &a));
+
+        assert(!pcx_rate_limit_take(limit, &a));
+
+        /* A different address has its own bucket */
+        assert(pcx_rate_limit_take(limit, &b));
+
+        /* A different port is the same client */
+        a.port++;
+        assert(!pcx_rate_limit_take(limit, &a));
+
+        /* One token per second */
+        test_time_hack_add_time(1);
+        assert(pcx_rate_limit_take(limit, &a));
+        assert(!pcx_rate_limit_take(limit, &a));
+
+        test_time_hack_add_time(2);
+        assert(pcx_rate_limit_take(limit, &a));
+        assert(pcx_rate_limit_take(limit, &a));
+        assert(!pcx_rate_limit_take(limit, &a));
+
+        /* The bucket doesn’t overflow */
+        test_time_hack_add_time(60);
+        for (int i = 0; i < 4; i++)
+                assert(pcx_rate_limit_take(limit, &a));
+        assert(!pcx_rate_limit_take(limit, &a));
+
+        pcx_rate_limit_free(limit);
+}
+
+static void
+test_ipv6_prefix(void)
+{
+        struct pcx_rate_limit *limit = pcx_rate_limit_new(1, 1);
+        struct pcx_netaddress a, b, c;
+
+        get_address(&a, "[2001:db8:1:2::1]");
+        get_address(&b, "[2001:db8:1:2::ffff]");
+        get_address(&c, "[2001:db8:1:3::1]");
+
+        assert(pcx_rate_limit_take(limit, &a));
+        /* Same /64 */
+        assert(!pcx_rate_limit_take(limit, &b));
+        assert(pcx_rate_limit_take(limit, &c));
+
+        pcx_rate_limit_free(limit);
+}
+
+static void
+test_gc(void)
+{
+        struct pcx_rate_limit *limit = pcx_rate_limit_new(60, 2);
+
+        for (int i = 0; i < 100; i++) {
+                struct pcx_netaddress address = {
+                        .family = AF_INET,
+                        .ipv4 = { .s_addr = i },
+                };
+                assert(pcx_rate_limit_take(limit, &address));
+        }
+
+        assert(pcx_rate_limit_get_n_buckets(limit) == 100);
+
+        /* The buckets aren’t full yet */
+        pcx_rate_limit_gc(limit);
+        assert(pcx_rate_limit_get_n_buckets(limit) == 100);
+
+        test_time_hack_add_time(1);
+
+        pcx_rate_limit_gc(limit);
+        assert(pcx_rate_limit_get_n_buckets(limit) == 0);
+
+        pcx_rate_limit_free(limit);
+}
+
+int
+main(int argc, char **argv)
+{
+        test_burst();
+        test_ipv6_prefix();
+        test_gc();
+
+        pcx_main_context_free(pcx_main_context_get_default());
+
+        return EXIT_SUCCESS;
+}
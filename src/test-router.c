@@ -0,0 +1,425 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "pcx-router.h"
+#include "pcx-main-context.h"
+#include "pcx-proxy-protocol.h"
+#include "pcx-generate-id.h"
+#include "pcx-proto.h"
+#include "pcx-buffer.h"
+#include "pcx-util.h"
+
+#define N_BACKENDS 2
+
+struct test_harness {
+        struct pcx_router *router;
+        int backend_socks[N_BACKENDS];
+        struct sockaddr_in router_addr;
+};
+
+static const char
+ws_request[] =
+        "GET / HTTP/1.1\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+        "\r\n";
+
+static const char
+backend_reply[] = "HTTP/1.1 101 Switching Protocols\r\n\r\n";
+
+static void
+clear_timeout_cb(struct pcx_main_context_source *source,
+                 void *user_data)
+{
+        struct pcx_main_context_source **timeout_ptr = user_data;
+
+        *timeout_ptr = NULL;
+}
+
+static void
+sync_with_router(void)
+{
+        /* Poll until a short timeout is hit so that the router has
+         * done everything it can with the data it has.
+         */
+        int poll_count = 0;
+
+        while (true) {
+                struct pcx_main_context_source *timeout =
+                        pcx_main_context_add_timeout(NULL,
+                                                     poll_count < 2 ? 0 : 16,
+                                                     clear_timeout_cb,
+                                                     &timeout);
+
+                pcx_main_context_poll(NULL);
+
+                if (timeout)
+                        pcx_main_context_remove_source(timeout);
+                else if (poll_count >= 2)
+                        break;
+
+                poll_count++;
+        }
+}
+
+static int
+create_listen_socket(struct sockaddr_in *addr)
+{
+        int sock = socket(PF_INET, SOCK_STREAM, 0);
+        socklen_t addr_len = sizeof *addr;
+
+        memset(addr, 0, sizeof *addr);
+        addr->sin_family = AF_INET;
+        addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        assert(sock != -1);
+        assert(bind(sock, (struct sockaddr *) addr, addr_len) == 0);
+        assert(listen(sock, 8) == 0);
+        assert(getsockname(sock, (struct sockaddr *) addr, &addr_len) == 0);
+
+        return sock;
+}
+
+static void
+set_up_harness(struct test_harness *harness)
+{
+        harness->router = pcx_router_new();
+
+        for (int i = 0; i < N_BACKENDS; i++) {
+                struct sockaddr_in addr;
+
+                harness->backend_socks[i] = create_listen_socket(&addr);
+
+                char address[32];
+
+                snprintf(address,
+                         sizeof address,
+                         "127.0.0.1:%i",
+                         ntohs(addr.sin_port));
+
+                /* Use shard numbers that don’t match the order */
+                bool ret = pcx_router_add_backend(harness->router,
+                                                  address,
+                                                  N_BACKENDS - 1 - i,
+                                                  NULL);
+                assert(ret);
+        }
+
+        pcx_router_add_listen_socket(harness->router,
+                                     create_listen_socket(&harness->
+                                                          router_addr));
+}
+
+static void
+free_harness(struct test_harness *harness)
+{
+        pcx_router_free(harness->router);
+
+        for (int i = 0; i < N_BACKENDS; i++)
+                pcx_close(harness->backend_socks[i]);
+}
+
+static bool
+has_pending_connection(int sock)
+{
+        struct pollfd pfd = { .fd = sock, .events = POLLIN };
+
+        return poll(&pfd, 1, 0) == 1;
+}
+
+/* Appends a masked binary frame with a reconnect message for the ID */
+static void
+add_reconnect_frame(struct pcx_buffer *buf,
+                    uint64_t id)
+{
+        static const uint8_t mask[] = { 0x12, 0x34, 0x56, 0x78 };
+        uint8_t payload[1 + sizeof (uint64_t) + sizeof (uint16_t)];
+
+        payload[0] = PCX_PROTO_RECONNECT;
+        pcx_proto_write_uint64_t(payload + 1, id);
+        pcx_proto_write_uint16_t(payload + 1 + sizeof (uint64_t), 0);
+
+        uint8_t header[] = { 0x82, 0x80 | sizeof payload };
+
+        pcx_buffer_append(buf, header, sizeof header);
+        pcx_buffer_append(buf, mask, sizeof mask);
+
+        for (size_t i = 0; i < sizeof payload; i++)
+                pcx_buffer_append_c(buf, payload[i] ^ mask[i % 4]);
+}
+
+/* Sends the WebSocket request and a reconnect message to the router
+ * and returns the socket. The sent data is copied to frame_buf
+ * without the request.
+ */
+static int
+connect_client(struct test_harness *harness,
+               uint64_t id,
+               struct pcx_buffer *frame_buf)
+{
+        int sock = socket(PF_INET, SOCK_STREAM, 0);
+
+        assert(sock != -1);
+        assert(connect(sock,
+                       (struct sockaddr *) &harness->router_addr,
+                       sizeof harness->router_addr) == 0);
+
+        add_reconnect_frame(frame_buf, id);
+
+        assert(write(sock, ws_request, sizeof ws_request - 1) ==
+               sizeof ws_request - 1);
+        assert(write(sock, frame_buf->data, frame_buf->length) ==
+               frame_buf->length);
+
+        return sock;
+}
+
+static void
+read_all(int sock,
+         struct pcx_buffer *buf)
+{
+        while (true) {
+                pcx_buffer_ensure_size(buf, buf->length + 1024);
+
+                ssize_t got = recv(sock,
+                                   buf->data + buf->length,
+                                   buf->size - buf->length,
+                                   MSG_DONTWAIT);
+
+                if (got <= 0)
+                        break;
+
+                buf->length += got;
+        }
+}
+
+static size_t
+find_header_end(const struct pcx_buffer *buf)
+{
+        for (size_t i = 4; i <= buf->length; i++) {
+                if (!memcmp(buf->data + i - 4, "\r\n\r\n", 4))
+                        return i;
+        }
+
+        return 0;
+}
+
+static void
+check_backend_data(const struct pcx_buffer *data,
+                   int client_sock,
+                   const struct pcx_buffer *frame_buf)
+{
+        struct pcx_netaddress address;
+        size_t header_length;
+
+        /* The backend should see the client’s own address */
+        assert(pcx_proxy_protocol_parse(data->data,
+                                        data->length,
+                                        &address,
+                                        &header_length,
+                                        NULL) ==
+               PCX_PROXY_PROTOCOL_RESULT_FINISHED);
+
+        struct pcx_netaddress_native native;
+        struct pcx_netaddress client_address;
+
+        native.length = sizeof native.sockaddr_in6;
+        assert(getsockname(client_sock,
+                           &native.sockaddr,
+                           &native.length) == 0);
+        pcx_netaddress_from_native(&client_address, &native);
+
+        assert(address.family == AF_INET);
+        assert(address.ipv4.s_addr == client_address.ipv4.s_addr);
+        assert(address.port == client_address.port);
+
+        /* Then the router’s own WebSocket request */
+        struct pcx_buffer rest = PCX_BUFFER_STATIC_INIT;
+
+        pcx_buffer_append(&rest,
+                          data->data + header_length,
+                          data->length - header_length);
+
+        static const char request_start[] = "GET / HTTP/1.1\r\n";
+
+        assert(rest.length >= sizeof request_start - 1);
+        assert(!memcmp(rest.data, request_start, sizeof request_start - 1));
+
+        size_t request_end = find_header_end(&rest);
+
+        assert(request_end > 0);
+
+        /* And finally the frame from the client, untouched */
+        assert(rest.length - request_end == frame_buf->length);
+        assert(!memcmp(rest.data + request_end,
+                       frame_buf->data,
+                       frame_buf->length));
+
+        pcx_buffer_destroy(&rest);
+}
+
+static uint64_t
+make_id(int shard)
+{
+        return ((uint64_t) shard << (64 - PCX_GENERATE_ID_SHARD_BITS)) |
+                UINT64_C(0x123456789a);
+}
+
+static void
+test_route_by_shard(void)
+{
+        struct test_harness harness;
+
+        set_up_harness(&harness);
+
+        for (int shard = 0; shard < N_BACKENDS; shard++) {
+                int backend_num = N_BACKENDS - 1 - shard;
+                struct pcx_buffer frame_buf = PCX_BUFFER_STATIC_INIT;
+                int client_sock = connect_client(&harness,
+                                                 make_id(shard),
+                                                 &frame_buf);
+
+                sync_with_router();
+
+                for (int i = 0; i < N_BACKENDS; i++) {
+                        assert(has_pending_connection(harness.
+                                                      backend_socks[i]) ==
+                               (i == backend_num));
+                }
+
+                int backend_sock = accept(harness.backend_socks[backend_num],
+                                          NULL,
+                                          NULL);
+
+                assert(backend_sock != -1);
+
+                sync_with_router();
+
+                struct pcx_buffer data = PCX_BUFFER_STATIC_INIT;
+
+                read_all(backend_sock, &data);
+                check_backend_data(&data, client_sock, &frame_buf);
+
+                /* The reply from the backend is replaced with the
+                 * router’s own but anything after it is forwarded.
+                 */
+                assert(write(backend_sock,
+                             backend_reply,
+                             sizeof backend_reply - 1) ==
+                       sizeof backend_reply - 1);
+                assert(write(backend_sock, "hello", 5) == 5);
+
+                sync_with_router();
+
+                data.length = 0;
+                read_all(client_sock, &data);
+
+                size_t reply_end = find_header_end(&data);
+
+                assert(reply_end > 0);
+                assert(!memcmp(data.data,
+                               "HTTP/1.1 101 ",
+                               strlen("HTTP/1.1 101 ")));
+                assert(data.length - reply_end == 5);
+                assert(!memcmp(data.data + reply_end, "hello", 5));
+
+                pcx_buffer_destroy(&data);
+                pcx_buffer_destroy(&frame_buf);
+                pcx_close(backend_sock);
+                pcx_close(client_sock);
+
+                sync_with_router();
+        }
+
+        free_harness(&harness);
+}
+
+static void
+test_unknown_shard(void)
+{
+        struct test_harness harness;
+
+        set_up_harness(&harness);
+
+        struct pcx_buffer frame_buf = PCX_BUFFER_STATIC_INIT;
+        int client_sock = connect_client(&harness,
+                                         make_id(N_BACKENDS + 3),
+                                         &frame_buf);
+
+        sync_with_router();
+
+        /* None of the backends could have the player so the client
+         * should be closed instead of being sent to one of them.
+         */
+        for (int i = 0; i < N_BACKENDS; i++)
+                assert(!has_pending_connection(harness.backend_socks[i]));
+
+        char buf[1024];
+        ssize_t got;
+
+        do
+                got = recv(client_sock, buf, sizeof buf, MSG_DONTWAIT);
+        while (got > 0);
+
+        assert(got == 0);
+
+        pcx_buffer_destroy(&frame_buf);
+        pcx_close(client_sock);
+
+        free_harness(&harness);
+}
+
+static void
+test_duplicate_shard(void)
+{
+        struct pcx_router *router = pcx_router_new();
+        struct pcx_error *error = NULL;
+
+        assert(pcx_router_add_backend(router, "127.0.0.1:1", 3, NULL));
+        assert(!pcx_router_add_backend(router, "127.0.0.1:2", 3, &error));
+        assert(error->domain == &pcx_router_error);
+        assert(error->code == PCX_ROUTER_ERROR_DUPLICATE_SHARD);
+        pcx_error_free(error);
+
+        pcx_router_free(router);
+}
+
+int
+main(int argc, char **argv)
+{
+        test_route_by_shard();
+        test_unknown_shard();
+        test_duplicate_shard();
+
+        pcx_main_context_free(pcx_main_context_get_default());
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,186 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "pcx-static-root.h"
+#include "pcx-util.h"
+
+struct request_test {
+        const char *path;
+        int status;
+};
+
+static const struct request_test
+request_tests[] = {
+        { "/", 200 },
+        { "/index.html", 200 },
+        { "/sub/file.txt", 200 },
+        { "/sub", 301 },
+        { "/sub/", 404 },
+        { "/missing", 404 },
+        /* Empty parts would make the path absolute */
+        { "//etc/passwd", 404 },
+        { "///etc/passwd", 404 },
+        { "/sub//file.txt", 404 },
+        { "/./index.html", 404 },
+        { "/sub/./file.txt", 404 },
+        { "/../secret.txt", 404 },
+        { "/sub/../../secret.txt", 404 },
+        { "/%2e%2e/secret.txt", 404 },
+        /* Symlinks can’t be used to escape the root */
+        { "/out-link", 404 },
+        { "/abs-link", 404 },
+        { "/dir-link/secret.txt", 404 },
+};
+
+static void
+write_file(const char *dir,
+           const char *name,
+           const char *contents)
+{
+        char *filename = pcx_strconcat(dir, "/", name, NULL);
+        int fd = open(filename, O_WRONLY | O_CREAT | O_EXCL, 0644);
+
+        assert(fd >= 0);
+        assert(write(fd, contents, strlen(contents)) == strlen(contents));
+
+        pcx_close(fd);
+        pcx_free(filename);
+}
+
+static void
+make_link(const char *dir,
+          const char *name,
+          const char *target)
+{
+        char *filename = pcx_strconcat(dir, "/", name, NULL);
+
+        assert(symlink(target, filename) == 0);
+
+        pcx_free(filename);
+}
+
+static void
+remove_file(const char *dir,
+            const char *name)
+{
+        char *filename = pcx_strconcat(dir, "/", name, NULL);
+
+        assert(unlink(filename) == 0);
+
+        pcx_free(filename);
+}
+
+static bool
+check_request(struct pcx_static_root *root,
+              const struct request_test *test)
+{
+        struct pcx_connection_http_request_event request = {
+                .method = "GET",
+                .path = test->path,
+        };
+        struct pcx_buffer headers = PCX_BUFFER_STATIC_INIT;
+        struct pcx_static_root_reply reply;
+
+        pcx_static_root_handle_request(root, &request, &headers, &reply);
+
+        pcx_buffer_destroy(&headers);
+
+        if (reply.fd != -1)
+                pcx_close(reply.fd);
+
+        if (reply.status != test->status) {
+                fprintf(stderr,
+                        "%s: expected %i but got %i\n",
+                        test->path,
+                        test->status,
+                        reply.status);
+                return false;
+        }
+
+        return true;
+}
+
+int
+main(int argc, char **argv)
+{
+        const char *tmp_dir = getenv("TMPDIR");
+
+        if (tmp_dir == NULL)
+                tmp_dir = "/tmp";
+
+        char *base_dir = pcx_strconcat(tmp_dir,
+                                       "/test-static-root-XXXXXX",
+                                       NULL);
+
+        assert(mkdtemp(base_dir) != NULL);
+
+        char *root_dir = pcx_strconcat(base_dir, "/root", NULL);
+        char *sub_dir = pcx_strconcat(root_dir, "/sub", NULL);
+        char *secret = pcx_strconcat(base_dir, "/secret.txt", NULL);
+
+        assert(mkdir(root_dir, 0755) == 0);
+        assert(mkdir(sub_dir, 0755) == 0);
+
+        write_file(base_dir, "secret.txt", "secret");
+        write_file(root_dir, "index.html", "<html></html>");
+        write_file(sub_dir, "file.txt", "file");
+        make_link(root_dir, "out-link", "../secret.txt");
+        make_link(root_dir, "abs-link", secret);
+        make_link(root_dir, "dir-link", "..");
+
+        struct pcx_error *error = NULL;
+        struct pcx_static_root *root = pcx_static_root_new(root_dir, &error);
+
+        assert(root != NULL);
+
+        int ret = EXIT_SUCCESS;
+
+        for (unsigned i = 0; i < PCX_N_ELEMENTS(request_tests); i++) {
+                if (!check_request(root, request_tests + i))
+                        ret = EXIT_FAILURE;
+        }
+
+        pcx_static_root_free(root);
+
+        remove_file(root_dir, "out-link");
+        remove_file(root_dir, "abs-link");
+        remove_file(root_dir, "dir-link");
+        remove_file(sub_dir, "file.txt");
+        remove_file(root_dir, "index.html");
+        remove_file(base_dir, "secret.txt");
+        rmdir(sub_dir);
+        rmdir(root_dir);
+        rmdir(base_dir);
+
+        pcx_free(secret);
+        pcx_free(sub_dir);
+        pcx_free(root_dir);
+        pcx_free(base_dir);
+
+        return ret;
+}
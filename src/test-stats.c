@@ -0,0 +1,306 @@
+/*
+ * Pucxobot - A bot and website to play some card games
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+#include "pcx-stats.h"
+#include "pcx-stats-log.h"
+#include "pcx-main-context.h"
+#include "pcx-util.h"
+
+static const struct pcx_game
+test_game = {
+        .name = "coup",
+};
+
+static const struct pcx_game
+long_game = {
+        .name = "averyveryverylonggamename",
+};
+
+static char *
+make_temp_file(void)
+{
+        const char *tmp_dir = getenv("TMPDIR");
+
+        if (tmp_dir == NULL)
+                tmp_dir = "/tmp";
+
+        char *filename = pcx_strconcat(tmp_dir, "/test-stats-XXXXXX", NULL);
+
+        int fd = mkstemp(filename);
+
+        assert(fd >= 0);
+
+        pcx_close(fd);
+
+        return filename;
+}
+
+static uint8_t *
+read_file(const char *filename,
+          size_t *length)
+{
+        struct stat statbuf;
+        int fd = open(filename, O_RDONLY);
+
+        assert(fd >= 0);
+        assert(fstat(fd, &statbuf) == 0);
+
+        uint8_t *data = pcx_alloc(statbuf.st_size + 1);
+
+        assert(read(fd, data, statbuf.st_size) == statbuf.st_size);
+
+        pcx_close(fd);
+
+        *length = statbuf.st_size;
+
+        return data;
+}
+
+static void
+append_to_file(const char *filename,
+               const char *data)
+{
+        int fd = open(filename, O_WRONLY | O_APPEND);
+
+        assert(fd >= 0);
+        assert(write(fd, data, strlen(data)) == strlen(data));
+
+        pcx_close(fd);
+}
+
+static void
+test_encode(void)
+{
+        struct pcx_stats_record record = {
+                .time = INT64_C(0x123456789a),
+                .duration = 0xfedcba98,
+                .event = PCX_STATS_EVENT_ABANDON,
+                .source = PCX_STATS_SOURCE_TELEGRAM,
+                .n_players = 6,
+                .language = "pt-br",
+                .game = "superfight",
+        };
+        uint8_t data[PCX_STATS_RECORD_SIZE];
+        struct pcx_stats_record decoded;
+
+        pcx_stats_encode(&record, data);
+
+        assert(data[0] == 0x9a);
+        assert(data[4] == 0x12);
+        assert(data[8] == 0x98);
+        assert(data[12] == PCX_STATS_EVENT_ABANDON);
+        assert(data[13] == PCX_STATS_SOURCE_TELEGRAM);
+        assert(data[14] == 6);
+
+        assert(pcx_stats_decode(data, &decoded));
+
+        assert(decoded.time == record.time);
+        assert(decoded.duration == record.duration);
+        assert(decoded.event == record.event);
+        assert(decoded.source == record.source);
+        assert(decoded.n_players == record.n_players);
+        assert(!strcmp(decoded.language, "pt-br"));
+        assert(!strcmp(decoded.game, "superfight"));
+
+        /* Records from a later version are skipped */
+        data[12] = PCX_STATS_N_EVENTS;
+        assert(!pcx_stats_decode(data, &decoded));
+}
+
+static void
+test_log(void)
+{
+        char *filename = make_temp_file();
+        struct pcx_error *error = NULL;
+
+        assert(pcx_stats_log_open(filename, &error));
+
+        uint64_t start_time = pcx_main_context_get_monotonic_clock(NULL);
+
+        pcx_stats_log_add(PCX_STATS_EVENT_START,
+                          PCX_STATS_SOURCE_WEB,
+                          &test_game,
+                          PCX_TEXT_LANGUAGE_ESPERANTO,
+                          3,
+                          start_time);
+        pcx_stats_log_add(PCX_STATS_EVENT_END,
+                          PCX_STATS_SOURCE_WEB,
+                          &long_game,
+                          PCX_TEXT_LANGUAGE_FRENCH,
+                          4,
+                          start_time - UINT64_C(90000000));
+
+        /* Nothing is written until the buffer is flushed */
+        size_t length;
+        uint8_t *data = read_file(filename, &length);
+        assert(length == PCX_STATS_MAGIC_SIZE);
+        assert(!memcmp(data, PCX_STATS_MAGIC, PCX_STATS_MAGIC_SIZE));
+        pcx_free(data);
+
+        pcx_stats_log_close();
+
+        data = read_file(filename, &length);
+
+        assert(length == PCX_STATS_MAGIC_SIZE + PCX_STATS_RECORD_SIZE * 2);
+
+        struct pcx_stats_record record;
+        const uint8_t *p = data + PCX_STATS_MAGIC_SIZE;
+
+        assert(pcx_stats_decode(p, &record));
+        assert(record.event == PCX_STATS_EVENT_START);
+        assert(record.source == PCX_STATS_SOURCE_WEB);
+        assert(record.n_players == 3);
+        assert(record.duration == 0);
+        assert(!strcmp(record.language, "eo"));
+        assert(!strcmp(record.game, "coup"));
+
+        p += PCX_STATS_RECORD_SIZE;
+
+        assert(pcx_stats_decode(p, &record));
+        assert(record.event == PCX_STATS_EVENT_END);
+        assert(record.n_players == 4);
+        assert(record.duration == 90);
+        assert(!strcmp(record.language, "fr"));
+        assert(strlen(record.game) == PCX_STATS_GAME_SIZE);
+        assert(!memcmp(record.game,
+                       long_game.name,
+                       PCX_STATS_GAME_SIZE));
+
+        pcx_free(data);
+
+        /* A partial record at the end is cut off so that the next
+         * records are still aligned.
+         */
+        append_to_file(filename, "crash");
+
+        assert(pcx_stats_log_open(filename, &error));
+        pcx_stats_log_add(PCX_STATS_EVENT_START,
+                          PCX_STATS_SOURCE_TELEGRAM,
+                          &test_game,
+                          PCX_TEXT_LANGUAGE_ENGLISH,
+                          2,
+                          start_time);
+        pcx_stats_log_close();
+
+        data = read_file(filename, &length);
+
+        assert(length == PCX_STATS_MAGIC_SIZE + PCX_STATS_RECORD_SIZE * 3);
+
+        p = data + PCX_STATS_MAGIC_SIZE + PCX_STATS_RECORD_SIZE * 2;
+        assert(pcx_stats_decode(p, &record));
+        assert(record.event == PCX_STATS_EVENT_START);
+        assert(record.source == PCX_STATS_SOURCE_TELEGRAM);
+        assert(!strcmp(record.language, "en"));
+
+        pcx_free(data);
+
+        unlink(filename);
+        pcx_free(filename);
+}
+
+static void
+test_failed_write(void)
+{
+        char *filename = make_temp_file();
+        struct pcx_error *error = NULL;
+
+        assert(pcx_stats_log_open(filename, &error));
+
+        for (int i = 0; i < 2; i++) {
+                pcx_stats_log_add(PCX_STATS_EVENT_START,
+                                  PCX_STATS_SOURCE_WEB,
+                                  &test_game,
+                                  PCX_TEXT_LANGUAGE_ENGLISH,
+                                  2,
+                                  0);
+        }
+
+        /* Make the write stop in the middle of the second record */
+        struct rlimit old_limit, limit;
+
+        assert(getrlimit(RLIMIT_FSIZE, &old_limit) == 0);
+        limit = old_limit;
+        limit.rlim_cur = (PCX_STATS_MAGIC_SIZE +
+                          PCX_STATS_RECORD_SIZE +
+                          PCX_STATS_RECORD_SIZE / 2);
+        assert(setrlimit(RLIMIT_FSIZE, &limit) == 0);
+        void (*old_handler)(int) = signal(SIGXFSZ, SIG_IGN);
+
+        pcx_stats_log_close();
+
+        signal(SIGXFSZ, old_handler);
+        assert(setrlimit(RLIMIT_FSIZE, &old_limit) == 0);
+
+        /* The partial record is cut off */
+        size_t length;
+        uint8_t *data = read_file(filename, &length);
+        assert(length == PCX_STATS_MAGIC_SIZE + PCX_STATS_RECORD_SIZE);
+        pcx_free(data);
+
+        unlink(filename);
+        pcx_free(filename);
+}
+
+static void
+test_invalid_file(void)
+{
+        char *filename = make_temp_file();
+        struct pcx_error *error = NULL;
+
+        append_to_file(filename, "not a stats file");
+
+        assert(!pcx_stats_log_open(filename, &error));
+        assert(error->domain == &pcx_stats_log_error);
+        assert(error->code == PCX_STATS_LOG_ERROR_INVALID);
+        pcx_error_free(error);
+
+        /* The events are ignored without a file */
+        pcx_stats_log_add(PCX_STATS_EVENT_START,
+                          PCX_STATS_SOURCE_WEB,
+                          &test_game,
+                          PCX_TEXT_LANGUAGE_ENGLISH,
+                          2,
+                          0);
+
+        unlink(filename);
+        pcx_free(filename);
+}
+
+int
+main(int argc, char **argv)
+{
+        test_encode();
+        test_log();
+        test_failed_write();
+        test_invalid_file();
+
+        pcx_main_context_free(pcx_main_context_get_default());
+
+        return EXIT_SUCCESS;
+}
@@ -23,6 +23,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
+#include <stdbool.h>
 
 #include "pcx-buffer.h"
 #include "pcx-util.h"
@@ -113,6 +114,57 @@ check_all_added(struct pcx_trie *trie,
         return true;
 }
 
+struct foreach_data {
+        struct pcx_trie *copy;
+        int n_words;
+        bool ret;
+};
+
+static void
+foreach_word_cb(const char *word,
+                void *user_data)
+{
+        struct foreach_data *data = user_data;
+
+        data->n_words++;
+
+        if (pcx_trie_add_word(data->copy, word) !=
+            PCX_TRIE_ADD_RESULT_NEW_WORD) {
+                fprintf(stderr, "“%s” was reported twice\n", word);
+                data->ret = false;
+        }
+}
+
+static bool
+check_foreach(struct pcx_trie *trie,
+              int n_words,
+              struct pcx_buffer *word_buf)
+{
+        struct foreach_data data = {
+                .copy = pcx_trie_new(),
+                .n_words = 0,
+                .ret = true,
+        };
+
+        pcx_trie_foreach_word(trie, foreach_word_cb, &data);
+
+        if (data.ret && data.n_words != n_words) {
+                fprintf(stderr,
+                        "pcx_trie_foreach_word reported %i words but %i "
+                        "were added\n",
+                        data.n_words,
+                        n_words);
+                data.ret = false;
+        }
+
+        if (data.ret && !check_all_added(data.copy, n_words, word_buf))
+                data.ret = false;
+
+        pcx_trie_free(data.copy);
+
+        return data.ret;
+}
+
 int
 main(int argc, char **argv)
 {
@@ -147,6 +199,9 @@ main(int argc, char **argv)
                 }
         }
 
+        if (ret == EXIT_SUCCESS && !check_foreach(trie, n_words, &word_buf))
+                ret = EXIT_FAILURE;
+
         pcx_buffer_destroy(&word_buf);
         pcx_trie_free(trie);
 
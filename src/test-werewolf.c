@@ -3728,6 +3728,170 @@ out:
         return ret;
 }
 
+static bool
+restore_snapshot(struct test_data *data)
+{
+        struct pcx_buffer buf = PCX_BUFFER_STATIC_INIT;
+
+        pcx_werewolf_game.snapshot_cb(data->werewolf, &buf);
+
+        struct pcx_snapshot_reader reader;
+
+        pcx_snapshot_reader_init(&reader, buf.data, buf.length);
+
+        struct pcx_werewolf *restored =
+                pcx_werewolf_game.restore_cb(NULL, /* config */
+                                             &test_message_callbacks,
+                                             &data->message_data,
+                                             PCX_TEXT_LANGUAGE_ENGLISH,
+                                             4, /* n_players */
+                                             test_message_player_names,
+                                             &reader);
+
+        bool ret = true;
+
+        if (restored == NULL) {
+                fprintf(stderr, "Restoring the snapshot failed\n");
+                ret = false;
+        } else {
+                struct pcx_buffer second_buf = PCX_BUFFER_STATIC_INIT;
+
+                pcx_werewolf_game.snapshot_cb(restored, &second_buf);
+
+                if (second_buf.length != buf.length ||
+                    memcmp(second_buf.data, buf.data, buf.length)) {
+                        fprintf(stderr,
+                                "Restored snapshot doesn’t match\n");
+                        ret = false;
+                }
+
+                pcx_buffer_destroy(&second_buf);
+
+                pcx_werewolf_game.free_game_cb(data->werewolf);
+                data->werewolf = restored;
+        }
+
+        /* Truncated data shouldn’t be accepted */
+        if (ret) {
+                pcx_snapshot_reader_init(&reader, buf.data, buf.length - 1);
+
+                struct pcx_werewolf *truncated =
+                        pcx_werewolf_game.restore_cb(NULL, /* config */
+                                                     &test_message_callbacks,
+                                                     &data->message_data,
+                                                     PCX_TEXT_LANGUAGE_ENGLISH,
+                                                     4, /* n_players */
+                                                     test_message_player_names,
+                                                     &reader);
+
+                if (truncated) {
+                        fprintf(stderr,
+                                "Truncated snapshot was restored\n");
+                        pcx_werewolf_game.free_game_cb(truncated);
+                        ret = false;
+                }
+        }
+
+        pcx_buffer_destroy(&buf);
+
+        return ret;
+}
+
+static bool
+test_snapshot_timeout(void)
+{
+        struct test_data *data = start_basic_game(2);
+
+        if (data == NULL)
+                return false;
+
+        bool ret = true;
+
+        test_time_hack_add_time(5);
+
+        if (!restore_snapshot(data)) {
+                ret = false;
+                goto out;
+        }
+
+        /* The restored game should only wait for the rest of the
+         * time before the werewolf phase.
+         */
+        test_time_hack_add_time(4);
+
+        if (!check_idle(data)) {
+                ret = false;
+                goto out;
+        }
+
+        test_time_hack_add_time(2);
+
+        queue_global_message(data,
+                             "🐺 The werewolves wake up and look at each other "
+                             "before going back to sleep.");
+
+        for (int i = 0; i < 2; i++) {
+                queue_private_message(data,
+                                      i,
+                                      "The werewolves in the village are:\n"
+                                      "\n"
+                                      "Alice\n"
+                                      "Bob");
+        }
+
+        if (!check_idle(data)) {
+                ret = false;
+                goto out;
+        }
+
+out:
+        free_test_data(data);
+        return ret;
+}
+
+static bool
+test_snapshot_votes(void)
+{
+        struct test_data *data = skip_to_voting_phase(2);
+
+        if (data == NULL)
+                return false;
+
+        bool ret = true;
+
+        if (!send_simple_vote(data, 0, 1) ||
+            !send_simple_vote(data, 1, 0) ||
+            !send_simple_vote(data, 2, 0) ||
+            !restore_snapshot(data)) {
+                ret = false;
+                goto out;
+        }
+
+        queue_global_message(data,
+                             "Everybody voted! The votes were:\n"
+                             "\n"
+                             "Alice 🐺👉 Bob\n"
+                             "Bob 🐺👉 Alice\n"
+                             "Charles 🧑‍🌾👉 Alice\n"
+                             "David 🧑‍🌾👉 Alice\n"
+                             "\n"
+                             "The village has chosen to sacrifice Alice. Their "
+                             "role was: 🐺 Werewolf\n"
+                             "\n"
+                             "🧑‍🌾 The villagers win! 🧑‍🌾");
+
+        test_message_queue(&data->message_data, TEST_MESSAGE_TYPE_GAME_OVER);
+
+        if (!send_vote(data, 3, 0)) {
+                ret = false;
+                goto out;
+        }
+
+out:
+        free_test_data(data);
+        return ret;
+}
+
 int
 main(int argc, char **argv)
 {
@@ -3877,6 +4041,12 @@ main(int argc, char **argv)
         if (!tanner_wins())
                 ret = EXIT_FAILURE;
 
+        if (!test_snapshot_timeout())
+                ret = EXIT_FAILURE;
+
+        if (!test_snapshot_votes())
+                ret = EXIT_FAILURE;
+
         pcx_main_context_free(pcx_main_context_get_default());
 
         return ret;
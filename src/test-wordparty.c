@@ -61,6 +61,8 @@ struct test_connection {
 
         bool had_player_num;
 
+        uint64_t spectate_id;
+
         struct pcx_list messages;
 };
 
@@ -93,7 +95,9 @@ config_file[] =
         "address=" PCX_STRINGIFY(TEST_PORT) "\n"
         "\n"
         "[general]\n"
-        "log_file=/dev/stderr\n";
+        "log_file=/dev/stderr\n"
+        /* The test sends words faster than the chat limit allows */
+        "chat_rate=0\n";
 
 static const char * const
 valid_words[] = {
@@ -842,8 +846,21 @@ handle_current_player(struct test_harness *harness,
 static bool
 handle_n_lives(struct test_harness *harness,
                int player_num,
-               int n_lives)
+               const char *value)
 {
+        char *tail;
+
+        errno = 0;
+        long n_lives = strtol(value, &tail, 10);
+
+        if (errno || *tail || n_lives < 0 || n_lives > 3) {
+                fprintf(stderr,
+                        "Invalid number of lives received: %s\n",
+                        value);
+                harness->had_error = true;
+                return false;
+        }
+
         harness->connections[player_num].n_lives = n_lives;
 
         return true;
@@ -903,19 +920,8 @@ handle_word_result(struct test_harness *harness,
 static bool
 handle_typed_word(struct test_harness *harness,
                   int player_num,
-                  const char *word,
-                  int word_length)
+                  const char *word)
 {
-        const char *end = memchr(word, '\0', word_length);
-
-        if (end == NULL) {
-                fprintf(stderr,
-                        "Missing zero terminator in typed word "
-                        "command.\n");
-                harness->had_error = true;
-                return false;
-        }
-
         struct test_connection *connection = harness->connections + player_num;
 
         pcx_free(connection->typed_word);
@@ -927,22 +933,22 @@ handle_typed_word(struct test_harness *harness,
 static bool
 handle_letters_used(struct test_harness *harness,
                     int player_num,
-                    const char *data,
-                    int data_length)
+                    const char *value)
 {
-        uint32_t letters_used_le;
+        char *tail;
+
+        errno = 0;
+        unsigned long long letters_used = strtoull(value, &tail, 10);
 
-        if (data_length != sizeof letters_used_le) {
+        if (errno || *tail || letters_used > UINT32_MAX) {
                 fprintf(stderr,
-                        "Invalid letters used sideband data.\n");
+                        "Invalid letters used sideband data: %s\n",
+                        value);
                 harness->had_error = true;
                 return false;
         }
 
-        memcpy(&letters_used_le, data, sizeof letters_used_le);
-
-        harness->connections[player_num].letters_used =
-                PCX_UINT32_FROM_LE(letters_used_le);
+        harness->connections[player_num].letters_used = letters_used;
 
         return true;
 }
@@ -957,56 +963,97 @@ handle_sideband(struct test_connection *connection,
 
         connection->harness->sideband_modified |= UINT64_C(1) << command[1];
 
-        int command_num = command[1];
-
-        if (command_num == 0)
+        switch (command[1]) {
+        case 0:
                 return handle_current_player(connection->harness, command[2]);
-
-        command_num--;
-
-        if (command_num < connection->harness->n_connections) {
-                return handle_n_lives(connection->harness,
-                                      command_num,
-                                      command[2]);
-        }
-
-        command_num -= connection->harness->n_connections;
-
-        if (command_num == 0) {
+        case 1:
                 return handle_syllable(connection->harness,
                                        (const char *) command + 2,
                                        command_length - 2);
-        }
-
-        command_num--;
-
-        if (command_num == 0) {
+        case 2:
                 return handle_word_result(connection->harness,
                                           command[2]);
         }
 
-        command_num--;
+error:
+        fprintf(stderr,
+                "Invalid sideband command received\n");
+        connection->harness->had_error = true;
 
-        if (command_num < connection->harness->n_connections) {
-                return handle_typed_word(connection->harness,
-                                         command_num,
-                                         (const char *) command + 2,
-                                         command_length - 2);
+        return false;
+}
+
+static bool
+handle_sideband_element(struct test_harness *harness,
+                        int data_num,
+                        int player_num,
+                        const char *value)
+{
+        switch (data_num) {
+        case 3:
+                return handle_n_lives(harness, player_num, value);
+        case 4:
+                return handle_typed_word(harness, player_num, value);
+        case 5:
+                return handle_letters_used(harness, player_num, value);
         }
 
-        command_num -= connection->harness->n_connections;
+        fprintf(stderr,
+                "Invalid sideband array received\n");
+        harness->had_error = true;
 
-        if (command_num < connection->harness->n_connections) {
-                return handle_letters_used(connection->harness,
-                                           command_num,
-                                           (const char *) command + 2,
-                                           command_length - 2);
+        return false;
+}
+
+static bool
+handle_sideband_array(struct test_connection *connection,
+                      const uint8_t *command,
+                      size_t command_length)
+{
+        struct test_harness *harness = connection->harness;
+
+        if (command_length < 2 + sizeof (uint16_t))
+                goto error;
+
+        int data_num = command[1];
+        int length = command[2] | (command[3] << 8);
+
+        if (length != harness->n_connections)
+                goto error;
+
+        harness->sideband_modified |= UINT64_C(1) << data_num;
+
+        const uint8_t *p = command + 2 + sizeof (uint16_t);
+        const uint8_t *end = command + command_length;
+
+        while (p < end) {
+                if (end - p < sizeof (uint16_t) + 1)
+                        goto error;
+
+                int index = p[0] | (p[1] << 8);
+
+                p += sizeof (uint16_t);
+
+                const uint8_t *value_end = memchr(p, '\0', end - p);
+
+                if (value_end == NULL || index >= length)
+                        goto error;
+
+                if (!handle_sideband_element(harness,
+                                             data_num,
+                                             index,
+                                             (const char *) p))
+                        return false;
+
+                p = value_end + 1;
         }
 
+        return true;
+
 error:
         fprintf(stderr,
-                "Invalid sideband command received\n");
-        connection->harness->had_error = true;
+                "Invalid sideband array command received\n");
+        harness->had_error = true;
 
         return false;
 }
@@ -1049,6 +1096,25 @@ handle_player_num(struct test_connection *connection,
         return true;
 }
 
+static bool
+handle_spectate_id(struct test_connection *connection,
+                   const uint8_t *command,
+                   size_t command_length)
+{
+        if (command_length != 1 + sizeof (uint64_t)) {
+                fprintf(stderr,
+                        "Invalid spectate ID command received\n");
+                connection->harness->had_error = true;
+                return false;
+        }
+
+        uint64_t id;
+        memcpy(&id, command + 1, sizeof id);
+        connection->spectate_id = PCX_UINT64_FROM_LE(id);
+
+        return true;
+}
+
 static void
 process_commands(struct test_connection *connection)
 {
@@ -1087,12 +1153,28 @@ process_commands(struct test_connection *connection)
                                                      length))
                                         return;
                                 break;
+                        case 0x09:
+                                if (!handle_sideband_array(connection,
+                                                           connection->
+                                                           read_buf +
+                                                           data_start,
+                                                           length))
+                                        return;
+                                break;
                         case 0x07:
                                 if (!handle_player_num(connection,
                                                        connection->read_buf +
                                                        data_start,
                                                        length))
                                         return;
+                                break;
+                        case 0x0a:
+                                if (!handle_spectate_id(connection,
+                                                        connection->read_buf +
+                                                        data_start,
+                                                        length))
+                                        return;
+                                break;
                         }
                 }
 
@@ -1535,7 +1617,7 @@ test_wrong_word(void)
         }
 
         if ((harness->sideband_modified &
-             (UINT64_C(1) << (harness->n_connections + 2))) == 0) {
+             (UINT64_C(1) << 2 /* LAST_RESULT */)) == 0) {
                 fprintf(stderr,
                         "Same result not resent after sending the same "
                         "wrong word twice.\n");
@@ -2390,6 +2472,119 @@ out:
         return ret;
 }
 
+static struct test_connection *
+add_spectator(struct test_harness *harness,
+              uint64_t spectate_id)
+{
+        struct test_connection *spectator = add_connection(harness);
+
+        if (spectator == NULL)
+                return NULL;
+
+        /* The spectator isn’t a player so it shouldn’t be included
+         * when checking the messages that the players receive.
+         */
+        harness->n_connections--;
+
+        if (!negotiate_ws(spectator))
+                return NULL;
+
+        uint8_t spectate_message[3 + sizeof spectate_id + 2] = {
+                0x82, sizeof spectate_message - 2, 0x89,
+        };
+
+        spectate_id = PCX_UINT64_TO_LE(spectate_id);
+        memcpy(spectate_message + 3, &spectate_id, sizeof spectate_id);
+        /* n_messages_received is left as zero */
+
+        if (!write_all(spectator->fd,
+                       spectate_message,
+                       sizeof spectate_message))
+                return NULL;
+
+        spectator->read_source =
+                pcx_main_context_add_poll(NULL,
+                                          spectator->fd,
+                                          PCX_MAIN_CONTEXT_POLL_IN,
+                                          connection_read_cb,
+                                          spectator);
+
+        return spectator;
+}
+
+static bool
+test_spectate(void)
+{
+        struct test_harness *harness = create_harness_with_game(2);
+
+        if (harness == NULL)
+                return false;
+
+        bool ret = true;
+
+        if (!expect_turn_message(harness)) {
+                ret = false;
+                goto out;
+        }
+
+        uint64_t spectate_id = harness->connections[0].spectate_id;
+
+        if (spectate_id == 0 ||
+            spectate_id != harness->connections[1].spectate_id) {
+                fprintf(stderr, "Players didn’t get the same spectate ID\n");
+                ret = false;
+                goto out;
+        }
+
+        struct test_connection *spectator =
+                add_spectator(harness, spectate_id);
+
+        if (spectator == NULL || !sync_with_server(harness)) {
+                ret = false;
+                goto out;
+        }
+
+        if (spectator->had_player_num) {
+                fprintf(stderr, "Spectator received a player number\n");
+                ret = false;
+                goto out;
+        }
+
+        if (spectator->spectate_id != spectate_id) {
+                fprintf(stderr, "Spectator received the wrong spectate ID\n");
+                ret = false;
+                goto out;
+        }
+
+        if (pcx_list_empty(&spectator->messages)) {
+                fprintf(stderr, "Spectator didn’t receive the old messages\n");
+                ret = false;
+                goto out;
+        }
+
+        flush_messages(spectator);
+
+        struct test_connection *start_player =
+                harness->connections + harness->start_player;
+
+        if (!send_word(start_player, "terpomo")) {
+                ret = false;
+                goto out;
+        }
+
+        char expected_chat[] = "<b>?</b>\n\nterpomo";
+        expected_chat[3] = start_player->name[0];
+
+        if (!expect_message_on_connection(spectator, expected_chat)) {
+                ret = false;
+                goto out;
+        }
+
+out:
+        free_harness(harness);
+        return ret;
+}
+
 static bool
 test_one_player(void)
 {
@@ -2505,6 +2700,9 @@ main(int argc, char **argv)
         if (!test_one_player())
                 ret = EXIT_FAILURE;
 
+        if (!test_spectate())
+                ret = EXIT_FAILURE;
+
         pcx_log_close();
 
         pcx_main_context_free(pcx_main_context_get_default());
@@ -122,35 +122,58 @@ ChameleonVisualisation.prototype.splitLine = function(elem, value)
   }
 };
 
-ChameleonVisualisation.prototype.handleSidebandData = function(dataNum, mr)
+ChameleonVisualisation.prototype.removeCover = function()
 {
   if (this.cover) {
     this.svg.removeChild(this.cover);
     this.cover = null;
   }
+};
 
-  if (dataNum == 0) {
-    this.setTextValue(this.topic, mr.getString());
+ChameleonVisualisation.prototype.setWord = function(wordNum, value)
+{
+  if (value == "") {
+    if (this.words[wordNum] !== undefined) {
+      this.svg.removeChild(this.words[wordNum]);
+      delete this.words[wordNum];
+    }
   } else {
-    var wordNum = dataNum - 1;
-    var value = mr.getString();
+    if (this.words[wordNum] === undefined) {
+      var elem =
+          this.createTextElement(ChameleonVisualisation.WORD_FONT_SIZE,
+                                 wordNum % 4 * 25 + 12.5,
+                                 Math.floor(wordNum / 4) * 20 + 30);
+      this.svg.appendChild(elem);
+      this.words[wordNum] = elem;
+    }
 
-    if (value == "") {
-      if (this.words[wordNum] !== undefined) {
-        this.svg.removeChild(this.words[wordNum]);
-        delete this.words[wordNum];
-      }
-    } else {
-      if (this.words[wordNum] === undefined) {
-        var elem =
-            this.createTextElement(ChameleonVisualisation.WORD_FONT_SIZE,
-                                   wordNum % 4 * 25 + 12.5,
-                                   Math.floor(wordNum / 4) * 20 + 30);
-        this.svg.appendChild(elem);
-        this.words[wordNum] = elem;
-      }
+    this.splitLine(this.words[wordNum], value);
+  }
+};
 
-      this.splitLine(this.words[wordNum], value);
-    }
+ChameleonVisualisation.prototype.handleSidebandData = function(dataNum, mr)
+{
+  this.removeCover();
+
+  if (dataNum == 0)
+    this.setTextValue(this.topic, mr.getString());
+};
+
+ChameleonVisualisation.prototype.handleSidebandArray = function(dataNum,
+                                                                length,
+                                                                changes)
+{
+  this.removeCover();
+
+  if (dataNum != 1)
+    return;
+
+  for (var i = 0; i < changes.length; i++)
+    this.setWord(changes[i][0], changes[i][1]);
+
+  /* Remove any words beyond the end of the array */
+  for (var wordNum in this.words) {
+    if (wordNum >= length)
+      this.setWord(wordNum, "");
   }
 };
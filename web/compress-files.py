@@ -0,0 +1,63 @@
+#!/usr/bin/python3
+
+# Pucxobot - A bot and website to play some card games
+# Copyright (C) 2026  Neil Roberts
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Run at install time to put a gzipped copy next to each of the text
+# files in the web directory. The server sends these instead of the
+# original to clients that accept gzip.
+
+import gzip
+import os
+import sys
+
+EXTENSIONS = ('.html', '.js', '.css', '.svg', '.txt')
+
+
+def compress_file(filename):
+    with open(filename, 'rb') as f:
+        data = f.read()
+
+    # Use a fixed time in the header so that reinstalling the same
+    # file gives the same result
+    compressed = gzip.compress(data, compresslevel=9, mtime=0)
+
+    gz_filename = filename + '.gz'
+
+    if len(compressed) >= len(data):
+        if os.path.exists(gz_filename):
+            os.unlink(gz_filename)
+        return
+
+    with open(gz_filename, 'wb') as f:
+        f.write(compressed)
+
+
+def main():
+    web_dir = sys.argv[1]
+    prefix = os.environ.get('MESON_INSTALL_DESTDIR_PREFIX')
+
+    if prefix is not None:
+        web_dir = os.path.join(prefix, web_dir)
+
+    for dirpath, dirnames, filenames in os.walk(web_dir):
+        for filename in filenames:
+            if filename.endswith(EXTENSIONS):
+                compress_file(os.path.join(dirpath, filename))
+
+
+if __name__ == '__main__':
+    main()
@@ -41,10 +41,17 @@ MessageReader.prototype.getString = function()
   return decodeURIComponent(s);
 };
 
+MessageReader.prototype.getUint16 = function()
+{
+  var value = this.dv.getUint16(this.pos, true /* littleEndian */);
+  this.pos += 2;
+  return value;
+};
+
 MessageReader.prototype.getUint32 = function()
 {
   var value = this.dv.getUint32(this.pos, true /* littleEndian */);
-  this.pos++;
+  this.pos += 4;
   return value;
 };
 
@@ -25,6 +25,7 @@ function Pucxo()
   this.playerId = null;
   this.playerName = null;
   this.isPrivate = null;
+  this.spectateLinkShown = false;
   this.messagesDiv = document.getElementById("messages");
   this.reconnectTimeout = null;
   this.numMessagesReceived = 0;
@@ -78,22 +79,58 @@ function Pucxo()
   this.checkHash();
 };
 
+Pucxo.parseId = function(hex)
+{
+  var id = new Uint8Array(8);
+  var i;
+
+  for (i = 0; i < 8; i++)
+    id[i] = parseInt("0x" + hex.substring(i * 2, i * 2 + 2));
+
+  return id;
+};
+
+Pucxo.formatId = function(id)
+{
+  var hex = "";
+  var i;
+
+  for (i = 0; i < 8; i++) {
+    var b = id[i];
+    if (b < 0x10)
+      hex += "0";
+    hex += b.toString(16);
+  }
+
+  return hex;
+};
+
+Pucxo.prototype.getBaseLink = function()
+{
+  return (window.location.protocol + "//" +
+          window.location.host +
+          window.location.pathname + "?");
+};
+
 Pucxo.prototype.checkQueryString = function()
 {
   var search = window.location.search;
 
-  if (!search || search.length != 17) {
-    this.privateGameId = null;
+  this.privateGameId = null;
+  this.spectateId = null;
+
+  if (!search)
+    return;
+
+  if (search.length == 26 && search.startsWith("?spectate=")) {
+    this.spectateId = Pucxo.parseId(search.substring(10));
     return;
   }
 
-  var i;
-  this.privateGameId = new Uint8Array(8);
+  if (search.length != 17)
+    return;
 
-  for (i = 0; i < 8; i++) {
-    this.privateGameId[i] =
-      parseInt("0x" + search.substring(i * 2 + 1, i * 2 + 3));
-  }
+  this.privateGameId = Pucxo.parseId(search.substring(1));
 
   document.getElementById("chosenName").innerText = "@JOIN@";
 };
@@ -207,6 +244,13 @@ Pucxo.prototype.checkHash = function()
 {
   var hash = window.location.hash;
 
+  /* Spectators don’t need to choose a name or a game */
+  if (this.spectateId != null) {
+    document.getElementById("inputContainer").style.display = "none";
+    this.start();
+    return;
+  }
+
   if (!hash || hash == "") {
     this.setWelcomeStep("chooseName");
     return;
@@ -531,6 +575,8 @@ Pucxo.prototype.sockOpenCb = function(e)
 
   if (this.playerId != null) {
     this.sendMessage(0x81, "BW", this.playerId, this.numMessagesReceived);
+  } else if (this.spectateId != null) {
+    this.sendMessage(0x89, "BW", this.spectateId, this.numMessagesReceived);
   } else if (this.privateGameId != null) {
     this.sendMessage(0x87, "sB", this.playerName, this.privateGameId);
   } else {
@@ -646,6 +692,7 @@ Pucxo.prototype.clearMessages = function()
 {
   this.numMessagesReceived = 0;
   this.messagesDiv.innerHTML = "";
+  this.spectateLinkShown = false;
 };
 
 Pucxo.prototype.handlePlayerId = function(mr)
@@ -697,19 +744,7 @@ Pucxo.prototype.handlePrivateGameId = function(mr)
   var textDiv = document.createElement("div");
   textDiv.className = "messageText";
 
-  var link = (window.location.protocol + "//" +
-              window.location.host +
-              window.location.pathname + "?");
-
-  var id = mr.getUint64();
-  var i;
-
-  for (i = 0; i < 8; i++) {
-    var b = id[i];
-    if (b < 0x10)
-      link += "0";
-    link += b.toString(16);
-  }
+  var link = this.getBaseLink() + Pucxo.formatId(mr.getUint64());
 
   var note = ("@PRIVATE_LINK@" +
               "<br><br><a target=\"_blank\" href=\"" + link + "\">" +
@@ -774,12 +809,41 @@ Pucxo.prototype.handleGameType = function(mr)
   }
 };
 
+Pucxo.prototype.handleSpectateId = function(mr)
+{
+  /* Only players get the link and only once */
+  if (this.spectateId != null || this.spectateLinkShown)
+    return;
+
+  this.spectateLinkShown = true;
+
+  var link = (this.getBaseLink() +
+              "spectate=" +
+              Pucxo.formatId(mr.getUint64()));
+
+  this.addServiceNote("@SPECTATE_LINK@" +
+                      "<br><br><a target=\"_blank\" href=\"" + link + "\">" +
+                      link + "</a>");
+};
+
 Pucxo.prototype.handlePrivateGameNotFound = function(e)
 {
+  if (this.spectateId != null) {
+    this.addServiceNote("@SPECTATE_LINK_INVALID@");
+    this.disconnect();
+    return;
+  }
+
   this.addServiceNote("@PRIVATE_LINK_INVALID@");
   this.disconnect();
 };
 
+Pucxo.prototype.handleServerFull = function(mr)
+{
+  this.addServiceNote("@SERVER_FULL@");
+  this.disconnect();
+};
+
 Pucxo.prototype.handlePlayerName = function(mr)
 {
   if (!this.visualisation)
@@ -801,6 +865,34 @@ Pucxo.prototype.handleSidebandData = function(mr)
   this.visualisation.handleSidebandData(dataNum, mr);
 };
 
+Pucxo.prototype.handleSidebandArray = function(mr)
+{
+  if (!this.visualisation || !this.visualisation.handleSidebandArray)
+    return;
+
+  var dataNum = mr.getUint8();
+  var length = mr.getUint16();
+  var changes = [];
+
+  while (!mr.isFinished()) {
+    var index = mr.getUint16();
+    changes.push([index, mr.getString()]);
+  }
+
+  this.visualisation.handleSidebandArray(dataNum, length, changes);
+};
+
+Pucxo.prototype.handleMessagesDropped = function(mr)
+{
+  /* The server has forgotten some of the messages that we haven’t
+   * seen yet. Count them as received so that the numbers still match
+   * if we reconnect again.
+   */
+  this.numMessagesReceived += mr.getUint32();
+
+  this.addServiceNote("@MESSAGES_DROPPED@");
+};
+
 Pucxo.prototype.messageCb = function(e)
 {
   var mr = new MessageReader(new DataView(e.data));
@@ -822,6 +914,14 @@ Pucxo.prototype.messageCb = function(e)
     this.handlePlayerName(mr);
   } else if (msgType == 6) {
     this.handleSidebandData(mr);
+  } else if (msgType == 8) {
+    this.handleMessagesDropped(mr);
+  } else if (msgType == 9) {
+    this.handleSidebandArray(mr);
+  } else if (msgType == 10) {
+    this.handleSpectateId(mr);
+  } else if (msgType == 14) {
+    this.handleServerFull(mr);
   }
 };
 
@@ -250,81 +250,72 @@ WordpartyVisualisation.prototype.handleSidebandData = function(dataNum, mr)
       if (input)
         input.focus();
     }
-
-    return;
-  }
-
-  dataNum--;
-
-  if (dataNum < this.players.length) {
-    var player = this.getPlayer(dataNum);
-    var val = mr.getUint8();
-    var lives;
-
-    if (val == 0) {
-      lives = "☠️";
-    } else {
-      lives = "";
-
-      for (var i = 0; i < val; i++)
-        lives += "❤️";
-    }
-
-    if (player.nLives == val + 1) {
-      this.loseLifeSound.play();
-      player.typedWord.setAttribute("text-decoration", "line-through");
-    } else if (player.nLives == val - 1) {
-      this.gainLifeSound.play();
-      this.setResultIcon(player, "💗️");
-    }
-
-    player.nLives = val;
-
-    var livesElement = player.lives;
-    while (livesElement.lastChild)
-      livesElement.removeChild(livesElement.lastChild);
-    livesElement.appendChild(document.createTextNode(lives));
-
-    return;
-  }
-
-  dataNum -= this.players.length;
-
-  if (dataNum == 0) {
+  } else if (dataNum == 1) {
     while (this.syllable.lastChild)
       this.syllable.removeChild(this.syllable.lastChild);
     this.syllable.appendChild(document.createTextNode(mr.getString()));
-    return;
-  }
-
-  dataNum--;
-
-  if (dataNum == 0) {
+  } else if (dataNum == 2) {
     var val = mr.getUint8();
     this.handleResult(val & 0x0f, val >> 6);
-    return;
   }
+};
 
-  dataNum--;
+WordpartyVisualisation.prototype.setLives = function(playerNum, val)
+{
+  var player = this.getPlayer(playerNum);
+  var lives;
 
-  if (dataNum < this.players.length) {
-    var player = this.getPlayer(dataNum);
+  if (val == 0) {
+    lives = "☠️";
+  } else {
+    lives = "";
 
-    var typedWordElement = player.typedWord;
+    for (var i = 0; i < val; i++)
+      lives += "❤️";
+  }
 
-    while (typedWordElement.lastChild)
-      typedWordElement.removeChild(typedWordElement.lastChild);
-    typedWordElement.appendChild(document.createTextNode(mr.getString()));
-    typedWordElement.removeAttribute("text-decoration", "line-through");
-    return;
+  if (player.nLives == val + 1) {
+    this.loseLifeSound.play();
+    player.typedWord.setAttribute("text-decoration", "line-through");
+  } else if (player.nLives == val - 1) {
+    this.gainLifeSound.play();
+    this.setResultIcon(player, "💗️");
   }
 
-  dataNum -= this.players.length;
+  player.nLives = val;
 
-  if (dataNum < this.players.length) {
-    if (dataNum == this.playerNum)
-      this.updateUsedLetters(mr.getUint32());
-    return;
+  var livesElement = player.lives;
+  while (livesElement.lastChild)
+    livesElement.removeChild(livesElement.lastChild);
+  livesElement.appendChild(document.createTextNode(lives));
+};
+
+WordpartyVisualisation.prototype.setTypedWord = function(playerNum, word)
+{
+  var typedWordElement = this.getPlayer(playerNum).typedWord;
+
+  while (typedWordElement.lastChild)
+    typedWordElement.removeChild(typedWordElement.lastChild);
+  typedWordElement.appendChild(document.createTextNode(word));
+  typedWordElement.removeAttribute("text-decoration", "line-through");
+};
+
+WordpartyVisualisation.prototype.handleSidebandArray = function(dataNum,
+                                                                length,
+                                                                changes)
+{
+  for (var i = 0; i < changes.length; i++) {
+    var playerNum = changes[i][0];
+    var value = changes[i][1];
+
+    if (dataNum == 3) {
+      this.setLives(playerNum, parseInt(value));
+    } else if (dataNum == 4) {
+      this.setTypedWord(playerNum, value);
+    } else if (dataNum == 5) {
+      if (playerNum == this.playerNum)
+        this.updateUsedLetters(parseInt(value));
+    }
   }
 };
 